@@ -106,6 +106,9 @@ asmlinkage void aesni_xts_encrypt(const struct crypto_aes_ctx *ctx, u8 *out,
 asmlinkage void aesni_xts_decrypt(const struct crypto_aes_ctx *ctx, u8 *out,
 				  const u8 *in, unsigned int len, u8 *iv);
 
+typedef void (*xts_crypt_func)(const struct crypto_aes_ctx *ctx, u8 *out,
+			       const u8 *in, unsigned int len, u8 *iv);
+
 #ifdef CONFIG_X86_64
 
 asmlinkage void aesni_ctr_enc(struct crypto_aes_ctx *ctx, u8 *out,
@@ -836,7 +839,7 @@ static int xts_aesni_setkey(struct crypto_skcipher *tfm, const u8 *key,
 				  key + keylen, keylen);
 }
 
-static int xts_crypt(struct skcipher_request *req, bool encrypt)
+static int xts_crypt(struct skcipher_request *req, xts_crypt_func crypt_func)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
 	struct aesni_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
@@ -883,14 +886,8 @@ static int xts_crypt(struct skcipher_request *req, bool encrypt)
 		if (nbytes < walk.total)
 			nbytes &= ~(AES_BLOCK_SIZE - 1);
 
-		if (encrypt)
-			aesni_xts_encrypt(aes_ctx(ctx->raw_crypt_ctx),
-					  walk.dst.virt.addr, walk.src.virt.addr,
-					  nbytes, walk.iv);
-		else
-			aesni_xts_decrypt(aes_ctx(ctx->raw_crypt_ctx),
-					  walk.dst.virt.addr, walk.src.virt.addr,
-					  nbytes, walk.iv);
+		crypt_func(aes_ctx(ctx->raw_crypt_ctx), walk.dst.virt.addr,
+			   walk.src.virt.addr, nbytes, walk.iv);
 		kernel_fpu_end();
 
 		err = skcipher_walk_done(&walk, walk.nbytes - nbytes);
@@ -915,14 +912,8 @@ static int xts_crypt(struct skcipher_request *req, bool encrypt)
 			return err;
 
 		kernel_fpu_begin();
-		if (encrypt)
-			aesni_xts_encrypt(aes_ctx(ctx->raw_crypt_ctx),
-					  walk.dst.virt.addr, walk.src.virt.addr,
-					  walk.nbytes, walk.iv);
-		else
-			aesni_xts_decrypt(aes_ctx(ctx->raw_crypt_ctx),
-					  walk.dst.virt.addr, walk.src.virt.addr,
-					  walk.nbytes, walk.iv);
+		crypt_func(aes_ctx(ctx->raw_crypt_ctx), walk.dst.virt.addr,
+			   walk.src.virt.addr, walk.nbytes, walk.iv);
 		kernel_fpu_end();
 
 		err = skcipher_walk_done(&walk, 0);
@@ -932,14 +923,67 @@ static int xts_crypt(struct skcipher_request *req, bool encrypt)
 
 static int xts_encrypt(struct skcipher_request *req)
 {
-	return xts_crypt(req, true);
+	return xts_crypt(req, aesni_xts_encrypt);
 }
 
 static int xts_decrypt(struct skcipher_request *req)
 {
-	return xts_crypt(req, false);
+	return xts_crypt(req, aesni_xts_decrypt);
+}
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX512)
+asmlinkage void aes_xts_encrypt_vaes_avx512(const struct crypto_aes_ctx *ctx,
+					    u8 *out, const u8 *in,
+					    unsigned int len, u8 *iv);
+asmlinkage void aes_xts_decrypt_vaes_avx512(const struct crypto_aes_ctx *ctx,
+					    u8 *out, const u8 *in,
+					    unsigned int len, u8 *iv);
+
+/*
+ * The VAES code only does whole blocks.  If there is a partial block at the
+ * end, hold back the last full block as well and let the AES-NI code do the
+ * ciphertext stealing over those two.
+ */
+static unsigned int xts_vaes_bulk_len(unsigned int len)
+{
+	unsigned int bulk = round_down(len, AES_BLOCK_SIZE);
+
+	if (bulk != len)
+		bulk -= AES_BLOCK_SIZE;
+	return bulk;
 }
 
+static void xts_encrypt_vaes_avx512(const struct crypto_aes_ctx *ctx, u8 *out,
+				    const u8 *in, unsigned int len, u8 *iv)
+{
+	unsigned int bulk = xts_vaes_bulk_len(len);
+
+	aes_xts_encrypt_vaes_avx512(ctx, out, in, bulk, iv);
+	if (bulk != len)
+		aesni_xts_encrypt(ctx, out + bulk, in + bulk, len - bulk, iv);
+}
+
+static void xts_decrypt_vaes_avx512(const struct crypto_aes_ctx *ctx, u8 *out,
+				    const u8 *in, unsigned int len, u8 *iv)
+{
+	unsigned int bulk = xts_vaes_bulk_len(len);
+
+	aes_xts_decrypt_vaes_avx512(ctx, out, in, bulk, iv);
+	if (bulk != len)
+		aesni_xts_decrypt(ctx, out + bulk, in + bulk, len - bulk, iv);
+}
+
+static int xts_encrypt_vaes(struct skcipher_request *req)
+{
+	return xts_crypt(req, xts_encrypt_vaes_avx512);
+}
+
+static int xts_decrypt_vaes(struct skcipher_request *req)
+{
+	return xts_crypt(req, xts_decrypt_vaes_avx512);
+}
+#endif
+
 static struct crypto_alg aesni_cipher_alg = {
 	.cra_name		= "aes",
 	.cra_driver_name	= "aes-aesni",
@@ -1050,6 +1094,67 @@ static struct skcipher_alg aesni_skciphers[] = {
 static
 struct simd_skcipher_alg *aesni_simd_skciphers[ARRAY_SIZE(aesni_skciphers)];
 
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX512)
+static struct skcipher_alg aes_xts_vaes_skciphers[] = {
+	{
+		.base = {
+			.cra_name		= "__xts(aes)",
+			.cra_driver_name	= "__xts-aes-vaes-avx512",
+			.cra_priority		= 800,
+			.cra_flags		= CRYPTO_ALG_INTERNAL,
+			.cra_blocksize		= AES_BLOCK_SIZE,
+			.cra_ctxsize		= XTS_AES_CTX_SIZE,
+			.cra_module		= THIS_MODULE,
+		},
+		.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+		.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.walksize	= 2 * AES_BLOCK_SIZE,
+		.setkey		= xts_aesni_setkey,
+		.encrypt	= xts_encrypt_vaes,
+		.decrypt	= xts_decrypt_vaes,
+	}
+};
+
+static struct simd_skcipher_alg *
+aes_xts_vaes_simd_skciphers[ARRAY_SIZE(aes_xts_vaes_skciphers)];
+
+static int __init register_xts_vaes_avx512(void)
+{
+	if (!boot_cpu_has(X86_FEATURE_VAES) ||
+	    !boot_cpu_has(X86_FEATURE_VPCLMULQDQ) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512F) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512VL) ||
+	    !boot_cpu_has(X86_FEATURE_AVX512BW) ||
+	    !cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+			       XFEATURE_MASK_AVX512, NULL))
+		return 0;
+
+	pr_info("VAES/AVX-512 version of xts(aes) engaged.\n");
+	return simd_register_skciphers_compat(aes_xts_vaes_skciphers,
+					      ARRAY_SIZE(aes_xts_vaes_skciphers),
+					      aes_xts_vaes_simd_skciphers);
+}
+
+static void unregister_xts_vaes_avx512(void)
+{
+	/* Only registered on CPUs that passed the checks above */
+	if (aes_xts_vaes_simd_skciphers[0])
+		simd_unregister_skciphers(aes_xts_vaes_skciphers,
+					  ARRAY_SIZE(aes_xts_vaes_skciphers),
+					  aes_xts_vaes_simd_skciphers);
+}
+#else
+static inline int register_xts_vaes_avx512(void)
+{
+	return 0;
+}
+
+static inline void unregister_xts_vaes_avx512(void)
+{
+}
+#endif
+
 #ifdef CONFIG_X86_64
 static int generic_gcmaes_set_key(struct crypto_aead *aead, const u8 *key,
 				  unsigned int key_len)
@@ -1180,8 +1285,15 @@ static int __init aesni_init(void)
 	if (err)
 		goto unregister_skciphers;
 
+	err = register_xts_vaes_avx512();
+	if (err)
+		goto unregister_aeads;
+
 	return 0;
 
+unregister_aeads:
+	simd_unregister_aeads(aesni_aeads, ARRAY_SIZE(aesni_aeads),
+			      aesni_simd_aeads);
 unregister_skciphers:
 	simd_unregister_skciphers(aesni_skciphers, ARRAY_SIZE(aesni_skciphers),
 				  aesni_simd_skciphers);
@@ -1192,6 +1304,7 @@ static int __init aesni_init(void)
 
 static void __exit aesni_exit(void)
 {
+	unregister_xts_vaes_avx512();
 	simd_unregister_aeads(aesni_aeads, ARRAY_SIZE(aesni_aeads),
 			      aesni_simd_aeads);
 	simd_unregister_skciphers(aesni_skciphers, ARRAY_SIZE(aesni_skciphers),
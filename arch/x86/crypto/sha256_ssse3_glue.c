@@ -314,13 +314,104 @@ static int sha256_ni_final(struct shash_desc *desc, u8 *out)
 	return sha256_ni_finup(desc, NULL, 0, out);
 }
 
+asmlinkage void sha256_ni_transform2x(u32 *digest1, u32 *digest2,
+				      const u8 *data1, const u8 *data2,
+				      int blocks);
+
+/*
+ * Finish two messages that continue from the same state.  The whole blocks
+ * are hashed straight from @data, only the block completing a partial
+ * sctx->buf and the padded final block(s) are staged on the stack.
+ */
+static void sha256_ni_finup2x(const struct sha256_state *sctx,
+			      const u8 * const data[2], unsigned int len,
+			      u8 * const outs[2], unsigned int digestsize)
+{
+	unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+	u64 bitlen = (sctx->count + len) << 3;
+	u8 blocks[2][2 * SHA256_BLOCK_SIZE];
+	u32 state[2][SHA256_DIGEST_SIZE / 4];
+	const u8 *src[2] = { data[0], data[1] };
+	unsigned int nblocks, tail, i, j;
+
+	memcpy(state[0], sctx->state, sizeof(state[0]));
+	memcpy(state[1], sctx->state, sizeof(state[1]));
+
+	if (partial && partial + len >= SHA256_BLOCK_SIZE) {
+		unsigned int n = SHA256_BLOCK_SIZE - partial;
+
+		for (i = 0; i < 2; i++) {
+			memcpy(blocks[i], sctx->buf, partial);
+			memcpy(&blocks[i][partial], src[i], n);
+			src[i] += n;
+		}
+		sha256_ni_transform2x(state[0], state[1], blocks[0], blocks[1],
+				      1);
+		len -= n;
+		partial = 0;
+	}
+
+	nblocks = len / SHA256_BLOCK_SIZE;
+	if (nblocks) {
+		sha256_ni_transform2x(state[0], state[1], src[0], src[1],
+				      nblocks);
+		src[0] += nblocks * SHA256_BLOCK_SIZE;
+		src[1] += nblocks * SHA256_BLOCK_SIZE;
+		len %= SHA256_BLOCK_SIZE;
+	}
+
+	/* What is left fits in one block, plus one more for the padding */
+	tail = partial + len;
+	nblocks = tail + 1 + sizeof(__be64) > SHA256_BLOCK_SIZE ? 2 : 1;
+	for (i = 0; i < 2; i++) {
+		u8 *end = &blocks[i][nblocks * SHA256_BLOCK_SIZE];
+
+		memcpy(blocks[i], sctx->buf, partial);
+		memcpy(&blocks[i][partial], src[i], len);
+		blocks[i][tail] = 0x80;
+		memset(&blocks[i][tail + 1], 0,
+		       end - sizeof(__be64) - &blocks[i][tail + 1]);
+		put_unaligned_be64(bitlen, end - sizeof(__be64));
+	}
+	sha256_ni_transform2x(state[0], state[1], blocks[0], blocks[1],
+			      nblocks);
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < digestsize / 4; j++)
+			put_unaligned_be32(state[i][j], outs[i] + 4 * j);
+
+	memzero_explicit(blocks, sizeof(blocks));
+	memzero_explicit(state, sizeof(state));
+}
+
+static int sha256_ni_finup_mb(struct shash_desc *desc,
+			      const u8 * const data[], unsigned int len,
+			      u8 * const outs[], unsigned int num_msgs)
+{
+	/* The API only calls in with 2 <= num_msgs <= mb_max_msgs */
+	if (WARN_ON_ONCE(num_msgs != 2))
+		return -EOPNOTSUPP;
+
+	if (!crypto_simd_usable())
+		return -EOPNOTSUPP;
+
+	kernel_fpu_begin();
+	sha256_ni_finup2x(shash_desc_ctx(desc), data, len, outs,
+			  crypto_shash_digestsize(desc->tfm));
+	kernel_fpu_end();
+
+	return 0;
+}
+
 static struct shash_alg sha256_ni_algs[] = { {
 	.digestsize	=	SHA256_DIGEST_SIZE,
 	.init		=	sha256_base_init,
 	.update		=	sha256_ni_update,
 	.final		=	sha256_ni_final,
 	.finup		=	sha256_ni_finup,
+	.finup_mb	=	sha256_ni_finup_mb,
 	.descsize	=	sizeof(struct sha256_state),
+	.mb_max_msgs	=	2,
 	.base		=	{
 		.cra_name	=	"sha256",
 		.cra_driver_name =	"sha256-ni",
@@ -334,7 +425,9 @@ static struct shash_alg sha256_ni_algs[] = { {
 	.update		=	sha256_ni_update,
 	.final		=	sha256_ni_final,
 	.finup		=	sha256_ni_finup,
+	.finup_mb	=	sha256_ni_finup_mb,
 	.descsize	=	sizeof(struct sha256_state),
+	.mb_max_msgs	=	2,
 	.base		=	{
 		.cra_name	=	"sha224",
 		.cra_driver_name =	"sha224-ni",
@@ -146,6 +146,9 @@
 #define KVM_NR_FIXED_MTRR_REGION 88
 #define KVM_NR_VAR_MTRR 8
 
+/* Log2 buckets of nanoseconds for the per-class VM-Exit handling time */
+#define KVM_EXIT_HIST_COUNT 32
+
 #define ASYNC_PF_PER_VCPU 64
 
 enum kvm_reg {
@@ -884,6 +887,9 @@ struct kvm_vcpu_arch {
 	/* Host CPU on which VM-entry was most recently attempted */
 	int last_vmentry_cpu;
 
+	/* enum kvm_exit_class of the VM-Exit being handled */
+	u8 exit_class;
+
 	/* AMD MSRC001_0015 Hardware Configuration */
 	u64 msr_hwcr;
 
@@ -1276,6 +1282,15 @@ struct kvm_vcpu_stat {
 	u64 preemption_reported;
 	u64 preemption_other;
 	u64 guest_mode;
+	u64 exit_other_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_emulation_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_page_fault_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_io_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_mmio_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_msr_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_cpuid_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_halt_hist[KVM_EXIT_HIST_COUNT];
+	u64 exit_hypercall_hist[KVM_EXIT_HIST_COUNT];
 };
 
 struct x86_instruction_info;
@@ -1578,6 +1593,9 @@ void kvm_mmu_reset_context(struct kvm_vcpu *vcpu);
 void kvm_mmu_slot_remove_write_access(struct kvm *kvm,
 				      const struct kvm_memory_slot *memslot,
 				      int start_level);
+void kvm_mmu_slot_try_split_huge_pages(struct kvm *kvm,
+				       const struct kvm_memory_slot *memslot,
+				       int target_level);
 void kvm_mmu_zap_collapsible_sptes(struct kvm *kvm,
 				   const struct kvm_memory_slot *memslot);
 void kvm_mmu_slot_leaf_clear_dirty(struct kvm *kvm,
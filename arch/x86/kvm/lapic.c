@@ -1843,6 +1843,26 @@ bool kvm_lapic_hv_timer_in_use(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL_GPL(kvm_lapic_hv_timer_in_use);
 
+/*
+ * Time left until the software timer fires, U64_MAX if it's not armed.  The
+ * hv timer is switched to the software timer before the vCPU blocks.
+ */
+u64 kvm_lapic_timer_remaining_ns(struct kvm_vcpu *vcpu)
+{
+	struct kvm_timer *ktimer;
+	s64 remaining;
+
+	if (!lapic_in_kernel(vcpu))
+		return U64_MAX;
+
+	ktimer = &vcpu->arch.apic->lapic_timer;
+	if (ktimer->hv_timer_in_use || !hrtimer_active(&ktimer->timer))
+		return U64_MAX;
+
+	remaining = ktime_to_ns(hrtimer_get_remaining(&ktimer->timer));
+	return max_t(s64, remaining, 0);
+}
+
 static void cancel_hv_timer(struct kvm_lapic *apic)
 {
 	WARN_ON(preemptible());
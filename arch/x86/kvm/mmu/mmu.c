@@ -5281,6 +5281,8 @@ int kvm_mmu_page_fault(struct kvm_vcpu *vcpu, gpa_t cr2_or_gpa, u64 error_code,
 	if (WARN_ON(!VALID_PAGE(vcpu->arch.mmu->root_hpa)))
 		return RET_PF_RETRY;
 
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_PAGE_FAULT);
+
 	r = RET_PF_INVALID;
 	if (unlikely(error_code & PFERR_RSVD_MASK)) {
 		r = handle_mmio_page_fault(vcpu, cr2_or_gpa, direct);
@@ -5763,15 +5765,22 @@ void kvm_zap_gfn_range(struct kvm *kvm, gfn_t gfn_start, gfn_t gfn_end)
 							   gfn_end - gfn_start);
 	}
 
+	/*
+	 * The elevated notifier count keeps vCPUs from faulting the range
+	 * back in, so the TDP MMU can zap it with mmu_lock held for read and
+	 * let the faults outside of the range proceed meanwhile.
+	 */
 	if (is_tdp_mmu_enabled(kvm)) {
+		write_unlock(&kvm->mmu_lock);
+		read_lock(&kvm->mmu_lock);
+
 		for (i = 0; i < KVM_ADDRESS_SPACE_NUM; i++)
-			flush = kvm_tdp_mmu_zap_gfn_range(kvm, i, gfn_start,
-							  gfn_end, flush);
-	}
+			kvm_tdp_mmu_zap_gfn_range_shared(kvm, i, gfn_start,
+							 gfn_end);
 
-	if (flush)
-		kvm_flush_remote_tlbs_with_address(kvm, gfn_start,
-						   gfn_end - gfn_start);
+		read_unlock(&kvm->mmu_lock);
+		write_lock(&kvm->mmu_lock);
+	}
 
 	kvm_dec_notifier_count(kvm, gfn_start, gfn_end);
 
@@ -5785,6 +5794,32 @@ static bool slot_rmap_write_protect(struct kvm *kvm,
 	return __rmap_write_protect(kvm, rmap_head, false);
 }
 
+/* Must be called with the mmu_lock not held. */
+void kvm_mmu_slot_try_split_huge_pages(struct kvm *kvm,
+				       const struct kvm_memory_slot *memslot,
+				       int target_level)
+{
+	u64 start = memslot->base_gfn;
+	u64 end = start + memslot->npages;
+
+	/*
+	 * Only the TDP MMU can split without vCPU caches, huge pages of the
+	 * shadow MMU keep being split on write faults.
+	 */
+	if (is_tdp_mmu_enabled(kvm)) {
+		read_lock(&kvm->mmu_lock);
+		kvm_tdp_mmu_try_split_huge_pages(kvm, memslot, start, end,
+						 target_level);
+		read_unlock(&kvm->mmu_lock);
+	}
+
+	/*
+	 * No TLB flush is needed here, the split SPTEs map the same memory
+	 * with the same permissions as the huge page they replace. The write
+	 * protection or dirty bit clearing that follows flushes.
+	 */
+}
+
 void kvm_mmu_slot_remove_write_access(struct kvm *kvm,
 				      const struct kvm_memory_slot *memslot,
 				      int start_level)
@@ -6234,10 +6269,25 @@ static void kvm_recover_nx_lpages(struct kvm *kvm)
 	ulong to_zap;
 
 	rcu_idx = srcu_read_lock(&kvm->srcu);
-	write_lock(&kvm->mmu_lock);
 
 	ratio = READ_ONCE(nx_huge_pages_recovery_ratio);
 	to_zap = ratio ? DIV_ROUND_UP(nx_lpage_splits, ratio) : 0;
+
+	/*
+	 * TDP MMU pages can be zapped with mmu_lock held for read, leave only
+	 * the shadow MMU pages (e.g. for nested guests) to the write side.
+	 */
+	if (is_tdp_mmu_enabled(kvm)) {
+		read_lock(&kvm->mmu_lock);
+		to_zap = kvm_tdp_mmu_recover_nx_lpages(kvm, to_zap);
+		read_unlock(&kvm->mmu_lock);
+
+		if (!to_zap)
+			goto out;
+	}
+
+	write_lock(&kvm->mmu_lock);
+
 	for ( ; to_zap; --to_zap) {
 		if (list_empty(&kvm->arch.lpage_disallowed_mmu_pages))
 			break;
@@ -6267,6 +6317,7 @@ static void kvm_recover_nx_lpages(struct kvm *kvm)
 	kvm_mmu_remote_flush_or_zap(kvm, &invalid_list, flush);
 
 	write_unlock(&kvm->mmu_lock);
+out:
 	srcu_read_unlock(&kvm->srcu, rcu_idx);
 }
 
@@ -183,6 +183,49 @@ int make_spte(struct kvm_vcpu *vcpu, unsigned int pte_access, int level,
 	return ret;
 }
 
+/*
+ * Construct an SPTE that maps the index'th sub-page of the given huge page
+ * SPTE, one level down. Used to fill the page table replacing a huge page
+ * that gets split.
+ */
+u64 make_huge_page_split_spte(u64 huge_spte, int huge_level, int index)
+{
+	u64 child_spte;
+	int child_level;
+
+	if (WARN_ON_ONCE(!is_shadow_present_pte(huge_spte)))
+		return 0;
+
+	if (WARN_ON_ONCE(!is_large_pte(huge_spte)))
+		return 0;
+
+	child_spte = huge_spte;
+	child_level = huge_level - 1;
+
+	/*
+	 * The child SPTE already has the base address of the huge page being
+	 * split, add the offset of the index'th page of the lower level.
+	 */
+	child_spte |= (u64)(index * KVM_PAGES_PER_HPAGE(child_level)) << PAGE_SHIFT;
+
+	if (child_level == PG_LEVEL_4K) {
+		child_spte &= ~PT_PAGE_SIZE_MASK;
+
+		/*
+		 * The NX huge page mitigation doesn't apply to 4K pages, make
+		 * them executable. Access-tracked SPTEs are left alone, the
+		 * fault restoring them sets up the executable bit too.
+		 */
+		if (is_nx_huge_page_enabled() &&
+		    !is_access_track_spte(child_spte)) {
+			child_spte &= ~shadow_nx_mask;
+			child_spte |= shadow_x_mask;
+		}
+	}
+
+	return child_spte;
+}
+
 u64 make_nonleaf_spte(u64 *child_pt, bool ad_disabled)
 {
 	u64 spte = SPTE_MMU_PRESENT_MASK;
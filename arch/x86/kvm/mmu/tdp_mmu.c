@@ -835,6 +835,72 @@ bool __kvm_tdp_mmu_zap_gfn_range(struct kvm *kvm, int as_id, gfn_t start,
 	return flush;
 }
 
+/*
+ * Same as kvm_tdp_mmu_zap_gfn_range(), but with the MMU lock held in read
+ * mode.  The SPTEs are zapped atomically and the TLBs are flushed as they
+ * are zapped, so nothing is left for the caller to flush.  The removed page
+ * tables are freed after an RCU grace period.
+ *
+ * The caller must keep the range from being faulted in again, e.g. by
+ * elevating mmu_notifier_count, if it needs the range to be empty on return.
+ */
+void kvm_tdp_mmu_zap_gfn_range_shared(struct kvm *kvm, int as_id, gfn_t start,
+				      gfn_t end)
+{
+	struct kvm_mmu_page *root;
+
+	lockdep_assert_held_read(&kvm->mmu_lock);
+
+	for_each_tdp_mmu_root_yield_safe(kvm, root, as_id, true)
+		zap_gfn_range(kvm, root, start, end, true, false, true);
+}
+
+/*
+ * Zap up to @to_zap of the pages on lpage_disallowed_mmu_pages, so that the
+ * NX huge pages can be recovered without stalling the vCPUs' page faults.
+ * Must be called with the MMU lock held in read mode.
+ *
+ * Returns the number of pages that are left to zap.  That is nonzero only
+ * if the list has a shadow MMU page at its head; those can only be zapped
+ * with the MMU lock held in write mode.
+ */
+ulong kvm_tdp_mmu_recover_nx_lpages(struct kvm *kvm, ulong to_zap)
+{
+	struct kvm_mmu_page *sp;
+	gfn_t start, end;
+	int as_id;
+
+	lockdep_assert_held_read(&kvm->mmu_lock);
+
+	for ( ; to_zap; --to_zap) {
+		spin_lock(&kvm->arch.tdp_mmu_pages_lock);
+		sp = list_first_entry_or_null(&kvm->arch.lpage_disallowed_mmu_pages,
+					      struct kvm_mmu_page,
+					      lpage_disallowed_link);
+		if (!sp || !is_tdp_mmu_page(sp)) {
+			spin_unlock(&kvm->arch.tdp_mmu_pages_lock);
+			return sp ? to_zap : 0;
+		}
+
+		/*
+		 * The page can be freed as soon as the lock is dropped, by
+		 * whoever zaps it first, so only its range is used below.
+		 */
+		WARN_ON_ONCE(!sp->lpage_disallowed);
+		start = sp->gfn;
+		end = sp->gfn + KVM_PAGES_PER_HPAGE(sp->role.level + 1);
+		as_id = kvm_mmu_page_as_id(sp);
+		spin_unlock(&kvm->arch.tdp_mmu_pages_lock);
+
+		/* Zapping the parent SPTE unlinks the page from the list. */
+		kvm_tdp_mmu_zap_gfn_range_shared(kvm, as_id, start, end);
+
+		cond_resched_rwlock_read(&kvm->mmu_lock);
+	}
+
+	return 0;
+}
+
 void kvm_tdp_mmu_zap_all(struct kvm *kvm)
 {
 	bool flush = false;
@@ -1290,6 +1356,198 @@ bool kvm_tdp_mmu_wrprot_slot(struct kvm *kvm,
 	return spte_set;
 }
 
+static struct kvm_mmu_page *__tdp_mmu_alloc_sp_for_split(gfp_t gfp)
+{
+	struct kvm_mmu_page *sp;
+
+	gfp |= __GFP_ZERO;
+
+	sp = kmem_cache_alloc(mmu_page_header_cache, gfp);
+	if (!sp)
+		return NULL;
+
+	sp->spt = (void *)__get_free_page(gfp);
+	if (!sp->spt) {
+		kmem_cache_free(mmu_page_header_cache, sp);
+		return NULL;
+	}
+
+	return sp;
+}
+
+static struct kvm_mmu_page *tdp_mmu_alloc_sp_for_split(struct kvm *kvm,
+						       struct tdp_iter *iter)
+{
+	struct kvm_mmu_page *sp;
+
+	lockdep_assert_held_read(&kvm->mmu_lock);
+
+	/*
+	 * There are no vCPU caches to allocate from here, and the MMU lock is
+	 * held, so don't enter direct reclaim, which could end up in the MMU
+	 * notifiers. If that fails, drop the lock and retry with reclaim
+	 * allowed.
+	 */
+	sp = __tdp_mmu_alloc_sp_for_split(GFP_NOWAIT | __GFP_ACCOUNT);
+	if (sp)
+		return sp;
+
+	rcu_read_unlock();
+	read_unlock(&kvm->mmu_lock);
+
+	iter->yielded = true;
+	sp = __tdp_mmu_alloc_sp_for_split(GFP_KERNEL_ACCOUNT);
+
+	read_lock(&kvm->mmu_lock);
+	rcu_read_lock();
+
+	return sp;
+}
+
+/*
+ * Replace the huge page SPTE at iter with a page table of SPTEs mapping the
+ * same memory one level down, with the same permissions. Returns false if
+ * the SPTE changed under us, in which case sp is left unused.
+ */
+static bool tdp_mmu_split_huge_page(struct kvm *kvm, struct tdp_iter *iter,
+				    struct kvm_mmu_page *sp)
+{
+	struct kvm_mmu_page *parent = sptep_to_sp(rcu_dereference(iter->sptep));
+	const u64 huge_spte = iter->old_spte;
+	const int level = iter->level;
+	int i;
+
+	sp->role = parent->role;
+	sp->role.level = level - 1;
+	sp->gfn = iter->gfn;
+	sp->tdp_mmu_page = true;
+	set_page_private(virt_to_page(sp->spt), (unsigned long)sp);
+
+	/*
+	 * No atomics needed to fill sp->spt, the page table isn't reachable
+	 * until it's linked below.
+	 */
+	for (i = 0; i < PT64_ENT_PER_PAGE; i++)
+		sp->spt[i] = make_huge_page_split_spte(huge_spte, level, i);
+
+	/*
+	 * Replace the huge SPTE without flushing the TLBs: vCPUs see a mix of
+	 * the huge mapping and the split ones until the next flush, which is
+	 * fine since both translate the same way. The caller write-protects
+	 * or clears the dirty bits of the split SPTEs and flushes afterwards.
+	 */
+	if (!tdp_mmu_set_spte_atomic_no_dirty_log(kvm, iter,
+						  make_nonleaf_spte(sp->spt,
+								    !shadow_accessed_mask))) {
+		trace_kvm_mmu_split_huge_page(iter->gfn, huge_spte, level, -EBUSY);
+		return false;
+	}
+
+	tdp_mmu_link_page(kvm, sp, false);
+	trace_kvm_mmu_get_page(sp, true);
+
+	/*
+	 * __handle_changed_spte() accounted for the huge page going away, the
+	 * children replacing it are new.
+	 */
+	kvm_update_page_stats(kvm, level - 1, PT64_ENT_PER_PAGE);
+
+	trace_kvm_mmu_split_huge_page(iter->gfn, huge_spte, level, 0);
+	return true;
+}
+
+static int tdp_mmu_split_huge_pages_root(struct kvm *kvm,
+					 struct kvm_mmu_page *root,
+					 gfn_t start, gfn_t end,
+					 int target_level)
+{
+	struct kvm_mmu_page *sp = NULL;
+	struct tdp_iter iter;
+	int ret = 0;
+
+	rcu_read_lock();
+
+	/*
+	 * Split all huge pages above the target level into pages of the next
+	 * level down. The walk is pre-order, so the SPTEs of a page table
+	 * linked here are visited next, and a 1G page is split all the way
+	 * down to the target level in one pass.
+	 */
+	for_each_tdp_pte_min_level(iter, root->spt, root->role.level,
+				   target_level + 1, start, end) {
+retry:
+		if (tdp_mmu_iter_cond_resched(kvm, &iter, false, true))
+			continue;
+
+		if (!is_shadow_present_pte(iter.old_spte) ||
+		    !is_large_pte(iter.old_spte))
+			continue;
+
+		if (!sp) {
+			sp = tdp_mmu_alloc_sp_for_split(kvm, &iter);
+			if (!sp) {
+				ret = -ENOMEM;
+				trace_kvm_mmu_split_huge_page(iter.gfn,
+							      iter.old_spte,
+							      iter.level, ret);
+				break;
+			}
+
+			/* the MMU lock was dropped, restart from the root */
+			if (iter.yielded)
+				continue;
+		}
+
+		if (!tdp_mmu_split_huge_page(kvm, &iter, sp)) {
+			/*
+			 * The iter must explicitly re-read the SPTE because
+			 * the atomic cmpxchg failed.
+			 */
+			iter.old_spte = READ_ONCE(*rcu_dereference(iter.sptep));
+			goto retry;
+		}
+
+		sp = NULL;
+	}
+
+	rcu_read_unlock();
+
+	/*
+	 * The last page table can go unused, e.g. if a vCPU fault zapped the
+	 * huge page first.
+	 */
+	if (sp)
+		tdp_mmu_free_sp(sp);
+
+	return ret;
+}
+
+/*
+ * Split the huge pages mapping GFNs [start, end) of the memslot down to
+ * target_level. The MMU lock is held for read, so vCPUs can keep faulting
+ * in meanwhile. Best effort: this stops at the first allocation failure,
+ * and pages it didn't split get split on their next write fault as before.
+ */
+void kvm_tdp_mmu_try_split_huge_pages(struct kvm *kvm,
+				      const struct kvm_memory_slot *slot,
+				      gfn_t start, gfn_t end,
+				      int target_level)
+{
+	struct kvm_mmu_page *root;
+	int r;
+
+	lockdep_assert_held_read(&kvm->mmu_lock);
+
+	for_each_valid_tdp_mmu_root_yield_safe(kvm, root, slot->as_id, true) {
+		r = tdp_mmu_split_huge_pages_root(kvm, root, start, end,
+						  target_level);
+		if (r) {
+			kvm_tdp_mmu_put_root(kvm, root, true);
+			break;
+		}
+	}
+}
+
 /*
  * Clear the dirty status of all the SPTEs mapping GFNs in the memslot. If
  * AD bits are enabled, this will involve clearing the dirty bit on each SPTE.
@@ -219,6 +219,9 @@ EXPORT_SYMBOL_GPL(allow_smaller_maxphyaddr);
 bool __read_mostly enable_apicv = true;
 EXPORT_SYMBOL_GPL(enable_apicv);
 
+bool __read_mostly eager_page_split = true;
+module_param(eager_page_split, bool, 0644);
+
 u64 __read_mostly host_xss;
 EXPORT_SYMBOL_GPL(host_xss);
 u64 __read_mostly supported_xss;
@@ -279,7 +282,25 @@ const struct _kvm_stats_desc kvm_vcpu_stats_desc[] = {
 	STATS_DESC_COUNTER(VCPU, directed_yield_successful),
 	STATS_DESC_COUNTER(VCPU, preemption_reported),
 	STATS_DESC_COUNTER(VCPU, preemption_other),
-	STATS_DESC_ICOUNTER(VCPU, guest_mode)
+	STATS_DESC_ICOUNTER(VCPU, guest_mode),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_other_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_emulation_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_page_fault_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_io_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_mmio_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_msr_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_cpuid_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_halt_hist,
+			KVM_EXIT_HIST_COUNT),
+	STATS_DESC_LOGHIST_TIME_NSEC(VCPU, exit_hypercall_hist,
+			KVM_EXIT_HIST_COUNT)
 };
 
 const struct kvm_stats_header kvm_vcpu_stats_header = {
@@ -1906,6 +1927,8 @@ int kvm_emulate_rdmsr(struct kvm_vcpu *vcpu)
 	u64 data;
 	int r;
 
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_MSR);
+
 	r = kvm_get_msr(vcpu, ecx, &data);
 
 	/* MSR read failed? See if we should ask user space */
@@ -1933,6 +1956,8 @@ int kvm_emulate_wrmsr(struct kvm_vcpu *vcpu)
 	u64 data = kvm_read_edx_eax(vcpu);
 	int r;
 
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_MSR);
+
 	r = kvm_set_msr(vcpu, ecx, data);
 
 	/* MSR write failed? See if we should ask user space */
@@ -8048,6 +8073,7 @@ int x86_decode_emulated_instruction(struct kvm_vcpu *vcpu, int emulation_type,
 
 	trace_kvm_emulate_insn_start(vcpu);
 	++vcpu->stat.insn_emulation;
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_EMULATION);
 
 	return r;
 }
@@ -8177,6 +8203,7 @@ int x86_emulate_instruction(struct kvm_vcpu *vcpu, gpa_t cr2_or_gpa,
 		if (inject_emulated_exception(vcpu))
 			return r;
 	} else if (vcpu->arch.pio.count) {
+		kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_IO);
 		if (!vcpu->arch.pio.in) {
 			/* FIXME: return into emulator if single-stepping.  */
 			vcpu->arch.pio.count = 0;
@@ -8187,6 +8214,7 @@ int x86_emulate_instruction(struct kvm_vcpu *vcpu, gpa_t cr2_or_gpa,
 		r = 0;
 	} else if (vcpu->mmio_needed) {
 		++vcpu->stat.mmio_exits;
+		kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_MMIO);
 
 		if (!vcpu->mmio_is_write)
 			writeback = false;
@@ -8338,6 +8366,8 @@ int kvm_fast_pio(struct kvm_vcpu *vcpu, int size, unsigned short port, int in)
 {
 	int ret;
 
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_IO);
+
 	if (in)
 		ret = kvm_fast_pio_in(vcpu, size, port);
 	else
@@ -8750,6 +8780,7 @@ void kvm_arch_exit(void)
 static int __kvm_vcpu_halt(struct kvm_vcpu *vcpu, int state, int reason)
 {
 	++vcpu->stat.halt_exits;
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_HALT);
 	if (lapic_in_kernel(vcpu)) {
 		vcpu->arch.mp_state = state;
 		return 1;
@@ -8910,6 +8941,8 @@ int kvm_emulate_hypercall(struct kvm_vcpu *vcpu)
 	unsigned long nr, a0, a1, a2, a3, ret;
 	int op_64_bit;
 
+	kvm_set_exit_class(vcpu, KVM_EXIT_CLASS_HYPERCALL);
+
 	if (kvm_xen_hypercall_enabled(vcpu->kvm))
 		return kvm_xen_hypercall(vcpu);
 
@@ -9668,6 +9701,30 @@ void __kvm_request_immediate_exit(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL_GPL(__kvm_request_immediate_exit);
 
+static u64 *kvm_exit_hist(struct kvm_vcpu *vcpu)
+{
+	switch (vcpu->arch.exit_class) {
+	case KVM_EXIT_CLASS_EMULATION:
+		return vcpu->stat.exit_emulation_hist;
+	case KVM_EXIT_CLASS_PAGE_FAULT:
+		return vcpu->stat.exit_page_fault_hist;
+	case KVM_EXIT_CLASS_IO:
+		return vcpu->stat.exit_io_hist;
+	case KVM_EXIT_CLASS_MMIO:
+		return vcpu->stat.exit_mmio_hist;
+	case KVM_EXIT_CLASS_MSR:
+		return vcpu->stat.exit_msr_hist;
+	case KVM_EXIT_CLASS_CPUID:
+		return vcpu->stat.exit_cpuid_hist;
+	case KVM_EXIT_CLASS_HALT:
+		return vcpu->stat.exit_halt_hist;
+	case KVM_EXIT_CLASS_HYPERCALL:
+		return vcpu->stat.exit_hypercall_hist;
+	default:
+		return vcpu->stat.exit_other_hist;
+	}
+}
+
 /*
  * Returns 1 to let vcpu_run() continue the guest execution loop without
  * exiting to the userspace.  Otherwise, the value will be returned to the
@@ -9680,6 +9737,7 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 		dm_request_for_irq_injection(vcpu) &&
 		kvm_cpu_accept_dm_intr(vcpu);
 	fastpath_t exit_fastpath;
+	u64 exit_start;
 
 	bool req_immediate_exit = false;
 
@@ -10007,7 +10065,13 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 	if (vcpu->arch.apic_attention)
 		kvm_lapic_sync_from_vapic(vcpu);
 
+	vcpu->arch.exit_class = KVM_EXIT_CLASS_OTHER;
+	exit_start = ktime_get_ns();
+
 	r = static_call(kvm_x86_handle_exit)(vcpu, exit_fastpath);
+
+	kvm_stats_log_hist_update(kvm_exit_hist(vcpu), KVM_EXIT_HIST_COUNT,
+				  ktime_get_ns() - exit_start);
 	return r;
 
 cancel_injection:
@@ -11920,6 +11984,14 @@ static void kvm_mmu_slot_apply_flags(struct kvm *kvm,
 		 */
 		kvm_mmu_zap_collapsible_sptes(kvm, new);
 	} else {
+		/*
+		 * Split the huge pages up front rather than on the first write
+		 * to each of them, where vCPUs would take the MMU lock for write
+		 * in the fault path while the whole guest is being migrated.
+		 */
+		if (READ_ONCE(eager_page_split))
+			kvm_mmu_slot_try_split_huge_pages(kvm, new, PG_LEVEL_4K);
+
 		/*
 		 * Initially-all-set does not require write protecting any page,
 		 * because they're all assumed to be dirty.
@@ -12024,6 +12096,11 @@ bool kvm_arch_dy_has_pending_interrupt(struct kvm_vcpu *vcpu)
 	return false;
 }
 
+u64 kvm_arch_vcpu_timer_remaining_ns(struct kvm_vcpu *vcpu)
+{
+	return kvm_lapic_timer_remaining_ns(vcpu);
+}
+
 bool kvm_arch_dy_runnable(struct kvm_vcpu *vcpu)
 {
 	if (READ_ONCE(vcpu->arch.pv.pv_unhalted))
@@ -354,6 +354,8 @@ extern struct static_key kvm_no_apic_vcpu;
 
 extern bool report_ignored_msrs;
 
+extern bool eager_page_split;
+
 static inline u64 nsec_to_cycles(struct kvm_vcpu *vcpu, u64 nsec)
 {
 	return pvclock_scale_delta(nsec, vcpu->arch.virtual_tsc_mult,
@@ -406,6 +408,30 @@ static inline void kvm_after_interrupt(struct kvm_vcpu *vcpu)
 	__this_cpu_write(current_vcpu, NULL);
 }
 
+/*
+ * Classes of VM-Exits for the exit_*_hist stats.  An exit can go through
+ * several handlers, e.g. a page fault that ends up emulating an MMIO access,
+ * and the highest class it was tagged with wins.
+ */
+enum kvm_exit_class {
+	KVM_EXIT_CLASS_OTHER,
+	KVM_EXIT_CLASS_EMULATION,
+	KVM_EXIT_CLASS_PAGE_FAULT,
+	KVM_EXIT_CLASS_IO,
+	KVM_EXIT_CLASS_MMIO,
+	KVM_EXIT_CLASS_MSR,
+	KVM_EXIT_CLASS_CPUID,
+	KVM_EXIT_CLASS_HALT,
+	KVM_EXIT_CLASS_HYPERCALL,
+};
+
+static inline void kvm_set_exit_class(struct kvm_vcpu *vcpu,
+				      enum kvm_exit_class class)
+{
+	if (class > vcpu->arch.exit_class)
+		vcpu->arch.exit_class = class;
+}
+
 
 static inline bool kvm_pat_valid(u64 data)
 {
@@ -25,9 +25,17 @@
 #include "blk.h"
 #include "blk-rq-qos.h"
 
+/*
+ * Per CPU cache of bios of a bio_set created with BIOSET_PERCPU_CACHE.
+ * free_list is only used from task context with preemption disabled. Bios
+ * freed from (soft)irq context go to free_list_irq with interrupts
+ * disabled, and are moved over to free_list by the allocation side.
+ */
 struct bio_alloc_cache {
 	struct bio_list		free_list;
+	struct bio_list		free_list_irq;
 	unsigned int		nr;
+	unsigned int		nr_irq;
 };
 
 static struct biovec_slab {
@@ -277,6 +285,7 @@ void bio_init(struct bio *bio, struct bio_vec *table,
 #ifdef CONFIG_BLK_DEV_INTEGRITY
 	bio->bi_integrity = NULL;
 #endif
+	bio->bi_dma_tag = NULL;
 	bio->bi_vcnt = 0;
 
 	atomic_set(&bio->__bi_remaining, 1);
@@ -396,6 +405,49 @@ static void punt_bios_to_rescuer(struct bio_set *bs)
 	queue_work(bs->rescue_workqueue, &bs->rescue_work);
 }
 
+#define ALLOC_CACHE_THRESHOLD	16
+#define ALLOC_CACHE_MAX		512
+
+static void bio_alloc_irq_cache_splice(struct bio_alloc_cache *cache)
+{
+	unsigned long flags;
+
+	/* cache->free_list_irq is only modified from (soft)irq context */
+	local_irq_save(flags);
+	bio_list_merge(&cache->free_list, &cache->free_list_irq);
+	bio_list_init(&cache->free_list_irq);
+	cache->nr += cache->nr_irq;
+	cache->nr_irq = 0;
+	local_irq_restore(flags);
+}
+
+static struct bio *bio_alloc_percpu_cache(struct bio_set *bs,
+					  unsigned short nr_vecs)
+{
+	struct bio_alloc_cache *cache;
+	struct bio *bio;
+
+	cache = per_cpu_ptr(bs->cache, get_cpu());
+	if (bio_list_empty(&cache->free_list) &&
+	    READ_ONCE(cache->nr_irq) >= ALLOC_CACHE_THRESHOLD)
+		bio_alloc_irq_cache_splice(cache);
+	bio = bio_list_pop(&cache->free_list);
+	if (!bio) {
+		put_cpu();
+		return NULL;
+	}
+	cache->nr--;
+	put_cpu();
+
+	if (nr_vecs)
+		bio_init(bio, bio->bi_inline_vecs, BIO_INLINE_VECS);
+	else
+		bio_init(bio, NULL, 0);
+	bio->bi_pool = bs;
+	bio_set_flag(bio, BIO_PERCPU_CACHE);
+	return bio;
+}
+
 /**
  * bio_alloc_bioset - allocate a bio for I/O
  * @gfp_mask:   the GFP_* mask given to the slab allocator
@@ -432,6 +484,7 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned short nr_iovecs,
 			     struct bio_set *bs)
 {
 	gfp_t saved_gfp = gfp_mask;
+	bool cached = false;
 	struct bio *bio;
 	void *p;
 
@@ -439,6 +492,14 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned short nr_iovecs,
 	if (WARN_ON_ONCE(!mempool_initialized(&bs->bvec_pool) && nr_iovecs > 0))
 		return NULL;
 
+	if (bs->cache && nr_iovecs <= BIO_INLINE_VECS && in_task()) {
+		bio = bio_alloc_percpu_cache(bs, nr_iovecs);
+		if (bio)
+			return bio;
+		/* the cache is empty, the new bio goes back to it when freed */
+		cached = true;
+	}
+
 	/*
 	 * submit_bio_noacct() converts recursion to iteration; this means if
 	 * we're running beneath it, any bios we allocate and submit will not be
@@ -493,6 +554,8 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned short nr_iovecs,
 	}
 
 	bio->bi_pool = bs;
+	if (cached)
+		bio_set_flag(bio, BIO_PERCPU_CACHE);
 	return bio;
 
 err_free:
@@ -620,9 +683,6 @@ void guard_bio_eod(struct bio *bio)
 	bio_truncate(bio, maxsector << 9);
 }
 
-#define ALLOC_CACHE_MAX		512
-#define ALLOC_CACHE_SLACK	 64
-
 static void bio_alloc_cache_prune(struct bio_alloc_cache *cache,
 				  unsigned int nr)
 {
@@ -633,7 +693,14 @@ static void bio_alloc_cache_prune(struct bio_alloc_cache *cache,
 		cache->nr--;
 		bio_free(bio);
 		if (++i == nr)
-			break;
+			return;
+	}
+	if (nr != -1U)
+		return;
+
+	while ((bio = bio_list_pop(&cache->free_list_irq)) != NULL) {
+		cache->nr_irq--;
+		bio_free(bio);
 	}
 }
 
@@ -668,6 +735,33 @@ static void bio_alloc_cache_destroy(struct bio_set *bs)
 	bs->cache = NULL;
 }
 
+static void bio_put_percpu_cache(struct bio *bio)
+{
+	struct bio_alloc_cache *cache;
+
+	cache = per_cpu_ptr(bio->bi_pool->cache, get_cpu());
+	if (READ_ONCE(cache->nr_irq) + cache->nr > ALLOC_CACHE_MAX) {
+		put_cpu();
+		bio_free(bio);
+		return;
+	}
+
+	bio_uninit(bio);
+
+	if (in_task()) {
+		bio_list_add_head(&cache->free_list, bio);
+		cache->nr++;
+	} else {
+		unsigned long flags;
+
+		local_irq_save(flags);
+		bio_list_add_head(&cache->free_list_irq, bio);
+		cache->nr_irq++;
+		local_irq_restore(flags);
+	}
+	put_cpu();
+}
+
 /**
  * bio_put - release a reference to a bio
  * @bio:   bio to release reference to
@@ -684,18 +778,10 @@ void bio_put(struct bio *bio)
 			return;
 	}
 
-	if (bio_flagged(bio, BIO_PERCPU_CACHE)) {
-		struct bio_alloc_cache *cache;
-
-		bio_uninit(bio);
-		cache = per_cpu_ptr(bio->bi_pool->cache, get_cpu());
-		bio_list_add_head(&cache->free_list, bio);
-		if (++cache->nr > ALLOC_CACHE_MAX + ALLOC_CACHE_SLACK)
-			bio_alloc_cache_prune(cache, ALLOC_CACHE_SLACK);
-		put_cpu();
-	} else {
+	if (bio_flagged(bio, BIO_PERCPU_CACHE))
+		bio_put_percpu_cache(bio);
+	else
 		bio_free(bio);
-	}
 }
 EXPORT_SYMBOL(bio_put);
 
@@ -729,6 +815,7 @@ void __bio_clone_fast(struct bio *bio, struct bio *bio_src)
 	bio->bi_write_hint = bio_src->bi_write_hint;
 	bio->bi_iter = bio_src->bi_iter;
 	bio->bi_io_vec = bio_src->bi_io_vec;
+	bio->bi_dma_tag = bio_src->bi_dma_tag;
 
 	bio_clone_blkg_association(bio, bio_src);
 	blkcg_bio_issue_init(bio);
@@ -1587,8 +1674,8 @@ EXPORT_SYMBOL(bioset_exit);
  * @bs:		pool to initialize
  * @pool_size:	Number of bio and bio_vecs to cache in the mempool
  * @front_pad:	Number of bytes to allocate in front of the returned bio
- * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS
- *              and %BIOSET_NEED_RESCUER
+ * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS,
+ *              %BIOSET_NEED_RESCUER and %BIOSET_PERCPU_CACHE
  *
  * Description:
  *    Set up a bio_set to be used with @bio_alloc_bioset. Allows the caller
@@ -1601,6 +1688,9 @@ EXPORT_SYMBOL(bioset_exit);
  *    for allocating iovecs.  This pool is not needed e.g. for bio_clone_fast().
  *    If %BIOSET_NEED_RESCUER is set, a workqueue is created which can be used to
  *    dispatch queued requests when the mempool runs out of space.
+ *    If %BIOSET_PERCPU_CACHE is set, freed bios with inline vecs are kept in
+ *    a per-cpu cache and handed out again by bio_alloc_bioset() from task
+ *    context, without going through the mempool.
  *
  */
 int bioset_init(struct bio_set *bs,
@@ -1662,6 +1752,8 @@ int bioset_init_from_src(struct bio_set *bs, struct bio_set *src)
 		flags |= BIOSET_NEED_BVECS;
 	if (src->rescue_workqueue)
 		flags |= BIOSET_NEED_RESCUER;
+	if (src->cache)
+		flags |= BIOSET_PERCPU_CACHE;
 
 	return bioset_init(bs, src->bio_pool.min_nr, src->front_pad, flags);
 }
@@ -1674,36 +1766,15 @@ EXPORT_SYMBOL(bioset_init_from_src);
  * @bs:		bio_set to allocate from
  *
  * Description:
- *    Like @bio_alloc_bioset, but pass in the kiocb. The kiocb is only
- *    used to check if we should dip into the per-cpu bio_set allocation
- *    cache. The allocation uses GFP_KERNEL internally. On return, the
- *    bio is marked BIO_PERCPU_CACHEABLE, and the final put of the bio
- *    MUST be done from process context, not hard/soft IRQ.
+ *    Like @bio_alloc_bioset, but pass in the kiocb. The allocation uses
+ *    GFP_KERNEL internally. A bio_set created with %BIOSET_PERCPU_CACHE
+ *    serves the allocation from its per-cpu cache if possible.
  *
  */
 struct bio *bio_alloc_kiocb(struct kiocb *kiocb, unsigned short nr_vecs,
 			    struct bio_set *bs)
 {
-	struct bio_alloc_cache *cache;
-	struct bio *bio;
-
-	if (!(kiocb->ki_flags & IOCB_ALLOC_CACHE) || nr_vecs > BIO_INLINE_VECS)
-		return bio_alloc_bioset(GFP_KERNEL, nr_vecs, bs);
-
-	cache = per_cpu_ptr(bs->cache, get_cpu());
-	bio = bio_list_pop(&cache->free_list);
-	if (bio) {
-		cache->nr--;
-		put_cpu();
-		bio_init(bio, nr_vecs ? bio->bi_inline_vecs : NULL, nr_vecs);
-		bio->bi_pool = bs;
-		bio_set_flag(bio, BIO_PERCPU_CACHE);
-		return bio;
-	}
-	put_cpu();
-	bio = bio_alloc_bioset(GFP_KERNEL, nr_vecs, bs);
-	bio_set_flag(bio, BIO_PERCPU_CACHE);
-	return bio;
+	return bio_alloc_bioset(GFP_KERNEL, nr_vecs, bs);
 }
 EXPORT_SYMBOL_GPL(bio_alloc_kiocb);
 
@@ -1724,7 +1795,8 @@ static int __init init_bio(void)
 	cpuhp_setup_state_multi(CPUHP_BIO_DEAD, "block/bio:dead", NULL,
 					bio_cpu_dead);
 
-	if (bioset_init(&fs_bio_set, BIO_POOL_SIZE, 0, BIOSET_NEED_BVECS))
+	if (bioset_init(&fs_bio_set, BIO_POOL_SIZE, 0,
+			BIOSET_NEED_BVECS | BIOSET_PERCPU_CACHE))
 		panic("bio: can't allocate bios\n");
 
 	if (bioset_integrity_create(&fs_bio_set, BIO_POOL_SIZE))
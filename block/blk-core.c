@@ -1641,11 +1641,12 @@ int kblockd_mod_delayed_work_on(int cpu, struct delayed_work *dwork,
 EXPORT_SYMBOL(kblockd_mod_delayed_work_on);
 
 /**
- * blk_start_plug - initialize blk_plug and track it inside the task_struct
+ * blk_start_plug_nr_ios - initialize blk_plug and track it inside the task_struct
  * @plug:	The &struct blk_plug that needs to be initialized
+ * @nr_ios:	Number of IOs the caller is about to submit
  *
  * Description:
- *   blk_start_plug() indicates to the block layer an intent by the caller
+ *   blk_start_plug_nr_ios() indicates to the block layer an intent by the caller
  *   to submit multiple I/O requests in a batch.  The block layer may use
  *   this hint to defer submitting I/Os from the caller until blk_finish_plug()
  *   is called.  However, the block layer may choose to submit requests
@@ -1663,7 +1664,7 @@ EXPORT_SYMBOL(kblockd_mod_delayed_work_on);
  *   plug. By flushing the pending I/O when the process goes to sleep, we avoid
  *   this kind of deadlock.
  */
-void blk_start_plug(struct blk_plug *plug)
+void blk_start_plug_nr_ios(struct blk_plug *plug, unsigned short nr_ios)
 {
 	struct task_struct *tsk = current;
 
@@ -1674,6 +1675,8 @@ void blk_start_plug(struct blk_plug *plug)
 		return;
 
 	INIT_LIST_HEAD(&plug->mq_list);
+	plug->cached_rq = NULL;
+	plug->nr_ios = min_t(unsigned short, nr_ios, BLK_MAX_REQUEST_COUNT);
 	INIT_LIST_HEAD(&plug->cb_list);
 	plug->rq_count = 0;
 	plug->multiple_queues = false;
@@ -1685,6 +1688,20 @@ void blk_start_plug(struct blk_plug *plug)
 	 */
 	tsk->plug = plug;
 }
+EXPORT_SYMBOL(blk_start_plug_nr_ios);
+
+/**
+ * blk_start_plug - initialize blk_plug and track it inside the task_struct
+ * @plug:	The &struct blk_plug that needs to be initialized
+ *
+ * Description:
+ *   See blk_start_plug_nr_ios(), without a hint about the number of I/Os to
+ *   come.
+ */
+void blk_start_plug(struct blk_plug *plug)
+{
+	blk_start_plug_nr_ios(plug, 1);
+}
 EXPORT_SYMBOL(blk_start_plug);
 
 static void flush_plug_callbacks(struct blk_plug *plug, bool from_schedule)
@@ -1735,6 +1752,14 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
+	/*
+	 * Unconditionally flush out cached requests, even if the unplug
+	 * event came from schedule. They hold tags and references to the
+	 * queue, a blocked task must not hold up a queue freeze or other
+	 * tasks waiting for a tag.
+	 */
+	if (unlikely(plug->cached_rq))
+		blk_mq_free_plug_rqs(plug);
 }
 
 /**
@@ -44,7 +44,10 @@
  * /sys/fs/cgroup/io.cost.model.
  *
  * If needed, tools/cgroup/iocost_coef_gen.py can be used to generate
- * device-specific coefficients.
+ * device-specific coefficients.  Alternatively, "ctrl=calib" makes the
+ * controller fit the coefficients to the device times of the IOs it
+ * observes and update the model as it goes.  The quality of the fits is
+ * reported in the root io.stat.
  *
  * 2. Control Strategy
  *
@@ -308,6 +311,17 @@ enum {
 
 	/* if apart further than 16M, consider randio for linear model */
 	LCOEF_RANDIO_PAGES	= 4096,
+
+	/*
+	 * Cost model calibration fits the model once this many IOs have
+	 * been observed in a direction and ages the samples by half after
+	 * each fit.  Per-IO device times are capped so that the sums of
+	 * squares can't overflow.  A class with fewer IOs than the minimum
+	 * keeps its current coefficient.
+	 */
+	CALIB_FIT_IOS		= 4096,
+	CALIB_MIN_CLASS_IOS	= 64,
+	CALIB_MAX_NSEC		= 40 * NSEC_PER_MSEC,
 };
 
 enum ioc_running {
@@ -370,6 +384,27 @@ enum {
 	AUTOP_SSD_FAST,
 };
 
+/* cost model calibration */
+enum {
+	CALIB_SEQ,
+	CALIB_RAND,
+	NR_CALIB_CLASSES,
+};
+
+/*
+ * Linear regression sums of the calibration samples of an IO class.  X is
+ * the IO size in pages and Y the device time of the IO in nsecs.
+ */
+enum {
+	CALIB_N,
+	CALIB_X,
+	CALIB_Y,
+	CALIB_XX,
+	CALIB_XY,
+	CALIB_YY,
+	NR_CALIB_SUMS,
+};
+
 struct ioc_params {
 	u32				qos[NR_QOS_PARAMS];
 	u64				i_lcoefs[NR_I_LCOEFS];
@@ -391,11 +426,27 @@ struct ioc_missed {
 	u32				last_missed;
 };
 
+struct ioc_pcpu_calib {
+	local64_t			sums[2][NR_CALIB_CLASSES][NR_CALIB_SUMS];
+	u64				last[2][NR_CALIB_CLASSES][NR_CALIB_SUMS];
+	local64_t			dev_ns;
+	u64				last_dev_ns;
+};
+
 struct ioc_pcpu_stat {
 	struct ioc_missed		missed[2];
 
 	local64_t			rq_wait_ns;
 	u64				last_rq_wait_ns;
+
+	struct ioc_pcpu_calib		calib;
+};
+
+struct ioc_calib {
+	u64				sums[2][NR_CALIB_CLASSES][NR_CALIB_SUMS];
+	u64				cursor[2];
+	u64				nr_fits[2];
+	u32				r2_ppm[2];
 };
 
 /* per device */
@@ -441,6 +492,10 @@ struct ioc {
 	int				autop_idx;
 	bool				user_qos_params:1;
 	bool				user_cost_model:1;
+	bool				calib_cost_model:1;
+
+	/* cost model calibration, see ioc_calib_fit() */
+	struct ioc_calib		calib;
 };
 
 struct iocg_pcpu_stat {
@@ -1597,6 +1652,155 @@ static void ioc_lat_stat(struct ioc *ioc, u32 *missed_ppm_ar, u32 *rq_wait_pct_p
 				   ioc->period_us * NSEC_PER_USEC);
 }
 
+/*
+ * Fit the linear model of @rw to the calibration samples.  The per-page cost
+ * is the slope shared by seq and rand IOs and the per-IO costs are the
+ * intercepts of the two classes, which is exactly the shape of the builtin
+ * linear model.  The samples are aged by half after each fit so that the
+ * model keeps following the device.
+ */
+static void ioc_calib_fit(struct ioc *ioc, int rw)
+{
+	u64 (*sums)[NR_CALIB_SUMS] = ioc->calib.sums[rw];
+	/* bps, seqiops and randiops of @rw, in this order */
+	u64 *u = &ioc->params.i_lcoefs[rw == READ ? I_LCOEF_RBPS : I_LCOEF_WBPS];
+	s64 sxx = 0, sxy = 0, syy = 0, sst, sse;
+	u64 n = 0, y = 0, yy = 0, page = 0;
+	bool fit_page = false;
+	u32 r2_ppm;
+	int c, i;
+
+	lockdep_assert_held(&ioc->lock);
+
+	for (c = 0; c < NR_CALIB_CLASSES; c++) {
+		u64 *s = sums[c];
+
+		if (!s[CALIB_N])
+			continue;
+
+		sxx += s[CALIB_XX] - mul_u64_u64_div_u64(s[CALIB_X], s[CALIB_X],
+							 s[CALIB_N]);
+		sxy += s[CALIB_XY] - mul_u64_u64_div_u64(s[CALIB_X], s[CALIB_Y],
+							 s[CALIB_N]);
+		syy += s[CALIB_YY] - mul_u64_u64_div_u64(s[CALIB_Y], s[CALIB_Y],
+							 s[CALIB_N]);
+		n += s[CALIB_N];
+		y += s[CALIB_Y];
+		yy += s[CALIB_YY];
+	}
+
+	/*
+	 * IOs of a single size can't tell the per-page cost apart from the
+	 * per-IO ones.  Keep the current per-page cost in that case.
+	 */
+	if (sxx > 0 && sxy > 0) {
+		page = max_t(s64, div64_s64(sxy, sxx), 1);
+		fit_page = true;
+	} else if (u[0]) {
+		page = div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC, u[0]);
+	}
+
+	sse = syy - (s64)page * (2 * sxy - (s64)page * sxx);
+	sst = yy - mul_u64_u64_div_u64(y, y, n);
+	if (sse <= 0)
+		r2_ppm = MILLION;
+	else if (sse >= sst)
+		r2_ppm = 0;
+	else
+		r2_ppm = MILLION - mul_u64_u64_div_u64(sse, MILLION, sst);
+
+	if (fit_page)
+		u[0] = div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC, page);
+
+	for (c = 0; c < NR_CALIB_CLASSES; c++) {
+		u64 *s = sums[c];
+		s64 base;
+
+		if (s[CALIB_N] < CALIB_MIN_CLASS_IOS)
+			continue;
+
+		base = div64_s64((s64)(s[CALIB_Y] - page * s[CALIB_X]),
+				 s[CALIB_N]);
+		base = max_t(s64, base, 0);
+		if (base + page)
+			u[1 + c] = max_t(u64, div64_u64(NSEC_PER_SEC,
+							base + page), 1);
+	}
+
+	for (c = 0; c < NR_CALIB_CLASSES; c++)
+		for (i = 0; i < NR_CALIB_SUMS; i++)
+			sums[c][i] >>= 1;
+
+	ioc->calib.r2_ppm[rw] = r2_ppm;
+	ioc->calib.nr_fits[rw]++;
+	ioc_refresh_lcoefs(ioc);
+}
+
+/*
+ * Collect the calibration samples of the period which just ended and fit
+ * the model of the directions which have seen enough IOs.
+ */
+static void ioc_calib_collect(struct ioc *ioc, struct ioc_now *now)
+{
+	u64 sums[2][NR_CALIB_CLASSES][NR_CALIB_SUMS] = { };
+	u64 dev_ns = 0, period_ns;
+	int cpu, rw, c, i;
+
+	lockdep_assert_held(&ioc->lock);
+
+	for_each_online_cpu(cpu) {
+		struct ioc_pcpu_stat *stat = per_cpu_ptr(ioc->pcpu_stat, cpu);
+		struct ioc_pcpu_calib *pc = &stat->calib;
+		u64 this;
+
+		for (rw = READ; rw <= WRITE; rw++) {
+			for (c = 0; c < NR_CALIB_CLASSES; c++) {
+				for (i = 0; i < NR_CALIB_SUMS; i++) {
+					this = local64_read(&pc->sums[rw][c][i]);
+					sums[rw][c][i] += this - pc->last[rw][c][i];
+					pc->last[rw][c][i] = this;
+				}
+			}
+		}
+
+		this = local64_read(&pc->dev_ns);
+		dev_ns += this - pc->last_dev_ns;
+		pc->last_dev_ns = this;
+	}
+
+	/*
+	 * The device times of IOs which were in flight together overlap.
+	 * Scale them down by the average number of IOs in flight during the
+	 * period so that the costs of IOs saturating the device add up to
+	 * the length of the period.
+	 */
+	period_ns = (now->now - ioc->period_at) * NSEC_PER_USEC;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		for (c = 0; c < NR_CALIB_CLASSES; c++) {
+			u64 *s = sums[rw][c];
+
+			if (dev_ns > period_ns) {
+				s[CALIB_Y] = mul_u64_u64_div_u64(s[CALIB_Y],
+							period_ns, dev_ns);
+				s[CALIB_XY] = mul_u64_u64_div_u64(s[CALIB_XY],
+							period_ns, dev_ns);
+				s[CALIB_YY] = mul_u64_u64_div_u64(s[CALIB_YY],
+							period_ns, dev_ns);
+				s[CALIB_YY] = mul_u64_u64_div_u64(s[CALIB_YY],
+							period_ns, dev_ns);
+			}
+
+			for (i = 0; i < NR_CALIB_SUMS; i++)
+				ioc->calib.sums[rw][c][i] += s[i];
+		}
+
+		if (ioc->calib.sums[rw][CALIB_SEQ][CALIB_N] +
+		    ioc->calib.sums[rw][CALIB_RAND][CALIB_N] >= CALIB_FIT_IOS)
+			ioc_calib_fit(ioc, rw);
+	}
+}
+
 /* was iocg idle this period? */
 static bool iocg_is_idle(struct ioc_gq *iocg)
 {
@@ -2234,6 +2438,9 @@ static void ioc_timer_fn(struct timer_list *timer)
 		return;
 	}
 
+	if (ioc->calib_cost_model)
+		ioc_calib_collect(ioc, &now);
+
 	nr_debtors = ioc_check_iocgs(ioc, &now);
 
 	/*
@@ -2766,11 +2973,47 @@ static void ioc_rqos_done_bio(struct rq_qos *rqos, struct bio *bio)
 		atomic64_add(bio->bi_iocost_cost, &iocg->done_vtime);
 }
 
+/* record the size and device time of @rq as a calibration sample */
+static void ioc_calib_account(struct ioc *ioc, struct ioc_pcpu_calib *pc,
+			      struct request *rq, int rw, u64 now_ns)
+{
+	u64 pages = max_t(u64, blk_rq_stats_sectors(rq) >> IOC_SECT_TO_PAGE_SHIFT,
+			  1);
+	u64 cursor = READ_ONCE(ioc->calib.cursor[rw]);
+	u64 seek_pages = 0, dev_ns;
+	local64_t *s;
+
+	if (!rq->io_start_time_ns || now_ns <= rq->io_start_time_ns)
+		return;
+
+	dev_ns = min_t(u64, now_ns - rq->io_start_time_ns, CALIB_MAX_NSEC);
+
+	if (cursor) {
+		seek_pages = abs(blk_rq_pos(rq) - cursor);
+		seek_pages >>= IOC_SECT_TO_PAGE_SHIFT;
+	}
+	WRITE_ONCE(ioc->calib.cursor[rw],
+		   blk_rq_pos(rq) + blk_rq_stats_sectors(rq));
+
+	if (seek_pages > LCOEF_RANDIO_PAGES)
+		s = pc->sums[rw][CALIB_RAND];
+	else
+		s = pc->sums[rw][CALIB_SEQ];
+
+	local64_inc(&s[CALIB_N]);
+	local64_add(pages, &s[CALIB_X]);
+	local64_add(dev_ns, &s[CALIB_Y]);
+	local64_add(pages * pages, &s[CALIB_XX]);
+	local64_add(pages * dev_ns, &s[CALIB_XY]);
+	local64_add(dev_ns * dev_ns, &s[CALIB_YY]);
+	local64_add(dev_ns, &pc->dev_ns);
+}
+
 static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 {
 	struct ioc *ioc = rqos_to_ioc(rqos);
 	struct ioc_pcpu_stat *ccs;
-	u64 on_q_ns, rq_wait_ns, size_nsec;
+	u64 now_ns, on_q_ns, rq_wait_ns, size_nsec;
 	int pidx, rw;
 
 	if (!ioc->enabled || !rq->alloc_time_ns || !rq->start_time_ns)
@@ -2789,7 +3032,8 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 		return;
 	}
 
-	on_q_ns = ktime_get_ns() - rq->alloc_time_ns;
+	now_ns = ktime_get_ns();
+	on_q_ns = now_ns - rq->alloc_time_ns;
 	rq_wait_ns = rq->start_time_ns - rq->alloc_time_ns;
 	size_nsec = div64_u64(calc_size_vtime_cost(rq, ioc), VTIME_PER_NSEC);
 
@@ -2803,6 +3047,9 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 
 	local64_add(rq_wait_ns, &ccs->rq_wait_ns);
 
+	if (ioc->calib_cost_model)
+		ioc_calib_account(ioc, &ccs->calib, rq, rw, now_ns);
+
 	put_cpu_ptr(ccs);
 }
 
@@ -3024,6 +3271,16 @@ static bool ioc_pd_stat(struct blkg_policy_data *pd, struct seq_file *s)
 			ioc->vtime_base_rate * 10000,
 			VTIME_PER_USEC);
 		seq_printf(s, " cost.vrate=%u.%02u", vp10k / 100, vp10k % 100);
+
+		if (ioc->calib_cost_model) {
+			unsigned r10k = ioc->calib.r2_ppm[READ] / 100;
+			unsigned w10k = ioc->calib.r2_ppm[WRITE] / 100;
+
+			seq_printf(s, " cost.calib.rfits=%llu cost.calib.rr2=%u.%02u"
+				   " cost.calib.wfits=%llu cost.calib.wr2=%u.%02u",
+				   ioc->calib.nr_fits[READ], r10k / 100, r10k % 100,
+				   ioc->calib.nr_fits[WRITE], w10k / 100, w10k % 100);
+		}
 	}
 
 	seq_printf(s, " cost.usage=%llu", iocg->last_stat.usage_us);
@@ -3310,7 +3567,8 @@ static u64 ioc_cost_model_prfill(struct seq_file *sf,
 	seq_printf(sf, "%s ctrl=%s model=linear "
 		   "rbps=%llu rseqiops=%llu rrandiops=%llu "
 		   "wbps=%llu wseqiops=%llu wrandiops=%llu\n",
-		   dname, ioc->user_cost_model ? "user" : "auto",
+		   dname, ioc->calib_cost_model ? "calib" :
+		   ioc->user_cost_model ? "user" : "auto",
 		   u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
 		   u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS]);
 	return 0;
@@ -3347,7 +3605,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	struct block_device *bdev;
 	struct ioc *ioc;
 	u64 u[NR_I_LCOEFS];
-	bool user;
+	bool user, calib;
 	char *p;
 	int ret;
 
@@ -3366,6 +3624,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	spin_lock_irq(&ioc->lock);
 	memcpy(u, ioc->params.i_lcoefs, sizeof(u));
 	user = ioc->user_cost_model;
+	calib = ioc->calib_cost_model;
 	spin_unlock_irq(&ioc->lock);
 
 	while ((p = strsep(&input, " \t\n"))) {
@@ -3380,12 +3639,18 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 		switch (match_token(p, cost_ctrl_tokens, args)) {
 		case COST_CTRL:
 			match_strlcpy(buf, &args[0], sizeof(buf));
-			if (!strcmp(buf, "auto"))
+			if (!strcmp(buf, "auto")) {
 				user = false;
-			else if (!strcmp(buf, "user"))
+				calib = false;
+			} else if (!strcmp(buf, "user")) {
 				user = true;
-			else
+				calib = false;
+			} else if (!strcmp(buf, "calib")) {
+				user = true;
+				calib = true;
+			} else {
 				goto einval;
+			}
 			continue;
 		case COST_MODEL:
 			match_strlcpy(buf, &args[0], sizeof(buf));
@@ -3410,6 +3675,9 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	} else {
 		ioc->user_cost_model = false;
 	}
+	if (calib && !ioc->calib_cost_model)
+		memset(&ioc->calib, 0, sizeof(ioc->calib));
+	ioc->calib_cost_model = calib;
 	ioc_refresh_params(ioc, true);
 	spin_unlock_irq(&ioc->lock);
 
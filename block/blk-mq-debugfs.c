@@ -41,6 +41,79 @@ static int queue_poll_stat_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static const char *const lat_hist_op_name[] = {
+	[BLK_LAT_HIST_READ]	= "read",
+	[BLK_LAT_HIST_WRITE]	= "write",
+	[BLK_LAT_HIST_DISCARD]	= "discard",
+	[BLK_LAT_HIST_OTHER]	= "other",
+};
+
+/*
+ * One line per operation type with the counts of the log2 buckets, see
+ * BLK_LAT_HIST_BUCKETS.
+ */
+static int print_lat_hist(struct seq_file *m, struct request_queue *q,
+			  struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_lat_hist *hist;
+	int op, bucket;
+
+	BUILD_BUG_ON(ARRAY_SIZE(lat_hist_op_name) != BLK_LAT_HIST_OPS);
+
+	hist = kmalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	if (!blk_stat_sum_lat_hist(q, hctx, hist)) {
+		seq_puts(m, "disabled\n");
+		goto out;
+	}
+
+	for (op = 0; op < BLK_LAT_HIST_OPS; op++) {
+		seq_printf(m, "%s:", lat_hist_op_name[op]);
+		for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+			seq_printf(m, " %llu", hist->buckets[op][bucket]);
+		seq_puts(m, "\n");
+	}
+out:
+	kfree(hist);
+	return 0;
+}
+
+static int queue_lat_hist_show(void *data, struct seq_file *m)
+{
+	return print_lat_hist(m, data, NULL);
+}
+
+static ssize_t queue_lat_hist_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct request_queue *q = data;
+	char opbuf[16] = { }, *op;
+	int ret;
+
+	if (count >= sizeof(opbuf))
+		goto inval;
+
+	if (copy_from_user(opbuf, buf, count))
+		return -EFAULT;
+	op = strstrip(opbuf);
+	if (strcmp(op, "on") == 0) {
+		ret = blk_stat_enable_lat_hist(q);
+		if (ret)
+			return ret;
+	} else if (strcmp(op, "off") == 0) {
+		blk_stat_disable_lat_hist(q);
+	} else if (strcmp(op, "reset") == 0) {
+		blk_stat_reset_lat_hist(q, NULL);
+	} else {
+inval:
+		pr_err("%s: use 'on', 'off' or 'reset'\n", __func__);
+		return -EINVAL;
+	}
+	return count;
+}
+
 static void *queue_requeue_list_start(struct seq_file *m, loff_t *pos)
 	__acquires(&q->requeue_lock)
 {
@@ -206,6 +279,7 @@ static ssize_t queue_write_hint_store(void *data, const char __user *buf,
 
 static const struct blk_mq_debugfs_attr blk_mq_debugfs_queue_attrs[] = {
 	{ "poll_stat", 0400, queue_poll_stat_show },
+	{ "lat_hist", 0600, queue_lat_hist_show, queue_lat_hist_write },
 	{ "requeue_list", 0400, .seq_ops = &queue_requeue_list_seq_ops },
 	{ "pm_only", 0600, queue_pm_only_show, NULL },
 	{ "state", 0600, queue_state_show, queue_state_write },
@@ -618,6 +692,22 @@ static int hctx_active_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int hctx_lat_hist_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+
+	return print_lat_hist(m, hctx->queue, hctx);
+}
+
+static ssize_t hctx_lat_hist_write(void *data, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+
+	blk_stat_reset_lat_hist(hctx->queue, hctx);
+	return count;
+}
+
 static int hctx_dispatch_busy_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
@@ -795,6 +885,7 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_hctx_attrs[] = {
 	{"run", 0600, hctx_run_show, hctx_run_write},
 	{"active", 0400, hctx_active_show},
 	{"dispatch_busy", 0400, hctx_dispatch_busy_show},
+	{"lat_hist", 0600, hctx_lat_hist_show, hctx_lat_hist_write},
 	{"type", 0400, hctx_type_show},
 	{},
 };
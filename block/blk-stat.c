@@ -16,6 +16,8 @@ struct blk_queue_stats {
 	struct list_head callbacks;
 	spinlock_t lock;
 	bool enable_accounting;
+	/* per-cpu array of HCTX_MAX_TYPES histograms */
+	struct blk_lat_hist __percpu __rcu *lat_hist;
 };
 
 void blk_rq_stat_init(struct blk_rq_stat *stat)
@@ -48,9 +50,46 @@ void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value)
 	stat->nr_samples++;
 }
 
+static int blk_lat_hist_op(const struct request *rq)
+{
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		return BLK_LAT_HIST_READ;
+	case REQ_OP_WRITE:
+		return BLK_LAT_HIST_WRITE;
+	case REQ_OP_DISCARD:
+		return BLK_LAT_HIST_DISCARD;
+	default:
+		return BLK_LAT_HIST_OTHER;
+	}
+}
+
+/*
+ * Completions don't necessarily run on the CPU the request was submitted
+ * from, so the counters can be updated concurrently and lose an increment
+ * now and then. Same as the other software queue statistics, that's good
+ * enough for what they are used for and it keeps the cost to an add on a
+ * mostly CPU local cacheline.
+ */
+static void blk_lat_hist_add(struct blk_lat_hist __percpu *lat_hist,
+			     struct request *rq, u64 value)
+{
+	struct blk_lat_hist *hist;
+	u64 usecs = div_u64(value, NSEC_PER_USEC);
+	int bucket;
+
+	if (!rq->mq_ctx || !rq->mq_hctx)
+		return;
+
+	bucket = min_t(int, fls64(usecs), BLK_LAT_HIST_BUCKETS - 1);
+	hist = per_cpu_ptr(lat_hist, rq->mq_ctx->cpu) + rq->mq_hctx->type;
+	hist->buckets[blk_lat_hist_op(rq)][bucket]++;
+}
+
 void blk_stat_add(struct request *rq, u64 now)
 {
 	struct request_queue *q = rq->q;
+	struct blk_lat_hist __percpu *lat_hist;
 	struct blk_stat_callback *cb;
 	struct blk_rq_stat *stat;
 	int bucket, cpu;
@@ -61,6 +100,10 @@ void blk_stat_add(struct request *rq, u64 now)
 	blk_throtl_stat_add(rq, value);
 
 	rcu_read_lock();
+	lat_hist = rcu_dereference(q->stats->lat_hist);
+	if (lat_hist)
+		blk_lat_hist_add(lat_hist, rq, value);
+
 	cpu = get_cpu();
 	list_for_each_entry_rcu(cb, &q->stats->callbacks, list) {
 		if (!blk_stat_is_active(cb))
@@ -195,6 +238,101 @@ void blk_stat_enable_accounting(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_stat_enable_accounting);
 
+int blk_stat_enable_lat_hist(struct request_queue *q)
+{
+	struct blk_lat_hist __percpu *lat_hist;
+	unsigned long flags;
+
+	lat_hist = __alloc_percpu(sizeof(struct blk_lat_hist) * HCTX_MAX_TYPES,
+				  __alignof__(struct blk_lat_hist));
+	if (!lat_hist)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&q->stats->lock, flags);
+	if (rcu_access_pointer(q->stats->lat_hist)) {
+		spin_unlock_irqrestore(&q->stats->lock, flags);
+		free_percpu(lat_hist);
+		return 0;
+	}
+	q->stats->enable_accounting = true;
+	blk_queue_flag_set(QUEUE_FLAG_STATS, q);
+	rcu_assign_pointer(q->stats->lat_hist, lat_hist);
+	spin_unlock_irqrestore(&q->stats->lock, flags);
+
+	return 0;
+}
+
+void blk_stat_disable_lat_hist(struct request_queue *q)
+{
+	struct blk_lat_hist __percpu *lat_hist;
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->stats->lock, flags);
+	lat_hist = rcu_replace_pointer(q->stats->lat_hist, NULL,
+				       lockdep_is_held(&q->stats->lock));
+	spin_unlock_irqrestore(&q->stats->lock, flags);
+
+	if (lat_hist) {
+		synchronize_rcu();
+		free_percpu(lat_hist);
+	}
+}
+
+static bool blk_stat_walk_lat_hist(struct request_queue *q,
+		struct blk_mq_hw_ctx *hctx,
+		void (*fn)(struct blk_lat_hist *hist, void *data), void *data)
+{
+	struct blk_lat_hist __percpu *lat_hist;
+	struct blk_mq_ctx *ctx;
+	int cpu, type, i;
+
+	rcu_read_lock();
+	lat_hist = rcu_dereference(q->stats->lat_hist);
+	if (!lat_hist) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	if (hctx) {
+		hctx_for_each_ctx(hctx, ctx, i)
+			fn(per_cpu_ptr(lat_hist, ctx->cpu) + hctx->type, data);
+	} else {
+		for_each_possible_cpu(cpu)
+			for (type = 0; type < HCTX_MAX_TYPES; type++)
+				fn(per_cpu_ptr(lat_hist, cpu) + type, data);
+	}
+	rcu_read_unlock();
+
+	return true;
+}
+
+static void blk_lat_hist_sum_fn(struct blk_lat_hist *hist, void *data)
+{
+	struct blk_lat_hist *sum = data;
+	int op, bucket;
+
+	for (op = 0; op < BLK_LAT_HIST_OPS; op++)
+		for (bucket = 0; bucket < BLK_LAT_HIST_BUCKETS; bucket++)
+			sum->buckets[op][bucket] += hist->buckets[op][bucket];
+}
+
+bool blk_stat_sum_lat_hist(struct request_queue *q, struct blk_mq_hw_ctx *hctx,
+			   struct blk_lat_hist *sum)
+{
+	memset(sum, 0, sizeof(*sum));
+	return blk_stat_walk_lat_hist(q, hctx, blk_lat_hist_sum_fn, sum);
+}
+
+static void blk_lat_hist_reset_fn(struct blk_lat_hist *hist, void *data)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+void blk_stat_reset_lat_hist(struct request_queue *q, struct blk_mq_hw_ctx *hctx)
+{
+	blk_stat_walk_lat_hist(q, hctx, blk_lat_hist_reset_fn, NULL);
+}
+
 struct blk_queue_stats *blk_alloc_queue_stats(void)
 {
 	struct blk_queue_stats *stats;
@@ -206,6 +344,7 @@ struct blk_queue_stats *blk_alloc_queue_stats(void)
 	INIT_LIST_HEAD(&stats->callbacks);
 	spin_lock_init(&stats->lock);
 	stats->enable_accounting = false;
+	RCU_INIT_POINTER(stats->lat_hist, NULL);
 
 	return stats;
 }
@@ -217,5 +356,6 @@ void blk_free_queue_stats(struct blk_queue_stats *stats)
 
 	WARN_ON(!list_empty(&stats->callbacks));
 
+	free_percpu(rcu_dereference_protected(stats->lat_hist, 1));
 	kfree(stats);
 }
@@ -4,6 +4,7 @@
 
 #include <linux/kernel.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/ktime.h>
 #include <linux/rcupdate.h>
 #include <linux/timer.h>
@@ -62,6 +63,31 @@ struct blk_stat_callback {
 	struct rcu_head rcu;
 };
 
+enum {
+	BLK_LAT_HIST_READ,
+	BLK_LAT_HIST_WRITE,
+	BLK_LAT_HIST_DISCARD,
+	BLK_LAT_HIST_OTHER,
+	BLK_LAT_HIST_OPS,
+};
+
+/*
+ * Bucket 0 counts completions under 1us, bucket i those in
+ * [2^(i-1), 2^i) us and the last bucket everything above.
+ */
+#define BLK_LAT_HIST_BUCKETS	24
+
+/**
+ * struct blk_lat_hist - log2 histogram of request completion latencies.
+ *
+ * The histogram of a queue is kept per CPU and per hardware queue type,
+ * indexed by the software queue a request was submitted from, so the
+ * numbers of a &struct blk_mq_hw_ctx are the sum over its software queues.
+ */
+struct blk_lat_hist {
+	u64 buckets[BLK_LAT_HIST_OPS][BLK_LAT_HIST_BUCKETS];
+};
+
 struct blk_queue_stats *blk_alloc_queue_stats(void);
 void blk_free_queue_stats(struct blk_queue_stats *);
 
@@ -70,6 +96,22 @@ void blk_stat_add(struct request *rq, u64 now);
 /* record time/size info in request but not add a callback */
 void blk_stat_enable_accounting(struct request_queue *q);
 
+int blk_stat_enable_lat_hist(struct request_queue *q);
+void blk_stat_disable_lat_hist(struct request_queue *q);
+
+/**
+ * blk_stat_sum_lat_hist() - Sum up the latency histogram of a queue.
+ * @q: The request queue.
+ * @hctx: Only sum up the completions of this hardware queue, or the whole
+ * queue if NULL.
+ * @sum: Where to store the result.
+ *
+ * Return: false if the histogram isn't enabled.
+ */
+bool blk_stat_sum_lat_hist(struct request_queue *q, struct blk_mq_hw_ctx *hctx,
+			   struct blk_lat_hist *sum);
+void blk_stat_reset_lat_hist(struct request_queue *q, struct blk_mq_hw_ctx *hctx);
+
 /**
  * blk_stat_alloc_callback() - Allocate a block statistics callback.
  * @timer_fn: Timer callback function.
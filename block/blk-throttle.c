@@ -37,6 +37,9 @@
  */
 #define LATENCY_FILTERED_HD (1000L) /* 1ms */
 
+/* A CPU pre-charges up to 1/THROTL_TOKEN_SHARE of the slice headroom */
+#define THROTL_TOKEN_SHARE 8
+
 static struct blkcg_policy blkcg_policy_throtl;
 
 /* A workqueue to queue throttle related work */
@@ -98,6 +101,18 @@ enum tg_state_flags {
 
 #define rb_entry_tg(node)	rb_entry((node), struct throtl_grp, rb_node)
 
+/*
+ * Dispatch budget which has already been charged to a tg and all its
+ * ancestors in the current slice and which bios issued on this CPU can use
+ * without taking queue_lock.  U64_MAX bytes or UINT_MAX ios mean unlimited.
+ * The tokens are only valid while @gen matches the tg's token_gen.
+ */
+struct throtl_tokens {
+	uint64_t bytes[2];
+	unsigned int ios[2];
+	unsigned int gen[2];
+};
+
 enum {
 	LIMIT_LOW,
 	LIMIT_MAX,
@@ -181,6 +196,10 @@ struct throtl_grp {
 	atomic_t io_split_cnt[2];
 	atomic_t last_io_split_cnt[2];
 
+	/* per-cpu pre-charged dispatch tokens, see throtl_refill_tokens() */
+	struct throtl_tokens __percpu *tokens;
+	unsigned int token_gen[2];
+
 	struct blkg_rwstat stat_bytes;
 	struct blkg_rwstat stat_ios;
 };
@@ -504,6 +523,10 @@ static struct blkg_policy_data *throtl_pd_alloc(gfp_t gfp,
 	if (blkg_rwstat_init(&tg->stat_ios, gfp))
 		goto err_exit_stat_bytes;
 
+	tg->tokens = alloc_percpu_gfp(struct throtl_tokens, gfp);
+	if (!tg->tokens)
+		goto err_exit_stat_ios;
+
 	throtl_service_queue_init(&tg->service_queue);
 
 	for (rw = READ; rw <= WRITE; rw++) {
@@ -529,6 +552,8 @@ static struct blkg_policy_data *throtl_pd_alloc(gfp_t gfp,
 
 	return &tg->pd;
 
+err_exit_stat_ios:
+	blkg_rwstat_exit(&tg->stat_ios);
 err_exit_stat_bytes:
 	blkg_rwstat_exit(&tg->stat_bytes);
 err_free_tg:
@@ -638,6 +663,7 @@ static void throtl_pd_free(struct blkg_policy_data *pd)
 	struct throtl_grp *tg = pd_to_tg(pd);
 
 	del_timer_sync(&tg->service_queue.pending_timer);
+	free_percpu(tg->tokens);
 	blkg_rwstat_exit(&tg->stat_bytes);
 	blkg_rwstat_exit(&tg->stat_ios);
 	kfree(tg);
@@ -774,11 +800,21 @@ static bool throtl_schedule_next_dispatch(struct throtl_service_queue *sq,
 	return false;
 }
 
+/*
+ * Invalidate the per-cpu tokens of @tg.  They were charged against the
+ * slice or the limits which are going away.
+ */
+static inline void throtl_invalidate_tokens(struct throtl_grp *tg, bool rw)
+{
+	WRITE_ONCE(tg->token_gen[rw], tg->token_gen[rw] + 1);
+}
+
 static inline void throtl_start_new_slice_with_credit(struct throtl_grp *tg,
 		bool rw, unsigned long start)
 {
 	tg->bytes_disp[rw] = 0;
 	tg->io_disp[rw] = 0;
+	throtl_invalidate_tokens(tg, rw);
 
 	atomic_set(&tg->io_split_cnt[rw], 0);
 
@@ -802,6 +838,7 @@ static inline void throtl_start_new_slice(struct throtl_grp *tg, bool rw)
 {
 	tg->bytes_disp[rw] = 0;
 	tg->io_disp[rw] = 0;
+	throtl_invalidate_tokens(tg, rw);
 	tg->slice_start[rw] = jiffies;
 	tg->slice_end[rw] = jiffies + tg->td->throtl_slice;
 
@@ -1079,6 +1116,126 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 		bio_set_flag(bio, BIO_THROTTLED);
 }
 
+/*
+ * Returns the number of bytes and ios @tg can still dispatch in its current
+ * slice, U64_MAX and UINT_MAX respectively if unlimited.
+ */
+static void tg_slice_headroom(struct throtl_grp *tg, bool rw, u64 *bytes,
+			      unsigned int *ios)
+{
+	u64 bps_limit = tg_bps_limit(tg, rw);
+	u32 iops_limit = tg_iops_limit(tg, rw);
+	unsigned long jiffy_elapsed = jiffies - tg->slice_start[rw];
+	unsigned long jiffy_elapsed_rnd;
+	u64 allowed;
+
+	*bytes = U64_MAX;
+	*ios = UINT_MAX;
+
+	if (bps_limit != U64_MAX) {
+		jiffy_elapsed_rnd = jiffy_elapsed ?: tg->td->throtl_slice;
+		jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd,
+					    tg->td->throtl_slice);
+		allowed = mul_u64_u64_div_u64(bps_limit, jiffy_elapsed_rnd, HZ);
+		if (allowed > tg->bytes_disp[rw])
+			*bytes = allowed - tg->bytes_disp[rw];
+		else
+			*bytes = 0;
+	}
+
+	if (iops_limit != UINT_MAX) {
+		jiffy_elapsed_rnd = roundup(jiffy_elapsed + 1,
+					    tg->td->throtl_slice);
+		allowed = (u64)iops_limit * jiffy_elapsed_rnd;
+		do_div(allowed, HZ);
+		allowed = min_t(u64, allowed, UINT_MAX - 1);
+		if (allowed > tg->io_disp[rw])
+			*ios = allowed - tg->io_disp[rw];
+		else
+			*ios = 0;
+	}
+}
+
+/*
+ * A bio from @leaf has just been dispatched directly through all the levels
+ * and @bytes and @ios are the smallest headroom left on the way up.  Charge
+ * a share of it to @leaf and all its ancestors at once and stash it as
+ * tokens on this CPU so that the following bios from @leaf can be
+ * dispatched without queue_lock and without walking the hierarchy.
+ *
+ * The tokens are dropped when @leaf starts a new slice or the limits
+ * change.  A new slice of an ancestor doesn't drop them, so an ancestor
+ * may overrun its limit by the tokens stashed below it.
+ */
+static void throtl_refill_tokens(struct throtl_grp *leaf, bool rw, u64 bytes,
+				 unsigned int ios)
+{
+	struct throtl_tokens *tk = this_cpu_ptr(leaf->tokens);
+	struct throtl_grp *tg;
+
+	lockdep_assert_held(&leaf->td->queue->queue_lock);
+
+	if (bytes != U64_MAX)
+		bytes = div_u64(bytes, THROTL_TOKEN_SHARE);
+	if (ios != UINT_MAX)
+		ios /= THROTL_TOKEN_SHARE;
+	if (!bytes || !ios)
+		return;
+
+	for (tg = leaf; tg; tg = sq_to_tg(tg->service_queue.parent_sq)) {
+		if (bytes != U64_MAX && tg_bps_limit(tg, rw) != U64_MAX)
+			tg->bytes_disp[rw] += bytes;
+		if (ios != UINT_MAX && tg_iops_limit(tg, rw) != UINT_MAX)
+			tg->io_disp[rw] += ios;
+	}
+
+	if (tk->gen[rw] != leaf->token_gen[rw]) {
+		tk->bytes[rw] = 0;
+		tk->ios[rw] = 0;
+		tk->gen[rw] = leaf->token_gen[rw];
+	}
+
+	if (bytes == U64_MAX || tk->bytes[rw] == U64_MAX)
+		tk->bytes[rw] = U64_MAX;
+	else
+		tk->bytes[rw] += bytes;
+
+	if (ios == UINT_MAX || tk->ios[rw] == UINT_MAX)
+		tk->ios[rw] = UINT_MAX;
+	else
+		tk->ios[rw] = min_t(u64, (u64)tk->ios[rw] + ios, UINT_MAX - 1);
+}
+
+/*
+ * Try to dispatch @bio from @tg with the tokens stashed on this CPU.  Bios
+ * must not overtake the ones already queued in @tg.
+ */
+static bool throtl_consume_tokens(struct throtl_grp *tg, struct bio *bio,
+				  bool rw)
+{
+	unsigned int bio_size = throtl_bio_data_size(bio);
+	struct throtl_tokens *tk;
+	unsigned long flags;
+	bool ret = false;
+
+	if (READ_ONCE(tg->service_queue.nr_queued[rw]))
+		return false;
+
+	local_irq_save(flags);
+	tk = this_cpu_ptr(tg->tokens);
+	if (tk->gen[rw] == READ_ONCE(tg->token_gen[rw]) &&
+	    tk->bytes[rw] >= bio_size && tk->ios[rw]) {
+		if (tk->bytes[rw] != U64_MAX)
+			tk->bytes[rw] -= bio_size;
+		if (tk->ios[rw] != UINT_MAX)
+			tk->ios[rw]--;
+		ret = true;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
 /**
  * throtl_add_bio_tg - add a bio to the specified throtl_grp
  * @bio: bio to add
@@ -1428,6 +1585,8 @@ static void tg_conf_updated(struct throtl_grp *tg, bool global)
 		struct throtl_grp *parent_tg;
 
 		tg_update_has_rules(this_tg);
+		throtl_invalidate_tokens(this_tg, READ);
+		throtl_invalidate_tokens(this_tg, WRITE);
 		/* ignore root/second level */
 		if (!cgroup_subsys_on_dfl(io_cgrp_subsys) || !blkg->parent ||
 		    !blkg->parent->parent)
@@ -2212,10 +2371,14 @@ bool blk_throtl_bio(struct bio *bio)
 	struct blkcg_gq *blkg = bio->bi_blkg;
 	struct throtl_qnode *qn = NULL;
 	struct throtl_grp *tg = blkg_to_tg(blkg);
+	struct throtl_grp *leaf = tg;
 	struct throtl_service_queue *sq;
 	bool rw = bio_data_dir(bio);
 	bool throttled = false;
 	struct throtl_data *td = tg->td;
+	u64 tok_bytes = U64_MAX;
+	unsigned int tok_ios = UINT_MAX;
+	bool refill;
 
 	rcu_read_lock();
 
@@ -2232,8 +2395,14 @@ bool blk_throtl_bio(struct bio *bio)
 	if (!tg->has_rules[rw])
 		goto out;
 
+	if (throtl_consume_tokens(tg, bio, rw))
+		goto out;
+
 	spin_lock_irq(&q->queue_lock);
 
+	/* low limits need every bio for their upgrade and downgrade checks */
+	refill = !td->limit_valid[LIMIT_LOW];
+
 	throtl_update_latency_buckets(td);
 
 	blk_throtl_update_idletime(tg);
@@ -2276,6 +2445,15 @@ bool blk_throtl_bio(struct bio *bio)
 		 */
 		throtl_trim_slice(tg, rw);
 
+		if (refill) {
+			u64 bytes;
+			unsigned int ios;
+
+			tg_slice_headroom(tg, rw, &bytes, &ios);
+			tok_bytes = min(tok_bytes, bytes);
+			tok_ios = min(tok_ios, ios);
+		}
+
 		/*
 		 * @bio passed through this layer without being throttled.
 		 * Climb up the ladder.  If we're already at the top, it
@@ -2284,8 +2462,12 @@ bool blk_throtl_bio(struct bio *bio)
 		qn = &tg->qnode_on_parent[rw];
 		sq = sq->parent_sq;
 		tg = sq_to_tg(sq);
-		if (!tg)
+		if (!tg) {
+			if (refill)
+				throtl_refill_tokens(leaf, rw, tok_bytes,
+						     tok_ios);
 			goto out_unlock;
+		}
 	}
 
 	/* out-of-limit, queue to @tg */
@@ -88,6 +88,8 @@ static ssize_t __blkdev_direct_IO_simple(struct kiocb *iocb,
 	if (unlikely(ret))
 		goto out;
 	ret = bio.bi_iter.bi_size;
+	if (iocb->ki_flags & IOCB_DMA_TAG)
+		bio.bi_dma_tag = iocb->private;
 
 	if (iov_iter_rw(iter) == READ) {
 		bio.bi_opf = REQ_OP_READ;
@@ -243,6 +245,8 @@ static ssize_t __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter,
 			bio_endio(bio);
 			break;
 		}
+		if (iocb->ki_flags & IOCB_DMA_TAG)
+			bio->bi_dma_tag = iocb->private;
 
 		if (is_read) {
 			bio->bi_opf = REQ_OP_READ;
@@ -59,9 +59,18 @@ struct io_stats_per_prio {
 	local_t completed;
 };
 
+/* Lock contention statistics, not tied to an I/O priority. */
+struct io_stats_lock {
+	local_t lock_contended;		/* dd->lock was busy on dispatch */
+	local_t insert_contended;	/* dd->insert_lock was busy */
+	local_t merge_skipped;		/* bio merge skipped, dd->lock busy */
+	local_t insert_batches;		/* insert lists moved into the trees */
+};
+
 /* I/O statistics for all I/O priorities (enum dd_prio). */
 struct io_stats {
 	struct io_stats_per_prio stats[DD_PRIO_COUNT];
+	struct io_stats_lock lock;
 };
 
 /*
@@ -101,6 +110,15 @@ struct deadline_data {
 
 	spinlock_t lock;
 	spinlock_t zone_lock;
+
+	/*
+	 * Requests are inserted here under insert_lock only, and moved into
+	 * the sort and FIFO lists in batches by the next dispatch, which
+	 * holds dd->lock. This keeps submitters off dd->lock.
+	 */
+	spinlock_t insert_lock;
+	struct list_head at_head;
+	struct list_head at_tail;
 };
 
 /* Count one event of type 'event_type' and with I/O priority 'prio' */
@@ -113,6 +131,15 @@ struct deadline_data {
 	put_cpu_ptr(io_stats);						\
 } while (0)
 
+/* Count one lock contention event of type 'event_type' */
+#define dd_count_lock(dd, event_type) do {				\
+	struct io_stats *io_stats = get_cpu_ptr((dd)->stats);		\
+									\
+	BUILD_BUG_ON(!__same_type((dd), struct deadline_data *));	\
+	local_inc(&io_stats->lock.event_type);				\
+	put_cpu_ptr(io_stats);						\
+} while (0)
+
 /*
  * Returns the total number of dd_count(dd, event_type, prio) calls across all
  * CPUs. No locking or barriers since it is fine if the returned sum is slightly
@@ -130,6 +157,18 @@ struct deadline_data {
 	sum;								\
 })
 
+/* Like dd_sum(), for the events counted with dd_count_lock() */
+#define dd_sum_lock(dd, event_type) ({					\
+	unsigned int cpu;						\
+	u32 sum = 0;							\
+									\
+	BUILD_BUG_ON(!__same_type((dd), struct deadline_data *));	\
+	for_each_present_cpu(cpu)					\
+		sum += local_read(&per_cpu_ptr((dd)->stats, cpu)->	\
+				  lock.event_type);			\
+	sum;								\
+})
+
 /* Maps an I/O priority class to a deadline scheduler priority. */
 static const enum dd_prio ioprio_class_to_prio[] = {
 	[IOPRIO_CLASS_NONE]	= DD_BE_PRIO,
@@ -466,6 +505,123 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd,
 	return rq;
 }
 
+/*
+ * add rq to rbtree and fifo
+ */
+static void dd_insert_request(struct request_queue *q, struct request *rq,
+			      bool at_head)
+{
+	struct deadline_data *dd = q->elevator->elevator_data;
+	const enum dd_data_dir data_dir = rq_data_dir(rq);
+	u16 ioprio = req_get_ioprio(rq);
+	u8 ioprio_class = IOPRIO_PRIO_CLASS(ioprio);
+	struct dd_per_prio *per_prio;
+	enum dd_prio prio;
+	LIST_HEAD(free);
+
+	lockdep_assert_held(&dd->lock);
+
+	/*
+	 * This may be a requeue of a write request that has locked its
+	 * target zone. If it is the case, this releases the zone lock.
+	 */
+	blk_req_zone_write_unlock(rq);
+
+	prio = ioprio_class_to_prio[ioprio_class];
+	dd_count(dd, inserted, prio);
+	rq->elv.priv[0] = (void *)(uintptr_t)1;
+
+	if (blk_mq_sched_try_insert_merge(q, rq, &free)) {
+		blk_mq_free_requests(&free);
+		return;
+	}
+
+	trace_block_rq_insert(rq);
+
+	per_prio = &dd->per_prio[prio];
+	if (at_head) {
+		list_add(&rq->queuelist, &per_prio->dispatch);
+	} else {
+		deadline_add_rq_rb(per_prio, rq);
+
+		if (rq_mergeable(rq)) {
+			elv_rqhash_add(q, rq);
+			if (!q->last_merge)
+				q->last_merge = rq;
+		}
+
+		/*
+		 * set expire time and add to fifo list
+		 */
+		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
+		list_add_tail(&rq->queuelist, &per_prio->fifo_list[data_dir]);
+	}
+}
+
+static void dd_insert_list(struct request_queue *q, struct list_head *list,
+			   bool at_head)
+{
+	while (!list_empty(list)) {
+		struct request *rq;
+
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		dd_insert_request(q, rq, at_head);
+	}
+}
+
+/*
+ * Move the requests of the insert lists into the sort and FIFO lists. Called
+ * with dd->lock held, so that all the requests inserted since the previous
+ * dispatch are sorted in one go.
+ */
+static void dd_do_insert(struct request_queue *q, struct deadline_data *dd)
+{
+	LIST_HEAD(at_head);
+	LIST_HEAD(at_tail);
+
+	lockdep_assert_held(&dd->lock);
+
+	if (list_empty_careful(&dd->at_head) &&
+	    list_empty_careful(&dd->at_tail))
+		return;
+
+	spin_lock(&dd->insert_lock);
+	list_splice_init(&dd->at_head, &at_head);
+	list_splice_init(&dd->at_tail, &at_tail);
+	spin_unlock(&dd->insert_lock);
+
+	dd_count_lock(dd, insert_batches);
+	dd_insert_list(q, &at_head, true);
+	dd_insert_list(q, &at_tail, false);
+}
+
+/*
+ * Called from blk_mq_sched_insert_request() or blk_mq_sched_insert_requests().
+ * The requests are only queued on the insert lists; they are sorted by
+ * dd_do_insert() on the next dispatch.
+ */
+static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
+			       struct list_head *list, bool at_head)
+{
+	struct request_queue *q = hctx->queue;
+	struct deadline_data *dd = q->elevator->elevator_data;
+
+	if (!spin_trylock(&dd->insert_lock)) {
+		dd_count_lock(dd, insert_contended);
+		spin_lock(&dd->insert_lock);
+	}
+	/*
+	 * Keep the order of the list for the at_head requests too, as each of
+	 * them is added to the head of the dispatch list in that order.
+	 */
+	if (at_head)
+		list_splice_tail_init(list, &dd->at_head);
+	else
+		list_splice_tail_init(list, &dd->at_tail);
+	spin_unlock(&dd->insert_lock);
+}
+
 /*
  * Called from blk_mq_run_hw_queue() -> __blk_mq_sched_dispatch_requests().
  *
@@ -480,7 +636,11 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	struct request *rq;
 	enum dd_prio prio;
 
-	spin_lock(&dd->lock);
+	if (!spin_trylock(&dd->lock)) {
+		dd_count_lock(dd, lock_contended);
+		spin_lock(&dd->lock);
+	}
+	dd_do_insert(hctx->queue, dd);
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++) {
 		rq = __dd_dispatch_request(dd, &dd->per_prio[prio]);
 		if (rq)
@@ -540,6 +700,8 @@ static void dd_exit_sched(struct elevator_queue *e)
 		WARN_ON_ONCE(!list_empty(&per_prio->fifo_list[DD_READ]));
 		WARN_ON_ONCE(!list_empty(&per_prio->fifo_list[DD_WRITE]));
 	}
+	WARN_ON_ONCE(!list_empty(&dd->at_head));
+	WARN_ON_ONCE(!list_empty(&dd->at_tail));
 
 	free_percpu(dd->stats);
 
@@ -588,6 +750,9 @@ static int dd_init_sched(struct request_queue *q, struct elevator_type *e)
 	dd->fifo_batch = fifo_batch;
 	spin_lock_init(&dd->lock);
 	spin_lock_init(&dd->zone_lock);
+	spin_lock_init(&dd->insert_lock);
+	INIT_LIST_HEAD(&dd->at_head);
+	INIT_LIST_HEAD(&dd->at_tail);
 
 	q->elevator = eq;
 	return 0;
@@ -643,7 +808,14 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
 	struct request *free = NULL;
 	bool ret;
 
-	spin_lock(&dd->lock);
+	/*
+	 * Merging is opportunistic. Don't wait for dd->lock if a dispatch
+	 * holds it, the bio is then submitted as a request of its own.
+	 */
+	if (!spin_trylock(&dd->lock)) {
+		dd_count_lock(dd, merge_skipped);
+		return false;
+	}
 	ret = blk_mq_sched_try_merge(q, bio, nr_segs, &free);
 	spin_unlock(&dd->lock);
 
@@ -653,80 +825,6 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
 	return ret;
 }
 
-/*
- * add rq to rbtree and fifo
- */
-static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
-			      bool at_head)
-{
-	struct request_queue *q = hctx->queue;
-	struct deadline_data *dd = q->elevator->elevator_data;
-	const enum dd_data_dir data_dir = rq_data_dir(rq);
-	u16 ioprio = req_get_ioprio(rq);
-	u8 ioprio_class = IOPRIO_PRIO_CLASS(ioprio);
-	struct dd_per_prio *per_prio;
-	enum dd_prio prio;
-	LIST_HEAD(free);
-
-	lockdep_assert_held(&dd->lock);
-
-	/*
-	 * This may be a requeue of a write request that has locked its
-	 * target zone. If it is the case, this releases the zone lock.
-	 */
-	blk_req_zone_write_unlock(rq);
-
-	prio = ioprio_class_to_prio[ioprio_class];
-	dd_count(dd, inserted, prio);
-	rq->elv.priv[0] = (void *)(uintptr_t)1;
-
-	if (blk_mq_sched_try_insert_merge(q, rq, &free)) {
-		blk_mq_free_requests(&free);
-		return;
-	}
-
-	trace_block_rq_insert(rq);
-
-	per_prio = &dd->per_prio[prio];
-	if (at_head) {
-		list_add(&rq->queuelist, &per_prio->dispatch);
-	} else {
-		deadline_add_rq_rb(per_prio, rq);
-
-		if (rq_mergeable(rq)) {
-			elv_rqhash_add(q, rq);
-			if (!q->last_merge)
-				q->last_merge = rq;
-		}
-
-		/*
-		 * set expire time and add to fifo list
-		 */
-		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
-		list_add_tail(&rq->queuelist, &per_prio->fifo_list[data_dir]);
-	}
-}
-
-/*
- * Called from blk_mq_sched_insert_request() or blk_mq_sched_insert_requests().
- */
-static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
-			       struct list_head *list, bool at_head)
-{
-	struct request_queue *q = hctx->queue;
-	struct deadline_data *dd = q->elevator->elevator_data;
-
-	spin_lock(&dd->lock);
-	while (!list_empty(list)) {
-		struct request *rq;
-
-		rq = list_first_entry(list, struct request, queuelist);
-		list_del_init(&rq->queuelist);
-		dd_insert_request(hctx, rq, at_head);
-	}
-	spin_unlock(&dd->lock);
-}
-
 /* Callback from inside blk_mq_rq_ctx_init(). */
 static void dd_prepare_request(struct request *rq)
 {
@@ -771,7 +869,8 @@ static void dd_finish_request(struct request *rq)
 
 		spin_lock_irqsave(&dd->zone_lock, flags);
 		blk_req_zone_write_unlock(rq);
-		if (!list_empty(&per_prio->fifo_list[DD_WRITE]))
+		if (!list_empty(&per_prio->fifo_list[DD_WRITE]) ||
+		    !list_empty_careful(&dd->at_tail))
 			blk_mq_sched_mark_restart_hctx(rq->mq_hctx);
 		spin_unlock_irqrestore(&dd->zone_lock, flags);
 	}
@@ -789,6 +888,10 @@ static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 	enum dd_prio prio;
 
+	if (!list_empty_careful(&dd->at_head) ||
+	    !list_empty_careful(&dd->at_tail))
+		return true;
+
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++)
 		if (dd_has_work_for_prio(&dd->per_prio[prio]))
 			return true;
@@ -982,6 +1085,19 @@ static int dd_owned_by_driver_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int dd_contention_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct deadline_data *dd = q->elevator->elevator_data;
+
+	seq_printf(m, "lock_contended %u\n", dd_sum_lock(dd, lock_contended));
+	seq_printf(m, "insert_contended %u\n",
+		   dd_sum_lock(dd, insert_contended));
+	seq_printf(m, "merge_skipped %u\n", dd_sum_lock(dd, merge_skipped));
+	seq_printf(m, "insert_batches %u\n", dd_sum_lock(dd, insert_batches));
+	return 0;
+}
+
 #define DEADLINE_DISPATCH_ATTR(prio)					\
 static void *deadline_dispatch##prio##_start(struct seq_file *m,	\
 					     loff_t *pos)		\
@@ -1052,6 +1168,7 @@ static const struct blk_mq_debugfs_attr deadline_queue_debugfs_attrs[] = {
 	{"dispatch2", 0400, .seq_ops = &deadline_dispatch2_seq_ops},
 	{"owned_by_driver", 0400, dd_owned_by_driver_show},
 	{"queued", 0400, dd_queued_show},
+	{"contention", 0400, dd_contention_show},
 	{},
 };
 #undef DEADLINE_QUEUE_DDIR_ATTRS
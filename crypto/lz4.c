@@ -9,6 +9,7 @@
 #include <linux/module.h>
 #include <linux/crypto.h>
 #include <linux/vmalloc.h>
+#include <linux/workspace_pool.h>
 #include <linux/lz4.h>
 #include <crypto/internal/scompress.h>
 
@@ -63,11 +64,78 @@ static int __lz4_compress_crypto(const u8 *src, unsigned int slen,
 	return 0;
 }
 
+/*
+ * scomp contexts are per request and only used under the per-CPU scratch
+ * lock, so they share their compression memory through a workspace pool
+ * rather than each allocating their own.
+ */
+struct lz4_workspace {
+	struct workspace_pool_entry entry;
+	void *mem;
+};
+
+static struct workspace_pool lz4_pool;
+
+static struct workspace_pool_entry *lz4_alloc_workspace(int nid)
+{
+	struct lz4_workspace *ws;
+
+	ws = kmalloc_node(sizeof(*ws), GFP_KERNEL, nid);
+	if (!ws)
+		return NULL;
+
+	ws->mem = vmalloc_node(LZ4_MEM_COMPRESS, nid);
+	if (!ws->mem) {
+		kfree(ws);
+		return NULL;
+	}
+
+	return &ws->entry;
+}
+
+static void lz4_free_workspace(struct workspace_pool_entry *entry)
+{
+	struct lz4_workspace *ws =
+		container_of(entry, struct lz4_workspace, entry);
+
+	vfree(ws->mem);
+	kfree(ws);
+}
+
+static void *lz4_scomp_alloc_ctx(struct crypto_scomp *tfm)
+{
+	int ret;
+
+	ret = workspace_pool_reserve(&lz4_pool);
+	if (ret)
+		return ERR_PTR(ret);
+
+	/* Nothing per context, but it must not look like an error */
+	return &lz4_pool;
+}
+
+static void lz4_scomp_free_ctx(struct crypto_scomp *tfm, void *ctx)
+{
+	workspace_pool_unreserve(&lz4_pool);
+}
+
 static int lz4_scompress(struct crypto_scomp *tfm, const u8 *src,
 			 unsigned int slen, u8 *dst, unsigned int *dlen,
 			 void *ctx)
 {
-	return __lz4_compress_crypto(src, slen, dst, dlen, ctx);
+	struct workspace_pool_entry *entry;
+	int ret;
+
+	entry = workspace_pool_get(&lz4_pool);
+	if (WARN_ON_ONCE(!entry))
+		return -EBUSY;
+
+	ret = __lz4_compress_crypto(src, slen, dst, dlen,
+				    container_of(entry, struct lz4_workspace,
+						 entry)->mem);
+	workspace_pool_put(&lz4_pool, entry);
+
+	return ret;
 }
 
 static int lz4_compress_crypto(struct crypto_tfm *tfm, const u8 *src,
@@ -118,8 +186,8 @@ static struct crypto_alg alg_lz4 = {
 };
 
 static struct scomp_alg scomp = {
-	.alloc_ctx		= lz4_alloc_ctx,
-	.free_ctx		= lz4_free_ctx,
+	.alloc_ctx		= lz4_scomp_alloc_ctx,
+	.free_ctx		= lz4_scomp_free_ctx,
 	.compress		= lz4_scompress,
 	.decompress		= lz4_sdecompress,
 	.base			= {
@@ -133,23 +201,33 @@ static int __init lz4_mod_init(void)
 {
 	int ret;
 
-	ret = crypto_register_alg(&alg_lz4);
+	ret = workspace_pool_init(&lz4_pool, lz4_alloc_workspace,
+				  lz4_free_workspace);
 	if (ret)
 		return ret;
 
+	ret = crypto_register_alg(&alg_lz4);
+	if (ret)
+		goto destroy_pool;
+
 	ret = crypto_register_scomp(&scomp);
 	if (ret) {
 		crypto_unregister_alg(&alg_lz4);
-		return ret;
+		goto destroy_pool;
 	}
 
 	return ret;
+
+destroy_pool:
+	workspace_pool_destroy(&lz4_pool);
+	return ret;
 }
 
 static void __exit lz4_mod_fini(void)
 {
 	crypto_unregister_alg(&alg_lz4);
 	crypto_unregister_scomp(&scomp);
+	workspace_pool_destroy(&lz4_pool);
 }
 
 subsys_initcall(lz4_mod_init);
@@ -15,6 +15,7 @@
 #include <linux/slab.h>
 #include <linux/kobject.h>
 #include <linux/cpu.h>
+#include <linux/topology.h>
 #include <crypto/pcrypt.h>
 
 static struct padata_instance *pencrypt;
@@ -168,20 +169,42 @@ static int pcrypt_aead_decrypt(struct aead_request *req)
 	return err;
 }
 
+/*
+ * Each tfm, i.e. each IPsec SA, gets a fixed callback CPU so all of its
+ * packets are serialized in one place, and padata runs the parallel part on
+ * the node of that CPU.  Spread the tfms over the CPUs of the node they are
+ * set up on, which is normally where the traffic of the SA arrives.
+ */
+static unsigned int pcrypt_pick_cb_cpu(struct pcrypt_instance_ctx *ictx)
+{
+	const struct cpumask *mask = cpumask_of_node(numa_node_id());
+	unsigned int cpu, i, cpu_index, weight = 0;
+
+	for_each_cpu_and(cpu, mask, cpu_online_mask)
+		weight++;
+
+	if (!weight) {
+		mask = cpu_online_mask;
+		weight = cpumask_weight(mask);
+	}
+
+	i = 0;
+	cpu_index = (unsigned int)atomic_inc_return(&ictx->tfm_count) % weight;
+	for_each_cpu_and(cpu, mask, cpu_online_mask)
+		if (i++ == cpu_index)
+			break;
+
+	return cpu;
+}
+
 static int pcrypt_aead_init_tfm(struct crypto_aead *tfm)
 {
-	int cpu, cpu_index;
 	struct aead_instance *inst = aead_alg_instance(tfm);
 	struct pcrypt_instance_ctx *ictx = aead_instance_ctx(inst);
 	struct pcrypt_aead_ctx *ctx = crypto_aead_ctx(tfm);
 	struct crypto_aead *cipher;
 
-	cpu_index = (unsigned int)atomic_inc_return(&ictx->tfm_count) %
-		    cpumask_weight(cpu_online_mask);
-
-	ctx->cb_cpu = cpumask_first(cpu_online_mask);
-	for (cpu = 0; cpu < cpu_index; cpu++)
-		ctx->cb_cpu = cpumask_next(ctx->cb_cpu, cpu_online_mask);
+	ctx->cb_cpu = pcrypt_pick_cb_cpu(ictx);
 
 	cipher = crypto_spawn_aead(&ictx->spawn);
 
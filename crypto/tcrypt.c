@@ -3034,6 +3034,18 @@ static int do_test(const char *alg, u32 type, u32 mask, int m, u32 num_mb)
 				       speed_template_8_32, num_mb);
 		break;
 
+	case 610:
+		/* x86 AES-NI vs. VAES/AVX-512 xts(aes), by driver name */
+		test_acipher_speed("xts-aes-aesni", ENCRYPT, sec, NULL, 0,
+				   speed_template_32_64);
+		test_acipher_speed("xts-aes-aesni", DECRYPT, sec, NULL, 0,
+				   speed_template_32_64);
+		test_acipher_speed("xts-aes-vaes-avx512", ENCRYPT, sec, NULL, 0,
+				   speed_template_32_64);
+		test_acipher_speed("xts-aes-vaes-avx512", DECRYPT, sec, NULL, 0,
+				   speed_template_32_64);
+		break;
+
 	case 1000:
 		test_available();
 		break;
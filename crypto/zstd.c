@@ -11,6 +11,7 @@
 #include <linux/module.h>
 #include <linux/net.h>
 #include <linux/vmalloc.h>
+#include <linux/workspace_pool.h>
 #include <linux/zstd.h>
 #include <crypto/internal/scompress.h>
 
@@ -103,22 +104,109 @@ static int __zstd_init(void *ctx)
 	return ret;
 }
 
+/*
+ * The scomp interface allocates a context per request but always calls in
+ * with preemption disabled, under the per-CPU scratch lock.  So instead of
+ * giving every context its own workspaces, which are large for zstd, share
+ * them between all contexts through workspace pools.
+ */
+struct zstd_workspace {
+	struct workspace_pool_entry entry;
+	union {
+		ZSTD_CCtx *cctx;
+		ZSTD_DCtx *dctx;
+	};
+	void *mem;
+};
+
+static struct workspace_pool zstd_cpool;
+static struct workspace_pool zstd_dpool;
+
+static struct zstd_workspace *zstd_alloc_workspace(size_t size, int nid)
+{
+	struct zstd_workspace *ws;
+
+	ws = kzalloc_node(sizeof(*ws), GFP_KERNEL, nid);
+	if (!ws)
+		return NULL;
+
+	ws->mem = vzalloc_node(size, nid);
+	if (!ws->mem) {
+		kfree(ws);
+		return NULL;
+	}
+
+	return ws;
+}
+
+static void zstd_free_workspace(struct workspace_pool_entry *entry)
+{
+	struct zstd_workspace *ws =
+		container_of(entry, struct zstd_workspace, entry);
+
+	vfree(ws->mem);
+	kfree(ws);
+}
+
+static struct workspace_pool_entry *zstd_alloc_cworkspace(int nid)
+{
+	const ZSTD_parameters params = zstd_params();
+	const size_t wksp_size = ZSTD_CCtxWorkspaceBound(params.cParams);
+	struct zstd_workspace *ws;
+
+	ws = zstd_alloc_workspace(wksp_size, nid);
+	if (!ws)
+		return NULL;
+
+	ws->cctx = ZSTD_initCCtx(ws->mem, wksp_size);
+	if (!ws->cctx) {
+		zstd_free_workspace(&ws->entry);
+		return NULL;
+	}
+
+	return &ws->entry;
+}
+
+static struct workspace_pool_entry *zstd_alloc_dworkspace(int nid)
+{
+	const size_t wksp_size = ZSTD_DCtxWorkspaceBound();
+	struct zstd_workspace *ws;
+
+	ws = zstd_alloc_workspace(wksp_size, nid);
+	if (!ws)
+		return NULL;
+
+	ws->dctx = ZSTD_initDCtx(ws->mem, wksp_size);
+	if (!ws->dctx) {
+		zstd_free_workspace(&ws->entry);
+		return NULL;
+	}
+
+	return &ws->entry;
+}
+
 static void *zstd_alloc_ctx(struct crypto_scomp *tfm)
 {
 	int ret;
-	struct zstd_ctx *ctx;
 
-	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
-	if (!ctx)
-		return ERR_PTR(-ENOMEM);
+	ret = workspace_pool_reserve(&zstd_cpool);
+	if (ret)
+		return ERR_PTR(ret);
 
-	ret = __zstd_init(ctx);
+	ret = workspace_pool_reserve(&zstd_dpool);
 	if (ret) {
-		kfree(ctx);
+		workspace_pool_unreserve(&zstd_cpool);
 		return ERR_PTR(ret);
 	}
 
-	return ctx;
+	/* Nothing per context, but it must not look like an error */
+	return &zstd_cpool;
+}
+
+static void zstd_free_ctx(struct crypto_scomp *tfm, void *ctx)
+{
+	workspace_pool_unreserve(&zstd_dpool);
+	workspace_pool_unreserve(&zstd_cpool);
 }
 
 static int zstd_init(struct crypto_tfm *tfm)
@@ -134,11 +222,6 @@ static void __zstd_exit(void *ctx)
 	zstd_decomp_exit(ctx);
 }
 
-static void zstd_free_ctx(struct crypto_scomp *tfm, void *ctx)
-{
-	__zstd_exit(ctx);
-	kfree_sensitive(ctx);
-}
 
 static void zstd_exit(struct crypto_tfm *tfm)
 {
@@ -173,7 +256,19 @@ static int zstd_scompress(struct crypto_scomp *tfm, const u8 *src,
 			  unsigned int slen, u8 *dst, unsigned int *dlen,
 			  void *ctx)
 {
-	return __zstd_compress(src, slen, dst, dlen, ctx);
+	struct workspace_pool_entry *entry;
+	struct zstd_ctx zctx = {};
+	int ret;
+
+	entry = workspace_pool_get(&zstd_cpool);
+	if (WARN_ON_ONCE(!entry))
+		return -EBUSY;
+
+	zctx.cctx = container_of(entry, struct zstd_workspace, entry)->cctx;
+	ret = __zstd_compress(src, slen, dst, dlen, &zctx);
+	workspace_pool_put(&zstd_cpool, entry);
+
+	return ret;
 }
 
 static int __zstd_decompress(const u8 *src, unsigned int slen,
@@ -201,7 +296,19 @@ static int zstd_sdecompress(struct crypto_scomp *tfm, const u8 *src,
 			    unsigned int slen, u8 *dst, unsigned int *dlen,
 			    void *ctx)
 {
-	return __zstd_decompress(src, slen, dst, dlen, ctx);
+	struct workspace_pool_entry *entry;
+	struct zstd_ctx zctx = {};
+	int ret;
+
+	entry = workspace_pool_get(&zstd_dpool);
+	if (WARN_ON_ONCE(!entry))
+		return -EBUSY;
+
+	zctx.dctx = container_of(entry, struct zstd_workspace, entry)->dctx;
+	ret = __zstd_decompress(src, slen, dst, dlen, &zctx);
+	workspace_pool_put(&zstd_dpool, entry);
+
+	return ret;
 }
 
 static struct crypto_alg alg = {
@@ -233,14 +340,32 @@ static int __init zstd_mod_init(void)
 {
 	int ret;
 
-	ret = crypto_register_alg(&alg);
+	ret = workspace_pool_init(&zstd_cpool, zstd_alloc_cworkspace,
+				  zstd_free_workspace);
 	if (ret)
 		return ret;
 
+	ret = workspace_pool_init(&zstd_dpool, zstd_alloc_dworkspace,
+				  zstd_free_workspace);
+	if (ret)
+		goto destroy_cpool;
+
+	ret = crypto_register_alg(&alg);
+	if (ret)
+		goto destroy_dpool;
+
 	ret = crypto_register_scomp(&scomp);
 	if (ret)
-		crypto_unregister_alg(&alg);
+		goto unregister_alg;
+
+	return 0;
 
+unregister_alg:
+	crypto_unregister_alg(&alg);
+destroy_dpool:
+	workspace_pool_destroy(&zstd_dpool);
+destroy_cpool:
+	workspace_pool_destroy(&zstd_cpool);
 	return ret;
 }
 
@@ -248,6 +373,8 @@ static void __exit zstd_mod_fini(void)
 {
 	crypto_unregister_alg(&alg);
 	crypto_unregister_scomp(&scomp);
+	workspace_pool_destroy(&zstd_dpool);
+	workspace_pool_destroy(&zstd_cpool);
 }
 
 subsys_initcall(zstd_mod_init);
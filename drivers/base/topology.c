@@ -48,6 +48,9 @@ static DEVICE_ATTR_RO(physical_package_id);
 define_id_show_func(die_id);
 static DEVICE_ATTR_RO(die_id);
 
+define_id_show_func(cluster_id);
+static DEVICE_ATTR_RO(cluster_id);
+
 define_id_show_func(core_id);
 static DEVICE_ATTR_RO(core_id);
 
@@ -59,6 +62,10 @@ define_siblings_read_func(core_cpus, sibling_cpumask);
 static BIN_ATTR_RO(core_cpus, CPUMAP_FILE_MAX_BYTES);
 static BIN_ATTR_RO(core_cpus_list, CPULIST_FILE_MAX_BYTES);
 
+define_siblings_read_func(cluster_cpus, cluster_cpumask);
+static BIN_ATTR_RO(cluster_cpus, CPUMAP_FILE_MAX_BYTES);
+static BIN_ATTR_RO(cluster_cpus_list, CPULIST_FILE_MAX_BYTES);
+
 define_siblings_read_func(core_siblings, core_cpumask);
 static BIN_ATTR_RO(core_siblings, CPUMAP_FILE_MAX_BYTES);
 static BIN_ATTR_RO(core_siblings_list, CPULIST_FILE_MAX_BYTES);
@@ -92,6 +99,8 @@ static struct bin_attribute *bin_attrs[] = {
 	&bin_attr_core_cpus_list,
 	&bin_attr_thread_siblings,
 	&bin_attr_thread_siblings_list,
+	&bin_attr_cluster_cpus,
+	&bin_attr_cluster_cpus_list,
 	&bin_attr_core_siblings,
 	&bin_attr_core_siblings_list,
 	&bin_attr_die_cpus,
@@ -112,6 +121,7 @@ static struct bin_attribute *bin_attrs[] = {
 static struct attribute *default_attrs[] = {
 	&dev_attr_physical_package_id.attr,
 	&dev_attr_die_id.attr,
+	&dev_attr_cluster_id.attr,
 	&dev_attr_core_id.attr,
 #ifdef CONFIG_SCHED_BOOK
 	&dev_attr_book_id.attr,
@@ -42,10 +42,14 @@
 #include <linux/interval_tree.h>
 #include <linux/hmm.h>
 #include <linux/pagemap.h>
+#include <linux/sizes.h>
+#include <linux/wait_bit.h>
+#include <linux/workqueue.h>
 
 #include <rdma/ib_verbs.h>
 #include <rdma/ib_umem.h>
 #include <rdma/ib_umem_odp.h>
+#include <rdma/restrack.h>
 
 #include "uverbs.h"
 
@@ -56,6 +60,7 @@ static inline int ib_init_umem_odp(struct ib_umem_odp *umem_odp,
 
 	umem_odp->umem.is_odp = 1;
 	mutex_init(&umem_odp->umem_mutex);
+	atomic_set(&umem_odp->num_prefetch, 0);
 
 	if (!umem_odp->is_implicit_odp) {
 		size_t page_size = 1UL << umem_odp->page_shift;
@@ -272,6 +277,9 @@ void ib_umem_odp_release(struct ib_umem_odp *umem_odp)
 	 * that the hardware will not attempt to access the MR any more.
 	 */
 	if (!umem_odp->is_implicit_odp) {
+		wait_var_event(&umem_odp->num_prefetch,
+			       !atomic_read(&umem_odp->num_prefetch));
+
 		mutex_lock(&umem_odp->umem_mutex);
 		ib_umem_odp_unmap_dma_pages(umem_odp, ib_umem_start(umem_odp),
 					    ib_umem_end(umem_odp));
@@ -326,28 +334,29 @@ static int ib_umem_odp_map_dma_single_page(
 	return 0;
 }
 
-/**
- * ib_umem_odp_map_dma_and_lock - DMA map userspace memory in an ODP MR and lock it.
- *
- * Maps the range passed in the argument to DMA addresses.
- * The DMA addresses of the mapped pages is updated in umem_odp->dma_list.
- * Upon success the ODP MR will be locked to let caller complete its device
- * page table update.
- *
- * Returns the number of pages mapped in success, negative error code
- * for failure.
- * @umem_odp: the umem to map and pin
- * @user_virt: the address from which we need to map.
- * @bcnt: the minimal number of bytes to pin and map. The mapping might be
- *        bigger due to alignment, and may also be smaller in case of an error
- *        pinning or mapping a page. The actual pages mapped is returned in
- *        the return value.
- * @access_mask: bit mask of the requested access permissions for the given
- *               range.
- * @fault: is faulting required for the given range
+/*
+ * If the last page of a faulted range is part of a THP or hugetlb mapping,
+ * the rest of that mapping is present as well.  Return the end of the
+ * mapping so the caller can map it in the same pass, instead of the device
+ * faulting again on every following page.
  */
-int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 user_virt,
-				 u64 bcnt, u64 access_mask, bool fault)
+static unsigned long ib_umem_odp_huge_end(struct ib_umem_odp *umem_odp,
+					  struct hmm_range *range,
+					  unsigned long num_pfns)
+{
+	unsigned long last = range->hmm_pfns[num_pfns - 1];
+	unsigned long end;
+
+	if (!(last & HMM_PFN_VALID))
+		return range->end;
+
+	end = ALIGN(range->end, 1UL << (hmm_pfn_to_map_order(last) + PAGE_SHIFT));
+	return min(end, ib_umem_end(umem_odp));
+}
+
+static int __ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp,
+					  u64 user_virt, u64 bcnt,
+					  u64 access_mask, bool fault)
 			__acquires(&umem_odp->umem_mutex)
 {
 	struct task_struct *owning_process  = NULL;
@@ -357,6 +366,7 @@ int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 user_virt,
 	unsigned long num_pfns, current_seq;
 	struct hmm_range range = {};
 	unsigned long timeout;
+	bool extended = false;
 
 	if (access_mask == 0)
 		return -EINVAL;
@@ -406,6 +416,18 @@ int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 user_virt,
 		goto out_put_mm;
 	}
 
+	if (fault && !extended) {
+		unsigned long end = ib_umem_odp_huge_end(umem_odp, &range,
+							 num_pfns);
+
+		extended = true;
+		if (end > range.end) {
+			range.end = end;
+			num_pfns = (range.end - range.start) >> PAGE_SHIFT;
+			goto retry;
+		}
+	}
+
 	start_idx = (range.start - ib_umem_start(umem_odp)) >> page_shift;
 	dma_index = start_idx;
 
@@ -469,6 +491,44 @@ int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 user_virt,
 		put_task_struct(owning_process);
 	return ret;
 }
+
+/**
+ * ib_umem_odp_map_dma_and_lock - DMA map userspace memory in an ODP MR and lock it.
+ *
+ * Maps the range passed in the argument to DMA addresses.
+ * The DMA addresses of the mapped pages is updated in umem_odp->dma_list.
+ * Upon success the ODP MR will be locked to let caller complete its device
+ * page table update.
+ *
+ * Returns the number of pages mapped in success, negative error code
+ * for failure.
+ * @umem_odp: the umem to map and pin
+ * @user_virt: the address from which we need to map.
+ * @bcnt: the minimal number of bytes to pin and map. The mapping might be
+ *        bigger due to alignment, and may also be smaller in case of an error
+ *        pinning or mapping a page. The actual pages mapped is returned in
+ *        the return value.
+ * @access_mask: bit mask of the requested access permissions for the given
+ *               range.
+ * @fault: is faulting required for the given range
+ *
+ * When faulting, a range ending inside a THP or hugetlb mapping is extended
+ * to the end of that mapping.
+ */
+int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 user_virt,
+				 u64 bcnt, u64 access_mask, bool fault)
+			__acquires(&umem_odp->umem_mutex)
+{
+	int ret;
+
+	ret = __ib_umem_odp_map_dma_and_lock(umem_odp, user_virt, bcnt,
+					     access_mask, fault);
+	if (ret >= 0) {
+		umem_odp->stats.page_faults++;
+		umem_odp->stats.fault_pages += ret;
+	}
+	return ret;
+}
 EXPORT_SYMBOL(ib_umem_odp_map_dma_and_lock);
 
 void ib_umem_odp_unmap_dma_pages(struct ib_umem_odp *umem_odp, u64 virt,
@@ -516,3 +576,135 @@ void ib_umem_odp_unmap_dma_pages(struct ib_umem_odp *umem_odp, u64 virt,
 	}
 }
 EXPORT_SYMBOL(ib_umem_odp_unmap_dma_pages);
+
+/* Map at most this much at a time, so umem_mutex isn't held for too long */
+#define ODP_PREFETCH_CHUNK	SZ_8M
+
+/**
+ * ib_umem_odp_prefetch - Fault in and DMA map a range of an ODP umem.
+ *
+ * Populates the page and DMA lists for the range without touching the
+ * device page tables, so later device faults on the range only have to
+ * program the device.  Drivers can use this to implement advise_mr().
+ * Must not be used on implicit ODP umems.
+ *
+ * Returns 0 on success or a negative error code.
+ * @umem_odp: the umem to map
+ * @user_virt: the address from which to map
+ * @bcnt: the number of bytes to map
+ * @access_mask: bit mask of the requested access permissions
+ * @fault: whether to fault in pages that are not present
+ */
+int ib_umem_odp_prefetch(struct ib_umem_odp *umem_odp, u64 user_virt,
+			 u64 bcnt, u64 access_mask, bool fault)
+{
+	u64 end, len;
+	int ret;
+
+	if (check_add_overflow(user_virt, bcnt, &end))
+		return -EOVERFLOW;
+
+	while (user_virt < end) {
+		len = min_t(u64, end - user_virt,
+			    ODP_PREFETCH_CHUNK -
+			    (user_virt & (ODP_PREFETCH_CHUNK - 1)));
+
+		ret = __ib_umem_odp_map_dma_and_lock(umem_odp, user_virt, len,
+						     access_mask, fault);
+		if (ret < 0)
+			return ret;
+		umem_odp->stats.prefetch_pages += ret;
+		mutex_unlock(&umem_odp->umem_mutex);
+
+		user_virt += len;
+		cond_resched();
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(ib_umem_odp_prefetch);
+
+struct ib_umem_odp_prefetch_work {
+	struct work_struct work;
+	struct ib_umem_odp *umem_odp;
+	u64 user_virt;
+	u64 bcnt;
+	u64 access_mask;
+	bool fault;
+};
+
+static void ib_umem_odp_prefetch_work(struct work_struct *w)
+{
+	struct ib_umem_odp_prefetch_work *work =
+		container_of(w, struct ib_umem_odp_prefetch_work, work);
+	struct ib_umem_odp *umem_odp = work->umem_odp;
+
+	ib_umem_odp_prefetch(umem_odp, work->user_virt, work->bcnt,
+			     work->access_mask, work->fault);
+	kfree(work);
+
+	if (atomic_dec_and_test(&umem_odp->num_prefetch))
+		wake_up_var(&umem_odp->num_prefetch);
+}
+
+/**
+ * ib_umem_odp_prefetch_async - Queue ib_umem_odp_prefetch() on a workqueue.
+ *
+ * Errors of the prefetch itself are not reported, the range is then simply
+ * faulted in on access.  ib_umem_odp_release() waits for queued prefetches.
+ *
+ * Returns 0 on success or -ENOMEM.
+ * @umem_odp: the umem to map
+ * @user_virt: the address from which to map
+ * @bcnt: the number of bytes to map
+ * @access_mask: bit mask of the requested access permissions
+ * @fault: whether to fault in pages that are not present
+ */
+int ib_umem_odp_prefetch_async(struct ib_umem_odp *umem_odp, u64 user_virt,
+			       u64 bcnt, u64 access_mask, bool fault)
+{
+	struct ib_umem_odp_prefetch_work *work;
+
+	work = kmalloc(sizeof(*work), GFP_KERNEL);
+	if (!work)
+		return -ENOMEM;
+
+	INIT_WORK(&work->work, ib_umem_odp_prefetch_work);
+	work->umem_odp = umem_odp;
+	work->user_virt = user_virt;
+	work->bcnt = bcnt;
+	work->access_mask = access_mask;
+	work->fault = fault;
+
+	atomic_inc(&umem_odp->num_prefetch);
+	queue_work(system_unbound_wq, &work->work);
+	return 0;
+}
+EXPORT_SYMBOL(ib_umem_odp_prefetch_async);
+
+/**
+ * ib_umem_odp_fill_stat_entry - Report the fault statistics of an ODP umem.
+ *
+ * For use in the fill_stat_mr_entry() device op, inside the
+ * RDMA_NLDEV_ATTR_STAT_HWCOUNTERS nest.
+ *
+ * Returns 0 on success or -EMSGSIZE.
+ * @msg: the netlink message
+ * @umem_odp: the umem of the MR
+ */
+int ib_umem_odp_fill_stat_entry(struct sk_buff *msg,
+				struct ib_umem_odp *umem_odp)
+{
+	struct ib_umem_odp_stats *stats = &umem_odp->stats;
+
+	if (rdma_nl_stat_hwcounter_entry(msg, "page_faults",
+					 READ_ONCE(stats->page_faults)) ||
+	    rdma_nl_stat_hwcounter_entry(msg, "page_fault_pages",
+					 READ_ONCE(stats->fault_pages)) ||
+	    rdma_nl_stat_hwcounter_entry(msg, "page_prefetch_pages",
+					 READ_ONCE(stats->prefetch_pages)))
+		return -EMSGSIZE;
+
+	return 0;
+}
+EXPORT_SYMBOL(ib_umem_odp_fill_stat_entry);
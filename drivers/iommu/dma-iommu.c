@@ -64,6 +64,39 @@ static int __init iommu_dma_forcedac_setup(char *str)
 }
 early_param("iommu.forcedac", iommu_dma_forcedac_setup);
 
+static unsigned int iommu_dma_fq_size __read_mostly = IOVA_FQ_SIZE;
+static unsigned int iommu_dma_fq_timeout __read_mostly = IOVA_FQ_TIMEOUT;
+
+static int __init iommu_dma_fq_size_setup(char *str)
+{
+	unsigned int size;
+	int ret = kstrtouint(str, 0, &size);
+
+	if (ret)
+		return ret;
+	if (!size || size > IOVA_FQ_MAX_SIZE)
+		return -EINVAL;
+
+	iommu_dma_fq_size = roundup_pow_of_two(size);
+	return 0;
+}
+early_param("iommu.fq_size", iommu_dma_fq_size_setup);
+
+static int __init iommu_dma_fq_timeout_setup(char *str)
+{
+	unsigned int timeout;
+	int ret = kstrtouint(str, 0, &timeout);
+
+	if (ret)
+		return ret;
+	if (!timeout)
+		return -EINVAL;
+
+	iommu_dma_fq_timeout = timeout;
+	return 0;
+}
+early_param("iommu.fq_timeout", iommu_dma_fq_timeout_setup);
+
 static void iommu_dma_entry_dtor(unsigned long data)
 {
 	struct page *freelist = (struct page *)data;
@@ -332,7 +365,8 @@ int iommu_dma_init_fq(struct iommu_domain *domain)
 		return 0;
 
 	ret = init_iova_flush_queue(&cookie->iovad, iommu_dma_flush_iotlb_all,
-				    iommu_dma_entry_dtor);
+				    iommu_dma_entry_dtor, iommu_dma_fq_size,
+				    iommu_dma_fq_timeout);
 	if (ret) {
 		pr_warn("iova flush queue initialization failed\n");
 		return ret;
@@ -455,7 +489,8 @@ static dma_addr_t iommu_dma_alloc_iova(struct iommu_domain *domain,
 	 * rounding up anything cacheable to make sure that can't happen. The
 	 * order of the unadjusted size will still match upon freeing.
 	 */
-	if (iova_len < (1 << (IOVA_RANGE_CACHE_MAX_SIZE - 1)))
+	if (iovad->rcache_max_size &&
+	    iova_len < (1 << (iovad->rcache_max_size - 1)))
 		iova_len = roundup_pow_of_two(iova_len);
 
 	dma_limit = min_not_zero(dma_limit, dev->bus_dma_limit);
@@ -7,14 +7,40 @@
 
 #include <linux/iova.h>
 #include <linux/module.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/smp.h>
 #include <linux/bitops.h>
 #include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/topology.h>
 
 /* The anchor node sits above the top of the usable address space */
 #define IOVA_ANCHOR	~0UL
 
+/*
+ * Ranges up to 2^(rcache_max_size - 1) pages are cached. Raising it keeps
+ * large DMA buffers (TSO, big block I/O) off the rbtree, at the cost of two
+ * more magazines per CPU and order in every domain.
+ */
+static unsigned int rcache_max_size = IOVA_RANGE_CACHE_DEFAULT_SIZE;
+module_param(rcache_max_size, uint, 0444);
+MODULE_PARM_DESC(rcache_max_size,
+	"Cache IOVA ranges of up to 2^(rcache_max_size - 1) pages (default "
+	__stringify(IOVA_RANGE_CACHE_DEFAULT_SIZE) ", max "
+	__stringify(IOVA_RANGE_CACHE_MAX_SIZE) ")");
+
+struct iova_rcache_stats {
+	unsigned long hits[IOVA_RANGE_CACHE_MAX_SIZE];	/* CPU magazines */
+	unsigned long depot_hits[IOVA_RANGE_CACHE_MAX_SIZE];	/* local node */
+	unsigned long remote_hits[IOVA_RANGE_CACHE_MAX_SIZE];	/* other nodes */
+	unsigned long misses[IOVA_RANGE_CACHE_MAX_SIZE];
+};
+
+static DEFINE_PER_CPU(struct iova_rcache_stats, iova_rcache_stats);
+static struct dentry *iova_debugfs_dir;
+
 static bool iova_rcache_insert(struct iova_domain *iovad,
 			       unsigned long pfn,
 			       unsigned long size);
@@ -78,6 +104,14 @@ static bool has_iova_flush_queue(struct iova_domain *iovad)
 	return !!iovad->fq;
 }
 
+static void free_iova_fq_entries(struct iova_fq __percpu *queue)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kvfree(per_cpu_ptr(queue, cpu)->entries);
+}
+
 static void free_iova_flush_queue(struct iova_domain *iovad)
 {
 	if (!has_iova_flush_queue(iovad))
@@ -87,6 +121,7 @@ static void free_iova_flush_queue(struct iova_domain *iovad)
 
 	fq_destroy_all_entries(iovad);
 
+	free_iova_fq_entries(iovad->fq);
 	free_percpu(iovad->fq);
 
 	iovad->fq         = NULL;
@@ -94,12 +129,22 @@ static void free_iova_flush_queue(struct iova_domain *iovad)
 	iovad->entry_dtor = NULL;
 }
 
+/*
+ * @fq_size entries are queued per CPU before a CPU has to flush the IOTLB
+ * itself, and a queued entry waits at most @fq_timeout ms for a flush. Busy
+ * devices want larger queues so that nearly all flushes are triggered by a
+ * full queue rather than the timer.
+ */
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor)
+			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor,
+			  unsigned int fq_size, unsigned int fq_timeout)
 {
 	struct iova_fq __percpu *queue;
 	int cpu;
 
+	if (!is_power_of_2(fq_size) || fq_size > IOVA_FQ_MAX_SIZE || !fq_timeout)
+		return -EINVAL;
+
 	atomic64_set(&iovad->fq_flush_start_cnt,  0);
 	atomic64_set(&iovad->fq_flush_finish_cnt, 0);
 
@@ -107,19 +152,28 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 	if (!queue)
 		return -ENOMEM;
 
-	iovad->flush_cb   = flush_cb;
-	iovad->entry_dtor = entry_dtor;
-
 	for_each_possible_cpu(cpu) {
 		struct iova_fq *fq;
 
 		fq = per_cpu_ptr(queue, cpu);
 		fq->head = 0;
 		fq->tail = 0;
+		fq->mod_mask = fq_size - 1;
+		fq->entries = kvmalloc_node(array_size(fq_size,
+						       sizeof(*fq->entries)),
+					    GFP_KERNEL, cpu_to_node(cpu));
+		if (!fq->entries) {
+			free_iova_fq_entries(queue);
+			free_percpu(queue);
+			return -ENOMEM;
+		}
 
 		spin_lock_init(&fq->lock);
 	}
 
+	iovad->flush_cb   = flush_cb;
+	iovad->entry_dtor = entry_dtor;
+	iovad->fq_timeout = fq_timeout;
 	iovad->fq = queue;
 
 	timer_setup(&iovad->fq_timer, fq_flush_timeout, 0);
@@ -306,6 +360,39 @@ static void free_iova_mem(struct iova *iova)
 		kmem_cache_free(iova_cache, iova);
 }
 
+static int rcache_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long hits, depot_hits, remote_hits, misses;
+	unsigned int cpu;
+	int i;
+
+	seq_puts(m, "pages\thits\tdepot\tremote\tmisses\n");
+	for (i = 0; i < min_t(int, rcache_max_size, IOVA_RANGE_CACHE_MAX_SIZE); ++i) {
+		hits = depot_hits = remote_hits = misses = 0;
+		for_each_possible_cpu(cpu) {
+			struct iova_rcache_stats *stats;
+
+			stats = per_cpu_ptr(&iova_rcache_stats, cpu);
+			hits += READ_ONCE(stats->hits[i]);
+			depot_hits += READ_ONCE(stats->depot_hits[i]);
+			remote_hits += READ_ONCE(stats->remote_hits[i]);
+			misses += READ_ONCE(stats->misses[i]);
+		}
+		seq_printf(m, "%lu\t%lu\t%lu\t%lu\t%lu\n", 1UL << i,
+			   hits, depot_hits, remote_hits, misses);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rcache_stats);
+
+static void iova_debugfs_init(void)
+{
+	iova_debugfs_dir = debugfs_create_dir("iova", NULL);
+	debugfs_create_file("rcache_stats", 0444, iova_debugfs_dir, NULL,
+			    &rcache_stats_fops);
+}
+
 int iova_cache_get(void)
 {
 	mutex_lock(&iova_cache_mutex);
@@ -329,6 +416,8 @@ int iova_cache_get(void)
 			pr_err("Couldn't create iova cache\n");
 			return -ENOMEM;
 		}
+
+		iova_debugfs_init();
 	}
 
 	iova_cache_users++;
@@ -347,6 +436,8 @@ void iova_cache_put(void)
 	}
 	iova_cache_users--;
 	if (!iova_cache_users) {
+		debugfs_remove_recursive(iova_debugfs_dir);
+		iova_debugfs_dir = NULL;
 		cpuhp_remove_multi_state(CPUHP_IOMMU_IOVA_DEAD);
 		kmem_cache_destroy(iova_cache);
 	}
@@ -540,12 +631,12 @@ free_iova_fast(struct iova_domain *iovad, unsigned long pfn, unsigned long size)
 EXPORT_SYMBOL_GPL(free_iova_fast);
 
 #define fq_ring_for_each(i, fq) \
-	for ((i) = (fq)->head; (i) != (fq)->tail; (i) = ((i) + 1) % IOVA_FQ_SIZE)
+	for ((i) = (fq)->head; (i) != (fq)->tail; (i) = ((i) + 1) & (fq)->mod_mask)
 
 static inline bool fq_full(struct iova_fq *fq)
 {
 	assert_spin_locked(&fq->lock);
-	return (((fq->tail + 1) % IOVA_FQ_SIZE) == fq->head);
+	return (((fq->tail + 1) & fq->mod_mask) == fq->head);
 }
 
 static inline unsigned fq_ring_add(struct iova_fq *fq)
@@ -554,7 +645,7 @@ static inline unsigned fq_ring_add(struct iova_fq *fq)
 
 	assert_spin_locked(&fq->lock);
 
-	fq->tail = (idx + 1) % IOVA_FQ_SIZE;
+	fq->tail = (idx + 1) & fq->mod_mask;
 
 	return idx;
 }
@@ -578,7 +669,7 @@ static void fq_ring_free(struct iova_domain *iovad, struct iova_fq *fq)
 			       fq->entries[idx].iova_pfn,
 			       fq->entries[idx].pages);
 
-		fq->head = (fq->head + 1) % IOVA_FQ_SIZE;
+		fq->head = (fq->head + 1) & fq->mod_mask;
 	}
 }
 
@@ -674,7 +765,7 @@ void queue_iova(struct iova_domain *iovad,
 	if (!atomic_read(&iovad->fq_timer_on) &&
 	    !atomic_xchg(&iovad->fq_timer_on, 1))
 		mod_timer(&iovad->fq_timer,
-			  jiffies + msecs_to_jiffies(IOVA_FQ_TIMEOUT));
+			  jiffies + msecs_to_jiffies(iovad->fq_timeout));
 }
 
 /**
@@ -889,15 +980,25 @@ static void init_iova_rcaches(struct iova_domain *iovad)
 	struct iova_cpu_rcache *cpu_rcache;
 	struct iova_rcache *rcache;
 	unsigned int cpu;
-	int i;
+	int i, node;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	iovad->rcache_max_size = min_t(unsigned int, rcache_max_size,
+				       IOVA_RANGE_CACHE_MAX_SIZE);
+
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
-		spin_lock_init(&rcache->lock);
-		rcache->depot_size = 0;
+		rcache->depots = kcalloc(nr_node_ids, sizeof(*rcache->depots),
+					 GFP_KERNEL);
 		rcache->cpu_rcaches = __alloc_percpu(sizeof(*cpu_rcache), cache_line_size());
-		if (WARN_ON(!rcache->cpu_rcaches))
-			continue;
+		if (WARN_ON(!rcache->depots || !rcache->cpu_rcaches)) {
+			/* Only cache the sizes we did manage to set up */
+			kfree(rcache->depots);
+			free_percpu(rcache->cpu_rcaches);
+			iovad->rcache_max_size = i;
+			break;
+		}
+		for (node = 0; node < nr_node_ids; node++)
+			spin_lock_init(&rcache->depots[node].lock);
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 			spin_lock_init(&cpu_rcache->lock);
@@ -934,14 +1035,14 @@ static bool __iova_rcache_insert(struct iova_domain *iovad,
 		struct iova_magazine *new_mag = iova_magazine_alloc(GFP_ATOMIC);
 
 		if (new_mag) {
-			spin_lock(&rcache->lock);
-			if (rcache->depot_size < MAX_GLOBAL_MAGS) {
-				rcache->depot[rcache->depot_size++] =
-						cpu_rcache->loaded;
-			} else {
+			struct iova_depot *depot = &rcache->depots[numa_node_id()];
+
+			spin_lock(&depot->lock);
+			if (depot->size < MAX_GLOBAL_MAGS)
+				depot->mags[depot->size++] = cpu_rcache->loaded;
+			else
 				mag_to_free = cpu_rcache->loaded;
-			}
-			spin_unlock(&rcache->lock);
+			spin_unlock(&depot->lock);
 
 			cpu_rcache->loaded = new_mag;
 			can_insert = true;
@@ -966,7 +1067,7 @@ static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_max_size)
 		return false;
 
 	return __iova_rcache_insert(iovad, &iovad->rcaches[log_size], pfn);
@@ -977,10 +1078,58 @@ static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn,
  * satisfy the request, return a matching non-NULL range and remove
  * it from the 'rcache'.
  */
+static struct iova_magazine *iova_depot_pop(struct iova_depot *depot)
+{
+	struct iova_magazine *mag = NULL;
+
+	if (!READ_ONCE(depot->size))
+		return NULL;
+
+	spin_lock(&depot->lock);
+	if (depot->size > 0)
+		mag = depot->mags[--depot->size];
+	spin_unlock(&depot->lock);
+
+	return mag;
+}
+
+/*
+ * Refill from the local node's depot first so that ranges tend to be reused
+ * where they were freed, and only then take a magazine from another node
+ * rather than falling back to the rbtree.
+ */
+static struct iova_magazine *iova_rcache_depot_get(struct iova_rcache *rcache,
+						   unsigned int log_size)
+{
+	struct iova_magazine *mag;
+	int this_node = numa_node_id();
+	int node;
+
+	mag = iova_depot_pop(&rcache->depots[this_node]);
+	if (mag) {
+		__this_cpu_inc(iova_rcache_stats.depot_hits[log_size]);
+		return mag;
+	}
+
+	for_each_node(node) {
+		if (node == this_node)
+			continue;
+		mag = iova_depot_pop(&rcache->depots[node]);
+		if (mag) {
+			__this_cpu_inc(iova_rcache_stats.remote_hits[log_size]);
+			return mag;
+		}
+	}
+
+	return NULL;
+}
+
 static unsigned long __iova_rcache_get(struct iova_rcache *rcache,
+				       unsigned int log_size,
 				       unsigned long limit_pfn)
 {
 	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_magazine *mag;
 	unsigned long iova_pfn = 0;
 	bool has_pfn = false;
 	unsigned long flags;
@@ -989,22 +1138,25 @@ static unsigned long __iova_rcache_get(struct iova_rcache *rcache,
 	spin_lock_irqsave(&cpu_rcache->lock, flags);
 
 	if (!iova_magazine_empty(cpu_rcache->loaded)) {
+		__this_cpu_inc(iova_rcache_stats.hits[log_size]);
 		has_pfn = true;
 	} else if (!iova_magazine_empty(cpu_rcache->prev)) {
 		swap(cpu_rcache->prev, cpu_rcache->loaded);
+		__this_cpu_inc(iova_rcache_stats.hits[log_size]);
 		has_pfn = true;
 	} else {
-		spin_lock(&rcache->lock);
-		if (rcache->depot_size > 0) {
+		mag = iova_rcache_depot_get(rcache, log_size);
+		if (mag) {
 			iova_magazine_free(cpu_rcache->loaded);
-			cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+			cpu_rcache->loaded = mag;
 			has_pfn = true;
 		}
-		spin_unlock(&rcache->lock);
 	}
 
 	if (has_pfn)
 		iova_pfn = iova_magazine_pop(cpu_rcache->loaded, limit_pfn);
+	if (!iova_pfn)
+		__this_cpu_inc(iova_rcache_stats.misses[log_size]);
 
 	spin_unlock_irqrestore(&cpu_rcache->lock, flags);
 
@@ -1022,10 +1174,11 @@ static unsigned long iova_rcache_get(struct iova_domain *iovad,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_max_size)
 		return 0;
 
-	return __iova_rcache_get(&iovad->rcaches[log_size], limit_pfn - size);
+	return __iova_rcache_get(&iovad->rcaches[log_size], log_size,
+				 limit_pfn - size);
 }
 
 /*
@@ -1035,10 +1188,11 @@ static void free_iova_rcaches(struct iova_domain *iovad)
 {
 	struct iova_rcache *rcache;
 	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_depot *depot;
 	unsigned int cpu;
-	int i, j;
+	int i, j, node;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
@@ -1046,8 +1200,12 @@ static void free_iova_rcaches(struct iova_domain *iovad)
 			iova_magazine_free(cpu_rcache->prev);
 		}
 		free_percpu(rcache->cpu_rcaches);
-		for (j = 0; j < rcache->depot_size; ++j)
-			iova_magazine_free(rcache->depot[j]);
+		for (node = 0; node < nr_node_ids; node++) {
+			depot = &rcache->depots[node];
+			for (j = 0; j < depot->size; ++j)
+				iova_magazine_free(depot->mags[j]);
+		}
+		kfree(rcache->depots);
 	}
 }
 
@@ -1061,7 +1219,7 @@ static void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
 	unsigned long flags;
 	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 		spin_lock_irqsave(&cpu_rcache->lock, flags);
@@ -1076,19 +1234,21 @@ static void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
  */
 static void free_global_cached_iovas(struct iova_domain *iovad)
 {
-	struct iova_rcache *rcache;
+	struct iova_depot *depot;
 	unsigned long flags;
-	int i, j;
-
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
-		rcache = &iovad->rcaches[i];
-		spin_lock_irqsave(&rcache->lock, flags);
-		for (j = 0; j < rcache->depot_size; ++j) {
-			iova_magazine_free_pfns(rcache->depot[j], iovad);
-			iova_magazine_free(rcache->depot[j]);
+	int i, j, node;
+
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
+		for (node = 0; node < nr_node_ids; node++) {
+			depot = &iovad->rcaches[i].depots[node];
+			spin_lock_irqsave(&depot->lock, flags);
+			for (j = 0; j < depot->size; ++j) {
+				iova_magazine_free_pfns(depot->mags[j], iovad);
+				iova_magazine_free(depot->mags[j]);
+			}
+			depot->size = 0;
+			spin_unlock_irqrestore(&depot->lock, flags);
 		}
-		rcache->depot_size = 0;
-		spin_unlock_irqrestore(&rcache->lock, flags);
 	}
 }
 MODULE_AUTHOR("Anil S Keshavamurthy <anil.s.keshavamurthy@intel.com>");
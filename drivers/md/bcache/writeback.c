@@ -463,6 +463,18 @@ static void read_dirty_submit(struct closure *cl)
 	continue_at(cl, write_dirty, io->dc->writeback_write_wq);
 }
 
+/*
+ * Writeback is falling behind when there is more dirty data than the
+ * target, or when the cache set is idle and we write back as fast as we
+ * can. Then it pays to hand the backing device several non-contiguous
+ * writes at once and let its command queueing sort out the seeks.
+ */
+static bool writeback_behind(struct cached_dev *dc)
+{
+	return dc->writeback_rate_proportional > 0 ||
+	       atomic_read(&dc->disk.c->at_max_writeback_rate);
+}
+
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned int delay = 0;
@@ -472,6 +484,7 @@ static void read_dirty(struct cached_dev *dc)
 	struct dirty_io *io;
 	struct closure cl;
 	uint16_t sequence = 0;
+	bool behind;
 
 	BUG_ON(!llist_empty(&dc->writeback_ordering_wait.list));
 	atomic_set(&dc->writeback_sequence_next, sequence);
@@ -489,6 +502,7 @@ static void read_dirty(struct cached_dev *dc)
 	       next) {
 		size = 0;
 		nk = 0;
+		behind = writeback_behind(dc);
 
 		do {
 			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
@@ -509,15 +523,13 @@ static void read_dirty(struct cached_dev *dc)
 
 			/*
 			 * Operations are only eligible to be combined
-			 * if they are contiguous.
-			 *
-			 * TODO: add a heuristic willing to fire a
-			 * certain amount of non-contiguous IO per pass,
-			 * so that we can benefit from backing device
-			 * command queueing.
+			 * if they are contiguous, unless writeback is
+			 * behind. The keybuf hands out keys in LBA
+			 * order, so the writes of a pass still go out
+			 * sorted by backing device offset.
 			 */
-			if ((nk != 0) && bkey_cmp(&keys[nk-1]->key,
-						&START_KEY(&next->key)))
+			if ((nk != 0) && !behind &&
+			    bkey_cmp(&keys[nk-1]->key, &START_KEY(&next->key)))
 				break;
 
 			size += KEY_SIZE(&next->key);
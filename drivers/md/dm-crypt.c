@@ -15,6 +15,8 @@
 #include <linux/key.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-crypto.h>
+#include <linux/keyslot-manager.h>
 #include <linux/mempool.h>
 #include <linux/slab.h>
 #include <linux/crypto.h>
@@ -131,7 +133,7 @@ struct iv_elephant_private {
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
 	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
 	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE,
-	     DM_CRYPT_WRITE_INLINE };
+	     DM_CRYPT_WRITE_INLINE, DM_CRYPT_INLINE_CRYPT };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cipher */
@@ -217,6 +219,11 @@ struct crypt_config {
 	struct bio_set bs;
 	struct mutex bio_alloc_lock;
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	/* key programmed into the device when DM_CRYPT_INLINE_CRYPT is set */
+	struct blk_crypto_key blk_key;
+#endif
+
 	u8 *authenc_key; /* space for keys in authenc() format (if used) */
 	u8 key[];
 };
@@ -1464,6 +1471,9 @@ static int crypt_alloc_req_skcipher(struct crypt_config *cc,
 		ctx->r.req = mempool_alloc(&cc->req_pool, in_interrupt() ? GFP_ATOMIC : GFP_NOIO);
 		if (!ctx->r.req)
 			return -ENOMEM;
+	} else if (cc->tfms_count == 1) {
+		/* reused after a synchronous completion, already set up */
+		return 0;
 	}
 
 	skcipher_request_set_tfm(ctx->r.req, cc->cipher_tfm.tfms[key_index]);
@@ -1536,6 +1546,12 @@ static void crypt_free_req(struct crypt_config *cc, void *req, struct bio *base_
 		crypt_free_req_skcipher(cc, req, base_bio);
 }
 
+/*
+ * Synchronous ciphers complete a sector per call, yield the CPU only once
+ * per this many bytes instead of after every sector.
+ */
+#define CRYPT_RESCHED_BYTES	(64 * 1024)
+
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
  */
@@ -1544,6 +1560,8 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 {
 	unsigned int tag_offset = 0;
 	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
+	unsigned int resched_mask = (CRYPT_RESCHED_BYTES >> SECTOR_SHIFT) /
+				    sector_step - 1;
 	int r;
 
 	/*
@@ -1612,7 +1630,7 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
 			tag_offset++;
-			if (!atomic)
+			if (!atomic && !(tag_offset & resched_mask))
 				cond_resched();
 			continue;
 		/*
@@ -2372,6 +2390,109 @@ static void crypt_copy_authenckey(char *p, const void *key,
 	memcpy(p, key, enckeylen);
 }
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+/*
+ * aes-xts-plain64 with one key and the IV counted in encryption sectors is
+ * exactly what blk-crypto calls AES-256-XTS with an 8 byte DUN, so such a
+ * mapping can let the device encrypt inline and produce the same on-disk
+ * format as the software path.
+ */
+static bool crypt_inline_crypt_compatible(struct crypt_config *cc)
+{
+	if (crypt_integrity_aead(cc) || cc->on_disk_tag_size ||
+	    cc->integrity_iv_size)
+		return false;
+	if (cc->iv_gen_ops != &crypt_iv_plain64_ops)
+		return false;
+	if (cc->sector_size != (1 << SECTOR_SHIFT) &&
+	    !test_bit(CRYPT_IV_LARGE_SECTORS, &cc->cipher_flags))
+		return false;
+	if (cc->tfms_count != 1 || cc->key_parts != 1 || cc->key_extra_size ||
+	    cc->key_size != BLK_CRYPTO_MAX_KEY_SIZE)
+		return false;
+	return !strcmp(crypto_skcipher_alg(any_tfm(cc))->base.cra_name,
+		       "xts(aes)");
+}
+
+static int crypt_inline_setkey(struct crypt_config *cc)
+{
+	struct request_queue *q = bdev_get_queue(cc->dev->bdev);
+	int r;
+
+	/* a new key of an inline mapping replaces the programmed one */
+	if (test_bit(DM_CRYPT_INLINE_CRYPT, &cc->flags))
+		blk_crypto_evict_key(q, &cc->blk_key);
+	r = blk_crypto_init_key(&cc->blk_key, cc->key,
+				BLK_ENCRYPTION_MODE_AES_256_XTS, sizeof(u64),
+				cc->sector_size);
+	if (r)
+		return r;
+	return blk_crypto_start_using_key(&cc->blk_key, q);
+}
+
+static void crypt_inline_crypt_init(struct dm_target *ti)
+{
+	struct crypt_config *cc = ti->private;
+	struct request_queue *q = bdev_get_queue(cc->dev->bdev);
+	struct blk_crypto_config cfg = {
+		.crypto_mode = BLK_ENCRYPTION_MODE_AES_256_XTS,
+		.data_unit_size = cc->sector_size,
+		.dun_bytes = sizeof(u64),
+	};
+
+	if (!test_bit(DM_CRYPT_KEY_VALID, &cc->flags) ||
+	    !crypt_inline_crypt_compatible(cc))
+		return;
+
+	/* only real hardware, the blk-crypto fallback is no faster than us */
+	if (!blk_ksm_crypto_cfg_supported(q->ksm, &cfg))
+		return;
+
+	if (crypt_inline_setkey(cc))
+		return;
+
+	set_bit(DM_CRYPT_INLINE_CRYPT, &cc->flags);
+	DMINFO("%s: using inline encryption of the underlying device",
+	       dm_device_name(dm_table_get_md(ti->table)));
+}
+
+static void crypt_inline_crypt_exit(struct crypt_config *cc)
+{
+	if (test_bit(DM_CRYPT_INLINE_CRYPT, &cc->flags))
+		blk_crypto_evict_key(bdev_get_queue(cc->dev->bdev),
+				     &cc->blk_key);
+}
+
+/*
+ * The device does the encryption, so the bio is only remapped and tagged
+ * with the key and the IV of its first encryption sector.
+ */
+static int crypt_map_inline(struct dm_target *ti, struct bio *bio)
+{
+	struct crypt_config *cc = ti->private;
+	sector_t sector = dm_target_offset(ti, bio->bi_iter.bi_sector);
+	u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE] = {
+		(sector + cc->iv_offset) >> cc->sector_shift,
+	};
+
+	bio_set_dev(bio, cc->dev->bdev);
+	bio->bi_iter.bi_sector = cc->start + sector;
+	bio_crypt_set_ctx(bio, &cc->blk_key, dun, GFP_NOIO);
+	return DM_MAPIO_REMAPPED;
+}
+#else
+static inline int crypt_inline_setkey(struct crypt_config *cc)
+{
+	return 0;
+}
+static inline void crypt_inline_crypt_init(struct dm_target *ti) {}
+static inline void crypt_inline_crypt_exit(struct crypt_config *cc) {}
+static inline int crypt_map_inline(struct dm_target *ti, struct bio *bio)
+{
+	return DM_MAPIO_KILL;
+}
+#endif
+
 static int crypt_setkey(struct crypt_config *cc)
 {
 	unsigned subkey_size;
@@ -2408,6 +2529,9 @@ static int crypt_setkey(struct crypt_config *cc)
 	if (crypt_integrity_hmac(cc))
 		memzero_explicit(cc->authenc_key, crypt_authenckey_size(cc));
 
+	if (!err && test_bit(DM_CRYPT_INLINE_CRYPT, &cc->flags))
+		err = crypt_inline_setkey(cc);
+
 	return err;
 }
 
@@ -2702,6 +2826,7 @@ static void crypt_dtr(struct dm_target *ti)
 	if (cc->crypt_queue)
 		destroy_workqueue(cc->crypt_queue);
 
+	crypt_inline_crypt_exit(cc);
 	crypt_free_tfms(cc);
 
 	bioset_exit(&cc->bs);
@@ -3362,6 +3487,8 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	ti->num_flush_bios = 1;
 	ti->limit_swap_bios = true;
 
+	crypt_inline_crypt_init(ti);
+
 	return 0;
 
 bad:
@@ -3405,6 +3532,9 @@ static int crypt_map(struct dm_target *ti, struct bio *bio)
 	if (unlikely(bio->bi_iter.bi_size & (cc->sector_size - 1)))
 		return DM_MAPIO_KILL;
 
+	if (test_bit(DM_CRYPT_INLINE_CRYPT, &cc->flags))
+		return crypt_map_inline(ti, bio);
+
 	io = dm_per_bio_data(bio, cc->per_bio_data_size);
 	crypt_io_init(io, cc, bio, dm_target_offset(ti, bio->bi_iter.bi_sector));
 
@@ -2163,6 +2163,35 @@ static void __sort_thin_deferred_bios(struct thin_c *tc)
 	__extract_sorted_bios(tc);
 }
 
+/*
+ * Walk the sorted batch with non-blocking lookups before processing it.
+ * Every btree node that isn't in core gets added to the prefetch set, so
+ * the misses of the whole batch are read in parallel rather than one
+ * synchronous read per bio from process_bio().
+ */
+static void prefetch_thin_deferred_bios(struct thin_c *tc, struct bio_list *bios)
+{
+	struct dm_thin_lookup_result lookup_result;
+	dm_block_t block, last_block = 0;
+	bool first = true;
+	struct bio *bio;
+
+	bio_list_for_each(bio, bios) {
+		if (bio_op(bio) == REQ_OP_DISCARD)
+			continue;
+
+		block = get_bio_block(tc, bio);
+		if (!first && block == last_block)
+			continue;
+
+		first = false;
+		last_block = block;
+		dm_thin_find_block(tc->td, block, 0, &lookup_result);
+	}
+
+	dm_pool_issue_prefetches(tc->pool->pmd);
+}
+
 static void process_thin_deferred_bios(struct thin_c *tc)
 {
 	struct pool *pool = tc->pool;
@@ -2193,6 +2222,9 @@ static void process_thin_deferred_bios(struct thin_c *tc)
 
 	spin_unlock_irq(&tc->lock);
 
+	if (bios.head != bios.tail)
+		prefetch_thin_deferred_bios(tc, &bios);
+
 	blk_start_plug(&plug);
 	while ((bio = bio_list_pop(&bios))) {
 		/*
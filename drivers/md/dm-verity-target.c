@@ -16,6 +16,7 @@
 #include "dm-verity.h"
 #include "dm-verity-fec.h"
 #include "dm-verity-verify-sig.h"
+#include <linux/highmem.h>
 #include <linux/module.h>
 #include <linux/reboot.h>
 
@@ -465,8 +466,97 @@ static inline void verity_bv_skip_block(struct dm_verity *v,
 	bio_advance_iter(bio, iter, 1 << v->data_dev_block_bits);
 }
 
+/*
+ * A data block didn't match its hash: try to correct it, otherwise report it.
+ * @start points to the block in the bio.
+ */
+static int verity_handle_data_hash_mismatch(struct dm_verity *v,
+					    struct dm_verity_io *io,
+					    struct bio *bio, sector_t blkno,
+					    struct bvec_iter *start)
+{
+	if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+			      blkno, NULL, start) == 0)
+		return 0;
+
+	if (bio->bi_status) {
+		/*
+		 * Error correction failed; Just return error
+		 */
+		return -EIO;
+	}
+	if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA, blkno))
+		return -EIO;
+
+	return 0;
+}
+
+static void verity_clear_pending_blocks(struct dm_verity_io *io)
+{
+	int i;
+
+	/* kmap_local mappings have to be released in reverse order */
+	for (i = io->num_pending - 1; i >= 0; i--) {
+		kunmap_local(io->pending_blocks[i].data);
+		io->pending_blocks[i].data = NULL;
+	}
+	io->num_pending = 0;
+}
+
+/*
+ * Hash all the pending data blocks at once with the multi-buffer hash, then
+ * check them one by one.
+ */
+static int verity_verify_pending_blocks(struct dm_verity *v,
+					struct dm_verity_io *io,
+					struct bio *bio)
+{
+	SHASH_DESC_ON_STACK(desc, v->mb_tfm);
+	const u8 *data[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	u8 *real_digests[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+	unsigned int i;
+	int r;
+
+	for (i = 0; i < io->num_pending; i++) {
+		data[i] = io->pending_blocks[i].data;
+		real_digests[i] = io->pending_blocks[i].real_digest;
+	}
+
+	desc->tfm = v->mb_tfm;
+	r = crypto_shash_import(desc, v->mb_initial_state) ?:
+	    crypto_shash_finup_mb(desc, data, 1 << v->data_dev_block_bits,
+				  real_digests, io->num_pending);
+	if (unlikely(r)) {
+		DMERR("verity_verify_pending_blocks crypto op failed: %d", r);
+		goto out;
+	}
+
+	for (i = 0; i < io->num_pending; i++) {
+		struct dm_verity_pending_block *block = &io->pending_blocks[i];
+
+		if (likely(memcmp(block->real_digest, block->want_digest,
+				  v->digest_size) == 0)) {
+			if (v->validated_blocks)
+				set_bit(block->blkno, v->validated_blocks);
+			continue;
+		}
+
+		r = verity_handle_data_hash_mismatch(v, io, bio, block->blkno,
+						     &block->start);
+		if (unlikely(r))
+			break;
+	}
+out:
+	verity_clear_pending_blocks(io);
+	return r;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
+ *
+ * With a multi-buffer hash, data blocks that sit in a single page are mapped
+ * and queued, and every v->mb_max_msgs of them are hashed together.  Blocks
+ * that span pages take the ahash path one by one as before.
  */
 static int verity_verify_io(struct dm_verity_io *io)
 {
@@ -474,13 +564,17 @@ static int verity_verify_io(struct dm_verity_io *io)
 	struct dm_verity *v = io->v;
 	struct bvec_iter start;
 	unsigned b;
+	int r;
 	struct crypto_wait wait;
 	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
 
+	io->num_pending = 0;
+
 	for (b = 0; b < io->n_blocks; b++) {
-		int r;
 		sector_t cur_block = io->block + b;
 		struct ahash_request *req = verity_io_hash_req(v, io);
+		struct dm_verity_pending_block *block = NULL;
+		u8 *want_digest = verity_io_want_digest(v, io);
 
 		if (v->validated_blocks &&
 		    likely(test_bit(cur_block, v->validated_blocks))) {
@@ -488,11 +582,15 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash_for_block(v, io, cur_block,
-					  verity_io_want_digest(v, io),
+		if (v->mb_tfm) {
+			block = &io->pending_blocks[io->num_pending];
+			want_digest = block->want_digest;
+		}
+
+		r = verity_hash_for_block(v, io, cur_block, want_digest,
 					  &is_zero);
 		if (unlikely(r < 0))
-			return r;
+			goto error;
 
 		if (is_zero) {
 			/*
@@ -502,24 +600,46 @@ static int verity_verify_io(struct dm_verity_io *io)
 			r = verity_for_bv_block(v, io, &io->iter,
 						verity_bv_zero);
 			if (unlikely(r < 0))
-				return r;
+				goto error;
 
 			continue;
 		}
 
+		if (block) {
+			struct bio_vec bv = bio_iter_iovec(bio, io->iter);
+
+			if (likely(bv.bv_len >= 1 << v->data_dev_block_bits)) {
+				block->data = kmap_local_page(bv.bv_page) +
+					      bv.bv_offset;
+				block->blkno = cur_block;
+				block->start = io->iter;
+				verity_bv_skip_block(v, io, &io->iter);
+
+				if (++io->num_pending == v->mb_max_msgs) {
+					r = verity_verify_pending_blocks(v, io,
+									 bio);
+					if (unlikely(r))
+						return r;
+				}
+				continue;
+			}
+			memcpy(verity_io_want_digest(v, io), want_digest,
+			       v->digest_size);
+		}
+
 		r = verity_hash_init(v, req, &wait);
 		if (unlikely(r < 0))
-			return r;
+			goto error;
 
 		start = io->iter;
 		r = verity_for_io_block(v, io, &io->iter, &wait);
 		if (unlikely(r < 0))
-			return r;
+			goto error;
 
 		r = verity_hash_final(v, req, verity_io_real_digest(v, io),
 					&wait);
 		if (unlikely(r < 0))
-			return r;
+			goto error;
 
 		if (likely(memcmp(verity_io_real_digest(v, io),
 				  verity_io_want_digest(v, io), v->digest_size) == 0)) {
@@ -527,23 +647,21 @@ static int verity_verify_io(struct dm_verity_io *io)
 				set_bit(cur_block, v->validated_blocks);
 			continue;
 		}
-		else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block, NULL, &start) == 0)
-			continue;
-		else {
-			if (bio->bi_status) {
-				/*
-				 * Error correction failed; Just return error
-				 */
-				return -EIO;
-			}
-			if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
-					      cur_block))
-				return -EIO;
-		}
+
+		r = verity_handle_data_hash_mismatch(v, io, bio, cur_block,
+						     &start);
+		if (unlikely(r))
+			goto error;
 	}
 
+	if (io->num_pending)
+		return verity_verify_pending_blocks(v, io, bio);
+
 	return 0;
+
+error:
+	verity_clear_pending_blocks(io);
+	return r;
 }
 
 /*
@@ -878,6 +996,10 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
+	kfree(v->mb_initial_state);
+	if (v->mb_tfm)
+		crypto_free_shash(v->mb_tfm);
+
 	kfree(v->alg_name);
 
 	if (v->hash_dev)
@@ -945,6 +1067,56 @@ static int verity_alloc_zero_digest(struct dm_verity *v)
 	return r;
 }
 
+/*
+ * Data blocks can be hashed several at a time if the algorithm has a
+ * synchronous implementation with multi-buffer support.  The salt is hashed
+ * once here and each batch starts from the exported state, which doesn't
+ * work for format version 0 where the salt comes after the data.
+ */
+static int verity_setup_mb_hash(struct dm_verity *v)
+{
+	struct crypto_shash *tfm;
+	SHASH_DESC_ON_STACK(desc, tfm);
+	int r;
+
+	if (!v->version && v->salt_size)
+		return 0;
+
+	tfm = crypto_alloc_shash(v->alg_name, 0, 0);
+	if (IS_ERR(tfm))
+		return 0;	/* e.g. only an async driver; use the ahash path */
+
+	if (crypto_shash_mb_max_msgs(tfm) < 2 ||
+	    crypto_shash_digestsize(tfm) != v->digest_size) {
+		crypto_free_shash(tfm);
+		return 0;
+	}
+
+	v->mb_initial_state = kmalloc(crypto_shash_statesize(tfm), GFP_KERNEL);
+	if (!v->mb_initial_state) {
+		crypto_free_shash(tfm);
+		return -ENOMEM;
+	}
+
+	desc->tfm = tfm;
+	r = crypto_shash_init(desc) ?:
+	    crypto_shash_update(desc, v->salt, v->salt_size) ?:
+	    crypto_shash_export(desc, v->mb_initial_state);
+	shash_desc_zero(desc);
+	if (r) {
+		crypto_free_shash(tfm);
+		return r;
+	}
+
+	v->mb_tfm = tfm;
+	v->mb_max_msgs = min_t(unsigned int, crypto_shash_mb_max_msgs(tfm),
+			       DM_VERITY_MAX_PENDING_DATA_BLOCKS);
+	DMINFO("%s hashing up to %u data blocks at once using \"%s\"",
+	       v->alg_name, v->mb_max_msgs,
+	       crypto_shash_driver_name(tfm));
+	return 0;
+}
+
 static inline bool verity_is_verity_mode(const char *arg_name)
 {
 	return (!strcasecmp(arg_name, DM_VERITY_OPT_LOGGING) ||
@@ -1280,6 +1452,12 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		goto bad;
 	}
 
+	r = verity_setup_mb_hash(v);
+	if (r) {
+		ti->error = "Cannot set up multi-buffer hashing";
+		goto bad;
+	}
+
 	/* WQ_UNBOUND greatly improves performance when running on ramdisk */
 	v->verify_wq = alloc_workqueue("kverityd", WQ_CPU_INTENSIVE | WQ_MEM_RECLAIM | WQ_UNBOUND, num_online_cpus());
 	if (!v->verify_wq) {
@@ -17,6 +17,9 @@
 
 #define DM_VERITY_MAX_LEVELS		63
 
+/* Max data blocks of one bio that are hashed together */
+#define DM_VERITY_MAX_PENDING_DATA_BLOCKS	HASH_MAX_MB_MSGS
+
 enum verity_mode {
 	DM_VERITY_MODE_EIO,
 	DM_VERITY_MODE_LOGGING,
@@ -38,6 +41,9 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_shash *mb_tfm;	/* multi-buffer hash for data blocks */
+	u8 *mb_initial_state;	/* mb_tfm state after hashing the salt */
+	unsigned int mb_max_msgs;	/* data blocks to hash at once */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -68,6 +74,15 @@ struct dm_verity {
 	char *signature_key_desc; /* signature keyring reference */
 };
 
+/* A data block that has been mapped and is waiting to be hashed */
+struct dm_verity_pending_block {
+	void *data;
+	sector_t blkno;
+	struct bvec_iter start;	/* bio position of the block, for FEC */
+	u8 want_digest[HASH_MAX_DIGESTSIZE];
+	u8 real_digest[HASH_MAX_DIGESTSIZE];
+};
+
 struct dm_verity_io {
 	struct dm_verity *v;
 
@@ -81,6 +96,11 @@ struct dm_verity_io {
 
 	struct work_struct work;
 
+	/* Only used with v->mb_tfm, see verity_verify_io() */
+	unsigned int num_pending;
+	struct dm_verity_pending_block
+		pending_blocks[DM_VERITY_MAX_PENDING_DATA_BLOCKS];
+
 	/*
 	 * Three variably-size fields follow this struct:
 	 *
@@ -16,6 +16,7 @@
 #include <linux/pfn_t.h>
 #include <linux/libnvdimm.h>
 #include <linux/delay.h>
+#include <linux/seqlock.h>
 #include "dm-io-tracker.h"
 
 #define DM_MSG_PREFIX "writecache"
@@ -120,6 +121,7 @@ struct dm_writecache {
 		};
 	};
 	struct rb_root tree;
+	seqcount_mutex_t tree_seq;
 
 	size_t freelist_size;
 	size_t writeback_size;
@@ -142,6 +144,7 @@ struct dm_writecache {
 
 	atomic_t bio_in_progress[2];
 	struct wait_queue_head bio_in_progress_wait[2];
+	atomic_long_t lockless_read_hits;
 
 	struct dm_target *ti;
 	struct dm_dev *dev;
@@ -488,6 +491,11 @@ static void writecache_notify_io(unsigned long error, void *context)
 
 static void writecache_wait_for_ios(struct dm_writecache *wc, int direction)
 {
+	/*
+	 * Pairs with the barrier in writecache_map_read_lockless(): a reader
+	 * that found an entry before it was unlinked is seen here.
+	 */
+	smp_mb();
 	wait_event(wc->bio_in_progress_wait[direction],
 		   !atomic_read(&wc->bio_in_progress[direction]));
 }
@@ -665,8 +673,10 @@ static void writecache_insert_entry(struct dm_writecache *wc, struct wc_entry *i
 		else
 			node = &parent->rb_right;
 	}
-	rb_link_node(&ins->rb_node, parent, node);
+	write_seqcount_begin(&wc->tree_seq);
+	rb_link_node_rcu(&ins->rb_node, parent, node);
 	rb_insert_color(&ins->rb_node, &wc->tree);
+	write_seqcount_end(&wc->tree_seq);
 	list_add(&ins->lru, &wc->lru);
 	ins->age = jiffies;
 }
@@ -674,7 +684,9 @@ static void writecache_insert_entry(struct dm_writecache *wc, struct wc_entry *i
 static void writecache_unlink(struct dm_writecache *wc, struct wc_entry *e)
 {
 	list_del(&e->lru);
+	write_seqcount_begin(&wc->tree_seq);
 	rb_erase(&e->rb_node, &wc->tree);
+	write_seqcount_end(&wc->tree_seq);
 }
 
 static void writecache_add_to_freelist(struct dm_writecache *wc, struct wc_entry *e)
@@ -907,8 +919,12 @@ static void writecache_discard(struct dm_writecache *wc, sector_t start, sector_
 		e = container_of(node, struct wc_entry, rb_node);
 	}
 
-	if (discarded_something)
+	if (discarded_something) {
+		/* lockless read hits may still be in flight on freed blocks */
+		if (!WC_MODE_PMEM(wc))
+			writecache_wait_for_ios(wc, READ);
 		writecache_commit_flushed(wc, false);
+	}
 }
 
 static bool writecache_wait_for_writeback(struct dm_writecache *wc)
@@ -1177,6 +1193,7 @@ static int process_clear_stats_mesg(unsigned argc, char **argv, struct dm_writec
 
 	wc_lock(wc);
 	memset(&wc->stats, 0, sizeof wc->stats);
+	atomic_long_set(&wc->lockless_read_hits, 0);
 	wc_unlock(wc);
 
 	return 0;
@@ -1527,6 +1544,74 @@ static enum wc_map_op writecache_map_discard(struct dm_writecache *wc, struct bi
 	return WC_MAP_RETURN;
 }
 
+/*
+ * Lookup of the newest entry for a block without wc->lock, the caller
+ * validates the result with wc->tree_seq. A concurrent rotation can make
+ * us miss the entry, it can't make us loop or return a wrong one. Only
+ * child pointers are followed since parent pointers aren't updated in
+ * a way that lockless walkers can rely on.
+ */
+static struct wc_entry *writecache_find_entry_lockless(struct dm_writecache *wc,
+						       uint64_t block)
+{
+	struct rb_node *node = READ_ONCE(wc->tree.rb_node);
+	struct wc_entry *e, *found = NULL;
+
+	while (node) {
+		e = container_of(node, struct wc_entry, rb_node);
+		if (read_original_sector(wc, e) > block) {
+			node = READ_ONCE(node->rb_left);
+		} else {
+			/* duplicates are inserted to the right, keep going */
+			if (read_original_sector(wc, e) == block)
+				found = e;
+			node = READ_ONCE(node->rb_right);
+		}
+	}
+
+	return found;
+}
+
+/*
+ * SSD mode read hit on a committed block: only a remap is needed, so do
+ * it without taking wc->lock. bio_in_progress[READ] is raised before the
+ * lookup, anything that frees an entry waits for it afterwards, so the
+ * block is not reused under the read.
+ */
+static bool writecache_map_read_lockless(struct dm_writecache *wc, struct bio *bio)
+{
+	sector_t sector = dm_target_offset(wc->ti, bio->bi_iter.bi_sector);
+	struct wc_entry *e;
+	unsigned seq;
+
+	if (unlikely((((unsigned)sector | bio_sectors(bio)) &
+		      (wc->block_size / 512 - 1)) != 0))
+		return false;
+
+	atomic_inc(&wc->bio_in_progress[READ]);
+	smp_mb__after_atomic();
+
+	seq = read_seqcount_begin(&wc->tree_seq);
+	e = writecache_find_entry_lockless(wc, sector);
+	if (!e || !writecache_entry_is_committed(wc, e) ||
+	    read_seqcount_retry(&wc->tree_seq, seq)) {
+		if (atomic_dec_and_test(&wc->bio_in_progress[READ]))
+			if (unlikely(waitqueue_active(&wc->bio_in_progress_wait[READ])))
+				wake_up(&wc->bio_in_progress_wait[READ]);
+		return false;
+	}
+
+	atomic_long_inc(&wc->lockless_read_hits);
+	bio->bi_iter.bi_sector = sector;
+	dm_accept_partial_bio(bio, wc->block_size >> SECTOR_SHIFT);
+	bio_set_dev(bio, wc->ssd_dev->bdev);
+	bio->bi_iter.bi_sector = cache_sector(wc, e);
+	/* make sure that writecache_end_io decrements bio_in_progress: */
+	bio->bi_private = (void *)1;
+
+	return true;
+}
+
 static int writecache_map(struct dm_target *ti, struct bio *bio)
 {
 	struct dm_writecache *wc = ti->private;
@@ -1534,6 +1619,11 @@ static int writecache_map(struct dm_target *ti, struct bio *bio)
 
 	bio->bi_private = NULL;
 
+	if (!WC_MODE_PMEM(wc) && bio_op(bio) == REQ_OP_READ &&
+	    !(bio->bi_opf & REQ_PREFLUSH) &&
+	    writecache_map_read_lockless(wc, bio))
+		return DM_MAPIO_REMAPPED;
+
 	wc_lock(wc);
 
 	if (unlikely(bio->bi_opf & REQ_PREFLUSH)) {
@@ -2239,6 +2329,7 @@ static int writecache_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	wc->ti = ti;
 
 	mutex_init(&wc->lock);
+	seqcount_mutex_init(&wc->tree_seq, &wc->lock);
 	wc->max_age = MAX_AGE_UNSPECIFIED;
 	writecache_poison_lists(wc);
 	init_waitqueue_head(&wc->freelist_wait);
@@ -2668,8 +2759,8 @@ static void writecache_status(struct dm_target *ti, status_type_t type,
 		       writecache_has_error(wc),
 		       (unsigned long long)wc->n_blocks, (unsigned long long)wc->freelist_size,
 		       (unsigned long long)wc->writeback_size,
-		       wc->stats.reads,
-		       wc->stats.read_hits,
+		       wc->stats.reads + atomic_long_read(&wc->lockless_read_hits),
+		       wc->stats.read_hits + atomic_long_read(&wc->lockless_read_hits),
 		       wc->stats.writes,
 		       wc->stats.write_hits_uncommitted,
 		       wc->stats.write_hits_committed,
@@ -112,6 +112,9 @@ struct md_rdev {
 	atomic_t	read_errors;	/* number of consecutive read errors that
 					 * we have tried to ignore.
 					 */
+	u64		read_lat_ewma;	/* moving average of read latency in
+					 * nsecs, for latency read balancing
+					 */
 	time64_t	last_read_error;	/* monotonic time since our
 						 * last read error
 						 */
@@ -784,6 +787,38 @@ static inline void rdev_dec_pending(struct md_rdev *rdev, struct mddev *mddev)
 	}
 }
 
+/* read balancing policies of the mirroring personalities */
+enum md_read_policy {
+	MD_READ_POLICY_DEFAULT,		/* head position and pending count */
+	MD_READ_POLICY_LATENCY,		/* lowest expected completion time */
+};
+
+#define MD_READ_LAT_SHIFT	3	/* weight of a new sample is 1/8 */
+
+static inline void md_rdev_read_done(struct md_rdev *rdev, u64 start_ns)
+{
+	u64 lat = ktime_get_ns() - start_ns;
+	u64 ewma = READ_ONCE(rdev->read_lat_ewma);
+
+	if (ewma)
+		ewma = ewma - (ewma >> MD_READ_LAT_SHIFT) +
+			(lat >> MD_READ_LAT_SHIFT);
+	else
+		ewma = lat;
+	WRITE_ONCE(rdev->read_lat_ewma, ewma);
+}
+
+/*
+ * Expected time for a new read on @rdev to complete: the reads already
+ * queued plus this one, at the average latency seen on the device.  A device
+ * without samples costs nothing, so that it gets reads and is measured.
+ */
+static inline u64 md_rdev_read_cost(struct md_rdev *rdev)
+{
+	return (u64)(atomic_read(&rdev->nr_pending) + 1) *
+		READ_ONCE(rdev->read_lat_ewma);
+}
+
 extern struct md_cluster_operations *md_cluster_ops;
 static inline int mddev_is_clustered(struct mddev *mddev)
 {
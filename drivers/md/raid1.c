@@ -392,6 +392,8 @@ static void raid1_end_read_request(struct bio *bio)
 	}
 
 	if (uptodate) {
+		if (r1_bio->read_start_ns && !bio->bi_status)
+			md_rdev_read_done(rdev, r1_bio->read_start_ns);
 		raid_end_bio_io(r1_bio);
 		rdev_dec_pending(rdev, conf->mddev);
 	} else {
@@ -598,14 +600,16 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	const sector_t this_sector = r1_bio->sector;
 	int sectors;
 	int best_good_sectors;
-	int best_disk, best_dist_disk, best_pending_disk;
+	int best_disk, best_dist_disk, best_pending_disk, best_cost_disk;
 	int has_nonrot_disk;
 	int disk;
 	sector_t best_dist;
 	unsigned int min_pending;
+	u64 min_cost;
 	struct md_rdev *rdev;
 	int choose_first;
 	int choose_next_idle;
+	bool by_latency;
 
 	rcu_read_lock();
 	/*
@@ -620,9 +624,12 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	best_dist = MaxSector;
 	best_pending_disk = -1;
 	min_pending = UINT_MAX;
+	best_cost_disk = -1;
+	min_cost = U64_MAX;
 	best_good_sectors = 0;
 	has_nonrot_disk = 0;
 	choose_next_idle = 0;
+	by_latency = READ_ONCE(conf->read_policy) == MD_READ_POLICY_LATENCY;
 	clear_bit(R1BIO_FailFast, &r1_bio->state);
 
 	if ((conf->mddev->recovery_cp < this_sector + sectors) ||
@@ -712,6 +719,20 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			best_disk = disk;
 			break;
 		}
+		/*
+		 * The latency policy ignores head position and sequential
+		 * streams, it only looks at how soon each device is expected
+		 * to complete the read.
+		 */
+		if (by_latency) {
+			u64 cost = md_rdev_read_cost(rdev);
+
+			if (cost < min_cost) {
+				min_cost = cost;
+				best_cost_disk = disk;
+			}
+			continue;
+		}
 		/* Don't change to another disk for sequential reads */
 		if (conf->mirrors[disk].next_seq_sect == this_sector
 		    || dist == 0) {
@@ -764,7 +785,9 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	 * mixed ratation/non-rotational disks depending on workload.
 	 */
 	if (best_disk == -1) {
-		if (has_nonrot_disk || min_pending == 0)
+		if (by_latency && best_cost_disk >= 0)
+			best_disk = best_cost_disk;
+		else if (has_nonrot_disk || min_pending == 0)
 			best_disk = best_pending_disk;
 		else
 			best_disk = best_dist_disk;
@@ -1313,6 +1336,10 @@ static void raid1_read_request(struct mddev *mddev, struct bio *bio,
 	        trace_block_bio_remap(read_bio, disk_devt(mddev->gendisk),
 				      r1_bio->sector);
 
+	if (READ_ONCE(conf->read_policy) == MD_READ_POLICY_LATENCY)
+		r1_bio->read_start_ns = ktime_get_ns();
+	else
+		r1_bio->read_start_ns = 0;
 	submit_bio_noacct(read_bio);
 }
 
@@ -3083,6 +3110,63 @@ static struct r1conf *setup_conf(struct mddev *mddev)
 	return ERR_PTR(err);
 }
 
+static const char *raid1_read_policy_names[] = {
+	[MD_READ_POLICY_DEFAULT]	= "default",
+	[MD_READ_POLICY_LATENCY]	= "latency",
+};
+
+static ssize_t
+raid1_show_read_policy(struct mddev *mddev, char *page)
+{
+	struct r1conf *conf;
+	int ret = 0;
+
+	spin_lock(&mddev->lock);
+	conf = mddev->private;
+	if (conf)
+		ret = sprintf(page, "%s\n",
+			raid1_read_policy_names[READ_ONCE(conf->read_policy)]);
+	spin_unlock(&mddev->lock);
+	return ret;
+}
+
+static ssize_t
+raid1_store_read_policy(struct mddev *mddev, const char *page, size_t len)
+{
+	struct r1conf *conf;
+	int policy, err;
+
+	policy = sysfs_match_string(raid1_read_policy_names, page);
+	if (policy < 0)
+		return policy;
+
+	err = mddev_lock(mddev);
+	if (err)
+		return err;
+	conf = mddev->private;
+	if (!conf)
+		err = -ENODEV;
+	else
+		WRITE_ONCE(conf->read_policy, policy);
+	mddev_unlock(mddev);
+	return err ?: len;
+}
+
+static struct md_sysfs_entry
+raid1_read_policy = __ATTR(read_policy, S_IRUGO | S_IWUSR,
+			   raid1_show_read_policy,
+			   raid1_store_read_policy);
+
+static struct attribute *raid1_attrs[] =  {
+	&raid1_read_policy.attr,
+	NULL,
+};
+
+static const struct attribute_group raid1_attrs_group = {
+	.name = NULL,
+	.attrs = raid1_attrs,
+};
+
 static void raid1_free(struct mddev *mddev, void *priv);
 static int raid1_run(struct mddev *mddev)
 {
@@ -3163,6 +3247,12 @@ static int raid1_run(struct mddev *mddev)
 	mddev->private = conf;
 	set_bit(MD_FAILFAST_SUPPORTED, &mddev->flags);
 
+	if (mddev->to_remove == &raid1_attrs_group)
+		mddev->to_remove = NULL;
+	else if (mddev->kobj.sd &&
+	    sysfs_create_group(&mddev->kobj, &raid1_attrs_group))
+		pr_warn("md/raid1:%s: failed to create sysfs attributes\n",
+			mdname(mddev));
 	md_set_array_sectors(mddev, raid1_size(mddev, 0, 0));
 
 	if (mddev->queue) {
@@ -3200,6 +3290,7 @@ static void raid1_free(struct mddev *mddev, void *priv)
 	kfree(conf->barrier);
 	bioset_exit(&conf->bio_split);
 	kfree(conf);
+	mddev->to_remove = &raid1_attrs_group;
 }
 
 static int raid1_resize(struct mddev *mddev, sector_t sectors)
@@ -133,6 +133,9 @@ struct r1conf {
 	 */
 	struct md_thread	*thread;
 
+	/* enum md_read_policy, set through the read_policy sysfs attribute */
+	int			read_policy;
+
 	/* Keep track of cluster resync window to send to other
 	 * nodes.
 	 */
@@ -168,6 +171,8 @@ struct r1bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_disk;
+	/* issue time of the read for latency accounting, 0 if not measured */
+	u64			read_start_ns;
 
 	struct list_head	retry_list;
 
@@ -384,6 +384,8 @@ static void raid10_end_read_request(struct bio *bio)
 			uptodate = 1;
 	}
 	if (uptodate) {
+		if (r10_bio->read_start_ns && !bio->bi_status)
+			md_rdev_read_done(rdev, r10_bio->read_start_ns);
 		raid_end_bio_io(r10_bio);
 		rdev_dec_pending(rdev, conf->mddev);
 	} else {
@@ -715,6 +717,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	int best_dist_slot, best_pending_slot;
 	bool has_nonrot_disk = false;
 	unsigned int min_pending;
+	struct md_rdev *best_cost_rdev = NULL;
+	int best_cost_slot = -1;
+	u64 min_cost = U64_MAX;
+	bool by_latency;
 	struct geom *geo = &conf->geo;
 
 	raid10_find_phys(conf, r10_bio);
@@ -726,6 +732,7 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	best_dist = MaxSector;
 	best_good_sectors = 0;
 	do_balance = 1;
+	by_latency = READ_ONCE(conf->read_policy) == MD_READ_POLICY_LATENCY;
 	clear_bit(R10BIO_FailFast, &r10_bio->state);
 	/*
 	 * Check if we can balance. We can balance on the whole
@@ -808,6 +815,16 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		if (best_dist_slot >= 0)
 			/* At least 2 disks to choose from so failfast is OK */
 			set_bit(R10BIO_FailFast, &r10_bio->state);
+
+		if (by_latency) {
+			u64 cost = md_rdev_read_cost(rdev);
+
+			if (cost < min_cost) {
+				min_cost = cost;
+				best_cost_slot = slot;
+				best_cost_rdev = rdev;
+			}
+		}
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -829,7 +846,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		}
 	}
 	if (slot >= conf->copies) {
-		if (has_nonrot_disk) {
+		if (by_latency && best_cost_rdev) {
+			slot = best_cost_slot;
+			rdev = best_cost_rdev;
+		} else if (has_nonrot_disk) {
 			slot = best_pending_slot;
 			rdev = best_pending_rdev;
 		} else {
@@ -1206,6 +1226,10 @@ static void raid10_read_request(struct mddev *mddev, struct bio *bio,
 	if (mddev->gendisk)
 	        trace_block_bio_remap(read_bio, disk_devt(mddev->gendisk),
 	                              r10_bio->sector);
+	if (READ_ONCE(conf->read_policy) == MD_READ_POLICY_LATENCY)
+		r10_bio->read_start_ns = ktime_get_ns();
+	else
+		r10_bio->read_start_ns = 0;
 	submit_bio_noacct(read_bio);
 	return;
 }
@@ -4047,6 +4071,63 @@ static void raid10_set_io_opt(struct r10conf *conf)
 			 raid_disks);
 }
 
+static const char *raid10_read_policy_names[] = {
+	[MD_READ_POLICY_DEFAULT]	= "default",
+	[MD_READ_POLICY_LATENCY]	= "latency",
+};
+
+static ssize_t
+raid10_show_read_policy(struct mddev *mddev, char *page)
+{
+	struct r10conf *conf;
+	int ret = 0;
+
+	spin_lock(&mddev->lock);
+	conf = mddev->private;
+	if (conf)
+		ret = sprintf(page, "%s\n",
+			raid10_read_policy_names[READ_ONCE(conf->read_policy)]);
+	spin_unlock(&mddev->lock);
+	return ret;
+}
+
+static ssize_t
+raid10_store_read_policy(struct mddev *mddev, const char *page, size_t len)
+{
+	struct r10conf *conf;
+	int policy, err;
+
+	policy = sysfs_match_string(raid10_read_policy_names, page);
+	if (policy < 0)
+		return policy;
+
+	err = mddev_lock(mddev);
+	if (err)
+		return err;
+	conf = mddev->private;
+	if (!conf)
+		err = -ENODEV;
+	else
+		WRITE_ONCE(conf->read_policy, policy);
+	mddev_unlock(mddev);
+	return err ?: len;
+}
+
+static struct md_sysfs_entry
+raid10_read_policy = __ATTR(read_policy, S_IRUGO | S_IWUSR,
+			    raid10_show_read_policy,
+			    raid10_store_read_policy);
+
+static struct attribute *raid10_attrs[] =  {
+	&raid10_read_policy.attr,
+	NULL,
+};
+
+static const struct attribute_group raid10_attrs_group = {
+	.name = NULL,
+	.attrs = raid10_attrs,
+};
+
 static int raid10_run(struct mddev *mddev)
 {
 	struct r10conf *conf;
@@ -4235,6 +4316,13 @@ static int raid10_run(struct mddev *mddev)
 			goto out_free_conf;
 	}
 
+	if (mddev->to_remove == &raid10_attrs_group)
+		mddev->to_remove = NULL;
+	else if (mddev->kobj.sd &&
+	    sysfs_create_group(&mddev->kobj, &raid10_attrs_group))
+		pr_warn("md/raid10:%s: failed to create sysfs attributes\n",
+			mdname(mddev));
+
 	return 0;
 
 out_free_conf:
@@ -4259,6 +4347,7 @@ static void raid10_free(struct mddev *mddev, void *priv)
 	kfree(conf->mirrors_new);
 	bioset_exit(&conf->bio_split);
 	kfree(conf);
+	mddev->to_remove = &raid10_attrs_group;
 }
 
 static void raid10_quiesce(struct mddev *mddev, int quiesce)
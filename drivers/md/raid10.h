@@ -103,6 +103,9 @@ struct r10conf {
 	 */
 	struct md_thread	*thread;
 
+	/* enum md_read_policy, set through the read_policy sysfs attribute */
+	int			read_policy;
+
 	/*
 	 * Keep track of cluster resync window to send to other nodes.
 	 */
@@ -134,6 +137,8 @@ struct r10bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_slot;
+	/* issue time of the read for latency accounting, 0 if not measured */
+	u64			read_start_ns;
 
 	struct list_head	retry_list;
 	/*
@@ -416,7 +416,7 @@ static inline void remove_hash(struct stripe_head *sh)
 	pr_debug("remove_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_del_init(&sh->hash);
+	hlist_del_init_rcu(&sh->hash);
 }
 
 static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
@@ -426,7 +426,7 @@ static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
 	pr_debug("insert_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_add_head(&sh->hash, hp);
+	hlist_add_head_rcu(&sh->hash, hp);
 }
 
 /* find an idle stripe, make sure it is unhashed, and return it. */
@@ -618,6 +618,39 @@ static struct stripe_head *__find_stripe(struct r5conf *conf, sector_t sector,
 	return NULL;
 }
 
+/*
+ * Lockless lookup of a stripe that is already active, i.e. has a non-zero
+ * count.  Stripes are allocated from a SLAB_TYPESAFE_BY_RCU cache and move
+ * between hash chains while we walk them, so the lookup may miss, and a
+ * stripe found may have been recycled for another sector before we got our
+ * reference.  Recheck it once the reference is held; anything unexpected
+ * is left to the locked lookup in raid5_get_active_stripe().
+ */
+static struct stripe_head *find_get_active_stripe_rcu(struct r5conf *conf,
+						      sector_t sector,
+						      short generation)
+{
+	struct stripe_head *sh;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(sh, stripe_hash(conf, sector), hash) {
+		if (READ_ONCE(sh->sector) != sector ||
+		    READ_ONCE(sh->generation) != generation)
+			continue;
+		if (!atomic_inc_not_zero(&sh->count))
+			break;
+		rcu_read_unlock();
+
+		if (sh->sector == sector && sh->generation == generation &&
+		    !hlist_unhashed(&sh->hash))
+			return sh;
+		raid5_release_stripe(sh);
+		return NULL;
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
 /*
  * Need to check if array has failed when deciding whether to:
  *  - start an array
@@ -710,6 +743,13 @@ raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 
 	pr_debug("get_stripe, sector %llu\n", (unsigned long long)sector);
 
+	if (noquiesce || !READ_ONCE(conf->quiesce)) {
+		sh = find_get_active_stripe_rcu(conf, sector,
+						conf->generation - previous);
+		if (sh)
+			return sh;
+	}
+
 	spin_lock_irq(conf->hash_locks + hash);
 
 	do {
@@ -2371,7 +2411,7 @@ static int grow_stripes(struct r5conf *conf, int num)
 	conf->active_name = 0;
 	sc = kmem_cache_create(conf->cache_name[conf->active_name],
 			       sizeof(struct stripe_head)+(devs-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return 1;
 	conf->slab_cache = sc;
@@ -2497,7 +2537,7 @@ static int resize_stripes(struct r5conf *conf, int newsize)
 	/* Step 1 */
 	sc = kmem_cache_create(conf->cache_name[1-conf->active_name],
 			       sizeof(struct stripe_head)+(newsize-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return -ENOMEM;
 
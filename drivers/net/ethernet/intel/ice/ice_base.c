@@ -372,8 +372,22 @@ static int ice_setup_rx_ctx(struct ice_ring *ring)
 	/* L2TSEL flag defines the reported L2 Tags in the receive descriptor */
 	rlan_ctx.l2tsel = 1;
 
-	rlan_ctx.dtype = ICE_RX_DTYPE_NO_SPLIT;
-	rlan_ctx.hsplit_0 = ICE_RLAN_RX_HSPLIT_0_NO_SPLIT;
+	if (ring->hdr_buf) {
+		/* Put the L2 to L4 headers of each frame in a buffer of their
+		 * own, so that the payload starts on a page boundary.
+		 */
+		rlan_ctx.hbuf = ICE_RX_HDR_SIZE >> ICE_RLAN_CTX_HBUF_S;
+		rlan_ctx.dtype = ICE_RX_DTYPE_HEADER_SPLIT;
+		rlan_ctx.hsplit_0 = ICE_RLAN_RX_HSPLIT_0_SPLIT_L2 |
+				    ICE_RLAN_RX_HSPLIT_0_SPLIT_IP |
+				    ICE_RLAN_RX_HSPLIT_0_SPLIT_TCP_UDP |
+				    ICE_RLAN_RX_HSPLIT_0_SPLIT_SCTP;
+		ring->flags |= ICE_RX_FLAGS_RING_HDR_SPLIT;
+	} else {
+		rlan_ctx.dtype = ICE_RX_DTYPE_NO_SPLIT;
+		rlan_ctx.hsplit_0 = ICE_RLAN_RX_HSPLIT_0_NO_SPLIT;
+		ring->flags &= ~ICE_RX_FLAGS_RING_HDR_SPLIT;
+	}
 	rlan_ctx.hsplit_1 = ICE_RLAN_RX_HSPLIT_1_NO_SPLIT;
 
 	/* This controls whether VLAN is stripped from inner headers
@@ -420,8 +434,11 @@ static int ice_setup_rx_ctx(struct ice_ring *ring)
 	if (vsi->type == ICE_VSI_VF)
 		return 0;
 
-	/* configure Rx buffer alignment */
-	if (!vsi->netdev || test_bit(ICE_FLAG_LEGACY_RX, vsi->back->flags))
+	/* configure Rx buffer alignment, the payload of header split rings
+	 * starts at the beginning of the page
+	 */
+	if (!vsi->netdev || test_bit(ICE_FLAG_LEGACY_RX, vsi->back->flags) ||
+	    ice_ring_uses_hdr_split(ring))
 		ice_clear_ring_build_skb_ena(ring);
 	else
 		ice_set_ring_build_skb_ena(ring);
@@ -482,9 +499,21 @@ int ice_vsi_cfg_rxq(struct ice_ring *ring)
 							 NULL);
 			if (err)
 				return err;
+			/* lets bpf_xdp_adjust_tail() grow the last frag */
+			ring->xdp_rxq.frag_size = ice_rx_pg_size(ring) / 2;
 		}
 	}
 
+	/* header buffers only exist while header split is enabled */
+	if (ring->vsi->type == ICE_VSI_PF && !ring->xsk_pool &&
+	    test_bit(ICE_FLAG_HDR_SPLIT, ring->vsi->back->flags)) {
+		err = ice_setup_rx_hdr_bufs(ring);
+		if (err)
+			return err;
+	} else {
+		ice_free_rx_hdr_bufs(ring);
+	}
+
 	err = ice_setup_rx_ctx(ring);
 	if (err) {
 		dev_err(dev, "ice_setup_rx_ctx failed for RxQ %d, err %d\n",
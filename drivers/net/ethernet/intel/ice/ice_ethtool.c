@@ -165,6 +165,7 @@ static const struct ice_priv_flag ice_gstrings_priv_flags[] = {
 		      ICE_FLAG_VF_TRUE_PROMISC_ENA),
 	ICE_PRIV_FLAG("mdd-auto-reset-vf", ICE_FLAG_MDD_AUTO_RESET_VF),
 	ICE_PRIV_FLAG("legacy-rx", ICE_FLAG_LEGACY_RX),
+	ICE_PRIV_FLAG("header-split", ICE_FLAG_HDR_SPLIT),
 };
 
 #define ICE_PRIV_FLAG_ARRAY_SIZE	ARRAY_SIZE(ice_gstrings_priv_flags)
@@ -1260,7 +1261,19 @@ static int ice_set_priv_flags(struct net_device *netdev, u32 flags)
 			ice_nway_reset(netdev);
 		}
 	}
-	if (test_bit(ICE_FLAG_LEGACY_RX, change_flags)) {
+	/* the payload buffers of header split rings must be whole pages and
+	 * XDP programs expect the headers in the same buffer as the payload
+	 */
+	if (test_bit(ICE_FLAG_HDR_SPLIT, change_flags) &&
+	    test_bit(ICE_FLAG_HDR_SPLIT, pf->flags) &&
+	    (PAGE_SIZE >= 8192 || ice_is_xdp_ena_vsi(vsi))) {
+		dev_err(dev, "header-split requires 4K pages and no XDP program\n");
+		clear_bit(ICE_FLAG_HDR_SPLIT, pf->flags);
+		clear_bit(ICE_FLAG_HDR_SPLIT, change_flags);
+		ret = -EOPNOTSUPP;
+	}
+	if (test_bit(ICE_FLAG_LEGACY_RX, change_flags) ||
+	    test_bit(ICE_FLAG_HDR_SPLIT, change_flags)) {
 		/* down and up VSI so that changes of Rx cfg are reflected. */
 		ice_down(vsi);
 		ice_up(vsi);
@@ -2847,6 +2860,8 @@ ice_set_ringparam(struct net_device *netdev, struct ethtool_ringparam *ring)
 		rx_rings[i].count = new_rx_cnt;
 		rx_rings[i].desc = NULL;
 		rx_rings[i].rx_buf = NULL;
+		/* sized by the ring, reallocated by ice_vsi_cfg_rxq() */
+		rx_rings[i].hdr_buf = NULL;
 		/* this is to allow wr32 to have something to write to
 		 * during early allocation of Rx buffers
 		 */
@@ -360,6 +360,11 @@ enum ice_flg64_bits {
 /* for ice_32byte_rx_flex_desc.pkt_length member */
 #define ICE_RX_FLX_DESC_PKT_LEN_M	(0x3FFF) /* 14-bits */
 
+/* for ice_32byte_rx_flex_desc.hdr_len_sph_flex_flags1 member */
+#define ICE_RX_FLX_DESC_HDR_LEN_M	(0x7FF) /* 11-bits */
+#define ICE_RX_FLX_DESC_SPH_S		11
+#define ICE_RX_FLX_DESC_SPH_M		BIT(ICE_RX_FLX_DESC_SPH_S)
+
 enum ice_rx_flex_desc_status_error_0_bits {
 	/* Note: These are predefined bit offsets */
 	ICE_RX_FLEX_DESC_STATUS0_DD_S = 0,
@@ -1663,6 +1663,14 @@ int ice_vsi_kill_vlan(struct ice_vsi *vsi, u16 vid)
  */
 void ice_vsi_cfg_frame_size(struct ice_vsi *vsi)
 {
+#if (PAGE_SIZE < 8192)
+	/* header split rings put the payload in whole pages */
+	if (vsi->netdev && test_bit(ICE_FLAG_HDR_SPLIT, vsi->back->flags)) {
+		vsi->max_frame = ICE_AQ_SET_MAC_FRAME_SIZE_MAX;
+		vsi->rx_buf_len = ICE_RXBUF_4096;
+		return;
+	}
+#endif
 	if (!vsi->netdev || test_bit(ICE_FLAG_LEGACY_RX, vsi->back->flags)) {
 		vsi->max_frame = ICE_AQ_SET_MAC_FRAME_SIZE_MAX;
 		vsi->rx_buf_len = ICE_RXBUF_2048;
@@ -2665,6 +2673,7 @@ void ice_vsi_free_irq(struct ice_vsi *vsi)
 		irq_set_affinity_hint(irq_num, NULL);
 		synchronize_irq(irq_num);
 		devm_free_irq(ice_pf_to_dev(pf), irq_num, vsi->q_vectors[i]);
+		netif_napi_set_irq(&vsi->q_vectors[i]->napi, -1);
 	}
 }
 
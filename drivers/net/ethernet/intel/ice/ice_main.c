@@ -2365,6 +2365,7 @@ static int ice_vsi_req_irq_msix(struct ice_vsi *vsi, char *basename)
 				   err);
 			goto free_q_irqs;
 		}
+		netif_napi_set_irq(&q_vector->napi, irq_num);
 
 		/* register for affinity change notifications */
 		if (!IS_ENABLED(CONFIG_RFS_ACCEL)) {
@@ -2655,6 +2656,19 @@ static void ice_vsi_rx_napi_schedule(struct ice_vsi *vsi)
 	}
 }
 
+/**
+ * ice_xdp_frags_capable - check if the Rx rings can gather XDP frags
+ * @vsi: VSI to check
+ *
+ * The frags of a multi-buffer frame are kept in the skb_shared_info of its
+ * first buffer, which only has room for it when the rings use build_skb.
+ */
+static bool ice_xdp_frags_capable(struct ice_vsi *vsi)
+{
+	return PAGE_SIZE < 8192 &&
+	       !test_bit(ICE_FLAG_LEGACY_RX, vsi->back->flags);
+}
+
 /**
  * ice_xdp_setup_prog - Add or remove XDP eBPF program
  * @vsi: VSI to setup XDP for
@@ -2669,7 +2683,13 @@ ice_xdp_setup_prog(struct ice_vsi *vsi, struct bpf_prog *prog,
 	bool if_running = netif_running(vsi->netdev);
 	int ret = 0, xdp_ring_err = 0;
 
-	if (frame_size > vsi->rx_buf_len) {
+	if (prog && test_bit(ICE_FLAG_HDR_SPLIT, vsi->back->flags)) {
+		NL_SET_ERR_MSG_MOD(extack, "XDP is not supported with header split");
+		return -EOPNOTSUPP;
+	}
+
+	if (frame_size > vsi->rx_buf_len &&
+	    !(prog && prog->aux->xdp_has_frags && ice_xdp_frags_capable(vsi))) {
 		NL_SET_ERR_MSG_MOD(extack, "MTU too large for loading XDP");
 		return -EOPNOTSUPP;
 	}
@@ -5611,6 +5631,18 @@ static void ice_napi_enable_all(struct ice_vsi *vsi)
 
 	ice_for_each_q_vector(vsi, q_idx) {
 		struct ice_q_vector *q_vector = vsi->q_vectors[q_idx];
+		struct ice_ring *ring;
+
+		/* report the queues served by the vector to user space */
+		ice_for_each_ring(ring, q_vector->rx)
+			netif_queue_set_napi(vsi->netdev, ring->q_index,
+					     NETDEV_QUEUE_TYPE_RX,
+					     &q_vector->napi);
+		ice_for_each_ring(ring, q_vector->tx)
+			if (!ice_ring_is_xdp(ring))
+				netif_queue_set_napi(vsi->netdev, ring->q_index,
+						     NETDEV_QUEUE_TYPE_TX,
+						     &q_vector->napi);
 
 		INIT_WORK(&q_vector->tx.dim.work, ice_tx_dim_work);
 		q_vector->tx.dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
@@ -6545,6 +6577,11 @@ static void ice_rebuild(struct ice_pf *pf, enum ice_reset_req reset_type)
  */
 static int ice_max_xdp_frame_size(struct ice_vsi *vsi)
 {
+	struct bpf_prog *prog = READ_ONCE(vsi->xdp_prog);
+
+	if (prog && prog->aux->xdp_has_frags && ice_xdp_frags_capable(vsi))
+		return ICE_AQ_SET_MAC_FRAME_SIZE_MAX;
+
 	if (PAGE_SIZE >= 8192 || test_bit(ICE_FLAG_LEGACY_RX, vsi->back->flags))
 		return ICE_RXBUF_2048 - XDP_PACKET_HEADROOM;
 	else
@@ -14,8 +14,6 @@
 #include "ice_dcb_lib.h"
 #include "ice_xsk.h"
 
-#define ICE_RX_HDR_SIZE		256
-
 #define FDIR_DESC_RXDID 0x40
 #define ICE_FDIR_CLEAN_DELAY 10
 
@@ -266,8 +264,17 @@ static bool ice_clean_tx_irq(struct ice_ring *tx_ring, int napi_budget)
 				tx_desc = ICE_TX_DESC(tx_ring, 0);
 			}
 
-			/* unmap any remaining paged data */
-			if (dma_unmap_len(tx_buf, len)) {
+			/* free the fragments of a multi-buffer XDP frame */
+			if (ice_ring_is_xdp(tx_ring) && tx_buf->raw_buf) {
+				page_frag_free(tx_buf->raw_buf);
+				tx_buf->raw_buf = NULL;
+				dma_unmap_single(tx_ring->dev,
+						 dma_unmap_addr(tx_buf, dma),
+						 dma_unmap_len(tx_buf, len),
+						 DMA_TO_DEVICE);
+				dma_unmap_len_set(tx_buf, len, 0);
+			} else if (dma_unmap_len(tx_buf, len)) {
+				/* unmap any remaining paged data */
 				dma_unmap_page(tx_ring->dev,
 					       dma_unmap_addr(tx_buf, dma),
 					       dma_unmap_len(tx_buf, len),
@@ -384,6 +391,11 @@ void ice_clean_rx_ring(struct ice_ring *rx_ring)
 		rx_ring->skb = NULL;
 	}
 
+	if (rx_ring->xdp.data) {
+		xdp_return_buff(&rx_ring->xdp);
+		rx_ring->xdp.data = NULL;
+	}
+
 	if (rx_ring->xsk_pool) {
 		ice_xsk_clean_rx_ring(rx_ring);
 		goto rx_skip_free;
@@ -439,6 +451,7 @@ void ice_free_rx_ring(struct ice_ring *rx_ring)
 	rx_ring->xdp_prog = NULL;
 	devm_kfree(rx_ring->dev, rx_ring->rx_buf);
 	rx_ring->rx_buf = NULL;
+	ice_free_rx_hdr_bufs(rx_ring);
 
 	if (rx_ring->desc) {
 		dmam_free_coherent(rx_ring->dev, rx_ring->size,
@@ -447,6 +460,47 @@ void ice_free_rx_ring(struct ice_ring *rx_ring)
 	}
 }
 
+/**
+ * ice_setup_rx_hdr_bufs - Allocate the header buffers of a header split ring
+ * @rx_ring: the Rx ring to set up
+ *
+ * Each descriptor gets ICE_RX_HDR_SIZE bytes for the headers of its frame.
+ * They are never recycled with the payload pages, so a single coherent
+ * allocation for the whole ring is enough.
+ *
+ * Return 0 on success, negative on error
+ */
+int ice_setup_rx_hdr_bufs(struct ice_ring *rx_ring)
+{
+	if (rx_ring->hdr_buf)
+		return 0;
+
+	rx_ring->hdr_buf = dmam_alloc_coherent(rx_ring->dev,
+					       rx_ring->count * ICE_RX_HDR_SIZE,
+					       &rx_ring->hdr_dma, GFP_KERNEL);
+	if (!rx_ring->hdr_buf) {
+		dev_err(rx_ring->dev, "Unable to allocate memory for the Rx header buffers, size=%d\n",
+			rx_ring->count * ICE_RX_HDR_SIZE);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * ice_free_rx_hdr_bufs - Free the header buffers of a ring
+ * @rx_ring: ring to clean the resources from
+ */
+void ice_free_rx_hdr_bufs(struct ice_ring *rx_ring)
+{
+	if (!rx_ring->hdr_buf)
+		return;
+
+	dmam_free_coherent(rx_ring->dev, rx_ring->count * ICE_RX_HDR_SIZE,
+			   rx_ring->hdr_buf, rx_ring->hdr_dma);
+	rx_ring->hdr_buf = NULL;
+}
+
 /**
  * ice_setup_rx_ring - Allocate the Rx descriptors
  * @rx_ring: the Rx ring to set up
@@ -695,6 +749,10 @@ bool ice_alloc_rx_bufs(struct ice_ring *rx_ring, u16 cleaned_count)
 		 * because each write-back erases this info.
 		 */
 		rx_desc->read.pkt_addr = cpu_to_le64(bi->dma + bi->page_offset);
+		if (rx_ring->hdr_buf)
+			rx_desc->read.hdr_addr =
+				cpu_to_le64(rx_ring->hdr_dma +
+					    ntu * ICE_RX_HDR_SIZE);
 
 		rx_desc++;
 		bi++;
@@ -782,6 +840,20 @@ ice_can_reuse_rx_page(struct ice_rx_buf *rx_buf, int rx_buf_pgcnt)
 	return true;
 }
 
+/**
+ * ice_can_reuse_hdr_split_page - Determine if a payload page can be reused
+ * @rx_buf: buffer containing the page
+ *
+ * The payload pages of header split rings are handed to the stack whole, so
+ * that they stay page aligned all the way to TCP_ZEROCOPY_RECEIVE. They can
+ * only be put back on the ring when the frame had no payload.
+ */
+static bool ice_can_reuse_hdr_split_page(struct ice_rx_buf *rx_buf)
+{
+	return dev_page_is_reusable(rx_buf->page) &&
+	       page_count(rx_buf->page) == rx_buf->pagecnt_bias;
+}
+
 /**
  * ice_add_rx_frag - Add contents of Rx buffer to sk_buff as a frag
  * @rx_ring: Rx descriptor ring to transact packets on
@@ -800,7 +872,8 @@ ice_add_rx_frag(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 #if (PAGE_SIZE >= 8192)
 	unsigned int truesize = SKB_DATA_ALIGN(size + rx_ring->rx_offset);
 #else
-	unsigned int truesize = ice_rx_pg_size(rx_ring) / 2;
+	unsigned int truesize = ice_ring_uses_hdr_split(rx_ring) ? PAGE_SIZE :
+				ice_rx_pg_size(rx_ring) / 2;
 #endif
 
 	if (!size)
@@ -812,6 +885,44 @@ ice_add_rx_frag(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 	ice_rx_buf_adjust_pg_offset(rx_buf, truesize);
 }
 
+/**
+ * ice_add_xdp_frag - Add contents of Rx buffer to xdp_buff as a frag
+ * @rx_ring: Rx descriptor ring to transact packets on
+ * @xdp: multi-buffer xdp_buff to place the data into
+ * @rx_buf: buffer containing page to add
+ * @size: packet length from rx_desc
+ *
+ * Same as ice_add_rx_frag(), but the frags go to the skb_shared_info in the
+ * tailroom of the first buffer of the frame. The hardware chains at most
+ * ICE_MAX_CHAINED_RX_BUFS buffers, so the frags never overflow.
+ */
+static void
+ice_add_xdp_frag(struct ice_ring *rx_ring, struct xdp_buff *xdp,
+		 struct ice_rx_buf *rx_buf, unsigned int size)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	unsigned int truesize = ice_rx_frame_truesize(rx_ring, size);
+	skb_frag_t *frag;
+
+	if (!size)
+		return;
+
+	if (!xdp_buff_has_frags(xdp)) {
+		sinfo->nr_frags = 0;
+		sinfo->xdp_frags_size = 0;
+		xdp_buff_set_frags_flag(xdp);
+	}
+
+	frag = &sinfo->frags[sinfo->nr_frags++];
+	__skb_frag_set_page(frag, rx_buf->page);
+	skb_frag_off_set(frag, rx_buf->page_offset);
+	skb_frag_size_set(frag, size);
+	sinfo->xdp_frags_size += size;
+
+	/* page is being used so we must update the page offset */
+	ice_rx_buf_adjust_pg_offset(rx_buf, truesize);
+}
+
 /**
  * ice_reuse_rx_page - page flip buffer and store it back on the ring
  * @rx_ring: Rx descriptor ring to store buffers on
@@ -929,6 +1040,45 @@ ice_build_skb(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 	return skb;
 }
 
+/**
+ * ice_build_skb_from_xdp - Build skb around a multi-buffer xdp_buff
+ * @rx_ring: Rx descriptor ring to transact packets on
+ * @xdp: xdp_buff pointing to the data
+ *
+ * The buffers already belong to the frame, so unlike ice_build_skb() there
+ * is no page offset to update. The frags are kept in place, build_skb()
+ * only clears their count.
+ */
+static struct sk_buff *
+ice_build_skb_from_xdp(struct ice_ring *rx_ring, struct xdp_buff *xdp)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	u8 metasize = xdp->data - xdp->data_meta;
+	struct sk_buff *skb;
+	u8 nr_frags = 0;
+
+	if (xdp_buff_has_frags(xdp))
+		nr_frags = sinfo->nr_frags;
+
+	net_prefetch(xdp->data_meta);
+	skb = build_skb(xdp->data_hard_start, xdp->frame_sz);
+	if (unlikely(!skb))
+		return NULL;
+
+	skb_record_rx_queue(skb, rx_ring->q_index);
+
+	skb_reserve(skb, xdp->data - xdp->data_hard_start);
+	__skb_put(skb, xdp->data_end - xdp->data);
+	if (metasize)
+		skb_metadata_set(skb, metasize);
+
+	if (nr_frags)
+		xdp_update_skb_shared_info(skb, nr_frags, sinfo->xdp_frags_size,
+					   nr_frags * xdp->frame_sz);
+
+	return skb;
+}
+
 /**
  * ice_construct_skb - Allocate skb and populate it
  * @rx_ring: Rx descriptor ring to transact packets on
@@ -972,7 +1122,8 @@ ice_construct_skb(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 #if (PAGE_SIZE >= 8192)
 		unsigned int truesize = SKB_DATA_ALIGN(size);
 #else
-		unsigned int truesize = ice_rx_pg_size(rx_ring) / 2;
+		unsigned int truesize = ice_ring_uses_hdr_split(rx_ring) ?
+					PAGE_SIZE : ice_rx_pg_size(rx_ring) / 2;
 #endif
 		skb_add_rx_frag(skb, 0, rx_buf->page,
 				rx_buf->page_offset + headlen, size, truesize);
@@ -989,6 +1140,52 @@ ice_construct_skb(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 	return skb;
 }
 
+/**
+ * ice_construct_skb_hdr_split - Allocate skb for a header split frame
+ * @rx_ring: Rx descriptor ring to transact packets on
+ * @rx_desc: descriptor of the first buffer of the frame
+ * @rx_buf: Rx buffer holding the payload
+ * @xdp: xdp_buff pointing to the payload, data is NULL if there is none
+ *
+ * The headers are copied out of the header buffer of the descriptor into
+ * the linear part of the skb and the payload page is attached as is, so the
+ * payload starts on a page boundary. Frames the hardware didn't split are
+ * handled like on any other ring.
+ */
+static struct sk_buff *
+ice_construct_skb_hdr_split(struct ice_ring *rx_ring,
+			    union ice_32b_rx_flex_desc *rx_desc,
+			    struct ice_rx_buf *rx_buf, struct xdp_buff *xdp)
+{
+	u16 hdr_info = le16_to_cpu(rx_desc->wb.hdr_len_sph_flex_flags1);
+	unsigned int hlen = hdr_info & ICE_RX_FLX_DESC_HDR_LEN_M;
+	struct sk_buff *skb;
+	void *hdr;
+
+	if (!(hdr_info & ICE_RX_FLX_DESC_SPH_M) || !hlen ||
+	    hlen > ICE_RX_HDR_SIZE)
+		return xdp->data ? ice_construct_skb(rx_ring, rx_buf, xdp) :
+				   NULL;
+
+	hdr = rx_ring->hdr_buf + rx_ring->next_to_clean * ICE_RX_HDR_SIZE;
+	net_prefetch(hdr);
+
+	skb = __napi_alloc_skb(&rx_ring->q_vector->napi, ICE_RX_HDR_SIZE,
+			       GFP_ATOMIC | __GFP_NOWARN);
+	if (unlikely(!skb))
+		return NULL;
+
+	skb_record_rx_queue(skb, rx_ring->q_index);
+	memcpy(__skb_put(skb, hlen), hdr, ALIGN(hlen, sizeof(long)));
+
+	/* the page isn't recycled, so there is no offset to update */
+	if (xdp->data)
+		skb_add_rx_frag(skb, 0, rx_buf->page, rx_buf->page_offset,
+				xdp->data_end - xdp->data, PAGE_SIZE);
+
+	return skb;
+}
+
 /**
  * ice_put_rx_buf - Clean up used buffer and either recycle or free
  * @rx_ring: Rx descriptor ring to transact packets on
@@ -1012,7 +1209,9 @@ ice_put_rx_buf(struct ice_ring *rx_ring, struct ice_rx_buf *rx_buf,
 	if (!rx_buf)
 		return;
 
-	if (ice_can_reuse_rx_page(rx_buf, rx_buf_pgcnt)) {
+	if (ice_ring_uses_hdr_split(rx_ring) ?
+	    ice_can_reuse_hdr_split_page(rx_buf) :
+	    ice_can_reuse_rx_page(rx_buf, rx_buf_pgcnt)) {
 		/* hand second half of page back to the ring */
 		ice_reuse_rx_page(rx_ring, rx_buf);
 	} else {
@@ -1048,6 +1247,49 @@ ice_is_non_eop(struct ice_ring *rx_ring, union ice_32b_rx_flex_desc *rx_desc)
 	return true;
 }
 
+/**
+ * ice_run_xdp_frags - Run XDP program on a gathered multi-buffer frame
+ * @rx_ring: Rx ring
+ * @xdp: multi-buffer xdp_buff, all of its buffers belong to the frame
+ * @xdp_prog: XDP program to run, XDP_PASS is assumed if it went away
+ * @xdp_xmit: XDP_TX/XDP_REDIRECT results of the batch
+ * @total_rx_bytes: bytes counter of the batch
+ * @total_rx_pkts: packets counter of the batch
+ *
+ * Returns the skb to hand to the stack on XDP_PASS, NULL otherwise.
+ */
+static struct sk_buff *
+ice_run_xdp_frags(struct ice_ring *rx_ring, struct xdp_buff *xdp,
+		  struct bpf_prog *xdp_prog, unsigned int *xdp_xmit,
+		  unsigned int *total_rx_bytes, unsigned int *total_rx_pkts)
+{
+	unsigned int size = xdp_get_buff_len(xdp);
+	unsigned int xdp_res = ICE_XDP_PASS;
+	struct sk_buff *skb;
+
+	if (xdp_prog)
+		xdp_res = ice_run_xdp(rx_ring, xdp, xdp_prog);
+
+	if (!xdp_res) {
+		skb = ice_build_skb_from_xdp(rx_ring, xdp);
+		if (likely(skb))
+			return skb;
+		rx_ring->rx_stats.alloc_buf_failed++;
+		xdp_return_buff(xdp);
+		return NULL;
+	}
+
+	if (xdp_res & (ICE_XDP_TX | ICE_XDP_REDIR))
+		*xdp_xmit |= xdp_res;
+	else
+		xdp_return_buff(xdp);
+
+	*total_rx_bytes += size;
+	(*total_rx_pkts)++;
+
+	return NULL;
+}
+
 /**
  * ice_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @rx_ring: Rx descriptor ring to transact packets on
@@ -1093,7 +1335,7 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 
 		/* status_error_len will always be zero for unused descriptors
 		 * because it's cleared in cleanup, and overlaps with hdr_addr
-		 * which is always zero because packet split isn't used, if the
+		 * which is either zero or ICE_RX_HDR_SIZE aligned, if the
 		 * hardware wrote DD then it will be non-zero
 		 */
 		stat_err_bits = BIT(ICE_RX_FLEX_DESC_STATUS0_DD_S);
@@ -1124,6 +1366,25 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 		/* retrieve a buffer from the ring */
 		rx_buf = ice_get_rx_buf(rx_ring, size, &rx_buf_pgcnt);
 
+		/* the next buffer of a multi-buffer XDP frame */
+		if (rx_ring->xdp.data) {
+			ice_add_xdp_frag(rx_ring, &rx_ring->xdp, rx_buf, size);
+			ice_put_rx_buf(rx_ring, rx_buf, rx_buf_pgcnt);
+			cleaned_count++;
+
+			if (ice_is_non_eop(rx_ring, rx_desc))
+				continue;
+
+			xdp_prog = READ_ONCE(rx_ring->xdp_prog);
+			skb = ice_run_xdp_frags(rx_ring, &rx_ring->xdp, xdp_prog,
+						&xdp_xmit, &total_rx_bytes,
+						&total_rx_pkts);
+			rx_ring->xdp.data = NULL;
+			if (!skb)
+				continue;
+			goto process_skb;
+		}
+
 		if (!size) {
 			xdp.data = NULL;
 			xdp.data_end = NULL;
@@ -1144,6 +1405,18 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 		if (!xdp_prog)
 			goto construct_skb;
 
+		/* gather the rest of the frame before running the program */
+		if (unlikely(!ice_test_staterr(rx_desc, ICE_RXD_EOF)) && !skb &&
+		    xdp_prog->aux->xdp_has_frags &&
+		    ice_ring_uses_build_skb(rx_ring)) {
+			rx_ring->xdp = xdp;
+			ice_rx_buf_adjust_pg_offset(rx_buf, xdp.frame_sz);
+			ice_put_rx_buf(rx_ring, rx_buf, rx_buf_pgcnt);
+			cleaned_count++;
+			rx_ring->rx_stats.non_eop_descs++;
+			continue;
+		}
+
 		xdp_res = ice_run_xdp(rx_ring, &xdp, xdp_prog);
 		if (!xdp_res)
 			goto construct_skb;
@@ -1162,6 +1435,9 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 construct_skb:
 		if (skb) {
 			ice_add_rx_frag(rx_ring, rx_buf, skb, size);
+		} else if (ice_ring_uses_hdr_split(rx_ring)) {
+			skb = ice_construct_skb_hdr_split(rx_ring, rx_desc,
+							  rx_buf, &xdp);
 		} else if (likely(xdp.data)) {
 			if (ice_ring_uses_build_skb(rx_ring))
 				skb = ice_build_skb(rx_ring, rx_buf, &xdp);
@@ -1171,7 +1447,8 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 		/* exit if we failed to retrieve a buffer */
 		if (!skb) {
 			rx_ring->rx_stats.alloc_buf_failed++;
-			if (rx_buf)
+			/* ice_get_rx_buf() only took a reference for data */
+			if (rx_buf && size)
 				rx_buf->pagecnt_bias++;
 			break;
 		}
@@ -1183,6 +1460,7 @@ int ice_clean_rx_irq(struct ice_ring *rx_ring, int budget)
 		if (ice_is_non_eop(rx_ring, rx_desc))
 			continue;
 
+process_skb:
 		stat_err_bits = BIT(ICE_RX_FLEX_DESC_STATUS0_RXE_S);
 		if (unlikely(ice_test_staterr(rx_desc, stat_err_bits))) {
 			dev_kfree_skb_any(skb);
@@ -7,10 +7,12 @@
 #include "ice_type.h"
 
 #define ICE_DFLT_IRQ_WORK	256
+#define ICE_RXBUF_4096		4096
 #define ICE_RXBUF_3072		3072
 #define ICE_RXBUF_2048		2048
 #define ICE_RXBUF_1536		1536
 #define ICE_MAX_CHAINED_RX_BUFS	5
+#define ICE_RX_HDR_SIZE		256
 #define ICE_MAX_BUF_TXD		8
 #define ICE_MIN_TX_LEN		17
 
@@ -295,11 +297,15 @@ struct ice_ring {
 	/* CL3 - 3rd cacheline starts here */
 	struct xdp_rxq_info xdp_rxq;
 	struct sk_buff *skb;
+	struct xdp_buff xdp;		/* multi-buffer frame being gathered */
+	void *hdr_buf;			/* header buffers of a header split ring */
+	dma_addr_t hdr_dma;		/* physical address of hdr_buf */
 	/* CLX - the below items are only accessed infrequently and should be
 	 * in their own cache line if possible
 	 */
 #define ICE_TX_FLAGS_RING_XDP		BIT(0)
 #define ICE_RX_FLAGS_RING_BUILD_SKB	BIT(1)
+#define ICE_RX_FLAGS_RING_HDR_SPLIT	BIT(2)
 	u8 flags;
 	dma_addr_t dma;			/* physical address of ring */
 	unsigned int size;		/* length of descriptor ring in bytes */
@@ -327,6 +333,11 @@ static inline void ice_clear_ring_build_skb_ena(struct ice_ring *ring)
 	ring->flags &= ~ICE_RX_FLAGS_RING_BUILD_SKB;
 }
 
+static inline bool ice_ring_uses_hdr_split(struct ice_ring *ring)
+{
+	return !!(ring->flags & ICE_RX_FLAGS_RING_HDR_SPLIT);
+}
+
 static inline bool ice_ring_is_xdp(struct ice_ring *ring)
 {
 	return !!(ring->flags & ICE_TX_FLAGS_RING_XDP);
@@ -371,7 +382,9 @@ struct ice_coalesce_stored {
 static inline unsigned int ice_rx_pg_order(struct ice_ring *ring)
 {
 #if (PAGE_SIZE < 8192)
-	if (ring->rx_buf_len > (PAGE_SIZE / 2))
+	/* header split rings use a whole page per payload buffer */
+	if (ring->rx_buf_len > (PAGE_SIZE / 2) &&
+	    !ice_ring_uses_hdr_split(ring))
 		return 1;
 #endif
 	return 0;
@@ -389,6 +402,8 @@ int ice_setup_tx_ring(struct ice_ring *tx_ring);
 int ice_setup_rx_ring(struct ice_ring *rx_ring);
 void ice_free_tx_ring(struct ice_ring *tx_ring);
 void ice_free_rx_ring(struct ice_ring *rx_ring);
+int ice_setup_rx_hdr_bufs(struct ice_ring *rx_ring);
+void ice_free_rx_hdr_bufs(struct ice_ring *rx_ring);
 int ice_napi_poll(struct napi_struct *napi, int budget);
 int
 ice_prgm_fdir_fltr(struct ice_vsi *vsi, struct ice_fltr_desc *fdir_desc,
@@ -262,6 +262,92 @@ int ice_xmit_xdp_ring(void *data, u16 size, struct ice_ring *xdp_ring)
 	return ICE_XDP_TX;
 }
 
+/**
+ * ice_xmit_xdp_frags - submit a multi-buffer XDP frame to XDP ring
+ * @xdpf: XDP frame with fragments
+ * @xdp_ring: XDP ring for transmission
+ *
+ * Each buffer of the frame takes a descriptor of its own, the last one
+ * carries EOP. Completion frees every buffer through its raw_buf.
+ */
+static int ice_xmit_xdp_frags(struct xdp_frame *xdpf, struct ice_ring *xdp_ring)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_frame(xdpf);
+	u32 nr_frags = sinfo->nr_frags, f = 0;
+	u16 ntu = xdp_ring->next_to_use;
+	struct ice_tx_buf *first, *tx_buf;
+	struct ice_tx_desc *tx_desc;
+	u16 i = ntu;
+	void *data = xdpf->data;
+	u32 size = xdpf->len;
+
+	if (unlikely(ICE_DESC_UNUSED(xdp_ring) < nr_frags + 1)) {
+		xdp_ring->tx_stats.tx_busy++;
+		return ICE_XDP_CONSUMED;
+	}
+
+	first = &xdp_ring->tx_buf[i];
+	for (;;) {
+		u64 cmd = f == nr_frags ? ICE_TXD_LAST_DESC_CMD : 0;
+		dma_addr_t dma;
+
+		dma = dma_map_single(xdp_ring->dev, data, size, DMA_TO_DEVICE);
+		if (dma_mapping_error(xdp_ring->dev, dma))
+			goto unmap;
+
+		tx_buf = &xdp_ring->tx_buf[i];
+		tx_buf->raw_buf = data;
+
+		/* record length, and DMA address */
+		dma_unmap_len_set(tx_buf, len, size);
+		dma_unmap_addr_set(tx_buf, dma, dma);
+
+		tx_desc = ICE_TX_DESC(xdp_ring, i);
+		tx_desc->buf_addr = cpu_to_le64(dma);
+		tx_desc->cmd_type_offset_bsz = ice_build_ctob(cmd, 0, size, 0);
+
+		i++;
+		if (i == xdp_ring->count)
+			i = 0;
+
+		if (f == nr_frags)
+			break;
+
+		data = skb_frag_address(&sinfo->frags[f]);
+		size = skb_frag_size(&sinfo->frags[f]);
+		f++;
+	}
+
+	first->bytecount = xdp_get_frame_len(xdpf);
+	first->gso_segs = 1;
+
+	/* Make certain all of the status bits have been updated
+	 * before next_to_watch is written.
+	 */
+	smp_wmb();
+
+	first->next_to_watch = tx_desc;
+	xdp_ring->next_to_use = i;
+
+	return ICE_XDP_TX;
+
+unmap:
+	/* the caller frees the frame, only undo the mappings */
+	while (ntu != i) {
+		tx_buf = &xdp_ring->tx_buf[ntu];
+		dma_unmap_single(xdp_ring->dev, dma_unmap_addr(tx_buf, dma),
+				 dma_unmap_len(tx_buf, len), DMA_TO_DEVICE);
+		dma_unmap_len_set(tx_buf, len, 0);
+		tx_buf->raw_buf = NULL;
+
+		ntu++;
+		if (ntu == xdp_ring->count)
+			ntu = 0;
+	}
+
+	return ICE_XDP_CONSUMED;
+}
+
 /**
  * ice_xmit_xdp_buff - convert an XDP buffer to an XDP frame and send it
  * @xdp: XDP buffer
@@ -276,6 +362,9 @@ int ice_xmit_xdp_buff(struct xdp_buff *xdp, struct ice_ring *xdp_ring)
 	if (unlikely(!xdpf))
 		return ICE_XDP_CONSUMED;
 
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		return ice_xmit_xdp_frags(xdpf, xdp_ring);
+
 	return ice_xmit_xdp_ring(xdpf->data, xdpf->len, xdp_ring);
 }
 
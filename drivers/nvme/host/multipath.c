@@ -273,6 +273,106 @@ static struct nvme_ns *nvme_round_robin_path(struct nvme_ns_head *head,
 	return found;
 }
 
+/* weight of a new sample in the per-controller EWMA latency, 1/8 */
+#define NVME_MPATH_LAT_SHIFT	3
+
+void nvme_mpath_start_request(struct request *rq)
+{
+	struct nvme_ns *ns = rq->q->queuedata;
+	int policy;
+
+	if (!(rq->cmd_flags & REQ_NVME_MPATH) ||
+	    (nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE))
+		return;
+
+	policy = READ_ONCE(ns->head->subsys->iopolicy);
+	if (policy != NVME_IOPOLICY_QD && policy != NVME_IOPOLICY_LAT)
+		return;
+
+	atomic_inc(&ns->ctrl->nr_active);
+	nvme_req(rq)->flags |= NVME_MPATH_CNT_ACTIVE;
+	nvme_req(rq)->start_time = ktime_get_ns();
+}
+
+/*
+ * Drop the request from the outstanding count of its controller.  Only
+ * requests that completed successfully feed the latency average, a request
+ * torn down before reaching the device would drag it towards zero.
+ */
+void nvme_mpath_end_request(struct request *rq, bool completed)
+{
+	struct nvme_ctrl *ctrl = nvme_req(rq)->ctrl;
+	u64 lat, ewma;
+
+	if (!(nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE))
+		return;
+	nvme_req(rq)->flags &= ~NVME_MPATH_CNT_ACTIVE;
+	atomic_dec(&ctrl->nr_active);
+
+	if (!completed || nvme_req(rq)->status)
+		return;
+
+	lat = ktime_get_ns() - nvme_req(rq)->start_time;
+	ewma = READ_ONCE(ctrl->mpath_lat_ewma);
+	if (ewma)
+		ewma = ewma - (ewma >> NVME_MPATH_LAT_SHIFT) +
+			(lat >> NVME_MPATH_LAT_SHIFT);
+	else
+		ewma = lat;
+	WRITE_ONCE(ctrl->mpath_lat_ewma, ewma);
+}
+
+/*
+ * Estimated cost of queueing one more I/O on the path.  For queue-depth this
+ * is the number of outstanding requests on the controller, for latency it is
+ * the time needed to drain them plus the new one at the average service time
+ * observed on the controller.  A controller without samples yet scores as
+ * cheap as possible so that it gets some I/O and learns its latency.
+ */
+static u64 nvme_path_score(struct nvme_ns *ns, int policy)
+{
+	u64 depth = atomic_read(&ns->ctrl->nr_active);
+
+	if (policy == NVME_IOPOLICY_QD)
+		return depth;
+	return (depth + 1) * READ_ONCE(ns->ctrl->mpath_lat_ewma);
+}
+
+static struct nvme_ns *nvme_queue_depth_path(struct nvme_ns_head *head,
+		int policy)
+{
+	struct nvme_ns *best_opt = NULL, *best_nonopt = NULL, *ns;
+	u64 min_opt = U64_MAX, min_nonopt = U64_MAX, score;
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (nvme_path_is_disabled(ns))
+			continue;
+
+		score = nvme_path_score(ns, policy);
+		switch (ns->ana_state) {
+		case NVME_ANA_OPTIMIZED:
+			if (score < min_opt) {
+				min_opt = score;
+				best_opt = ns;
+			}
+			break;
+		case NVME_ANA_NONOPTIMIZED:
+			if (score < min_nonopt) {
+				min_nonopt = score;
+				best_nonopt = ns;
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (min_opt == 0)
+			return best_opt;
+	}
+
+	return best_opt ? best_opt : best_nonopt;
+}
+
 static inline bool nvme_path_is_optimized(struct nvme_ns *ns)
 {
 	return ns->ctrl->state == NVME_CTRL_LIVE &&
@@ -281,14 +381,18 @@ static inline bool nvme_path_is_optimized(struct nvme_ns *ns)
 
 inline struct nvme_ns *nvme_find_path(struct nvme_ns_head *head)
 {
+	int policy = READ_ONCE(head->subsys->iopolicy);
 	int node = numa_node_id();
 	struct nvme_ns *ns;
 
+	if (policy == NVME_IOPOLICY_QD || policy == NVME_IOPOLICY_LAT)
+		return nvme_queue_depth_path(head, policy);
+
 	ns = srcu_dereference(head->current_path[node], &head->srcu);
 	if (unlikely(!ns))
 		return __nvme_find_path(head, node);
 
-	if (READ_ONCE(head->subsys->iopolicy) == NVME_IOPOLICY_RR)
+	if (policy == NVME_IOPOLICY_RR)
 		return nvme_round_robin_path(head, node, ns);
 	if (unlikely(!nvme_path_is_optimized(ns)))
 		return __nvme_find_path(head, node);
@@ -422,6 +526,7 @@ static const struct file_operations nvme_ns_head_chr_fops = {
 	.release	= nvme_ns_head_chr_release,
 	.unlocked_ioctl	= nvme_ns_head_chr_ioctl,
 	.compat_ioctl	= compat_ptr_ioctl,
+	.uring_cmd	= nvme_ns_head_chr_uring_cmd,
 };
 
 static int nvme_add_ns_head_cdev(struct nvme_ns_head *head)
@@ -711,6 +816,8 @@ void nvme_mpath_stop(struct nvme_ctrl *ctrl)
 static const char *nvme_iopolicy_names[] = {
 	[NVME_IOPOLICY_NUMA]	= "numa",
 	[NVME_IOPOLICY_RR]	= "round-robin",
+	[NVME_IOPOLICY_QD]	= "queue-depth",
+	[NVME_IOPOLICY_LAT]	= "latency",
 };
 
 static ssize_t nvme_subsys_iopolicy_show(struct device *dev,
@@ -758,6 +865,26 @@ static ssize_t ana_state_show(struct device *dev, struct device_attribute *attr,
 }
 DEVICE_ATTR_RO(ana_state);
 
+static ssize_t queue_depth_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns *ns = nvme_get_ns_from_dev(dev);
+
+	return sysfs_emit(buf, "%d\n", atomic_read(&ns->ctrl->nr_active));
+}
+DEVICE_ATTR_RO(queue_depth);
+
+static ssize_t avg_lat_us_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns *ns = nvme_get_ns_from_dev(dev);
+
+	return sysfs_emit(buf, "%llu\n",
+			  div_u64(READ_ONCE(ns->ctrl->mpath_lat_ewma),
+				  NSEC_PER_USEC));
+}
+DEVICE_ATTR_RO(avg_lat_us);
+
 static int nvme_lookup_ana_group_desc(struct nvme_ctrl *ctrl,
 		struct nvme_ana_group_desc *desc, void *data)
 {
@@ -831,6 +958,8 @@ void nvme_mpath_init_ctrl(struct nvme_ctrl *ctrl)
 	mutex_init(&ctrl->ana_lock);
 	timer_setup(&ctrl->anatt_timer, nvme_anatt_timeout, 0);
 	INIT_WORK(&ctrl->ana_work, nvme_ana_work);
+	atomic_set(&ctrl->nr_active, 0);
+	ctrl->mpath_lat_ewma = 0;
 }
 
 int nvme_mpath_init_identify(struct nvme_ctrl *ctrl, struct nvme_id_ctrl *id)
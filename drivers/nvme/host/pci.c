@@ -98,6 +98,41 @@ static unsigned int poll_queues;
 module_param_cb(poll_queues, &io_queue_count_ops, &poll_queues, 0644);
 MODULE_PARM_DESC(poll_queues, "Number of queues to use for polled IO.");
 
+static struct cpumask poll_cpus;
+
+static int poll_cpus_set(const char *val, const struct kernel_param *kp)
+{
+	cpumask_var_t mask;
+	int ret;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = cpulist_parse(val, mask);
+	if (!ret && !cpumask_subset(mask, cpu_possible_mask))
+		ret = -EINVAL;
+	if (!ret)
+		cpumask_copy(&poll_cpus, mask);
+
+	free_cpumask_var(mask);
+	return ret;
+}
+
+static int poll_cpus_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%*pbl\n", cpumask_pr_args(&poll_cpus));
+}
+
+static const struct kernel_param_ops poll_cpus_ops = {
+	.set = poll_cpus_set,
+	.get = poll_cpus_get,
+};
+
+module_param_cb(poll_cpus, &poll_cpus_ops, NULL, 0644);
+MODULE_PARM_DESC(poll_cpus,
+	"CPUs which get a dedicated poll queue each, e.g. the CPUs of "
+	"polling threads. Poll queues are added as needed.");
+
 static bool noacpi;
 module_param(noacpi, bool, 0444);
 MODULE_PARM_DESC(noacpi, "disable acpi bios quirks");
@@ -156,6 +191,7 @@ struct nvme_dev {
 	unsigned int nr_allocated_queues;
 	unsigned int nr_write_queues;
 	unsigned int nr_poll_queues;
+	cpumask_var_t poll_cpus;
 
 	bool attrs_added;
 };
@@ -227,6 +263,7 @@ struct nvme_iod {
 	struct nvme_queue *nvmeq;
 	bool use_sgl;
 	int aborted;
+	bool dma_tagged;	/* PRPs built from a cached ->dma_map tag */
 	int npages;		/* In the PRP list. 0 means small pool in use */
 	int nents;		/* Used in scatterlist */
 	dma_addr_t first_dma;
@@ -441,6 +478,36 @@ static int queue_irq_offset(struct nvme_dev *dev)
 	return 0;
 }
 
+/*
+ * Give each of the poll_cpus a poll queue of its own, so that a polling
+ * thread running there neither contends for its queue nor reaps the
+ * completions of others, and spread the remaining CPUs over the remaining
+ * poll queues.
+ */
+static void nvme_pci_map_poll_queues(struct nvme_dev *dev,
+		struct blk_mq_queue_map *map)
+{
+	unsigned int nr_dedicated, nr_shared, cpu, q = 0, i = 0;
+
+	nr_dedicated = min(cpumask_weight(dev->poll_cpus), map->nr_queues);
+	if (nr_dedicated == map->nr_queues &&
+	    nr_dedicated < num_possible_cpus())
+		nr_dedicated--;
+	if (!nr_dedicated) {
+		blk_mq_map_queues(map);
+		return;
+	}
+	nr_shared = map->nr_queues - nr_dedicated;
+
+	for_each_possible_cpu(cpu) {
+		if (cpumask_test_cpu(cpu, dev->poll_cpus) && q < nr_dedicated)
+			map->mq_map[cpu] = map->queue_offset + q++;
+		else
+			map->mq_map[cpu] = map->queue_offset + nr_dedicated +
+					   i++ % nr_shared;
+	}
+}
+
 static int nvme_pci_map_queues(struct blk_mq_tag_set *set)
 {
 	struct nvme_dev *dev = set->driver_data;
@@ -463,6 +530,8 @@ static int nvme_pci_map_queues(struct blk_mq_tag_set *set)
 		map->queue_offset = qoff;
 		if (i != HCTX_TYPE_POLL && offset)
 			blk_mq_pci_map_queues(map, to_pci_dev(dev->dev), offset);
+		else if (i == HCTX_TYPE_POLL)
+			nvme_pci_map_poll_queues(dev, map);
 		else
 			blk_mq_map_queues(map);
 		qoff += map->nr_queues;
@@ -590,6 +659,16 @@ static void nvme_unmap_data(struct nvme_dev *dev, struct request *req)
 {
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 
+	if (iod->dma_tagged) {
+		if (iod->npages == 0)
+			dma_pool_free(dev->prp_small_pool,
+				      nvme_pci_iod_list(req)[0],
+				      iod->first_dma);
+		else
+			nvme_free_prps(dev, req);
+		return;
+	}
+
 	if (iod->dma_len) {
 		dma_unmap_page(dev->dev, iod->first_dma, iod->dma_len,
 			       rq_dma_dir(req));
@@ -837,12 +916,197 @@ static blk_status_t nvme_setup_sgl_simple(struct nvme_dev *dev,
 	return BLK_STS_OK;
 }
 
+/*
+ * Pages of a bvec array mapped once by ->dma_map.  All the bvecs but the
+ * first start at a page boundary, so a byte at @pos counted from the start
+ * of the first page is at offset_in_page(@pos) of page (@pos >> PAGE_SHIFT).
+ */
+struct nvme_dma_tag {
+	struct nvme_dev		*dev;
+	struct bio_vec		*bvec;
+	int			nr_vecs;
+	dma_addr_t		addrs[];
+};
+
+static void *nvme_pci_dma_map(struct nvme_ctrl *ctrl, struct bio_vec *bvec,
+		int nr_vecs)
+{
+	struct nvme_dev *dev = to_nvme_dev(ctrl);
+	struct nvme_dma_tag *tag;
+	int i, ret = -ENOMEM;
+
+	tag = kvmalloc(struct_size(tag, addrs, nr_vecs), GFP_KERNEL);
+	if (!tag)
+		return ERR_PTR(-ENOMEM);
+	tag->dev = dev;
+	tag->bvec = bvec;
+	tag->nr_vecs = nr_vecs;
+
+	for (i = 0; i < nr_vecs; i++) {
+		if ((i && bvec[i].bv_offset) ||
+		    bvec[i].bv_offset + bvec[i].bv_len > PAGE_SIZE) {
+			ret = -EINVAL;
+			goto unmap;
+		}
+
+		tag->addrs[i] = dma_map_page(dev->dev, bvec[i].bv_page, 0,
+					     PAGE_SIZE, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(dev->dev, tag->addrs[i]))
+			goto unmap;
+
+		/* the cached mappings are used without syncing them */
+		if (dma_need_sync(dev->dev, tag->addrs[i])) {
+			dma_unmap_page(dev->dev, tag->addrs[i], PAGE_SIZE,
+				       DMA_BIDIRECTIONAL);
+			ret = -EOPNOTSUPP;
+			goto unmap;
+		}
+	}
+	return tag;
+
+unmap:
+	while (--i >= 0)
+		dma_unmap_page(dev->dev, tag->addrs[i], PAGE_SIZE,
+			       DMA_BIDIRECTIONAL);
+	kvfree(tag);
+	return ERR_PTR(ret);
+}
+
+static void nvme_pci_dma_unmap(struct nvme_ctrl *ctrl, void *dma_tag)
+{
+	struct nvme_dev *dev = to_nvme_dev(ctrl);
+	struct nvme_dma_tag *tag = dma_tag;
+	int i;
+
+	for (i = 0; i < tag->nr_vecs; i++)
+		dma_unmap_page(dev->dev, tag->addrs[i], PAGE_SIZE,
+			       DMA_BIDIRECTIONAL);
+	kvfree(tag);
+}
+
+static inline dma_addr_t nvme_dma_tag_addr(struct nvme_dma_tag *tag, u64 pos)
+{
+	return tag->addrs[pos >> PAGE_SHIFT] + offset_in_page(pos);
+}
+
+/*
+ * Returns the position of the data of @req in its cached DMA mapping or -1
+ * if @req can't use one.
+ */
+static s64 nvme_dma_tag_pos(struct nvme_dev *dev, struct request *req)
+{
+	struct bio *bio = req->bio;
+	struct nvme_dma_tag *tag;
+	struct bio_vec *bv;
+	u64 pos;
+
+	if (!bio || bio != req->biotail || !bio->bi_dma_tag)
+		return -1;
+
+	tag = bio->bi_dma_tag;
+	if (tag->dev != dev)
+		return -1;
+
+	bv = bio->bi_io_vec + bio->bi_iter.bi_idx;
+	if (bv < tag->bvec || bv >= tag->bvec + tag->nr_vecs)
+		return -1;
+
+	pos = ((u64)(bv - tag->bvec) << PAGE_SHIFT) + bv->bv_offset +
+		bio->bi_iter.bi_bvec_done;
+	if (pos + blk_rq_payload_bytes(req) > (u64)tag->nr_vecs << PAGE_SHIFT)
+		return -1;
+	return pos;
+}
+
+/*
+ * Build the PRPs of @req straight from the cached DMA mapping of its bvecs,
+ * which saves mapping and unmapping it, and the IOVA allocation that comes
+ * with it, on every IO.
+ */
+static blk_status_t nvme_pci_setup_dma_tag_prps(struct nvme_dev *dev,
+		struct request *req, struct nvme_rw_command *cmnd, u64 pos)
+{
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+	struct nvme_dma_tag *tag = req->bio->bi_dma_tag;
+	int length = blk_rq_payload_bytes(req);
+	dma_addr_t prp1 = nvme_dma_tag_addr(tag, pos);
+	int offset = pos & (NVME_CTRL_PAGE_SIZE - 1);
+	void **list = nvme_pci_iod_list(req);
+	struct dma_pool *pool;
+	__le64 *prp_list;
+	dma_addr_t prp_dma;
+	int nprps, i;
+
+	iod->dma_tagged = true;
+	iod->use_sgl = false;
+
+	length -= (NVME_CTRL_PAGE_SIZE - offset);
+	pos += (NVME_CTRL_PAGE_SIZE - offset);
+	if (length <= 0) {
+		iod->first_dma = 0;
+		goto done;
+	}
+	if (length <= NVME_CTRL_PAGE_SIZE) {
+		iod->first_dma = nvme_dma_tag_addr(tag, pos);
+		goto done;
+	}
+
+	nprps = DIV_ROUND_UP(length, NVME_CTRL_PAGE_SIZE);
+	if (nprps <= (256 / 8)) {
+		pool = dev->prp_small_pool;
+		iod->npages = 0;
+	} else {
+		pool = dev->prp_page_pool;
+		iod->npages = 1;
+	}
+
+	prp_list = dma_pool_alloc(pool, GFP_ATOMIC, &prp_dma);
+	if (!prp_list) {
+		iod->npages = -1;
+		goto err;
+	}
+	list[0] = prp_list;
+	iod->first_dma = prp_dma;
+	i = 0;
+	for (;;) {
+		if (i == NVME_CTRL_PAGE_SIZE >> 3) {
+			__le64 *old_prp_list = prp_list;
+			prp_list = dma_pool_alloc(pool, GFP_ATOMIC, &prp_dma);
+			if (!prp_list)
+				goto free_prps;
+			list[iod->npages++] = prp_list;
+			prp_list[0] = old_prp_list[i - 1];
+			old_prp_list[i - 1] = cpu_to_le64(prp_dma);
+			i = 1;
+		}
+		prp_list[i++] = cpu_to_le64(nvme_dma_tag_addr(tag, pos));
+		pos += NVME_CTRL_PAGE_SIZE;
+		length -= NVME_CTRL_PAGE_SIZE;
+		if (length <= 0)
+			break;
+	}
+done:
+	cmnd->dptr.prp1 = cpu_to_le64(prp1);
+	cmnd->dptr.prp2 = cpu_to_le64(iod->first_dma);
+	return BLK_STS_OK;
+free_prps:
+	nvme_free_prps(dev, req);
+err:
+	iod->dma_tagged = false;
+	return BLK_STS_RESOURCE;
+}
+
 static blk_status_t nvme_map_data(struct nvme_dev *dev, struct request *req,
 		struct nvme_command *cmnd)
 {
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	blk_status_t ret = BLK_STS_RESOURCE;
 	int nr_mapped;
+	s64 pos;
+
+	pos = nvme_dma_tag_pos(dev, req);
+	if (pos >= 0)
+		return nvme_pci_setup_dma_tag_prps(dev, req, &cmnd->rw, pos);
 
 	if (blk_rq_nr_phys_segments(req) == 1) {
 		struct bio_vec bv = req_bvec(req);
@@ -921,6 +1185,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	blk_status_t ret;
 
 	iod->aborted = 0;
+	iod->dma_tagged = false;
 	iod->npages = -1;
 	iod->nents = 0;
 
@@ -960,7 +1225,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return ret;
 }
 
-static void nvme_pci_complete_rq(struct request *req)
+static void nvme_pci_unmap_rq(struct request *req)
 {
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	struct nvme_dev *dev = iod->nvmeq->dev;
@@ -970,9 +1235,19 @@ static void nvme_pci_complete_rq(struct request *req)
 			       rq_integrity_vec(req)->bv_len, rq_data_dir(req));
 	if (blk_rq_nr_phys_segments(req))
 		nvme_unmap_data(dev, req);
+}
+
+static void nvme_pci_complete_rq(struct request *req)
+{
+	nvme_pci_unmap_rq(req);
 	nvme_complete_rq(req);
 }
 
+static void nvme_pci_complete_batch(struct io_comp_batch *iob)
+{
+	nvme_complete_batch(iob, nvme_pci_unmap_rq);
+}
+
 /* We read the CQE phase first to check if the rest of the entry is valid */
 static inline bool nvme_cqe_pending(struct nvme_queue *nvmeq)
 {
@@ -997,7 +1272,8 @@ static inline struct blk_mq_tags *nvme_queue_tagset(struct nvme_queue *nvmeq)
 	return nvmeq->dev->tagset.tags[nvmeq->qid - 1];
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq,
+				   struct io_comp_batch *iob, u16 idx)
 {
 	struct nvme_completion *cqe = &nvmeq->cqes[idx];
 	__u16 command_id = READ_ONCE(cqe->command_id);
@@ -1024,7 +1300,9 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 	}
 
 	trace_nvme_sq(req, cqe->sq_head, nvmeq->sq_tail);
-	if (!nvme_try_complete_req(req, cqe->status, cqe->result))
+	if (!nvme_try_complete_req(req, cqe->status, cqe->result) &&
+	    !blk_mq_add_to_batch(req, iob, nvme_req(req)->status,
+					nvme_pci_complete_batch))
 		nvme_pci_complete_rq(req);
 }
 
@@ -1040,7 +1318,8 @@ static inline void nvme_update_cq_head(struct nvme_queue *nvmeq)
 	}
 }
 
-static inline int nvme_process_cq(struct nvme_queue *nvmeq)
+static inline int nvme_process_cq(struct nvme_queue *nvmeq,
+				  struct io_comp_batch *iob)
 {
 	int found = 0;
 
@@ -1051,7 +1330,7 @@ static inline int nvme_process_cq(struct nvme_queue *nvmeq)
 		 * the cqe requires a full read memory barrier
 		 */
 		dma_rmb();
-		nvme_handle_cqe(nvmeq, nvmeq->cq_head);
+		nvme_handle_cqe(nvmeq, iob, nvmeq->cq_head);
 		nvme_update_cq_head(nvmeq);
 	}
 
@@ -1063,9 +1342,13 @@ static inline int nvme_process_cq(struct nvme_queue *nvmeq)
 static irqreturn_t nvme_irq(int irq, void *data)
 {
 	struct nvme_queue *nvmeq = data;
+	DEFINE_IO_COMP_BATCH(iob);
 
-	if (nvme_process_cq(nvmeq))
+	if (nvme_process_cq(nvmeq, &iob)) {
+		if (iob.req_list)
+			nvme_pci_complete_batch(&iob);
 		return IRQ_HANDLED;
+	}
 	return IRQ_NONE;
 }
 
@@ -1089,22 +1372,26 @@ static void nvme_poll_irqdisable(struct nvme_queue *nvmeq)
 	WARN_ON_ONCE(test_bit(NVMEQ_POLLED, &nvmeq->flags));
 
 	disable_irq(pci_irq_vector(pdev, nvmeq->cq_vector));
-	nvme_process_cq(nvmeq);
+	nvme_process_cq(nvmeq, NULL);
 	enable_irq(pci_irq_vector(pdev, nvmeq->cq_vector));
 }
 
 static int nvme_poll(struct blk_mq_hw_ctx *hctx)
 {
 	struct nvme_queue *nvmeq = hctx->driver_data;
+	DEFINE_IO_COMP_BATCH(iob);
 	bool found;
 
 	if (!nvme_cqe_pending(nvmeq))
 		return 0;
 
 	spin_lock(&nvmeq->cq_poll_lock);
-	found = nvme_process_cq(nvmeq);
+	found = nvme_process_cq(nvmeq, &iob);
 	spin_unlock(&nvmeq->cq_poll_lock);
 
+	if (iob.req_list)
+		nvme_pci_complete_batch(&iob);
+
 	return found;
 }
 
@@ -1435,7 +1722,7 @@ static void nvme_reap_pending_cqes(struct nvme_dev *dev)
 
 	for (i = dev->ctrl.queue_count - 1; i > 0; i--) {
 		spin_lock(&dev->queues[i].cq_poll_lock);
-		nvme_process_cq(&dev->queues[i]);
+		nvme_process_cq(&dev->queues[i], NULL);
 		spin_unlock(&dev->queues[i].cq_poll_lock);
 	}
 }
@@ -2235,6 +2522,25 @@ static void nvme_disable_io_queues(struct nvme_dev *dev)
 		__nvme_disable_io_queues(dev, nvme_admin_delete_cq);
 }
 
+/*
+ * Sample the poll queue module parameters, making room for a dedicated poll
+ * queue per poll CPU plus one for the other CPUs.
+ */
+static void nvme_sample_poll_queues(struct nvme_dev *dev)
+{
+	unsigned int nr_dedicated;
+
+	cpumask_and(dev->poll_cpus, &poll_cpus, cpu_possible_mask);
+	nr_dedicated = cpumask_weight(dev->poll_cpus);
+
+	dev->nr_poll_queues = poll_queues;
+	if (nr_dedicated) {
+		if (nr_dedicated < num_possible_cpus())
+			nr_dedicated++;
+		dev->nr_poll_queues = max(dev->nr_poll_queues, nr_dedicated);
+	}
+}
+
 static unsigned int nvme_max_io_queues(struct nvme_dev *dev)
 {
 	/*
@@ -2259,7 +2565,7 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	 * stable values to work with.
 	 */
 	dev->nr_write_queues = write_queues;
-	dev->nr_poll_queues = poll_queues;
+	nvme_sample_poll_queues(dev);
 
 	nr_io_queues = dev->nr_allocated_queues - 1;
 	result = nvme_set_queue_count(&dev->ctrl, &nr_io_queues);
@@ -2681,6 +2987,7 @@ static void nvme_pci_free_ctrl(struct nvme_ctrl *ctrl)
 	free_opal_dev(dev->ctrl.opal_dev);
 	mempool_destroy(dev->iod_mempool);
 	put_device(dev->dev);
+	free_cpumask_var(dev->poll_cpus);
 	kfree(dev->queues);
 	kfree(dev);
 }
@@ -2889,6 +3196,8 @@ static const struct nvme_ctrl_ops nvme_pci_ctrl_ops = {
 	.free_ctrl		= nvme_pci_free_ctrl,
 	.submit_async_event	= nvme_pci_submit_async_event,
 	.get_address		= nvme_pci_get_address,
+	.dma_map		= nvme_pci_dma_map,
+	.dma_unmap		= nvme_pci_dma_unmap,
 };
 
 static int nvme_dev_map(struct nvme_dev *dev)
@@ -2974,8 +3283,11 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	if (!dev)
 		return -ENOMEM;
 
+	if (!zalloc_cpumask_var(&dev->poll_cpus, GFP_KERNEL))
+		goto free;
+
 	dev->nr_write_queues = write_queues;
-	dev->nr_poll_queues = poll_queues;
+	nvme_sample_poll_queues(dev);
 	dev->nr_allocated_queues = nvme_max_io_queues(dev) + 1;
 	dev->queues = kcalloc_node(dev->nr_allocated_queues,
 			sizeof(struct nvme_queue), GFP_KERNEL, node);
@@ -3046,6 +3358,7 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
  put_pci:
 	put_device(dev->dev);
  free:
+	free_cpumask_var(dev->poll_cpus);
 	kfree(dev->queues);
 	kfree(dev);
 	return result;
@@ -30,6 +30,18 @@ static int so_priority;
 module_param(so_priority, int, 0644);
 MODULE_PARM_DESC(so_priority, "nvme tcp socket optimize priority");
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/*
+ * Busy poll the NIC queue of the connection for this long before io_work
+ * gives up waiting for a response and relies on the interrupt again.  Zero
+ * keeps the system wide net.core.busy_read setting.
+ */
+static unsigned int busy_poll_usec;
+module_param(busy_poll_usec, uint, 0644);
+MODULE_PARM_DESC(busy_poll_usec,
+	"nvme tcp receive busy poll time in usecs (default: net.core.busy_read)");
+#endif
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 /* lockdep can detect a circular dependency of the form
  *   sk_lock -> mmap_lock (page fault) -> fs locks -> sk_lock
@@ -1181,6 +1193,24 @@ static int nvme_tcp_try_recv(struct nvme_tcp_queue *queue)
 	return consumed;
 }
 
+/*
+ * Spin on the NAPI context the socket last received on instead of waiting
+ * for the interrupt and the data_ready callback to requeue io_work.  The
+ * spin is bounded by the socket busy poll time and only happens when busy
+ * polling has been enabled for the socket.
+ */
+static bool nvme_tcp_busy_poll(struct nvme_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+
+	if (!sk_can_busy_loop(sk) ||
+	    !skb_queue_empty_lockless(&sk->sk_receive_queue))
+		return false;
+
+	sk_busy_loop(sk, false);
+	return !skb_queue_empty_lockless(&sk->sk_receive_queue);
+}
+
 static void nvme_tcp_io_work(struct work_struct *w)
 {
 	struct nvme_tcp_queue *queue =
@@ -1206,6 +1236,9 @@ static void nvme_tcp_io_work(struct work_struct *w)
 		else if (unlikely(result < 0))
 			return;
 
+		if (!pending && nvme_tcp_busy_poll(queue))
+			pending = true;
+
 		if (!pending || !queue->rd_enabled)
 			return;
 
@@ -1441,6 +1474,39 @@ static void nvme_tcp_set_queue_io_cpu(struct nvme_tcp_queue *queue)
 	queue->io_cpu = cpumask_next_wrap(n - 1, cpu_online_mask, -1, false);
 }
 
+/*
+ * Once blk-mq has mapped the I/O queues, run io_work of each queue on a CPU
+ * that submits to it.  nvme_tcp_queue_request() then sends inline instead of
+ * bouncing every request through the workqueue, and the completion side runs
+ * where the submitter's cache is warm.
+ */
+static void nvme_tcp_map_io_cpus(struct nvme_tcp_ctrl *ctrl)
+{
+	struct blk_mq_tag_set *set = &ctrl->tag_set;
+	int qid, cpu;
+
+	for (qid = 1; qid < ctrl->ctrl.queue_count; qid++) {
+		struct nvme_tcp_queue *queue = &ctrl->queues[qid];
+		struct blk_mq_queue_map *map;
+
+		if (nvme_tcp_default_queue(queue))
+			map = &set->map[HCTX_TYPE_DEFAULT];
+		else if (nvme_tcp_read_queue(queue))
+			map = &set->map[HCTX_TYPE_READ];
+		else if (nvme_tcp_poll_queue(queue))
+			map = &set->map[HCTX_TYPE_POLL];
+		else
+			continue;
+
+		for_each_online_cpu(cpu) {
+			if (map->mq_map[cpu] == qid - 1) {
+				WRITE_ONCE(queue->io_cpu, cpu);
+				break;
+			}
+		}
+	}
+}
+
 static int nvme_tcp_alloc_queue(struct nvme_ctrl *nctrl,
 		int qid, size_t queue_size)
 {
@@ -1496,6 +1562,10 @@ static int nvme_tcp_alloc_queue(struct nvme_ctrl *nctrl,
 	queue->sock->sk->sk_rcvtimeo = 10 * HZ;
 
 	queue->sock->sk->sk_allocation = GFP_ATOMIC;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	if (busy_poll_usec)
+		WRITE_ONCE(queue->sock->sk->sk_ll_usec, busy_poll_usec);
+#endif
 	nvme_tcp_set_queue_io_cpu(queue);
 	queue->request = NULL;
 	queue->data_remaining = 0;
@@ -2471,6 +2541,8 @@ static int nvme_tcp_map_queues(struct blk_mq_tag_set *set)
 		blk_mq_map_queues(&set->map[HCTX_TYPE_POLL]);
 	}
 
+	nvme_tcp_map_io_cpus(ctrl);
+
 	dev_info(ctrl->ctrl.device,
 		"mapped %d/%d/%d default/read/poll queues.\n",
 		ctrl->io_queues[HCTX_TYPE_DEFAULT],
@@ -1089,6 +1089,18 @@ void nvmet_req_free_sgls(struct nvmet_req *req)
 }
 EXPORT_SYMBOL_GPL(nvmet_req_free_sgls);
 
+/*
+ * Called by the transports when they free the command a request is embedded
+ * in, the cached bvec array otherwise lives as long as the request.
+ */
+void nvmet_req_free_bvec_cache(struct nvmet_req *req)
+{
+	kfree(req->bvec_cache);
+	req->bvec_cache = NULL;
+	req->nr_bvec_cache = 0;
+}
+EXPORT_SYMBOL_GPL(nvmet_req_free_bvec_cache);
+
 static inline bool nvmet_cc_en(u32 cc)
 {
 	return (cc >> NVME_CC_EN_SHIFT) & 0x1;
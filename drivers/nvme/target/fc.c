@@ -666,6 +666,7 @@ nvmet_fc_destroy_fcp_iodlist(struct nvmet_fc_tgtport *tgtport,
 	int i;
 
 	for (i = 0; i < queue->sqsize; fod++, i++) {
+		nvmet_req_free_bvec_cache(&fod->req);
 		if (fod->rspdma)
 			fc_dma_unmap_single(tgtport->dev, fod->rspdma,
 				sizeof(fod->rspiubuf), DMA_TO_DEVICE);
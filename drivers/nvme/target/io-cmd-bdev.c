@@ -229,6 +229,30 @@ static int nvmet_bdev_alloc_bip(struct nvmet_req *req, struct bio *bio,
 }
 #endif /* CONFIG_BLK_DEV_INTEGRITY */
 
+/*
+ * Commands too large for the inline bvecs used to allocate a bio and a bvec
+ * array from the mempools for every command.  The transports keep their
+ * requests around for the lifetime of the queue, so size a bvec array once
+ * for the largest command seen and build the bio in the request itself.
+ */
+static bool nvmet_bdev_reserve_bvec(struct nvmet_req *req,
+		unsigned short nr_vecs)
+{
+	struct bio_vec *bvec;
+
+	if (req->nr_bvec_cache >= nr_vecs)
+		return true;
+
+	bvec = kmalloc_array(nr_vecs, sizeof(*bvec), GFP_KERNEL);
+	if (!bvec)
+		return false;
+
+	kfree(req->bvec_cache);
+	req->bvec_cache = bvec;
+	req->nr_bvec_cache = nr_vecs;
+	return true;
+}
+
 static void nvmet_bdev_execute_rw(struct nvmet_req *req)
 {
 	unsigned int sg_cnt = req->sg_cnt;
@@ -267,6 +291,9 @@ static void nvmet_bdev_execute_rw(struct nvmet_req *req)
 	if (nvmet_use_inline_bvec(req)) {
 		bio = &req->b.inline_bio;
 		bio_init(bio, req->inline_bvec, ARRAY_SIZE(req->inline_bvec));
+	} else if (nvmet_bdev_reserve_bvec(req, bio_max_segs(sg_cnt))) {
+		bio = &req->b.inline_bio;
+		bio_init(bio, req->bvec_cache, req->nr_bvec_cache);
 	} else {
 		bio = bio_alloc(GFP_KERNEL, bio_max_segs(sg_cnt));
 	}
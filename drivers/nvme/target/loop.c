@@ -213,6 +213,14 @@ static int nvme_loop_init_request(struct blk_mq_tag_set *set,
 			(set == &ctrl->tag_set) ? hctx_idx + 1 : 0);
 }
 
+static void nvme_loop_exit_request(struct blk_mq_tag_set *set,
+		struct request *req, unsigned int hctx_idx)
+{
+	struct nvme_loop_iod *iod = blk_mq_rq_to_pdu(req);
+
+	nvmet_req_free_bvec_cache(&iod->req);
+}
+
 static struct lock_class_key loop_hctx_fq_lock_key;
 
 static int nvme_loop_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
@@ -251,6 +259,7 @@ static const struct blk_mq_ops nvme_loop_mq_ops = {
 	.queue_rq	= nvme_loop_queue_rq,
 	.complete	= nvme_loop_complete_rq,
 	.init_request	= nvme_loop_init_request,
+	.exit_request	= nvme_loop_exit_request,
 	.init_hctx	= nvme_loop_init_hctx,
 };
 
@@ -258,6 +267,7 @@ static const struct blk_mq_ops nvme_loop_admin_mq_ops = {
 	.queue_rq	= nvme_loop_queue_rq,
 	.complete	= nvme_loop_complete_rq,
 	.init_request	= nvme_loop_init_request,
+	.exit_request	= nvme_loop_exit_request,
 	.init_hctx	= nvme_loop_init_admin_hctx,
 };
 
@@ -323,6 +323,9 @@ struct nvmet_req {
 	struct scatterlist	*sg;
 	struct scatterlist	*metadata_sg;
 	struct bio_vec		inline_bvec[NVMET_MAX_INLINE_BIOVEC];
+	/* larger bvec array kept across commands by the bdev backend */
+	struct bio_vec		*bvec_cache;
+	unsigned short		nr_bvec_cache;
 	union {
 		struct {
 			struct bio      inline_bio;
@@ -428,6 +431,7 @@ bool nvmet_check_data_len_lte(struct nvmet_req *req, size_t data_len);
 void nvmet_req_complete(struct nvmet_req *req, u16 status);
 int nvmet_req_alloc_sgls(struct nvmet_req *req);
 void nvmet_req_free_sgls(struct nvmet_req *req);
+void nvmet_req_free_bvec_cache(struct nvmet_req *req);
 
 void nvmet_execute_set_features(struct nvmet_req *req);
 void nvmet_execute_get_features(struct nvmet_req *req);
@@ -442,6 +442,7 @@ static int nvmet_rdma_alloc_rsp(struct nvmet_rdma_device *ndev,
 static void nvmet_rdma_free_rsp(struct nvmet_rdma_device *ndev,
 		struct nvmet_rdma_rsp *r)
 {
+	nvmet_req_free_bvec_cache(&r->req);
 	ib_dma_unmap_single(ndev->device, r->send_sge.addr,
 				sizeof(*r->req.cqe), DMA_TO_DEVICE);
 	kfree(r->req.cqe);
@@ -14,6 +14,7 @@
 #include <linux/inet.h>
 #include <linux/llist.h>
 #include <crypto/hash.h>
+#include <net/busy_poll.h>
 
 #include "nvmet.h"
 
@@ -39,6 +40,16 @@ module_param(idle_poll_period_usecs, int, 0644);
 MODULE_PARM_DESC(idle_poll_period_usecs,
 		"nvmet tcp io_work poll till idle time period in usecs");
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* Let io_work poll the NIC RX queue of the connection for new PDUs instead
+ * of waiting for the interrupt.  Zero keeps the net.core.busy_read setting.
+ */
+static unsigned int busy_poll_usecs;
+module_param(busy_poll_usecs, uint, 0644);
+MODULE_PARM_DESC(busy_poll_usecs,
+		"nvmet tcp io_work receive busy poll time in usecs");
+#endif
+
 #define NVMET_TCP_RECV_BUDGET		8
 #define NVMET_TCP_SEND_BUDGET		8
 #define NVMET_TCP_IO_WORK_BUDGET	64
@@ -1280,13 +1291,30 @@ static bool nvmet_tcp_check_queue_deadline(struct nvmet_tcp_queue *queue,
 	return !time_after(jiffies, queue->poll_end);
 }
 
+static void nvmet_tcp_busy_poll(struct nvmet_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+
+	if (sk_can_busy_loop(sk) &&
+	    skb_queue_empty_lockless(&sk->sk_receive_queue))
+		sk_busy_loop(sk, true);
+}
+
 static void nvmet_tcp_io_work(struct work_struct *w)
 {
 	struct nvmet_tcp_queue *queue =
 		container_of(w, struct nvmet_tcp_queue, io_work);
+	struct blk_plug plug;
 	bool pending;
 	int ret, ops = 0;
 
+	nvmet_tcp_busy_poll(queue);
+
+	/*
+	 * Commands parsed in one pass are executed back to back, plug them so
+	 * that the backend submits them to the device as a batch.
+	 */
+	blk_start_plug(&plug);
 	do {
 		pending = false;
 
@@ -1294,15 +1322,16 @@ static void nvmet_tcp_io_work(struct work_struct *w)
 		if (ret > 0)
 			pending = true;
 		else if (ret < 0)
-			return;
+			goto out_unplug;
 
 		ret = nvmet_tcp_try_send(queue, NVMET_TCP_SEND_BUDGET, &ops);
 		if (ret > 0)
 			pending = true;
 		else if (ret < 0)
-			return;
+			goto out_unplug;
 
 	} while (pending && ops < NVMET_TCP_IO_WORK_BUDGET);
+	blk_finish_plug(&plug);
 
 	/*
 	 * Requeue the worker if idle deadline period is in progress or any
@@ -1310,6 +1339,10 @@ static void nvmet_tcp_io_work(struct work_struct *w)
 	 */
 	if (nvmet_tcp_check_queue_deadline(queue, ops) || pending)
 		queue_work_on(queue_cpu(queue), nvmet_tcp_wq, &queue->io_work);
+	return;
+
+out_unplug:
+	blk_finish_plug(&plug);
 }
 
 static int nvmet_tcp_alloc_cmd(struct nvmet_tcp_queue *queue,
@@ -1358,6 +1391,7 @@ static int nvmet_tcp_alloc_cmd(struct nvmet_tcp_queue *queue,
 
 static void nvmet_tcp_free_cmd(struct nvmet_tcp_cmd *c)
 {
+	nvmet_req_free_bvec_cache(&c->req);
 	page_frag_free(c->r2t_pdu);
 	page_frag_free(c->data_pdu);
 	page_frag_free(c->rsp_pdu);
@@ -1551,6 +1585,11 @@ static int nvmet_tcp_set_queue_sock(struct nvmet_tcp_queue *queue)
 	if (so_priority > 0)
 		sock_set_priority(sock->sk, so_priority);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	if (busy_poll_usecs)
+		WRITE_ONCE(sock->sk->sk_ll_usec, busy_poll_usecs);
+#endif
+
 	/* Set socket type of service */
 	if (inet->rcv_tos > 0)
 		ip_sock_set_tos(sock->sk, inet->rcv_tos);
@@ -387,6 +387,22 @@ static int vfio_add_to_pfn_list(struct vfio_dma *dma, dma_addr_t iova,
 	return 0;
 }
 
+/* Number of externally pinned pages in [iova, iova + npage pages) */
+static long vfio_vpfn_count(struct vfio_dma *dma, dma_addr_t iova, long npage)
+{
+	long i, count = 0;
+
+	if (RB_EMPTY_ROOT(&dma->pfn_list))
+		return 0;
+
+	for (i = 0; i < npage; i++, iova += PAGE_SIZE) {
+		if (vfio_find_vpfn(dma, iova))
+			count++;
+	}
+
+	return count;
+}
+
 static void vfio_remove_from_pfn_list(struct vfio_dma *dma,
 				      struct vfio_pfn *vpfn)
 {
@@ -500,6 +516,29 @@ static void vfio_batch_unpin(struct vfio_batch *batch, struct vfio_dma *dma)
 	}
 }
 
+/*
+ * Count how many pages at the head of the batch continue the pfn run that
+ * starts at @pfn, up to @max.  Reserved state is uniform within a compound
+ * page, so it's only rechecked when the run crosses into a new one and the
+ * subpages of a THP or hugetlbfs page cost a single pfn comparison each.
+ */
+static long vfio_batch_contig(struct vfio_batch *batch, unsigned long pfn,
+			      long max)
+{
+	struct page **pages = batch->pages + batch->offset;
+	long i, nr = min_t(long, batch->size, max);
+
+	for (i = 1; i < nr; i++) {
+		if (page_to_pfn(pages[i]) != pfn + i)
+			break;
+		if (compound_head(pages[i]) != compound_head(pages[i - 1]) &&
+		    is_invalid_reserved_pfn(pfn + i))
+			break;
+	}
+
+	return i;
+}
+
 static void vfio_batch_fini(struct vfio_batch *batch)
 {
 	if (batch->capacity == VFIO_BATCH_MAX_CAPACITY)
@@ -710,6 +749,8 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 		 * !VM_PFNMAP vma.
 		 */
 		while (true) {
+			long nr_pages = 1, acct_pages;
+
 			if (pfn != *pfn_base + pinned ||
 			    rsvd != is_invalid_reserved_pfn(pfn))
 				goto out;
@@ -717,25 +758,29 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 			/*
 			 * Reserved pages aren't counted against the user,
 			 * externally pinned pages are already counted against
-			 * the user.
+			 * the user.  Pinned pages come with a valid batch, so
+			 * take the whole contiguous run at once.
 			 */
-			if (!rsvd && !vfio_find_vpfn(dma, iova)) {
+			if (!rsvd) {
+				nr_pages = vfio_batch_contig(batch, pfn, npage);
+				acct_pages = nr_pages -
+					     vfio_vpfn_count(dma, iova, nr_pages);
 				if (!dma->lock_cap &&
-				    mm->locked_vm + lock_acct + 1 > limit) {
+				    mm->locked_vm + lock_acct + acct_pages > limit) {
 					pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
 						__func__, limit << PAGE_SHIFT);
 					ret = -ENOMEM;
 					goto unpin_out;
 				}
-				lock_acct++;
+				lock_acct += acct_pages;
 			}
 
-			pinned++;
-			npage--;
-			vaddr += PAGE_SIZE;
-			iova += PAGE_SIZE;
-			batch->offset++;
-			batch->size--;
+			pinned += nr_pages;
+			npage -= nr_pages;
+			vaddr += nr_pages << PAGE_SHIFT;
+			iova += nr_pages << PAGE_SHIFT;
+			batch->offset += nr_pages;
+			batch->size -= nr_pages;
 
 			if (!batch->size)
 				break;
@@ -775,14 +820,23 @@ static long vfio_unpin_pages_remote(struct vfio_dma *dma, dma_addr_t iova,
 				    bool do_accounting)
 {
 	long unlocked = 0, locked = 0;
-	long i;
+	long i, nr;
 
-	for (i = 0; i < npage; i++, iova += PAGE_SIZE) {
-		if (put_pfn(pfn++, dma->prot)) {
-			unlocked++;
-			if (vfio_find_vpfn(dma, iova))
-				locked++;
-		}
+	for (i = 0; i < npage; i += nr) {
+		struct page *page, *head;
+
+		nr = 1;
+		if (is_invalid_reserved_pfn(pfn + i))
+			continue;
+
+		/* Drop a whole compound page's worth of pins at once */
+		page = pfn_to_page(pfn + i);
+		head = compound_head(page);
+		nr = min_t(long, npage - i, compound_nr(head) - (page - head));
+
+		unpin_user_page_range_dirty_lock(page, nr, dma->prot & IOMMU_WRITE);
+		unlocked += nr;
+		locked += vfio_vpfn_count(dma, iova + (i << PAGE_SHIFT), nr);
 	}
 
 	if (do_accounting)
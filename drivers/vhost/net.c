@@ -19,6 +19,7 @@
 #include <linux/sched/clock.h>
 #include <linux/sched/signal.h>
 #include <linux/vmalloc.h>
+#include <linux/prefetch.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -166,9 +167,32 @@ static int vhost_net_buf_is_empty(struct vhost_net_buf *rxq)
 	return rxq->tail == rxq->head;
 }
 
+static void *vhost_net_buf_data(void *ptr)
+{
+	if (tun_is_xdp_frame(ptr))
+		return tun_ptr_to_xdp(ptr)->data;
+
+	return ((struct sk_buff *)ptr)->data;
+}
+
+/* The batch was pulled off the ring while the producer may still have the
+ * entries hot in another cache. Stay a packet ahead: pull in the metadata of
+ * the entry after next and the payload of the next one, whose metadata was
+ * fetched on the previous round, so the copy to the guest doesn't stall.
+ */
+static void vhost_net_buf_prefetch(struct vhost_net_buf *rxq)
+{
+	if (rxq->head + 2 < rxq->tail)
+		prefetch(rxq->queue[rxq->head + 2]);
+	if (rxq->head + 1 < rxq->tail)
+		prefetch(vhost_net_buf_data(rxq->queue[rxq->head + 1]));
+}
+
 static void *vhost_net_buf_consume(struct vhost_net_buf *rxq)
 {
 	void *ret = vhost_net_buf_get_ptr(rxq);
+
+	vhost_net_buf_prefetch(rxq);
 	++rxq->head;
 	return ret;
 }
@@ -180,6 +204,8 @@ static int vhost_net_buf_produce(struct vhost_net_virtqueue *nvq)
 	rxq->head = 0;
 	rxq->tail = ptr_ring_consume_batched(nvq->rx_ring, rxq->queue,
 					      VHOST_NET_BATCH);
+	if (rxq->tail > 1)
+		prefetch(rxq->queue[1]);
 	return rxq->tail;
 }
 
@@ -544,7 +570,7 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	endtime = busy_clock() + busyloop_timeout;
 
 	while (vhost_can_busy_poll(endtime)) {
-		if (vhost_has_work(&net->dev)) {
+		if (vhost_vq_has_work(poll_rx ? rvq : tvq)) {
 			*busyloop_intr = true;
 			break;
 		}
@@ -1340,8 +1366,10 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true,
 		       NULL);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 	n->page_frag.page = NULL;
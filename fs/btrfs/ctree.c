@@ -736,11 +736,11 @@ int btrfs_realloc_node(struct btrfs_trans_handle *trans,
  * all of the keys
  */
 static noinline int generic_bin_search(struct extent_buffer *eb,
-				       unsigned long p, int item_size,
+				       unsigned long p, int item_size, int nritems,
 				       const struct btrfs_key *key, int *slot)
 {
 	int low = 0;
-	int high = btrfs_header_nritems(eb);
+	int high = nritems;
 	int ret;
 	const int key_size = sizeof(struct btrfs_disk_key);
 
@@ -799,11 +799,13 @@ int btrfs_bin_search(struct extent_buffer *eb, const struct btrfs_key *key,
 	if (btrfs_header_level(eb) == 0)
 		return generic_bin_search(eb,
 					  offsetof(struct btrfs_leaf, items),
-					  sizeof(struct btrfs_item), key, slot);
+					  sizeof(struct btrfs_item),
+					  btrfs_header_nritems(eb), key, slot);
 	else
 		return generic_bin_search(eb,
 					  offsetof(struct btrfs_node, ptrs),
-					  sizeof(struct btrfs_key_ptr), key, slot);
+					  sizeof(struct btrfs_key_ptr),
+					  btrfs_header_nritems(eb), key, slot);
 }
 
 static void root_add_used(struct btrfs_root *root, u32 size)
@@ -1676,6 +1678,110 @@ static int finish_need_commit_sem_search(struct btrfs_path *path)
 	return 0;
 }
 
+/*
+ * Lockless descent for plain searches, trying to avoid read locking every node
+ * from the root down, which makes the upper nodes of busy trees a contention
+ * point for parallel lookups.
+ *
+ * Every modification of a tree block is done with its write lock held, and
+ * the write lock bumps eb->lock_seq.  So instead of locking a node, sample its
+ * sequence count, search it and only trust the child pointer found if the
+ * count is unchanged once the child has been looked up and its own count has
+ * been sampled.  A node that is COWed, split or freed is write locked first,
+ * so this also catches nodes that are no longer part of the tree.  Only the
+ * leaf is read locked, as the callers expect, and it is validated the same way
+ * once it is locked.
+ *
+ * If a node is write locked, not cached or not uptodate, or if it changes from
+ * under us, give up with -EAGAIN and let the caller do the locked search.  On
+ * success the path is set up exactly like btrfs_search_slot() would leave it
+ * for a search with @ins_len and @cow set to 0.
+ */
+static int search_slot_lockless(struct btrfs_root *root,
+				const struct btrfs_key *key,
+				struct btrfs_path *p)
+{
+	struct btrfs_fs_info *fs_info = root->fs_info;
+	struct extent_buffer *b;
+	unsigned int seq;
+	int level;
+	int slot;
+	int ret;
+
+	b = btrfs_root_node(root);
+	seq = raw_read_seqcount(&b->lock_seq);
+	if ((seq & 1) || b != rcu_access_pointer(root->node) ||
+	    !extent_buffer_uptodate(b)) {
+		free_extent_buffer(b);
+		return -EAGAIN;
+	}
+	level = btrfs_header_level(b);
+	if (level >= BTRFS_MAX_LEVEL) {
+		free_extent_buffer(b);
+		return -EAGAIN;
+	}
+	p->nodes[level] = b;
+
+	while (level > 0) {
+		struct extent_buffer *child;
+		unsigned int child_seq;
+		u32 nritems;
+		u64 blockptr;
+		u64 gen;
+
+		/*
+		 * The contents may be changing under us, make sure the search
+		 * stays within the extent buffer.
+		 */
+		nritems = btrfs_header_nritems(b);
+		if (nritems == 0 || nritems > BTRFS_NODEPTRS_PER_BLOCK(fs_info))
+			goto fallback;
+
+		ret = generic_bin_search(b, offsetof(struct btrfs_node, ptrs),
+					 sizeof(struct btrfs_key_ptr), nritems,
+					 key, &slot);
+		if (ret && slot > 0)
+			slot--;
+		p->slots[level] = slot;
+		blockptr = btrfs_node_blockptr(b, slot);
+		gen = btrfs_node_ptr_generation(b, slot);
+		if (read_seqcount_retry(&b->lock_seq, seq))
+			goto fallback;
+
+		child = find_extent_buffer(fs_info, blockptr);
+		if (!child)
+			goto fallback;
+		p->nodes[level - 1] = child;
+		if (!extent_buffer_uptodate(child))
+			goto fallback;
+
+		child_seq = raw_read_seqcount(&child->lock_seq);
+		if ((child_seq & 1) || read_seqcount_retry(&b->lock_seq, seq))
+			goto fallback;
+		if (btrfs_header_level(child) != level - 1 ||
+		    btrfs_header_generation(child) != gen)
+			goto fallback;
+
+		b = child;
+		seq = child_seq;
+		level--;
+	}
+
+	btrfs_maybe_reset_lockdep_class(root, b);
+	btrfs_tree_read_lock(b);
+	p->locks[0] = BTRFS_READ_LOCK;
+	if (read_seqcount_retry(&b->lock_seq, seq))
+		goto fallback;
+
+	ret = btrfs_bin_search(b, key, &slot);
+	p->slots[0] = slot;
+	return ret;
+
+fallback:
+	btrfs_release_path(p);
+	return -EAGAIN;
+}
+
 /*
  * btrfs_search_slot - look for a key in a tree and perform necessary
  * modifications to preserve tree invariants.
@@ -1758,6 +1864,13 @@ int btrfs_search_slot(struct btrfs_trans_handle *trans, struct btrfs_root *root,
 		down_read(&fs_info->commit_root_sem);
 	}
 
+	if (!cow && !ins_len && !lowest_level && !p->keep_locks &&
+	    !p->skip_locking) {
+		ret = search_slot_lockless(root, key, p);
+		if (ret != -EAGAIN)
+			goto done;
+	}
+
 again:
 	prev_cmp = -1;
 	b = btrfs_search_slot_get_root(root, p, write_lock_level);
@@ -975,6 +975,9 @@ struct btrfs_fs_info {
 	struct list_head reclaim_bgs;
 	int bg_reclaim_threshold;
 
+	/* Maximum number of rbios kept in the raid56 stripe cache */
+	int stripe_cache_size;
+
 	spinlock_t unused_bgs_lock;
 	struct list_head unused_bgs;
 	struct mutex unused_bg_unpin_mutex;
@@ -281,8 +281,39 @@ static int search_csum_tree(struct btrfs_fs_info *fs_info,
 
 		if (in_range(disk_bytenr, csum_start, csum_len))
 			goto found;
+
+		/*
+		 * Reads are mostly sequential, so what we want is most likely
+		 * in the next csum item of the same leaf.  Check it before
+		 * going through a full search of the csum tree.
+		 */
+		if (csum_start < disk_bytenr &&
+		    path->slots[0] + 1 < btrfs_header_nritems(path->nodes[0])) {
+			btrfs_item_key_to_cpu(path->nodes[0], &key,
+					      path->slots[0] + 1);
+			if (key.objectid != BTRFS_EXTENT_CSUM_OBJECTID ||
+			    key.type != BTRFS_EXTENT_CSUM_KEY)
+				goto search;
+
+			/* Nothing can start between the two items, a hole */
+			if (key.offset > disk_bytenr) {
+				ret = 0;
+				goto out;
+			}
+
+			path->slots[0]++;
+			item = btrfs_item_ptr(path->nodes[0], path->slots[0],
+					      struct btrfs_csum_item);
+			itemsize = btrfs_item_size_nr(path->nodes[0],
+						      path->slots[0]);
+			csum_start = key.offset;
+			csum_len = (itemsize / csum_size) * sectorsize;
+			if (in_range(disk_bytenr, csum_start, csum_len))
+				goto found;
+		}
 	}
 
+search:
 	/* Current item doesn't contain the desired range, search again */
 	btrfs_release_path(path);
 	item = btrfs_lookup_csum(NULL, fs_info->csum_root, path, disk_bytenr, 0);
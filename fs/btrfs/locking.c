@@ -114,6 +114,13 @@ void btrfs_maybe_reset_lockdep_class(struct btrfs_root *root, struct extent_buff
  *
  * The rwsem implementation does opportunistic spinning which reduces number of
  * times the locking task needs to sleep.
+ *
+ * Taking and releasing the write lock also bumps eb->lock_seq, which is odd
+ * while the write lock is held.  Every modification of an extent buffer is
+ * done under the write lock, so readers can search an extent buffer without
+ * locking it and validate the result against the sequence count afterwards.
+ * The write side may sleep, so the raw seqcount helpers are used and readers
+ * must never wait for an odd count, they have to fall back to taking the lock.
  */
 
 /*
@@ -163,6 +170,7 @@ int btrfs_try_tree_write_lock(struct extent_buffer *eb)
 {
 	if (down_write_trylock(&eb->lock)) {
 		eb->lock_owner = current->pid;
+		raw_write_seqcount_begin(&eb->lock_seq);
 		trace_btrfs_try_tree_write_lock(eb);
 		return 1;
 	}
@@ -195,6 +203,7 @@ void __btrfs_tree_lock(struct extent_buffer *eb, enum btrfs_lock_nesting nest)
 
 	down_write_nested(&eb->lock, nest);
 	eb->lock_owner = current->pid;
+	raw_write_seqcount_begin(&eb->lock_seq);
 	trace_btrfs_tree_lock(eb, start_ns);
 }
 
@@ -209,6 +218,7 @@ void btrfs_tree_lock(struct extent_buffer *eb)
 void btrfs_tree_unlock(struct extent_buffer *eb)
 {
 	trace_btrfs_tree_unlock(eb);
+	raw_write_seqcount_end(&eb->lock_seq);
 	eb->lock_owner = 0;
 	up_write(&eb->lock);
 }
@@ -34,8 +34,6 @@
  */
 #define RBIO_CACHE_READY_BIT	3
 
-#define RBIO_CACHE_SIZE 1024
-
 #define BTRFS_STRIPE_HASH_TABLE_BITS				11
 
 /* Used by the raid56 code to lock stripes for read/modify/write */
@@ -481,15 +479,18 @@ static void cache_rbio(struct btrfs_raid_bio *rbio)
 
 	spin_unlock(&rbio->bio_list_lock);
 
-	if (table->cache_size > RBIO_CACHE_SIZE) {
+	/* The limit may have been lowered through sysfs, prune down to it */
+	while (table->cache_size >
+	       READ_ONCE(rbio->fs_info->stripe_cache_size)) {
 		struct btrfs_raid_bio *found;
 
 		found = list_entry(table->stripe_cache.prev,
 				  struct btrfs_raid_bio,
 				  stripe_cache);
 
-		if (found != rbio)
-			__remove_rbio_from_cache(found);
+		if (found == rbio)
+			break;
+		__remove_rbio_from_cache(found);
 	}
 
 	spin_unlock_irqrestore(&table->cache_lock, flags);
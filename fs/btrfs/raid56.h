@@ -27,6 +27,13 @@ static inline int nr_data_stripes(const struct map_lookup *map)
 #define is_parity_stripe(x) (((x) == RAID5_P_STRIPE) ||		\
 			     ((x) == RAID6_Q_STRIPE))
 
+/*
+ * Limits for the number of rbios kept in the stripe cache.  Every cached rbio
+ * holds the pages of a full stripe, so a large cache costs a lot of memory.
+ */
+#define BTRFS_DEFAULT_STRIPE_CACHE_SIZE	1024
+#define BTRFS_MAX_STRIPE_CACHE_SIZE	16384
+
 struct btrfs_raid_bio;
 struct btrfs_device;
 
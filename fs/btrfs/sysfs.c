@@ -21,6 +21,7 @@
 #include "space-info.h"
 #include "block-group.h"
 #include "qgroup.h"
+#include "raid56.h"
 
 /*
  * Structure name                       Path
@@ -1056,6 +1057,38 @@ static ssize_t btrfs_bg_reclaim_threshold_store(struct kobject *kobj,
 BTRFS_ATTR_RW(, bg_reclaim_threshold, btrfs_bg_reclaim_threshold_show,
 	      btrfs_bg_reclaim_threshold_store);
 
+static ssize_t btrfs_stripe_cache_size_show(struct kobject *kobj,
+					    struct kobj_attribute *a,
+					    char *buf)
+{
+	struct btrfs_fs_info *fs_info = to_fs_info(kobj);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+			 READ_ONCE(fs_info->stripe_cache_size));
+}
+
+static ssize_t btrfs_stripe_cache_size_store(struct kobject *kobj,
+					     struct kobj_attribute *a,
+					     const char *buf, size_t len)
+{
+	struct btrfs_fs_info *fs_info = to_fs_info(kobj);
+	int size;
+	int ret;
+
+	ret = kstrtoint(buf, 10, &size);
+	if (ret)
+		return ret;
+
+	if (size < 1 || size > BTRFS_MAX_STRIPE_CACHE_SIZE)
+		return -EINVAL;
+
+	WRITE_ONCE(fs_info->stripe_cache_size, size);
+
+	return len;
+}
+BTRFS_ATTR_RW(, stripe_cache_size, btrfs_stripe_cache_size_show,
+	      btrfs_stripe_cache_size_store);
+
 /*
  * Per-filesystem information and stats.
  *
@@ -1073,6 +1106,7 @@ static const struct attribute *btrfs_attrs[] = {
 	BTRFS_ATTR_PTR(, generation),
 	BTRFS_ATTR_PTR(, read_policy),
 	BTRFS_ATTR_PTR(, bg_reclaim_threshold),
+	BTRFS_ATTR_PTR(, stripe_cache_size),
 	NULL,
 };
 
@@ -64,6 +64,9 @@ static const struct cachefiles_daemon_cmd cachefiles_daemon_cmds[] = {
 	{ "brun",	cachefiles_daemon_brun		},
 	{ "bcull",	cachefiles_daemon_bcull		},
 	{ "bstop",	cachefiles_daemon_bstop		},
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+	{ "cread",	cachefiles_ondemand_cread	},
+#endif
 	{ "cull",	cachefiles_daemon_cull		},
 	{ "debug",	cachefiles_daemon_debug		},
 	{ "dir",	cachefiles_daemon_dir		},
@@ -105,6 +108,9 @@ static int cachefiles_daemon_open(struct inode *inode, struct file *file)
 	cache->active_nodes = RB_ROOT;
 	rwlock_init(&cache->active_lock);
 	init_waitqueue_head(&cache->daemon_pollwq);
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+	xa_init_flags(&cache->reqs, XA_FLAGS_ALLOC);
+#endif
 
 	/* set default caching limits
 	 * - limit at 1% free space and/or free files
@@ -136,10 +142,15 @@ static int cachefiles_daemon_release(struct inode *inode, struct file *file)
 
 	set_bit(CACHEFILES_DEAD, &cache->flags);
 
+	cachefiles_ondemand_flush(cache);
 	cachefiles_daemon_unbind(cache);
 
 	ASSERT(!cache->active_nodes.rb_node);
 
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+	xa_destroy(&cache->reqs);
+#endif
+
 	/* clean up the control file interface */
 	cache->cachefilesd = NULL;
 	file->private_data = NULL;
@@ -168,6 +179,10 @@ static ssize_t cachefiles_daemon_read(struct file *file, char __user *_buffer,
 	if (!test_bit(CACHEFILES_READY, &cache->flags))
 		return 0;
 
+	/* in on-demand mode the daemon reads requests instead */
+	if (cachefiles_in_ondemand_mode(cache))
+		return cachefiles_ondemand_daemon_read(cache, _buffer, buflen);
+
 	/* check how much space the cache has */
 	cachefiles_has_space(cache, 0, 0);
 
@@ -286,6 +301,7 @@ static ssize_t cachefiles_daemon_write(struct file *file,
 /*
  * poll for culling state
  * - use EPOLLOUT to indicate culling state
+ * - use EPOLLIN to indicate pending requests in on-demand mode
  */
 static __poll_t cachefiles_daemon_poll(struct file *file,
 					   struct poll_table_struct *poll)
@@ -296,8 +312,14 @@ static __poll_t cachefiles_daemon_poll(struct file *file,
 	poll_wait(file, &cache->daemon_pollwq, poll);
 	mask = 0;
 
-	if (test_bit(CACHEFILES_STATE_CHANGED, &cache->flags))
+	if (cachefiles_in_ondemand_mode(cache)) {
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+		if (xa_marked(&cache->reqs, CACHEFILES_REQ_NEW))
+			mask |= EPOLLIN;
+#endif
+	} else if (test_bit(CACHEFILES_STATE_CHANGED, &cache->flags)) {
 		mask |= EPOLLIN;
+	}
 
 	if (test_bit(CACHEFILES_CULLING, &cache->flags))
 		mask |= EPOLLOUT;
@@ -452,6 +452,10 @@ static int cachefiles_attr_changed(struct fscache_object *_object)
 	if (!object->backer)
 		return -ENOBUFS;
 
+	/* the daemon sizes the cache files itself in on-demand mode */
+	if (cachefiles_in_ondemand_mode(cache))
+		return 0;
+
 	ASSERT(d_is_reg(object->backer));
 
 	fscache_set_store_limit(&object->fscache, ni_size);
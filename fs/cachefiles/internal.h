@@ -18,6 +18,8 @@
 #include <linux/cred.h>
 #include <linux/workqueue.h>
 #include <linux/security.h>
+#include <linux/xarray.h>
+#include <linux/cachefiles.h>
 
 struct cachefiles_cache;
 struct cachefiles_object;
@@ -84,9 +86,13 @@ struct cachefiles_cache {
 #define CACHEFILES_DEAD			1	/* T if cache dead */
 #define CACHEFILES_CULLING		2	/* T if cull engaged */
 #define CACHEFILES_STATE_CHANGED	3	/* T if state changed (poll trigger) */
+#define CACHEFILES_ONDEMAND_MODE	4	/* T if in on-demand read mode */
 	char				*rootdirname;	/* name of cache root directory */
 	char				*secctx;	/* LSM security context */
 	char				*tag;		/* cache binding tag */
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+	struct xarray			reqs;		/* on-demand requests to the daemon */
+#endif
 };
 
 /*
@@ -180,6 +186,59 @@ extern int cachefiles_cull(struct cachefiles_cache *cache, struct dentry *dir,
 extern int cachefiles_check_in_use(struct cachefiles_cache *cache,
 				   struct dentry *dir, char *filename);
 
+/*
+ * ondemand.c
+ */
+#ifdef CONFIG_CACHEFILES_ONDEMAND
+/*
+ * on-demand read request, the daemon holds a ref while delivering it
+ */
+struct cachefiles_req {
+	refcount_t			ref;
+	struct completion		done;
+	int				error;
+	struct file			*file;		/* cache file handed to the daemon */
+	struct cachefiles_msg		msg;
+};
+
+/* mark of the requests the daemon hasn't read yet */
+#define CACHEFILES_REQ_NEW		XA_MARK_1
+
+extern ssize_t cachefiles_ondemand_daemon_read(struct cachefiles_cache *cache,
+					       char __user *_buffer,
+					       size_t buflen);
+extern int cachefiles_ondemand_cread(struct cachefiles_cache *cache,
+				     char *args);
+extern int cachefiles_ondemand_read(struct cachefiles_object *object,
+				    loff_t pos, size_t len);
+extern void cachefiles_ondemand_flush(struct cachefiles_cache *cache);
+
+static inline bool cachefiles_in_ondemand_mode(struct cachefiles_cache *cache)
+{
+	return test_bit(CACHEFILES_ONDEMAND_MODE, &cache->flags);
+}
+#else
+static inline ssize_t cachefiles_ondemand_daemon_read(struct cachefiles_cache *cache,
+						      char __user *_buffer,
+						      size_t buflen)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int cachefiles_ondemand_read(struct cachefiles_object *object,
+					   loff_t pos, size_t len)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void cachefiles_ondemand_flush(struct cachefiles_cache *cache) {}
+
+static inline bool cachefiles_in_ondemand_mode(struct cachefiles_cache *cache)
+{
+	return false;
+}
+#endif
+
 /*
  * rdwr.c
  */
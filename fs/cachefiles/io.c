@@ -273,6 +273,7 @@ static enum netfs_read_source cachefiles_prepare_read(struct netfs_read_subreque
 	struct cachefiles_cache *cache;
 	const struct cred *saved_cred;
 	struct file *file = subreq->rreq->cache_resources.cache_priv2;
+	bool retried = false;
 	loff_t off, to;
 
 	_enter("%zx @%llx/%llx", subreq->len, subreq->start, i_size);
@@ -288,6 +289,7 @@ static enum netfs_read_source cachefiles_prepare_read(struct netfs_read_subreque
 	if (subreq->start >= i_size)
 		return NETFS_FILL_WITH_ZEROES;
 
+retry:
 	cachefiles_begin_secure(cache, &saved_cred);
 
 	off = vfs_llseek(file, subreq->start, SEEK_DATA);
@@ -322,6 +324,16 @@ static enum netfs_read_source cachefiles_prepare_read(struct netfs_read_subreque
 	return NETFS_READ_FROM_CACHE;
 
 download_and_store:
+	/* in on-demand mode, ask the daemon to fill the hole and look again */
+	if (cachefiles_in_ondemand_mode(cache)) {
+		cachefiles_end_secure(cache, saved_cred);
+		if (retried ||
+		    cachefiles_ondemand_read(object, subreq->start, subreq->len))
+			goto cache_fail_nosec;
+		retried = true;
+		goto retry;
+	}
+
 	if (cachefiles_has_space(cache, 0, (subreq->len + PAGE_SIZE - 1) / PAGE_SIZE) == 0)
 		__set_bit(NETFS_SREQ_WRITE_TO_CACHE, &subreq->flags);
 cache_fail:
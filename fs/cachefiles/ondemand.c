@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/* On-demand reading of cache files through the daemon
+ *
+ * In "ondemand" mode the cache files aren't filled by the netfs.  Instead,
+ * reads that hit a hole in a cache file are turned into requests that the
+ * daemon reads from /dev/cachefiles.  The daemon writes the data into the
+ * cache file through the fd passed in the request and then completes the
+ * request with the "cread" command.
+ */
+
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include "internal.h"
+
+static void cachefiles_req_put(struct cachefiles_req *req)
+{
+	if (refcount_dec_and_test(&req->ref)) {
+		fput(req->file);
+		kfree(req);
+	}
+}
+
+/*
+ * complete a request and let the reader go
+ * - must be called with the xarray locked
+ */
+static void __cachefiles_ondemand_complete(struct cachefiles_cache *cache,
+					   struct cachefiles_req *req,
+					   int error)
+{
+	__xa_erase(&cache->reqs, req->msg.msg_id);
+	req->error = error;
+	complete(&req->done);
+}
+
+/*
+ * hand the next pending request over to the daemon
+ */
+ssize_t cachefiles_ondemand_daemon_read(struct cachefiles_cache *cache,
+					char __user *_buffer, size_t buflen)
+{
+	struct cachefiles_req *req;
+	unsigned long id = 0;
+	size_t n;
+	int fd;
+
+	xa_lock(&cache->reqs);
+	req = xa_find(&cache->reqs, &id, UINT_MAX, CACHEFILES_REQ_NEW);
+	if (!req) {
+		xa_unlock(&cache->reqs);
+		return 0;
+	}
+
+	n = req->msg.len;
+	if (n > buflen) {
+		xa_unlock(&cache->reqs);
+		return -EMSGSIZE;
+	}
+
+	__xa_clear_mark(&cache->reqs, id, CACHEFILES_REQ_NEW);
+	refcount_inc(&req->ref);
+	xa_unlock(&cache->reqs);
+
+	fd = get_unused_fd_flags(O_WRONLY);
+	if (fd < 0)
+		goto error;
+
+	req->msg.fd = fd;
+	if (copy_to_user(_buffer, &req->msg, n) != 0) {
+		put_unused_fd(fd);
+		fd = -EFAULT;
+		goto error;
+	}
+
+	fd_install(fd, get_file(req->file));
+	cachefiles_req_put(req);
+	return n;
+
+error:
+	/* don't leave the reader waiting for a request nobody saw */
+	xa_lock(&cache->reqs);
+	if (xa_load(&cache->reqs, id) == req)
+		__cachefiles_ondemand_complete(cache, req, fd);
+	xa_unlock(&cache->reqs);
+	cachefiles_req_put(req);
+	return fd;
+}
+
+/*
+ * note that the daemon has filled the range of a request
+ * - command: "cread <msg_id>[ <error>]"
+ */
+int cachefiles_ondemand_cread(struct cachefiles_cache *cache, char *args)
+{
+	struct cachefiles_req *req;
+	unsigned long id;
+	long error = 0;
+	int ret;
+
+	_enter(",%s", args);
+
+	if (!cachefiles_in_ondemand_mode(cache))
+		return -EOPNOTSUPP;
+
+	if (!*args)
+		return -EINVAL;
+
+	id = simple_strtoul(args, &args, 10);
+	if (*args == ' ') {
+		error = simple_strtol(skip_spaces(args), &args, 10);
+		if (error > 0 || error < -MAX_ERRNO)
+			return -EINVAL;
+	}
+	if (*args)
+		return -EINVAL;
+
+	ret = -EINVAL;
+	xa_lock(&cache->reqs);
+	req = xa_load(&cache->reqs, id);
+	if (req && !xa_get_mark(&cache->reqs, id, CACHEFILES_REQ_NEW)) {
+		__cachefiles_ondemand_complete(cache, req, error);
+		ret = 0;
+	}
+	xa_unlock(&cache->reqs);
+	return ret;
+}
+
+/*
+ * ask the daemon to fill a range of a cache file and wait for it
+ */
+int cachefiles_ondemand_read(struct cachefiles_object *object,
+			     loff_t pos, size_t len)
+{
+	struct fscache_cookie *cookie = object->fscache.cookie;
+	struct cachefiles_cache *cache;
+	struct cachefiles_req *req;
+	struct path path;
+	const void *key;
+	u32 id;
+	int ret;
+
+	cache = container_of(object->fscache.cache,
+			     struct cachefiles_cache, cache);
+
+	_enter("{OBJ%x},%llx,%zx", object->fscache.debug_id, pos, len);
+
+	if (test_bit(CACHEFILES_DEAD, &cache->flags))
+		return -EIO;
+
+	req = kzalloc(sizeof(*req) + cookie->key_len, GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	path.mnt = cache->mnt;
+	path.dentry = object->backer;
+	req->file = open_with_fake_path(&path, O_WRONLY | O_LARGEFILE,
+					d_inode(object->backer),
+					cache->cache_cred);
+	if (IS_ERR(req->file)) {
+		ret = PTR_ERR(req->file);
+		kfree(req);
+		return ret;
+	}
+
+	refcount_set(&req->ref, 1);
+	init_completion(&req->done);
+	req->msg.opcode = CACHEFILES_OP_READ;
+	req->msg.len = sizeof(req->msg) + cookie->key_len;
+	req->msg.off = pos;
+	req->msg.size = len;
+
+	if (cookie->key_len <= sizeof(cookie->inline_key))
+		key = cookie->inline_key;
+	else
+		key = cookie->key;
+	memcpy(req->msg.key, key, cookie->key_len);
+
+	ret = xa_alloc(&cache->reqs, &id, req, xa_limit_32b, GFP_KERNEL);
+	if (ret)
+		goto out;
+	req->msg.msg_id = id;
+
+	/* recheck under the lock, so that either we or the flush sees it */
+	xa_lock(&cache->reqs);
+	if (test_bit(CACHEFILES_DEAD, &cache->flags)) {
+		__xa_erase(&cache->reqs, id);
+		xa_unlock(&cache->reqs);
+		ret = -EIO;
+		goto out;
+	}
+	__xa_set_mark(&cache->reqs, id, CACHEFILES_REQ_NEW);
+	xa_unlock(&cache->reqs);
+
+	wake_up_all(&cache->daemon_pollwq);
+
+	ret = wait_for_completion_killable(&req->done);
+	if (ret == 0) {
+		ret = req->error;
+	} else {
+		xa_lock(&cache->reqs);
+		if (xa_load(&cache->reqs, id) == req)
+			__xa_erase(&cache->reqs, id);
+		xa_unlock(&cache->reqs);
+	}
+out:
+	cachefiles_req_put(req);
+	_leave(" = %d", ret);
+	return ret;
+}
+
+/*
+ * fail all the outstanding requests when the daemon goes away
+ */
+void cachefiles_ondemand_flush(struct cachefiles_cache *cache)
+{
+	struct cachefiles_req *req;
+	unsigned long id;
+
+	xa_lock(&cache->reqs);
+	xa_for_each(&cache->reqs, id, req)
+		__cachefiles_ondemand_complete(cache, req, -EIO);
+	xa_unlock(&cache->reqs);
+}
@@ -131,6 +131,7 @@ cifs_dump_channel(struct seq_file *m, int i, struct cifs_chan *chan)
 		   "\n\t\tNumber of credits: %d Dialect 0x%x"
 		   "\n\t\tTCP status: %d Instance: %d"
 		   "\n\t\tLocal Users To Server: %d SecMode: 0x%x Req On Wire: %d"
+		   " Max Req On Wire: %d"
 		   "\n\t\tIn Send: %d In MaxReq Wait: %d",
 		   i+1, server->conn_id,
 		   server->credits,
@@ -140,6 +141,7 @@ cifs_dump_channel(struct seq_file *m, int i, struct cifs_chan *chan)
 		   server->srv_count,
 		   server->sec_mode,
 		   in_flight(server),
+		   server->max_in_flight,
 		   atomic_read(&server->in_send),
 		   atomic_read(&server->num_waiters));
 }
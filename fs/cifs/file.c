@@ -2990,7 +2990,6 @@ cifs_write_from_iter(loff_t offset, size_t len, struct iov_iter *from,
 	else
 		pid = current->tgid;
 
-	server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
 	xid = get_xid();
 
 	do {
@@ -3006,6 +3005,9 @@ cifs_write_from_iter(loff_t offset, size_t len, struct iov_iter *from,
 				break;
 		}
 
+		/* spread the chunks of a large write over the channels */
+		server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
+
 		rc = server->ops->wait_mtu_credits(server, cifs_sb->ctx->wsize,
 						   &wsize, credits);
 		if (rc)
@@ -3721,8 +3723,6 @@ cifs_send_async_read(loff_t offset, size_t len, struct cifsFileInfo *open_file,
 	size_t start;
 	struct iov_iter direct_iov = ctx->iter;
 
-	server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
-
 	if (cifs_sb->mnt_cifs_flags & CIFS_MOUNT_RWPIDFORWARD)
 		pid = open_file->pid;
 	else
@@ -3740,6 +3740,9 @@ cifs_send_async_read(loff_t offset, size_t len, struct cifsFileInfo *open_file,
 				break;
 		}
 
+		/* spread the chunks of a large read over the channels */
+		server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
+
 		if (cifs_sb->ctx->rsize == 0)
 			cifs_sb->ctx->rsize =
 				server->ops->negotiate_rsize(tlink_tcon(open_file->tlink),
@@ -4500,7 +4503,6 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		pid = current->tgid;
 
 	rc = 0;
-	server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
 
 	cifs_dbg(FYI, "%s: file=%p mapping=%p num_pages=%u\n",
 		 __func__, file, mapping, num_pages);
@@ -4532,6 +4534,9 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 				break;
 		}
 
+		/* spread the chunks of a large read over the channels */
+		server = cifs_pick_channel(tlink_tcon(open_file->tlink)->ses);
+
 		if (cifs_sb->ctx->rsize == 0)
 			cifs_sb->ctx->rsize =
 				server->ops->negotiate_rsize(tlink_tcon(open_file->tlink),
@@ -1028,24 +1028,39 @@ cifs_cancelled_callback(struct mid_q_entry *mid)
 
 /*
  * Return a channel (master if none) of @ses that can be used to send
- * regular requests.
+ * regular requests.  That is the connected one with the fewest requests on
+ * the wire, ties are broken round robin.
  *
  * If we are currently binding a new channel (negprot/sess.setup),
  * return the new incomplete channel.
  */
 struct TCP_Server_Info *cifs_pick_channel(struct cifs_ses *ses)
 {
-	uint index = 0;
+	unsigned int min_in_flight = UINT_MAX;
+	struct TCP_Server_Info *server;
+	uint index = 0, start, cur, i, n;
 
 	if (!ses)
 		return NULL;
 
 	spin_lock(&ses->chan_lock);
 	if (!ses->binding) {
-		/* round robin */
 		if (ses->chan_count > 1) {
-			index = (uint)atomic_inc_return(&ses->chan_seq);
-			index %= ses->chan_count;
+			start = (uint)atomic_inc_return(&ses->chan_seq);
+			index = start % ses->chan_count;
+			for (i = 0; i < ses->chan_count; i++) {
+				cur = (start + i) % ses->chan_count;
+				server = ses->chans[cur].server;
+				if (!server || server->tcpStatus != CifsGood)
+					continue;
+
+				/* racy, but only a hint */
+				n = READ_ONCE(server->in_flight);
+				if (n < min_in_flight) {
+					min_in_flight = n;
+					index = cur;
+				}
+			}
 		}
 		spin_unlock(&ses->chan_lock);
 		return ses->chans[index].server;
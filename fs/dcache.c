@@ -74,6 +74,12 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Max number of unused negative dentries of a superblock, as a percentage
+ * of its positive dentries.  0 means no limit.
+ */
+int sysctl_negative_dentry_ratio __read_mostly;
+
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -177,6 +183,49 @@ int proc_nr_dentry(struct ctl_table *table, int write, void *buffer,
 }
 #endif
 
+/* superblocks with fewer negative dentries than this are left alone */
+#define NEGATIVE_DENTRY_MIN	1024
+
+/* how many unused negative dentries of @sb are over the limit */
+static long d_negative_excess(struct super_block *sb)
+{
+	int ratio = READ_ONCE(sysctl_negative_dentry_ratio);
+	s64 neg, pos;
+
+	if (!ratio)
+		return 0;
+
+	neg = percpu_counter_read_positive(&sb->s_nr_dentry_negative);
+	if (neg < NEGATIVE_DENTRY_MIN)
+		return 0;
+
+	pos = percpu_counter_read_positive(&sb->s_nr_dentry) - neg;
+	return neg - div_s64(max_t(s64, pos, 0) * ratio, 100);
+}
+
+/*
+ * The unused negative dentries are counted per superblock as well, so that
+ * background trimming can be kicked off when a superblock collects too many
+ * of them, see d_trim_negative_work().
+ */
+static inline void d_negative_inc(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&sb->s_nr_dentry_negative);
+	if (unlikely(READ_ONCE(sysctl_negative_dentry_ratio)) &&
+	    !work_pending(&sb->s_dentry_trim_work) &&
+	    d_negative_excess(sb) > 0)
+		queue_work(system_unbound_wq, &sb->s_dentry_trim_work);
+}
+
+static inline void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 /*
  * Compare 2 name strings, return 0 if they match, otherwise non-zero.
  * The strings are both count bytes long, and count is non-zero.
@@ -332,7 +381,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -402,7 +451,7 @@ static void d_lru_add(struct dentry *dentry)
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -412,7 +461,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -444,7 +493,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -454,7 +503,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -583,6 +632,7 @@ static void __dentry_kill(struct dentry *dentry)
 	else
 		spin_unlock(&dentry->d_lock);
 	this_cpu_dec(nr_dentry);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry);
 	if (dentry->d_op && dentry->d_op->d_release)
 		dentry->d_op->d_release(dentry);
 
@@ -1258,6 +1308,72 @@ long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc)
 	return freed;
 }
 
+static enum lru_status dentry_lru_isolate_negative(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/* positive dentries are left to the shrinker */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_SKIP;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+/**
+ * d_trim_negative_work - trim the negative dentries of a superblock
+ * @work: the s_dentry_trim_work of the superblock
+ *
+ * Kicked off when the unused negative dentries of a superblock go over
+ * sysctl_negative_dentry_ratio percents of its positive dentries.  Walk the
+ * dentry LRU and prune cold negative dentries until the superblock is back
+ * under the limit, so that they neither pile up in the hash chains nor have
+ * to be reclaimed in one go by the shrinker under memory pressure.
+ */
+void d_trim_negative_work(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_dentry_trim_work);
+	unsigned long budget;
+
+	if (!trylock_super(sb))
+		return;
+
+	budget = list_lru_count(&sb->s_dentry_lru);
+	while (budget && d_negative_excess(sb) > 0) {
+		unsigned long nr = min_t(unsigned long, budget, 1024);
+		LIST_HEAD(dispose);
+
+		budget -= nr;
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_negative,
+			      &dispose, nr);
+		shrink_dentry_list(&dispose);
+		cond_resched();
+	}
+	up_read(&sb->s_umount);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
@@ -1805,6 +1921,7 @@ static struct dentry *__d_alloc(struct super_block *sb, const struct qstr *name)
 	}
 
 	this_cpu_inc(nr_dentry);
+	percpu_counter_inc(&sb->s_nr_dentry);
 
 	return dentry;
 }
@@ -1977,7 +2094,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 * Decrement negative dentry count if it was in the LRU list.
 	 */
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
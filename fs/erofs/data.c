@@ -11,7 +11,7 @@
 
 struct page *erofs_get_meta_page(struct super_block *sb, erofs_blk_t blkaddr)
 {
-	struct address_space *const mapping = sb->s_bdev->bd_inode->i_mapping;
+	struct address_space *const mapping = erofs_meta_mapping(sb);
 	struct page *page;
 
 	page = read_cache_page_gfp(mapping, blkaddr,
@@ -77,8 +77,8 @@ static int erofs_map_blocks_flatmode(struct inode *inode,
 	return err;
 }
 
-static int erofs_map_blocks(struct inode *inode,
-			    struct erofs_map_blocks *map, int flags)
+int erofs_map_blocks(struct inode *inode,
+		     struct erofs_map_blocks *map, int flags)
 {
 	struct super_block *sb = inode->i_sb;
 	struct erofs_inode *vi = EROFS_I(inode);
@@ -262,6 +262,10 @@ static int erofs_prepare_dio(struct kiocb *iocb, struct iov_iter *to)
 	struct block_device *bdev = inode->i_sb->s_bdev;
 	unsigned int blksize_mask;
 
+	/* fscache blobs can only be read through the page cache */
+	if (erofs_is_fscache_mode(inode->i_sb))
+		return 1;
+
 	if (bdev)
 		blksize_mask = (1 << ilog2(bdev_logical_block_size(bdev))) - 1;
 	else
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2021, Alibaba Cloud
+ */
+#define FSCACHE_USE_NEW_IO_API
+#include <linux/fscache.h>
+#include <linux/netfs.h>
+#include "internal.h"
+
+static struct fscache_netfs erofs_fscache_netfs = {
+	.name		= "erofs",
+	.version	= 0,
+};
+
+static const struct fscache_cookie_def erofs_fscache_blob_def = {
+	.name		= "EROFS.blob",
+	.type		= FSCACHE_COOKIE_TYPE_DATAFILE,
+};
+
+/*
+ * Read a page of the blob from the cache.  The cache files are filled by the
+ * cachefiles daemon on demand, so there is nothing to download when the
+ * cache can't serve the read.
+ */
+static int erofs_fscache_read_page(struct super_block *sb, struct page *page,
+				   erofs_off_t pos)
+{
+	struct netfs_read_subrequest subreq = {};
+	struct netfs_cache_resources *cres;
+	struct netfs_read_request *rreq;
+	enum netfs_read_source source;
+	struct bio_vec bvec;
+	struct iov_iter iter;
+	size_t done = 0;
+	int ret;
+
+	rreq = kzalloc(sizeof(*rreq), GFP_NOFS);
+	if (!rreq)
+		return -ENOMEM;
+
+	rreq->inode = EROFS_SB(sb)->blob_inode;
+	rreq->mapping = rreq->inode->i_mapping;
+	rreq->start = pos;
+	rreq->len = PAGE_SIZE;
+	rreq->i_size = OFFSET_MAX;
+
+	ret = fscache_begin_read_operation(rreq, EROFS_SB(sb)->fscache);
+	if (ret)
+		goto out;
+
+	cres = &rreq->cache_resources;
+	subreq.rreq = rreq;
+	while (done < PAGE_SIZE) {
+		subreq.start = pos + done;
+		subreq.len = PAGE_SIZE - done;
+		subreq.flags = 0;
+
+		source = cres->ops->prepare_read(&subreq, rreq->i_size);
+		if (source != NETFS_READ_FROM_CACHE) {
+			erofs_err(sb, "failed to fscache prepare_read (source %d) @ %llu",
+				  source, subreq.start);
+			ret = -EIO;
+			break;
+		}
+
+		bvec.bv_page = page;
+		bvec.bv_offset = done;
+		bvec.bv_len = subreq.len;
+		iov_iter_bvec(&iter, READ, &bvec, 1, subreq.len);
+		ret = cres->ops->read(cres, subreq.start, &iter, false,
+				      NULL, NULL);
+		if (!ret && iov_iter_count(&iter))
+			ret = -EIO;
+		if (ret) {
+			erofs_err(sb, "failed to fscache_read (ret %d) @ %llu",
+				  ret, subreq.start);
+			break;
+		}
+		done += subreq.len;
+	}
+	cres->ops->end_operation(cres);
+out:
+	kfree(rreq);
+	return ret;
+}
+
+static int erofs_fscache_meta_readpage(struct file *data, struct page *page)
+{
+	struct super_block *sb = page->mapping->host->i_sb;
+	int ret;
+
+	ret = erofs_fscache_read_page(sb, page, page_offset(page));
+	if (!ret)
+		SetPageUptodate(page);
+	unlock_page(page);
+	return ret;
+}
+
+/* the blob is read-only and only accessed through the page cache */
+static const struct address_space_operations erofs_fscache_meta_aops = {
+	.readpage = erofs_fscache_meta_readpage,
+};
+
+static int erofs_fscache_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct super_block *sb = inode->i_sb;
+	struct erofs_map_blocks map;
+	erofs_off_t pos = page_offset(page);
+	struct page *mpage;
+	unsigned int len;
+	int ret;
+
+	map.m_la = pos;
+	ret = erofs_map_blocks(inode, &map, EROFS_GET_BLOCKS_RAW);
+	if (ret)
+		goto out;
+
+	if (!(map.m_flags & EROFS_MAP_MAPPED)) {
+		zero_user(page, 0, PAGE_SIZE);
+		SetPageUptodate(page);
+		goto out;
+	}
+
+	/* plain blocks are read from the blob directly */
+	if (!(map.m_flags & EROFS_MAP_META)) {
+		ret = erofs_fscache_read_page(sb, page,
+					      map.m_pa + pos - map.m_la);
+		if (ret)
+			goto out;
+		if (pos + PAGE_SIZE > inode->i_size)
+			zero_user_segment(page, inode->i_size - pos, PAGE_SIZE);
+		SetPageUptodate(page);
+		goto out;
+	}
+
+	/* the inline tail is copied out of the metadata block */
+	mpage = erofs_get_meta_page(sb, erofs_blknr(map.m_pa));
+	if (IS_ERR(mpage)) {
+		ret = PTR_ERR(mpage);
+		goto out;
+	}
+
+	len = min_t(u64, map.m_llen, PAGE_SIZE);
+	memcpy_page(page, 0, mpage, erofs_blkoff(map.m_pa), len);
+	zero_user_segment(page, len, PAGE_SIZE);
+	SetPageUptodate(page);
+
+	unlock_page(mpage);
+	put_page(mpage);
+out:
+	unlock_page(page);
+	return ret;
+}
+
+const struct address_space_operations erofs_fscache_access_aops = {
+	.readpage = erofs_fscache_readpage,
+};
+
+int erofs_fscache_register_fs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	struct inode *inode;
+
+	sbi->fscache = fscache_acquire_cookie(erofs_fscache_netfs.primary_index,
+					      &erofs_fscache_blob_def,
+					      sbi->fsid, strlen(sbi->fsid),
+					      NULL, 0, sbi, 0, true);
+	if (!sbi->fscache) {
+		erofs_err(sb, "failed to get fscache cookie for blob %s",
+			  sbi->fsid);
+		return -ENOBUFS;
+	}
+
+	inode = new_inode(sb);
+	if (!inode)
+		return -ENOMEM;
+
+	set_nlink(inode, 1);
+	inode->i_size = OFFSET_MAX;
+	inode->i_mapping->a_ops = &erofs_fscache_meta_aops;
+	mapping_set_gfp_mask(inode->i_mapping, GFP_NOFS);
+	sbi->blob_inode = inode;
+	return 0;
+}
+
+void erofs_fscache_unregister_fs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+
+	iput(sbi->blob_inode);
+	sbi->blob_inode = NULL;
+	fscache_relinquish_cookie(sbi->fscache, NULL, false);
+	sbi->fscache = NULL;
+	kfree(sbi->fsid);
+	sbi->fsid = NULL;
+}
+
+int __init erofs_fscache_register(void)
+{
+	return fscache_register_netfs(&erofs_fscache_netfs);
+}
+
+void erofs_fscache_unregister(void)
+{
+	fscache_unregister_netfs(&erofs_fscache_netfs);
+}
@@ -296,10 +296,20 @@ static int erofs_fill_inode(struct inode *inode, int isdir)
 	}
 
 	if (erofs_inode_is_data_compressed(vi->datalayout)) {
+		if (erofs_is_fscache_mode(inode->i_sb)) {
+			erofs_err(inode->i_sb,
+				  "compressed inode (nid %llu) unsupported in fscache mode",
+				  vi->nid);
+			err = -EOPNOTSUPP;
+			goto out_unlock;
+		}
 		err = z_erofs_fill_inode(inode);
 		goto out_unlock;
 	}
-	inode->i_mapping->a_ops = &erofs_raw_access_aops;
+	if (erofs_is_fscache_mode(inode->i_sb))
+		inode->i_mapping->a_ops = &erofs_fscache_access_aops;
+	else
+		inode->i_mapping->a_ops = &erofs_raw_access_aops;
 
 out_unlock:
 	unlock_page(page);
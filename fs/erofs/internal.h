@@ -56,6 +56,10 @@ struct erofs_fs_context {
 
 	/* threshold for decompression synchronously */
 	unsigned int max_sync_decompress_pages;
+#endif
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	/* the blob to mount, handed over to erofs_sb_info at fill_super */
+	char *fsid;
 #endif
 	unsigned int mount_opt;
 };
@@ -85,6 +89,14 @@ struct erofs_sb_info {
 
 	struct erofs_sb_lz4_info lz4;
 #endif	/* CONFIG_EROFS_FS_ZIP */
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	/* fscache blob which backs the whole filesystem */
+	char *fsid;
+	struct fscache_cookie *fscache;
+
+	/* pseudo inode to cache the metadata of the blob */
+	struct inode *blob_inode;
+#endif
 	struct dax_device *dax_dev;
 	u32 blocks;
 	u32 meta_blkaddr;
@@ -115,6 +127,12 @@ struct erofs_sb_info {
 #define EROFS_SB(sb) ((struct erofs_sb_info *)(sb)->s_fs_info)
 #define EROFS_I_SB(inode) ((struct erofs_sb_info *)(inode)->i_sb->s_fs_info)
 
+/* mounted with "fsid=" on top of a fscache blob rather than a bdev */
+static inline bool erofs_is_fscache_mode(struct super_block *sb)
+{
+	return IS_ENABLED(CONFIG_EROFS_FS_ONDEMAND) && !sb->s_bdev;
+}
+
 /* Mount flags set via mount options or defaults */
 #define EROFS_MOUNT_XATTR_USER		0x00000010
 #define EROFS_MOUNT_POSIX_ACL		0x00000020
@@ -359,7 +377,19 @@ static inline int z_erofs_map_blocks_iter(struct inode *inode,
 
 /* data.c */
 extern const struct file_operations erofs_file_fops;
+
+static inline struct address_space *erofs_meta_mapping(struct super_block *sb)
+{
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	if (erofs_is_fscache_mode(sb))
+		return EROFS_SB(sb)->blob_inode->i_mapping;
+#endif
+	return sb->s_bdev->bd_inode->i_mapping;
+}
+
 struct page *erofs_get_meta_page(struct super_block *sb, erofs_blk_t blkaddr);
+int erofs_map_blocks(struct inode *inode, struct erofs_map_blocks *map,
+		     int flags);
 int erofs_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		 u64 start, u64 len);
 
@@ -406,6 +436,24 @@ static inline void *erofs_vm_map_ram(struct page **pages, unsigned int count)
 	return NULL;
 }
 
+/* fscache.c */
+extern const struct address_space_operations erofs_fscache_access_aops;
+
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+int __init erofs_fscache_register(void);
+void erofs_fscache_unregister(void);
+int erofs_fscache_register_fs(struct super_block *sb);
+void erofs_fscache_unregister_fs(struct super_block *sb);
+#else
+static inline int erofs_fscache_register(void) { return 0; }
+static inline void erofs_fscache_unregister(void) {}
+static inline int erofs_fscache_register_fs(struct super_block *sb)
+{
+	return -EOPNOTSUPP;
+}
+static inline void erofs_fscache_unregister_fs(struct super_block *sb) {}
+#endif	/* !CONFIG_EROFS_FS_ONDEMAND */
+
 /* pcpubuf.c */
 void *erofs_get_pcpubuf(unsigned int requiredpages);
 void erofs_put_pcpubuf(void *ptr);
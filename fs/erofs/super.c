@@ -261,7 +261,7 @@ static int erofs_read_superblock(struct super_block *sb)
 	void *data;
 	int ret;
 
-	page = read_mapping_page(sb->s_bdev->bd_inode->i_mapping, 0, NULL);
+	page = read_mapping_page(erofs_meta_mapping(sb), 0, NULL);
 	if (IS_ERR(page)) {
 		erofs_err(sb, "cannot read erofs superblock");
 		return PTR_ERR(page);
@@ -358,6 +358,7 @@ enum {
 	Opt_cache_strategy,
 	Opt_dax,
 	Opt_dax_enum,
+	Opt_fsid,
 	Opt_err
 };
 
@@ -381,6 +382,7 @@ static const struct fs_parameter_spec erofs_fs_parameters[] = {
 		     erofs_param_cache_strategy),
 	fsparam_flag("dax",             Opt_dax),
 	fsparam_enum("dax",		Opt_dax_enum, erofs_dax_param_enums),
+	fsparam_string("fsid",		Opt_fsid),
 	{}
 };
 
@@ -456,6 +458,15 @@ static int erofs_fc_parse_param(struct fs_context *fc,
 		if (!erofs_fc_set_dax_mode(fc, result.uint_32))
 			return -EINVAL;
 		break;
+	case Opt_fsid:
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+		kfree(ctx->fsid);
+		ctx->fsid = param->string;
+		param->string = NULL;
+#else
+		errorfc(fc, "fsid option not supported");
+#endif
+		break;
 	default:
 		return -ENOPARAM;
 	}
@@ -530,7 +541,10 @@ static int erofs_fc_fill_super(struct super_block *sb, struct fs_context *fc)
 
 	sb->s_magic = EROFS_SUPER_MAGIC;
 
-	if (!sb_set_blocksize(sb, EROFS_BLKSIZ)) {
+	if (erofs_is_fscache_mode(sb)) {
+		sb->s_blocksize = EROFS_BLKSIZ;
+		sb->s_blocksize_bits = LOG_BLOCK_SIZE;
+	} else if (!sb_set_blocksize(sb, EROFS_BLKSIZ)) {
 		erofs_err(sb, "failed to set erofs blksize");
 		return -EINVAL;
 	}
@@ -540,13 +554,25 @@ static int erofs_fc_fill_super(struct super_block *sb, struct fs_context *fc)
 		return -ENOMEM;
 
 	sb->s_fs_info = sbi;
-	sbi->dax_dev = fs_dax_get_by_bdev(sb->s_bdev);
+	if (erofs_is_fscache_mode(sb)) {
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+		sbi->fsid = ctx->fsid;
+		ctx->fsid = NULL;
+#endif
+		err = erofs_fscache_register_fs(sb);
+		if (err)
+			return err;
+	} else {
+		sbi->dax_dev = fs_dax_get_by_bdev(sb->s_bdev);
+	}
+
 	err = erofs_read_superblock(sb);
 	if (err)
 		return err;
 
 	if (test_opt(ctx, DAX_ALWAYS) &&
-	    !dax_supported(sbi->dax_dev, sb->s_bdev, EROFS_BLKSIZ, 0, bdev_nr_sectors(sb->s_bdev))) {
+	    (!sbi->dax_dev ||
+	     !dax_supported(sbi->dax_dev, sb->s_bdev, EROFS_BLKSIZ, 0, bdev_nr_sectors(sb->s_bdev)))) {
 		errorfc(fc, "DAX unsupported by block device. Turning off DAX.");
 		clear_opt(ctx, DAX_ALWAYS);
 	}
@@ -596,6 +622,13 @@ static int erofs_fc_fill_super(struct super_block *sb, struct fs_context *fc)
 
 static int erofs_fc_get_tree(struct fs_context *fc)
 {
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	struct erofs_fs_context *ctx = fc->fs_private;
+
+	/* there is no block device behind a fscache blob */
+	if (ctx->fsid)
+		return get_tree_nodev(fc, erofs_fc_fill_super);
+#endif
 	return get_tree_bdev(fc, erofs_fc_fill_super);
 }
 
@@ -620,6 +653,11 @@ static int erofs_fc_reconfigure(struct fs_context *fc)
 
 static void erofs_fc_free(struct fs_context *fc)
 {
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	struct erofs_fs_context *ctx = fc->fs_private;
+
+	kfree(ctx->fsid);
+#endif
 	kfree(fc->fs_private);
 }
 
@@ -654,7 +692,14 @@ static void erofs_kill_sb(struct super_block *sb)
 
 	WARN_ON(sb->s_magic != EROFS_SUPER_MAGIC);
 
-	kill_block_super(sb);
+	if (erofs_is_fscache_mode(sb)) {
+		/* drop the blob inode before the inodes get evicted */
+		if (sb->s_fs_info)
+			erofs_fscache_unregister_fs(sb);
+		kill_anon_super(sb);
+	} else {
+		kill_block_super(sb);
+	}
 
 	sbi = EROFS_SB(sb);
 	if (!sbi)
@@ -711,6 +756,10 @@ static int __init erofs_module_init(void)
 	if (err)
 		goto zip_err;
 
+	err = erofs_fscache_register();
+	if (err)
+		goto fscache_err;
+
 	err = register_filesystem(&erofs_fs_type);
 	if (err)
 		goto fs_err;
@@ -718,6 +767,8 @@ static int __init erofs_module_init(void)
 	return 0;
 
 fs_err:
+	erofs_fscache_unregister();
+fscache_err:
 	z_erofs_exit_zip_subsystem();
 zip_err:
 	erofs_exit_shrinker();
@@ -730,6 +781,7 @@ static int __init erofs_module_init(void)
 static void __exit erofs_module_exit(void)
 {
 	unregister_filesystem(&erofs_fs_type);
+	erofs_fscache_unregister();
 	z_erofs_exit_zip_subsystem();
 	erofs_exit_shrinker();
 
@@ -744,7 +796,7 @@ static int erofs_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
 	struct super_block *sb = dentry->d_sb;
 	struct erofs_sb_info *sbi = EROFS_SB(sb);
-	u64 id = huge_encode_dev(sb->s_bdev->bd_dev);
+	u64 id = huge_encode_dev(sb->s_dev);
 
 	buf->f_type = sb->s_magic;
 	buf->f_bsize = EROFS_BLKSIZ;
@@ -789,6 +841,10 @@ static int erofs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",dax=always");
 	if (test_opt(ctx, DAX_NEVER))
 		seq_puts(seq, ",dax=never");
+#ifdef CONFIG_EROFS_FS_ONDEMAND
+	if (sbi->fsid)
+		seq_printf(seq, ",fsid=%s", sbi->fsid);
+#endif
 	return 0;
 }
 
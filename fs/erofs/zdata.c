@@ -1057,6 +1057,45 @@ static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 	}
 }
 
+/* compressed pages one worker decompresses before handing the rest over */
+#define Z_EROFS_SPLIT_PAGES	16
+
+/*
+ * The pclusters of a chain are independent, so cut off the rest of a long
+ * chain after a batch of compressed pages and queue it to another worker.
+ * That worker will do the same, so a big readahead request gets fanned out
+ * to the whole workqueue instead of being decompressed by a single thread.
+ */
+static void z_erofs_split_decompressqueue(struct z_erofs_decompressqueue *io)
+{
+	z_erofs_next_pcluster_t owned = io->head;
+	struct z_erofs_decompressqueue *q;
+	struct z_erofs_pcluster *pcl;
+	unsigned int nr_pages = 0;
+
+	while (1) {
+		pcl = container_of(owned, struct z_erofs_pcluster, next);
+		owned = READ_ONCE(pcl->next);
+		if (owned == Z_EROFS_PCLUSTER_TAIL_CLOSED)
+			return;
+
+		nr_pages += pcl->pclusterpages;
+		if (nr_pages >= Z_EROFS_SPLIT_PAGES)
+			break;
+	}
+
+	q = kvzalloc(sizeof(*q), GFP_NOIO | __GFP_NOWARN);
+	if (!q)
+		return;
+
+	INIT_WORK(&q->u.work, z_erofs_decompressqueue_work);
+	q->sb = io->sb;
+	q->head = owned;
+	/* a closed tail can't be claimed by others, just like the real one */
+	WRITE_ONCE(pcl->next, Z_EROFS_PCLUSTER_TAIL_CLOSED);
+	queue_work(z_erofs_workqueue, &q->u.work);
+}
+
 static void z_erofs_decompressqueue_work(struct work_struct *work)
 {
 	struct z_erofs_decompressqueue *bgq =
@@ -1064,6 +1103,7 @@ static void z_erofs_decompressqueue_work(struct work_struct *work)
 	LIST_HEAD(pagepool);
 
 	DBG_BUGON(bgq->head == Z_EROFS_PCLUSTER_TAIL_CLOSED);
+	z_erofs_split_decompressqueue(bgq);
 	z_erofs_decompress_queue(bgq, &pagepool);
 
 	put_pages_list(&pagepool);
@@ -40,7 +40,9 @@
  * - EXT4_FC_TAG_INODE		- record the inode that should be replayed
  *				  during recovery. Note that iblocks field is
  *				  not replayed and instead derived during
- *				  replay.
+ *				  replay. The whole on-disk inode is logged,
+ *				  so this covers extended attributes stored
+ *				  in the inode body too.
  * Commit Operation
  * ----------------
  * With fast commits, we maintain all the directory entry operations in the
@@ -67,7 +69,7 @@
  * -------------------------
  *
  * Not all operations are supported by fast commits today (e.g extended
- * attributes). Fast commit ineligibility is marked by calling
+ * attributes stored outside of the inode body). Fast commit ineligibility is marked by calling
  * ext4_fc_mark_ineligible(): This makes next fast commit operation to fall back
  * to full commit.
  *
@@ -775,7 +777,6 @@ static bool ext4_fc_add_dentry_tlv(struct super_block *sb, u32 *crc,
  */
 static int ext4_fc_write_inode(struct inode *inode, u32 *crc)
 {
-	struct ext4_inode_info *ei = EXT4_I(inode);
 	int inode_len = EXT4_GOOD_OLD_INODE_SIZE;
 	int ret;
 	struct ext4_iloc iloc;
@@ -787,8 +788,13 @@ static int ext4_fc_write_inode(struct inode *inode, u32 *crc)
 	if (ret)
 		return ret;
 
+	/*
+	 * Log the whole on-disk inode so that extended attributes stored in
+	 * the inode body are replayed along with it. Replay copies as much
+	 * as the tag length says, so older kernels cope with this as well.
+	 */
 	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE)
-		inode_len += ei->i_extra_isize;
+		inode_len = EXT4_INODE_SIZE(inode->i_sb);
 
 	fc_inode.fc_ino = cpu_to_le32(inode->i_ino);
 	tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_INODE);
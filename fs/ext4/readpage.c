@@ -241,6 +241,8 @@ int ext4_mpage_readpages(struct inode *inode,
 	unsigned relative_block = 0;
 	struct ext4_map_blocks map;
 	unsigned int nr_pages = rac ? readahead_count(rac) : 1;
+	struct page *batch[PAGEVEC_SIZE];
+	unsigned int batch_nr = 0, batch_idx = 0;
 
 	map.m_pblk = 0;
 	map.m_lblk = 0;
@@ -252,7 +254,17 @@ int ext4_mpage_readpages(struct inode *inode,
 		unsigned first_hole = blocks_per_page;
 
 		if (rac) {
-			page = readahead_page(rac);
+			/*
+			 * Pull the pages out of the page cache a batch at a
+			 * time, with a single xarray walk, and drop the
+			 * readahead references to the batch in one go.
+			 */
+			if (batch_idx == batch_nr) {
+				batch_nr = __readahead_batch(rac, batch,
+							     ARRAY_SIZE(batch));
+				batch_idx = 0;
+			}
+			page = batch[batch_idx++];
 			prefetchw(&page->flags);
 		}
 
@@ -404,8 +416,8 @@ int ext4_mpage_readpages(struct inode *inode,
 		else
 			unlock_page(page);
 	next_page:
-		if (rac)
-			put_page(page);
+		if (rac && batch_idx == batch_nr)
+			release_pages(batch, batch_nr);
 	}
 	if (bio)
 		submit_bio(bio);
@@ -2298,6 +2298,7 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 	struct ext4_xattr_block_find bs = {
 		.s = { .not_found = -ENODATA, },
 	};
+	bool had_block, had_feature;
 	int no_expand;
 	int error;
 
@@ -2307,6 +2308,8 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 		return -ERANGE;
 
 	ext4_write_lock_xattr(inode, &no_expand);
+	had_block = EXT4_I(inode)->i_file_acl != 0;
+	had_feature = ext4_has_feature_xattr(inode->i_sb);
 
 	/* Check journal credits under write lock. */
 	if (ext4_handle_valid(handle)) {
@@ -2423,7 +2426,15 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 		if (IS_SYNC(inode))
 			ext4_handle_sync(handle);
 	}
-	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR, handle);
+	/*
+	 * Fast commits log the whole inode body, so only changes involving an
+	 * xattr block, an EA inode or the superblock feature need a full
+	 * commit.
+	 */
+	if (had_block || EXT4_I(inode)->i_file_acl || i.in_inode ||
+	    !had_feature)
+		ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR,
+					handle);
 
 cleanup:
 	brelse(is.iloc.bh);
@@ -2501,7 +2512,6 @@ ext4_xattr_set(struct inode *inode, int name_index, const char *name,
 		if (error == 0)
 			error = error2;
 	}
-	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR, NULL);
 
 	return error;
 }
@@ -1045,6 +1045,7 @@ static int f2fs_submit_page_read(struct inode *inode, struct page *page,
 	ClearPageError(page);
 	inc_page_count(sbi, F2FS_RD_DATA);
 	f2fs_update_iostat(sbi, FS_DATA_READ_IO, F2FS_BLKSIZE);
+	f2fs_update_segment_rtime(sbi, blkaddr);
 	__submit_bio(sbi, bio, DATA);
 	return 0;
 }
@@ -2132,6 +2133,7 @@ static int f2fs_read_single_page(struct inode *inode, struct page *page,
 
 	inc_page_count(F2FS_I_SB(inode), F2FS_RD_DATA);
 	f2fs_update_iostat(F2FS_I_SB(inode), FS_DATA_READ_IO, F2FS_BLKSIZE);
+	f2fs_update_segment_rtime(F2FS_I_SB(inode), block_nr);
 	ClearPageError(page);
 	*last_block_in_bio = block_nr;
 	goto out;
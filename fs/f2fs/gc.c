@@ -315,8 +315,16 @@ static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 	unsigned int i;
 	unsigned int usable_segs_per_sec = f2fs_usable_segs_in_sec(sbi, segno);
 
-	for (i = 0; i < usable_segs_per_sec; i++)
-		mtime += get_seg_entry(sbi, start + i)->mtime;
+	/*
+	 * Data that is read a lot is hot even if it isn't rewritten, so let
+	 * reads make a segment look younger, the same way writes do. That
+	 * keeps read-hot data from being migrated over and over again.
+	 */
+	for (i = 0; i < usable_segs_per_sec; i++) {
+		struct seg_entry *se = get_seg_entry(sbi, start + i);
+
+		mtime += max(se->mtime, READ_ONCE(se->rtime));
+	}
 	vblocks = get_valid_blocks(sbi, segno, true);
 
 	mtime = div_u64(mtime, usable_segs_per_sec);
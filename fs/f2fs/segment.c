@@ -2258,6 +2258,33 @@ static void update_segment_mtime(struct f2fs_sb_info *sbi, block_t blkaddr,
 		SIT_I(sbi)->max_mtime = ctime;
 }
 
+/*
+ * Like the mtime, the rtime is averaged over the valid blocks of the segment,
+ * so it only gets close to the current time for segments with a lot of reads.
+ * It is racy, as it is updated without any lock from the read path, but it's
+ * only a hint for victim selection.
+ */
+void f2fs_update_segment_rtime(struct f2fs_sb_info *sbi, block_t blkaddr)
+{
+	struct seg_entry *se;
+	unsigned int segno = GET_SEGNO(sbi, blkaddr);
+	unsigned long long ctime = get_mtime(sbi, false);
+	unsigned long long old_rtime, rtime;
+	unsigned int vblocks;
+
+	if (segno == NULL_SEGNO)
+		return;
+
+	se = get_seg_entry(sbi, segno);
+	vblocks = se->valid_blocks;
+	old_rtime = READ_ONCE(se->rtime);
+	rtime = div_u64(old_rtime * vblocks + ctime, vblocks + 1);
+
+	/* avoid dirtying the cacheline when nothing changes */
+	if (rtime != old_rtime)
+		WRITE_ONCE(se->rtime, rtime);
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -213,6 +213,7 @@ struct seg_entry {
 	unsigned char *ckpt_valid_map;	/* validity bitmap of blocks last cp */
 	unsigned char *discard_map;
 	unsigned long long mtime;	/* modification time of the segment */
+	unsigned long long rtime;	/* read time of the segment, in memory only */
 };
 
 struct sec_entry {
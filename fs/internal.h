@@ -167,6 +167,7 @@ extern struct dentry * d_alloc_pseudo(struct super_block *, const struct qstr *)
 extern char *simple_dname(struct dentry *, char *, int);
 extern void dput_to_list(struct dentry *, struct list_head *);
 extern void shrink_dentry_list(struct list_head *);
+extern void d_trim_negative_work(struct work_struct *);
 
 /*
  * read_write.c
@@ -196,7 +197,8 @@ int sb_init_dio_done_wq(struct super_block *sb);
  * fs/stat.c:
  */
 int do_statx(int dfd, const char __user *filename, unsigned flags,
-	     unsigned int mask, struct statx __user *buffer);
+	     unsigned int mask, struct statx __user *buffer,
+	     unsigned int lookup_flags);
 
 /*
  * fs/splice.c:
@@ -776,6 +776,14 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 				bh->b_end_io = journal_end_buffer_io_sync;
 				submit_bh(REQ_OP_WRITE, REQ_SYNC, bh);
 			}
+			/*
+			 * Consecutive log blocks merge into a few large
+			 * requests which the plug would otherwise hold until
+			 * the whole transaction has been prepared. Send each
+			 * descriptor's worth out now so the device writes it
+			 * while we build the next one.
+			 */
+			blk_flush_plug(current);
 			cond_resched();
 
 			/* Force a new descriptor to be generated next
@@ -6228,7 +6228,11 @@ int smb2_read(struct ksmbd_work *work)
 	ksmbd_debug(SMB, "filename %pd, offset %lld, len %zu\n",
 		    fp->filp->f_path.dentry, offset, length);
 
-	work->aux_payload_buf = kvmalloc(length, GFP_KERNEL | __GFP_ZERO);
+	/*
+	 * Only the nbytes read into the buffer are sent, there is no need to
+	 * clear it first.
+	 */
+	work->aux_payload_buf = kvmalloc(length, GFP_KERNEL);
 	if (!work->aux_payload_buf) {
 		err = -ENOMEM;
 		goto out;
@@ -131,7 +131,7 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page && !PageCompound(page))
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -142,7 +142,8 @@ static bool anon_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) != 1)
+	/* large buffers can't be inserted into a page cache */
+	if (page_count(page) != 1 || PageCompound(page))
 		return false;
 	memcg_kmem_uncharge_page(page, 0);
 	__SetPageLocked(page);
@@ -400,6 +401,39 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+/*
+ * Large writes are copied into compound pages of this order, so that they
+ * are read and spliced as one buffer instead of one buffer per page.
+ */
+#define PIPE_LARGE_BUF_ORDER	4
+
+/*
+ * Allocate a large buffer page for a write of @len bytes, or return NULL to
+ * fall back to a normal page.  A large buffer takes a single slot, so keep
+ * the pages held by the pipe within max_usage, which is what was accounted
+ * to the user.  Called with the pipe locked.
+ */
+static struct page *pipe_alloc_large_page(struct pipe_inode_info *pipe,
+					  size_t len)
+{
+	unsigned int mask = pipe->ring_size - 1;
+	unsigned int head = pipe->head;
+	unsigned int tail = pipe->tail;
+	unsigned int pages = 1 << PIPE_LARGE_BUF_ORDER;
+
+	if (len < (PAGE_SIZE << PIPE_LARGE_BUF_ORDER))
+		return NULL;
+
+	for (; tail != head; tail++)
+		pages += 1 << compound_order(pipe->bufs[tail & mask].page);
+	if (pages > pipe->max_usage)
+		return NULL;
+
+	/* not highmem, copies into the page need it mapped contiguously */
+	return alloc_pages(GFP_USER | __GFP_ACCOUNT | __GFP_COMP |
+			   __GFP_NORETRY | __GFP_NOWARN, PIPE_LARGE_BUF_ORDER);
+}
+
 /* Done while waiting without holding the pipe lock - thus the READ_ONCE() */
 static inline bool pipe_writable(const struct pipe_inode_info *pipe)
 {
@@ -459,7 +493,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		int offset = buf->offset + buf->len;
 
 		if ((buf->flags & PIPE_BUF_FLAG_CAN_MERGE) &&
-		    offset + chars <= PAGE_SIZE) {
+		    offset + chars <= page_size(buf->page)) {
 			ret = pipe_buf_confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -488,10 +522,18 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (!pipe_full(head, pipe->tail, pipe->max_usage)) {
 			unsigned int mask = pipe->ring_size - 1;
 			struct pipe_buffer *buf = &pipe->bufs[head & mask];
-			struct page *page = pipe->tmp_page;
+			struct page *page = NULL;
+			size_t size = PAGE_SIZE;
 			int copied;
 
-			if (!page) {
+			if (!is_packetized(filp))
+				page = pipe_alloc_large_page(pipe,
+							     iov_iter_count(from));
+			if (page) {
+				size = page_size(page);
+			} else if (pipe->tmp_page) {
+				page = pipe->tmp_page;
+			} else {
 				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
@@ -510,6 +552,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			head = pipe->head;
 			if (pipe_full(head, pipe->tail, pipe->max_usage)) {
 				spin_unlock_irq(&pipe->rd_wait.lock);
+				if (page != pipe->tmp_page)
+					put_page(page);
 				continue;
 			}
 
@@ -526,10 +570,11 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			else
 				buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
-			pipe->tmp_page = NULL;
+			if (page == pipe->tmp_page)
+				pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
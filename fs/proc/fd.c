@@ -59,6 +59,13 @@ static int seq_show(struct seq_file *m, void *v)
 		   real_mount(file->f_path.mnt)->mnt_id,
 		   file_inode(file)->i_ino);
 
+	if (S_ISREG(file_inode(file)->i_mode))
+		seq_printf(m, "ra_hits:\t%u\nra_misses:\t%u\nra_stride:\t%ld\n",
+			   READ_ONCE(file->f_ra.nr_hits),
+			   READ_ONCE(file->f_ra.nr_misses),
+			   READ_ONCE(file->f_ra.stride_hits) >= RA_STRIDE_MIN_HITS ?
+			   READ_ONCE(file->f_ra.stride) : 0);
+
 	/* show_fd_locks() never deferences files so a stale value is safe */
 	show_fd_locks(m, file, files);
 	if (seq_has_overflowed(m))
@@ -191,6 +191,7 @@ int vfs_fstat(int fd, struct kstat *stat)
  * @flags: Flags to control the query
  * @stat: The result structure to fill in.
  * @request_mask: STATX_xxx flags indicating what the caller wants
+ * @lookup_flags: Additional LOOKUP_xxx flags for the path walk
  *
  * This function is a wrapper around vfs_getattr().  The main difference is
  * that it uses a filename and base directory to determine the file location.
@@ -200,10 +201,9 @@ int vfs_fstat(int fd, struct kstat *stat)
  * 0 will be returned on success, and a -ve error code if unsuccessful.
  */
 static int vfs_statx(int dfd, const char __user *filename, int flags,
-	      struct kstat *stat, u32 request_mask)
+	      struct kstat *stat, u32 request_mask, unsigned lookup_flags)
 {
 	struct path path;
-	unsigned lookup_flags = 0;
 	int error;
 
 	if (flags & ~(AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_EMPTY_PATH |
@@ -222,6 +222,18 @@ static int vfs_statx(int dfd, const char __user *filename, int flags,
 	if (error)
 		goto out;
 
+	/*
+	 * A cached lookup must not block in ->getattr() either.  Dentries that
+	 * need revalidation belong to network filesystems, which may go to the
+	 * server for the attributes.
+	 */
+	if ((lookup_flags & LOOKUP_CACHED) &&
+	    ((flags & AT_STATX_SYNC_TYPE) == AT_STATX_FORCE_SYNC ||
+	     (path.dentry->d_flags & DCACHE_OP_REVALIDATE))) {
+		path_put(&path);
+		return -EAGAIN;
+	}
+
 	error = vfs_getattr(&path, stat, request_mask, flags);
 	stat->mnt_id = real_mount(path.mnt)->mnt_id;
 	stat->result_mask |= STATX_MNT_ID;
@@ -241,7 +253,7 @@ int vfs_fstatat(int dfd, const char __user *filename,
 			      struct kstat *stat, int flags)
 {
 	return vfs_statx(dfd, filename, flags | AT_NO_AUTOMOUNT,
-			 stat, STATX_BASIC_STATS);
+			 stat, STATX_BASIC_STATS, 0);
 }
 
 #ifdef __ARCH_WANT_OLD_STAT
@@ -602,7 +614,8 @@ cp_statx(const struct kstat *stat, struct statx __user *buffer)
 }
 
 int do_statx(int dfd, const char __user *filename, unsigned flags,
-	     unsigned int mask, struct statx __user *buffer)
+	     unsigned int mask, struct statx __user *buffer,
+	     unsigned int lookup_flags)
 {
 	struct kstat stat;
 	int error;
@@ -612,7 +625,7 @@ int do_statx(int dfd, const char __user *filename, unsigned flags,
 	if ((flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
 		return -EINVAL;
 
-	error = vfs_statx(dfd, filename, flags, &stat, mask);
+	error = vfs_statx(dfd, filename, flags, &stat, mask, lookup_flags);
 	if (error)
 		return error;
 
@@ -635,7 +648,7 @@ SYSCALL_DEFINE5(statx,
 		unsigned int, mask,
 		struct statx __user *, buffer)
 {
-	return do_statx(dfd, filename, flags, mask, buffer);
+	return do_statx(dfd, filename, flags, mask, buffer, 0);
 }
 
 #ifdef CONFIG_COMPAT
@@ -86,6 +86,9 @@ struct xfs_iwalk_ag {
 
 	/* Drop the (hopefully empty) transaction when calling iwalk_fn. */
 	unsigned int			drop_trans:1;
+
+	/* Don't read ahead into the next AG? */
+	unsigned int			same_ag:1;
 };
 
 /*
@@ -120,6 +123,50 @@ xfs_iwalk_ichunk_ra(
 	blk_finish_plug(&plug);
 }
 
+/*
+ * Start readahead for the inode chunks that follow the records in the cache so
+ * that their IO is in flight while the walk function works through the cached
+ * inodes.  The cursor points at the last cached record on entry and is left
+ * wherever the lookahead stopped.  If we run off the end of the AG, read ahead
+ * the AGI of the next AG instead so that the next AG walk doesn't start with a
+ * synchronous read.  This is only a hint, so leave any errors for the walk
+ * itself to find.
+ */
+STATIC void
+xfs_iwalk_lookahead(
+	struct xfs_iwalk_ag		*iwag,
+	struct xfs_btree_cur		*cur,
+	int				has_more)
+{
+	struct xfs_mount		*mp = iwag->mp;
+	struct xfs_perag		*pag = iwag->pag;
+	struct xfs_inobt_rec_incore	irec;
+	xfs_agnumber_t			next_agno = pag->pag_agno + 1;
+	struct blk_plug			plug;
+	unsigned int			nr_recs = 0;
+
+	blk_start_plug(&plug);
+	while (has_more && nr_recs < iwag->sz_recs) {
+		if (xfs_btree_increment(cur, 0, &has_more) || !has_more)
+			break;
+		if (xfs_inobt_get_rec(cur, &irec, &has_more) || !has_more)
+			break;
+		if (irec.ir_freecount == irec.ir_count)
+			continue;
+
+		xfs_iwalk_ichunk_ra(mp, pag, &irec);
+		nr_recs++;
+	}
+	blk_finish_plug(&plug);
+
+	if (has_more || iwag->same_ag || next_agno >= mp->m_sb.sb_agcount)
+		return;
+
+	xfs_buf_readahead(mp->m_ddev_targp,
+			XFS_AG_DADDR(mp, next_agno, XFS_AGI_DADDR(mp)),
+			XFS_FSS_TO_BB(mp, 1), &xfs_agi_buf_ops);
+}
+
 /*
  * Set the bits in @irec's free mask that correspond to the inodes before
  * @agino so that we skip them.  This is how we restart an inode walk that was
@@ -363,7 +410,11 @@ xfs_iwalk_run_callbacks(
 
 	ASSERT(iwag->nr_recs > 0);
 
-	/* Delete cursor but remember the last record we cached... */
+	/* Get the IO for the next batch of inodes going... */
+	if (iwag->iwalk_fn)
+		xfs_iwalk_lookahead(iwag, *curpp, *has_more);
+
+	/* ...delete cursor but remember the last record we cached... */
 	xfs_iwalk_del_inobt(iwag->tp, curpp, agi_bpp, 0);
 	irec = &iwag->recs[iwag->nr_recs - 1];
 	ASSERT(next_agino >= irec->ir_startino + XFS_INODES_PER_CHUNK);
@@ -565,6 +616,7 @@ xfs_iwalk(
 		.sz_recs	= xfs_iwalk_prefetch(inode_records),
 		.trim_start	= 1,
 		.skip_empty	= 1,
+		.same_ag	= !!(flags & XFS_IWALK_SAME_AG),
 		.pwork		= XFS_PWORK_SINGLE_THREADED,
 		.lastino	= NULLFSINO,
 	};
@@ -677,6 +729,8 @@ xfs_iwalk_threaded(
 		iwag->startino = startino;
 		iwag->sz_recs = xfs_iwalk_prefetch(inode_records);
 		iwag->lastino = NULLFSINO;
+		/* every AG gets its own worker */
+		iwag->same_ag = 1;
 		xfs_pwork_queue(&pctl, &iwag->pwork);
 		startino = XFS_AGINO_TO_INO(mp, pag->pag_agno + 1, 0);
 		if (flags & XFS_INOBT_WALK_SAME_AG)
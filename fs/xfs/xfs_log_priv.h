@@ -242,14 +242,37 @@ struct xfs_cil_ctx {
 	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
 	struct xlog_in_core	*commit_iclog;
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
-	int			nvecs;		/* number of regions */
-	int			space_used;	/* aggregate size of regions */
+	atomic_t		space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* commit order of log items */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct list_head	iclog_entry;
 	struct list_head	committing;	/* ctx committing list */
 	struct work_struct	discard_endio_work;
 	struct work_struct	push_work;
+	cpumask_t		cil_pcpmask;	/* CPUs with per-cpu CIL state */
+};
+
+/*
+ * Per-cpu CIL tracking items.
+ *
+ * Transaction commits insert their log items, busy extents and log space usage
+ * into the CIL structure of the CPU they are running on so that concurrent
+ * commits do not contend on a shared lock. The per-cpu state is aggregated
+ * into the CIL context at push time, while the context lock is held
+ * exclusively and no commits can be running.
+ *
+ * @space_used is the space consumed by commits on this CPU during the current
+ * context, of which @space_folded has already been added to the context's
+ * space_used counter. @space_reserved is the iclog header reservation stolen
+ * for the checkpoint ticket by commits on this CPU.
+ */
+struct xlog_cil_pcp {
+	int32_t			space_used;
+	int32_t			space_folded;
+	uint32_t		space_reserved;
+	struct list_head	busy_extents;
+	struct list_head	log_items;
 };
 
 /*
@@ -270,8 +293,8 @@ struct xfs_cil_ctx {
  */
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xlog_cil_pcp __percpu *xc_pcp;
 	struct workqueue_struct	*xc_push_wq;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
@@ -287,6 +310,9 @@ struct xfs_cil {
 	wait_queue_head_t	xc_push_wait;	/* background push throttle */
 } ____cacheline_aligned_in_smp;
 
+/* xc_flags bit values */
+#define	XLOG_CIL_EMPTY		1	/* no commits in the current context */
+
 /*
  * The amount of log space we allow the CIL to aggregate is difficult to size.
  * Whatever we choose, we have to make sure we can get a reservation for the
@@ -376,6 +402,16 @@ struct xfs_cil {
 #define XLOG_CIL_BLOCKING_SPACE_LIMIT(log)	\
 	(XLOG_CIL_SPACE_LIMIT(log) * 2)
 
+/*
+ * Space consumed on a CPU is only folded into the context's space_used counter
+ * once it exceeds this share of the background push limit, so that commits
+ * don't bounce the counter cacheline between CPUs. Once the context is over the
+ * background push limit, the counter is updated on every commit so that the
+ * blocking limit is accurately enforced.
+ */
+#define XLOG_CIL_PCP_SPACE(log)	\
+	(XLOG_CIL_SPACE_LIMIT(log) / num_online_cpus())
+
 /*
  * ticket grant locks, queues and accounting have their own cachlines
  * as these are quite hot and can be operated on concurrently.
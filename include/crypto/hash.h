@@ -162,6 +162,9 @@ struct shash_desc {
 
 #define HASH_MAX_STATESIZE	512
 
+/* Largest mb_max_msgs an shash_alg may set, see crypto_shash_finup_mb() */
+#define HASH_MAX_MB_MSGS	2
+
 #define SHASH_DESC_ON_STACK(shash, ctx)					     \
 	char __##shash##_desc[sizeof(struct shash_desc) + HASH_MAX_DESCSIZE] \
 		__aligned(__alignof__(struct shash_desc));		     \
@@ -173,6 +176,12 @@ struct shash_desc {
  * @update: see struct ahash_alg
  * @final: see struct ahash_alg
  * @finup: see struct ahash_alg
+ * @finup_mb: **[optional]** Multi-buffer finup.  Finish hashing @num_msgs
+ *	      messages of @len bytes each, all continuing from the state in
+ *	      @desc, and write their digests to @outs.  @num_msgs is between 2
+ *	      and @mb_max_msgs.  May return -EOPNOTSUPP if the messages can't
+ *	      be done together right now, e.g. if SIMD is not usable, in which
+ *	      case the API hashes them one at a time instead.
  * @digest: see struct ahash_alg
  * @export: see struct ahash_alg
  * @import: see struct ahash_alg
@@ -193,6 +202,8 @@ struct shash_desc {
  * @descsize: Size of the operational state for the message digest. This state
  * 	      size is the memory size that needs to be allocated for
  *	      shash_desc.__ctx
+ * @mb_max_msgs: Maximum number of messages @finup_mb can hash at once, at most
+ *		 HASH_MAX_MB_MSGS.  Set to 1 by the API if @finup_mb is NULL.
  * @base: internally used
  */
 struct shash_alg {
@@ -202,6 +213,9 @@ struct shash_alg {
 	int (*final)(struct shash_desc *desc, u8 *out);
 	int (*finup)(struct shash_desc *desc, const u8 *data,
 		     unsigned int len, u8 *out);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
 	int (*digest)(struct shash_desc *desc, const u8 *data,
 		      unsigned int len, u8 *out);
 	int (*export)(struct shash_desc *desc, void *out);
@@ -212,6 +226,7 @@ struct shash_alg {
 	void (*exit_tfm)(struct crypto_shash *tfm);
 
 	unsigned int descsize;
+	unsigned int mb_max_msgs;
 
 	/* These fields must match hash_alg_common. */
 	unsigned int digestsize
@@ -833,6 +848,22 @@ static inline void *shash_desc_ctx(struct shash_desc *desc)
 	return desc->__ctx;
 }
 
+/**
+ * crypto_shash_mb_max_msgs() - obtain max messages for multi-buffer hashing
+ * @tfm: hash transformation object
+ *
+ * Return the largest number of messages crypto_shash_finup_mb() will hash in
+ * parallel.  Callers may pass more, but then the extra messages are hashed one
+ * at a time, so there is no point in batching beyond this.
+ *
+ * Return: the maximum number of interleaved messages, 1 if the algorithm has
+ *	   no multi-buffer support
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return crypto_shash_alg(tfm)->mb_max_msgs;
+}
+
 /**
  * crypto_shash_setkey() - set key for message digest
  * @tfm: cipher handle
@@ -996,6 +1027,28 @@ int crypto_shash_final(struct shash_desc *desc, u8 *out);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_finup_mb() - finish hashing several equal-length messages
+ * @desc: hash state that all the messages continue from, e.g. after hashing a
+ *	  common salt.  Its contents are undefined on return.
+ * @data: the remaining data of each message
+ * @len: length of each buffer in @data, in bytes
+ * @outs: output buffer for each message's digest
+ * @num_msgs: number of messages, i.e. the number of entries in @data and @outs
+ *
+ * The result is the same as calling crypto_shash_finup() on a copy of @desc
+ * for each message, but algorithms that implement multi-buffer hashing
+ * interleave the messages, which is much faster on CPUs where the hash
+ * instructions have more latency than throughput.  See
+ * crypto_shash_mb_max_msgs() for how many messages are worth passing.
+ *
+ * Context: Any context.
+ * Return: 0 on success; < 0 if an error occurred
+ */
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs);
+
 static inline void shash_desc_zero(struct shash_desc *desc)
 {
 	memzero_explicit(desc,
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_ALLOC_SAMPLE_H
+#define _LINUX_ALLOC_SAMPLE_H
+
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/mm_types.h>
+
+struct kmem_cache;
+
+#ifdef CONFIG_ALLOC_SAMPLE
+/*
+ * Sampled allocation profiling: one in alloc_sample.rate slab and page
+ * allocations has its stack recorded, and the bytes are aggregated per
+ * allocation stack in /proc/alloc_samples. Frees of sampled memory are
+ * found through a bitmap with a bit per page frame that held a sample.
+ */
+DECLARE_STATIC_KEY_FALSE(alloc_sample_key);
+DECLARE_PER_CPU(long, alloc_sample_countdown);
+extern unsigned long *alloc_sample_pfns;
+extern unsigned long alloc_sample_nr_pfns;
+
+void __alloc_sample_slab(struct kmem_cache *s, void *object);
+void __alloc_sample_slab_free(struct kmem_cache *s, void *object);
+void __alloc_sample_pages(struct page *page, unsigned int order);
+void __alloc_sample_slab_page(struct page *page, unsigned int order);
+void __alloc_sample_pages_free(struct page *page, unsigned int order);
+
+static __always_inline bool alloc_sample_tick(void)
+{
+	if (!static_branch_unlikely(&alloc_sample_key))
+		return false;
+
+	return this_cpu_dec_return(alloc_sample_countdown) <= 0;
+}
+
+static __always_inline bool alloc_sample_pfn_marked(unsigned long pfn)
+{
+	return pfn < alloc_sample_nr_pfns && test_bit(pfn, alloc_sample_pfns);
+}
+
+static inline void alloc_sample_slab(struct kmem_cache *s, void *object)
+{
+	if (unlikely(alloc_sample_tick()) && object)
+		__alloc_sample_slab(s, object);
+}
+
+static inline void alloc_sample_slab_free(struct kmem_cache *s, void *object)
+{
+	if (static_branch_unlikely(&alloc_sample_key) &&
+	    unlikely(alloc_sample_pfn_marked(PHYS_PFN(__pa(object)))))
+		__alloc_sample_slab_free(s, object);
+}
+
+static inline void alloc_sample_pages(struct page *page, unsigned int order)
+{
+	if (unlikely(alloc_sample_tick()))
+		__alloc_sample_pages(page, order);
+}
+
+static inline void alloc_sample_pages_free(struct page *page,
+					   unsigned int order)
+{
+	if (static_branch_unlikely(&alloc_sample_key))
+		__alloc_sample_pages_free(page, order);
+}
+
+static inline void alloc_sample_slab_page(struct page *page,
+					  unsigned int order)
+{
+	if (static_branch_unlikely(&alloc_sample_key) &&
+	    unlikely(alloc_sample_pfn_marked(page_to_pfn(page))))
+		__alloc_sample_slab_page(page, order);
+}
+#else
+static inline void alloc_sample_slab(struct kmem_cache *s, void *object)
+{
+}
+
+static inline void alloc_sample_slab_free(struct kmem_cache *s, void *object)
+{
+}
+
+static inline void alloc_sample_pages(struct page *page, unsigned int order)
+{
+}
+
+static inline void alloc_sample_pages_free(struct page *page,
+					   unsigned int order)
+{
+}
+
+static inline void alloc_sample_slab_page(struct page *page,
+					  unsigned int order)
+{
+}
+#endif /* CONFIG_ALLOC_SAMPLE */
+
+#endif /* _LINUX_ALLOC_SAMPLE_H */
@@ -177,6 +177,7 @@ struct backing_dev_info {
 	unsigned int capabilities; /* Device capabilities */
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
+	unsigned long bw_period; /* write bandwidth averaging period, jiffies */
 
 	/*
 	 * Sum of avg_write_bw of wbs with dirty inodes.  > 0 if there are
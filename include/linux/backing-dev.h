@@ -106,6 +106,10 @@ static inline unsigned long wb_stat_error(void)
 
 int bdi_set_min_ratio(struct backing_dev_info *bdi, unsigned int min_ratio);
 int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
+int bdi_set_bw_period(struct backing_dev_info *bdi, unsigned int msecs);
+
+/* default write bandwidth averaging period, must be a power of two */
+#define BDI_BW_PERIOD		roundup_pow_of_two(3 * HZ)
 
 /*
  * Flags in backing_dev_info::capability
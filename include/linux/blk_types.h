@@ -253,6 +253,12 @@ struct bio {
 #endif
 	};
 
+	/*
+	 * DMA mapping of the bvec array bi_io_vec points into, cached by the
+	 * driver of bi_bdev through ->dma_map.
+	 */
+	void			*bi_dma_tag;
+
 	unsigned short		bi_vcnt;	/* how many bio_vec's */
 
 	/*
@@ -133,7 +133,14 @@ struct request {
 	struct bio *bio;
 	struct bio *biotail;
 
-	struct list_head queuelist;
+	/*
+	 * rq_next links the request into an io_comp_batch once the driver
+	 * completed it, queuelist is no longer used at that point.
+	 */
+	union {
+		struct list_head queuelist;
+		struct request *rq_next;
+	};
 
 	/*
 	 * The hash is used inside the scheduler, and killed once the
@@ -1200,12 +1207,31 @@ void blk_mark_disk_dead(struct gendisk *disk);
  */
 struct blk_plug {
 	struct list_head mq_list; /* blk-mq requests */
+
+	/* if nr_ios is > 1, we can batch tag/rq allocations */
+	struct request *cached_rq;
+	unsigned short nr_ios;
+
 	struct list_head cb_list; /* md requires an unplug callback */
 	unsigned short rq_count;
 	bool multiple_queues;
 	bool nowait;
 };
 
+/*
+ * io_comp_batch collects the requests completed by a driver in one pass
+ * over its completion queue, so that they can be ended together through
+ * blk_mq_end_request_batch(). Requests are added by blk_mq_add_to_batch(),
+ * ->complete() ends the whole batch and is set by the driver.
+ */
+struct io_comp_batch {
+	struct request *req_list;
+	bool need_ts;
+	void (*complete)(struct io_comp_batch *);
+};
+
+#define DEFINE_IO_COMP_BATCH(name)	struct io_comp_batch name = { }
+
 struct blk_plug_cb;
 typedef void (*blk_plug_cb_fn)(struct blk_plug_cb *, bool);
 struct blk_plug_cb {
@@ -1216,6 +1242,7 @@ struct blk_plug_cb {
 extern struct blk_plug_cb *blk_check_plugged(blk_plug_cb_fn unplug,
 					     void *data, int size);
 extern void blk_start_plug(struct blk_plug *);
+extern void blk_start_plug_nr_ios(struct blk_plug *, unsigned short);
 extern void blk_finish_plug(struct blk_plug *);
 extern void blk_flush_plug_list(struct blk_plug *, bool);
 
@@ -1241,7 +1268,8 @@ static inline bool blk_needs_flush_plug(struct task_struct *tsk)
 
 	return plug &&
 		 (!list_empty(&plug->mq_list) ||
-		 !list_empty(&plug->cb_list));
+		 !list_empty(&plug->cb_list) ||
+		 plug->cached_rq);
 }
 
 int blkdev_issue_flush(struct block_device *bdev);
@@ -1254,6 +1282,11 @@ static inline void blk_start_plug(struct blk_plug *plug)
 {
 }
 
+static inline void blk_start_plug_nr_ios(struct blk_plug *plug,
+					 unsigned short nr_ios)
+{
+}
+
 static inline void blk_finish_plug(struct blk_plug *plug)
 {
 }
@@ -1872,8 +1905,33 @@ struct block_device_operations {
 	 * driver.
 	 */
 	int (*alternative_gpt_sector)(struct gendisk *disk, sector_t *sector);
+
+	/*
+	 * Map the pages of @bvec for DMA once so that bios whose bi_io_vec
+	 * points into @bvec can be issued without mapping them on every IO.
+	 * The returned tag is passed in bio->bi_dma_tag and must be released
+	 * with ->dma_unmap once no more IO uses @bvec.
+	 */
+	void *(*dma_map)(struct block_device *bdev, struct bio_vec *bvec,
+			 int nr_vecs);
+	void (*dma_unmap)(struct block_device *bdev, void *dma_tag);
 };
 
+static inline void *bdev_dma_map(struct block_device *bdev,
+				 struct bio_vec *bvec, int nr_vecs)
+{
+	const struct block_device_operations *fops = bdev->bd_disk->fops;
+
+	if (!fops->dma_map)
+		return ERR_PTR(-EOPNOTSUPP);
+	return fops->dma_map(bdev, bvec, nr_vecs);
+}
+
+static inline void bdev_dma_unmap(struct block_device *bdev, void *dma_tag)
+{
+	bdev->bd_disk->fops->dma_unmap(bdev, dma_tag);
+}
+
 #ifdef CONFIG_COMPAT
 extern int blkdev_compat_ptr_ioctl(struct block_device *, fmode_t,
 				      unsigned int, unsigned long);
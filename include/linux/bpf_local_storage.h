@@ -14,7 +14,7 @@
 #include <linux/types.h>
 #include <uapi/linux/btf.h>
 
-#define BPF_LOCAL_STORAGE_CACHE_SIZE	16
+#define BPF_LOCAL_STORAGE_CACHE_SIZE	CONFIG_BPF_LOCAL_STORAGE_CACHE_SIZE
 
 struct bpf_local_storage_map_bucket {
 	struct hlist_head list;
@@ -48,6 +48,8 @@ struct bpf_local_storage_map {
 	 * multiple buckets to improve contention.
 	 */
 	struct bpf_local_storage_map_bucket *buckets;
+	/* Elements are all elem_size, they come from their own slab */
+	struct kmem_cache *selem_cache;
 	u32 bucket_log;
 	u16 elem_size;
 	u16 cache_idx;
@@ -100,8 +102,6 @@ struct bpf_local_storage {
 	container_of((_SDATA), struct bpf_local_storage_elem, sdata)
 #define SDATA(_SELEM) (&(_SELEM)->sdata)
 
-#define BPF_LOCAL_STORAGE_CACHE_SIZE	16
-
 struct bpf_local_storage_cache {
 	spinlock_t idx_lock;
 	u64 idx_usage_counts[BPF_LOCAL_STORAGE_CACHE_SIZE];
@@ -152,6 +152,9 @@ struct bpf_local_storage_elem *
 bpf_selem_alloc(struct bpf_local_storage_map *smap, void *owner, void *value,
 		bool charge_mem);
 
+void bpf_selem_free(struct bpf_local_storage_map *smap,
+		    struct bpf_local_storage_elem *selem);
+
 int
 bpf_local_storage_alloc(void *owner,
 			struct bpf_local_storage_map *smap,
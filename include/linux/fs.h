@@ -31,6 +31,7 @@
 #include <linux/uidgid.h>
 #include <linux/lockdep.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
 #include <linux/delayed_call.h>
 #include <linux/uuid.h>
@@ -322,6 +323,8 @@ enum rw_hint {
 #define IOCB_NOIO		(1 << 20)
 /* can use bio alloc cache */
 #define IOCB_ALLOC_CACHE	(1 << 21)
+/* iocb->private is the ->dma_map tag of the bvecs of the iter */
+#define IOCB_DMA_TAG		(1 << 22)
 
 struct kiocb {
 	struct file		*ki_filp;
@@ -952,8 +955,22 @@ struct file_ra_state {
 	unsigned int ra_pages;
 	unsigned int mmap_miss;
 	loff_t prev_pos;
+
+	/* mmap stride detection, see do_sync_mmap_readahead() */
+	pgoff_t run_start;
+	unsigned int run_len;
+	unsigned int prev_run_len;
+	long stride;
+	unsigned int stride_hits;
+
+	/* page cache lookups through this file, shown in fdinfo */
+	unsigned int nr_hits;
+	unsigned int nr_misses;
 };
 
+/* Strides seen this many times in a row are followed by mmap readahead */
+#define RA_STRIDE_MIN_HITS	2
+
 /*
  * Check if @index falls in the readahead windows.
  */
@@ -1587,6 +1604,11 @@ struct super_block {
 	struct rcu_head		rcu;
 	struct work_struct	destroy_work;
 
+	/* all dentries, and the unused negative ones, see fs/dcache.c */
+	struct percpu_counter	s_nr_dentry;
+	struct percpu_counter	s_nr_dentry_negative;
+	struct work_struct	s_dentry_trim_work;
+
 	struct mutex		s_sync_lock;	/* sync serialisation lock */
 
 	/*
@@ -1999,6 +2021,7 @@ struct dir_context {
 #define COPY_FILE_SPLICE		(1 << 0)
 
 struct iov_iter;
+struct io_uring_cmd;
 
 struct file_operations {
 	struct module *owner;
@@ -2040,6 +2063,7 @@ struct file_operations {
 				   struct file *file_out, loff_t pos_out,
 				   loff_t len, unsigned int remap_flags);
 	int (*fadvise)(struct file *, loff_t, loff_t, int);
+	int (*uring_cmd)(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
 } __randomize_layout;
 
 struct inode_operations {
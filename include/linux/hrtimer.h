@@ -195,6 +195,10 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @nr_reprograms:	Total number of clock event device reprograms
+ * @nr_expired:		Total number of expired hrtimers
+ * @nr_coalesced:	Total number of hrtimer enqueues which did not need a
+ *			reprogram because the armed event is in their slack
  * @softirq_expiry_lock: Lock which is taken while softirq based hrtimer are
  *			 expired
  * @timer_waiters:	A hrtimer_cancel() invocation waits for the timer
@@ -226,6 +230,9 @@ struct hrtimer_cpu_base {
 	unsigned short			nr_hangs;
 	unsigned int			max_hang_time;
 #endif
+	unsigned int			nr_reprograms;
+	unsigned int			nr_expired;
+	unsigned int			nr_coalesced;
 #ifdef CONFIG_PREEMPT_RT
 	spinlock_t			softirq_expiry_lock;
 	atomic_t			timer_waiters;
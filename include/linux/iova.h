@@ -25,13 +25,18 @@ struct iova {
 struct iova_magazine;
 struct iova_cpu_rcache;
 
-#define IOVA_RANGE_CACHE_MAX_SIZE 6	/* log of max cached IOVA range size (in pages) */
-#define MAX_GLOBAL_MAGS 32	/* magazines per bin */
+#define IOVA_RANGE_CACHE_MAX_SIZE 10	/* log of max cacheable IOVA range size (in pages) */
+#define IOVA_RANGE_CACHE_DEFAULT_SIZE 6	/* log of max IOVA range size cached by default */
+#define MAX_GLOBAL_MAGS 32	/* magazines per bin and node */
 
-struct iova_rcache {
+struct iova_depot {
 	spinlock_t lock;
-	unsigned long depot_size;
-	struct iova_magazine *depot[MAX_GLOBAL_MAGS];
+	unsigned long size;
+	struct iova_magazine *mags[MAX_GLOBAL_MAGS];
+} ____cacheline_aligned_in_smp;
+
+struct iova_rcache {
+	struct iova_depot *depots;	/* one per NUMA node */
 	struct iova_cpu_rcache __percpu *cpu_rcaches;
 };
 
@@ -43,10 +48,11 @@ typedef void (* iova_flush_cb)(struct iova_domain *domain);
 /* Destructor for per-entry data */
 typedef void (* iova_entry_dtor)(unsigned long data);
 
-/* Number of entries per Flush Queue */
+/* Default number of entries per Flush Queue, must be a power of two */
 #define IOVA_FQ_SIZE	256
+#define IOVA_FQ_MAX_SIZE	32768
 
-/* Timeout (in ms) after which entries are flushed from the Flush-Queue */
+/* Default timeout (in ms) after which entries are flushed from the Flush-Queue */
 #define IOVA_FQ_TIMEOUT	10
 
 /* Flush Queue entry for defered flushing */
@@ -59,8 +65,9 @@ struct iova_fq_entry {
 
 /* Per-CPU Flush Queue structure */
 struct iova_fq {
-	struct iova_fq_entry entries[IOVA_FQ_SIZE];
+	struct iova_fq_entry *entries;
 	unsigned head, tail;
+	unsigned mod_mask;
 	spinlock_t lock;
 };
 
@@ -75,6 +82,7 @@ struct iova_domain {
 	unsigned long	dma_32bit_pfn;
 	unsigned long	max32_alloc_size; /* Size of last failed allocation */
 	struct iova_fq __percpu *fq;	/* Flush Queue */
+	unsigned int	fq_timeout;	/* Flush Queue timeout in ms */
 
 	atomic64_t	fq_flush_start_cnt;	/* Number of TLB flushes that
 						   have been started */
@@ -84,6 +92,8 @@ struct iova_domain {
 
 	struct iova	anchor;		/* rbtree lookup anchor */
 	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
+	unsigned int	rcache_max_size;	/* log of max cached range size,
+						   rcaches above it are unused */
 
 	iova_flush_cb	flush_cb;	/* Call-Back function to flush IOMMU
 					   TLBs */
@@ -154,7 +164,8 @@ struct iova *reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo,
 void init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn);
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor);
+			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor,
+			  unsigned int fq_size, unsigned int fq_timeout);
 struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn);
 void put_iova_domain(struct iova_domain *iovad);
 #else
@@ -218,7 +229,9 @@ static inline void init_iova_domain(struct iova_domain *iovad,
 
 static inline int init_iova_flush_queue(struct iova_domain *iovad,
 					iova_flush_cb flush_cb,
-					iova_entry_dtor entry_dtor)
+					iova_entry_dtor entry_dtor,
+					unsigned int fq_size,
+					unsigned int fq_timeout)
 {
 	return -ENODEV;
 }
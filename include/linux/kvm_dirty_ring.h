@@ -2,6 +2,7 @@
 #define KVM_DIRTY_RING_H
 
 #include <linux/kvm.h>
+#include <linux/mutex.h>
 
 /**
  * kvm_dirty_ring: KVM internal dirty ring structure
@@ -17,6 +18,10 @@
  *               to allow userspace to harvest all the dirty pages
  * @dirty_gfns:  the array to keep the dirty gfns
  * @index:       index of this dirty ring
+ * @reset_lock:  serializes the resets of this ring, which can come from
+ *               both KVM_RESET_DIRTY_RINGS and KVM_RESET_DIRTY_RING
+ * @soft_full_eventfd: signalled when the ring reaches @soft_limit, so that
+ *               userspace can harvest it without waiting for the vcpu exit
  */
 struct kvm_dirty_ring {
 	u32 dirty_index;
@@ -25,6 +30,8 @@ struct kvm_dirty_ring {
 	u32 soft_limit;
 	struct kvm_dirty_gfn *dirty_gfns;
 	int index;
+	struct mutex reset_lock;
+	struct eventfd_ctx *soft_full_eventfd;
 };
 
 #if (KVM_DIRTY_LOG_PAGE_OFFSET == 0)
@@ -69,6 +76,12 @@ static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
 {
 }
 
+static inline int kvm_dirty_ring_set_eventfd(struct kvm_dirty_ring *ring,
+					     int fd)
+{
+	return -EINVAL;
+}
+
 static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
 {
 	return true;
@@ -81,7 +94,7 @@ int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size);
 struct kvm_dirty_ring *kvm_dirty_ring_get(struct kvm *kvm);
 
 /*
- * called with kvm->slots_lock held, returns the number of
+ * called with kvm->slots_lock or kvm->srcu held, returns the number of
  * processed pages.
  */
 int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
@@ -98,6 +111,9 @@ struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
 void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
 bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring);
 
+/* fd < 0 detaches the eventfd, called with vcpu->mutex held */
+int kvm_dirty_ring_set_eventfd(struct kvm_dirty_ring *ring, int fd);
+
 #endif /* KVM_DIRTY_LOG_PAGE_OFFSET == 0 */
 
 #endif	/* KVM_DIRTY_RING_H */
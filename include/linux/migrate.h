@@ -183,4 +183,20 @@ static inline int next_demotion_node(int node)
 
 #endif /* CONFIG_MIGRATION */
 
+#ifdef CONFIG_NUMA
+/*
+ * Memory on nodes without CPUs (PMEM, CXL) is treated as a slow tier, from
+ * which hot pages get promoted by NUMA balancing in memory tiering mode.
+ */
+static inline bool node_is_toptier(int node)
+{
+	return node_state(node, N_CPU);
+}
+#else
+static inline bool node_is_toptier(int node)
+{
+	return true;
+}
+#endif
+
 #endif /* _LINUX_MIGRATE_H */
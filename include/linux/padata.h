@@ -17,6 +17,7 @@
 #include <linux/workqueue.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/kobject.h>
 
 #define PADATA_CPU_SERIAL   0x01
@@ -26,6 +27,7 @@
  * struct padata_priv - Represents one job
  *
  * @list: List entry, to attach to the padata lists.
+ * @llnode: Entry in the pending list of a reorder queue.
  * @pd: Pointer to the internal control structure.
  * @cb_cpu: Callback cpu for serializatioon.
  * @seq_nr: Sequence number of the parallelized data object.
@@ -35,6 +37,7 @@
  */
 struct padata_priv {
 	struct list_head	list;
+	struct llist_node	llnode;
 	struct parallel_data	*pd;
 	int			cb_cpu;
 	unsigned int		seq_nr;
@@ -54,6 +57,17 @@ struct padata_list {
 	spinlock_t              lock;
 };
 
+/**
+ * struct padata_reorder_list - one per CPU, for the objects hashed to it
+ *
+ * @pending: Objects handed to padata_do_serial, added without locking.
+ * @list: Objects sorted by sequence number, only touched under pd->lock.
+ */
+struct padata_reorder_list {
+	struct llist_head	pending;
+	struct list_head	list;
+};
+
 /**
 * struct padata_serial_queue - The percpu padata serial queue
 *
@@ -95,7 +109,7 @@ struct padata_cpumask {
  */
 struct parallel_data {
 	struct padata_shell		*ps;
-	struct padata_list		__percpu *reorder_list;
+	struct padata_reorder_list	__percpu *reorder_list;
 	struct padata_serial_queue	__percpu *squeue;
 	refcount_t			refcnt;
 	unsigned int			seq_nr;
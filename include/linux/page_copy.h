@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_PAGE_COPY_H
+#define _LINUX_PAGE_COPY_H
+
+#include <linux/types.h>
+
+struct page;
+
+#ifdef CONFIG_PAGE_COPY_DMA
+#include <linux/dmaengine.h>
+
+/* Most pages in flight on a DMA channel for one batch */
+#define PAGE_COPY_BATCH_MAX	512
+
+struct page_copy_entry;
+
+/*
+ * A batch of page copies handed to a DMA channel. Without a channel, e.g.
+ * because DMA offload is disabled or the batch is too small to be worth it,
+ * page_copy_batch_add() leaves each copy to the caller.
+ */
+struct page_copy_batch {
+	struct dma_chan *chan;
+	struct page_copy_entry *entries;
+	unsigned int nr;
+	unsigned int max;
+	dma_cookie_t cookie;
+	bool failed;
+};
+
+void page_copy_batch_init(struct page_copy_batch *batch, unsigned int nr);
+bool page_copy_batch_add(struct page_copy_batch *batch, struct page *dst,
+			 struct page *src);
+void page_copy_batch_finish(struct page_copy_batch *batch);
+#else
+struct page_copy_batch {
+};
+
+static inline void page_copy_batch_init(struct page_copy_batch *batch,
+					unsigned int nr)
+{
+}
+
+static inline bool page_copy_batch_add(struct page_copy_batch *batch,
+				       struct page *dst, struct page *src)
+{
+	return false;
+}
+
+static inline void page_copy_batch_finish(struct page_copy_batch *batch)
+{
+}
+#endif /* CONFIG_PAGE_COPY_DMA */
+
+#endif /* _LINUX_PAGE_COPY_H */
@@ -46,7 +46,12 @@ enum psi_res {
 	PSI_IO,
 	PSI_MEM,
 	PSI_CPU,
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+	PSI_IRQ,
+	NR_PSI_RESOURCES = 4,
+#else
 	NR_PSI_RESOURCES = 3,
+#endif
 };
 
 /*
@@ -62,9 +67,17 @@ enum psi_states {
 	PSI_MEM_FULL,
 	PSI_CPU_SOME,
 	PSI_CPU_FULL,
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+	/* Time the current task was interrupted; there is no SOME */
+	PSI_IRQ_FULL,
+#endif
 	/* Only per-CPU, to weigh the CPU in the global average: */
 	PSI_NONIDLE,
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+	NR_PSI_STATES = 8,
+#else
 	NR_PSI_STATES = 7,
+#endif
 };
 
 enum psi_aggregators {
@@ -143,6 +156,12 @@ struct psi_trigger {
 };
 
 struct psi_group {
+	/*
+	 * Whether stall times are accounted. Task counts are kept up to
+	 * date regardless, so that accounting can resume at any time.
+	 */
+	bool enabled;
+
 	/* Protects data used by the aggregator */
 	struct mutex avgs_lock;
 
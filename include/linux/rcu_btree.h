@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_RCU_BTREE_H
+#define _LINUX_RCU_BTREE_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+#include <linux/gfp.h>
+
+/**
+ * DOC: RCU-safe B+tree
+ *
+ * An ordered map from unsigned long keys to pointers, laid out as a B+tree
+ * whose nodes span a few cachelines, so that a lookup touches one node per
+ * level instead of one per key.
+ *
+ * Nodes are never modified once they are reachable from the root. Writers
+ * copy the path they change, publish the new root with rcu_assign_pointer()
+ * and free the replaced nodes after a grace period. Lookups can therefore run
+ * under rcu_read_lock() concurrently with a writer and see either the old or
+ * the new tree, never a mix of both.
+ *
+ * Writers must be serialized by the caller. Since an update allocates up to
+ * two nodes per level, callers that can't sleep in the update itself reserve
+ * them beforehand with rcu_btree_preallocate().
+ */
+
+#define RCU_BTREE_SLOTS		14
+#define RCU_BTREE_MAX_HEIGHT	16
+
+struct rcu_btree_node;
+
+struct rcu_btree {
+	struct rcu_btree_node __rcu *root;
+	/* the following are only used by writers */
+	unsigned int height;
+	unsigned int nr_spare;
+	struct rcu_btree_node *spare;
+};
+
+#define RCU_BTREE_INIT(name)	{ .root = NULL }
+
+static inline void rcu_btree_init(struct rcu_btree *tree)
+{
+	*tree = (struct rcu_btree)RCU_BTREE_INIT(*tree);
+}
+
+static inline bool rcu_btree_empty(struct rcu_btree *tree)
+{
+	return !rcu_access_pointer(tree->root);
+}
+
+void *rcu_btree_lookup_ge(struct rcu_btree *tree, unsigned long *key);
+int rcu_btree_preallocate(struct rcu_btree *tree, unsigned int nr_ops,
+			  gfp_t gfp);
+int rcu_btree_insert(struct rcu_btree *tree, unsigned long key, void *entry,
+		     gfp_t gfp);
+int rcu_btree_erase(struct rcu_btree *tree, unsigned long key, gfp_t gfp);
+void rcu_btree_destroy(struct rcu_btree *tree);
+
+#endif /* _LINUX_RCU_BTREE_H */
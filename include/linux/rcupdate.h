@@ -38,6 +38,14 @@
 
 /* Exported common interfaces */
 void call_rcu(struct rcu_head *head, rcu_callback_t func);
+#ifdef CONFIG_RCU_LAZY
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func);
+#else
+static inline void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	call_rcu(head, func);
+}
+#endif
 void rcu_barrier_tasks(void);
 void rcu_barrier_tasks_rude(void);
 void synchronize_rcu(void);
@@ -161,10 +169,16 @@ static inline void rcu_nocb_flush_deferred_wakeup(void) { }
 	} while (0)
 void call_rcu_tasks(struct rcu_head *head, rcu_callback_t func);
 void synchronize_rcu_tasks(void);
+unsigned long get_state_synchronize_rcu_tasks(void);
+unsigned long start_poll_synchronize_rcu_tasks(void);
+bool poll_state_synchronize_rcu_tasks(unsigned long oldstate);
 # else
 # define rcu_tasks_classic_qs(t, preempt) do { } while (0)
 # define call_rcu_tasks call_rcu
 # define synchronize_rcu_tasks synchronize_rcu
+# define get_state_synchronize_rcu_tasks get_state_synchronize_rcu
+# define start_poll_synchronize_rcu_tasks start_poll_synchronize_rcu
+# define poll_state_synchronize_rcu_tasks poll_state_synchronize_rcu
 # endif
 
 # ifdef CONFIG_TASKS_TRACE_RCU
@@ -199,6 +213,9 @@ void exit_tasks_rcu_finish(void);
 #define rcu_note_voluntary_context_switch(t) do { } while (0)
 #define call_rcu_tasks call_rcu
 #define synchronize_rcu_tasks synchronize_rcu
+#define get_state_synchronize_rcu_tasks get_state_synchronize_rcu
+#define start_poll_synchronize_rcu_tasks start_poll_synchronize_rcu
+#define poll_state_synchronize_rcu_tasks poll_state_synchronize_rcu
 static inline void exit_tasks_rcu_start(void) { }
 static inline void exit_tasks_rcu_finish(void) { }
 #endif /* #else #ifdef CONFIG_TASKS_RCU_GENERIC */
@@ -86,6 +86,9 @@ static inline void rcu_read_unlock_trace(void)
 void call_rcu_tasks_trace(struct rcu_head *rhp, rcu_callback_t func);
 void synchronize_rcu_tasks_trace(void);
 void rcu_barrier_tasks_trace(void);
+unsigned long get_state_synchronize_rcu_tasks_trace(void);
+unsigned long start_poll_synchronize_rcu_tasks_trace(void);
+bool poll_state_synchronize_rcu_tasks_trace(unsigned long oldstate);
 #else
 /*
  * The BPF JIT forms these addresses even when it doesn't call these
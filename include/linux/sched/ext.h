@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_SCHED_EXT_H
+#define _LINUX_SCHED_EXT_H
+
+#ifdef CONFIG_SCHED_CLASS_EXT
+
+#include <linux/list.h>
+#include <linux/rhashtable-types.h>
+#include <linux/spinlock_types.h>
+#include <linux/time64.h>
+
+struct task_struct;
+
+#define SCX_OPS_NAME_LEN	128
+#define SCX_EXIT_MSG_LEN	1024
+
+/* Slice of a task dispatched without one */
+#define SCX_SLICE_DFL		(20 * NSEC_PER_MSEC)
+
+/*
+ * Dispatch queue IDs. The top bit marks the queues built into the kernel,
+ * the other IDs are free for the BPF scheduler to create.
+ */
+enum scx_dsq_id_flags {
+	SCX_DSQ_FLAG_BUILTIN	= 1LLU << 63,
+
+	SCX_DSQ_INVALID		= SCX_DSQ_FLAG_BUILTIN | 0,
+	/* shared by all CPUs, consumed after each CPU's local queue */
+	SCX_DSQ_GLOBAL		= SCX_DSQ_FLAG_BUILTIN | 1,
+	/* the local queue of the CPU the task is queued on */
+	SCX_DSQ_LOCAL		= SCX_DSQ_FLAG_BUILTIN | 2,
+};
+
+/* Flags of ops.enqueue() and scx_bpf_dispatch() */
+enum scx_enq_flags {
+	SCX_ENQ_WAKEUP		= 1LLU << 0,
+	/* queue at the head instead of the tail of the dispatch queue */
+	SCX_ENQ_HEAD		= 1LLU << 1,
+	/* preempt the current task of the CPU the local queue belongs to */
+	SCX_ENQ_PREEMPT		= 1LLU << 32,
+};
+
+/* Flags of ops.dequeue() */
+enum scx_deq_flags {
+	SCX_DEQ_SLEEP		= 1LLU << 0,
+};
+
+/* Flags of struct sched_ext_ops */
+enum scx_ops_flags {
+	/*
+	 * Only tasks with the SCHED_EXT policy are scheduled by the BPF
+	 * scheduler. Otherwise all SCHED_NORMAL, SCHED_BATCH and SCHED_IDLE
+	 * tasks are too.
+	 */
+	SCX_OPS_SWITCH_PARTIAL	= 1LLU << 0,
+
+	SCX_OPS_ALL_FLAGS	= SCX_OPS_SWITCH_PARTIAL,
+};
+
+enum scx_exit_kind {
+	SCX_EXIT_NONE,
+	SCX_EXIT_DONE,
+	SCX_EXIT_UNREG,		/* unregistered from BPF */
+	SCX_EXIT_ERROR,		/* misbehaviour of the BPF scheduler */
+	SCX_EXIT_ERROR_STALL,	/* a runnable task wasn't run in time */
+};
+
+/* Why the BPF scheduler was disabled, passed to ops.exit() */
+struct scx_exit_info {
+	enum scx_exit_kind	kind;
+	const char		*reason;
+	char			msg[SCX_EXIT_MSG_LEN];
+};
+
+/**
+ * struct sched_ext_ops - operations of a BPF scheduler
+ *
+ * Implemented as BPF struct_ops. All the operations are optional; a BPF
+ * scheduler without any schedules its tasks in FIFO order from the global
+ * dispatch queue.
+ *
+ * The BPF scheduler places runnable tasks on dispatch queues (DSQs) with
+ * scx_bpf_dispatch() from ops.enqueue(), and each CPU runs the tasks of its
+ * local DSQ. When it runs out of them, it takes the first task it can run
+ * from the global DSQ, or else calls ops.dispatch() so that the BPF scheduler
+ * can move tasks from its own DSQs with scx_bpf_consume().
+ */
+struct sched_ext_ops {
+	/*
+	 * Pick the CPU @p should wake up on, @prev_cpu by default. The CPU
+	 * is only a hint: it is overridden if @p can't run there.
+	 */
+	s32 (*select_cpu)(struct task_struct *p, s32 prev_cpu, u64 wake_flags);
+
+	/*
+	 * @p became runnable or used up its slice: it must be dispatched to
+	 * a DSQ with scx_bpf_dispatch() before returning.
+	 */
+	void (*enqueue)(struct task_struct *p, u64 enq_flags);
+
+	/* @p left its DSQ without having been run */
+	void (*dequeue)(struct task_struct *p, u64 deq_flags);
+
+	/*
+	 * @cpu ran out of tasks on its local DSQ: move some there with
+	 * scx_bpf_consume(). @prev is the task that was running, if it is
+	 * scheduled by the BPF scheduler.
+	 */
+	void (*dispatch)(s32 cpu, struct task_struct *prev);
+
+	/* @p starts and stops running on a CPU */
+	void (*running)(struct task_struct *p);
+	void (*stopping)(struct task_struct *p, bool runnable);
+
+	/*
+	 * Called once for every task, when the BPF scheduler is loaded or
+	 * when the task is forked. A task whose init_task() fails stays on
+	 * CFS.
+	 */
+	s32 (*init_task)(struct task_struct *p);
+	void (*exit_task)(struct task_struct *p);
+
+	/* Called when the BPF scheduler is loaded and unloaded */
+	s32 (*init)(void);
+	void (*exit)(struct scx_exit_info *info);
+
+	/* SCX_OPS_* */
+	u64 flags;
+
+	/*
+	 * How long a runnable task may wait to be run before the BPF
+	 * scheduler is disabled. Defaults to and can't exceed 30s.
+	 */
+	u32 timeout_ms;
+
+	char name[SCX_OPS_NAME_LEN];
+};
+
+/* A FIFO of runnable tasks */
+struct scx_dispatch_q {
+	raw_spinlock_t		lock;
+	struct list_head	list;
+	u32			nr;
+	u64			id;
+	struct rhash_head	hash_node;
+	struct rcu_head		rcu;
+};
+
+/* sched_ext_entity.flags */
+enum scx_ent_flags {
+	SCX_TASK_QUEUED		= 1 << 0, /* on the rq of the ext class */
+	SCX_TASK_INITED		= 1 << 1, /* ops.init_task() succeeded */
+	SCX_TASK_ENQ_LOCAL	= 1 << 2, /* moved to the local DSQ of a CPU */
+};
+
+/*
+ * The state of a task for the ext class, embedded in task_struct.
+ *
+ * While @dsq is NULL, @holding_cpu >= 0 says that a CPU took the task off a
+ * shared DSQ and is moving it to its own rq. Dequeueing the task resets it,
+ * so that the CPU knows to give up.
+ */
+struct sched_ext_entity {
+	struct scx_dispatch_q	*dsq;
+	struct list_head	dsq_node;
+	struct list_head	runnable_node;	/* rq->scx.runnable_list */
+	unsigned long		runnable_at;
+	u32			flags;
+	s32			holding_cpu;
+	u64			slice;		/* writable by the BPF scheduler */
+	struct list_head	tasks_node;	/* all tasks, for (un)loading */
+};
+
+void sched_ext_free(struct task_struct *p);
+
+#else	/* !CONFIG_SCHED_CLASS_EXT */
+
+static inline void sched_ext_free(struct task_struct *p) {}
+
+#endif	/* CONFIG_SCHED_CLASS_EXT */
+#endif	/* _LINUX_SCHED_EXT_H */
@@ -39,6 +39,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	ALLOC_SHEAF,		/* Allocation from cpu sheaf */
+	FREE_SHEAF,		/* Free to cpu sheaf */
+	SHEAF_REFILL,		/* Refill of an empty cpu sheaf */
+	SHEAF_FLUSH,		/* Flush of objects from a cpu sheaf */
 	NR_SLUB_STAT_ITEMS };
 
 /*
@@ -87,8 +91,13 @@ struct kmem_cache_order_objects {
 /*
  * Slab cache management.
  */
+struct slub_sheaf;
+
 struct kmem_cache {
 	struct kmem_cache_cpu __percpu *cpu_slab;
+	/* Optional per cpu arrays of free objects, see slub_sheaves= */
+	struct slub_sheaf __percpu *cpu_sheaves;
+	unsigned int sheaf_capacity;
 	/* Used for retrieving partial slabs, etc. */
 	slab_flags_t flags;
 	unsigned long min_partial;
@@ -35,7 +35,8 @@ struct srcu_data {
 	struct timer_list delay_work;		/* Delay for CB invoking */
 	struct work_struct work;		/* Context for CB invoking. */
 	struct rcu_head srcu_barrier_head;	/* For srcu_barrier() use. */
-	struct srcu_node *mynode;		/* Leaf srcu_node. */
+	struct srcu_node *mynode;		/* Leaf srcu_node, NULL */
+						/*  until tree allocated. */
 	unsigned long grpmask;			/* Mask for leaf srcu_node */
 						/*  ->srcu_data_have_cbs[]. */
 	int cpu;
@@ -62,9 +63,10 @@ struct srcu_node {
  * Per-SRCU-domain structure, similar in function to rcu_state.
  */
 struct srcu_struct {
-	struct srcu_node node[NUM_RCU_NODES];	/* Combining tree. */
+	struct srcu_node *node;			/* Combining tree. */
 	struct srcu_node *level[RCU_NUM_LVLS + 1];
 						/* First node at each level. */
+	int srcu_size_state;			/* Small-to-big transition state. */
 	struct mutex srcu_cb_mutex;		/* Serialize CB preparation. */
 	spinlock_t __private lock;		/* Protect counters */
 	struct mutex srcu_gp_mutex;		/* Serialize GP work. */
@@ -73,6 +75,10 @@ struct srcu_struct {
 	unsigned long srcu_gp_seq_needed;	/* Latest gp_seq needed. */
 	unsigned long srcu_gp_seq_needed_exp;	/* Furthest future exp GP. */
 	unsigned long srcu_last_gp_end;		/* Last GP end timestamp (ns) */
+	unsigned long srcu_size_jiffies;	/* Current contention-measurement */
+						/*  interval. */
+	unsigned long srcu_n_lock_retries;	/* Contention events in current */
+						/*  interval. */
 	struct srcu_data __percpu *sda;		/* Per-CPU srcu_data array. */
 	unsigned long srcu_barrier_seq;		/* srcu_barrier seq #. */
 	struct mutex srcu_barrier_mutex;	/* Serialize barrier ops. */
@@ -90,6 +96,23 @@ struct srcu_struct {
 #define SRCU_STATE_SCAN1	1
 #define SRCU_STATE_SCAN2	2
 
+/*
+ * Values for ->srcu_size_state.  An srcu_struct starts out with all of
+ * its callbacks on CPU 0's srcu_data and no srcu_node combining tree.
+ * Once contention is detected, the tree is allocated at the end of the
+ * next grace period, and each later grace period moves one step closer
+ * to per-CPU callback queueing through the tree.
+ */
+#define SRCU_SIZE_SMALL		0	/* No combining tree, CPU 0 only. */
+#define SRCU_SIZE_ALLOC		1	/* Allocate tree at next GP end. */
+#define SRCU_SIZE_WAIT_BARRIER	2	/* Tree allocated, srcu_barrier() */
+					/*  must scan all CPUs. */
+#define SRCU_SIZE_WAIT_CALL	3	/* call_srcu() uses per-CPU queues. */
+#define SRCU_SIZE_WAIT_CBS1	4	/* Wait for CPU 0's leftover */
+#define SRCU_SIZE_WAIT_CBS2	5	/*  callbacks to be invoked. */
+#define SRCU_SIZE_WAIT_CBS3	6
+#define SRCU_SIZE_BIG		7	/* Full combining tree in use. */
+
 #define __SRCU_STRUCT_INIT(name, pcpu_name)				\
 {									\
 	.sda = &pcpu_name,						\
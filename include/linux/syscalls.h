@@ -70,6 +70,7 @@ struct clone_args;
 struct open_how;
 struct mount_attr;
 struct landlock_ruleset_attr;
+struct futex_waitv;
 enum landlock_rule_type;
 
 #include <linux/types.h>
@@ -617,6 +618,11 @@ asmlinkage long sys_futex(u32 __user *uaddr, int op, u32 val,
 asmlinkage long sys_futex_time32(u32 __user *uaddr, int op, u32 val,
 				 const struct old_timespec32 __user *utime,
 				 u32 __user *uaddr2, u32 val3);
+asmlinkage long sys_futex_waitv(struct futex_waitv __user *waiters,
+				unsigned int nr_futexes, unsigned int flags,
+				struct __kernel_timespec __user *timeout, clockid_t clockid);
+asmlinkage long sys_futex_wake(void __user *uaddr, unsigned long mask, int nr,
+			       unsigned int flags);
 asmlinkage long sys_get_robust_list(int pid,
 				    struct robust_list_head __user * __user *head_ptr,
 				    size_t __user *len_ptr);
@@ -60,6 +60,7 @@ struct udp_sock {
 	 */
 	__u16		 len;		/* total length of pending frames */
 	__u16		 gso_size;
+	__u32		 gso_gap;	/* ns between GSO segments */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
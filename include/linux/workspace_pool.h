@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Shared, NUMA-aware pool of compression workspaces
+ */
+#ifndef _LINUX_WORKSPACE_POOL_H
+#define _LINUX_WORKSPACE_POOL_H
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+/*
+ * Compressors need large scratch buffers ("workspaces"), but only while a
+ * call is running.  A workspace_pool lets every user of an algorithm share
+ * them: users reserve capacity when they are set up, and take a workspace
+ * only for the duration of one call.  The pool never holds more than one
+ * workspace per reservation, nor more than one per possible CPU, so callers
+ * must not sleep or be preempted while holding a workspace; that is what
+ * guarantees workspace_pool_get() finds one.
+ *
+ * Idle workspaces are kept on per-node lists and workspace_pool_get() prefers
+ * one from the local node.
+ */
+struct workspace_pool_entry {
+	struct list_head list;
+	int nid;			/* node the memory was allocated on */
+};
+
+struct workspace_pool_node {
+	spinlock_t lock;
+	struct list_head idle;
+} ____cacheline_aligned_in_smp;
+
+struct workspace_pool {
+	/* Allocate a workspace, preferably on @nid.  May sleep. */
+	struct workspace_pool_entry *(*alloc)(int nid);
+	void (*free)(struct workspace_pool_entry *ws);
+
+	struct mutex mutex;		/* protects the counters below */
+	unsigned int users;
+	unsigned int nr_allocated;
+
+	struct workspace_pool_node **nodes;
+};
+
+int workspace_pool_init(struct workspace_pool *pool,
+			struct workspace_pool_entry *(*alloc)(int nid),
+			void (*free)(struct workspace_pool_entry *ws));
+void workspace_pool_destroy(struct workspace_pool *pool);
+
+int workspace_pool_reserve(struct workspace_pool *pool);
+void workspace_pool_unreserve(struct workspace_pool *pool);
+
+struct workspace_pool_entry *workspace_pool_get(struct workspace_pool *pool);
+void workspace_pool_put(struct workspace_pool *pool,
+			struct workspace_pool_entry *ws);
+
+#endif /* _LINUX_WORKSPACE_POOL_H */
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __NET_BPF_QDISC_H
+#define __NET_BPF_QDISC_H
+
+#include <linux/if.h>
+#include <linux/types.h>
+
+struct Qdisc;
+struct sk_buff;
+
+/* Upper bound of struct bpf_qdisc_ops.nr_queues */
+#define BPF_QDISC_MAX_QUEUES	256
+
+/* Return value of ops.enqueue() dropping the packet */
+#define BPF_QDISC_DROP		-1
+
+/*
+ * A queueing discipline written in BPF. Registering it adds a qdisc named
+ * after @name, which is then set up with "tc qdisc add ... @name".
+ *
+ * The packets themselves are held by the kernel, in @nr_queues FIFOs per
+ * qdisc instance: the BPF program decides which queue a packet goes to and
+ * which queue is served next. Packets follow the earliest departure time
+ * model of sch_fq: a packet is not sent before skb->tstamp, which
+ * ops.enqueue() may set.
+ */
+struct bpf_qdisc_ops {
+	/*
+	 * Return the queue @skb is appended to, or BPF_QDISC_DROP. Setting
+	 * skb->tstamp (CLOCK_MONOTONIC) delays it until then.
+	 */
+	s32 (*enqueue)(struct sk_buff *skb, struct Qdisc *sch);
+
+	/*
+	 * Return the queue to send the next packet from, or a negative value
+	 * to send nothing for now, in which case bpf_qdisc_watchdog_schedule()
+	 * should be called unless an enqueue is expected to restart the queue.
+	 * Nothing is sent either if the head of the queue isn't due yet, and
+	 * the qdisc watchdog fires when it is. Without it non-empty queues
+	 * are served round robin, skipping the ones whose head isn't due.
+	 */
+	s32 (*dequeue)(struct Qdisc *sch);
+
+	/* Called when a qdisc instance is created, reset and destroyed */
+	s32 (*init)(struct Qdisc *sch);
+	void (*reset)(struct Qdisc *sch);
+	void (*destroy)(struct Qdisc *sch);
+
+	/* Queues per qdisc instance, 1 if 0 */
+	u32 nr_queues;
+
+	char name[IFNAMSIZ];
+};
+
+#endif /* __NET_BPF_QDISC_H */
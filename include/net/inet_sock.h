@@ -174,6 +174,7 @@ struct inet_cork {
 	__u16			gso_size;
 	u64			transmit_time;
 	u32			mark;
+	u32			gso_gap;
 };
 
 struct inet_cork_full {
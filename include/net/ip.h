@@ -79,6 +79,7 @@ struct ipcm_cookie {
 	__s16			tos;
 	char			priority;
 	__u16			gso_size;
+	__u32			gso_gap;
 };
 
 static inline void ipcm_init(struct ipcm_cookie *ipcm)
@@ -92,9 +92,43 @@ struct mptcp_out_options {
 #endif
 };
 
+#define MPTCP_SCHED_NAME_MAX		16
+#define MPTCP_SCHED_MAX_SUBFLOWS	16
+
+/* Also duplicate the data sent on the chosen subflow on every other one */
+#define MPTCP_SCHED_FLAG_REDUNDANT	BIT(0)
+#define MPTCP_SCHED_FLAG_ALL		MPTCP_SCHED_FLAG_REDUNDANT
+
+struct mptcp_sock;
+struct mptcp_subflow_context;
+
+/* Subflows able to take more data, as seen by the packet scheduler */
+struct mptcp_sched_data {
+	u8	nr_active;	/* active non backup subflows, full ones too */
+	u8	subflows;
+	struct mptcp_subflow_context *contexts[MPTCP_SCHED_MAX_SUBFLOWS];
+};
+
+struct mptcp_sched_ops {
+	/* Return the index in @data of the subflow to send on, or -1 */
+	int (*get_subflow)(struct mptcp_sock *msk,
+			   struct mptcp_sched_data *data);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
+	u32			flags;
+
+	void (*init)(struct mptcp_sock *msk);
+	void (*release)(struct mptcp_sock *msk);
+};
+
 #ifdef CONFIG_MPTCP
 extern struct request_sock_ops mptcp_subflow_request_sock_ops;
 
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+
 void mptcp_init(void);
 
 static inline bool sk_is_mptcp(const struct sock *sk)
@@ -43,10 +43,16 @@ union nf_conntrack_expect_proto {
 	/* insert expect proto private data here */
 };
 
+/* per-cpu counters not exported through struct ip_conntrack_stat */
+struct nf_conntrack_net_stat {
+	unsigned int new;
+};
+
 struct nf_conntrack_net {
 	/* only used when new connection is allocated: */
 	atomic_t count;
 	unsigned int expect_count;
+	struct nf_conntrack_net_stat __percpu *stat;
 	u8 sysctl_auto_assign_helper;
 	bool auto_assign_helper_warned;
 
@@ -11,6 +11,7 @@
 #include <net/flow_offload.h>
 #include <net/dst.h>
 #include <linux/if_pppox.h>
+#include <linux/if_vlan.h>
 #include <linux/ppp_defs.h>
 
 struct nf_flowtable;
@@ -318,12 +319,10 @@ int nf_flow_rule_route_ipv6(struct net *net, const struct flow_offload *flow,
 int nf_flow_table_offload_init(void);
 void nf_flow_table_offload_exit(void);
 
-static inline __be16 nf_flow_pppoe_proto(const struct sk_buff *skb)
+static inline __be16 __nf_flow_pppoe_proto(const struct pppoe_hdr *phdr)
 {
-	__be16 proto;
+	__be16 proto = *(const __be16 *)(phdr + 1);
 
-	proto = *((__be16 *)(skb_mac_header(skb) + ETH_HLEN +
-			     sizeof(struct pppoe_hdr)));
 	switch (proto) {
 	case htons(PPP_IP):
 		return htons(ETH_P_IP);
@@ -334,4 +333,42 @@ static inline __be16 nf_flow_pppoe_proto(const struct sk_buff *skb)
 	return 0;
 }
 
+/* Walk the in-band VLAN and PPPoE headers in front of the network header,
+ * at most NF_FLOW_TABLE_ENCAP_MAX including a hardware accelerated tag.
+ * Returns the protocol they carry and sets @offset to their length, or
+ * returns 0 if they are truncated.
+ */
+static inline __be16 nf_flow_skb_inner_proto(struct sk_buff *skb,
+					     u32 *offset)
+{
+	__be16 proto = skb->protocol;
+	const struct vlan_hdr *vhdr;
+	int i;
+
+	*offset = 0;
+	for (i = skb_vlan_tag_present(skb); i < NF_FLOW_TABLE_ENCAP_MAX; i++) {
+		switch (proto) {
+		case htons(ETH_P_8021Q):
+		case htons(ETH_P_8021AD):
+			if (!pskb_may_pull(skb, *offset + VLAN_HLEN))
+				return 0;
+			vhdr = (const struct vlan_hdr *)(skb->data + *offset);
+			proto = vhdr->h_vlan_encapsulated_proto;
+			*offset += VLAN_HLEN;
+			break;
+		case htons(ETH_P_PPP_SES):
+			if (!pskb_may_pull(skb, *offset + PPPOE_SES_HLEN))
+				return 0;
+			proto = __nf_flow_pppoe_proto((const struct pppoe_hdr *)
+						      (skb->data + *offset));
+			*offset += PPPOE_SES_HLEN;
+			break;
+		default:
+			return proto;
+		}
+	}
+
+	return proto;
+}
+
 #endif /* _NF_FLOW_TABLE_H */
@@ -46,9 +46,14 @@
 					* device driver responsibility
 					*/
 #define PP_FLAG_PAGE_FRAG	BIT(2) /* for page frag feature */
+#define PP_FLAG_RECYCLE_PCP	BIT(3) /* Stage pages freed outside of the
+					* pool's NAPI context in per-CPU
+					* caches, see pp_recycle_pcp
+					*/
 #define PP_FLAG_ALL		(PP_FLAG_DMA_MAP |\
 				 PP_FLAG_DMA_SYNC_DEV |\
-				 PP_FLAG_PAGE_FRAG)
+				 PP_FLAG_PAGE_FRAG |\
+				 PP_FLAG_RECYCLE_PCP)
 
 /*
  * Fast allocation side cache array/stack
@@ -71,6 +76,26 @@ struct pp_alloc_cache {
 	struct page *cache[PP_ALLOC_CACHE_SIZE];
 };
 
+/*
+ * Per-CPU recycle cache
+ *
+ * Pages freed outside of the pool's NAPI context, e.g. when the
+ * application CPU consumes the skb, would each take the ptr_ring
+ * producer lock.  With PP_FLAG_RECYCLE_PCP they are staged in a small
+ * cache on the freeing CPU instead, and the whole cache is produced
+ * into the ptr_ring under a single lock when it fills up.  Pages freed
+ * on the CPU running the pool's NAPI are taken back by the allocation
+ * side without touching the ring at all.
+ *
+ * The cost is that up to PP_RECYCLE_PCP_SIZE pages per CPU can sit in
+ * these caches until the pool is destroyed.
+ */
+#define PP_RECYCLE_PCP_SIZE	32
+struct pp_recycle_pcp {
+	u32 count;
+	struct page *cache[PP_RECYCLE_PCP_SIZE];
+};
+
 struct page_pool_params {
 	unsigned int	flags;
 	unsigned int	order;
@@ -82,6 +107,29 @@ struct page_pool_params {
 	unsigned int	offset;  /* DMA addr offset */
 };
 
+struct page_pool_alloc_stats {
+	u64 fast;		/* fast path allocations */
+	u64 slow;		/* slow path order-0 allocations */
+	u64 slow_high_order;	/* slow path high order allocations */
+	u64 empty;		/* ptr_ring was empty, forcing a slow path */
+	u64 refill;		/* alloc cache refilled from ring or pcp cache */
+	u64 waive;		/* pages released on refill due to NUMA mismatch */
+};
+
+struct page_pool_recycle_stats {
+	u64 cached;		/* recycled into the alloc cache */
+	u64 cache_full;		/* alloc cache was full */
+	u64 pcp;		/* staged in a per-CPU recycle cache */
+	u64 ring;		/* recycled into the ptr_ring */
+	u64 ring_full;		/* ptr_ring was full, page released */
+	u64 released_refcnt;	/* page released because of elevated refcnt */
+};
+
+struct page_pool_stats {
+	struct page_pool_alloc_stats alloc_stats;
+	struct page_pool_recycle_stats recycle_stats;
+};
+
 struct page_pool {
 	struct page_pool_params p;
 
@@ -110,6 +158,20 @@ struct page_pool {
 	 */
 	struct pp_alloc_cache alloc ____cacheline_aligned_in_smp;
 
+	/* Only written by the allocation side, same protection as above */
+	struct page_pool_alloc_stats alloc_stats;
+
+	/* Recycling happens on any CPU, so these are per-CPU */
+	struct page_pool_recycle_stats __percpu *recycle_stats;
+
+	/* PP_FLAG_RECYCLE_PCP caches.  Once recycle_pcp_closed is set
+	 * the caches are only drained after the RCU grace period started
+	 * at recycle_pcp_gp, as producers run with BH disabled.
+	 */
+	struct pp_recycle_pcp __percpu *recycle_pcp;
+	bool recycle_pcp_closed;
+	unsigned long recycle_pcp_gp;
+
 	/* Data structure for storing recycled pages.
 	 *
 	 * Returning/freeing pages is more complicated synchronization
@@ -174,6 +236,11 @@ void page_pool_use_xdp_mem(struct page_pool *pool, void (*disconnect)(void *));
 void page_pool_release_page(struct page_pool *pool, struct page *page);
 void page_pool_put_page_bulk(struct page_pool *pool, void **data,
 			     int count);
+bool page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats);
+int page_pool_ethtool_stats_get_count(void);
+u8 *page_pool_ethtool_stats_get_strings(u8 *data);
+u64 *page_pool_ethtool_stats_get(u64 *data, void *stats);
 #else
 static inline void page_pool_destroy(struct page_pool *pool)
 {
@@ -192,6 +259,27 @@ static inline void page_pool_put_page_bulk(struct page_pool *pool, void **data,
 					   int count)
 {
 }
+
+static inline bool page_pool_get_stats(struct page_pool *pool,
+				       struct page_pool_stats *stats)
+{
+	return false;
+}
+
+static inline int page_pool_ethtool_stats_get_count(void)
+{
+	return 0;
+}
+
+static inline u8 *page_pool_ethtool_stats_get_strings(u8 *data)
+{
+	return data;
+}
+
+static inline u64 *page_pool_ethtool_stats_get(u64 *data, void *stats)
+{
+	return data;
+}
 #endif
 
 void page_pool_put_page(struct page_pool *pool, struct page *page,
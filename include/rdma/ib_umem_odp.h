@@ -9,6 +9,16 @@
 #include <rdma/ib_umem.h>
 #include <rdma/ib_verbs.h>
 
+/*
+ * Fault statistics of an ODP umem, reported through restrack by drivers
+ * that call ib_umem_odp_fill_stat_entry().  Protected by umem_mutex.
+ */
+struct ib_umem_odp_stats {
+	u64 page_faults;	/* ib_umem_odp_map_dma_and_lock() calls */
+	u64 fault_pages;	/* pages mapped by them */
+	u64 prefetch_pages;	/* pages mapped by ib_umem_odp_prefetch() */
+};
+
 struct ib_umem_odp {
 	struct ib_umem umem;
 	struct mmu_interval_notifier notifier;
@@ -42,6 +52,10 @@ struct ib_umem_odp {
 	bool is_implicit_odp;
 
 	unsigned int		page_shift;
+
+	struct ib_umem_odp_stats stats;
+	/* Number of ib_umem_odp_prefetch_async() requests not done yet */
+	atomic_t		num_prefetch;
 };
 
 static inline struct ib_umem_odp *to_ib_umem_odp(struct ib_umem *umem)
@@ -99,6 +113,14 @@ int ib_umem_odp_map_dma_and_lock(struct ib_umem_odp *umem_odp, u64 start_offset,
 void ib_umem_odp_unmap_dma_pages(struct ib_umem_odp *umem_odp, u64 start_offset,
 				 u64 bound);
 
+int ib_umem_odp_prefetch(struct ib_umem_odp *umem_odp, u64 user_virt,
+			 u64 bcnt, u64 access_mask, bool fault);
+int ib_umem_odp_prefetch_async(struct ib_umem_odp *umem_odp, u64 user_virt,
+			       u64 bcnt, u64 access_mask, bool fault);
+
+int ib_umem_odp_fill_stat_entry(struct sk_buff *msg,
+				struct ib_umem_odp *umem_odp);
+
 #else /* CONFIG_INFINIBAND_ON_DEMAND_PAGING */
 
 static inline struct ib_umem_odp *
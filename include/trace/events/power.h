@@ -173,6 +173,33 @@ TRACE_EVENT(cpu_frequency_limits,
 		  (unsigned long)__entry->cpu_id)
 );
 
+TRACE_EVENT(sugov_util_boost,
+
+	TP_PROTO(struct cpufreq_policy *policy, unsigned int cpu,
+		 unsigned long boost, unsigned long util),
+
+	TP_ARGS(policy, cpu, boost, util),
+
+	TP_STRUCT__entry(
+		__field(u32, policy_cpu)
+		__field(u32, cpu_id)
+		__field(unsigned long, boost)
+		__field(unsigned long, util)
+	),
+
+	TP_fast_assign(
+		__entry->policy_cpu = policy->cpu;
+		__entry->cpu_id = cpu;
+		__entry->boost = boost;
+		__entry->util = util;
+	),
+
+	TP_printk("policy=%lu cpu_id=%lu boost=%lu util=%lu",
+		  (unsigned long)__entry->policy_cpu,
+		  (unsigned long)__entry->cpu_id,
+		  __entry->boost, __entry->util)
+);
+
 TRACE_EVENT(device_pm_callback_start,
 
 	TP_PROTO(struct device *dev, const char *pm_ops, int event),
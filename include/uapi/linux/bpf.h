@@ -906,6 +906,9 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
 	BPF_MAP_TYPE_TASK_STORAGE,
+	BPF_MAP_TYPE_ARENA,
+	BPF_MAP_TYPE_RHASH,
+	BPF_MAP_TYPE_USER_RINGBUF,
 };
 
 /* Note that tracing related programs such as
@@ -994,6 +997,7 @@ enum bpf_attach_type {
 	BPF_SK_REUSEPORT_SELECT,
 	BPF_SK_REUSEPORT_SELECT_OR_MIGRATE,
 	BPF_PERF_EVENT,
+	BPF_TRACE_KPROBE_MULTI,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -1008,6 +1012,7 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
 	BPF_LINK_TYPE_PERF_EVENT = 7,
+	BPF_LINK_TYPE_KPROBE_MULTI = 8,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -1110,6 +1115,11 @@ enum bpf_link_type {
  */
 #define BPF_F_SLEEPABLE		(1U << 4)
 
+/* If BPF_F_XDP_HAS_FRAGS is used in BPF_PROG_LOAD command, the loaded program
+ * fully support xdp frags.
+ */
+#define BPF_F_XDP_HAS_FRAGS	(1U << 5)
+
 /* When BPF ldimm64's insn[0].src_reg != 0 then this can have
  * the following extensions:
  *
@@ -1210,6 +1220,13 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Split the common LRU list of a BPF_MAP_TYPE_LRU_[PERCPU_]HASH map in
+ * shards, picked from the hash of the key and each with its own lock.
+ * Like with BPF_F_NO_COMMON_LRU, the LRU nodes cannot be moved across
+ * shards.
+ */
+	BPF_F_SHARDED_LRU	= (1U << 13),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -1455,6 +1472,12 @@ union bpf_attr {
 				 */
 				__u64		bpf_cookie;
 			} perf_event;
+			struct {
+				__u32		flags;
+				__u32		cnt;
+				__aligned_u64	syms;
+				__aligned_u64	addrs;
+			} kprobe_multi;
 		};
 	} link_create;
 
@@ -4877,6 +4900,90 @@ union bpf_attr {
  *		Get the struct pt_regs associated with **task**.
  *	Return
  *		A pointer to struct pt_regs.
+ *
+ * u64 bpf_xdp_get_buff_len(struct xdp_buff *xdp_md)
+ *	Description
+ *		Get the total size of a given xdp buff (linear and paged area)
+ *	Return
+ *		The total size of a given xdp buffer.
+ *
+ * long bpf_xdp_load_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		This helper is provided as an easy way to load data from a
+ *		xdp buffer. It can be used to load *len* bytes from *offset* from
+ *		the frame associated to *xdp_md*, into the buffer pointed by
+ *		*buf*.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * long bpf_xdp_store_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		Store *len* bytes from buffer *buf* into the frame
+ *		associated to *xdp_md*, at *offset*.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * void *bpf_arena_ptr(void *arena, u64 offset, u32 size)
+ *	Description
+ *		Get a pointer to *size* bytes at *offset* in *arena*, a map of
+ *		type **BPF_MAP_TYPE_ARENA**, allocating the page they are in
+ *		if it doesn't exist yet. *size* must be a known constant and
+ *		the bytes must not cross a page boundary. The same memory is
+ *		seen by user space through **mmap**\ () of the map, at the
+ *		same *offset*.
+ *	Return
+ *		Valid pointer with *size* bytes of memory available; NULL,
+ *		otherwise.
+ *
+ * long bpf_user_ringbuf_drain(struct bpf_map *map, void *callback_fn, void *ctx, u64 flags)
+ *	Description
+ *		Consume the samples user space committed to *map*, a ring
+ *		buffer of type **BPF_MAP_TYPE_USER_RINGBUF**, calling
+ *		*callback_fn* for each of them, in order.
+ *
+ *		long (\*callback_fn)(const void \*sample, u64 size, void \*ctx);
+ *
+ *		*sample* can be read up to the value size of *map*, of which
+ *		*size* bytes are the sample itself. *ctx* is passed as is.
+ *		The callback returns 0 to carry on with the next sample, or 1
+ *		to stop. Samples user space discarded, or larger than the value
+ *		size of *map*, are dropped without being passed to the
+ *		callback.
+ *
+ *		Once done, user space is told about the room made, according
+ *		to *flags*, as with **bpf_ringbuf_output**\ (). Only one
+ *		program can drain *map* at a time.
+ *	Return
+ *		The number of samples passed to *callback_fn*, or a negative
+ *		error: **-EBUSY** if *map* is being drained already,
+ *		**-EINVAL** if user space corrupted the ring buffer.
+ *
+ * long bpf_loop(u32 nr_loops, void *callback_fn, void *callback_ctx, u64 flags)
+ *	Description
+ *		For **nr_loops**, call **callback_fn** function
+ *		with **callback_ctx** as the context parameter.
+ *		The **callback_fn** should be a static function and
+ *		the **callback_ctx** should be a pointer to the stack.
+ *		The **flags** is used to control certain aspects of the helper.
+ *		Currently, the **flags** must be 0. Currently, nr_loops is
+ *		limited to 1 << 23 (~8 million) loops.
+ *
+ *		long (\*callback_fn)(u32 index, void \*ctx);
+ *
+ *		where **index** is the current index in the loop. The index
+ *		is zero-indexed.
+ *
+ *		If **callback_fn** returns 0, the helper will continue to the next
+ *		loop. If return value is 1, the helper will skip the rest of
+ *		the loops and return. Other return values are not used now,
+ *		and will be rejected by the verifier.
+ *
+ *		The callback is verified once, whatever **nr_loops** is, and
+ *		calls with a zero **flags** are inlined as a plain loop.
+ *
+ *	Return
+ *		The number of loops performed, **-EINVAL** for invalid **flags**,
+ *		**-E2BIG** if **nr_loops** exceeds the maximum number of loops.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -5055,6 +5162,12 @@ union bpf_attr {
 	FN(get_func_ip),		\
 	FN(get_attach_cookie),		\
 	FN(task_pt_regs),		\
+	FN(xdp_get_buff_len),		\
+	FN(xdp_load_bytes),		\
+	FN(xdp_store_bytes),		\
+	FN(arena_ptr),			\
+	FN(user_ringbuf_drain),		\
+	FN(loop),			\
 	/* */
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -5578,6 +5691,11 @@ struct bpf_prog_info {
 	__u64 run_time_ns;
 	__u64 run_cnt;
 	__u64 recursion_misses;
+	__u32 verified_insns;
+	__u32 verified_states;
+	__u32 verified_peak_states;
+	__u32 verified_pruned_states;
+	__u64 verification_time_ns;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _LINUX_CACHEFILES_H
+#define _LINUX_CACHEFILES_H
+
+#include <linux/types.h>
+
+/*
+ * Requests read from /dev/cachefiles by a daemon that bound the cache in
+ * "ondemand" mode.  The cookie key is at most 255 bytes long.
+ */
+#define CACHEFILES_MSG_MAX_SIZE	512
+
+enum cachefiles_opcode {
+	CACHEFILES_OP_READ,
+};
+
+/*
+ * Ask the daemon to fill [off, off + len) of a cache file.  The daemon
+ * writes the data through @fd, closes it and then completes the request by
+ * writing "cread <msg_id>" to /dev/cachefiles.
+ */
+struct cachefiles_msg {
+	__u32 msg_id;
+	__u32 opcode;
+	__u32 len;		/* length of the whole message */
+	__u32 fd;		/* write-only fd of the cache file */
+	__u64 off;
+	__u64 size;
+	__u8  key[];		/* the cookie key, not NUL terminated */
+};
+
+#endif /* _LINUX_CACHEFILES_H */
@@ -43,6 +43,41 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/*
+ * Flags for futex2 syscalls.
+ *
+ * The futex word is 1 << (flags & FUTEX2_SIZE_MASK) bytes large, and must be
+ * naturally aligned. FUTEX2_SIZE_U64 is only supported on 64-bit kernels.
+ */
+#define FUTEX2_SIZE_U8		0x00
+#define FUTEX2_SIZE_U16		0x01
+#define FUTEX2_SIZE_U32		0x02
+#define FUTEX2_SIZE_U64		0x03
+#define FUTEX2_SIZE_MASK	0x03
+#define FUTEX2_PRIVATE		FUTEX_PRIVATE_FLAG
+
+/* Flag to specify a 32-bit futex word, the size the futex syscall uses */
+#define FUTEX_32		FUTEX2_SIZE_U32
+
+/*
+ * Max numbers of elements in a futex_waitv array
+ */
+#define FUTEX_WAITV_MAX		128
+
+/**
+ * struct futex_waitv - A waiter for vectorized wait
+ * @val:	Expected value at uaddr
+ * @uaddr:	User address to wait on
+ * @flags:	Flags for this waiter
+ * @__reserved:	Reserved member to preserve data alignment. Should be 0.
+ */
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
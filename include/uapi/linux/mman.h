@@ -9,6 +9,9 @@
 #define MREMAP_FIXED		2
 #define MREMAP_DONTUNMAP	4
 
+/* process_madvise() flags */
+#define PMADV_VEC_RESULT	0x01	/* store bytes advised per range in iov_len */
+
 #define OVERCOMMIT_GUESS		0
 #define OVERCOMMIT_ALWAYS		1
 #define OVERCOMMIT_NEVER		2
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_NETDEV_H
+#define _UAPI_LINUX_NETDEV_H
+
+/* Generic netlink interface to the queues and NAPI instances of netdevs */
+
+#define NETDEV_FAMILY_NAME	"netdev"
+#define NETDEV_FAMILY_VERSION	1
+
+enum netdev_queue_type {
+	NETDEV_QUEUE_TYPE_RX,
+	NETDEV_QUEUE_TYPE_TX,
+};
+
+enum {
+	NETDEV_A_QUEUE_UNSPEC,
+
+	NETDEV_A_QUEUE_ID,			/* u32 */
+	NETDEV_A_QUEUE_IFINDEX,			/* u32 */
+	NETDEV_A_QUEUE_TYPE,			/* u32, enum netdev_queue_type */
+	NETDEV_A_QUEUE_NAPI_ID,			/* u32 */
+
+	__NETDEV_A_QUEUE_MAX,
+	NETDEV_A_QUEUE_MAX = __NETDEV_A_QUEUE_MAX - 1
+};
+
+enum {
+	NETDEV_A_NAPI_UNSPEC,
+
+	NETDEV_A_NAPI_IFINDEX,			/* u32 */
+	NETDEV_A_NAPI_ID,			/* u32 */
+	NETDEV_A_NAPI_IRQ,			/* u32 */
+	NETDEV_A_NAPI_PID,			/* u32, pid of the NAPI thread */
+	NETDEV_A_NAPI_THREADED,			/* u8, 0 or 1 */
+	NETDEV_A_NAPI_DEFER_HARD_IRQS,		/* u32 */
+	NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT,	/* u64, nanoseconds */
+	NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT,	/* u64, nanoseconds */
+	NETDEV_A_NAPI_PAD,
+
+	__NETDEV_A_NAPI_MAX,
+	NETDEV_A_NAPI_MAX = __NETDEV_A_NAPI_MAX - 1
+};
+
+enum {
+	NETDEV_CMD_UNSPEC,
+
+	NETDEV_CMD_QUEUE_GET,			/* can dump */
+	NETDEV_CMD_NAPI_GET,			/* can dump */
+	NETDEV_CMD_NAPI_SET,
+
+	__NETDEV_CMD_MAX,
+	NETDEV_CMD_MAX = __NETDEV_CMD_MAX - 1
+};
+
+#endif /* _UAPI_LINUX_NETDEV_H */
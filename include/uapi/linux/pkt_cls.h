@@ -584,6 +584,10 @@ enum {
 	TCA_FLOWER_KEY_HASH,		/* u32 */
 	TCA_FLOWER_KEY_HASH_MASK,	/* u32 */
 
+	TCA_FLOWER_CACHE_HITS,		/* u64 */
+	TCA_FLOWER_CACHE_MISSES,	/* u64 */
+	TCA_FLOWER_PAD,
+
 	__TCA_FLOWER_MAX,
 };
 
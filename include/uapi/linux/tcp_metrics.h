@@ -42,6 +42,7 @@ enum {
 	TCP_METRICS_ATTR_SADDR_IPV4,		/* u32 */
 	TCP_METRICS_ATTR_SADDR_IPV6,		/* binary */
 	TCP_METRICS_ATTR_PAD,
+	TCP_METRICS_ATTR_RCV_SPACE,		/* u32, bytes copied per RTT */
 
 	__TCP_METRICS_ATTR_MAX,
 };
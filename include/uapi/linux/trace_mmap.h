@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/*
+ * A per CPU trace_pipe_raw file can be mmap()'ed read-only. The first page
+ * of the mapping is the meta page below, then come the sub-buffers of the
+ * ring buffer, of subbuf_size bytes each, in the order of their IDs. The
+ * sub-buffers keep their IDs until the file is unmapped, but which one is the
+ * reader and which ones the writer is using changes all the time: only the
+ * reader sub-buffer, as reported by TRACE_MMAP_IOCTL_GET_READER, is safe to
+ * parse.
+ */
+
+/**
+ * struct trace_buffer_meta - description of a mapped ring buffer
+ * @meta_page_size:	Size of this meta page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer, its header included.
+ * @nr_subbufs:		Number of sub-buffers, the reader one included.
+ * @reader.lost_events:	Number of events lost before the reader sub-buffer.
+ * @reader.id:		ID of the reader sub-buffer, in [0, @nr_subbufs).
+ * @reader.read:	Offset in the reader sub-buffer data of the first event
+ *			user space hasn't been handed yet.
+ * @flags:		Always 0 for now.
+ * @entries:		Number of entries in the ring buffer.
+ * @overrun:		Number of entries the writer has overwritten.
+ * @read:		Number of entries consumed.
+ *
+ * The meta page is only updated by TRACE_MMAP_IOCTL_GET_READER.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64		flags;
+
+	__u64		entries;
+	__u64		overrun;
+	__u64		read;
+
+	__u64		reserved[2];
+};
+
+/*
+ * Consume what's left in the reader sub-buffer, swapping in the oldest
+ * sub-buffer with data first if the reader one was entirely consumed
+ * already, and update the meta page. The events from reader.read up to
+ * the commit in the sub-buffer header are then user space's to parse. The
+ * writer may still be adding to that sub-buffer if it's the only one with
+ * data, user space then gets the new events with the next call.
+ */
+#define TRACE_MMAP_IOCTL_GET_READER		_IO('R', 0x20)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
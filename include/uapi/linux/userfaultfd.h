@@ -32,7 +32,8 @@
 			   UFFD_FEATURE_SIGBUS |		\
 			   UFFD_FEATURE_THREAD_ID |		\
 			   UFFD_FEATURE_MINOR_HUGETLBFS |	\
-			   UFFD_FEATURE_MINOR_SHMEM)
+			   UFFD_FEATURE_MINOR_SHMEM |		\
+			   UFFD_FEATURE_WP_ASYNC)
 #define UFFD_API_IOCTLS				\
 	((__u64)1 << _UFFDIO_REGISTER |		\
 	 (__u64)1 << _UFFDIO_UNREGISTER |	\
@@ -189,6 +190,16 @@ struct uffdio_api {
 	 *
 	 * UFFD_FEATURE_MINOR_SHMEM indicates the same support as
 	 * UFFD_FEATURE_MINOR_HUGETLBFS, but for shmem-backed pages instead.
+	 *
+	 * UFFD_FEATURE_WP_ASYNC indicates that write protect faults are
+	 * resolved by the kernel: the uffd-wp bit of the faulting entry
+	 * is dropped and the write goes on, without any message queued.
+	 * The pages written since UFFDIO_WRITEPROTECT are then the ones
+	 * in the range that no longer report bit 57 in /proc/pid/pagemap.
+	 * In this mode UFFDIO_REGISTER_MODE_WP is also accepted on shmem
+	 * and hugetlbfs. Protection isn't tracked across unmapped page
+	 * table entries of those, so pages faulted in again, e.g. after
+	 * swap out, report as written.
 	 */
 #define UFFD_FEATURE_PAGEFAULT_FLAG_WP		(1<<0)
 #define UFFD_FEATURE_EVENT_FORK			(1<<1)
@@ -201,6 +212,7 @@ struct uffdio_api {
 #define UFFD_FEATURE_THREAD_ID			(1<<8)
 #define UFFD_FEATURE_MINOR_HUGETLBFS		(1<<9)
 #define UFFD_FEATURE_MINOR_SHMEM		(1<<10)
+#define UFFD_FEATURE_WP_ASYNC			(1<<11)
 	__u64 features;
 
 	__u64 ioctls;
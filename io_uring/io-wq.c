@@ -14,6 +14,7 @@
 #include <linux/rculist_nulls.h>
 #include <linux/cpu.h>
 #include <linux/tracehook.h>
+#include <linux/seq_file.h>
 #include <uapi/linux/io_uring.h>
 
 #include "io-wq.h"
@@ -1340,9 +1341,10 @@ int io_wq_cpu_affinity(struct io_wq *wq, cpumask_var_t mask)
 
 /*
  * Set max number of unbounded workers, returns old value. If new_count is 0,
- * then just return the old value.
+ * then just return the old value. If @only_node is NUMA_NO_NODE, the limits
+ * apply to every node's pool, otherwise just to that of @only_node.
  */
-int io_wq_max_workers(struct io_wq *wq, int *new_count)
+int io_wq_max_workers(struct io_wq *wq, int *new_count, int only_node)
 {
 	int prev[IO_WQ_ACCT_NR];
 	bool first_node = true;
@@ -1365,6 +1367,9 @@ int io_wq_max_workers(struct io_wq *wq, int *new_count)
 		struct io_wqe *wqe = wq->wqes[node];
 		struct io_wqe_acct *acct;
 
+		if (only_node != NUMA_NO_NODE && node != only_node)
+			continue;
+
 		raw_spin_lock(&wqe->lock);
 		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
 			acct = &wqe->acct[i];
@@ -1384,6 +1389,50 @@ int io_wq_max_workers(struct io_wq *wq, int *new_count)
 	return 0;
 }
 
+#ifdef CONFIG_PROC_FS
+struct io_wqe_acct_stats {
+	unsigned nr_workers;
+	unsigned max_workers;
+	int nr_running;
+	unsigned nr_pending;
+};
+
+/*
+ * Dump per-node pool state: workers alive vs allowed, workers currently
+ * running work, and items queued waiting for a worker.
+ */
+void io_wq_show_fdinfo(struct io_wq *wq, struct seq_file *m)
+{
+	int node, i;
+
+	for_each_node(node) {
+		struct io_wqe_acct_stats stats[IO_WQ_ACCT_NR];
+		struct io_wqe *wqe = wq->wqes[node];
+
+		raw_spin_lock(&wqe->lock);
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			struct io_wqe_acct *acct = &wqe->acct[i];
+			struct io_wq_work_node *n, *prev;
+
+			stats[i].nr_workers = acct->nr_workers;
+			stats[i].max_workers = acct->max_workers;
+			stats[i].nr_running = atomic_read(&acct->nr_running);
+			stats[i].nr_pending = 0;
+			wq_list_for_each(n, prev, &acct->work_list)
+				stats[i].nr_pending++;
+		}
+		raw_spin_unlock(&wqe->lock);
+
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			seq_printf(m, "  node%d %s:\tworkers=%u/%u running=%d pending=%u\n",
+				   node, i == IO_WQ_ACCT_BOUND ? "bound" : "unbound",
+				   stats[i].nr_workers, stats[i].max_workers,
+				   stats[i].nr_running, stats[i].nr_pending);
+		}
+	}
+}
+#endif
+
 static __init int io_wq_init(void)
 {
 	int ret;
@@ -4,6 +4,7 @@
 #include <linux/refcount.h>
 
 struct io_wq;
+struct seq_file;
 
 enum {
 	IO_WQ_WORK_CANCEL	= 1,
@@ -128,7 +129,8 @@ void io_wq_enqueue(struct io_wq *wq, struct io_wq_work *work);
 void io_wq_hash_work(struct io_wq_work *work, void *val);
 
 int io_wq_cpu_affinity(struct io_wq *wq, cpumask_var_t mask);
-int io_wq_max_workers(struct io_wq *wq, int *new_count);
+int io_wq_max_workers(struct io_wq *wq, int *new_count, int only_node);
+void io_wq_show_fdinfo(struct io_wq *wq, struct seq_file *m);
 
 static inline bool io_wq_is_hashed(struct io_wq_work *work)
 {
@@ -194,24 +194,30 @@ struct io_rings {
 	struct io_uring_cqe	cqes[] ____cacheline_aligned_in_smp;
 };
 
-enum io_uring_cmd_flags {
-	IO_URING_F_NONBLOCK		= 1,
-	IO_URING_F_COMPLETE_DEFER	= 2,
-};
+/*
+ * Returned by a multishot request issued with IO_URING_F_MULTISHOT once it
+ * won't post any more CQEs. The final CQE is stashed in ->result and
+ * ->compl.cflags and posted by the poll handler when it tears down.
+ */
+#define IO_STOP_MULTISHOT	1
 
 struct io_mapped_ubuf {
 	u64		ubuf;
 	u64		ubuf_end;
 	unsigned int	nr_bvecs;
 	unsigned long	acct_pages;
+	/* DMA mapping of the bvecs by the block device of dma_file */
+	struct file	*dma_file;
+	void		*dma_tag;
 	struct bio_vec	bvec[];
 };
 
 struct io_ring_ctx;
 
 struct io_overflow_cqe {
-	struct io_uring_cqe cqe;
 	struct list_head list;
+	/* must be last, followed by big_cqe[] for IORING_SETUP_CQE32 */
+	struct io_uring_cqe cqe;
 };
 
 struct io_fixed_file {
@@ -231,6 +237,8 @@ struct io_rsrc_put {
 
 struct io_file_table {
 	struct io_fixed_file *files;
+	unsigned long *bitmap;
+	unsigned int alloc_hint;
 };
 
 struct io_rsrc_node {
@@ -262,6 +270,22 @@ struct io_buffer {
 	__u16 bid;
 };
 
+#define IO_BUFFER_LIST_BUF_PER_PAGE (PAGE_SIZE / sizeof(struct io_uring_buf))
+
+/*
+ * A provided buffer ring registered through IORING_REGISTER_PBUF_RING. The
+ * application owns the tail and fills in buffers, the kernel consumes them
+ * from head under ->uring_lock.
+ */
+struct io_buffer_list {
+	struct page **buf_pages;
+	struct io_uring_buf_ring *buf_ring;
+	__u16 bgid;
+	__u16 head;
+	__u16 mask;
+	__u16 buf_nr_pages;
+};
+
 struct io_restriction {
 	DECLARE_BITMAP(register_op, IORING_REGISTER_LAST);
 	DECLARE_BITMAP(sqe_op, IORING_OP_LAST);
@@ -340,6 +364,8 @@ struct io_ring_ctx {
 		unsigned int		restricted: 1;
 		unsigned int		off_timeout_used: 1;
 		unsigned int		drain_active: 1;
+		/* IORING_SETUP_SINGLE_ISSUER, the only task allowed to submit */
+		struct task_struct	*submitter_task;
 	} ____cacheline_aligned_in_smp;
 
 	/* submission data */
@@ -378,6 +404,7 @@ struct io_ring_ctx {
 		struct list_head	ltimeout_list;
 		struct list_head	cq_overflow_list;
 		struct xarray		io_buffers;
+		struct xarray		io_buf_rings;
 		struct xarray		personalities;
 		u32			pers_next;
 		unsigned		sq_thread_idle;
@@ -395,7 +422,17 @@ struct io_ring_ctx {
 
 	unsigned long		check_cq_overflow;
 
+	/* IORING_SETUP_DEFER_TASKRUN, run by the submitter when it waits */
+	struct llist_head	work_llist;
+
 	struct {
+		/*
+		 * Contiguous run of free CQ entries we can fill without
+		 * looking at the shared ring head, see io_get_cqe().
+		 */
+		struct io_uring_cqe	*cqe_cached;
+		struct io_uring_cqe	*cqe_sentinel;
+
 		unsigned		cached_cq_tail;
 		unsigned		cq_entries;
 		struct eventfd_ctx	*cq_ev_fd;
@@ -458,6 +495,8 @@ struct io_ring_ctx {
 		struct completion		ref_comp;
 		u32				iowq_limits[2];
 		bool				iowq_limits_set;
+		/* per-node overrides, indexed by NUMA node id, 0 == unset */
+		u32				(*iowq_node_limits)[2];
 	};
 };
 
@@ -521,6 +560,16 @@ struct io_accept {
 	unsigned long			nofile;
 };
 
+struct io_socket {
+	struct file			*file;
+	int				domain;
+	int				type;
+	int				protocol;
+	int				flags;
+	u32				file_slot;
+	unsigned long			nofile;
+};
+
 struct io_sync {
 	struct file			*file;
 	loff_t				len;
@@ -578,7 +627,38 @@ struct io_sr_msg {
 	int				msg_flags;
 	int				bgid;
 	size_t				len;
-	struct io_buffer		*kbuf;
+};
+
+/* command payload available to ->uring_cmd(), up to the end of the SQE */
+#define uring_cmd_pdu_size(is_sqe128)				\
+	((1 + !!(is_sqe128)) * sizeof(struct io_uring_sqe) -	\
+		offsetof(struct io_uring_sqe, cmd))
+
+struct io_notif {
+	struct ubuf_info		uarg;
+	struct io_kiocb			*req;
+};
+
+struct io_sendzc {
+	struct file			*file;
+	u64				addr;
+	size_t				len;
+	int				msg_flags;
+	u16				flags;
+	/* owned by the request until the send has been issued */
+	struct io_notif			*notif;
+};
+
+struct io_msg {
+	struct file			*file;
+	u64				user_data;
+	u32				len;
+	u32				cmd;
+	u32				src_fd;
+	u32				dst_fd;
+	u32				flags;
+	/* IORING_MSG_SEND_FD: grabbed from our table, not yet installed */
+	struct file			*src_file;
 };
 
 struct io_open {
@@ -739,6 +819,8 @@ enum {
 	REQ_F_CREDS_BIT,
 	REQ_F_REFCOUNT_BIT,
 	REQ_F_ARM_LTIMEOUT_BIT,
+	REQ_F_APOLL_MULTISHOT_BIT,
+	REQ_F_BUFFER_RING_BIT,
 	/* keep async read/write and isreg together and in order */
 	REQ_F_NOWAIT_READ_BIT,
 	REQ_F_NOWAIT_WRITE_BIT,
@@ -794,8 +876,13 @@ enum {
 	REQ_F_REFCOUNT		= BIT(REQ_F_REFCOUNT_BIT),
 	/* there is a linked timeout that has to be armed */
 	REQ_F_ARM_LTIMEOUT	= BIT(REQ_F_ARM_LTIMEOUT_BIT),
+	/* fast poll multishot mode */
+	REQ_F_APOLL_MULTISHOT	= BIT(REQ_F_APOLL_MULTISHOT_BIT),
+	/* buffer selected from a provided buffer ring, ->buf_index is the bid */
+	REQ_F_BUFFER_RING	= BIT(REQ_F_BUFFER_RING_BIT),
 };
 
+
 struct async_poll {
 	struct io_poll_iocb	poll;
 	struct io_poll_iocb	*double_poll;
@@ -829,12 +916,16 @@ struct io_kiocb {
 		struct io_poll_iocb	poll;
 		struct io_poll_update	poll_update;
 		struct io_accept	accept;
+		struct io_socket	sock;
 		struct io_sync		sync;
 		struct io_cancel	cancel;
 		struct io_timeout	timeout;
 		struct io_timeout_rem	timeout_rem;
 		struct io_connect	connect;
 		struct io_sr_msg	sr_msg;
+		struct io_sendzc	sendzc;
+		struct io_uring_cmd	uring_cmd;
+		struct io_msg		msg;
 		struct io_open		open;
 		struct io_close		close;
 		struct io_rsrc_update	rsrc_update;
@@ -1068,6 +1159,21 @@ static const struct io_op_def io_op_defs[] = {
 	[IORING_OP_MKDIRAT] = {},
 	[IORING_OP_SYMLINKAT] = {},
 	[IORING_OP_LINKAT] = {},
+	[IORING_OP_SEND_ZC] = {
+		.needs_file		= 1,
+		.unbound_nonreg_file	= 1,
+		.pollout		= 1,
+	},
+	[IORING_OP_URING_CMD] = {
+		.needs_file		= 1,
+		.plug			= 1,
+		.needs_async_setup	= 1,
+		.async_size		= uring_cmd_pdu_size(1),
+	},
+	[IORING_OP_MSG_RING] = {
+		.needs_file		= 1,
+	},
+	[IORING_OP_SOCKET] = {},
 };
 
 /* requests with any of those set should undergo io_disarm_next() */
@@ -1090,6 +1196,7 @@ static int __io_register_rsrc_update(struct io_ring_ctx *ctx, unsigned type,
 				     struct io_uring_rsrc_update2 *up,
 				     unsigned nr_args);
 static void io_clean_op(struct io_kiocb *req);
+static int io_issue_sqe(struct io_kiocb *req, unsigned int issue_flags);
 static struct file *io_file_get(struct io_ring_ctx *ctx,
 				struct io_kiocb *req, int fd, bool fixed);
 static void __io_queue_sqe(struct io_kiocb *req);
@@ -1099,8 +1206,10 @@ static void io_req_task_queue(struct io_kiocb *req);
 static void io_submit_flush_completions(struct io_ring_ctx *ctx);
 static int io_req_prep_async(struct io_kiocb *req);
 
+static int __io_install_fixed_file(struct io_ring_ctx *ctx, struct file *file,
+				   u32 file_slot);
 static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
-				 unsigned int issue_flags, u32 slot_index);
+				 unsigned int issue_flags, u32 file_slot);
 static int io_close_fixed(struct io_kiocb *req, unsigned int issue_flags);
 
 static enum hrtimer_restart io_link_timeout_fn(struct hrtimer *timer);
@@ -1338,6 +1447,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_LIST_HEAD(&ctx->cq_overflow_list);
 	init_completion(&ctx->ref_comp);
 	xa_init_flags(&ctx->io_buffers, XA_FLAGS_ALLOC1);
+	xa_init(&ctx->io_buf_rings);
 	xa_init_flags(&ctx->personalities, XA_FLAGS_ALLOC1);
 	mutex_init(&ctx->uring_lock);
 	init_waitqueue_head(&ctx->cq_wait);
@@ -1351,6 +1461,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_LIST_HEAD(&ctx->rsrc_ref_list);
 	INIT_DELAYED_WORK(&ctx->rsrc_put_work, io_rsrc_put_work);
 	init_llist_head(&ctx->rsrc_put_llist);
+	init_llist_head(&ctx->work_llist);
 	INIT_LIST_HEAD(&ctx->tctx_list);
 	INIT_LIST_HEAD(&ctx->submit_state.free_list);
 	INIT_LIST_HEAD(&ctx->locked_free_list);
@@ -1391,6 +1502,33 @@ static bool req_need_defer(struct io_kiocb *req, u32 seq)
 #endif
 #define FFS_MASK		~(FFS_ASYNC_READ|FFS_ASYNC_WRITE|FFS_ISREG)
 
+static inline struct io_fixed_file *io_fixed_file_slot(struct io_file_table *table,
+						       unsigned i)
+{
+	return &table->files[i];
+}
+
+static inline struct file *io_file_from_index(struct io_ring_ctx *ctx,
+					      int index)
+{
+	struct io_fixed_file *slot = io_fixed_file_slot(&ctx->file_table, index);
+
+	return (struct file *) (slot->file_ptr & FFS_MASK);
+}
+
+static inline void io_file_bitmap_set(struct io_file_table *table, int bit)
+{
+	WARN_ON_ONCE(test_bit(bit, table->bitmap));
+	__set_bit(bit, table->bitmap);
+	table->alloc_hint = bit + 1;
+}
+
+static inline void io_file_bitmap_clear(struct io_file_table *table, int bit)
+{
+	__clear_bit(bit, table->bitmap);
+	table->alloc_hint = bit;
+}
+
 static inline bool io_req_ffs_set(struct io_kiocb *req)
 {
 	return IS_ENABLED(CONFIG_64BIT) && (req->flags & REQ_F_FIXED_FILE);
@@ -1588,21 +1726,49 @@ static inline unsigned int __io_cqring_events(struct io_ring_ctx *ctx)
 	return ctx->cached_cq_tail - READ_ONCE(ctx->rings->cq.head);
 }
 
-static inline struct io_uring_cqe *io_get_cqe(struct io_ring_ctx *ctx)
+/*
+ * Look at the ring head once and cache the range of entries that are free
+ * and contiguous in memory, up to the point where the ring wraps. Entries
+ * only ever get freed by userspace, so the cached range stays valid until
+ * we've filled it.
+ */
+static noinline bool io_cqe_cache_refill(struct io_ring_ctx *ctx)
 {
 	struct io_rings *rings = ctx->rings;
-	unsigned tail, mask = ctx->cq_entries - 1;
+	unsigned int off = ctx->cached_cq_tail & (ctx->cq_entries - 1);
+	unsigned int shift = ctx->flags & IORING_SETUP_CQE32 ? 1 : 0;
+	unsigned int free, queued, len;
 
 	/*
 	 * writes to the cq entry need to come after reading head; the
 	 * control dependency is enough as we're using WRITE_ONCE to
-	 * fill the cq entry
+	 * fill the cq entry. Userspace may cheat modifying the head, so
+	 * be safe and clamp.
 	 */
-	if (__io_cqring_events(ctx) == ctx->cq_entries)
-		return NULL;
+	queued = min(__io_cqring_events(ctx), ctx->cq_entries);
+	free = ctx->cq_entries - queued;
+	len = min(free, ctx->cq_entries - off);
+	if (!len)
+		return false;
+
+	ctx->cqe_cached = &rings->cqes[off << shift];
+	ctx->cqe_sentinel = ctx->cqe_cached + (len << shift);
+	return true;
+}
+
+static inline struct io_uring_cqe *io_get_cqe(struct io_ring_ctx *ctx)
+{
+	struct io_uring_cqe *cqe;
 
-	tail = ctx->cached_cq_tail++;
-	return &rings->cqes[tail & mask];
+	if (unlikely(ctx->cqe_cached >= ctx->cqe_sentinel)) {
+		if (!io_cqe_cache_refill(ctx))
+			return NULL;
+	}
+
+	cqe = ctx->cqe_cached;
+	ctx->cached_cq_tail++;
+	ctx->cqe_cached += ctx->flags & IORING_SETUP_CQE32 ? 2 : 1;
+	return cqe;
 }
 
 static inline bool io_should_trigger_evfd(struct io_ring_ctx *ctx)
@@ -1657,9 +1823,12 @@ static void io_cqring_ev_posted_iopoll(struct io_ring_ctx *ctx)
 static bool __io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 {
 	bool all_flushed, posted;
+	size_t cqe_size = sizeof(struct io_uring_cqe);
 
 	if (!force && __io_cqring_events(ctx) == ctx->cq_entries)
 		return false;
+	if (ctx->flags & IORING_SETUP_CQE32)
+		cqe_size <<= 1;
 
 	posted = false;
 	spin_lock(&ctx->completion_lock);
@@ -1672,7 +1841,7 @@ static bool __io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force)
 		ocqe = list_first_entry(&ctx->cq_overflow_list,
 					struct io_overflow_cqe, list);
 		if (cqe)
-			memcpy(cqe, &ocqe->cqe, sizeof(*cqe));
+			memcpy(cqe, &ocqe->cqe, cqe_size);
 		else
 			io_account_cq_overflow(ctx);
 
@@ -1758,11 +1927,17 @@ static __cold void io_uring_drop_tctx_refs(struct task_struct *task)
 }
 
 static bool io_cqring_event_overflow(struct io_ring_ctx *ctx, u64 user_data,
-				     s32 res, u32 cflags)
+				     s32 res, u32 cflags, u64 extra1,
+				     u64 extra2)
 {
 	struct io_overflow_cqe *ocqe;
+	size_t ocq_size = sizeof(struct io_overflow_cqe);
+	bool is_cqe32 = (ctx->flags & IORING_SETUP_CQE32);
 
-	ocqe = kmalloc(sizeof(*ocqe), GFP_ATOMIC | __GFP_ACCOUNT);
+	if (is_cqe32)
+		ocq_size += sizeof(struct io_uring_cqe);
+
+	ocqe = kmalloc(ocq_size, GFP_ATOMIC | __GFP_ACCOUNT);
 	if (!ocqe) {
 		/*
 		 * If we're in ring overflow flush mode, or in task cancel mode,
@@ -1781,12 +1956,16 @@ static bool io_cqring_event_overflow(struct io_ring_ctx *ctx, u64 user_data,
 	ocqe->cqe.user_data = user_data;
 	ocqe->cqe.res = res;
 	ocqe->cqe.flags = cflags;
+	if (is_cqe32) {
+		ocqe->cqe.big_cqe[0] = extra1;
+		ocqe->cqe.big_cqe[1] = extra2;
+	}
 	list_add_tail(&ocqe->list, &ctx->cq_overflow_list);
 	return true;
 }
 
-static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
-				 s32 res, u32 cflags)
+static inline bool __io_fill_cqe32(struct io_ring_ctx *ctx, u64 user_data,
+				   s32 res, u32 cflags, u64 extra1, u64 extra2)
 {
 	struct io_uring_cqe *cqe;
 
@@ -1802,9 +1981,20 @@ static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
 		WRITE_ONCE(cqe->user_data, user_data);
 		WRITE_ONCE(cqe->res, res);
 		WRITE_ONCE(cqe->flags, cflags);
+		if (ctx->flags & IORING_SETUP_CQE32) {
+			WRITE_ONCE(cqe->big_cqe[0], extra1);
+			WRITE_ONCE(cqe->big_cqe[1], extra2);
+		}
 		return true;
 	}
-	return io_cqring_event_overflow(ctx, user_data, res, cflags);
+	return io_cqring_event_overflow(ctx, user_data, res, cflags, extra1,
+					extra2);
+}
+
+static inline bool __io_fill_cqe(struct io_ring_ctx *ctx, u64 user_data,
+				 s32 res, u32 cflags)
+{
+	return __io_fill_cqe32(ctx, user_data, res, cflags, 0, 0);
 }
 
 static noinline void io_fill_cqe_req(struct io_kiocb *req, s32 res, u32 cflags)
@@ -1819,13 +2009,13 @@ static noinline bool io_fill_cqe_aux(struct io_ring_ctx *ctx, u64 user_data,
 	return __io_fill_cqe(ctx, user_data, res, cflags);
 }
 
-static void io_req_complete_post(struct io_kiocb *req, s32 res,
-				 u32 cflags)
+static void io_req_complete_post32(struct io_kiocb *req, s32 res, u32 cflags,
+				   u64 extra1, u64 extra2)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 
 	spin_lock(&ctx->completion_lock);
-	__io_fill_cqe(ctx, req->user_data, res, cflags);
+	__io_fill_cqe32(ctx, req->user_data, res, cflags, extra1, extra2);
 	/*
 	 * If we're the last reference to this request, add to our locked
 	 * free_list cache.
@@ -1856,6 +2046,12 @@ static void io_req_complete_post(struct io_kiocb *req, s32 res,
 	}
 }
 
+static inline void io_req_complete_post(struct io_kiocb *req, s32 res,
+					u32 cflags)
+{
+	io_req_complete_post32(req, res, cflags, 0, 0);
+}
+
 static inline bool io_req_needs_clean(struct io_kiocb *req)
 {
 	return req->flags & IO_REQ_CLEAN_FLAGS;
@@ -2206,7 +2402,7 @@ static void tctx_task_work(struct callback_head *cb)
 		io_uring_drop_tctx_refs(current);
 }
 
-static void io_req_task_work_add(struct io_kiocb *req)
+static void __io_req_task_work_add(struct io_kiocb *req)
 {
 	struct task_struct *tsk = req->task;
 	struct io_uring_task *tctx = tsk->io_uring;
@@ -2255,6 +2451,90 @@ static void io_req_task_work_add(struct io_kiocb *req)
 	}
 }
 
+/*
+ * Deferred task_work may only be run by the submitter task from within
+ * io_uring_enter(). Anyone else, e.g. ring exit or a cancelling submitter,
+ * punts it to the normal task_work path, which in turn falls back to
+ * ->fallback_work if the task is gone.
+ */
+static bool io_move_task_work_from_local(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node = llist_del_all(&ctx->work_llist);
+	bool moved = node != NULL;
+
+	while (node) {
+		struct io_kiocb *req = container_of(node, struct io_kiocb,
+						    io_task_work.fallback_node);
+
+		node = node->next;
+		__io_req_task_work_add(req);
+	}
+	return moved;
+}
+
+static void io_req_local_work_add(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (!llist_add(&req->io_task_work.fallback_node, &ctx->work_llist))
+		return;
+
+	/* the submitter is cancelling and won't wait for CQEs anymore */
+	if (unlikely(atomic_read(&req->task->io_uring->in_idle))) {
+		io_move_task_work_from_local(ctx);
+		return;
+	}
+
+	/* no IPI or signal, just kick the task if it's waiting for CQEs */
+	if (wq_has_sleeper(&ctx->cq_wait))
+		wake_up_all(&ctx->cq_wait);
+	if (io_should_trigger_evfd(ctx))
+		eventfd_signal(ctx->cq_ev_fd, 1);
+}
+
+static void io_req_task_work_add(struct io_kiocb *req)
+{
+	if (req->ctx->flags & IORING_SETUP_DEFER_TASKRUN)
+		io_req_local_work_add(req);
+	else
+		__io_req_task_work_add(req);
+}
+
+static int io_run_local_work(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node;
+	bool locked;
+	int ret = 0;
+
+	if (llist_empty(&ctx->work_llist))
+		return 0;
+	if (WARN_ON_ONCE(ctx->submitter_task != current))
+		return -EEXIST;
+
+	/* if not contended, grab and improve batching */
+	locked = mutex_trylock(&ctx->uring_lock);
+	while ((node = llist_del_all(&ctx->work_llist)) != NULL) {
+		/* llist is LIFO, complete in the order the work was queued */
+		node = llist_reverse_order(node);
+		do {
+			struct llist_node *next = node->next;
+			struct io_kiocb *req = container_of(node, struct io_kiocb,
+						io_task_work.fallback_node);
+
+			req->io_task_work.func(req, &locked);
+			node = next;
+			ret++;
+		} while (node);
+	}
+
+	if (locked) {
+		if (ctx->submit_state.compl_nr)
+			io_submit_flush_completions(ctx);
+		mutex_unlock(&ctx->uring_lock);
+	}
+	return ret;
+}
+
 static void io_req_task_cancel(struct io_kiocb *req, bool *locked)
 {
 	struct io_ring_ctx *ctx = req->ctx;
@@ -2431,25 +2711,33 @@ static inline unsigned int io_sqring_entries(struct io_ring_ctx *ctx)
 	return smp_load_acquire(&rings->sq.tail) - ctx->cached_sq_head;
 }
 
-static unsigned int io_put_kbuf(struct io_kiocb *req, struct io_buffer *kbuf)
+static unsigned int io_put_kbuf(struct io_kiocb *req)
 {
 	unsigned int cflags;
 
-	cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
-	cflags |= IORING_CQE_F_BUFFER;
-	req->flags &= ~REQ_F_BUFFER_SELECTED;
-	kfree(kbuf);
-	return cflags;
+	if (req->flags & REQ_F_BUFFER_RING) {
+		/* ring buffers are consumed at selection time */
+		cflags = req->buf_index << IORING_CQE_BUFFER_SHIFT;
+		req->flags &= ~REQ_F_BUFFER_RING;
+	} else {
+		cflags = req->kbuf->bid << IORING_CQE_BUFFER_SHIFT;
+		req->flags &= ~REQ_F_BUFFER_SELECTED;
+		kfree(req->kbuf);
+		req->kbuf = NULL;
+	}
+	return cflags | IORING_CQE_F_BUFFER;
 }
 
-static inline unsigned int io_put_rw_kbuf(struct io_kiocb *req)
+static inline bool io_buffer_selected(struct io_kiocb *req)
 {
-	struct io_buffer *kbuf;
+	return req->flags & (REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING);
+}
 
-	if (likely(!(req->flags & REQ_F_BUFFER_SELECTED)))
+static inline unsigned int io_put_rw_kbuf(struct io_kiocb *req)
+{
+	if (likely(!io_buffer_selected(req)))
 		return 0;
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
-	return io_put_kbuf(req, kbuf);
+	return io_put_kbuf(req);
 }
 
 static inline bool io_run_task_work(void)
@@ -3022,11 +3310,11 @@ static void kiocb_done(struct kiocb *kiocb, ssize_t ret,
 	}
 }
 
-static int __io_import_fixed(struct io_kiocb *req, int rw, struct iov_iter *iter,
-			     struct io_mapped_ubuf *imu)
+static int __io_import_fixed(int rw, struct iov_iter *iter,
+			     struct io_mapped_ubuf *imu, u64 buf_addr,
+			     size_t len)
 {
-	size_t len = req->rw.len;
-	u64 buf_end, buf_addr = req->rw.addr;
+	u64 buf_end;
 	size_t offset;
 
 	if (unlikely(check_add_overflow(buf_addr, (u64)len, &buf_end)))
@@ -3082,9 +3370,15 @@ static int __io_import_fixed(struct io_kiocb *req, int rw, struct iov_iter *iter
 
 static int io_import_fixed(struct io_kiocb *req, int rw, struct iov_iter *iter)
 {
-	if (WARN_ON_ONCE(!req->imu))
+	struct io_mapped_ubuf *imu = req->imu;
+
+	if (WARN_ON_ONCE(!imu))
 		return -EFAULT;
-	return __io_import_fixed(req, rw, iter, req->imu);
+	if (imu->dma_tag && req->file == imu->dma_file) {
+		req->rw.kiocb.private = imu->dma_tag;
+		req->rw.kiocb.ki_flags |= IOCB_DMA_TAG;
+	}
+	return __io_import_fixed(rw, iter, imu, req->rw.addr, req->rw.len);
 }
 
 static void io_ring_submit_unlock(struct io_ring_ctx *ctx, bool needs_lock)
@@ -3105,20 +3399,61 @@ static void io_ring_submit_lock(struct io_ring_ctx *ctx, bool needs_lock)
 		mutex_lock(&ctx->uring_lock);
 }
 
-static struct io_buffer *io_buffer_select(struct io_kiocb *req, size_t *len,
-					  int bgid, struct io_buffer *kbuf,
-					  bool needs_lock)
+static void __user *io_ring_buffer_select(struct io_kiocb *req, size_t *len,
+					  struct io_buffer_list *bl)
 {
-	struct io_buffer *head;
+	struct io_uring_buf_ring *br = bl->buf_ring;
+	struct io_uring_buf *buf;
+	__u16 head = bl->head;
+	__u32 buf_len;
 
-	if (req->flags & REQ_F_BUFFER_SELECTED)
-		return kbuf;
+	/* pairs with the tail store_release in the application */
+	if (unlikely(smp_load_acquire(&br->tail) == head))
+		return ERR_PTR(-ENOBUFS);
+
+	head &= bl->mask;
+	if (head < IO_BUFFER_LIST_BUF_PER_PAGE) {
+		buf = &br->bufs[head];
+	} else {
+		int off = head & (IO_BUFFER_LIST_BUF_PER_PAGE - 1);
+		int index = head / IO_BUFFER_LIST_BUF_PER_PAGE;
 
-	io_ring_submit_lock(req->ctx, needs_lock);
+		buf = page_address(bl->buf_pages[index]);
+		buf += off;
+	}
 
-	lockdep_assert_held(&req->ctx->uring_lock);
+	buf_len = min_t(__u32, READ_ONCE(buf->len), MAX_RW_COUNT);
+	if (*len == 0 || *len > buf_len)
+		*len = buf_len;
+	req->flags |= REQ_F_BUFFER_RING;
+	req->buf_index = READ_ONCE(buf->bid);
+	/*
+	 * Consume the entry right away, we may drop ->uring_lock before the
+	 * request completes and another request must not pick the same one.
+	 */
+	bl->head++;
+	return u64_to_user_ptr(READ_ONCE(buf->addr));
+}
+
+static void __user *io_buffer_select(struct io_kiocb *req, size_t *len,
+				     int bgid, bool needs_lock)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer_list *bl;
+	struct io_buffer *head, *kbuf;
+	void __user *ret;
+
+	io_ring_submit_lock(ctx, needs_lock);
+
+	lockdep_assert_held(&ctx->uring_lock);
 
-	head = xa_load(&req->ctx->io_buffers, bgid);
+	bl = xa_load(&ctx->io_buf_rings, bgid);
+	if (bl) {
+		ret = io_ring_buffer_select(req, len, bl);
+		goto out;
+	}
+
+	head = xa_load(&ctx->io_buffers, bgid);
 	if (head) {
 		if (!list_empty(&head->list)) {
 			kbuf = list_last_entry(&head->list, struct io_buffer,
@@ -3126,33 +3461,59 @@ static struct io_buffer *io_buffer_select(struct io_kiocb *req, size_t *len,
 			list_del(&kbuf->list);
 		} else {
 			kbuf = head;
-			xa_erase(&req->ctx->io_buffers, bgid);
+			xa_erase(&ctx->io_buffers, bgid);
 		}
-		if (*len > kbuf->len)
+		if (*len == 0 || *len > kbuf->len)
 			*len = kbuf->len;
+		req->kbuf = kbuf;
+		req->flags |= REQ_F_BUFFER_SELECTED;
+		ret = u64_to_user_ptr(kbuf->addr);
 	} else {
-		kbuf = ERR_PTR(-ENOBUFS);
+		ret = ERR_PTR(-ENOBUFS);
 	}
+out:
+	io_ring_submit_unlock(ctx, needs_lock);
 
-	io_ring_submit_unlock(req->ctx, needs_lock);
+	return ret;
+}
+
+/*
+ * Hand a selected but unused ring buffer back, so we don't hold on to it
+ * while waiting for data. Only valid if ->uring_lock has been held since
+ * the buffer was selected, or someone else may have picked the next entry.
+ * Legacy provided buffers stay attached to the request, as for retries.
+ */
+static void io_kbuf_recycle(struct io_kiocb *req, int bgid)
+{
+	struct io_buffer_list *bl;
+
+	if (!(req->flags & REQ_F_BUFFER_RING))
+		return;
 
-	return kbuf;
+	lockdep_assert_held(&req->ctx->uring_lock);
+
+	bl = xa_load(&req->ctx->io_buf_rings, bgid);
+	if (bl)
+		bl->head--;
+	req->flags &= ~REQ_F_BUFFER_RING;
 }
 
 static void __user *io_rw_buffer_select(struct io_kiocb *req, size_t *len,
 					bool needs_lock)
 {
-	struct io_buffer *kbuf;
-	u16 bgid;
+	void __user *buf;
+
+	if (io_buffer_selected(req)) {
+		*len = req->rw.len;
+		return u64_to_user_ptr(req->rw.addr);
+	}
 
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
-	bgid = req->buf_index;
-	kbuf = io_buffer_select(req, len, bgid, kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
-	req->rw.addr = (u64) (unsigned long) kbuf;
-	req->flags |= REQ_F_BUFFER_SELECTED;
-	return u64_to_user_ptr(kbuf->addr);
+	buf = io_buffer_select(req, len, req->buf_index, needs_lock);
+	if (IS_ERR(buf))
+		return buf;
+	req->rw.addr = (u64) (unsigned long) buf;
+	req->rw.len = *len;
+	return buf;
 }
 
 #ifdef CONFIG_COMPAT
@@ -3206,12 +3567,9 @@ static ssize_t __io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 static ssize_t io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 				    bool needs_lock)
 {
-	if (req->flags & REQ_F_BUFFER_SELECTED) {
-		struct io_buffer *kbuf;
-
-		kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
-		iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
-		iov[0].iov_len = kbuf->len;
+	if (io_buffer_selected(req)) {
+		iov[0].iov_base = u64_to_user_ptr(req->rw.addr);
+		iov[0].iov_len = req->rw.len;
 		return 0;
 	}
 	if (req->rw.len != 1)
@@ -3981,80 +4339,337 @@ static int io_linkat(struct io_kiocb *req, int issue_flags)
 	return 0;
 }
 
-static int io_shutdown_prep(struct io_kiocb *req,
-			    const struct io_uring_sqe *sqe)
+static void io_uring_cmd_work(struct io_kiocb *req, bool *locked)
 {
-#if defined(CONFIG_NET)
-	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
-		return -EINVAL;
-	if (unlikely(sqe->ioprio || sqe->off || sqe->addr || sqe->rw_flags ||
-		     sqe->buf_index || sqe->splice_fd_in))
-		return -EINVAL;
-
-	req->shutdown.how = READ_ONCE(sqe->len);
-	return 0;
-#else
-	return -EOPNOTSUPP;
-#endif
+	req->uring_cmd.task_work_cb(&req->uring_cmd);
 }
 
-static int io_shutdown(struct io_kiocb *req, unsigned int issue_flags)
+void io_uring_cmd_complete_in_task(struct io_uring_cmd *ioucmd,
+			void (*task_work_cb)(struct io_uring_cmd *))
 {
-#if defined(CONFIG_NET)
-	struct socket *sock;
-	int ret;
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
 
-	if (issue_flags & IO_URING_F_NONBLOCK)
-		return -EAGAIN;
+	req->uring_cmd.task_work_cb = task_work_cb;
+	req->io_task_work.func = io_uring_cmd_work;
+	io_req_task_work_add(req);
+}
+EXPORT_SYMBOL_GPL(io_uring_cmd_complete_in_task);
 
-	sock = sock_from_file(req->file);
-	if (unlikely(!sock))
-		return -ENOTSOCK;
+/*
+ * Called by consumers of io_uring_cmd, if they originally returned
+ * -EIOCBQUEUED upon receiving the command.
+ */
+void io_uring_cmd_done(struct io_uring_cmd *ioucmd, ssize_t ret, ssize_t res2)
+{
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
 
-	ret = __sys_shutdown_sock(sock, req->shutdown.how);
 	if (ret < 0)
 		req_set_fail(req);
-	io_req_complete(req, ret);
-	return 0;
-#else
-	return -EOPNOTSUPP;
-#endif
+	if (req->ctx->flags & IORING_SETUP_CQE32)
+		io_req_complete_post32(req, ret, 0, res2, 0);
+	else
+		io_req_complete_post(req, ret, 0);
 }
+EXPORT_SYMBOL_GPL(io_uring_cmd_done);
 
-static int __io_splice_prep(struct io_kiocb *req,
-			    const struct io_uring_sqe *sqe)
+static int io_uring_cmd_prep_async(struct io_kiocb *req)
 {
-	struct io_splice *sp = &req->splice;
-	unsigned int valid_flags = SPLICE_F_FD_IN_FIXED | SPLICE_F_ALL;
+	size_t cmd_size;
 
-	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
-		return -EINVAL;
+	cmd_size = uring_cmd_pdu_size(req->ctx->flags & IORING_SETUP_SQE128);
 
-	sp->len = READ_ONCE(sqe->len);
-	sp->flags = READ_ONCE(sqe->splice_flags);
-	if (unlikely(sp->flags & ~valid_flags))
-		return -EINVAL;
-	sp->splice_fd_in = READ_ONCE(sqe->splice_fd_in);
+	memcpy(req->async_data, req->uring_cmd.cmd, cmd_size);
 	return 0;
 }
 
-static int io_tee_prep(struct io_kiocb *req,
-		       const struct io_uring_sqe *sqe)
+static int io_uring_cmd_prep(struct io_kiocb *req,
+			     const struct io_uring_sqe *sqe)
 {
-	if (READ_ONCE(sqe->splice_off_in) || READ_ONCE(sqe->off))
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EOPNOTSUPP;
+	if (sqe->rw_flags)
 		return -EINVAL;
-	return __io_splice_prep(req, sqe);
+	ioucmd->cmd = sqe->cmd;
+	ioucmd->cmd_op = READ_ONCE(sqe->cmd_op);
+	return 0;
 }
 
-static int io_tee(struct io_kiocb *req, unsigned int issue_flags)
+static int io_uring_cmd(struct io_kiocb *req, unsigned int issue_flags)
 {
-	struct io_splice *sp = &req->splice;
-	struct file *out = sp->file_out;
-	unsigned int flags = sp->flags & ~SPLICE_F_FD_IN_FIXED;
-	struct file *in;
-	long ret = 0;
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *file = req->file;
+	int ret;
 
-	if (issue_flags & IO_URING_F_NONBLOCK)
+	if (!req->file->f_op->uring_cmd)
+		return -EOPNOTSUPP;
+
+	if (ctx->flags & IORING_SETUP_SQE128)
+		issue_flags |= IO_URING_F_SQE128;
+	if (ctx->flags & IORING_SETUP_CQE32)
+		issue_flags |= IO_URING_F_CQE32;
+
+	if (req->async_data)
+		ioucmd->cmd = req->async_data;
+
+	ret = file->f_op->uring_cmd(ioucmd, issue_flags);
+	if (ret == -EAGAIN) {
+		/* the SQE may be reused once we return, keep a copy */
+		if (!req->async_data) {
+			if (io_alloc_async_data(req))
+				return -ENOMEM;
+			io_uring_cmd_prep_async(req);
+		}
+		return -EAGAIN;
+	}
+
+	if (ret != -EIOCBQUEUED)
+		io_uring_cmd_done(ioucmd, ret, 0);
+	return 0;
+}
+
+static int io_msg_ring_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_msg *msg = &req->msg;
+
+	if (unlikely(sqe->ioprio || sqe->buf_index || sqe->personality))
+		return -EINVAL;
+
+	msg->src_file = NULL;
+	msg->user_data = READ_ONCE(sqe->off);
+	msg->len = READ_ONCE(sqe->len);
+	msg->cmd = READ_ONCE(sqe->addr);
+	msg->src_fd = READ_ONCE(sqe->addr3);
+	msg->dst_fd = READ_ONCE(sqe->file_index);
+	msg->flags = READ_ONCE(sqe->msg_ring_flags);
+	if (msg->flags & ~IORING_MSG_RING_CQE_SKIP)
+		return -EINVAL;
+	return 0;
+}
+
+static bool io_msg_post_cqe(struct io_ring_ctx *target_ctx, u64 user_data,
+			    s32 res)
+{
+	bool filled;
+
+	spin_lock(&target_ctx->completion_lock);
+	filled = io_fill_cqe_aux(target_ctx, user_data, res, 0);
+	io_commit_cqring(target_ctx);
+	spin_unlock(&target_ctx->completion_lock);
+
+	if (filled)
+		io_cqring_ev_posted(target_ctx);
+	return filled;
+}
+
+/*
+ * We may already be holding our own ->uring_lock, so we can only trylock the
+ * target to avoid ABBA deadlocks between two rings messaging each other. If
+ * that fails, punt to io-wq, where we don't hold any ring lock and can sleep.
+ */
+static int io_msg_lock_target(struct io_ring_ctx *target_ctx,
+			      unsigned int issue_flags)
+{
+	if (issue_flags & IO_URING_F_NONBLOCK) {
+		if (!mutex_trylock(&target_ctx->uring_lock))
+			return -EAGAIN;
+		return 0;
+	}
+	mutex_lock(&target_ctx->uring_lock);
+	return 0;
+}
+
+static int io_msg_ring_data(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = &req->msg;
+	int ret = 0;
+
+	if (msg->src_fd || msg->dst_fd || msg->flags)
+		return -EINVAL;
+
+	/* IOPOLL rings fill their CQ under ->uring_lock, not completion_lock */
+	if (target_ctx->flags & IORING_SETUP_IOPOLL) {
+		if (io_msg_lock_target(target_ctx, issue_flags))
+			return -EAGAIN;
+	}
+	if (!io_msg_post_cqe(target_ctx, msg->user_data, msg->len))
+		ret = -EOVERFLOW;
+	if (target_ctx->flags & IORING_SETUP_IOPOLL)
+		mutex_unlock(&target_ctx->uring_lock);
+	return ret;
+}
+
+static struct file *io_msg_grab_file(struct io_kiocb *req,
+				     unsigned int issue_flags)
+{
+	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned int idx = req->msg.src_fd;
+	struct file *file = NULL;
+
+	io_ring_submit_lock(ctx, !force_nonblock);
+	if (likely(idx < ctx->nr_user_files)) {
+		idx = array_index_nospec(idx, ctx->nr_user_files);
+		file = io_file_from_index(ctx, idx);
+		if (file)
+			get_file(file);
+	}
+	io_ring_submit_unlock(ctx, !force_nonblock);
+	return file;
+}
+
+static int io_msg_send_fd(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = &req->msg;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *src_file;
+	int ret;
+
+	if (target_ctx == ctx)
+		return -EINVAL;
+
+	src_file = msg->src_file;
+	if (!src_file) {
+		src_file = io_msg_grab_file(req, issue_flags);
+		if (!src_file)
+			return -EBADF;
+		msg->src_file = src_file;
+		req->flags |= REQ_F_NEED_CLEANUP;
+	}
+
+	if (io_msg_lock_target(target_ctx, issue_flags))
+		return -EAGAIN;
+
+	ret = __io_install_fixed_file(target_ctx, src_file, msg->dst_fd);
+	if (ret < 0)
+		goto out_unlock;
+	/* the target's file table owns the reference now */
+	msg->src_file = NULL;
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+
+	if (msg->flags & IORING_MSG_RING_CQE_SKIP)
+		goto out_unlock;
+	/*
+	 * If this fails, the target still has the file and the sender
+	 * gets -EOVERFLOW. There's no reliable way to undo the install, as
+	 * the target may have used the slot already.
+	 */
+	if (!io_msg_post_cqe(target_ctx, msg->user_data, msg->len))
+		ret = -EOVERFLOW;
+out_unlock:
+	mutex_unlock(&target_ctx->uring_lock);
+	return ret;
+}
+
+static int io_msg_ring(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_msg *msg = &req->msg;
+	int ret;
+
+	ret = -EBADFD;
+	if (req->file->f_op != &io_uring_fops)
+		goto done;
+
+	switch (msg->cmd) {
+	case IORING_MSG_DATA:
+		ret = io_msg_ring_data(req, issue_flags);
+		break;
+	case IORING_MSG_SEND_FD:
+		ret = io_msg_send_fd(req, issue_flags);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+done:
+	if (ret == -EAGAIN)
+		return -EAGAIN;
+	if (ret < 0)
+		req_set_fail(req);
+	__io_req_complete(req, issue_flags, ret, 0);
+	return 0;
+}
+
+static int io_shutdown_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+#if defined(CONFIG_NET)
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (unlikely(sqe->ioprio || sqe->off || sqe->addr || sqe->rw_flags ||
+		     sqe->buf_index || sqe->splice_fd_in))
+		return -EINVAL;
+
+	req->shutdown.how = READ_ONCE(sqe->len);
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static int io_shutdown(struct io_kiocb *req, unsigned int issue_flags)
+{
+#if defined(CONFIG_NET)
+	struct socket *sock;
+	int ret;
+
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		return -EAGAIN;
+
+	sock = sock_from_file(req->file);
+	if (unlikely(!sock))
+		return -ENOTSOCK;
+
+	ret = __sys_shutdown_sock(sock, req->shutdown.how);
+	if (ret < 0)
+		req_set_fail(req);
+	io_req_complete(req, ret);
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static int __io_splice_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_splice *sp = &req->splice;
+	unsigned int valid_flags = SPLICE_F_FD_IN_FIXED | SPLICE_F_ALL;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+
+	sp->len = READ_ONCE(sqe->len);
+	sp->flags = READ_ONCE(sqe->splice_flags);
+	if (unlikely(sp->flags & ~valid_flags))
+		return -EINVAL;
+	sp->splice_fd_in = READ_ONCE(sqe->splice_fd_in);
+	return 0;
+}
+
+static int io_tee_prep(struct io_kiocb *req,
+		       const struct io_uring_sqe *sqe)
+{
+	if (READ_ONCE(sqe->splice_off_in) || READ_ONCE(sqe->off))
+		return -EINVAL;
+	return __io_splice_prep(req, sqe);
+}
+
+static int io_tee(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_splice *sp = &req->splice;
+	struct file *out = sp->file_out;
+	unsigned int flags = sp->flags & ~SPLICE_F_FD_IN_FIXED;
+	struct file *in;
+	long ret = 0;
+
+	if (issue_flags & IO_URING_F_NONBLOCK)
 		return -EAGAIN;
 
 	in = io_file_get(req->ctx, req, sp->splice_fd_in,
@@ -4320,7 +4935,7 @@ static int io_openat2(struct io_kiocb *req, unsigned int issue_flags)
 		fd_install(ret, file);
 	else
 		ret = io_install_fixed_file(req, file, issue_flags,
-					    req->open.file_slot - 1);
+					    req->open.file_slot);
 err:
 	putname(req->open.filename);
 	req->flags &= ~REQ_F_NEED_CLEANUP;
@@ -4398,6 +5013,9 @@ static int io_remove_buffers(struct io_kiocb *req, unsigned int issue_flags)
 	head = xa_load(&ctx->io_buffers, p->bgid);
 	if (head)
 		ret = __io_remove_buffers(ctx, head, p->bgid, p->nbufs);
+	else if (xa_load(&ctx->io_buf_rings, p->bgid))
+		/* ring provided buffers are owned by the application */
+		ret = -EINVAL;
 	if (ret < 0)
 		req_set_fail(req);
 
@@ -4482,6 +5100,12 @@ static int io_provide_buffers(struct io_kiocb *req, unsigned int issue_flags)
 
 	lockdep_assert_held(&ctx->uring_lock);
 
+	/* can't mix legacy provided buffers and a buffer ring in a group */
+	if (unlikely(xa_load(&ctx->io_buf_rings, p->bgid))) {
+		ret = -EINVAL;
+		goto err;
+	}
+
 	list = head = xa_load(&ctx->io_buffers, p->bgid);
 
 	ret = io_add_buffers(p, &head);
@@ -4491,6 +5115,7 @@ static int io_provide_buffers(struct io_kiocb *req, unsigned int issue_flags)
 		if (ret < 0)
 			__io_remove_buffers(ctx, head, p->bgid, -1U);
 	}
+err:
 	if (ret < 0)
 		req_set_fail(req);
 	/* complete before unlock, IOPOLL may need the lock */
@@ -4639,13 +5264,20 @@ static int io_statx_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 static int io_statx(struct io_kiocb *req, unsigned int issue_flags)
 {
 	struct io_statx *ctx = &req->statx;
+	unsigned int lookup_flags = 0;
 	int ret;
 
+	/*
+	 * Try a cached lookup inline first, so that a batch of statx of hot
+	 * paths completes in the submission instead of as many io-wq works.
+	 */
 	if (issue_flags & IO_URING_F_NONBLOCK)
-		return -EAGAIN;
+		lookup_flags = LOOKUP_CACHED;
 
 	ret = do_statx(ctx->dfd, ctx->filename, ctx->flags, ctx->mask,
-		       ctx->buffer);
+		       ctx->buffer, lookup_flags);
+	if (ret == -EAGAIN && (issue_flags & IO_URING_F_NONBLOCK))
+		return -EAGAIN;
 
 	if (ret < 0)
 		req_set_fail(req);
@@ -4782,6 +5414,7 @@ static int io_sendmsg_copy_hdr(struct io_kiocb *req,
 			       struct io_async_msghdr *iomsg)
 {
 	iomsg->msg.msg_name = &iomsg->addr;
+	iomsg->msg.msg_ubuf = NULL;
 	iomsg->free_iov = iomsg->fast_iov;
 	return sendmsg_copy_msghdr(&iomsg->msg, req->sr_msg.umsg,
 				   req->sr_msg.msg_flags, &iomsg->free_iov);
@@ -4885,6 +5518,7 @@ static int io_send(struct io_kiocb *req, unsigned int issue_flags)
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
 	msg.msg_namelen = 0;
+	msg.msg_ubuf = NULL;
 
 	flags = req->sr_msg.msg_flags;
 	if (issue_flags & IO_URING_F_NONBLOCK)
@@ -4905,6 +5539,139 @@ static int io_send(struct io_kiocb *req, unsigned int issue_flags)
 	return 0;
 }
 
+static void io_send_zc_notif_tw(struct io_kiocb *req, bool *locked)
+{
+	kfree(req->sendzc.notif);
+	req->sendzc.notif = NULL;
+	io_req_complete_post(req, 0, IORING_CQE_F_NOTIF);
+}
+
+/*
+ * Called for every dropped reference on the notification, which may happen
+ * from any context once the network stack is done with the pages. The final
+ * put punts the notification CQE to task_work.
+ */
+static void io_send_zc_callback(struct sk_buff *skb, struct ubuf_info *uarg,
+				bool zerocopy_success)
+{
+	struct io_notif *notif = container_of(uarg, struct io_notif, uarg);
+	struct io_kiocb *req = notif->req;
+
+	if (!refcount_dec_and_test(&uarg->refcnt))
+		return;
+	req->io_task_work.func = io_send_zc_notif_tw;
+	io_req_task_work_add(req);
+}
+
+static int io_send_zc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_sendzc *zc = &req->sendzc;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_notif *notif;
+
+	if (unlikely(ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (unlikely(sqe->addr2 || sqe->file_index))
+		return -EINVAL;
+
+	zc->flags = READ_ONCE(sqe->ioprio);
+	if (zc->flags & ~IORING_RECVSEND_FIXED_BUF)
+		return -EINVAL;
+	if (zc->flags & IORING_RECVSEND_FIXED_BUF) {
+		u16 index = READ_ONCE(sqe->buf_index);
+
+		if (unlikely(index >= ctx->nr_user_bufs))
+			return -EFAULT;
+		index = array_index_nospec(index, ctx->nr_user_bufs);
+		req->imu = ctx->user_bufs[index];
+		io_req_set_rsrc_node(req);
+	} else if (sqe->buf_index) {
+		return -EINVAL;
+	}
+
+	zc->addr = READ_ONCE(sqe->addr);
+	zc->len = READ_ONCE(sqe->len);
+	zc->msg_flags = READ_ONCE(sqe->msg_flags) | MSG_NOSIGNAL;
+	if (zc->msg_flags & MSG_DONTWAIT)
+		req->flags |= REQ_F_NOWAIT;
+
+	notif = kzalloc(sizeof(*notif), GFP_KERNEL);
+	if (!notif)
+		return -ENOMEM;
+	notif->uarg.callback = io_send_zc_callback;
+	notif->uarg.flags = SKBFL_ZEROCOPY_FRAG;
+	refcount_set(&notif->uarg.refcnt, 1);
+	notif->req = req;
+	zc->notif = notif;
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+/*
+ * Zerocopy send. Once the data has been handed to the socket, the result is
+ * posted with IORING_CQE_F_MORE set, and the request completes with a second
+ * IORING_CQE_F_NOTIF CQE when the network stack has released the buffer. If
+ * the request fails before reaching the socket, it completes normally with a
+ * single CQE.
+ */
+static int io_send_zc(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_sendzc *zc = &req->sendzc;
+	struct msghdr msg;
+	struct iovec iov;
+	struct socket *sock;
+	unsigned flags;
+	int min_ret = 0;
+	int ret;
+
+	sock = sock_from_file(req->file);
+	if (unlikely(!sock))
+		return -ENOTSOCK;
+
+	if (zc->flags & IORING_RECVSEND_FIXED_BUF)
+		ret = __io_import_fixed(WRITE, &msg.msg_iter, req->imu,
+					zc->addr, zc->len);
+	else
+		ret = import_single_range(WRITE, u64_to_user_ptr(zc->addr),
+					  zc->len, &iov, &msg.msg_iter);
+	if (unlikely(ret))
+		return ret;
+
+	msg.msg_name = NULL;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_namelen = 0;
+	msg.msg_ubuf = &zc->notif->uarg;
+
+	flags = zc->msg_flags | MSG_ZEROCOPY;
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		flags |= MSG_DONTWAIT;
+	if (flags & MSG_WAITALL)
+		min_ret = iov_iter_count(&msg.msg_iter);
+
+	msg.msg_flags = flags;
+	ret = sock_sendmsg(sock, &msg);
+	if ((issue_flags & IO_URING_F_NONBLOCK) && ret == -EAGAIN)
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	if (ret < min_ret)
+		req_set_fail(req);
+
+	spin_lock(&ctx->completion_lock);
+	io_fill_cqe_aux(ctx, req->user_data, ret, IORING_CQE_F_MORE);
+	io_commit_cqring(ctx);
+	spin_unlock(&ctx->completion_lock);
+	io_cqring_ev_posted(ctx);
+
+	/* skbs hold their own references, the last put completes the request */
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	net_zcopy_put(&zc->notif->uarg);
+	return 0;
+}
+
 static int __io_recvmsg_copy_hdr(struct io_kiocb *req,
 				 struct io_async_msghdr *iomsg)
 {
@@ -4992,24 +5759,17 @@ static int io_recvmsg_copy_hdr(struct io_kiocb *req,
 	return __io_recvmsg_copy_hdr(req, iomsg);
 }
 
-static struct io_buffer *io_recv_buffer_select(struct io_kiocb *req,
-					       bool needs_lock)
+static void __user *io_recv_buffer_select(struct io_kiocb *req,
+					  bool needs_lock)
 {
 	struct io_sr_msg *sr = &req->sr_msg;
-	struct io_buffer *kbuf;
-
-	kbuf = io_buffer_select(req, &sr->len, sr->bgid, sr->kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
 
-	sr->kbuf = kbuf;
-	req->flags |= REQ_F_BUFFER_SELECTED;
-	return kbuf;
+	return io_buffer_select(req, &sr->len, sr->bgid, needs_lock);
 }
 
 static inline unsigned int io_put_recv_kbuf(struct io_kiocb *req)
 {
-	return io_put_kbuf(req, req->sr_msg.kbuf);
+	return io_put_kbuf(req);
 }
 
 static int io_recvmsg_prep_async(struct io_kiocb *req)
@@ -5025,13 +5785,12 @@ static int io_recvmsg_prep_async(struct io_kiocb *req)
 static int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_sr_msg *sr = &req->sr_msg;
+	unsigned flags;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
 		return -EINVAL;
 	if (unlikely(sqe->addr2 || sqe->file_index))
 		return -EINVAL;
-	if (unlikely(sqe->addr2 || sqe->file_index || sqe->ioprio))
-		return -EINVAL;
 
 	sr->umsg = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	sr->len = READ_ONCE(sqe->len);
@@ -5040,6 +5799,22 @@ static int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 	if (sr->msg_flags & MSG_DONTWAIT)
 		req->flags |= REQ_F_NOWAIT;
 
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_RECV_MULTISHOT)
+		return -EINVAL;
+	if (flags & IORING_RECV_MULTISHOT) {
+		/* each CQE gets a buffer of its own, sized by the group */
+		if (req->opcode != IORING_OP_RECV)
+			return -EINVAL;
+		if (!(req->flags & REQ_F_BUFFER_SELECT))
+			return -EINVAL;
+		if (sr->msg_flags & MSG_WAITALL)
+			return -EINVAL;
+		if (sr->len)
+			return -EINVAL;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+	}
+
 #ifdef CONFIG_COMPAT
 	if (req->ctx->compat)
 		sr->msg_flags |= MSG_CMSG_COMPAT;
@@ -5051,7 +5826,6 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 {
 	struct io_async_msghdr iomsg, *kmsg;
 	struct socket *sock;
-	struct io_buffer *kbuf;
 	unsigned flags;
 	int min_ret = 0;
 	int ret, cflags = 0;
@@ -5070,11 +5844,16 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 	}
 
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		kmsg->fast_iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
-		kmsg->fast_iov[0].iov_len = req->sr_msg.len;
+		/* a retry keeps the buffer it already got in ->fast_iov */
+		if (!io_buffer_selected(req)) {
+			void __user *buf;
+
+			buf = io_recv_buffer_select(req, !force_nonblock);
+			if (IS_ERR(buf))
+				return PTR_ERR(buf);
+			kmsg->fast_iov[0].iov_base = buf;
+			kmsg->fast_iov[0].iov_len = req->sr_msg.len;
+		}
 		iov_iter_init(&kmsg->msg.msg_iter, READ, kmsg->fast_iov,
 				1, req->sr_msg.len);
 	}
@@ -5092,7 +5871,7 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 	if (ret == -ERESTARTSYS)
 		ret = -EINTR;
 
-	if (req->flags & REQ_F_BUFFER_SELECTED)
+	if (io_buffer_selected(req))
 		cflags = io_put_recv_kbuf(req);
 	/* fast path, check for non-NULL to avoid function call */
 	if (kmsg->free_iov)
@@ -5106,7 +5885,7 @@ static int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 
 static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 {
-	struct io_buffer *kbuf;
+	struct io_ring_ctx *ctx = req->ctx;
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct msghdr msg;
 	void __user *buf = sr->buf;
@@ -5121,11 +5900,13 @@ static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 	if (unlikely(!sock))
 		return -ENOTSOCK;
 
-	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		buf = u64_to_user_ptr(kbuf->addr);
+retry_multishot:
+	if ((req->flags & REQ_F_BUFFER_SELECT) && !io_buffer_selected(req)) {
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
+		/* stash it so a retry uses the same buffer */
+		sr->buf = buf;
 	}
 
 	ret = import_single_range(READ, buf, sr->len, &iov, &msg.msg_iter);
@@ -5146,15 +5927,47 @@ static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 		min_ret = iov_iter_count(&msg.msg_iter);
 
 	ret = sock_recvmsg(sock, &msg, flags);
-	if (force_nonblock && ret == -EAGAIN)
+	if (force_nonblock && ret == -EAGAIN) {
+		if (req->flags & REQ_F_APOLL_MULTISHOT) {
+			io_kbuf_recycle(req, sr->bgid);
+			/* the poll handler is still armed, it'll retry us */
+			if (issue_flags & IO_URING_F_MULTISHOT)
+				return 0;
+		}
 		return -EAGAIN;
+	}
 	if (ret == -ERESTARTSYS)
 		ret = -EINTR;
 out_free:
-	if (req->flags & REQ_F_BUFFER_SELECTED)
+	if (io_buffer_selected(req))
 		cflags = io_put_recv_kbuf(req);
 	if (ret < min_ret || ((flags & MSG_WAITALL) && (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))))
 		req_set_fail(req);
+
+	if (req->flags & REQ_F_APOLL_MULTISHOT) {
+		if (ret > 0) {
+			bool filled;
+
+			spin_lock(&ctx->completion_lock);
+			filled = io_fill_cqe_aux(ctx, req->user_data, ret,
+						 cflags | IORING_CQE_F_MORE);
+			io_commit_cqring(ctx);
+			spin_unlock(&ctx->completion_lock);
+			if (filled) {
+				io_cqring_ev_posted(ctx);
+				cflags = 0;
+				sr->len = 0;
+				goto retry_multishot;
+			}
+		}
+		/* EOF, error or CQ overflow, this is the final CQE */
+		if (issue_flags & IO_URING_F_MULTISHOT) {
+			req->result = ret;
+			req->compl.cflags = cflags;
+			return IO_STOP_MULTISHOT;
+		}
+	}
+
 	__io_req_complete(req, issue_flags, ret, cflags);
 	return 0;
 }
@@ -5162,10 +5975,11 @@ static int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_accept *accept = &req->accept;
+	unsigned flags;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
 		return -EINVAL;
-	if (sqe->ioprio || sqe->len || sqe->buf_index)
+	if (sqe->len || sqe->buf_index)
 		return -EINVAL;
 
 	accept->addr = u64_to_user_ptr(READ_ONCE(sqe->addr));
@@ -5173,6 +5987,10 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 	accept->flags = READ_ONCE(sqe->accept_flags);
 	accept->nofile = rlimit(RLIMIT_NOFILE);
 
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_ACCEPT_MULTISHOT)
+		return -EINVAL;
+
 	accept->file_slot = READ_ONCE(sqe->file_index);
 	if (accept->file_slot && (accept->flags & SOCK_CLOEXEC))
 		return -EINVAL;
@@ -5180,11 +5998,22 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return -EINVAL;
 	if (SOCK_NONBLOCK != O_NONBLOCK && (accept->flags & SOCK_NONBLOCK))
 		accept->flags = (accept->flags & ~SOCK_NONBLOCK) | O_NONBLOCK;
+	if (flags & IORING_ACCEPT_MULTISHOT) {
+		/*
+		 * A single fixed slot can't hold more than one file, but
+		 * letting the kernel allocate a slot per connection is fine.
+		 */
+		if (accept->file_slot &&
+		    accept->file_slot != IORING_FILE_INDEX_ALLOC)
+			return -EINVAL;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+	}
 	return 0;
 }
 
 static int io_accept(struct io_kiocb *req, unsigned int issue_flags)
 {
+	struct io_ring_ctx *ctx = req->ctx;
 	struct io_accept *accept = &req->accept;
 	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
 	unsigned int file_flags = force_nonblock ? O_NONBLOCK : 0;
@@ -5195,18 +6024,114 @@ static int io_accept(struct io_kiocb *req, unsigned int issue_flags)
 	if (req->file->f_flags & O_NONBLOCK)
 		req->flags |= REQ_F_NOWAIT;
 
+retry:
 	if (!fixed) {
 		fd = __get_unused_fd_flags(accept->flags, accept->nofile);
 		if (unlikely(fd < 0))
 			return fd;
 	}
-	file = do_accept(req->file, file_flags, accept->addr, accept->addr_len,
-			 accept->flags);
+	file = do_accept(req->file, file_flags, accept->addr, accept->addr_len,
+			 accept->flags);
+	if (IS_ERR(file)) {
+		if (!fixed)
+			put_unused_fd(fd);
+		ret = PTR_ERR(file);
+		if (ret == -EAGAIN && force_nonblock) {
+			/*
+			 * If we're reissued by the multishot poll handler, it
+			 * is still armed and will retry us on the next
+			 * connection, don't make the caller arm it again.
+			 */
+			if (issue_flags & IO_URING_F_MULTISHOT)
+				ret = 0;
+			return ret;
+		}
+		if (ret == -ERESTARTSYS)
+			ret = -EINTR;
+		req_set_fail(req);
+	} else if (!fixed) {
+		fd_install(fd, file);
+		ret = fd;
+	} else {
+		ret = io_install_fixed_file(req, file, issue_flags,
+					    accept->file_slot);
+	}
+
+	if (!(req->flags & REQ_F_APOLL_MULTISHOT)) {
+		__io_req_complete(req, issue_flags, ret, 0);
+		return 0;
+	}
+	if (ret >= 0) {
+		bool filled;
+
+		spin_lock(&ctx->completion_lock);
+		filled = io_fill_cqe_aux(ctx, req->user_data, ret,
+					 IORING_CQE_F_MORE);
+		io_commit_cqring(ctx);
+		spin_unlock(&ctx->completion_lock);
+		if (filled) {
+			io_cqring_ev_posted(ctx);
+			goto retry;
+		}
+		ret = -ECANCELED;
+	}
+
+	return ret;
+}
+
+static int io_socket_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_socket *sock = &req->sock;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->addr || sqe->rw_flags || sqe->buf_index)
+		return -EINVAL;
+
+	sock->domain = READ_ONCE(sqe->fd);
+	sock->type = READ_ONCE(sqe->off);
+	sock->protocol = READ_ONCE(sqe->len);
+	sock->file_slot = READ_ONCE(sqe->file_index);
+	sock->nofile = rlimit(RLIMIT_NOFILE);
+
+	sock->flags = sock->type & ~SOCK_TYPE_MASK;
+	if (sock->file_slot && (sock->flags & SOCK_CLOEXEC))
+		return -EINVAL;
+	if (sock->flags & ~(SOCK_CLOEXEC | SOCK_NONBLOCK))
+		return -EINVAL;
+	if (SOCK_NONBLOCK != O_NONBLOCK && (sock->flags & SOCK_NONBLOCK))
+		sock->flags = (sock->flags & ~SOCK_NONBLOCK) | O_NONBLOCK;
+	return 0;
+}
+
+static int io_socket(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_socket *sock = &req->sock;
+	bool fixed = !!sock->file_slot;
+	struct socket *newsock;
+	struct file *file;
+	int ret, fd;
+
+	if (!fixed) {
+		fd = __get_unused_fd_flags(sock->flags, sock->nofile);
+		if (unlikely(fd < 0))
+			return fd;
+	}
+
+	ret = sock_create(sock->domain, sock->type & SOCK_TYPE_MASK,
+			  sock->protocol, &newsock);
+	if (ret < 0) {
+		file = ERR_PTR(ret);
+	} else {
+		/* releases newsock on failure */
+		file = sock_alloc_file(newsock, sock->flags, NULL);
+	}
+
 	if (IS_ERR(file)) {
 		if (!fixed)
 			put_unused_fd(fd);
 		ret = PTR_ERR(file);
-		if (ret == -EAGAIN && force_nonblock)
+		if (ret == -EAGAIN && (issue_flags & IO_URING_F_NONBLOCK))
 			return -EAGAIN;
 		if (ret == -ERESTARTSYS)
 			ret = -EINTR;
@@ -5216,7 +6141,9 @@ static int io_accept(struct io_kiocb *req, unsigned int issue_flags)
 		ret = fd;
 	} else {
 		ret = io_install_fixed_file(req, file, issue_flags,
-					    accept->file_slot - 1);
+					    sock->file_slot);
+		if (ret < 0)
+			req_set_fail(req);
 	}
 	__io_req_complete(req, issue_flags, ret, 0);
 	return 0;
@@ -5310,6 +6237,8 @@ IO_NETOP_PREP_ASYNC(sendmsg);
 IO_NETOP_PREP_ASYNC(recvmsg);
 IO_NETOP_PREP_ASYNC(connect);
 IO_NETOP_PREP(accept);
+IO_NETOP_PREP(socket);
+IO_NETOP_PREP(send_zc);
 IO_NETOP_FN(send);
 IO_NETOP_FN(recv);
 #endif /* CONFIG_NET */
@@ -5438,15 +6367,22 @@ static void io_poll_remove_entries(struct io_kiocb *req)
 	rcu_read_unlock();
 }
 
+enum {
+	IO_POLL_NO_ACTION = 1,
+	IO_POLL_REMOVE_POLL_USE_RES,
+};
+
 /*
  * All poll tw should go through this. Checks for poll events, manages
  * references, does rewait, etc.
  *
- * Returns a negative error on failure. >0 when no action require, which is
- * either spurious wakeup or multishot CQE is served. 0 when it's done with
- * the request, then the mask is stored in req->result.
+ * Returns a negative error on failure. IO_POLL_NO_ACTION when no action
+ * require, which is either spurious wakeup or multishot CQE is served.
+ * IO_POLL_REMOVE_POLL_USE_RES when a multishot request is done and its final
+ * CQE is in req->result and req->compl.cflags. 0 when it's done with the
+ * request, then the mask is stored in req->result.
  */
-static int io_poll_check_events(struct io_kiocb *req)
+static int io_poll_check_events(struct io_kiocb *req, bool *locked)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 	struct io_poll_iocb *poll = io_poll_get_single(req);
@@ -5488,8 +6424,20 @@ static int io_poll_check_events(struct io_kiocb *req)
 			req->result = vfs_poll(req->file, &pt) & poll->events;
 		}
 
-		/* multishot, just fill an CQE and proceed */
-		if (req->result && !(poll->events & EPOLLONESHOT)) {
+		/* multishot poll driven op, it posts its own CQEs */
+		if (req->result && (req->flags & REQ_F_APOLL_MULTISHOT)) {
+			int ret;
+
+			/* buffer selection and recycling need the lock */
+			io_tw_lock(ctx, locked);
+			ret = io_issue_sqe(req, IO_URING_F_NONBLOCK |
+						IO_URING_F_MULTISHOT);
+			if (ret == IO_STOP_MULTISHOT)
+				return IO_POLL_REMOVE_POLL_USE_RES;
+			if (ret)
+				return ret;
+		} else if (req->result && !(poll->events & EPOLLONESHOT)) {
+			/* multishot, just fill an CQE and proceed */
 			__poll_t mask = mangle_poll(req->result & poll->events);
 			bool filled;
 
@@ -5515,7 +6463,7 @@ static int io_poll_check_events(struct io_kiocb *req)
 	} while (atomic_sub_return(v & IO_POLL_REF_MASK, &req->poll_refs) &
 					IO_POLL_REF_MASK);
 
-	return 1;
+	return IO_POLL_NO_ACTION;
 }
 
 static void io_poll_task_func(struct io_kiocb *req, bool *locked)
@@ -5523,8 +6471,8 @@ static void io_poll_task_func(struct io_kiocb *req, bool *locked)
 	struct io_ring_ctx *ctx = req->ctx;
 	int ret;
 
-	ret = io_poll_check_events(req);
-	if (ret > 0)
+	ret = io_poll_check_events(req, locked);
+	if (ret == IO_POLL_NO_ACTION)
 		return;
 
 	if (!ret) {
@@ -5546,8 +6494,8 @@ static void io_apoll_task_func(struct io_kiocb *req, bool *locked)
 	struct io_ring_ctx *ctx = req->ctx;
 	int ret;
 
-	ret = io_poll_check_events(req);
-	if (ret > 0)
+	ret = io_poll_check_events(req, locked);
+	if (ret == IO_POLL_NO_ACTION)
 		return;
 
 	io_poll_remove_entries(req);
@@ -5555,7 +6503,9 @@ static void io_apoll_task_func(struct io_kiocb *req, bool *locked)
 	hash_del(&req->hash_node);
 	spin_unlock(&ctx->completion_lock);
 
-	if (!ret)
+	if (ret == IO_POLL_REMOVE_POLL_USE_RES)
+		io_req_complete_post(req, req->result, req->compl.cflags);
+	else if (!ret)
 		io_req_task_submit(req, locked);
 	else
 		io_req_complete_failed(req, ret);
@@ -5723,6 +6673,7 @@ static int __io_arm_poll_handler(struct io_kiocb *req,
 		/* can't multishot if failed, just queue the event we've got */
 		if (unlikely(ipt->error || !ipt->nr_entries)) {
 			poll->events |= EPOLLONESHOT;
+			req->flags &= ~REQ_F_APOLL_MULTISHOT;
 			ipt->error = 0;
 		}
 		__io_poll_execute(req, mask);
@@ -5759,7 +6710,7 @@ static int io_arm_poll_handler(struct io_kiocb *req)
 	struct io_ring_ctx *ctx = req->ctx;
 	struct async_poll *apoll;
 	struct io_poll_table ipt;
-	__poll_t mask = EPOLLONESHOT | POLLERR | POLLPRI;
+	__poll_t mask = POLLERR | POLLPRI;
 	int ret;
 
 	if (!req->file || !file_can_poll(req->file))
@@ -5779,6 +6730,8 @@ static int io_arm_poll_handler(struct io_kiocb *req)
 	} else {
 		mask |= POLLOUT | POLLWRNORM;
 	}
+	if (!(req->flags & REQ_F_APOLL_MULTISHOT))
+		mask |= EPOLLONESHOT;
 
 	apoll = kmalloc(sizeof(*apoll), GFP_ATOMIC);
 	if (unlikely(!apoll))
@@ -6506,6 +7459,14 @@ static int io_req_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return io_symlinkat_prep(req, sqe);
 	case IORING_OP_LINKAT:
 		return io_linkat_prep(req, sqe);
+	case IORING_OP_SEND_ZC:
+		return io_send_zc_prep(req, sqe);
+	case IORING_OP_URING_CMD:
+		return io_uring_cmd_prep(req, sqe);
+	case IORING_OP_MSG_RING:
+		return io_msg_ring_prep(req, sqe);
+	case IORING_OP_SOCKET:
+		return io_socket_prep(req, sqe);
 	}
 
 	printk_once(KERN_WARNING "io_uring: unhandled opcode %d\n",
@@ -6533,6 +7494,8 @@ static int io_req_prep_async(struct io_kiocb *req)
 		return io_recvmsg_prep_async(req);
 	case IORING_OP_CONNECT:
 		return io_connect_prep_async(req);
+	case IORING_OP_URING_CMD:
+		return io_uring_cmd_prep_async(req);
 	}
 	printk_once(KERN_WARNING "io_uring: prep_async() bad opcode %d\n",
 		    req->opcode);
@@ -6626,19 +7589,8 @@ static bool io_drain_req(struct io_kiocb *req)
 
 static void io_clean_op(struct io_kiocb *req)
 {
-	if (req->flags & REQ_F_BUFFER_SELECTED) {
-		switch (req->opcode) {
-		case IORING_OP_READV:
-		case IORING_OP_READ_FIXED:
-		case IORING_OP_READ:
-			kfree((void *)(unsigned long)req->rw.addr);
-			break;
-		case IORING_OP_RECVMSG:
-		case IORING_OP_RECV:
-			kfree(req->sr_msg.kbuf);
-			break;
-		}
-	}
+	if (req->flags & REQ_F_BUFFER_SELECTED)
+		kfree(req->kbuf);
 
 	if (req->flags & REQ_F_NEED_CLEANUP) {
 		switch (req->opcode) {
@@ -6683,6 +7635,13 @@ static void io_clean_op(struct io_kiocb *req)
 			putname(req->hardlink.oldpath);
 			putname(req->hardlink.newpath);
 			break;
+		case IORING_OP_SEND_ZC:
+			kfree(req->sendzc.notif);
+			break;
+		case IORING_OP_MSG_RING:
+			if (req->msg.src_file)
+				fput(req->msg.src_file);
+			break;
 		}
 	}
 	if ((req->flags & REQ_F_POLLED) && req->apoll) {
@@ -6820,6 +7779,18 @@ static int io_issue_sqe(struct io_kiocb *req, unsigned int issue_flags)
 	case IORING_OP_LINKAT:
 		ret = io_linkat(req, issue_flags);
 		break;
+	case IORING_OP_SEND_ZC:
+		ret = io_send_zc(req, issue_flags);
+		break;
+	case IORING_OP_URING_CMD:
+		ret = io_uring_cmd(req, issue_flags);
+		break;
+	case IORING_OP_MSG_RING:
+		ret = io_msg_ring(req, issue_flags);
+		break;
+	case IORING_OP_SOCKET:
+		ret = io_socket(req, issue_flags);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -6883,20 +7854,6 @@ static void io_wq_submit_work(struct io_wq_work *work)
 		io_req_task_queue_fail(req, ret);
 }
 
-static inline struct io_fixed_file *io_fixed_file_slot(struct io_file_table *table,
-						       unsigned i)
-{
-	return &table->files[i];
-}
-
-static inline struct file *io_file_from_index(struct io_ring_ctx *ctx,
-					      int index)
-{
-	struct io_fixed_file *slot = io_fixed_file_slot(&ctx->file_table, index);
-
-	return (struct file *) (slot->file_ptr & FFS_MASK);
-}
-
 static void io_fixed_file_set(struct io_fixed_file *file_slot, struct file *file)
 {
 	unsigned long file_ptr = (unsigned long) file;
@@ -7161,7 +8118,7 @@ static int io_init_req(struct io_ring_ctx *ctx, struct io_kiocb *req,
 	 */
 	if (!state->plug_started && state->ios_left > 1 &&
 	    io_op_defs[req->opcode].plug) {
-		blk_start_plug(&state->plug);
+		blk_start_plug_nr_ios(&state->plug, state->ios_left);
 		state->plug_started = true;
 	}
 
@@ -7318,8 +8275,12 @@ static const struct io_uring_sqe *io_get_sqe(struct io_ring_ctx *ctx)
 	 *    though the application is the one updating it.
 	 */
 	head = READ_ONCE(ctx->sq_array[sq_idx]);
-	if (likely(head < ctx->sq_entries))
+	if (likely(head < ctx->sq_entries)) {
+		/* double index for 128-byte SQEs, twice as long */
+		if (ctx->flags & IORING_SETUP_SQE128)
+			head <<= 1;
 		return &ctx->sq_sqes[head];
+	}
 
 	/* drop invalid entries */
 	ctx->cq_extra--;
@@ -7579,7 +8540,8 @@ static int io_wake_function(struct wait_queue_entry *curr, unsigned int mode,
 	 * Cannot safely flush overflowed CQEs from here, ensure we wake up
 	 * the task, and the next invocation will do it.
 	 */
-	if (io_should_wake(iowq) || test_bit(0, &iowq->ctx->check_cq_overflow))
+	if (io_should_wake(iowq) || test_bit(0, &iowq->ctx->check_cq_overflow) ||
+	    !llist_empty(&iowq->ctx->work_llist))
 		return autoremove_wake_function(curr, mode, wake_flags, key);
 	return -1;
 }
@@ -7609,6 +8571,9 @@ static inline int io_cqring_wait_schedule(struct io_ring_ctx *ctx,
 	/* let the caller flush overflows, retry */
 	if (test_bit(0, &ctx->check_cq_overflow))
 		return 1;
+	/* deferred task_work to run, retry */
+	if (!llist_empty(&ctx->work_llist))
+		return 1;
 
 	if (!schedule_hrtimeout(&timeout, HRTIMER_MODE_ABS))
 		return -ETIME;
@@ -7629,6 +8594,8 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 	int ret;
 
 	do {
+		if (ctx->flags & IORING_SETUP_DEFER_TASKRUN)
+			io_run_local_work(ctx);
 		io_cqring_overflow_flush(ctx);
 		if (io_cqring_events(ctx) >= min_events)
 			return 0;
@@ -7666,6 +8633,8 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 
 	trace_io_uring_cqring_wait(ctx, min_events);
 	do {
+		if (ctx->flags & IORING_SETUP_DEFER_TASKRUN)
+			io_run_local_work(ctx);
 		/* if we can't even flush overflow, don't wait for more */
 		if (!io_cqring_overflow_flush(ctx)) {
 			ret = -EBUSY;
@@ -7911,13 +8880,25 @@ static bool io_alloc_file_tables(struct io_file_table *table, unsigned nr_files)
 {
 	table->files = kvcalloc(nr_files, sizeof(table->files[0]),
 				GFP_KERNEL_ACCOUNT);
-	return !!table->files;
+	if (unlikely(!table->files))
+		return false;
+
+	table->bitmap = bitmap_zalloc(nr_files, GFP_KERNEL_ACCOUNT);
+	if (unlikely(!table->bitmap)) {
+		kvfree(table->files);
+		table->files = NULL;
+		return false;
+	}
+	table->alloc_hint = 0;
+	return true;
 }
 
 static void io_free_file_tables(struct io_file_table *table)
 {
 	kvfree(table->files);
+	bitmap_free(table->bitmap);
 	table->files = NULL;
+	table->bitmap = NULL;
 }
 
 static void __io_sqe_files_unregister(struct io_ring_ctx *ctx)
@@ -8364,6 +9345,7 @@ static int io_sqe_files_register(struct io_ring_ctx *ctx, void __user *arg,
 			goto out_fput;
 		}
 		io_fixed_file_set(io_fixed_file_slot(&ctx->file_table, i), file);
+		io_file_bitmap_set(&ctx->file_table, i);
 	}
 
 	ret = io_sqe_files_scm(ctx);
@@ -8448,58 +9430,110 @@ static int io_queue_rsrc_removal(struct io_rsrc_data *data, unsigned idx,
 	return 0;
 }
 
-static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
-				 unsigned int issue_flags, u32 slot_index)
+static int io_file_bitmap_get(struct io_ring_ctx *ctx)
 {
-	struct io_ring_ctx *ctx = req->ctx;
-	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	struct io_file_table *table = &ctx->file_table;
+	unsigned long nr = ctx->nr_user_files;
+	int ret;
+
+	do {
+		ret = find_next_zero_bit(table->bitmap, nr, table->alloc_hint);
+		if (ret != nr)
+			return ret;
+
+		if (!table->alloc_hint)
+			break;
+
+		nr = table->alloc_hint;
+		table->alloc_hint = 0;
+	} while (1);
+
+	return -ENFILE;
+}
+
+/*
+ * Install @file into the fixed file table of @ctx. @file_slot is what
+ * userspace passed in sqe->file_index: either a slot index plus one, in
+ * which case whatever was in that slot gets replaced, or
+ * IORING_FILE_INDEX_ALLOC to pick a free slot. Returns the allocated slot
+ * index for the latter and 0 for the former. Must be called with
+ * ->uring_lock held. On success the file reference is owned by the table,
+ * on failure it's left with the caller.
+ */
+static int __io_install_fixed_file(struct io_ring_ctx *ctx, struct file *file,
+				   u32 file_slot)
+{
+	bool alloc_slot = file_slot == IORING_FILE_INDEX_ALLOC;
 	bool needs_switch = false;
-	struct io_fixed_file *file_slot;
+	struct io_fixed_file *slot;
+	u32 slot_index;
 	int ret = -EBADF;
 
-	io_ring_submit_lock(ctx, !force_nonblock);
 	if (file->f_op == &io_uring_fops)
 		goto err;
 	ret = -ENXIO;
 	if (!ctx->file_data)
 		goto err;
+
+	if (alloc_slot) {
+		ret = io_file_bitmap_get(ctx);
+		if (unlikely(ret < 0))
+			goto err;
+		slot_index = ret;
+	} else {
+		slot_index = file_slot - 1;
+	}
 	ret = -EINVAL;
 	if (slot_index >= ctx->nr_user_files)
 		goto err;
 
 	slot_index = array_index_nospec(slot_index, ctx->nr_user_files);
-	file_slot = io_fixed_file_slot(&ctx->file_table, slot_index);
+	slot = io_fixed_file_slot(&ctx->file_table, slot_index);
 
-	if (file_slot->file_ptr) {
+	if (slot->file_ptr) {
 		struct file *old_file;
 
 		ret = io_rsrc_node_switch_start(ctx);
 		if (ret)
 			goto err;
 
-		old_file = (struct file *)(file_slot->file_ptr & FFS_MASK);
+		old_file = (struct file *)(slot->file_ptr & FFS_MASK);
 		ret = io_queue_rsrc_removal(ctx->file_data, slot_index,
 					    ctx->rsrc_node, old_file);
 		if (ret)
 			goto err;
-		file_slot->file_ptr = 0;
+		slot->file_ptr = 0;
+		io_file_bitmap_clear(&ctx->file_table, slot_index);
 		needs_switch = true;
 	}
 
 	*io_get_tag_slot(ctx->file_data, slot_index) = 0;
-	io_fixed_file_set(file_slot, file);
+	io_fixed_file_set(slot, file);
 	ret = io_sqe_file_register(ctx, file, slot_index);
 	if (ret) {
-		file_slot->file_ptr = 0;
+		slot->file_ptr = 0;
 		goto err;
 	}
+	io_file_bitmap_set(&ctx->file_table, slot_index);
 
-	ret = 0;
+	ret = alloc_slot ? slot_index : 0;
 err:
 	if (needs_switch)
 		io_rsrc_node_switch(ctx, ctx->file_data);
+	return ret;
+}
+
+static int io_install_fixed_file(struct io_kiocb *req, struct file *file,
+				 unsigned int issue_flags, u32 file_slot)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
+	int ret;
+
+	io_ring_submit_lock(ctx, !force_nonblock);
+	ret = __io_install_fixed_file(ctx, file, file_slot);
 	io_ring_submit_unlock(ctx, !force_nonblock);
-	if (ret)
+	if (ret < 0)
 		fput(file);
 	return ret;
 }
@@ -8535,6 +9569,7 @@ static int io_close_fixed(struct io_kiocb *req, unsigned int issue_flags)
 		goto out;
 
 	file_slot->file_ptr = 0;
+	io_file_bitmap_clear(&ctx->file_table, offset);
 	io_rsrc_node_switch(ctx, ctx->file_data);
 	ret = 0;
 out:
@@ -8584,6 +9619,7 @@ static int __io_sqe_files_update(struct io_ring_ctx *ctx,
 			if (err)
 				break;
 			file_slot->file_ptr = 0;
+			io_file_bitmap_clear(&ctx->file_table, i);
 			needs_switch = true;
 		}
 		if (fd != -1) {
@@ -8613,6 +9649,7 @@ static int __io_sqe_files_update(struct io_ring_ctx *ctx,
 				fput(file);
 				break;
 			}
+			io_file_bitmap_set(&ctx->file_table, i);
 		}
 	}
 
@@ -8856,8 +9893,8 @@ static void *io_mem_alloc(size_t size)
 	return (void *) __get_free_pages(gfp, get_order(size));
 }
 
-static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
-				size_t *sq_offset)
+static unsigned long rings_size(struct io_ring_ctx *ctx, unsigned sq_entries,
+				unsigned cq_entries, size_t *sq_offset)
 {
 	struct io_rings *rings;
 	size_t off, sq_array_size;
@@ -8865,6 +9902,10 @@ static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
 	off = struct_size(rings, cqes, cq_entries);
 	if (off == SIZE_MAX)
 		return SIZE_MAX;
+	if (ctx->flags & IORING_SETUP_CQE32) {
+		if (check_shl_overflow(off, 1, &off))
+			return SIZE_MAX;
+	}
 
 #ifdef CONFIG_SMP
 	off = ALIGN(off, SMP_CACHE_BYTES);
@@ -8885,12 +9926,25 @@ static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
 	return off;
 }
 
+static void io_buffer_dma_unmap(struct io_mapped_ubuf *imu)
+{
+#ifdef CONFIG_BLOCK
+	if (!imu->dma_tag)
+		return;
+	bdev_dma_unmap(I_BDEV(imu->dma_file->f_mapping->host), imu->dma_tag);
+	fput(imu->dma_file);
+	imu->dma_tag = NULL;
+	imu->dma_file = NULL;
+#endif
+}
+
 static void io_buffer_unmap(struct io_ring_ctx *ctx, struct io_mapped_ubuf **slot)
 {
 	struct io_mapped_ubuf *imu = *slot;
 	unsigned int i;
 
 	if (imu != ctx->dummy_ubuf) {
+		io_buffer_dma_unmap(imu);
 		for (i = 0; i < imu->nr_bvecs; i++)
 			unpin_user_page(imu->bvec[i].bv_page);
 		if (imu->acct_pages)
@@ -9033,30 +10087,18 @@ static int io_buffer_account_pin(struct io_ring_ctx *ctx, struct page **pages,
 	return ret;
 }
 
-static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
-				  struct io_mapped_ubuf **pimu,
-				  struct page **last_hpage)
+static struct page **io_pin_pages(unsigned long ubuf, unsigned long len,
+				  int *npages)
 {
-	struct io_mapped_ubuf *imu = NULL;
+	unsigned long start, end, nr_pages;
 	struct vm_area_struct **vmas = NULL;
 	struct page **pages = NULL;
-	unsigned long off, start, end, ubuf;
-	size_t size;
-	int ret, pret, nr_pages, i;
-
-	if (!iov->iov_base) {
-		*pimu = ctx->dummy_ubuf;
-		return 0;
-	}
+	int i, pret, ret = -ENOMEM;
 
-	ubuf = (unsigned long) iov->iov_base;
-	end = (ubuf + iov->iov_len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	end = (ubuf + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
 	start = ubuf >> PAGE_SHIFT;
 	nr_pages = end - start;
 
-	*pimu = NULL;
-	ret = -ENOMEM;
-
 	pages = kvmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
 	if (!pages)
 		goto done;
@@ -9066,10 +10108,6 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 	if (!vmas)
 		goto done;
 
-	imu = kvmalloc(struct_size(imu, bvec, nr_pages), GFP_KERNEL);
-	if (!imu)
-		goto done;
-
 	ret = 0;
 	mmap_read_lock(current->mm);
 	pret = pin_user_pages(ubuf, nr_pages, FOLL_WRITE | FOLL_LONGTERM,
@@ -9087,6 +10125,7 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 				break;
 			}
 		}
+		*npages = nr_pages;
 	} else {
 		ret = pret < 0 ? pret : -EFAULT;
 	}
@@ -9098,12 +10137,51 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 		 */
 		if (pret > 0)
 			unpin_user_pages(pages, pret);
+	}
+done:
+	kvfree(vmas);
+	if (ret < 0) {
+		kvfree(pages);
+		pages = ERR_PTR(ret);
+	}
+	return pages;
+}
+
+static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
+				  struct io_mapped_ubuf **pimu,
+				  struct page **last_hpage)
+{
+	struct io_mapped_ubuf *imu = NULL;
+	struct page **pages = NULL;
+	unsigned long off, ubuf;
+	size_t size;
+	int ret, nr_pages, i;
+
+	if (!iov->iov_base) {
+		*pimu = ctx->dummy_ubuf;
+		return 0;
+	}
+
+	ubuf = (unsigned long) iov->iov_base;
+	*pimu = NULL;
+	ret = -ENOMEM;
+
+	pages = io_pin_pages(ubuf, iov->iov_len, &nr_pages);
+	if (IS_ERR(pages)) {
+		ret = PTR_ERR(pages);
+		pages = NULL;
 		goto done;
 	}
 
-	ret = io_buffer_account_pin(ctx, pages, pret, imu, last_hpage);
+	imu = kvmalloc(struct_size(imu, bvec, nr_pages), GFP_KERNEL);
+	if (!imu) {
+		unpin_user_pages(pages, nr_pages);
+		goto done;
+	}
+
+	ret = io_buffer_account_pin(ctx, pages, nr_pages, imu, last_hpage);
 	if (ret) {
-		unpin_user_pages(pages, pret);
+		unpin_user_pages(pages, nr_pages);
 		goto done;
 	}
 
@@ -9123,16 +10201,76 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 	imu->ubuf = ubuf;
 	imu->ubuf_end = ubuf + iov->iov_len;
 	imu->nr_bvecs = nr_pages;
+	imu->dma_file = NULL;
+	imu->dma_tag = NULL;
 	*pimu = imu;
 	ret = 0;
 done:
 	if (ret)
 		kvfree(imu);
 	kvfree(pages);
-	kvfree(vmas);
 	return ret;
 }
 
+/*
+ * Map all registered buffers for DMA by the block device @fd is open on, so
+ * that fixed buffer IO to @fd doesn't map and unmap the buffers every time.
+ * A buffer is mapped for one device at a time.
+ */
+static int io_register_map_buffers(struct io_ring_ctx *ctx, void __user *arg)
+{
+#ifdef CONFIG_BLOCK
+	struct block_device *bdev;
+	struct file *file;
+	unsigned int i;
+	__s32 fd;
+	int ret = 0;
+
+	if (copy_from_user(&fd, arg, sizeof(fd)))
+		return -EFAULT;
+	if (!ctx->user_bufs)
+		return -ENXIO;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+	if (!S_ISBLK(file_inode(file)->i_mode)) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+	bdev = I_BDEV(file->f_mapping->host);
+
+	for (i = 0; i < ctx->nr_user_bufs; i++) {
+		struct io_mapped_ubuf *imu = ctx->user_bufs[i];
+		void *tag;
+
+		if (imu == ctx->dummy_ubuf)
+			continue;
+
+		io_buffer_dma_unmap(imu);
+		tag = bdev_dma_map(bdev, imu->bvec, imu->nr_bvecs);
+		if (IS_ERR(tag)) {
+			ret = PTR_ERR(tag);
+			break;
+		}
+		imu->dma_file = get_file(file);
+		imu->dma_tag = tag;
+	}
+
+	if (ret) {
+		while (i--) {
+			if (ctx->user_bufs[i] != ctx->dummy_ubuf)
+				io_buffer_dma_unmap(ctx->user_bufs[i]);
+		}
+	}
+out:
+	fput(file);
+	return ret;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
 static int io_buffers_map_alloc(struct io_ring_ctx *ctx, unsigned int nr_args)
 {
 	ctx->user_bufs = kcalloc(nr_args, sizeof(*ctx->user_bufs), GFP_KERNEL);
@@ -9308,13 +10446,99 @@ static int io_eventfd_unregister(struct io_ring_ctx *ctx)
 	return -ENXIO;
 }
 
+static void io_free_buf_ring(struct io_buffer_list *bl)
+{
+	unpin_user_pages(bl->buf_pages, bl->buf_nr_pages);
+	kvfree(bl->buf_pages);
+	kfree(bl);
+}
+
 static void io_destroy_buffers(struct io_ring_ctx *ctx)
 {
+	struct io_buffer_list *bl;
 	struct io_buffer *buf;
 	unsigned long index;
 
 	xa_for_each(&ctx->io_buffers, index, buf)
 		__io_remove_buffers(ctx, buf, index, -1U);
+
+	xa_for_each(&ctx->io_buf_rings, index, bl) {
+		xa_erase(&ctx->io_buf_rings, index);
+		io_free_buf_ring(bl);
+	}
+	xa_destroy(&ctx->io_buf_rings);
+}
+
+static int io_register_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+	struct page **pages;
+	int nr_pages, ret;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+	if (!reg.ring_addr)
+		return -EFAULT;
+	if (reg.ring_addr & ~PAGE_MASK)
+		return -EINVAL;
+	if (!is_power_of_2(reg.ring_entries))
+		return -EINVAL;
+	/* cannot disambiguate full vs empty due to head/tail size */
+	if (reg.ring_entries >= 65536)
+		return -EINVAL;
+
+	if (xa_load(&ctx->io_buffers, reg.bgid) ||
+	    xa_load(&ctx->io_buf_rings, reg.bgid))
+		return -EEXIST;
+
+	bl = kzalloc(sizeof(*bl), GFP_KERNEL_ACCOUNT);
+	if (!bl)
+		return -ENOMEM;
+
+	pages = io_pin_pages(reg.ring_addr,
+			     struct_size(br, bufs, reg.ring_entries),
+			     &nr_pages);
+	if (IS_ERR(pages)) {
+		kfree(bl);
+		return PTR_ERR(pages);
+	}
+
+	br = page_address(pages[0]);
+	bl->buf_pages = pages;
+	bl->buf_nr_pages = nr_pages;
+	bl->buf_ring = br;
+	bl->bgid = reg.bgid;
+	bl->mask = reg.ring_entries - 1;
+
+	ret = xa_err(xa_store(&ctx->io_buf_rings, reg.bgid, bl,
+			      GFP_KERNEL_ACCOUNT));
+	if (ret)
+		io_free_buf_ring(bl);
+	return ret;
+}
+
+static int io_unregister_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+
+	bl = xa_erase(&ctx->io_buf_rings, reg.bgid);
+	if (!bl)
+		return -ENOENT;
+
+	/* selected buffers are consumed, inflight requests don't need @bl */
+	io_free_buf_ring(bl);
+	return 0;
 }
 
 static void io_req_cache_free(struct list_head *list)
@@ -9369,6 +10593,8 @@ static void io_ring_ctx_free(struct io_ring_ctx *ctx)
 	io_destroy_buffers(ctx);
 	if (ctx->sq_creds)
 		put_cred(ctx->sq_creds);
+	if (ctx->submitter_task)
+		put_task_struct(ctx->submitter_task);
 
 	/* there are no registered resources left, nobody uses it */
 	if (ctx->rsrc_node)
@@ -9403,6 +10629,7 @@ static void io_ring_ctx_free(struct io_ring_ctx *ctx)
 		io_wq_put_hash(ctx->hash_map);
 	kfree(ctx->cancel_hash);
 	kfree(ctx->dummy_ubuf);
+	kfree(ctx->iowq_node_limits);
 	kfree(ctx);
 }
 
@@ -9710,6 +10937,12 @@ static void io_uring_try_cancel_requests(struct io_ring_ctx *ctx,
 		ret |= io_cancel_defer_files(ctx, task, cancel_all);
 		ret |= io_poll_remove_all(ctx, task, cancel_all);
 		ret |= io_kill_timeouts(ctx, task, cancel_all);
+		if (ctx->flags & IORING_SETUP_DEFER_TASKRUN) {
+			if (ctx->submitter_task == current)
+				ret |= io_run_local_work(ctx) > 0;
+			else
+				ret |= io_move_task_work_from_local(ctx);
+		}
 		if (task)
 			ret |= io_run_task_work();
 		if (!ret)
@@ -9734,10 +10967,27 @@ static int __io_uring_add_tctx_node(struct io_ring_ctx *ctx)
 			unsigned int limits[2] = { ctx->iowq_limits[0],
 						   ctx->iowq_limits[1], };
 
-			ret = io_wq_max_workers(tctx->io_wq, limits);
+			ret = io_wq_max_workers(tctx->io_wq, limits,
+						NUMA_NO_NODE);
 			if (ret)
 				return ret;
 		}
+		if (ctx->iowq_node_limits) {
+			int nid;
+
+			for_each_node(nid) {
+				unsigned int limits[2] = {
+					ctx->iowq_node_limits[nid][0],
+					ctx->iowq_node_limits[nid][1],
+				};
+
+				if (!limits[0] && !limits[1])
+					continue;
+				ret = io_wq_max_workers(tctx->io_wq, limits, nid);
+				if (ret)
+					return ret;
+			}
+		}
 	}
 	if (!xa_load(&tctx->xa, (unsigned long)ctx)) {
 		node = kmalloc(sizeof(*node), GFP_KERNEL);
@@ -10074,6 +11324,10 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 		}
 		submitted = to_submit;
 	} else if (to_submit) {
+		ret = -EEXIST;
+		if (unlikely(ctx->submitter_task &&
+			     ctx->submitter_task != current))
+			goto out;
 		ret = io_uring_add_tctx_node(ctx);
 		if (unlikely(ret))
 			goto out;
@@ -10092,6 +11346,12 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 		if (unlikely(ret))
 			goto out;
 
+		/* only the submitter may run deferred task_work */
+		ret = -EEXIST;
+		if ((ctx->flags & IORING_SETUP_DEFER_TASKRUN) &&
+		    unlikely(ctx->submitter_task != current))
+			goto out;
+
 		min_complete = min(min_complete, ctx->cq_entries);
 
 		/*
@@ -10194,6 +11454,19 @@ static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 		xa_for_each(&ctx->personalities, index, cred)
 			io_uring_show_cred(m, index, cred);
 	}
+	if (has_lock && !list_empty(&ctx->tctx_list)) {
+		struct io_tctx_node *node;
+
+		seq_printf(m, "IoWq:\n");
+		list_for_each_entry(node, &ctx->tctx_list, ctx_node) {
+			struct io_uring_task *tctx = node->task->io_uring;
+
+			if (!tctx || !tctx->io_wq)
+				continue;
+			seq_printf(m, " pid=%d\n", task_pid_nr(node->task));
+			io_wq_show_fdinfo(tctx->io_wq, m);
+		}
+	}
 	seq_printf(m, "PollList:\n");
 	spin_lock(&ctx->completion_lock);
 	for (i = 0; i < (1U << ctx->cancel_hash_bits); i++) {
@@ -10243,7 +11516,7 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	ctx->sq_entries = p->sq_entries;
 	ctx->cq_entries = p->cq_entries;
 
-	size = rings_size(p->sq_entries, p->cq_entries, &sq_array_offset);
+	size = rings_size(ctx, p->sq_entries, p->cq_entries, &sq_array_offset);
 	if (size == SIZE_MAX)
 		return -EOVERFLOW;
 
@@ -10258,7 +11531,10 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	rings->sq_ring_entries = p->sq_entries;
 	rings->cq_ring_entries = p->cq_entries;
 
-	size = array_size(sizeof(struct io_uring_sqe), p->sq_entries);
+	if (p->flags & IORING_SETUP_SQE128)
+		size = array_size(2 * sizeof(struct io_uring_sqe), p->sq_entries);
+	else
+		size = array_size(sizeof(struct io_uring_sqe), p->sq_entries);
 	if (size == SIZE_MAX) {
 		io_mem_free(ctx->rings);
 		ctx->rings = NULL;
@@ -10371,6 +11647,10 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	if (!ctx)
 		return -ENOMEM;
 	ctx->compat = in_compat_syscall();
+	/* with SQPOLL, the SQ thread is the only submitter anyway */
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    !(ctx->flags & (IORING_SETUP_SQPOLL | IORING_SETUP_R_DISABLED)))
+		ctx->submitter_task = get_task_struct(current);
 	if (!capable(CAP_IPC_LOCK))
 		ctx->user = get_uid(current_user());
 
@@ -10470,7 +11750,14 @@ static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
 	if (p.flags & ~(IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
 			IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE |
 			IORING_SETUP_CLAMP | IORING_SETUP_ATTACH_WQ |
-			IORING_SETUP_R_DISABLED))
+			IORING_SETUP_R_DISABLED | IORING_SETUP_SQE128 |
+			IORING_SETUP_CQE32 | IORING_SETUP_SINGLE_ISSUER |
+			IORING_SETUP_DEFER_TASKRUN))
+		return -EINVAL;
+	/* deferred task_work is run by the single submitter when it waits */
+	if ((p.flags & IORING_SETUP_DEFER_TASKRUN) &&
+	    ((p.flags & IORING_SETUP_SQPOLL) ||
+	     !(p.flags & IORING_SETUP_SINGLE_ISSUER)))
 		return -EINVAL;
 
 	return  io_uring_create(entries, &p, params);
@@ -10616,6 +11903,10 @@ static int io_register_enable_rings(struct io_ring_ctx *ctx)
 	if (ctx->restrictions.registered)
 		ctx->restricted = 1;
 
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    !(ctx->flags & IORING_SETUP_SQPOLL) && !ctx->submitter_task)
+		ctx->submitter_task = get_task_struct(current);
+
 	ctx->flags &= ~IORING_SETUP_R_DISABLED;
 	if (ctx->sq_data && wq_has_sleeper(&ctx->sq_data->wait))
 		wake_up(&ctx->sq_data->wait);
@@ -10744,13 +12035,19 @@ static int io_unregister_iowq_aff(struct io_ring_ctx *ctx)
 	return io_wq_cpu_affinity(tctx->io_wq, NULL);
 }
 
+/*
+ * @arg holds the bounded and unbounded limits. If @nr_args is 3, a third
+ * value gives the NUMA node the limits are restricted to, otherwise they're
+ * applied to the pools of all nodes.
+ */
 static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
-					void __user *arg)
+					void __user *arg, unsigned nr_args)
 	__must_hold(&ctx->uring_lock)
 {
 	struct io_tctx_node *node;
 	struct io_uring_task *tctx = NULL;
 	struct io_sq_data *sqd = NULL;
+	int nid = NUMA_NO_NODE;
 	__u32 new_count[2];
 	int i, ret;
 
@@ -10760,6 +12057,25 @@ static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
 		if (new_count[i] > INT_MAX)
 			return -EINVAL;
 
+	if (nr_args == 3) {
+		__u32 __user *unode = arg + sizeof(new_count);
+		__u32 val;
+
+		if (get_user(val, unode))
+			return -EFAULT;
+		if (val >= nr_node_ids || !node_possible(val))
+			return -EINVAL;
+		nid = val;
+
+		if (!ctx->iowq_node_limits) {
+			ctx->iowq_node_limits = kcalloc(nr_node_ids,
+						sizeof(*ctx->iowq_node_limits),
+						GFP_KERNEL_ACCOUNT);
+			if (!ctx->iowq_node_limits)
+				return -ENOMEM;
+		}
+	}
+
 	if (ctx->flags & IORING_SETUP_SQPOLL) {
 		sqd = ctx->sq_data;
 		if (sqd) {
@@ -10780,15 +12096,31 @@ static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
 	}
 
 	BUILD_BUG_ON(sizeof(new_count) != sizeof(ctx->iowq_limits));
+	BUILD_BUG_ON(sizeof(new_count) != sizeof(ctx->iowq_node_limits[0]));
 
-	for (i = 0; i < ARRAY_SIZE(new_count); i++)
-		if (new_count[i])
+	if (nid == NUMA_NO_NODE) {
+		for (i = 0; i < ARRAY_SIZE(new_count); i++) {
+			if (!new_count[i])
+				continue;
 			ctx->iowq_limits[i] = new_count[i];
-	ctx->iowq_limits_set = true;
+			/* a global limit overrides earlier per-node ones */
+			if (ctx->iowq_node_limits) {
+				int n;
+
+				for_each_node(n)
+					ctx->iowq_node_limits[n][i] = 0;
+			}
+		}
+		ctx->iowq_limits_set = true;
+	} else {
+		for (i = 0; i < ARRAY_SIZE(new_count); i++)
+			if (new_count[i])
+				ctx->iowq_node_limits[nid][i] = new_count[i];
+	}
 
 	ret = -EINVAL;
 	if (tctx && tctx->io_wq) {
-		ret = io_wq_max_workers(tctx->io_wq, new_count);
+		ret = io_wq_max_workers(tctx->io_wq, new_count, nid);
 		if (ret)
 			goto err;
 	} else {
@@ -10814,10 +12146,14 @@ static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
 		if (WARN_ON_ONCE(!tctx->io_wq))
 			continue;
 
-		for (i = 0; i < ARRAY_SIZE(new_count); i++)
-			new_count[i] = ctx->iowq_limits[i];
+		for (i = 0; i < ARRAY_SIZE(new_count); i++) {
+			if (nid == NUMA_NO_NODE)
+				new_count[i] = ctx->iowq_limits[i];
+			else
+				new_count[i] = ctx->iowq_node_limits[nid][i];
+		}
 		/* ignore errors, it always returns zero anyway */
-		(void)io_wq_max_workers(tctx->io_wq, new_count);
+		(void)io_wq_max_workers(tctx->io_wq, new_count, nid);
 	}
 	return 0;
 err:
@@ -10846,6 +12182,8 @@ static bool io_register_op_must_quiesce(int op)
 	case IORING_REGISTER_IOWQ_AFF:
 	case IORING_UNREGISTER_IOWQ_AFF:
 	case IORING_REGISTER_IOWQ_MAX_WORKERS:
+	case IORING_REGISTER_PBUF_RING:
+	case IORING_UNREGISTER_PBUF_RING:
 		return false;
 	default:
 		return true;
@@ -10894,6 +12232,9 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 	if (percpu_ref_is_dying(&ctx->refs))
 		return -ENXIO;
 
+	if (ctx->submitter_task && ctx->submitter_task != current)
+		return -EEXIST;
+
 	if (ctx->restricted) {
 		if (opcode >= IORING_REGISTER_LAST)
 			return -EINVAL;
@@ -11004,9 +12345,27 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 		break;
 	case IORING_REGISTER_IOWQ_MAX_WORKERS:
 		ret = -EINVAL;
-		if (!arg || nr_args != 2)
+		if (!arg || (nr_args != 2 && nr_args != 3))
+			break;
+		ret = io_register_iowq_max_workers(ctx, arg, nr_args);
+		break;
+	case IORING_REGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_register_pbuf_ring(ctx, arg);
+		break;
+	case IORING_UNREGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_unregister_pbuf_ring(ctx, arg);
+		break;
+	case IORING_REGISTER_MAP_BUFFERS:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
 			break;
-		ret = io_register_iowq_max_workers(ctx, arg);
+		ret = io_register_map_buffers(ctx, arg);
 		break;
 	default:
 		ret = -EINVAL;
@@ -11090,6 +12449,9 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(42, __u16,  personality);
 	BUILD_BUG_SQE_ELEM(44, __s32,  splice_fd_in);
 	BUILD_BUG_SQE_ELEM(44, __u32,  file_index);
+	BUILD_BUG_SQE_ELEM(8,  __u32,  cmd_op);
+	BUILD_BUG_SQE_ELEM(48, __u64,  addr3);
+	BUILD_BUG_ON(offsetof(struct io_uring_sqe, cmd) != 48);
 
 	BUILD_BUG_ON(sizeof(struct io_uring_files_update) !=
 		     sizeof(struct io_uring_rsrc_update));
@@ -11098,6 +12460,10 @@ static int __init io_uring_init(void)
 
 	/* ->buf_index is u16 */
 	BUILD_BUG_ON(IORING_MAX_REG_BUFFERS >= (1u << 16));
+	/* the ring tail overlays the first buffer's ->resv */
+	BUILD_BUG_ON(offsetof(struct io_uring_buf_ring, bufs) != 0);
+	BUILD_BUG_ON(offsetof(struct io_uring_buf, resv) !=
+		     offsetof(struct io_uring_buf_ring, tail));
 
 	/* should fit into one byte */
 	BUILD_BUG_ON(SQE_VALID_FLAGS >= (1 << 8));
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * BPF arena: a sparse memory region shared by BPF programs and user space.
+ *
+ * The arena is max_entries pages long, up to 4GB. Pages are only allocated
+ * when first touched, by a program through bpf_arena_ptr() or by a process
+ * through a page fault on its mmap()'ed view of the map, and then stay around
+ * until the map is freed. Both sides see the same pages but at different
+ * addresses, so what's stored in the arena refers to other parts of it by
+ * offset.
+ */
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/filter.h>
+#include <linux/memcontrol.h>
+#include <linux/mm.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/xarray.h>
+
+#define ARENA_CREATE_FLAG_MASK	(BPF_F_NUMA_NODE)
+
+#define ARENA_MAX_PAGES		((u32)(SZ_4G >> PAGE_SHIFT))
+
+struct bpf_arena {
+	struct bpf_map map;
+	u64 size;
+	struct xarray pages;	/* page offset -> struct page */
+};
+
+static struct bpf_arena *arena_of(struct bpf_map *map)
+{
+	return container_of(map, struct bpf_arena, map);
+}
+
+static struct page *arena_alloc_page(struct bpf_arena *arena, gfp_t gfp)
+{
+	int nid = arena->map.numa_node;
+#ifdef CONFIG_MEMCG_KMEM
+	struct mem_cgroup *old_memcg;
+	struct page *page;
+
+	old_memcg = set_active_memcg(arena->map.memcg);
+	page = alloc_pages_node(nid, gfp | __GFP_ZERO | __GFP_ACCOUNT, 0);
+	set_active_memcg(old_memcg);
+
+	return page;
+#else
+	return alloc_pages_node(nid, gfp | __GFP_ZERO, 0);
+#endif
+}
+
+/* Return the page at @pgoff, allocating it with @gfp if there's none yet and
+ * @gfp isn't 0.
+ */
+static struct page *arena_get_page(struct bpf_arena *arena, u32 pgoff,
+				   gfp_t gfp)
+{
+	struct page *page, *old;
+	unsigned long flags;
+
+	page = xa_load(&arena->pages, pgoff);
+	if (page || !gfp)
+		return page;
+
+	page = arena_alloc_page(arena, gfp);
+	if (!page)
+		return NULL;
+
+	/* programs may run in any context, user space faults included */
+	xa_lock_irqsave(&arena->pages, flags);
+	old = __xa_cmpxchg(&arena->pages, pgoff, NULL, page, GFP_ATOMIC);
+	xa_unlock_irqrestore(&arena->pages, flags);
+	if (old) {
+		__free_page(page);
+		return xa_is_err(old) ? NULL : old;
+	}
+
+	return page;
+}
+
+static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_arena *arena;
+
+	if (!bpf_capable())
+		return ERR_PTR(-EPERM);
+
+	if (attr->map_flags & ~ARENA_CREATE_FLAG_MASK)
+		return ERR_PTR(-EINVAL);
+
+	if (attr->key_size || attr->value_size || !attr->max_entries)
+		return ERR_PTR(-EINVAL);
+
+	if (attr->max_entries > ARENA_MAX_PAGES)
+		return ERR_PTR(-E2BIG);
+
+	arena = kzalloc(sizeof(*arena), GFP_USER | __GFP_ACCOUNT);
+	if (!arena)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&arena->map, attr);
+	arena->size = (u64)attr->max_entries << PAGE_SHIFT;
+	xa_init_flags(&arena->pages, XA_FLAGS_LOCK_IRQ);
+
+	return &arena->map;
+}
+
+static void arena_map_free(struct bpf_map *map)
+{
+	struct bpf_arena *arena = arena_of(map);
+	struct page *page;
+	unsigned long i;
+
+	/* user mappings hold the map, they are all gone by now */
+	xa_for_each(&arena->pages, i, page)
+		__free_page(page);
+	xa_destroy(&arena->pages);
+	kfree(arena);
+}
+
+static void *arena_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return ERR_PTR(-ENOTSUPP);
+}
+
+static int arena_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 flags)
+{
+	return -ENOTSUPP;
+}
+
+static int arena_map_delete_elem(struct bpf_map *map, void *key)
+{
+	return -ENOTSUPP;
+}
+
+static int arena_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+static int arena_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff + vma_pages(vma) > map->max_entries)
+		return -EINVAL;
+
+	/* pages get mapped in on fault, see arena_map_fault() */
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	return 0;
+}
+
+static vm_fault_t arena_map_fault(struct bpf_map *map, struct vm_fault *vmf)
+{
+	struct page *page;
+
+	if (vmf->pgoff >= map->max_entries)
+		return VM_FAULT_SIGBUS;
+
+	page = arena_get_page(arena_of(map), vmf->pgoff, GFP_KERNEL);
+	if (!page)
+		return VM_FAULT_OOM;
+
+	get_page(page);
+	vmf->page = page;
+	return 0;
+}
+
+BPF_CALL_3(bpf_arena_ptr, struct bpf_map *, map, u64, offset, u32, size)
+{
+	struct bpf_arena *arena = arena_of(map);
+	struct page *page;
+
+	if (unlikely(offset >= arena->size ||
+		     size > PAGE_SIZE - offset_in_page(offset)))
+		return 0;
+
+	/* no allocation from NMI, there's no lock we could safely take */
+	page = arena_get_page(arena, offset >> PAGE_SHIFT,
+			      in_nmi() ? 0 : GFP_ATOMIC | __GFP_NOWARN);
+	if (!page)
+		return 0;
+
+	return (unsigned long)page_address(page) + offset_in_page(offset);
+}
+
+const struct bpf_func_proto bpf_arena_ptr_proto = {
+	.func		= bpf_arena_ptr,
+	.gpl_only	= false,
+	.ret_type	= RET_PTR_TO_ALLOC_MEM_OR_NULL,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_CONST_ALLOC_SIZE_OR_ZERO,
+};
+
+static int arena_map_btf_id;
+const struct bpf_map_ops arena_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = arena_map_alloc,
+	.map_free = arena_map_free,
+	.map_mmap = arena_map_mmap,
+	.map_fault = arena_map_fault,
+	.map_lookup_elem = arena_map_lookup_elem,
+	.map_update_elem = arena_map_update_elem,
+	.map_delete_elem = arena_map_delete_elem,
+	.map_get_next_key = arena_map_get_next_key,
+	.map_btf_name = "bpf_arena",
+	.map_btf_id = &arena_map_btf_id,
+};
@@ -14,6 +14,8 @@
 
 #define BPF_LOCAL_STORAGE_CREATE_FLAG_MASK (BPF_F_NO_PREALLOC | BPF_F_CLONE)
 
+static atomic_t selem_cache_id = ATOMIC_INIT(0);
+
 static struct bpf_local_storage_map_bucket *
 select_bucket(struct bpf_local_storage_map *smap,
 	      struct bpf_local_storage_elem *selem)
@@ -67,8 +69,8 @@ bpf_selem_alloc(struct bpf_local_storage_map *smap, void *owner,
 	if (charge_mem && mem_charge(smap, owner, smap->elem_size))
 		return NULL;
 
-	selem = bpf_map_kzalloc(&smap->map, smap->elem_size,
-				GFP_ATOMIC | __GFP_NOWARN);
+	selem = bpf_map_kmem_cache_zalloc(&smap->map, smap->selem_cache,
+					  GFP_ATOMIC | __GFP_NOWARN);
 	if (selem) {
 		if (value)
 			copy_map_value(&smap->map, SDATA(selem)->data, value);
@@ -81,6 +83,24 @@ bpf_selem_alloc(struct bpf_local_storage_map *smap, void *owner,
 	return NULL;
 }
 
+/* For a selem that was never published */
+void bpf_selem_free(struct bpf_local_storage_map *smap,
+		    struct bpf_local_storage_elem *selem)
+{
+	kmem_cache_free(smap->selem_cache, selem);
+}
+
+static void bpf_selem_free_rcu(struct rcu_head *rcu)
+{
+	struct bpf_local_storage_elem *selem;
+	struct bpf_local_storage_map *smap;
+
+	selem = container_of(rcu, struct bpf_local_storage_elem, rcu);
+	/* bpf_local_storage_map_free() waits for this callback */
+	smap = rcu_dereference_raw(SDATA(selem)->smap);
+	kmem_cache_free(smap->selem_cache, selem);
+}
+
 /* local_storage->lock must be held and selem->local_storage == local_storage.
  * The caller must ensure selem->smap is still valid to be
  * dereferenced for its smap->elem_size and smap->cache_idx.
@@ -131,7 +151,7 @@ bool bpf_selem_unlink_storage_nolock(struct bpf_local_storage *local_storage,
 	    SDATA(selem))
 		RCU_INIT_POINTER(local_storage->cache[smap->cache_idx], NULL);
 
-	kfree_rcu(selem, rcu);
+	call_rcu(&selem->rcu, bpf_selem_free_rcu);
 
 	return free_local_storage;
 }
@@ -233,8 +253,13 @@ bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
 		 * parallel delete.  Otherwise, publishing an already
 		 * deleted sdata to the cache will become a use-after-free
 		 * problem in the next bpf_local_storage_lookup().
+		 *
+		 * Caching is only an optimization, so don't wait for the
+		 * lock: if someone else holds it, leave the cache alone
+		 * and let a later lookup fill it.
 		 */
-		raw_spin_lock_irqsave(&local_storage->lock, flags);
+		if (!raw_spin_trylock_irqsave(&local_storage->lock, flags))
+			return sdata;
 		if (selem_linked_to_storage(selem))
 			rcu_assign_pointer(local_storage->cache[smap->cache_idx],
 					   sdata);
@@ -355,7 +380,7 @@ bpf_local_storage_update(void *owner, struct bpf_local_storage_map *smap,
 
 		err = bpf_local_storage_alloc(owner, smap, selem);
 		if (err) {
-			kfree(selem);
+			bpf_selem_free(smap, selem);
 			mem_uncharge(smap, owner, smap->elem_size);
 			return ERR_PTR(err);
 		}
@@ -532,6 +557,10 @@ void bpf_local_storage_map_free(struct bpf_local_storage_map *smap,
 	 */
 	synchronize_rcu();
 
+	/* All selems are unlinked by now, wait for them to be freed */
+	rcu_barrier();
+	kmem_cache_destroy(smap->selem_cache);
+
 	kvfree(smap->buckets);
 	kfree(smap);
 }
@@ -558,6 +587,7 @@ int bpf_local_storage_map_alloc_check(union bpf_attr *attr)
 struct bpf_local_storage_map *bpf_local_storage_map_alloc(union bpf_attr *attr)
 {
 	struct bpf_local_storage_map *smap;
+	char name[32];
 	unsigned int i;
 	u32 nbuckets;
 
@@ -586,6 +616,18 @@ struct bpf_local_storage_map *bpf_local_storage_map_alloc(union bpf_attr *attr)
 	smap->elem_size =
 		sizeof(struct bpf_local_storage_elem) + attr->value_size;
 
+	/* The name is only there to keep a cache apart in slabinfo */
+	snprintf(name, sizeof(name), "bpf_local_storage_%d",
+		 atomic_inc_return(&selem_cache_id));
+	smap->selem_cache = kmem_cache_create(name, smap->elem_size, 0,
+					      SLAB_HWCACHE_ALIGN | SLAB_ACCOUNT,
+					      NULL);
+	if (!smap->selem_cache) {
+		kvfree(smap->buckets);
+		kfree(smap);
+		return ERR_PTR(-ENOMEM);
+	}
+
 	return smap;
 }
 
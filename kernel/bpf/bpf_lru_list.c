@@ -2,8 +2,10 @@
 /* Copyright (c) 2016 Facebook
  */
 #include <linux/cpumask.h>
+#include <linux/kernel.h>
 #include <linux/spinlock.h>
 #include <linux/percpu.h>
+#include <linux/slab.h>
 
 #include "bpf_lru_list.h"
 
@@ -13,6 +15,9 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define SHARD_FREE_TARGET		(4)
+#define SHARD_NR_SCANS			SHARD_FREE_TARGET
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -396,16 +401,17 @@ __local_list_pop_pending(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
 	return NULL;
 }
 
-static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
-						    u32 hash)
+/* Take a free node from a list that isn't shared with local lists, i.e. a
+ * percpu or shard one, shrinking it by up to @tgt_nshrink nodes if needed.
+ */
+static struct bpf_lru_node *bpf_lru_list_pop_free(struct bpf_lru *lru,
+						  struct bpf_lru_list *l,
+						  u32 hash,
+						  unsigned int tgt_nshrink)
 {
 	struct list_head *free_list;
 	struct bpf_lru_node *node = NULL;
-	struct bpf_lru_list *l;
 	unsigned long flags;
-	int cpu = raw_smp_processor_id();
-
-	l = per_cpu_ptr(lru->percpu_lru, cpu);
 
 	raw_spin_lock_irqsave(&l->lock, flags);
 
@@ -413,7 +419,7 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 
 	free_list = &l->lists[BPF_LRU_LIST_T_FREE];
 	if (list_empty(free_list))
-		__bpf_lru_list_shrink(lru, l, PERCPU_FREE_TARGET, free_list,
+		__bpf_lru_list_shrink(lru, l, tgt_nshrink, free_list,
 				      BPF_LRU_LIST_T_FREE);
 
 	if (!list_empty(free_list)) {
@@ -428,6 +434,44 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
+						    u32 hash)
+{
+	int cpu = raw_smp_processor_id();
+
+	return bpf_lru_list_pop_free(lru, per_cpu_ptr(lru->percpu_lru, cpu),
+				     hash, PERCPU_FREE_TARGET);
+}
+
+/* Each shard is rotated and shrunk on its own, under its own lock, using
+ * the ref bits as clock bits. Keys are spread over the shards by hash, so
+ * evicting the coldest nodes of one shard approximates evicting the
+ * coldest nodes of the whole map. The other shards are only tried when
+ * nothing can be evicted from this one, e.g. when all the candidates'
+ * buckets are locked.
+ */
+static struct bpf_lru_node *bpf_sharded_lru_pop_free(struct bpf_lru *lru,
+						     u32 hash)
+{
+	struct bpf_sharded_lru *slru = &lru->sharded_lru;
+	unsigned int first, shard;
+	struct bpf_lru_node *node;
+
+	first = reciprocal_scale(hash, slru->nr_shards);
+	shard = first;
+	do {
+		node = bpf_lru_list_pop_free(lru, &slru->shards[shard], hash,
+					     SHARD_FREE_TARGET);
+		if (node)
+			return node;
+
+		if (++shard == slru->nr_shards)
+			shard = 0;
+	} while (shard != first);
+
+	return NULL;
+}
+
 static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 						    u32 hash)
 {
@@ -495,6 +539,8 @@ struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
 	if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
+	else if (lru->sharded)
+		return bpf_sharded_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
 }
@@ -552,6 +598,10 @@ void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
 	if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
+	else if (lru->sharded)
+		/* nodes never leave the shard they were populated in */
+		bpf_lru_list_push_free(&lru->sharded_lru.shards[node->cpu],
+				       node);
 	else
 		bpf_common_lru_push_free(lru, node);
 }
@@ -605,12 +655,36 @@ static void bpf_percpu_lru_populate(struct bpf_lru *lru, void *buf,
 	}
 }
 
+static void bpf_sharded_lru_populate(struct bpf_lru *lru, void *buf,
+				     u32 node_offset, u32 elem_size,
+				     u32 nr_elems)
+{
+	struct bpf_sharded_lru *slru = &lru->sharded_lru;
+	u32 i;
+
+	for (i = 0; i < nr_elems; i++) {
+		unsigned int shard = i % slru->nr_shards;
+		struct bpf_lru_node *node;
+
+		node = (struct bpf_lru_node *)(buf + node_offset);
+		node->cpu = shard;
+		node->type = BPF_LRU_LIST_T_FREE;
+		node->ref = 0;
+		list_add(&node->list,
+			 &slru->shards[shard].lists[BPF_LRU_LIST_T_FREE]);
+		buf += elem_size;
+	}
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
 	if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
+	else if (lru->sharded)
+		bpf_sharded_lru_populate(lru, buf, node_offset, elem_size,
+					 nr_elems);
 	else
 		bpf_common_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
@@ -643,8 +717,14 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *del_arg)
+unsigned int bpf_lru_nr_shards(void)
+{
+	return num_possible_cpus();
+}
+
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool sharded,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *del_arg)
 {
 	int cpu;
 
@@ -660,6 +740,19 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 			bpf_lru_list_init(l);
 		}
 		lru->nr_scans = PERCPU_NR_SCANS;
+	} else if (sharded) {
+		struct bpf_sharded_lru *slru = &lru->sharded_lru;
+		unsigned int i;
+
+		slru->nr_shards = bpf_lru_nr_shards();
+		slru->shards = kvcalloc(slru->nr_shards, sizeof(*slru->shards),
+					GFP_KERNEL);
+		if (!slru->shards)
+			return -ENOMEM;
+
+		for (i = 0; i < slru->nr_shards; i++)
+			bpf_lru_list_init(&slru->shards[i]);
+		lru->nr_scans = SHARD_NR_SCANS;
 	} else {
 		struct bpf_common_lru *clru = &lru->common_lru;
 
@@ -679,6 +772,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->sharded = sharded;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
@@ -690,6 +784,8 @@ void bpf_lru_destroy(struct bpf_lru *lru)
 {
 	if (lru->percpu)
 		free_percpu(lru->percpu_lru);
+	else if (lru->sharded)
+		kvfree(lru->sharded_lru.shards);
 	else
 		free_percpu(lru->common_lru.local_list);
 }
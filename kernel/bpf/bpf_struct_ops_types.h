@@ -6,4 +6,16 @@
 #include <net/tcp.h>
 BPF_STRUCT_OPS_TYPE(tcp_congestion_ops)
 #endif
+#ifdef CONFIG_SCHED_CLASS_EXT
+#include <linux/sched/ext.h>
+BPF_STRUCT_OPS_TYPE(sched_ext_ops)
+#endif
+#ifdef CONFIG_NET_SCH_BPF
+#include <net/bpf_qdisc.h>
+BPF_STRUCT_OPS_TYPE(bpf_qdisc_ops)
+#endif
+#ifdef CONFIG_MPTCP
+#include <net/mptcp.h>
+BPF_STRUCT_OPS_TYPE(mptcp_sched_ops)
+#endif
 #endif
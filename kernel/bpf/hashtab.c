@@ -16,7 +16,7 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_SHARDED_LRU)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -345,6 +345,7 @@ static int prealloc_init(struct bpf_htab *htab)
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
 				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & BPF_F_SHARDED_LRU,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -417,6 +418,7 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	 * nothing to do with the map's value.
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
+	bool sharded_lru = (attr->map_flags & BPF_F_SHARDED_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
 	int numa_node = bpf_map_attr_numa_node(attr);
@@ -440,7 +442,10 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	    !bpf_map_flags_access_ok(attr->map_flags))
 		return -EINVAL;
 
-	if (!lru && percpu_lru)
+	if (!lru && (percpu_lru || sharded_lru))
+		return -EINVAL;
+
+	if (percpu_lru && sharded_lru)
 		return -EINVAL;
 
 	if (lru && !prealloc)
@@ -480,6 +485,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 * nothing to do with the map's value.
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
+	bool sharded_lru = (attr->map_flags & BPF_F_SHARDED_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	struct bpf_htab *htab;
 	int err, i;
@@ -502,6 +508,13 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		if (htab->map.max_entries < attr->max_entries)
 			htab->map.max_entries = rounddown(attr->max_entries,
 							  num_possible_cpus());
+	} else if (sharded_lru) {
+		/* same for each shard */
+		htab->map.max_entries = roundup(attr->max_entries,
+						bpf_lru_nr_shards());
+		if (htab->map.max_entries < attr->max_entries)
+			htab->map.max_entries = rounddown(attr->max_entries,
+							  bpf_lru_nr_shards());
 	}
 
 	/* hash table size must be power of 2 */
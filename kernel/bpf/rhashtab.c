@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Hash map on top of rhashtable: the table grows and shrinks with the number
+ * of elements instead of being sized for max_entries up front, which is only
+ * an upper bound here. Elements are allocated on update, charged to the map's
+ * memcg, and freed after an RCU grace period.
+ */
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/filter.h>
+#include <linux/rhashtable.h>
+#include <linux/slab.h>
+#include <linux/rcupdate_trace.h>
+
+#define RHTAB_CREATE_FLAG_MASK						\
+	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK)
+
+struct rhtab_elem {
+	struct rhash_head node;
+	struct rcu_head rcu;
+	char key[] __aligned(8);
+};
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhashtable ht;
+	struct rhashtable_params params;
+	atomic_t count;
+	u32 elem_size;
+	int __percpu *busy;	/* update/delete recursion on this CPU */
+};
+
+static struct bpf_rhtab *rhtab_of(struct bpf_map *map)
+{
+	return container_of(map, struct bpf_rhtab, map);
+}
+
+static void *rhtab_elem_value(const struct bpf_rhtab *rtab,
+			      struct rhtab_elem *elem)
+{
+	return elem->key + round_up(rtab->map.key_size, 8);
+}
+
+/* rhashtable bucket locks disable BHs, which can't be done from a hard irq,
+ * and a program run while one is held must not try to take it again.
+ */
+static bool rhtab_lock(struct bpf_rhtab *rtab)
+{
+	if (unlikely(in_hardirq() || in_nmi()))
+		return false;
+
+	preempt_disable();
+	if (unlikely(__this_cpu_inc_return(*rtab->busy) != 1)) {
+		__this_cpu_dec(*rtab->busy);
+		preempt_enable();
+		return false;
+	}
+	return true;
+}
+
+static void rhtab_unlock(struct bpf_rhtab *rtab)
+{
+	__this_cpu_dec(*rtab->busy);
+	preempt_enable();
+}
+
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags))
+		return -EINVAL;
+
+	/* there's nothing preallocated, say so */
+	if (!(attr->map_flags & BPF_F_NO_PREALLOC))
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > U16_MAX)
+		return -E2BIG;
+
+	if ((u64)round_up(attr->key_size, 8) + attr->value_size >=
+	    KMALLOC_MAX_SIZE - sizeof(struct rhtab_elem))
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_rhtab *rtab;
+	int err;
+
+	rtab = kzalloc(sizeof(*rtab), GFP_USER | __GFP_ACCOUNT);
+	if (!rtab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rtab->map, attr);
+	rtab->elem_size = sizeof(struct rhtab_elem) +
+			  round_up(attr->key_size, 8) +
+			  round_up(attr->value_size, 8);
+
+	rtab->busy = bpf_map_alloc_percpu(&rtab->map, sizeof(int),
+					  sizeof(int), GFP_USER);
+	if (!rtab->busy) {
+		err = -ENOMEM;
+		goto free_rtab;
+	}
+
+	rtab->params = (struct rhashtable_params) {
+		.head_offset		= offsetof(struct rhtab_elem, node),
+		.key_offset		= offsetof(struct rhtab_elem, key),
+		.key_len		= attr->key_size,
+		.automatic_shrinking	= true,
+	};
+
+	err = rhashtable_init(&rtab->ht, &rtab->params);
+	if (err)
+		goto free_busy;
+
+	return &rtab->map;
+
+free_busy:
+	free_percpu(rtab->busy);
+free_rtab:
+	kfree(rtab);
+	return ERR_PTR(err);
+}
+
+static void rhtab_free_elem(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *rtab = rhtab_of(map);
+
+	/* no more users, elements being freed through RCU aren't in the table */
+	rhashtable_free_and_destroy(&rtab->ht, rhtab_free_elem, NULL);
+	free_percpu(rtab->busy);
+	kfree(rtab);
+}
+
+static struct rhtab_elem *rhtab_lookup(struct bpf_rhtab *rtab, void *key)
+{
+	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held() &&
+		     !rcu_read_lock_bh_held());
+
+	return rhashtable_lookup(&rtab->ht, key, rtab->params);
+}
+
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rtab = rhtab_of(map);
+	struct rhtab_elem *elem;
+
+	elem = rhtab_lookup(rtab, key);
+	return elem ? rhtab_elem_value(rtab, elem) : NULL;
+}
+
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *rtab = rhtab_of(map);
+	struct rhtab_elem *elem, *old;
+	int err;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags, BPF_F_LOCK included */
+		return -EINVAL;
+
+	if (!rhtab_lock(rtab))
+		return -EBUSY;
+
+	elem = bpf_map_kmalloc_node(map, rtab->elem_size,
+				    GFP_ATOMIC | __GFP_NOWARN, map->numa_node);
+	if (!elem) {
+		err = -ENOMEM;
+		goto out;
+	}
+	memcpy(elem->key, key, map->key_size);
+	memcpy(rhtab_elem_value(rtab, elem), value, map->value_size);
+
+	for (;;) {
+		old = rhtab_lookup(rtab, key);
+		if (old) {
+			if (map_flags == BPF_NOEXIST) {
+				err = -EEXIST;
+				break;
+			}
+			err = rhashtable_replace_fast(&rtab->ht, &old->node,
+						      &elem->node, rtab->params);
+			if (err == -ENOENT)
+				/* deleted meanwhile */
+				continue;
+			if (!err)
+				kfree_rcu(old, rcu);
+			break;
+		}
+
+		if (map_flags == BPF_EXIST) {
+			err = -ENOENT;
+			break;
+		}
+
+		if (atomic_inc_return(&rtab->count) > map->max_entries) {
+			atomic_dec(&rtab->count);
+			err = -E2BIG;
+			break;
+		}
+		old = rhashtable_lookup_get_insert_fast(&rtab->ht, &elem->node,
+							rtab->params);
+		if (!old) {
+			err = 0;
+			break;
+		}
+		atomic_dec(&rtab->count);
+		if (IS_ERR(old)) {
+			err = PTR_ERR(old);
+			break;
+		}
+		/* lost a race against an insert of the same key */
+	}
+
+	if (err)
+		kfree(elem);
+out:
+	rhtab_unlock(rtab);
+	return err;
+}
+
+static int __rhtab_map_delete_elem(struct bpf_rhtab *rtab, void *key,
+				   void *value)
+{
+	struct rhtab_elem *elem;
+	int err;
+
+	if (!rhtab_lock(rtab))
+		return -EBUSY;
+
+	elem = rhtab_lookup(rtab, key);
+	if (!elem) {
+		err = -ENOENT;
+		goto out;
+	}
+
+	err = rhashtable_remove_fast(&rtab->ht, &elem->node, rtab->params);
+	if (err)
+		/* someone else removed it */
+		goto out;
+
+	if (value)
+		memcpy(value, rhtab_elem_value(rtab, elem),
+		       rtab->map.value_size);
+	atomic_dec(&rtab->count);
+	kfree_rcu(elem, rcu);
+out:
+	rhtab_unlock(rtab);
+	return err;
+}
+
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	return __rhtab_map_delete_elem(rhtab_of(map), key, NULL);
+}
+
+static int rhtab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
+					    void *value, u64 flags)
+{
+	if (flags)
+		return -EINVAL;
+
+	return __rhtab_map_delete_elem(rhtab_of(map), key, value);
+}
+
+/*
+ * Keys are returned in the order of the current bucket table: after the one
+ * following @key in its bucket, the buckets after that one. An unknown @key
+ * restarts from the first bucket. Elements moved by a concurrent resize may be
+ * missed or returned twice.
+ */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *rtab = rhtab_of(map);
+	struct rhtab_elem *elem;
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	unsigned int i = 0;
+	bool found = false;
+	int err = -ENOENT;
+
+	rcu_read_lock();
+	tbl = rht_dereference_rcu(rtab->ht.tbl, &rtab->ht);
+
+	if (key) {
+		i = rht_key_hashfn(&rtab->ht, tbl, key, rtab->params);
+		rht_for_each_entry_rcu(elem, pos, tbl, i, node) {
+			if (found)
+				goto copy;
+			found = !memcmp(elem->key, key, map->key_size);
+		}
+		i = found ? i + 1 : 0;
+	}
+
+	for (; i < tbl->size; i++) {
+		rht_for_each_entry_rcu(elem, pos, tbl, i, node)
+			goto copy;
+	}
+	goto out;
+
+copy:
+	memcpy(next_key, elem->key, map->key_size);
+	err = 0;
+out:
+	rcu_read_unlock();
+	return err;
+}
+
+static int rhtab_map_btf_id;
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_lookup_and_delete_elem = rhtab_map_lookup_and_delete_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+	.map_btf_name = "bpf_rhtab",
+	.map_btf_id = &rhtab_map_btf_id,
+};
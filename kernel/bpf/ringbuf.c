@@ -21,6 +21,9 @@
 
 #define RINGBUF_MAX_RECORD_SZ (UINT_MAX/4)
 
+/* Most samples a program can consume with one bpf_user_ringbuf_drain() */
+#define USER_RINGBUF_MAX_SAMPLES (128 * 1024)
+
 /* Maximum size of ring buffer area is limited by 32-bit page offset within
  * record header, counted in pages. Reserve 8 bits for extensibility, and take
  * into account few extra pages for consumer/producer pages and
@@ -37,6 +40,8 @@ struct bpf_ringbuf {
 	struct page **pages;
 	int nr_pages;
 	spinlock_t spinlock ____cacheline_aligned_in_smp;
+	/* Held by the program draining a user ring buffer */
+	atomic_t busy;
 	/* Consumer and producer counters are put into separate pages to allow
 	 * mapping consumer page as r/w, but restrict producer page to r/o.
 	 * This protects producer position from being modified by user-space
@@ -139,6 +144,7 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
 
 	rb->mask = data_sz - 1;
+	atomic_set(&rb->busy, 0);
 	rb->consumer_pos = 0;
 	rb->producer_pos = 0;
 
@@ -152,11 +158,19 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
 		return ERR_PTR(-EINVAL);
 
-	if (attr->key_size || attr->value_size ||
-	    !is_power_of_2(attr->max_entries) ||
+	if (attr->key_size || !is_power_of_2(attr->max_entries) ||
 	    !PAGE_ALIGNED(attr->max_entries))
 		return ERR_PTR(-EINVAL);
 
+	if (attr->map_type == BPF_MAP_TYPE_USER_RINGBUF) {
+		/* largest sample handed to programs, header excluded */
+		if (!attr->value_size ||
+		    attr->value_size > attr->max_entries - BPF_RINGBUF_HDR_SZ)
+			return ERR_PTR(-EINVAL);
+	} else if (attr->value_size) {
+		return ERR_PTR(-EINVAL);
+	}
+
 #ifdef CONFIG_64BIT
 	/* on 32-bit arch, it's impossible to overflow record's hdr->pgoff */
 	if (attr->max_entries > RINGBUF_MAX_DATA_SZ)
@@ -241,6 +255,27 @@ static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
 				   vma->vm_pgoff + RINGBUF_PGOFF);
 }
 
+/* User space produces samples and programs consume them, so it's the other
+ * way round: the consumer position is the one user space can't write to.
+ */
+static int user_ringbuf_map_mmap(struct bpf_map *map,
+				 struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	if (vma->vm_flags & VM_WRITE) {
+		if (vma->vm_pgoff == 0)
+			return -EPERM;
+	} else {
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+	/* remap_vmalloc_range() checks size and offset constraints */
+	return remap_vmalloc_range(vma, rb_map->rb,
+				   vma->vm_pgoff + RINGBUF_PGOFF);
+}
+
 static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb)
 {
 	unsigned long cons_pos, prod_pos;
@@ -263,6 +298,19 @@ static __poll_t ringbuf_map_poll(struct bpf_map *map, struct file *filp,
 	return 0;
 }
 
+static __poll_t user_ringbuf_map_poll(struct bpf_map *map, struct file *filp,
+				      struct poll_table_struct *pts)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	poll_wait(filp, &rb_map->rb->waitq, pts);
+
+	if (ringbuf_avail_data_sz(rb_map->rb) <= rb_map->rb->mask)
+		return EPOLLOUT | EPOLLWRNORM;
+	return 0;
+}
+
 static int ringbuf_map_btf_id;
 const struct bpf_map_ops ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -278,6 +326,21 @@ const struct bpf_map_ops ringbuf_map_ops = {
 	.map_btf_id = &ringbuf_map_btf_id,
 };
 
+static int user_ringbuf_map_btf_id;
+const struct bpf_map_ops user_ringbuf_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = ringbuf_map_alloc,
+	.map_free = ringbuf_map_free,
+	.map_mmap = user_ringbuf_map_mmap,
+	.map_poll = user_ringbuf_map_poll,
+	.map_lookup_elem = ringbuf_map_lookup_elem,
+	.map_update_elem = ringbuf_map_update_elem,
+	.map_delete_elem = ringbuf_map_delete_elem,
+	.map_get_next_key = ringbuf_map_get_next_key,
+	.map_btf_name = "bpf_ringbuf_map",
+	.map_btf_id = &user_ringbuf_map_btf_id,
+};
+
 /* Given pointer to ring buffer record metadata and struct bpf_ringbuf itself,
  * calculate offset from record metadata to ring buffer in pages, rounded
  * down. This page offset is stored as part of record metadata and allows to
@@ -475,3 +538,106 @@ const struct bpf_func_proto bpf_ringbuf_query_proto = {
 	.arg1_type	= ARG_CONST_MAP_PTR,
 	.arg2_type	= ARG_ANYTHING,
 };
+
+/* Look at the sample at the consumer position of a user ring buffer. The
+ * producer position and the headers are written by user space, so they must
+ * be read once and checked before being trusted. Set *@rec_len to the space
+ * taken by the sample, and *@size to 0 if it's to be skipped without being
+ * passed to the program: discarded, or larger than the map's value size.
+ */
+static int __bpf_user_ringbuf_peek(struct bpf_ringbuf *rb, u32 max_size,
+				   void **sample, u32 *size, u32 *rec_len)
+{
+	unsigned long cons_pos, prod_pos;
+	u32 hdr_len, len;
+	u64 avail;
+	u32 *hdr;
+
+	cons_pos = rb->consumer_pos;
+	/* pairs with the producer's store-release in user space */
+	prod_pos = smp_load_acquire(&rb->producer_pos);
+	if (prod_pos % 8)
+		return -EINVAL;
+	if (prod_pos == cons_pos)
+		return -ENODATA;
+
+	avail = prod_pos - cons_pos;
+	if (avail > rb->mask + 1)
+		return -EINVAL;
+
+	hdr = (u32 *)((uintptr_t)rb->data + (cons_pos & rb->mask));
+	hdr_len = smp_load_acquire(hdr);
+	if (hdr_len & BPF_RINGBUF_BUSY_BIT)
+		/* not committed yet */
+		return -ENODATA;
+
+	len = hdr_len & ~BPF_RINGBUF_DISCARD_BIT;
+	*rec_len = round_up(len + BPF_RINGBUF_HDR_SZ, 8);
+	if (len > RINGBUF_MAX_RECORD_SZ || *rec_len > avail)
+		return -EINVAL;
+
+	*sample = (void *)hdr + BPF_RINGBUF_HDR_SZ;
+	*size = (hdr_len & BPF_RINGBUF_DISCARD_BIT) || len > max_size ? 0 : len;
+	return 0;
+}
+
+BPF_CALL_4(bpf_user_ringbuf_drain, struct bpf_map *, map, void *, callback_fn,
+	   void *, callback_ctx, u64, flags)
+{
+	u64 wakeup_flags = BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP;
+	u32 size, rec_len;
+	struct bpf_ringbuf *rb;
+	long samples = 0;
+	void *sample;
+	int err = 0;
+	u64 ret = 0;
+
+	if (unlikely(flags & ~wakeup_flags))
+		return -EINVAL;
+
+	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+
+	/* only one program consumes at a time */
+	if (atomic_cmpxchg(&rb->busy, 0, 1))
+		return -EBUSY;
+
+	while (!ret && samples < USER_RINGBUF_MAX_SAMPLES) {
+		err = __bpf_user_ringbuf_peek(rb, map->value_size, &sample,
+					      &size, &rec_len);
+		if (err)
+			break;
+
+		if (size) {
+			ret = BPF_CAST_CALL(callback_fn)((u64)(long)sample,
+					(u64)size, (u64)(long)callback_ctx,
+					0, 0);
+			samples++;
+		}
+
+		/* hand the space back to user space, pairs with the
+		 * producer's load-acquire
+		 */
+		smp_store_release(&rb->consumer_pos,
+				  rb->consumer_pos + rec_len);
+	}
+
+	atomic_set_release(&rb->busy, 0);
+
+	if (flags & BPF_RB_FORCE_WAKEUP)
+		irq_work_queue(&rb->work);
+	else if (samples && !(flags & BPF_RB_NO_WAKEUP))
+		irq_work_queue(&rb->work);
+
+	if (!samples && err != -ENODATA)
+		return err;
+	return samples;
+}
+
+const struct bpf_func_proto bpf_user_ringbuf_drain_proto = {
+	.func		= bpf_user_ringbuf_drain,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_PTR_TO_FUNC,
+	.arg3_type	= ARG_PTR_TO_STACK_OR_NULL,
+	.arg4_type	= ARG_ANYTHING,
+};
@@ -142,6 +142,12 @@ struct cpuset {
 	 */
 	int attach_in_progress;
 
+	/*
+	 * On cpuset_cpus_pending while the tasks still have to be moved to
+	 * effective_cpus.  Protected by callback_lock.
+	 */
+	struct list_head cpus_pending_node;
+
 	/* partition number for rebuild_sched_domains() */
 	int pn;
 
@@ -281,6 +287,7 @@ static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
 	.partition_root_state = PRS_ENABLED,
+	.cpus_pending_node = LIST_HEAD_INIT(top_cpuset.cpus_pending_node),
 };
 
 /**
@@ -1076,20 +1083,38 @@ void rebuild_sched_domains(void)
 	cpus_read_unlock();
 }
 
-/**
- * update_tasks_cpumask - Update the cpumasks of tasks in the cpuset.
- * @cs: the cpuset in which each task's cpus_allowed mask needs to be changed
- *
- * Iterate through each task of @cs updating its cpus_allowed to the
- * effective cpuset's.  As this function is called with cpuset_rwsem held,
- * cpuset membership stays stable.
+/*
+ * Changing the affinity of every task in a big cpuset takes a while, and
+ * holding cpuset_rwsem for all of it stalls anyone else who needs it.  That
+ * includes task migration, which takes cpuset_rwsem in ->can_attach() with
+ * cgroup_threadgroup_rwsem write-locked, so forks and execs all over the
+ * system end up waiting behind a "cpuset.cpus" write.
+ *
+ * Writes to "cpuset.cpus" and "cpuset.cpus.partition" therefore only update
+ * the effective masks under the lock and queue the cpusets whose tasks need
+ * updating on cpuset_cpus_pending.  Once the locks are dropped, the queue is
+ * drained by cpuset_apply_pending_cpumasks(), which applies the mask as it
+ * is at that point.
+ *
+ * Applying the mask is serialized by cpuset_cpus_apply_mutex, and a cpuset
+ * is queued again if its mask changes after it was taken off the queue, so
+ * the last update of a mask is always the one its tasks end up with.
+ * Tasks attached in the meantime get the new mask from cpuset_attach().
  */
-static void update_tasks_cpumask(struct cpuset *cs)
+static LIST_HEAD(cpuset_cpus_pending);		/* protected by callback_lock */
+static DEFINE_MUTEX(cpuset_cpus_apply_mutex);
+static cpumask_var_t cpus_apply;	/* protected by cpuset_cpus_apply_mutex */
+static bool cpuset_defer_cpus_update;		/* protected by cpuset_rwsem */
+
+static void __update_tasks_cpumask(struct cpuset *cs,
+				   const struct cpumask *new_cpus)
 {
 	struct css_task_iter it;
 	struct task_struct *task;
 	bool top_cs = cs == &top_cpuset;
 
+	lockdep_assert_held(&cpuset_cpus_apply_mutex);
+
 	css_task_iter_start(&cs->css, 0, &it);
 	while ((task = css_task_iter_next(&it))) {
 		/*
@@ -1098,11 +1123,66 @@ static void update_tasks_cpumask(struct cpuset *cs)
 		if (top_cs && (task->flags & PF_KTHREAD) &&
 		    kthread_is_per_cpu(task))
 			continue;
-		set_cpus_allowed_ptr(task, cs->effective_cpus);
+		set_cpus_allowed_ptr(task, new_cpus);
 	}
 	css_task_iter_end(&it);
 }
 
+/**
+ * update_tasks_cpumask - Update the cpumasks of tasks in the cpuset.
+ * @cs: the cpuset in which each task's cpus_allowed mask needs to be changed
+ *
+ * Iterate through each task of @cs updating its cpus_allowed to the
+ * effective cpuset's, or queue @cs for cpuset_apply_pending_cpumasks() if
+ * the caller asked for the update to be deferred.  Call with cpuset_rwsem
+ * held.
+ */
+static void update_tasks_cpumask(struct cpuset *cs)
+{
+	if (cpuset_defer_cpus_update) {
+		spin_lock_irq(&callback_lock);
+		if (list_empty(&cs->cpus_pending_node)) {
+			css_get(&cs->css);
+			list_add_tail(&cs->cpus_pending_node,
+				      &cpuset_cpus_pending);
+		}
+		spin_unlock_irq(&callback_lock);
+		return;
+	}
+
+	mutex_lock(&cpuset_cpus_apply_mutex);
+	__update_tasks_cpumask(cs, cs->effective_cpus);
+	mutex_unlock(&cpuset_cpus_apply_mutex);
+}
+
+/*
+ * Move the tasks of the cpusets queued by update_tasks_cpumask() to their
+ * current effective_cpus.  Must be called without cpuset_rwsem held.
+ */
+static void cpuset_apply_pending_cpumasks(void)
+{
+	struct cpuset *cs;
+
+	mutex_lock(&cpuset_cpus_apply_mutex);
+	while (1) {
+		spin_lock_irq(&callback_lock);
+		cs = list_first_entry_or_null(&cpuset_cpus_pending,
+					      struct cpuset, cpus_pending_node);
+		if (cs) {
+			list_del_init(&cs->cpus_pending_node);
+			cpumask_copy(cpus_apply, cs->effective_cpus);
+		}
+		spin_unlock_irq(&callback_lock);
+
+		if (!cs)
+			break;
+
+		__update_tasks_cpumask(cs, cpus_apply);
+		css_put(&cs->css);
+	}
+	mutex_unlock(&cpuset_cpus_apply_mutex);
+}
+
 /**
  * compute_effective_cpumask - Compute the effective cpumask of the cpuset
  * @new_cpus: the temp variable for the new effective_cpus mask
@@ -2442,6 +2522,7 @@ static ssize_t cpuset_write_resmask(struct kernfs_open_file *of,
 
 	cpus_read_lock();
 	percpu_down_write(&cpuset_rwsem);
+	cpuset_defer_cpus_update = true;
 	if (!is_cpuset_online(cs))
 		goto out_unlock;
 
@@ -2465,8 +2546,10 @@ static ssize_t cpuset_write_resmask(struct kernfs_open_file *of,
 
 	free_cpuset(trialcs);
 out_unlock:
+	cpuset_defer_cpus_update = false;
 	percpu_up_write(&cpuset_rwsem);
 	cpus_read_unlock();
+	cpuset_apply_pending_cpumasks();
 	kernfs_unbreak_active_protection(of->kn);
 	css_put(&cs->css);
 	flush_workqueue(cpuset_migrate_mm_wq);
@@ -2599,13 +2682,16 @@ static ssize_t sched_partition_write(struct kernfs_open_file *of, char *buf,
 	css_get(&cs->css);
 	cpus_read_lock();
 	percpu_down_write(&cpuset_rwsem);
+	cpuset_defer_cpus_update = true;
 	if (!is_cpuset_online(cs))
 		goto out_unlock;
 
 	retval = update_prstate(cs, val);
 out_unlock:
+	cpuset_defer_cpus_update = false;
 	percpu_up_write(&cpuset_rwsem);
 	cpus_read_unlock();
+	cpuset_apply_pending_cpumasks();
 	css_put(&cs->css);
 	return retval ?: nbytes;
 }
@@ -2798,6 +2884,7 @@ cpuset_css_alloc(struct cgroup_subsys_state *parent_css)
 	nodes_clear(cs->effective_mems);
 	fmeter_init(&cs->fmeter);
 	cs->relax_domain_level = -1;
+	INIT_LIST_HEAD(&cs->cpus_pending_node);
 
 	/* Set CS_MEMORY_MIGRATE for default hierarchy */
 	if (cgroup_subsys_on_dfl(cpuset_cgrp_subsys))
@@ -2992,6 +3079,7 @@ int __init cpuset_init(void)
 	top_cpuset.relax_domain_level = -1;
 
 	BUG_ON(!alloc_cpumask_var(&cpus_attach, GFP_KERNEL));
+	BUG_ON(!alloc_cpumask_var(&cpus_apply, GFP_KERNEL));
 
 	return 0;
 }
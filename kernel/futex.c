@@ -39,6 +39,7 @@
 #include <linux/memblock.h>
 #include <linux/fault-inject.h>
 #include <linux/time_namespace.h>
+#include <linux/slab.h>
 
 #include <asm/futex.h>
 
@@ -297,16 +298,18 @@ struct futex_hash_bucket {
 } ____cacheline_aligned_in_smp;
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in hash_futex()), so ensure that they
- * reside in the same cacheline.
+ * There is one bucket array per node, all of the same size. The arrays and
+ * their size are always used together (after initialization only in
+ * hash_futex()), so ensure that they reside in the same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
+	struct futex_hash_bucket **queues;
 	unsigned long            hashsize;
-} __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+	unsigned int             hashshift;
+} __futex_data __read_mostly __aligned(4*sizeof(long));
+#define futex_queues    (__futex_data.queues)
+#define futex_hashsize  (__futex_data.hashsize)
+#define futex_hashshift (__futex_data.hashshift)
 
 
 /*
@@ -407,19 +410,43 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+/*
+ * Threads sharing an mm were forked on the node it was allocated on, and
+ * are likely to keep running there.
+ */
+static inline int futex_mm_node(struct mm_struct *mm)
+{
+	int node = 0;
+
+	if (virt_addr_valid(mm))
+		node = page_to_nid(virt_to_page(mm));
+
+	return node < nr_node_ids ? node : 0;
+}
+
 /**
  * hash_futex - Return the hash bucket in the global hash
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the global hash. Private futexes are hashed
+ * in the bucket array of the node of their mm, the others are spread over
+ * the arrays of all the nodes.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
 			  key->both.offset);
+	int node = 0;
 
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	if (nr_node_ids > 1) {
+		if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED)))
+			node = futex_mm_node(key->private.mm);
+		else
+			node = (hash >> futex_hashshift) % nr_node_ids;
+	}
+
+	return &futex_queues[node][hash & (futex_hashsize - 1)];
 }
 
 
@@ -539,8 +566,9 @@ static u64 get_inode_sequence_number(struct inode *inode)
  *
  * lock_page() might sleep, the caller should not hold a spinlock.
  */
-static int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
-			 enum futex_access rw)
+static int __get_futex_key(void __user *uaddr, bool fshared,
+			   union futex_key *key, enum futex_access rw,
+			   unsigned int size)
 {
 	unsigned long address = (unsigned long)uaddr;
 	struct mm_struct *mm = current->mm;
@@ -552,11 +580,11 @@ static int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
 	 * The futex address must be "naturally" aligned.
 	 */
 	key->both.offset = address % PAGE_SIZE;
-	if (unlikely((address % sizeof(u32)) != 0))
+	if (unlikely((address % size) != 0))
 		return -EINVAL;
 	address -= key->both.offset;
 
-	if (unlikely(!access_ok(uaddr, sizeof(u32))))
+	if (unlikely(!access_ok(uaddr, size)))
 		return -EFAULT;
 
 	if (unlikely(should_fail_futex(fshared)))
@@ -716,6 +744,12 @@ static int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
 	return err;
 }
 
+static inline int get_futex_key(u32 __user *uaddr, bool fshared,
+				union futex_key *key, enum futex_access rw)
+{
+	return __get_futex_key(uaddr, fshared, key, rw, sizeof(u32));
+}
+
 /**
  * fault_in_user_writeable() - Fault in user address and verify RW access
  * @uaddr:	pointer to faulting user space address
@@ -1647,8 +1681,8 @@ double_unlock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 /*
  * Wake up waiters matching bitset queued on this futex (uaddr).
  */
-static int
-futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
+static int __futex_wake(void __user *uaddr, unsigned int flags,
+			unsigned int size, int nr_wake, u32 bitset)
 {
 	struct futex_hash_bucket *hb;
 	struct futex_q *this, *next;
@@ -1659,7 +1693,8 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!bitset)
 		return -EINVAL;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, FUTEX_READ);
+	ret = __get_futex_key(uaddr, flags & FLAGS_SHARED, &key, FUTEX_READ,
+			      size);
 	if (unlikely(ret != 0))
 		return ret;
 
@@ -1693,6 +1728,12 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	return ret;
 }
 
+static int
+futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
+{
+	return __futex_wake(uaddr, flags, sizeof(u32), nr_wake, bitset);
+}
+
 static int futex_atomic_op_inuser(unsigned int encoded_op, u32 __user *uaddr)
 {
 	unsigned int op =	  (encoded_op & 0x70000000) >> 28;
@@ -3005,6 +3046,266 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * struct futex_vector - A futex of a vectored wait
+ * @w:		the futex_waitv passed by userspace
+ * @size:	the size of the futex word, in bytes
+ * @q:		the futex_q queued on the futex
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	unsigned int size;
+	struct futex_q q;
+};
+
+/*
+ * Read a futex word of any futex2 size. Called with page faults disabled
+ * under the hash bucket lock, and enabled to fault the word in.
+ */
+static int futex_get_value_sized(u64 *dest, void __user *from,
+				 unsigned int size)
+{
+	int ret = -EFAULT;
+
+	switch (size) {
+	case 1: {
+		u8 val;
+
+		ret = __get_user(val, (u8 __user *)from);
+		*dest = val;
+		break;
+	}
+	case 2: {
+		u16 val;
+
+		ret = __get_user(val, (u16 __user *)from);
+		*dest = val;
+		break;
+	}
+	case 4: {
+		u32 val;
+
+		ret = __get_user(val, (u32 __user *)from);
+		*dest = val;
+		break;
+	}
+#ifdef CONFIG_64BIT
+	case 8: {
+		u64 val;
+
+		ret = __get_user(val, (u64 __user *)from);
+		*dest = val;
+		break;
+	}
+#endif
+	}
+
+	return ret ? -EFAULT : 0;
+}
+
+/**
+ * unqueue_multiple - Remove various futexes from their hash bucket
+ * @v:	   The list of futexes to unqueue
+ * @count: Number of futexes in the list
+ *
+ * Helper to unqueue a list of futexes. This can't fail.
+ *
+ * Return:
+ *  - >=0 - Index of the last futex that was awoken;
+ *  - -1  - No futex was awoken
+ */
+static int unqueue_multiple(struct futex_vector *v, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&v[i].q))
+			ret = i;
+	}
+
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup - Prepare to wait and enqueue multiple futexes
+ * @vs:		The futex list to wait on
+ * @count:	The size of the list
+ * @woken:	Index of the last woken futex, if any. Used to notify the
+ *		caller that it can return this index to userspace (return parameter)
+ *
+ * Prepare multiple futexes in a single step and enqueue them. This may fail if
+ * the futex list is invalid or if any futex was already awoken. On success the
+ * task is ready to interruptible sleep.
+ *
+ * Return:
+ *  -  1 - One of the futexes was woken by another thread
+ *  -  0 - Success
+ *  - <0 - -EFAULT, -EWOULDBLOCK or -EINVAL
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	bool retry = false;
+	int ret, i;
+	u64 uval;
+
+	/*
+	 * Enqueuing multiple futexes is tricky, because we need to enqueue
+	 * each futex on the list before dealing with the next one to avoid
+	 * deadlocking on the hash bucket. But, before enqueuing, we need to
+	 * make sure that current->state is TASK_INTERRUPTIBLE, so we don't
+	 * lose any wake events, which cannot be done before the get_futex_key
+	 * of the next key, because it calls get_user_pages, which can sleep.
+	 * Thus, we fetch the list of futexes keys in two steps, by first
+	 * pinning all the memory keys in the futex key, and only then we read
+	 * each key and queue the corresponding futex.
+	 *
+	 * Private futexes doesn't need to recalculate hash in retry, so skip
+	 * get_futex_key() when retrying.
+	 */
+retry:
+	for (i = 0; i < count; i++) {
+		if ((vs[i].w.flags & FUTEX2_PRIVATE) && retry)
+			continue;
+
+		ret = __get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
+				      !(vs[i].w.flags & FUTEX2_PRIVATE),
+				      &vs[i].q.key, FUTEX_READ, vs[i].size);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		void __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+		u64 val = vs[i].w.val;
+
+		hb = queue_lock(q);
+		pagefault_disable();
+		ret = futex_get_value_sized(&uval, uaddr, vs[i].size);
+		pagefault_enable();
+
+		if (!ret && uval == val) {
+			/*
+			 * The bucket lock can't be held while dealing with the
+			 * next futex. Queue each futex at this moment so hb can
+			 * be unlocked.
+			 */
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * Even if something went wrong, if we find out that a futex
+		 * was woken, we don't return error and return this index to
+		 * userspace
+		 */
+		*woken = unqueue_multiple(vs, i);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/*
+			 * If we need to handle a page fault, we need to do so
+			 * without any lock and any enqueued futex (otherwise
+			 * we could lose some wakeup). So we do it here, after
+			 * undoing all the work done so far. In success, we
+			 * retry all the work.
+			 */
+			if (futex_get_value_sized(&uval, uaddr, vs[i].size))
+				return -EFAULT;
+
+			retry = true;
+			goto retry;
+		}
+
+		if (uval != val)
+			return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/**
+ * futex_sleep_multiple - Check sleeping conditions and sleep
+ * @vs:    List of futexes to wait for
+ * @count: Length of vs
+ * @to:    Timeout
+ *
+ * Sleep if and only if the timeout hasn't expired and no futex on the list has
+ * been woken up.
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, unsigned int count,
+				 struct hrtimer_sleeper *to)
+{
+	if (to && !to->task)
+		return;
+
+	for (; count; count--, vs++) {
+		if (!READ_ONCE(vs->q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+/**
+ * futex_wait_multiple - Prepare to wait on and enqueue several futexes
+ * @vs:		The list of futexes to wait on
+ * @count:	The number of objects
+ * @to:		Timeout before giving up and returning to userspace
+ *
+ * Entry point for futex_waitv(), this function sleeps on a group of futexes
+ * and returns on the first futex that is woken, or after the timeout has
+ * elapsed.
+ *
+ * Return:
+ *  - >=0 - Hint to the futex that was awoken
+ *  - <0  - On error
+ */
+static int futex_wait_multiple(struct futex_vector *vs, unsigned int count,
+			       struct hrtimer_sleeper *to)
+{
+	int ret, hint = 0;
+
+	if (to)
+		hrtimer_sleeper_start_expires(to, HRTIMER_MODE_ABS);
+
+	while (1) {
+		ret = futex_wait_multiple_setup(vs, count, &hint);
+		if (ret) {
+			if (ret > 0) {
+				/* A futex was woken during setup */
+				ret = hint;
+			}
+			return ret;
+		}
+
+		futex_sleep_multiple(vs, count, to);
+
+		__set_current_state(TASK_RUNNING);
+
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (to && !to->task)
+			return -ETIMEDOUT;
+		else if (signal_pending(current))
+			return -ERESTARTSYS;
+		/*
+		 * The final case is a spurious wakeup, for
+		 * which just retry.
+		 */
+	}
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -4041,6 +4342,163 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, (unsigned long)utime, val3);
 }
 
+/* Mask of available flags for each futex in futex_waitv list */
+#define FUTEXV_WAITER_MASK (FUTEX2_SIZE_MASK | FUTEX2_PRIVATE)
+
+/* Size in bytes of the futex word of futex2 @flags, 0 if unsupported */
+static unsigned int futex2_size(unsigned int flags)
+{
+	unsigned int size = 1U << (flags & FUTEX2_SIZE_MASK);
+
+	if (size > sizeof(unsigned long))
+		return 0;
+
+	return size;
+}
+
+static int futex_parse_waitv(struct futex_vector *futexv,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int nr_futexes)
+{
+	struct futex_waitv aux;
+	unsigned int i, size;
+
+	for (i = 0; i < nr_futexes; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~FUTEXV_WAITER_MASK) || aux.__reserved)
+			return -EINVAL;
+
+		size = futex2_size(aux.flags);
+		if (!size)
+			return -EINVAL;
+
+		/* The expected value must fit in the futex word */
+		if (size < sizeof(u64) && (aux.val >> (size * BITS_PER_BYTE)))
+			return -EINVAL;
+
+		futexv[i].w.flags = aux.flags;
+		futexv[i].w.val = aux.val;
+		futexv[i].w.uaddr = aux.uaddr;
+		futexv[i].size = size;
+		futexv[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/**
+ * sys_futex_waitv - Wait on a list of futexes
+ * @waiters:    List of futexes to wait on
+ * @nr_futexes: Length of futexv
+ * @flags:      Flag for timeout (monotonic/realtime)
+ * @timeout:	Optional absolute timeout.
+ * @clockid:	Clock to be used for the timeout, realtime or monotonic.
+ *
+ * Given an array of `struct futex_waitv`, wait on each uaddr. The thread wakes
+ * if a futex_wake() is performed at any uaddr. The syscall returns immediately
+ * if any waiter has *uaddr != val. *timeout is an optional timeout value for
+ * the operation. Each waiter has individual flags. The `flags` argument for
+ * the syscall should be used solely for specifying the timeout as realtime, if
+ * needed. Flags for private futexes, sizes, etc. should be used on the
+ * individual flags of each waiter.
+ *
+ * Returns the array index of one of the woken futexes. No further information
+ * is provided: any number of other futexes may also have been woken by the
+ * same event, and if more than one futex was woken, the returned index may
+ * refer to any one of them. (It is not necessarily the futex with the
+ * smallest index, nor the one most recently woken, nor...)
+ */
+SYSCALL_DEFINE5(futex_waitv, struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes, unsigned int, flags,
+		struct __kernel_timespec __user *, timeout, clockid_t, clockid)
+{
+	struct hrtimer_sleeper to;
+	struct futex_vector *futexv;
+	struct timespec64 ts;
+	ktime_t time;
+	int ret;
+
+	/* This syscall supports no flags for now */
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	if (timeout) {
+		int flag_clkid = 0, flag_init = 0;
+
+		if (clockid == CLOCK_REALTIME) {
+			flag_clkid = FLAGS_CLOCKRT;
+			flag_init = FUTEX_CLOCK_REALTIME;
+		}
+
+		if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+			return -EINVAL;
+
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+
+		/*
+		 * Since there's no opcode for futex_waitv, use
+		 * FUTEX_WAIT_BITSET that uses absolute timeout as well
+		 */
+		ret = futex_init_timeout(FUTEX_WAIT_BITSET, flag_init, &ts, &time);
+		if (ret)
+			return ret;
+
+		futex_setup_timer(&time, &to, flag_clkid, 0);
+	}
+
+	futexv = kcalloc(nr_futexes, sizeof(*futexv), GFP_KERNEL);
+	if (!futexv) {
+		ret = -ENOMEM;
+		goto destroy_timer;
+	}
+
+	ret = futex_parse_waitv(futexv, waiters, nr_futexes);
+	if (!ret)
+		ret = futex_wait_multiple(futexv, nr_futexes, timeout ? &to : NULL);
+
+	kfree(futexv);
+
+destroy_timer:
+	if (timeout) {
+		hrtimer_cancel(&to.timer);
+		destroy_hrtimer_on_stack(&to.timer);
+	}
+	return ret;
+}
+
+/**
+ * sys_futex_wake - Wake a number of futexes
+ * @uaddr:	Address of the futex(es) to wake
+ * @mask:	bitmask
+ * @nr:		Number of the futexes to wake
+ * @flags:	FUTEX2 flags
+ *
+ * Identical to the traditional FUTEX_WAKE_BITSET op, except it is part of the
+ * futex2 family of calls and so takes futex words of any futex2 size, such as
+ * the ones futex_waitv() waits on.
+ */
+SYSCALL_DEFINE4(futex_wake, void __user *, uaddr, unsigned long, mask,
+		int, nr, unsigned int, flags)
+{
+	unsigned int size;
+
+	if (flags & ~FUTEXV_WAITER_MASK)
+		return -EINVAL;
+
+	size = futex2_size(flags);
+	if (!size || mask > U32_MAX)
+		return -EINVAL;
+
+	return __futex_wake(uaddr, flags & FUTEX2_PRIVATE ? 0 : FLAGS_SHARED,
+			    size, nr, mask);
+}
+
 #ifdef CONFIG_COMPAT
 /*
  * Fetch a robust-list pointer. Bit 0 signals PI futexes:
@@ -4243,30 +4701,43 @@ static void __init futex_detect_cmpxchg(void)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
 	unsigned long i;
+	int node;
 
 #if CONFIG_BASE_SMALL
 	futex_hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	futex_hashsize = roundup_pow_of_two(256 *
+			DIV_ROUND_UP(num_possible_cpus(), nr_node_ids));
 #endif
+	futex_hashshift = ilog2(futex_hashsize);
 
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0,
-					       futex_hashsize < 256 ? HASH_SMALL : 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
+	futex_queues = kcalloc(nr_node_ids, sizeof(*futex_queues), GFP_KERNEL);
+	if (!futex_queues)
+		panic("Failed to allocate futex hash tables\n");
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+	for (node = 0; node < nr_node_ids; node++) {
+		struct futex_hash_bucket *queues;
+		int nid = node_state(node, N_MEMORY) ? node : NUMA_NO_NODE;
+
+		queues = kvmalloc_node(futex_hashsize * sizeof(*queues),
+				       GFP_KERNEL, nid);
+		if (!queues)
+			panic("Failed to allocate futex hash table\n");
+
+		for (i = 0; i < futex_hashsize; i++) {
+			atomic_set(&queues[i].waiters, 0);
+			plist_head_init(&queues[i].chain);
+			spin_lock_init(&queues[i].lock);
+		}
+		futex_queues[node] = queues;
 	}
 
+	pr_info("futex hash table entries: %lu (%d nodes)\n",
+		futex_hashsize, nr_node_ids);
+
 	return 0;
 }
 core_initcall(futex_init);
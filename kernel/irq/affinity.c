@@ -8,6 +8,7 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/sort.h>
+#include <linux/sched/topology.h>
 
 static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
 				unsigned int cpus_per_vec)
@@ -80,6 +81,56 @@ static void build_node_to_cpumask(cpumask_var_t *masks)
 		cpumask_set_cpu(cpu, masks[cpu_to_node(cpu)]);
 }
 
+/*
+ * Offline CPUs have no cache topology yet. Keep them together per node so
+ * they are spread like before the LLC grouping was introduced.
+ */
+static bool cpus_share_llc(unsigned int a, unsigned int b)
+{
+	if (cpu_online(a) && cpu_online(b))
+		return cpus_share_cache(a, b);
+	if (!cpu_online(a) && !cpu_online(b))
+		return cpu_to_node(a) == cpu_to_node(b);
+	return false;
+}
+
+static void free_llc_to_cpumask(cpumask_var_t *masks, unsigned int nr_llcs)
+{
+	unsigned int llc;
+
+	for (llc = 0; llc < nr_llcs; llc++)
+		free_cpumask_var(masks[llc]);
+	kfree(masks);
+}
+
+static cpumask_var_t *alloc_llc_to_cpumask(unsigned int *nr_llcs)
+{
+	unsigned int cpu, llc, nr = 0;
+	cpumask_var_t *masks;
+
+	masks = kcalloc(nr_cpu_ids, sizeof(cpumask_var_t), GFP_KERNEL);
+	if (!masks)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		for (llc = 0; llc < nr; llc++) {
+			if (cpus_share_llc(cpu, cpumask_first(masks[llc])))
+				break;
+		}
+		if (llc == nr) {
+			if (!zalloc_cpumask_var(&masks[nr], GFP_KERNEL)) {
+				free_llc_to_cpumask(masks, nr);
+				return NULL;
+			}
+			nr++;
+		}
+		cpumask_set_cpu(cpu, masks[llc]);
+	}
+
+	*nr_llcs = nr;
+	return masks;
+}
+
 static int get_nodes_in_cpumask(cpumask_var_t *node_to_cpumask,
 				const struct cpumask *mask, nodemask_t *nodemsk)
 {
@@ -95,7 +146,7 @@ static int get_nodes_in_cpumask(cpumask_var_t *node_to_cpumask,
 	return nodes;
 }
 
-struct node_vectors {
+struct group_vectors {
 	unsigned id;
 
 	union {
@@ -106,54 +157,53 @@ struct node_vectors {
 
 static int ncpus_cmp_func(const void *l, const void *r)
 {
-	const struct node_vectors *ln = l;
-	const struct node_vectors *rn = r;
+	const struct group_vectors *ln = l;
+	const struct group_vectors *rn = r;
 
 	return ln->ncpus - rn->ncpus;
 }
 
 /*
- * Allocate vector number for each node, so that for each node:
+ * Allocate vector number for each group of CPUs, a node or the part of a
+ * node sharing a last level cache, so that for each group:
  *
  * 1) the allocated number is >= 1
  *
- * 2) the allocated numbver is <= active CPU number of this node
+ * 2) the allocated numbver is <= active CPU number of this group
  *
  * The actual allocated total vectors may be less than @numvecs when
  * active total CPU number is less than @numvecs.
  *
- * Active CPUs means the CPUs in '@cpu_mask AND @node_to_cpumask[]'
- * for each node.
+ * Active CPUs means the CPUs in '@cpu_mask AND @group_to_cpumask[]'
+ * for each group.
  */
-static void alloc_nodes_vectors(unsigned int numvecs,
-				cpumask_var_t *node_to_cpumask,
-				const struct cpumask *cpu_mask,
-				const nodemask_t nodemsk,
-				struct cpumask *nmsk,
-				struct node_vectors *node_vectors)
+static void alloc_groups_vectors(unsigned int numvecs,
+				 cpumask_var_t *group_to_cpumask,
+				 unsigned int ngroups,
+				 const struct cpumask *cpu_mask,
+				 struct cpumask *nmsk,
+				 struct group_vectors *group_vectors)
 {
 	unsigned n, remaining_ncpus = 0;
 
-	for (n = 0; n < nr_node_ids; n++) {
-		node_vectors[n].id = n;
-		node_vectors[n].ncpus = UINT_MAX;
-	}
-
-	for_each_node_mask(n, nodemsk) {
+	for (n = 0; n < ngroups; n++) {
 		unsigned ncpus;
 
-		cpumask_and(nmsk, cpu_mask, node_to_cpumask[n]);
+		group_vectors[n].id = n;
+		group_vectors[n].ncpus = UINT_MAX;
+
+		cpumask_and(nmsk, cpu_mask, group_to_cpumask[n]);
 		ncpus = cpumask_weight(nmsk);
 
 		if (!ncpus)
 			continue;
 		remaining_ncpus += ncpus;
-		node_vectors[n].ncpus = ncpus;
+		group_vectors[n].ncpus = ncpus;
 	}
 
 	numvecs = min_t(unsigned, remaining_ncpus, numvecs);
 
-	sort(node_vectors, nr_node_ids, sizeof(node_vectors[0]),
+	sort(group_vectors, ngroups, sizeof(group_vectors[0]),
 	     ncpus_cmp_func, NULL);
 
 	/*
@@ -224,39 +274,154 @@ static void alloc_nodes_vectors(unsigned int numvecs,
 	 * finally for each node X: vecs(X) <= ncpu(X).
 	 *
 	 */
-	for (n = 0; n < nr_node_ids; n++) {
+	for (n = 0; n < ngroups; n++) {
 		unsigned nvectors, ncpus;
 
-		if (node_vectors[n].ncpus == UINT_MAX)
+		if (group_vectors[n].ncpus == UINT_MAX)
 			continue;
 
 		WARN_ON_ONCE(numvecs == 0);
 
-		ncpus = node_vectors[n].ncpus;
+		ncpus = group_vectors[n].ncpus;
 		nvectors = max_t(unsigned, 1,
 				 numvecs * ncpus / remaining_ncpus);
 		WARN_ON_ONCE(nvectors > ncpus);
 
-		node_vectors[n].nvectors = nvectors;
+		group_vectors[n].nvectors = nvectors;
 
 		remaining_ncpus -= ncpus;
 		numvecs -= nvectors;
 	}
 }
 
+static unsigned int irq_wrap_vec(unsigned int vec, unsigned int firstvec,
+				 unsigned int last_affv)
+{
+	return vec >= last_affv ? firstvec + vec - last_affv : vec;
+}
+
+/* Spread @nvectors vectors evenly on the CPUs in @nmsk, siblings first */
+static unsigned int irq_spread_vectors(unsigned int curvec,
+				       unsigned int nvectors,
+				       unsigned int firstvec,
+				       unsigned int last_affv,
+				       struct cpumask *nmsk,
+				       struct irq_affinity_desc *masks)
+{
+	unsigned int ncpus = cpumask_weight(nmsk);
+	unsigned int v, cpus_per_vec, extra_vecs;
+
+	/* Account for rounding errors */
+	extra_vecs = ncpus - nvectors * (ncpus / nvectors);
+
+	for (v = 0; v < nvectors; v++, curvec++) {
+		cpus_per_vec = ncpus / nvectors;
+
+		/* Account for extra vectors to compensate rounding errors */
+		if (extra_vecs) {
+			cpus_per_vec++;
+			--extra_vecs;
+		}
+
+		/*
+		 * wrapping has to be considered given 'startvec'
+		 * may start anywhere
+		 */
+		if (curvec >= last_affv)
+			curvec = firstvec;
+		irq_spread_init_one(&masks[curvec].mask, nmsk, cpus_per_vec);
+	}
+	return curvec;
+}
+
+/*
+ * Spread the vectors of a node on the CPUs of the node in @nmsk. When the
+ * node has less vectors than CPUs, a vector must not be shared by CPUs
+ * which sit behind different last level caches, so the vectors are first
+ * distributed to the LLC domains of the node and then spread within each
+ * domain.
+ */
+static int irq_spread_node_vectors(unsigned int *curvec,
+				   unsigned int nvectors,
+				   unsigned int firstvec,
+				   unsigned int last_affv,
+				   cpumask_var_t *llc_to_cpumask,
+				   unsigned int nr_llcs,
+				   struct cpumask *nmsk,
+				   struct cpumask *lmsk,
+				   struct irq_affinity_desc *masks)
+{
+	unsigned int i, v, vec, nllcs = 0;
+	struct group_vectors *llc_vectors;
+
+	for (i = 0; i < nr_llcs; i++) {
+		if (cpumask_intersects(nmsk, llc_to_cpumask[i]))
+			nllcs++;
+	}
+
+	if (nllcs <= 1 || nvectors >= cpumask_weight(nmsk)) {
+		*curvec = irq_spread_vectors(*curvec, nvectors, firstvec,
+					     last_affv, nmsk, masks);
+		return 0;
+	}
+
+	/* Not more vectors than LLCs, hand out whole LLCs */
+	if (nvectors <= nllcs) {
+		for (i = 0, v = 0; i < nr_llcs; i++) {
+			cpumask_and(lmsk, nmsk, llc_to_cpumask[i]);
+			if (cpumask_empty(lmsk))
+				continue;
+			vec = irq_wrap_vec(*curvec + v, firstvec, last_affv);
+			cpumask_or(&masks[vec].mask, &masks[vec].mask, lmsk);
+			if (++v == nvectors)
+				v = 0;
+		}
+		*curvec = irq_wrap_vec(*curvec + nvectors, firstvec, last_affv);
+		return 0;
+	}
+
+	llc_vectors = kcalloc(nr_llcs, sizeof(struct group_vectors),
+			      GFP_KERNEL);
+	if (!llc_vectors)
+		return -ENOMEM;
+
+	alloc_groups_vectors(nvectors, llc_to_cpumask, nr_llcs, nmsk, lmsk,
+			     llc_vectors);
+
+	for (i = 0; i < nr_llcs; i++) {
+		struct group_vectors *lv = &llc_vectors[i];
+
+		if (lv->nvectors == UINT_MAX)
+			continue;
+
+		cpumask_and(lmsk, nmsk, llc_to_cpumask[lv->id]);
+		if (cpumask_empty(lmsk))
+			continue;
+
+		*curvec = irq_spread_vectors(*curvec, lv->nvectors, firstvec,
+					     last_affv, lmsk, masks);
+	}
+	kfree(llc_vectors);
+	return 0;
+}
+
 static int __irq_build_affinity_masks(unsigned int startvec,
 				      unsigned int numvecs,
 				      unsigned int firstvec,
 				      cpumask_var_t *node_to_cpumask,
+				      cpumask_var_t *llc_to_cpumask,
+				      unsigned int nr_llcs,
 				      const struct cpumask *cpu_mask,
 				      struct cpumask *nmsk,
+				      struct cpumask *lmsk,
 				      struct irq_affinity_desc *masks)
 {
-	unsigned int i, n, nodes, cpus_per_vec, extra_vecs, done = 0;
+	unsigned int i, n, nodes, done = 0;
 	unsigned int last_affv = firstvec + numvecs;
 	unsigned int curvec = startvec;
 	nodemask_t nodemsk = NODE_MASK_NONE;
-	struct node_vectors *node_vectors;
+	struct group_vectors *node_vectors;
+	int ret = 0;
 
 	if (!cpumask_weight(cpu_mask))
 		return 0;
@@ -279,18 +444,18 @@ static int __irq_build_affinity_masks(unsigned int startvec,
 	}
 
 	node_vectors = kcalloc(nr_node_ids,
-			       sizeof(struct node_vectors),
+			       sizeof(struct group_vectors),
 			       GFP_KERNEL);
 	if (!node_vectors)
 		return -ENOMEM;
 
 	/* allocate vector number for each node */
-	alloc_nodes_vectors(numvecs, node_to_cpumask, cpu_mask,
-			    nodemsk, nmsk, node_vectors);
+	alloc_groups_vectors(numvecs, node_to_cpumask, nr_node_ids, cpu_mask,
+			     nmsk, node_vectors);
 
 	for (i = 0; i < nr_node_ids; i++) {
-		unsigned int ncpus, v;
-		struct node_vectors *nv = &node_vectors[i];
+		unsigned int ncpus;
+		struct group_vectors *nv = &node_vectors[i];
 
 		if (nv->nvectors == UINT_MAX)
 			continue;
@@ -303,32 +468,16 @@ static int __irq_build_affinity_masks(unsigned int startvec,
 
 		WARN_ON_ONCE(nv->nvectors > ncpus);
 
-		/* Account for rounding errors */
-		extra_vecs = ncpus - nv->nvectors * (ncpus / nv->nvectors);
-
 		/* Spread allocated vectors on CPUs of the current node */
-		for (v = 0; v < nv->nvectors; v++, curvec++) {
-			cpus_per_vec = ncpus / nv->nvectors;
-
-			/* Account for extra vectors to compensate rounding errors */
-			if (extra_vecs) {
-				cpus_per_vec++;
-				--extra_vecs;
-			}
-
-			/*
-			 * wrapping has to be considered given 'startvec'
-			 * may start anywhere
-			 */
-			if (curvec >= last_affv)
-				curvec = firstvec;
-			irq_spread_init_one(&masks[curvec].mask, nmsk,
-						cpus_per_vec);
-		}
+		ret = irq_spread_node_vectors(&curvec, nv->nvectors, firstvec,
+					      last_affv, llc_to_cpumask,
+					      nr_llcs, nmsk, lmsk, masks);
+		if (ret)
+			break;
 		done += nv->nvectors;
 	}
 	kfree(node_vectors);
-	return done;
+	return ret ? ret : done;
 }
 
 /*
@@ -341,16 +490,20 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 				    struct irq_affinity_desc *masks)
 {
 	unsigned int curvec = startvec, nr_present = 0, nr_others = 0;
-	cpumask_var_t *node_to_cpumask;
-	cpumask_var_t nmsk, npresmsk;
+	cpumask_var_t *node_to_cpumask, *llc_to_cpumask;
+	cpumask_var_t nmsk, lmsk, npresmsk;
+	unsigned int nr_llcs;
 	int ret = -ENOMEM;
 
 	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
 		return ret;
 
-	if (!zalloc_cpumask_var(&npresmsk, GFP_KERNEL))
+	if (!zalloc_cpumask_var(&lmsk, GFP_KERNEL))
 		goto fail_nmsk;
 
+	if (!zalloc_cpumask_var(&npresmsk, GFP_KERNEL))
+		goto fail_lmsk;
+
 	node_to_cpumask = alloc_node_to_cpumask();
 	if (!node_to_cpumask)
 		goto fail_npresmsk;
@@ -359,10 +512,15 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 	cpus_read_lock();
 	build_node_to_cpumask(node_to_cpumask);
 
+	llc_to_cpumask = alloc_llc_to_cpumask(&nr_llcs);
+	if (!llc_to_cpumask)
+		goto fail_llc;
+
 	/* Spread on present CPUs starting from affd->pre_vectors */
 	ret = __irq_build_affinity_masks(curvec, numvecs, firstvec,
-					 node_to_cpumask, cpu_present_mask,
-					 nmsk, masks);
+					 node_to_cpumask, llc_to_cpumask,
+					 nr_llcs, cpu_present_mask,
+					 nmsk, lmsk, masks);
 	if (ret < 0)
 		goto fail_build_affinity;
 	nr_present = ret;
@@ -379,12 +537,16 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
 		curvec = firstvec + nr_present;
 	cpumask_andnot(npresmsk, cpu_possible_mask, cpu_present_mask);
 	ret = __irq_build_affinity_masks(curvec, numvecs, firstvec,
-					 node_to_cpumask, npresmsk, nmsk,
+					 node_to_cpumask, llc_to_cpumask,
+					 nr_llcs, npresmsk, nmsk, lmsk,
 					 masks);
 	if (ret >= 0)
 		nr_others = ret;
 
  fail_build_affinity:
+	free_llc_to_cpumask(llc_to_cpumask, nr_llcs);
+
+ fail_llc:
 	cpus_read_unlock();
 
 	if (ret >= 0)
@@ -395,6 +557,9 @@ static int irq_build_affinity_masks(unsigned int startvec, unsigned int numvecs,
  fail_npresmsk:
 	free_cpumask_var(npresmsk);
 
+ fail_lmsk:
+	free_cpumask_var(lmsk);
+
  fail_nmsk:
 	free_cpumask_var(nmsk);
 	return ret < 0 ? ret : 0;
@@ -7,6 +7,7 @@
 #include <linux/percpu.h>
 #include <linux/cpu.h>
 #include <linux/irq.h>
+#include <linux/topology.h>
 
 #define IRQ_MATRIX_SIZE	(BITS_TO_LONGS(IRQ_MATRIX_BITS))
 
@@ -125,23 +126,49 @@ static unsigned int matrix_alloc_area(struct irq_matrix *m, struct cpumap *cm,
 	return area;
 }
 
+/*
+ * Load of the core of @cpu, i.e. the sum of @cpu and its SMT siblings.
+ * Used to break ties between equally loaded CPUs, so that vectors are
+ * spread over cores before two of them end up on siblings of one core.
+ */
+static unsigned int matrix_core_load(struct irq_matrix *m, unsigned int cpu,
+				     bool managed)
+{
+	unsigned int sibl, load = 0;
+	struct cpumap *cm;
+
+	for_each_cpu(sibl, topology_sibling_cpumask(cpu)) {
+		cm = per_cpu_ptr(m->maps, sibl);
+		if (cm->online)
+			load += managed ? cm->managed_allocated : cm->allocated;
+	}
+	return load;
+}
+
 /* Find the best CPU which has the lowest vector allocation count */
 static unsigned int matrix_find_best_cpu(struct irq_matrix *m,
 					const struct cpumask *msk)
 {
-	unsigned int cpu, best_cpu, maxavl = 0;
+	unsigned int cpu, best_cpu, maxavl = 0, coreload = UINT_MAX;
 	struct cpumap *cm;
 
 	best_cpu = UINT_MAX;
 
 	for_each_cpu(cpu, msk) {
+		unsigned int load;
+
 		cm = per_cpu_ptr(m->maps, cpu);
 
-		if (!cm->online || cm->available <= maxavl)
+		if (!cm->online || cm->available < maxavl || !cm->available)
+			continue;
+
+		load = matrix_core_load(m, cpu, false);
+		if (cm->available == maxavl && load >= coreload)
 			continue;
 
 		best_cpu = cpu;
 		maxavl = cm->available;
+		coreload = load;
 	}
 	return best_cpu;
 }
@@ -150,19 +177,26 @@ static unsigned int matrix_find_best_cpu(struct irq_matrix *m,
 static unsigned int matrix_find_best_cpu_managed(struct irq_matrix *m,
 						const struct cpumask *msk)
 {
-	unsigned int cpu, best_cpu, allocated = UINT_MAX;
+	unsigned int cpu, best_cpu, allocated = UINT_MAX, coreload = UINT_MAX;
 	struct cpumap *cm;
 
 	best_cpu = UINT_MAX;
 
 	for_each_cpu(cpu, msk) {
+		unsigned int load;
+
 		cm = per_cpu_ptr(m->maps, cpu);
 
 		if (!cm->online || cm->managed_allocated > allocated)
 			continue;
 
+		load = matrix_core_load(m, cpu, true);
+		if (cm->managed_allocated == allocated && load > coreload)
+			continue;
+
 		best_cpu = cpu;
 		allocated = cm->managed_allocated;
+		coreload = load;
 	}
 	return best_cpu;
 }
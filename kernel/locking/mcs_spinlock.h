@@ -35,14 +35,20 @@ do {									\
 } while (0)
 #endif
 
-#ifndef arch_mcs_spin_unlock_contended
+#ifndef arch_mcs_lock_handoff
 /*
  * smp_store_release() provides a memory barrier to ensure all
  * operations in the critical section has been completed before
- * unlocking.
+ * unlocking. @val is 1 for a plain MCS handoff; the NUMA-aware
+ * qspinlock slowpath uses other non-zero values to pass on state.
  */
+#define arch_mcs_lock_handoff(l, val)					\
+	smp_store_release((l), (val))
+#endif
+
+#ifndef arch_mcs_spin_unlock_contended
 #define arch_mcs_spin_unlock_contended(l)				\
-	smp_store_release((l), 1)
+	arch_mcs_lock_handoff((l), 1)
 #endif
 
 /*
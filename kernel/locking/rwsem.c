@@ -27,6 +27,7 @@
 #include <linux/export.h>
 #include <linux/rwsem.h>
 #include <linux/atomic.h>
+#include <trace/events/lock.h>
 
 #ifndef CONFIG_PREEMPT_RT
 #include "lock_events.h"
@@ -668,6 +669,29 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	return false;
 }
 
+/*
+ * Try to acquire read lock before the reader is put on wait queue.
+ * The read bias of down_read() must have been backed out.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long count = atomic_long_read(&sem->count);
+
+	if (count & (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))
+		return false;
+
+	count = atomic_long_fetch_add_acquire(RWSEM_READER_BIAS, &sem->count);
+	if (!(count & (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))) {
+		rwsem_set_reader_owned(sem);
+		lockevent_inc(rwsem_opt_rlock);
+		return true;
+	}
+
+	/* Back out the change */
+	atomic_long_add(-RWSEM_READER_BIAS, &sem->count);
+	return false;
+}
+
 static inline bool owner_on_cpu(struct task_struct *owner)
 {
 	/*
@@ -910,6 +934,61 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	return taken;
 }
 
+/*
+ * Reader optimistic spinning. Only a running writer is spun on: its
+ * critical section is likely to be over before the reader could go to
+ * sleep and be woken up again. A reader-owned lock that can't be joined
+ * has either the handoff bit set or a writer about to take it, neither of
+ * which is worth waiting for.
+ *
+ * The handoff bit of a writer that waited for more than RWSEM_WAIT_TIMEOUT
+ * stops the spinning readers, which bounds how long they can keep queued
+ * writers away just like it does for reader lock stealing.
+ */
+static bool rwsem_reader_optimistic_spin(struct rw_semaphore *sem)
+{
+	bool taken = false;
+	int prev_owner_state = OWNER_NULL;
+
+	preempt_disable();
+
+	/* sem->wait_lock should not be held when doing optimistic spinning */
+	if (!osq_lock(&sem->osq))
+		goto done;
+
+	for (;;) {
+		enum owner_state owner_state;
+
+		owner_state = rwsem_spin_on_owner(sem);
+		if (!(owner_state & OWNER_SPINNABLE))
+			break;
+
+		taken = rwsem_try_read_lock_unqueued(sem);
+		if (taken)
+			break;
+
+		/*
+		 * The writer went away without us getting the lock: retry
+		 * once in case a new writer is about to show up in the owner
+		 * field, then give up unless we end up spinning on it.
+		 */
+		if (owner_state != OWNER_WRITER) {
+			if (need_resched() ||
+			    prev_owner_state != OWNER_WRITER ||
+			    (atomic_long_read(&sem->count) & RWSEM_FLAG_HANDOFF))
+				break;
+		}
+		prev_owner_state = owner_state;
+
+		cpu_relax();
+	}
+	osq_unlock(&sem->osq);
+done:
+	preempt_enable();
+	lockevent_cond_inc(rwsem_opt_fail, !taken);
+	return taken;
+}
+
 /*
  * Clear the owner's RWSEM_NONSPINNABLE bit if it is set. This should
  * only be called when the reader count reaches 0.
@@ -931,6 +1010,11 @@ static inline bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	return false;
 }
 
+static inline bool rwsem_reader_optimistic_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+
 static inline void clear_nonspinnable(struct rw_semaphore *sem) { }
 
 static inline enum owner_state
@@ -983,6 +1067,31 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, unsigned int stat
 		return sem;
 	}
 
+	/*
+	 * Spin on a running writer instead of sleeping behind it, unless a
+	 * waiter already asked for the lock to be handed off.
+	 */
+	if ((count & RWSEM_WRITER_LOCKED) && !(count & RWSEM_FLAG_HANDOFF) &&
+	    rwsem_can_spin_on_owner(sem)) {
+		/*
+		 * Undo read bias from down_read() and do optimistic spinning.
+		 */
+		atomic_long_add(-RWSEM_READER_BIAS, &sem->count);
+		adjustment = 0;
+		if (rwsem_reader_optimistic_spin(sem)) {
+			/* rwsem_reader_optimistic_spin() implies ACQUIRE */
+			if (atomic_long_read(&sem->count) & RWSEM_FLAG_WAITERS) {
+				raw_spin_lock_irq(&sem->wait_lock);
+				if (!list_empty(&sem->wait_list))
+					rwsem_mark_wake(sem, RWSEM_WAKE_READ_OWNED,
+							&wake_q);
+				raw_spin_unlock_irq(&sem->wait_lock);
+				wake_up_q(&wake_q);
+			}
+			return sem;
+		}
+	}
+
 queue:
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
@@ -995,9 +1104,10 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, unsigned int stat
 		 * In case the wait queue is empty and the lock isn't owned
 		 * by a writer or has the handoff bit set, this reader can
 		 * exit the slowpath and return immediately as its
-		 * RWSEM_READER_BIAS has already been set in the count.
+		 * RWSEM_READER_BIAS has already been set in the count,
+		 * unless it was backed out for spinning.
 		 */
-		if (!(atomic_long_read(&sem->count) &
+		if (adjustment && !(atomic_long_read(&sem->count) &
 		     (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))) {
 			/* Provide lock ACQUIRE */
 			smp_acquire__after_ctrl_dep();
@@ -1227,8 +1337,12 @@ static inline int __down_read_common(struct rw_semaphore *sem, int state)
 	long count;
 
 	if (!rwsem_read_trylock(sem, &count)) {
-		if (IS_ERR(rwsem_down_read_slowpath(sem, count, state)))
+		trace_contention_begin(sem, LCB_F_READ);
+		if (IS_ERR(rwsem_down_read_slowpath(sem, count, state))) {
+			trace_contention_end(sem, -EINTR);
 			return -EINTR;
+		}
+		trace_contention_end(sem, 0);
 		DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
 	}
 	return 0;
@@ -1275,8 +1389,12 @@ static inline int __down_read_trylock(struct rw_semaphore *sem)
 static inline int __down_write_common(struct rw_semaphore *sem, int state)
 {
 	if (unlikely(!rwsem_write_trylock(sem))) {
-		if (IS_ERR(rwsem_down_write_slowpath(sem, state)))
+		trace_contention_begin(sem, LCB_F_WRITE);
+		if (IS_ERR(rwsem_down_write_slowpath(sem, state))) {
+			trace_contention_end(sem, -EINTR);
 			return -EINTR;
+		}
+		trace_contention_end(sem, 0);
 	}
 
 	return 0;
@@ -18,6 +18,8 @@
 #include <linux/cpu.h>
 #include <linux/padata.h>
 #include <linux/mutex.h>
+#include <linux/llist.h>
+#include <linux/topology.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/sysfs.h>
@@ -69,6 +71,42 @@ static int padata_cpu_hash(struct parallel_data *pd, unsigned int seq_nr)
 	return padata_index_to_cpu(pd, cpu_index);
 }
 
+/*
+ * Pick a serial CPU for a caller whose choice isn't in the serial cpumask.
+ * CPUs on the node of the requested one are preferred, so the callback still
+ * runs close to where the caller expected it.
+ */
+static int padata_fallback_cpu(struct parallel_data *pd, int cb_cpu)
+{
+	const struct cpumask *mask = pd->cpumask.cbcpu;
+	int i, cpu, cpu_index, weight;
+
+	if ((unsigned int)cb_cpu < nr_cpu_ids) {
+		const struct cpumask *node_mask;
+
+		node_mask = cpumask_of_node(cpu_to_node(cb_cpu));
+		weight = 0;
+		for_each_cpu_and(cpu, mask, node_mask)
+			weight++;
+
+		if (weight) {
+			i = 0;
+			cpu_index = cb_cpu % weight;
+			for_each_cpu_and(cpu, mask, node_mask)
+				if (i++ == cpu_index)
+					return cpu;
+		}
+	}
+
+	cpu_index = (unsigned int)cb_cpu % cpumask_weight(mask);
+
+	cpu = cpumask_first(mask);
+	for (i = 0; i < cpu_index; i++)
+		cpu = cpumask_next(cpu, mask);
+
+	return cpu;
+}
+
 static struct padata_work *padata_work_alloc(void)
 {
 	struct padata_work *pw;
@@ -158,7 +196,9 @@ static void padata_parallel_worker(struct work_struct *parallel_work)
  *          (i.e. cpumask.cbcpu), this function selects a fallback CPU and if
  *          none found, returns -EINVAL.
  *
- * The parallelization callback function will run with BHs off.
+ * The parallelization callback function will run with BHs off, on a CPU of
+ * the same NUMA node as @cb_cpu if the parallel cpumask has one there, so
+ * the data of a flow doesn't bounce between nodes.
  * Note: Every object which is parallelized by padata_do_parallel
  * must be seen by padata_do_serial.
  *
@@ -168,9 +208,9 @@ int padata_do_parallel(struct padata_shell *ps,
 		       struct padata_priv *padata, int *cb_cpu)
 {
 	struct padata_instance *pinst = ps->pinst;
-	int i, cpu, cpu_index, err;
 	struct parallel_data *pd;
 	struct padata_work *pw;
+	int err;
 
 	rcu_read_lock_bh();
 
@@ -185,13 +225,7 @@ int padata_do_parallel(struct padata_shell *ps,
 			goto out;
 
 		/* Select an alternate fallback CPU and notify the caller. */
-		cpu_index = *cb_cpu % cpumask_weight(pd->cpumask.cbcpu);
-
-		cpu = cpumask_first(pd->cpumask.cbcpu);
-		for (i = 0; i < cpu_index; i++)
-			cpu = cpumask_next(cpu, pd->cpumask.cbcpu);
-
-		*cb_cpu = cpu;
+		*cb_cpu = padata_fallback_cpu(pd, *cb_cpu);
 	}
 
 	err =  -EBUSY;
@@ -211,7 +245,8 @@ int padata_do_parallel(struct padata_shell *ps,
 
 	if (pw) {
 		padata_work_init(pw, padata_parallel_worker, padata, 0);
-		queue_work(pinst->parallel_wq, &pw->pw_work);
+		queue_work_node(cpu_to_node(*cb_cpu), pinst->parallel_wq,
+				&pw->pw_work);
 	} else {
 		/* Maximum works limit exceeded, run in the current task. */
 		padata->parallel(padata);
@@ -226,7 +261,28 @@ int padata_do_parallel(struct padata_shell *ps,
 EXPORT_SYMBOL(padata_do_parallel);
 
 /*
- * padata_find_next - Find the next object that needs serialization.
+ * Move the objects that padata_do_serial added to @reorder since the last
+ * call into its sorted list.  Called with pd->lock held.
+ */
+static void padata_reorder_collect(struct padata_reorder_list *reorder)
+{
+	struct padata_priv *padata, *next, *cur;
+	struct llist_node *pending;
+
+	pending = llist_del_all(&reorder->pending);
+
+	llist_for_each_entry_safe(padata, next, pending, llnode) {
+		/* Sort in ascending order of sequence number. */
+		list_for_each_entry_reverse(cur, &reorder->list, list)
+			if (cur->seq_nr < padata->seq_nr)
+				break;
+		list_add(&padata->list, &cur->list);
+	}
+}
+
+/*
+ * padata_find_next - Find and dequeue the next object that needs
+ * serialization.  Called with pd->lock held.
  *
  * Return:
  * * A pointer to the control struct of the next object that needs
@@ -235,39 +291,33 @@ EXPORT_SYMBOL(padata_do_parallel);
  *   be parallel processed by another cpu and is not yet present in
  *   the cpu's reorder queue.
  */
-static struct padata_priv *padata_find_next(struct parallel_data *pd,
-					    bool remove_object)
+static struct padata_priv *padata_find_next(struct parallel_data *pd)
 {
+	struct padata_reorder_list *reorder;
 	struct padata_priv *padata;
-	struct padata_list *reorder;
 	int cpu = pd->cpu;
 
+	lockdep_assert_held(&pd->lock);
+
 	reorder = per_cpu_ptr(pd->reorder_list, cpu);
+	padata_reorder_collect(reorder);
 
-	spin_lock(&reorder->lock);
-	if (list_empty(&reorder->list)) {
-		spin_unlock(&reorder->lock);
+	padata = list_first_entry_or_null(&reorder->list, struct padata_priv,
+					  list);
+	if (!padata)
 		return NULL;
-	}
-
-	padata = list_entry(reorder->list.next, struct padata_priv, list);
 
 	/*
 	 * Checks the rare case where two or more parallel jobs have hashed to
 	 * the same CPU and one of the later ones finishes first.
 	 */
-	if (padata->seq_nr != pd->processed) {
-		spin_unlock(&reorder->lock);
+	if (padata->seq_nr != pd->processed)
 		return NULL;
-	}
 
-	if (remove_object) {
-		list_del_init(&padata->list);
-		++pd->processed;
-		pd->cpu = cpumask_next_wrap(cpu, pd->cpumask.pcpu, -1, false);
-	}
+	list_del_init(&padata->list);
+	++pd->processed;
+	pd->cpu = cpumask_next_wrap(cpu, pd->cpumask.pcpu, -1, false);
 
-	spin_unlock(&reorder->lock);
 	return padata;
 }
 
@@ -277,7 +327,7 @@ static void padata_reorder(struct parallel_data *pd)
 	int cb_cpu;
 	struct padata_priv *padata;
 	struct padata_serial_queue *squeue;
-	struct padata_list *reorder;
+	struct padata_reorder_list *reorder;
 
 	/*
 	 * We need to ensure that only one cpu can work on dequeueing of
@@ -293,7 +343,7 @@ static void padata_reorder(struct parallel_data *pd)
 		return;
 
 	while (1) {
-		padata = padata_find_next(pd, true);
+		padata = padata_find_next(pd);
 
 		/*
 		 * If the next object that needs serialization is parallel
@@ -322,11 +372,15 @@ static void padata_reorder(struct parallel_data *pd)
 	 * Ensure reorder queue is read after pd->lock is dropped so we see
 	 * new objects from another task in padata_do_serial.  Pairs with
 	 * smp_mb in padata_do_serial.
+	 *
+	 * Everything that was already on the sorted list of pd->cpu has been
+	 * looked at under the lock, so only a new pending object can be the
+	 * next one.
 	 */
 	smp_mb();
 
-	reorder = per_cpu_ptr(pd->reorder_list, pd->cpu);
-	if (!list_empty(&reorder->list) && padata_find_next(pd, false))
+	reorder = per_cpu_ptr(pd->reorder_list, READ_ONCE(pd->cpu));
+	if (!llist_empty(&reorder->pending))
 		queue_work(pinst->serial_wq, &pd->reorder_work);
 }
 
@@ -386,16 +440,15 @@ void padata_do_serial(struct padata_priv *padata)
 {
 	struct parallel_data *pd = padata->pd;
 	int hashed_cpu = padata_cpu_hash(pd, padata->seq_nr);
-	struct padata_list *reorder = per_cpu_ptr(pd->reorder_list, hashed_cpu);
-	struct padata_priv *cur;
+	struct padata_reorder_list *reorder;
 
-	spin_lock(&reorder->lock);
-	/* Sort in ascending order of sequence number. */
-	list_for_each_entry_reverse(cur, &reorder->list, list)
-		if (cur->seq_nr < padata->seq_nr)
-			break;
-	list_add(&padata->list, &cur->list);
-	spin_unlock(&reorder->lock);
+	/*
+	 * Only queue the object here, whoever holds pd->lock in padata_reorder
+	 * sorts it in.  Completions on many CPUs then don't serialize on a
+	 * list lock just to hand their object over.
+	 */
+	reorder = per_cpu_ptr(pd->reorder_list, hashed_cpu);
+	llist_add(&padata->llnode, &reorder->pending);
 
 	/*
 	 * Ensure the addition to the reorder list is ordered correctly
@@ -541,11 +594,12 @@ static void padata_init_squeues(struct parallel_data *pd)
 static void padata_init_reorder_list(struct parallel_data *pd)
 {
 	int cpu;
-	struct padata_list *list;
+	struct padata_reorder_list *reorder;
 
 	for_each_cpu(cpu, pd->cpumask.pcpu) {
-		list = per_cpu_ptr(pd->reorder_list, cpu);
-		__padata_list_init(list);
+		reorder = per_cpu_ptr(pd->reorder_list, cpu);
+		init_llist_head(&reorder->pending);
+		INIT_LIST_HEAD(&reorder->list);
 	}
 }
 
@@ -559,7 +613,7 @@ static struct parallel_data *padata_alloc_pd(struct padata_shell *ps)
 	if (!pd)
 		goto err;
 
-	pd->reorder_list = alloc_percpu(struct padata_list);
+	pd->reorder_list = alloc_percpu(struct padata_reorder_list);
 	if (!pd->reorder_list)
 		goto err_free_pd;
 
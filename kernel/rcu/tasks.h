@@ -35,6 +35,8 @@ typedef void (*postgp_func_t)(struct rcu_tasks *rtp);
  * @n_gps: Number of grace periods completed since boot.
  * @n_ipis: Number of IPIs sent to encourage grace periods to end.
  * @n_ipis_fails: Number of IPI-send failures.
+ * @tasks_gp_seq: Grace-period sequence number, for polled grace periods.
+ * @gp_seq_needed: Furthest future @tasks_gp_seq requested by pollers.
  * @pregp_func: This flavor's pre-grace-period function (optional).
  * @pertask_func: This flavor's per-task scan function (optional).
  * @postscan_func: This flavor's post-task scan function (optional).
@@ -57,6 +59,8 @@ struct rcu_tasks {
 	unsigned long n_gps;
 	unsigned long n_ipis;
 	unsigned long n_ipis_fails;
+	unsigned long tasks_gp_seq;
+	unsigned long gp_seq_needed;
 	struct task_struct *kthread_ptr;
 	rcu_tasks_gp_func_t gp_func;
 	pregp_func_t pregp_func;
@@ -178,6 +182,51 @@ static void synchronize_rcu_tasks_generic(struct rcu_tasks *rtp)
 	wait_rcu_gp(rtp->call_func);
 }
 
+// Snapshot the grace-period state for the specified flavor of Tasks RCU.
+static unsigned long get_state_synchronize_rcu_tasks_generic(struct rcu_tasks *rtp)
+{
+	smp_mb(); // Order prior updates before the load of ->tasks_gp_seq.
+	return rcu_seq_snap(&rtp->tasks_gp_seq);
+}
+
+// Snapshot the grace-period state and make sure that a grace period
+// will be run for the specified flavor of Tasks RCU.
+static unsigned long start_poll_synchronize_rcu_tasks_generic(struct rcu_tasks *rtp)
+{
+	unsigned long flags;
+	bool needwake = false;
+	unsigned long s;
+
+	s = get_state_synchronize_rcu_tasks_generic(rtp);
+	raw_spin_lock_irqsave(&rtp->cbs_lock, flags);
+	if (ULONG_CMP_LT(rtp->gp_seq_needed, s)) {
+		WRITE_ONCE(rtp->gp_seq_needed, s);
+		needwake = true;
+	}
+	raw_spin_unlock_irqrestore(&rtp->cbs_lock, flags);
+	/* The kthread checks ->gp_seq_needed once it starts. */
+	if (needwake && READ_ONCE(rtp->kthread_ptr))
+		wake_up(&rtp->cbs_wq);
+	return s;
+}
+
+// Has the grace period of the cookie ended for the specified flavor?
+static bool poll_state_synchronize_rcu_tasks_generic(struct rcu_tasks *rtp,
+						     unsigned long oldstate)
+{
+	if (rcu_seq_done(&rtp->tasks_gp_seq, oldstate)) {
+		smp_mb(); // Order the grace period before later accesses.
+		return true;
+	}
+	return false;
+}
+
+// Has a poller asked for a grace period that has not yet run?
+static bool rcu_tasks_gp_needed(struct rcu_tasks *rtp)
+{
+	return !rcu_seq_done(&rtp->tasks_gp_seq, READ_ONCE(rtp->gp_seq_needed));
+}
+
 /* RCU-tasks kthread that detects grace periods and invokes callbacks. */
 static int __noreturn rcu_tasks_kthread(void *arg)
 {
@@ -208,10 +257,11 @@ static int __noreturn rcu_tasks_kthread(void *arg)
 		raw_spin_unlock_irqrestore(&rtp->cbs_lock, flags);
 
 		/* If there were none, wait a bit and start over. */
-		if (!list) {
+		if (!list && !rcu_tasks_gp_needed(rtp)) {
 			wait_event_interruptible(rtp->cbs_wq,
-						 READ_ONCE(rtp->cbs_head));
-			if (!rtp->cbs_head) {
+						 READ_ONCE(rtp->cbs_head) ||
+						 rcu_tasks_gp_needed(rtp));
+			if (!rtp->cbs_head && !rcu_tasks_gp_needed(rtp)) {
 				WARN_ON(signal_pending(current));
 				set_tasks_gp_state(rtp, RTGS_WAIT_WAIT_CBS);
 				schedule_timeout_idle(HZ/10);
@@ -222,7 +272,9 @@ static int __noreturn rcu_tasks_kthread(void *arg)
 		// Wait for one grace period.
 		set_tasks_gp_state(rtp, RTGS_WAIT_GP);
 		rtp->gp_start = jiffies;
+		rcu_seq_start(&rtp->tasks_gp_seq);
 		rtp->gp_func(rtp);
+		rcu_seq_end(&rtp->tasks_gp_seq);
 		rtp->n_gps++;
 
 		/* Invoke the callbacks. */
@@ -578,6 +630,46 @@ void synchronize_rcu_tasks(void)
 }
 EXPORT_SYMBOL_GPL(synchronize_rcu_tasks);
 
+/**
+ * get_state_synchronize_rcu_tasks - Snapshot rcu-tasks grace-period state
+ *
+ * Returns a cookie for poll_state_synchronize_rcu_tasks(), which reports
+ * whether a full rcu-tasks grace period has elapsed since.  This does not
+ * itself cause a grace period to start.
+ */
+unsigned long get_state_synchronize_rcu_tasks(void)
+{
+	return get_state_synchronize_rcu_tasks_generic(&rcu_tasks);
+}
+EXPORT_SYMBOL_GPL(get_state_synchronize_rcu_tasks);
+
+/**
+ * start_poll_synchronize_rcu_tasks - Snapshot and start rcu-tasks grace period
+ *
+ * Returns a cookie as get_state_synchronize_rcu_tasks() does, and makes
+ * sure that the rcu-tasks kthread will run the needed grace period even
+ * if no callbacks are pending.  Does not block.
+ */
+unsigned long start_poll_synchronize_rcu_tasks(void)
+{
+	return start_poll_synchronize_rcu_tasks_generic(&rcu_tasks);
+}
+EXPORT_SYMBOL_GPL(start_poll_synchronize_rcu_tasks);
+
+/**
+ * poll_state_synchronize_rcu_tasks - Has cookie's rcu-tasks grace period ended?
+ * @oldstate: value from get_state_synchronize_rcu_tasks() or
+ *	      start_poll_synchronize_rcu_tasks()
+ *
+ * Returns true if a full rcu-tasks grace period has elapsed since the
+ * cookie was obtained, false otherwise.
+ */
+bool poll_state_synchronize_rcu_tasks(unsigned long oldstate)
+{
+	return poll_state_synchronize_rcu_tasks_generic(&rcu_tasks, oldstate);
+}
+EXPORT_SYMBOL_GPL(poll_state_synchronize_rcu_tasks);
+
 /**
  * rcu_barrier_tasks - Wait for in-flight call_rcu_tasks() callbacks.
  *
@@ -1253,6 +1345,44 @@ void synchronize_rcu_tasks_trace(void)
 }
 EXPORT_SYMBOL_GPL(synchronize_rcu_tasks_trace);
 
+/**
+ * get_state_synchronize_rcu_tasks_trace - Snapshot trace rcu-tasks GP state
+ *
+ * Returns a cookie for poll_state_synchronize_rcu_tasks_trace().  This
+ * does not itself cause a grace period to start.
+ */
+unsigned long get_state_synchronize_rcu_tasks_trace(void)
+{
+	return get_state_synchronize_rcu_tasks_generic(&rcu_tasks_trace);
+}
+EXPORT_SYMBOL_GPL(get_state_synchronize_rcu_tasks_trace);
+
+/**
+ * start_poll_synchronize_rcu_tasks_trace - Snapshot and start trace rcu-tasks GP
+ *
+ * Returns a cookie as get_state_synchronize_rcu_tasks_trace() does, and
+ * makes sure that the needed grace period will be run.  Does not block.
+ */
+unsigned long start_poll_synchronize_rcu_tasks_trace(void)
+{
+	return start_poll_synchronize_rcu_tasks_generic(&rcu_tasks_trace);
+}
+EXPORT_SYMBOL_GPL(start_poll_synchronize_rcu_tasks_trace);
+
+/**
+ * poll_state_synchronize_rcu_tasks_trace - Has cookie's trace GP ended?
+ * @oldstate: value from get_state_synchronize_rcu_tasks_trace() or
+ *	      start_poll_synchronize_rcu_tasks_trace()
+ *
+ * Returns true if a full trace rcu-tasks grace period has elapsed since
+ * the cookie was obtained, false otherwise.
+ */
+bool poll_state_synchronize_rcu_tasks_trace(unsigned long oldstate)
+{
+	return poll_state_synchronize_rcu_tasks_generic(&rcu_tasks_trace, oldstate);
+}
+EXPORT_SYMBOL_GPL(poll_state_synchronize_rcu_tasks_trace);
+
 /**
  * rcu_barrier_tasks_trace - Wait for in-flight call_rcu_tasks_trace() callbacks.
  *
@@ -862,3 +862,112 @@ void synchronize_rcu_expedited(void)
 		destroy_work_on_stack(&rew.rew_work);
 }
 EXPORT_SYMBOL_GPL(synchronize_rcu_expedited);
+
+/*
+ * Workqueue handler that runs expedited grace periods on behalf of
+ * start_poll_synchronize_rcu_expedited() until the furthest requested
+ * polled expedited grace period has completed.
+ */
+static void sync_rcu_do_polled_gp(struct work_struct *wp)
+{
+	unsigned long flags;
+	unsigned long needed;
+
+	for (;;) {
+		raw_spin_lock_irqsave(&rcu_state.exp_poll_lock, flags);
+		needed = rcu_state.exp_poll_seq_needed;
+		raw_spin_unlock_irqrestore(&rcu_state.exp_poll_lock, flags);
+		if (rcu_seq_done(&rcu_state.exp_poll_seq, needed))
+			return;
+		/* Only this work item updates ->exp_poll_seq. */
+		rcu_seq_start(&rcu_state.exp_poll_seq);
+		synchronize_rcu_expedited();
+		rcu_seq_end(&rcu_state.exp_poll_seq);
+	}
+}
+
+/**
+ * get_state_synchronize_rcu_expedited - Snapshot polled expedited GP state
+ *
+ * Returns a cookie that is passed to poll_state_synchronize_rcu_expedited()
+ * or cond_synchronize_rcu_expedited() to determine whether a full expedited
+ * grace period has elapsed in the meantime.  Unlike
+ * start_poll_synchronize_rcu_expedited(), this does not cause one to start.
+ *
+ * The cookie is distinct from those returned by get_state_synchronize_rcu()
+ * and must not be mixed with the non-expedited polling functions.
+ */
+unsigned long get_state_synchronize_rcu_expedited(void)
+{
+	/*
+	 * Any prior manipulation of RCU-protected data must happen
+	 * before the load from ->exp_poll_seq.
+	 */
+	smp_mb();  /* ^^^ */
+	return rcu_seq_snap(&rcu_state.exp_poll_seq);
+}
+EXPORT_SYMBOL_GPL(get_state_synchronize_rcu_expedited);
+
+/**
+ * start_poll_synchronize_rcu_expedited - Snapshot and start expedited GP
+ *
+ * Returns a cookie as get_state_synchronize_rcu_expedited() does, and
+ * also arranges for an expedited grace period to run from a workqueue if
+ * one is needed.  This may be invoked from any context that can invoke
+ * queue_work(), but does not itself block.
+ */
+unsigned long start_poll_synchronize_rcu_expedited(void)
+{
+	unsigned long flags;
+	bool needwork = false;
+	unsigned long s;
+
+	s = get_state_synchronize_rcu_expedited();
+	raw_spin_lock_irqsave(&rcu_state.exp_poll_lock, flags);
+	if (ULONG_CMP_LT(rcu_state.exp_poll_seq_needed, s)) {
+		WRITE_ONCE(rcu_state.exp_poll_seq_needed, s);
+		needwork = true;
+	}
+	raw_spin_unlock_irqrestore(&rcu_state.exp_poll_lock, flags);
+	/* Before rcu_init(), rcu_init() itself queues the work. */
+	if (needwork && rcu_gp_wq)
+		queue_work(rcu_gp_wq, &rcu_state.exp_poll_work);
+	return s;
+}
+EXPORT_SYMBOL_GPL(start_poll_synchronize_rcu_expedited);
+
+/**
+ * poll_state_synchronize_rcu_expedited - Has cookie's expedited GP ended?
+ * @oldstate: value from get_state_synchronize_rcu_expedited() or
+ *	      start_poll_synchronize_rcu_expedited()
+ *
+ * Returns true if a full expedited grace period has elapsed since the
+ * cookie was obtained, false otherwise.  A true return implies a full
+ * memory barrier between the end of that grace period and the caller's
+ * subsequent accesses.
+ */
+bool poll_state_synchronize_rcu_expedited(unsigned long oldstate)
+{
+	if (rcu_seq_done(&rcu_state.exp_poll_seq, oldstate)) {
+		smp_mb(); /* Ensure GP ends before subsequent accesses. */
+		return true;
+	}
+	return false;
+}
+EXPORT_SYMBOL_GPL(poll_state_synchronize_rcu_expedited);
+
+/**
+ * cond_synchronize_rcu_expedited - Conditionally wait for an expedited GP
+ * @oldstate: value from get_state_synchronize_rcu_expedited() or
+ *	      start_poll_synchronize_rcu_expedited()
+ *
+ * If a full expedited grace period has elapsed since the cookie was
+ * obtained, just return.  Otherwise, invoke synchronize_rcu_expedited()
+ * to wait for one.
+ */
+void cond_synchronize_rcu_expedited(unsigned long oldstate)
+{
+	if (!poll_state_synchronize_rcu_expedited(oldstate))
+		synchronize_rcu_expedited();
+}
+EXPORT_SYMBOL_GPL(cond_synchronize_rcu_expedited);
@@ -14,10 +14,13 @@
 #include <trace/events/power.h>
 
 #define IOWAIT_BOOST_MIN	(SCHED_CAPACITY_SCALE / 8)
+/* How long the uclamp.min of an IO waiter is held by default */
+#define UCLAMP_BOOST_HOLD_US	(4 * USEC_PER_MSEC)
 
 struct sugov_tunables {
 	struct gov_attr_set	attr_set;
 	unsigned int		rate_limit_us;
+	unsigned int		boost_hold_us;
 };
 
 struct sugov_policy {
@@ -29,6 +32,7 @@ struct sugov_policy {
 	raw_spinlock_t		update_lock;
 	u64			last_freq_update_time;
 	s64			freq_update_delay_ns;
+	u64			boost_hold_ns;
 	unsigned int		next_freq;
 	unsigned int		cached_raw_freq;
 
@@ -53,6 +57,10 @@ struct sugov_cpu {
 	unsigned int		iowait_boost;
 	u64			last_update;
 
+	/* uclamp.min of the last IO waiter, in capacity units */
+	unsigned long		uclamp_boost;
+	u64			uclamp_boost_expires;
+
 	unsigned long		util;
 	unsigned long		bw_dl;
 	unsigned long		max;
@@ -294,6 +302,74 @@ static void sugov_iowait_apply(struct sugov_cpu *sg_cpu, u64 time)
 		sg_cpu->util = boost;
 }
 
+/**
+ * sugov_uclamp_boost() - Boost a CPU to the uclamp.min of an IO waiter.
+ * @sg_cpu: the sugov data for the CPU to boost
+ * @time: the update time from the caller
+ * @flags: SCHED_CPUFREQ_IOWAIT if the task is waking up after an IO wait
+ *
+ * The uclamp.min of a task waking up after IO, as aggregated on its rq, is
+ * applied right away rather than once the rate limit allows, and it is held
+ * for boost_hold_us after the last such wakeup so that tasks doing bursts of
+ * IO don't see the frequency drop between them.
+ */
+static void sugov_uclamp_boost(struct sugov_cpu *sg_cpu, u64 time,
+			       unsigned int flags)
+{
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned long boost;
+
+	if (!(flags & SCHED_CPUFREQ_IOWAIT) || !uclamp_is_used())
+		return;
+
+	boost = uclamp_rq_util_with(cpu_rq(sg_cpu->cpu), 0, NULL);
+	if (!boost)
+		return;
+
+	sg_cpu->uclamp_boost_expires = time + sg_policy->boost_hold_ns;
+	if (boost <= sg_cpu->uclamp_boost)
+		return;
+
+	sg_cpu->uclamp_boost = boost;
+	/* Don't let the rate limit delay the boost */
+	sg_policy->limits_changed = true;
+
+	trace_sugov_util_boost(sg_policy->policy, sg_cpu->cpu, boost,
+			       sg_cpu->util);
+}
+
+/**
+ * sugov_uclamp_apply() - Apply the uclamp.min boost to a CPU.
+ * @sg_cpu: the sugov data for the cpu to boost
+ * @time: the update time from the caller
+ *
+ * Once the hold time has passed, the boost is halved at each update, which
+ * ramps the frequency down gradually, until it drops below IOWAIT_BOOST_MIN.
+ */
+static void sugov_uclamp_apply(struct sugov_cpu *sg_cpu, u64 time)
+{
+	unsigned long boost = sg_cpu->uclamp_boost;
+
+	if (!boost)
+		return;
+
+	if (time > sg_cpu->uclamp_boost_expires) {
+		boost >>= 1;
+		if (boost < IOWAIT_BOOST_MIN)
+			boost = 0;
+
+		sg_cpu->uclamp_boost = boost;
+		trace_sugov_util_boost(sg_cpu->sg_policy->policy, sg_cpu->cpu,
+				       boost, sg_cpu->util);
+		if (!boost)
+			return;
+	}
+
+	boost = uclamp_rq_util_with(cpu_rq(sg_cpu->cpu), boost, NULL);
+	if (sg_cpu->util < boost)
+		sg_cpu->util = boost;
+}
+
 #ifdef CONFIG_NO_HZ_COMMON
 static bool sugov_cpu_is_busy(struct sugov_cpu *sg_cpu)
 {
@@ -321,6 +397,7 @@ static inline bool sugov_update_single_common(struct sugov_cpu *sg_cpu,
 					      u64 time, unsigned int flags)
 {
 	sugov_iowait_boost(sg_cpu, time, flags);
+	sugov_uclamp_boost(sg_cpu, time, flags);
 	sg_cpu->last_update = time;
 
 	ignore_dl_rate_limit(sg_cpu);
@@ -330,6 +407,7 @@ static inline bool sugov_update_single_common(struct sugov_cpu *sg_cpu,
 
 	sugov_get_util(sg_cpu);
 	sugov_iowait_apply(sg_cpu, time);
+	sugov_uclamp_apply(sg_cpu, time);
 
 	return true;
 }
@@ -379,6 +457,7 @@ static void sugov_update_single_perf(struct update_util_data *hook, u64 time,
 {
 	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu, update_util);
 	unsigned long prev_util = sg_cpu->util;
+	unsigned long min_util;
 
 	/*
 	 * Fall back to the "frequency" path if frequency invariance is not
@@ -400,7 +479,13 @@ static void sugov_update_single_perf(struct update_util_data *hook, u64 time,
 	if (sugov_cpu_is_busy(sg_cpu) && sg_cpu->util < prev_util)
 		sg_cpu->util = prev_util;
 
-	cpufreq_driver_adjust_perf(sg_cpu->cpu, map_util_perf(sg_cpu->bw_dl),
+	/*
+	 * Pass the uclamp.min boost as the floor too, so that a driver with
+	 * autonomous control, such as HWP, doesn't go below it either.
+	 */
+	min_util = max(sg_cpu->bw_dl, sg_cpu->uclamp_boost);
+
+	cpufreq_driver_adjust_perf(sg_cpu->cpu, map_util_perf(min_util),
 				   map_util_perf(sg_cpu->util), sg_cpu->max);
 
 	sg_cpu->sg_policy->last_freq_update_time = time;
@@ -419,6 +504,7 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 
 		sugov_get_util(j_sg_cpu);
 		sugov_iowait_apply(j_sg_cpu, time);
+		sugov_uclamp_apply(j_sg_cpu, time);
 		j_util = j_sg_cpu->util;
 		j_max = j_sg_cpu->max;
 
@@ -441,6 +527,7 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 	raw_spin_lock(&sg_policy->update_lock);
 
 	sugov_iowait_boost(sg_cpu, time, flags);
+	sugov_uclamp_boost(sg_cpu, time, flags);
 	sg_cpu->last_update = time;
 
 	ignore_dl_rate_limit(sg_cpu);
@@ -532,8 +619,36 @@ rate_limit_us_store(struct gov_attr_set *attr_set, const char *buf, size_t count
 
 static struct governor_attr rate_limit_us = __ATTR_RW(rate_limit_us);
 
+static ssize_t boost_hold_us_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->boost_hold_us);
+}
+
+static ssize_t
+boost_hold_us_store(struct gov_attr_set *attr_set, const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	struct sugov_policy *sg_policy;
+	unsigned int boost_hold_us;
+
+	if (kstrtouint(buf, 10, &boost_hold_us))
+		return -EINVAL;
+
+	tunables->boost_hold_us = boost_hold_us;
+
+	list_for_each_entry(sg_policy, &attr_set->policy_list, tunables_hook)
+		sg_policy->boost_hold_ns = (u64)boost_hold_us * NSEC_PER_USEC;
+
+	return count;
+}
+
+static struct governor_attr boost_hold_us = __ATTR_RW(boost_hold_us);
+
 static struct attribute *sugov_attrs[] = {
 	&rate_limit_us.attr,
+	&boost_hold_us.attr,
 	NULL
 };
 ATTRIBUTE_GROUPS(sugov);
@@ -697,6 +812,7 @@ static int sugov_init(struct cpufreq_policy *policy)
 	}
 
 	tunables->rate_limit_us = cpufreq_policy_transition_delay_us(policy);
+	tunables->boost_hold_us = UCLAMP_BOOST_HOLD_US;
 
 	policy->governor_data = sg_policy;
 	sg_policy->tunables = tunables;
@@ -757,6 +873,7 @@ static int sugov_start(struct cpufreq_policy *policy)
 	unsigned int cpu;
 
 	sg_policy->freq_update_delay_ns	= sg_policy->tunables->rate_limit_us * NSEC_PER_USEC;
+	sg_policy->boost_hold_ns		= (u64)sg_policy->tunables->boost_hold_us * NSEC_PER_USEC;
 	sg_policy->last_freq_update_time	= 0;
 	sg_policy->next_freq			= 0;
 	sg_policy->work_in_progress		= false;
@@ -333,6 +333,7 @@ static __init int sched_init_debug(void)
 	debugfs_create_u32("scan_period_min_ms", 0644, numa, &sysctl_numa_balancing_scan_period_min);
 	debugfs_create_u32("scan_period_max_ms", 0644, numa, &sysctl_numa_balancing_scan_period_max);
 	debugfs_create_u32("scan_size_mb", 0644, numa, &sysctl_numa_balancing_scan_size);
+	debugfs_create_u32("hot_threshold_ms", 0644, numa, &sysctl_numa_balancing_hot_threshold);
 #endif
 
 	debugfs_create_file("debug", 0444, debugfs_sched, NULL, &sched_debug_fops);
@@ -380,6 +381,8 @@ static void register_sd(struct sched_domain *sd, struct dentry *parent)
 	SDM(ulong, 0644, min_interval);
 	SDM(ulong, 0644, max_interval);
 	SDM(u64,   0644, max_newidle_lb_cost);
+	SDM(u64,   0444, avg_newidle_lb_cost);
+	SDM(u32,   0444, newidle_success);
 	SDM(u32,   0644, busy_factor);
 	SDM(u32,   0644, imbalance_pct);
 	SDM(u32,   0644, cache_nice_tries);
@@ -985,6 +988,9 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 		P_SCHEDSTAT(se.statistics.nr_wakeups_affine_attempts);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_passive);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_idle);
+#ifdef CONFIG_SCHED_CORE
+		PN_SCHEDSTAT(se.statistics.core_forceidle_sum);
+#endif
 
 		avg_atom = p->se.sum_exec_runtime;
 		if (nr_switches)
@@ -0,0 +1,1370 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF extensible scheduler class
+ *
+ * A scheduling class placed between CFS and idle whose policy is implemented
+ * by a BPF program registered as struct sched_ext_ops. While one is loaded,
+ * SCHED_EXT tasks, and by default all other SCHED_NORMAL, SCHED_BATCH and
+ * SCHED_IDLE tasks, are scheduled by it; otherwise they run on CFS.
+ *
+ * The kernel side only provides dispatch queues (DSQs): FIFOs of runnable
+ * tasks that the BPF scheduler fills from ops.enqueue() and that CPUs take
+ * their next task from. Every CPU has a local DSQ it runs tasks from, there
+ * is a global DSQ all CPUs take tasks from when their local one is empty, and
+ * the BPF scheduler can create more that CPUs move tasks from on request in
+ * ops.dispatch().
+ *
+ * The BPF scheduler can't crash the kernel, but it can get things wrong, e.g.
+ * never run some task. Whenever it misbehaves, or a runnable task waits for
+ * longer than ops.timeout_ms, it is disabled and all its tasks go back to
+ * CFS.
+ */
+#include "sched.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <linux/filter.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/percpu-rwsem.h>
+#include <linux/rhashtable.h>
+
+#define SCX_WATCHDOG_MAX_TIMEOUT	(30 * HZ)
+
+enum scx_ops_enable_state {
+	SCX_OPS_DISABLED,
+	SCX_OPS_ENABLING,
+	SCX_OPS_ENABLED,
+	/* the BPF scheduler is bypassed until its tasks are back on CFS */
+	SCX_OPS_DISABLING,
+};
+
+static atomic_t scx_ops_enable_state_var = ATOMIC_INIT(SCX_OPS_DISABLED);
+static DEFINE_MUTEX(scx_ops_enable_mutex);
+DEFINE_STATIC_KEY_FALSE(__scx_ops_enabled);
+
+static struct sched_ext_ops scx_ops;
+/* the struct_ops map @scx_ops was copied from */
+static void *scx_ops_kdata;
+static bool scx_switch_all;
+
+/* SCX_EXIT_NONE while the BPF scheduler can be disabled for a reason */
+static atomic_t scx_exit_kind = ATOMIC_INIT(SCX_EXIT_DONE);
+static struct scx_exit_info scx_exit_info;
+
+static struct kthread_worker *scx_ops_helper;
+static struct kthread_work scx_ops_disable_work;
+static struct irq_work scx_ops_error_irq_work;
+
+static unsigned long scx_watchdog_timeout;
+static unsigned long scx_watchdog_timestamp = INITIAL_JIFFIES;
+static struct delayed_work scx_watchdog_work;
+
+static struct scx_dispatch_q scx_dsq_global;
+/* the DSQs created by the BPF scheduler */
+static struct rhashtable scx_dsq_hash;
+
+static const struct rhashtable_params dsq_hash_params = {
+	.key_len	= sizeof_field(struct scx_dispatch_q, id),
+	.key_offset	= offsetof(struct scx_dispatch_q, id),
+	.head_offset	= offsetof(struct scx_dispatch_q, hash_node),
+};
+
+/*
+ * All tasks past sched_post_fork(), so that they can be moved to or from the
+ * ext class when a BPF scheduler is loaded or unloaded. Loading or unloading
+ * holds scx_fork_rwsem for write to keep new tasks out in the meantime.
+ */
+DEFINE_STATIC_PERCPU_RWSEM(scx_fork_rwsem);
+static DEFINE_RAW_SPINLOCK(scx_tasks_lock);
+static LIST_HEAD(scx_tasks);
+
+/* What the BPF scheduler may do from the operation running on this CPU */
+struct scx_dsp_ctx {
+	/* ops.enqueue() of this task is running */
+	struct task_struct	*enq_task;
+	bool			enq_dispatched;
+	/* ops.dispatch() is running for this rq */
+	struct rq		*rq;
+	struct rq_flags		*rf;
+};
+
+static DEFINE_PER_CPU(struct scx_dsp_ctx, scx_dsp_ctx);
+
+/* CPUs to reschedule on behalf of scx_bpf_kick_cpu() */
+static DEFINE_PER_CPU(cpumask_var_t, scx_kick_cpus);
+static DEFINE_PER_CPU(struct irq_work, scx_kick_irq_work);
+
+#define SCX_HAS_OP(op)	(scx_ops.op != NULL)
+#define SCX_CALL_OP(op, args...)	scx_ops.op(args)
+
+static enum scx_ops_enable_state scx_ops_enable_state(void)
+{
+	return atomic_read(&scx_ops_enable_state_var);
+}
+
+static bool scx_ops_tryset_enable_state(enum scx_ops_enable_state to,
+					enum scx_ops_enable_state from)
+{
+	int from_v = from;
+
+	return atomic_try_cmpxchg(&scx_ops_enable_state_var, &from_v, to);
+}
+
+static bool scx_ops_bypassing(void)
+{
+	return unlikely(scx_ops_enable_state() == SCX_OPS_DISABLING);
+}
+
+static __printf(2, 3) void scx_ops_error_kind(enum scx_exit_kind kind,
+					      const char *fmt, ...)
+{
+	int none = SCX_EXIT_NONE;
+	va_list args;
+
+	if (!atomic_try_cmpxchg(&scx_exit_kind, &none, kind))
+		return;
+
+	va_start(args, fmt);
+	vscnprintf(scx_exit_info.msg, SCX_EXIT_MSG_LEN, fmt, args);
+	va_end(args);
+
+	/*
+	 * Stop trusting the BPF scheduler right away. The rq locks may be
+	 * held, so leave disabling it to the helper.
+	 */
+	scx_ops_tryset_enable_state(SCX_OPS_DISABLING, SCX_OPS_ENABLED);
+	irq_work_queue(&scx_ops_error_irq_work);
+}
+
+#define scx_ops_error(fmt, args...)					\
+	scx_ops_error_kind(SCX_EXIT_ERROR, fmt, ##args)
+
+static const char *scx_exit_reason(enum scx_exit_kind kind)
+{
+	switch (kind) {
+	case SCX_EXIT_UNREG:
+		return "unregistered from BPF";
+	case SCX_EXIT_ERROR:
+		return "runtime error";
+	case SCX_EXIT_ERROR_STALL:
+		return "runnable task stall";
+	default:
+		return "<UNKNOWN>";
+	}
+}
+
+static bool ops_cpu_valid(s32 cpu)
+{
+	return cpu >= 0 && cpu < nr_cpu_ids && cpu_possible(cpu);
+}
+
+/*
+ * Dispatch queues
+ */
+
+static void init_dsq(struct scx_dispatch_q *dsq, u64 dsq_id)
+{
+	memset(dsq, 0, sizeof(*dsq));
+	raw_spin_lock_init(&dsq->lock);
+	INIT_LIST_HEAD(&dsq->list);
+	dsq->id = dsq_id;
+}
+
+static struct scx_dispatch_q *find_user_dsq(u64 dsq_id)
+{
+	return rhashtable_lookup_fast(&scx_dsq_hash, &dsq_id, dsq_hash_params);
+}
+
+static struct scx_dispatch_q *find_non_local_dsq(u64 dsq_id)
+{
+	if (dsq_id == SCX_DSQ_GLOBAL)
+		return &scx_dsq_global;
+	if (dsq_id & SCX_DSQ_FLAG_BUILTIN)
+		return NULL;
+	return find_user_dsq(dsq_id);
+}
+
+static void dispatch_enqueue(struct scx_dispatch_q *dsq, struct task_struct *p,
+			     u64 enq_flags)
+{
+	raw_spin_lock(&dsq->lock);
+	if (unlikely(dsq->id == SCX_DSQ_INVALID)) {
+		raw_spin_unlock(&dsq->lock);
+		scx_ops_error("%s[%d] dispatched to a destroyed DSQ",
+			      p->comm, p->pid);
+		dsq = &scx_dsq_global;
+		raw_spin_lock(&dsq->lock);
+	}
+
+	if (enq_flags & SCX_ENQ_HEAD)
+		list_add(&p->scx.dsq_node, &dsq->list);
+	else
+		list_add_tail(&p->scx.dsq_node, &dsq->list);
+	dsq->nr++;
+	WRITE_ONCE(p->scx.dsq, dsq);
+	raw_spin_unlock(&dsq->lock);
+}
+
+static void task_unlink_from_dsq(struct task_struct *p,
+				 struct scx_dispatch_q *dsq)
+{
+	lockdep_assert_held(&dsq->lock);
+
+	list_del_init(&p->scx.dsq_node);
+	dsq->nr--;
+	/* pairs with the acquire in dispatch_dequeue() */
+	smp_store_release(&p->scx.dsq, NULL);
+}
+
+static void dispatch_dequeue(struct task_struct *p)
+{
+	struct scx_dispatch_q *dsq = smp_load_acquire(&p->scx.dsq);
+
+	if (dsq) {
+		raw_spin_lock(&dsq->lock);
+		if (p->scx.dsq == dsq)
+			task_unlink_from_dsq(p, dsq);
+		raw_spin_unlock(&dsq->lock);
+	}
+
+	/* Tell a CPU taking @p off a shared DSQ that it is gone */
+	WRITE_ONCE(p->scx.holding_cpu, -1);
+}
+
+static struct task_struct *first_local_task(struct rq *rq)
+{
+	return list_first_entry_or_null(&rq->scx.local_dsq.list,
+					struct task_struct, scx.dsq_node);
+}
+
+static int destroy_dsq(u64 dsq_id)
+{
+	struct scx_dispatch_q *dsq;
+	unsigned long flags;
+	int ret = -ENOENT;
+
+	rcu_read_lock();
+	dsq = find_user_dsq(dsq_id);
+	if (!dsq)
+		goto out;
+
+	raw_spin_lock_irqsave(&dsq->lock, flags);
+	if (dsq->id == SCX_DSQ_INVALID)
+		goto out_unlock;
+	ret = -EBUSY;
+	if (dsq->nr)
+		goto out_unlock;
+
+	/* Keep dispatch_enqueue() off it until it is freed */
+	dsq->id = SCX_DSQ_INVALID;
+	rhashtable_remove_fast(&scx_dsq_hash, &dsq->hash_node,
+			       dsq_hash_params);
+	kfree_rcu(dsq, rcu);
+	ret = 0;
+out_unlock:
+	raw_spin_unlock_irqrestore(&dsq->lock, flags);
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+/*
+ * Moving tasks between DSQs and rqs
+ */
+
+/*
+ * Move @p, which this CPU took off a shared DSQ, from @src_rq to @rq. The rq
+ * locks have to be dropped in between, so @p may have been dequeued in the
+ * meantime, in which case it is left alone.
+ */
+static bool consume_remote_task(struct rq *rq, struct rq_flags *rf,
+				struct task_struct *p, struct rq *src_rq)
+{
+	bool moved = false;
+
+	rq_unpin_lock(rq, rf);
+	raw_spin_rq_unlock(rq);
+
+	raw_spin_rq_lock(src_rq);
+	if (READ_ONCE(p->scx.holding_cpu) == cpu_of(rq)) {
+		update_rq_clock(src_rq);
+		p->scx.holding_cpu = -1;
+		p->scx.flags |= SCX_TASK_ENQ_LOCAL;
+		deactivate_task(src_rq, p, DEQUEUE_NOCLOCK);
+		set_task_cpu(p, cpu_of(rq));
+		moved = true;
+	}
+	raw_spin_rq_unlock(src_rq);
+
+	raw_spin_rq_lock(rq);
+	rq_repin_lock(rq, rf);
+
+	if (moved)
+		activate_task(rq, p, ENQUEUE_NOCLOCK);
+
+	return moved;
+}
+
+static bool task_can_run_on(struct task_struct *p, int cpu)
+{
+	return cpumask_test_cpu(cpu, p->cpus_ptr) &&
+		!is_migration_disabled(p) && cpu_active(cpu);
+}
+
+/* Move the first task of @dsq that can run on @rq to its local DSQ */
+static bool consume_dispatch_q(struct rq *rq, struct rq_flags *rf,
+			       struct scx_dispatch_q *dsq)
+{
+	struct task_struct *p;
+	struct rq *task_rq;
+
+	if (list_empty(&dsq->list))
+		return false;
+retry:
+	raw_spin_lock(&dsq->lock);
+	list_for_each_entry(p, &dsq->list, scx.dsq_node) {
+		/* @p can't change rqs without being dequeued from @dsq first */
+		task_rq = task_rq(p);
+
+		if (task_rq == rq) {
+			task_unlink_from_dsq(p, dsq);
+			raw_spin_unlock(&dsq->lock);
+			dispatch_enqueue(&rq->scx.local_dsq, p, 0);
+			return true;
+		}
+
+		if (!task_can_run_on(p, cpu_of(rq)))
+			continue;
+
+		WRITE_ONCE(p->scx.holding_cpu, cpu_of(rq));
+		task_unlink_from_dsq(p, dsq);
+		raw_spin_unlock(&dsq->lock);
+
+		if (consume_remote_task(rq, rf, p, task_rq))
+			return true;
+		goto retry;
+	}
+	raw_spin_unlock(&dsq->lock);
+
+	return false;
+}
+
+static void do_enqueue_task(struct rq *rq, struct task_struct *p, u64 enq_flags)
+{
+	struct scx_dsp_ctx *dctx = this_cpu_ptr(&scx_dsp_ctx);
+
+	if (p->scx.flags & SCX_TASK_ENQ_LOCAL) {
+		p->scx.flags &= ~SCX_TASK_ENQ_LOCAL;
+		dispatch_enqueue(&rq->scx.local_dsq, p, enq_flags);
+		return;
+	}
+
+	if (scx_ops_bypassing() || !SCX_HAS_OP(enqueue))
+		goto global;
+
+	dctx->enq_task = p;
+	dctx->enq_dispatched = false;
+	SCX_CALL_OP(enqueue, p, enq_flags);
+	dctx->enq_task = NULL;
+	if (dctx->enq_dispatched)
+		return;
+
+	scx_ops_error("ops.enqueue() didn't dispatch %s[%d]", p->comm, p->pid);
+global:
+	if (!p->scx.slice)
+		p->scx.slice = SCX_SLICE_DFL;
+	dispatch_enqueue(&scx_dsq_global, p, enq_flags);
+}
+
+/*
+ * The scheduling class
+ */
+
+static void update_curr_scx(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	u64 now = rq_clock_task(rq);
+	u64 delta_exec;
+
+	if (curr->sched_class != &ext_sched_class)
+		return;
+
+	delta_exec = now - curr->se.exec_start;
+	if (unlikely((s64)delta_exec <= 0))
+		return;
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+	cgroup_account_cputime(curr, delta_exec);
+	curr->se.exec_start = now;
+
+	curr->scx.slice -= min(curr->scx.slice, delta_exec);
+}
+
+static void enqueue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	u64 enq_flags = 0;
+
+	p->scx.flags |= SCX_TASK_QUEUED;
+	add_nr_running(rq, 1);
+
+	/* Requeued while running, put_prev_task_scx() will dispatch it */
+	if (task_current(rq, p))
+		return;
+
+	if (flags & ENQUEUE_WAKEUP)
+		enq_flags |= SCX_ENQ_WAKEUP;
+	if (flags & ENQUEUE_HEAD)
+		enq_flags |= SCX_ENQ_HEAD;
+
+	list_add_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+	p->scx.runnable_at = jiffies;
+	do_enqueue_task(rq, p, enq_flags);
+}
+
+static void dequeue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	if (!(p->scx.flags & SCX_TASK_QUEUED))
+		return;
+
+	if (task_current(rq, p)) {
+		update_curr_scx(rq);
+	} else {
+		dispatch_dequeue(p);
+		list_del_init(&p->scx.runnable_node);
+		/* Not for a CPU moving @p to its own local DSQ */
+		if (!(p->scx.flags & SCX_TASK_ENQ_LOCAL) &&
+		    !scx_ops_bypassing() && SCX_HAS_OP(dequeue))
+			SCX_CALL_OP(dequeue, p,
+				    flags & DEQUEUE_SLEEP ? SCX_DEQ_SLEEP : 0);
+	}
+
+	p->scx.flags &= ~SCX_TASK_QUEUED;
+	sub_nr_running(rq, 1);
+}
+
+static void yield_task_scx(struct rq *rq)
+{
+	rq->curr->scx.slice = 0;
+}
+
+static void check_preempt_curr_scx(struct rq *rq, struct task_struct *p,
+				   int wake_flags)
+{
+}
+
+static void set_next_task_scx(struct rq *rq, struct task_struct *p, bool first)
+{
+	p->se.exec_start = rq_clock_task(rq);
+
+	if (p->scx.flags & SCX_TASK_QUEUED) {
+		dispatch_dequeue(p);
+		list_del_init(&p->scx.runnable_node);
+	}
+
+	if (!scx_ops_bypassing() && SCX_HAS_OP(running))
+		SCX_CALL_OP(running, p);
+}
+
+static struct task_struct *pick_next_task_scx(struct rq *rq)
+{
+	struct task_struct *p = first_local_task(rq);
+
+	if (!p)
+		return NULL;
+
+	set_next_task_scx(rq, p, true);
+	if (!p->scx.slice)
+		p->scx.slice = SCX_SLICE_DFL;
+
+	return p;
+}
+
+static void put_prev_task_scx(struct rq *rq, struct task_struct *p)
+{
+	bool runnable = p->scx.flags & SCX_TASK_QUEUED;
+
+	update_curr_scx(rq);
+
+	if (!scx_ops_bypassing() && SCX_HAS_OP(stopping))
+		SCX_CALL_OP(stopping, p, runnable);
+
+	if (!runnable)
+		return;
+
+	list_add_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+	p->scx.runnable_at = jiffies;
+
+	/*
+	 * With slice left, @p was preempted by a higher class or is being
+	 * kept running by balance_scx(): it stays first in line.
+	 */
+	if (p->scx.slice)
+		dispatch_enqueue(&rq->scx.local_dsq, p, SCX_ENQ_HEAD);
+	else
+		do_enqueue_task(rq, p, 0);
+}
+
+static int balance_scx(struct rq *rq, struct task_struct *prev,
+		       struct rq_flags *rf)
+{
+	struct scx_dsp_ctx *dctx = this_cpu_ptr(&scx_dsp_ctx);
+	bool prev_on_scx = prev->sched_class == &ext_sched_class;
+
+	if (!scx_enabled())
+		return 0;
+
+	if (prev_on_scx) {
+		update_curr_scx(rq);
+		if ((prev->scx.flags & SCX_TASK_QUEUED) && prev->scx.slice)
+			return 1;
+	}
+
+	if (!list_empty(&rq->scx.local_dsq.list))
+		return 1;
+
+	if (consume_dispatch_q(rq, rf, &scx_dsq_global))
+		return 1;
+
+	if (!scx_ops_bypassing() && SCX_HAS_OP(dispatch)) {
+		dctx->rq = rq;
+		dctx->rf = rf;
+		SCX_CALL_OP(dispatch, cpu_of(rq), prev_on_scx ? prev : NULL);
+		dctx->rq = NULL;
+
+		if (!list_empty(&rq->scx.local_dsq.list))
+			return 1;
+	}
+
+	/* Nothing else to run, let @prev go on */
+	if (prev_on_scx && (prev->scx.flags & SCX_TASK_QUEUED)) {
+		prev->scx.slice = SCX_SLICE_DFL;
+		return 1;
+	}
+
+	return 0;
+}
+
+static s32 scx_select_cpu_dfl(struct task_struct *p, s32 prev_cpu,
+			      u64 wake_flags)
+{
+	s32 cpu;
+
+	if (available_idle_cpu(prev_cpu))
+		return prev_cpu;
+
+	for_each_cpu_wrap(cpu, p->cpus_ptr, prev_cpu) {
+		if (cpu_active(cpu) && available_idle_cpu(cpu))
+			return cpu;
+	}
+
+	return prev_cpu;
+}
+
+static int select_task_rq_scx(struct task_struct *p, int prev_cpu,
+			      int wake_flags)
+{
+	s32 cpu;
+
+	if (scx_ops_bypassing() || !SCX_HAS_OP(select_cpu))
+		return scx_select_cpu_dfl(p, prev_cpu, wake_flags);
+
+	cpu = SCX_CALL_OP(select_cpu, p, prev_cpu, wake_flags);
+	if (likely(ops_cpu_valid(cpu)))
+		return cpu;
+
+	scx_ops_error("ops.select_cpu() returned invalid CPU %d", cpu);
+	return prev_cpu;
+}
+
+static struct task_struct *pick_task_scx(struct rq *rq)
+{
+	return first_local_task(rq);
+}
+
+static void task_tick_scx(struct rq *rq, struct task_struct *curr, int queued)
+{
+	update_curr_scx(rq);
+
+	if (!curr->scx.slice)
+		resched_curr(rq);
+}
+
+static void switched_to_scx(struct rq *rq, struct task_struct *p)
+{
+}
+
+static void prio_changed_scx(struct rq *rq, struct task_struct *p, int oldprio)
+{
+}
+
+DEFINE_SCHED_CLASS(ext) = {
+	.enqueue_task		= enqueue_task_scx,
+	.dequeue_task		= dequeue_task_scx,
+	.yield_task		= yield_task_scx,
+
+	.check_preempt_curr	= check_preempt_curr_scx,
+
+	.pick_next_task		= pick_next_task_scx,
+	.put_prev_task		= put_prev_task_scx,
+	.set_next_task		= set_next_task_scx,
+
+	.balance		= balance_scx,
+	.select_task_rq		= select_task_rq_scx,
+	.pick_task		= pick_task_scx,
+	.set_cpus_allowed	= set_cpus_allowed_common,
+
+	.task_tick		= task_tick_scx,
+
+	.switched_to		= switched_to_scx,
+	.prio_changed		= prio_changed_scx,
+
+	.update_curr		= update_curr_scx,
+};
+
+/*
+ * Watchdog
+ */
+
+static bool check_rq_for_timeouts(struct rq *rq)
+{
+	struct task_struct *p;
+	struct rq_flags rf;
+	bool timed_out = false;
+
+	rq_lock_irqsave(rq, &rf);
+	p = list_first_entry_or_null(&rq->scx.runnable_list,
+				     struct task_struct, scx.runnable_node);
+	if (p && time_after(jiffies, p->scx.runnable_at + scx_watchdog_timeout)) {
+		u32 dur_ms = jiffies_to_msecs(jiffies - p->scx.runnable_at);
+
+		scx_ops_error_kind(SCX_EXIT_ERROR_STALL,
+				   "%s[%d] failed to run for %u.%03us",
+				   p->comm, p->pid,
+				   dur_ms / 1000, dur_ms % 1000);
+		timed_out = true;
+	}
+	rq_unlock_irqrestore(rq, &rf);
+
+	return timed_out;
+}
+
+static void scx_watchdog_workfn(struct work_struct *work)
+{
+	int cpu;
+
+	WRITE_ONCE(scx_watchdog_timestamp, jiffies);
+
+	for_each_online_cpu(cpu) {
+		if (unlikely(check_rq_for_timeouts(cpu_rq(cpu))))
+			break;
+		cond_resched();
+	}
+
+	queue_delayed_work(system_unbound_wq, to_delayed_work(work),
+			   scx_watchdog_timeout / 2);
+}
+
+/*
+ * The watchdog is a regular work item, which a broken BPF scheduler may never
+ * run: make sure from the tick that it does.
+ */
+void scx_tick(struct rq *rq)
+{
+	unsigned long last_check;
+
+	if (!scx_enabled() || scx_ops_enable_state() != SCX_OPS_ENABLED)
+		return;
+
+	last_check = READ_ONCE(scx_watchdog_timestamp);
+	if (unlikely(time_after(jiffies, last_check + scx_watchdog_timeout))) {
+		u32 dur_ms = jiffies_to_msecs(jiffies - last_check);
+
+		scx_ops_error_kind(SCX_EXIT_ERROR_STALL,
+				   "watchdog failed to check in for %u.%03us",
+				   dur_ms / 1000, dur_ms % 1000);
+	}
+}
+
+/*
+ * Loading and unloading
+ */
+
+/*
+ * Walks scx_tasks with a cursor so that scx_tasks_lock can be dropped for
+ * each task returned, which is referenced until the next call.
+ */
+struct scx_task_iter {
+	struct list_head	cursor;
+	struct task_struct	*curr;
+};
+
+static void scx_task_iter_init(struct scx_task_iter *iter)
+{
+	raw_spin_lock_irq(&scx_tasks_lock);
+	list_add(&iter->cursor, &scx_tasks);
+	iter->curr = NULL;
+}
+
+static struct task_struct *scx_task_iter_next(struct scx_task_iter *iter)
+{
+	struct task_struct *p;
+
+	if (iter->curr) {
+		put_task_struct(iter->curr);
+		cond_resched();
+		raw_spin_lock_irq(&scx_tasks_lock);
+		iter->curr = NULL;
+	}
+
+	while (!list_is_last(&iter->cursor, &scx_tasks)) {
+		p = container_of(iter->cursor.next, struct task_struct,
+				 scx.tasks_node);
+		list_move(&iter->cursor, &p->scx.tasks_node);
+
+		/* The idle tasks never leave the idle class */
+		if (is_idle_task(p) || !refcount_inc_not_zero(&p->usage))
+			continue;
+
+		iter->curr = p;
+		raw_spin_unlock_irq(&scx_tasks_lock);
+		return p;
+	}
+
+	return NULL;
+}
+
+static void scx_task_iter_exit(struct scx_task_iter *iter)
+{
+	list_del(&iter->cursor);
+	raw_spin_unlock_irq(&scx_tasks_lock);
+}
+
+/*
+ * SCX_TASK_INITED is only changed while @p isn't in the ext class, so it
+ * doesn't race with the rq-locked updates of the other flags.
+ */
+static void scx_ops_init_task(struct task_struct *p)
+{
+	if (SCX_HAS_OP(init_task) && SCX_CALL_OP(init_task, p))
+		return;
+	p->scx.flags |= SCX_TASK_INITED;
+}
+
+static void scx_ops_exit_task(struct task_struct *p)
+{
+	if (!(p->scx.flags & SCX_TASK_INITED))
+		return;
+	p->scx.flags &= ~SCX_TASK_INITED;
+	if (SCX_HAS_OP(exit_task))
+		SCX_CALL_OP(exit_task, p);
+}
+
+bool task_should_scx(struct task_struct *p)
+{
+	if (!scx_enabled() || !(p->scx.flags & SCX_TASK_INITED))
+		return false;
+
+	switch (scx_ops_enable_state()) {
+	case SCX_OPS_ENABLING:
+	case SCX_OPS_ENABLED:
+		break;
+	default:
+		return false;
+	}
+
+	return p->policy == SCHED_EXT || READ_ONCE(scx_switch_all);
+}
+
+void scx_post_fork(struct task_struct *p)
+{
+	percpu_down_read(&scx_fork_rwsem);
+
+	if (scx_enabled() && scx_ops_enable_state() == SCX_OPS_ENABLED) {
+		scx_ops_init_task(p);
+		/* @p is still TASK_NEW, nobody can have queued it */
+		if (p->sched_class == &fair_sched_class && task_should_scx(p))
+			p->sched_class = &ext_sched_class;
+	}
+
+	raw_spin_lock_irq(&scx_tasks_lock);
+	list_add_tail(&p->scx.tasks_node, &scx_tasks);
+	raw_spin_unlock_irq(&scx_tasks_lock);
+
+	percpu_up_read(&scx_fork_rwsem);
+}
+
+void sched_ext_free(struct task_struct *p)
+{
+	unsigned long flags;
+
+	/* Under the lock so that unloading can tell when we're done */
+	raw_spin_lock_irqsave(&scx_tasks_lock, flags);
+	list_del_init(&p->scx.tasks_node);
+	scx_ops_exit_task(p);
+	raw_spin_unlock_irqrestore(&scx_tasks_lock, flags);
+}
+
+static void scx_ops_disable_locked(void)
+{
+	struct scx_exit_info *ei = &scx_exit_info;
+	struct rhashtable_iter rht_iter;
+	struct scx_dispatch_q *dsq;
+	struct scx_task_iter sti;
+	struct task_struct *p;
+
+	lockdep_assert_held(&scx_ops_enable_mutex);
+
+	if (scx_ops_enable_state() == SCX_OPS_DISABLED)
+		return;
+	atomic_set(&scx_ops_enable_state_var, SCX_OPS_DISABLING);
+
+	ei->kind = atomic_read(&scx_exit_kind);
+	ei->reason = scx_exit_reason(ei->kind);
+
+	cancel_delayed_work_sync(&scx_watchdog_work);
+
+	/*
+	 * The ext class is bypassing the BPF scheduler: once the operations
+	 * running are done, only we call it.
+	 */
+	synchronize_rcu();
+
+	percpu_down_write(&scx_fork_rwsem);
+	scx_task_iter_init(&sti);
+	while ((p = scx_task_iter_next(&sti))) {
+		sched_update_task_class(p);
+		scx_ops_exit_task(p);
+	}
+	scx_task_iter_exit(&sti);
+	percpu_up_write(&scx_fork_rwsem);
+
+	static_branch_disable(&__scx_ops_enabled);
+
+	if (ei->kind >= SCX_EXIT_ERROR)
+		pr_err("sched_ext: BPF scheduler \"%s\" disabled (%s): %s\n",
+		       scx_ops.name, ei->reason, ei->msg);
+	else
+		pr_info("sched_ext: BPF scheduler \"%s\" disabled (%s)\n",
+			scx_ops.name, ei->reason);
+
+	if (SCX_HAS_OP(exit))
+		SCX_CALL_OP(exit, ei);
+
+	/* All the tasks are gone from the DSQs */
+	rhashtable_walk_enter(&scx_dsq_hash, &rht_iter);
+	do {
+		rhashtable_walk_start(&rht_iter);
+		while ((dsq = rhashtable_walk_next(&rht_iter)) && !IS_ERR(dsq))
+			destroy_dsq(dsq->id);
+		rhashtable_walk_stop(&rht_iter);
+	} while (dsq == ERR_PTR(-EAGAIN));
+	rhashtable_walk_exit(&rht_iter);
+
+	memset(&scx_ops, 0, sizeof(scx_ops));
+	scx_ops_kdata = NULL;
+	atomic_set(&scx_ops_enable_state_var, SCX_OPS_DISABLED);
+}
+
+static void scx_ops_disable_workfn(struct kthread_work *work)
+{
+	mutex_lock(&scx_ops_enable_mutex);
+	/* Not if the error was for a BPF scheduler that is gone already */
+	if (atomic_read(&scx_exit_kind) != SCX_EXIT_NONE)
+		scx_ops_disable_locked();
+	mutex_unlock(&scx_ops_enable_mutex);
+}
+
+static void scx_ops_error_irq_workfn(struct irq_work *irq_work)
+{
+	kthread_queue_work(scx_ops_helper, &scx_ops_disable_work);
+}
+
+static int scx_ops_enable(struct sched_ext_ops *ops)
+{
+	struct scx_task_iter sti;
+	struct task_struct *p;
+	int ret = 0;
+
+	mutex_lock(&scx_ops_enable_mutex);
+
+	if (!scx_ops_helper) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+	if (scx_ops_enable_state() != SCX_OPS_DISABLED) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	scx_ops = *ops;
+	scx_ops_kdata = ops;
+	WRITE_ONCE(scx_switch_all, !(ops->flags & SCX_OPS_SWITCH_PARTIAL));
+	scx_watchdog_timeout = SCX_WATCHDOG_MAX_TIMEOUT;
+	if (ops->timeout_ms)
+		scx_watchdog_timeout = max(msecs_to_jiffies(ops->timeout_ms),
+					   2UL);
+
+	memset(&scx_exit_info, 0, sizeof(scx_exit_info));
+	atomic_set(&scx_exit_kind, SCX_EXIT_NONE);
+	atomic_set(&scx_ops_enable_state_var, SCX_OPS_ENABLING);
+
+	if (SCX_HAS_OP(init)) {
+		ret = SCX_CALL_OP(init);
+		if (ret) {
+			scx_ops_error("ops.init() failed (%d)", ret);
+			goto out_disable;
+		}
+	}
+
+	WRITE_ONCE(scx_watchdog_timestamp, jiffies);
+	queue_delayed_work(system_unbound_wq, &scx_watchdog_work,
+			   scx_watchdog_timeout / 2);
+
+	static_branch_enable(&__scx_ops_enabled);
+
+	/*
+	 * Initialize every task for the BPF scheduler before any of them can
+	 * be scheduled by it, then move those it should schedule.
+	 */
+	percpu_down_write(&scx_fork_rwsem);
+
+	scx_task_iter_init(&sti);
+	while ((p = scx_task_iter_next(&sti)))
+		scx_ops_init_task(p);
+	scx_task_iter_exit(&sti);
+
+	scx_task_iter_init(&sti);
+	while ((p = scx_task_iter_next(&sti)))
+		sched_update_task_class(p);
+	scx_task_iter_exit(&sti);
+
+	scx_ops_tryset_enable_state(SCX_OPS_ENABLED, SCX_OPS_ENABLING);
+	percpu_up_write(&scx_fork_rwsem);
+
+	/* Errors while loading couldn't disable the BPF scheduler yet */
+	if (atomic_read(&scx_exit_kind) != SCX_EXIT_NONE) {
+		ret = -EINVAL;
+		goto out_disable;
+	}
+
+	pr_info("sched_ext: BPF scheduler \"%s\" enabled\n", scx_ops.name);
+	goto out_unlock;
+
+out_disable:
+	scx_ops_disable_locked();
+out_unlock:
+	mutex_unlock(&scx_ops_enable_mutex);
+	return ret;
+}
+
+/*
+ * Functions the BPF scheduler can call
+ */
+
+__diag_push();
+__diag_ignore(GCC, 8, "-Wmissing-prototypes",
+	      "Global functions as their definitions will be in vmlinux BTF");
+
+/**
+ * scx_bpf_create_dsq - create a dispatch queue
+ * @dsq_id: ID of the new DSQ, without SCX_DSQ_FLAG_BUILTIN
+ * @node: NUMA node to allocate it on, or NUMA_NO_NODE
+ *
+ * Return: 0 on success, -EEXIST if @dsq_id is taken, or another -errno.
+ */
+s32 noinline scx_bpf_create_dsq(u64 dsq_id, s32 node)
+{
+	struct scx_dispatch_q *dsq;
+	int ret;
+
+	if (dsq_id & SCX_DSQ_FLAG_BUILTIN)
+		return -EINVAL;
+	if (node != NUMA_NO_NODE && (node < 0 || node >= nr_node_ids))
+		return -EINVAL;
+
+	dsq = kmalloc_node(sizeof(*dsq), GFP_NOWAIT | __GFP_NOWARN, node);
+	if (!dsq)
+		return -ENOMEM;
+	init_dsq(dsq, dsq_id);
+
+	ret = rhashtable_lookup_insert_fast(&scx_dsq_hash, &dsq->hash_node,
+					    dsq_hash_params);
+	if (ret)
+		kfree(dsq);
+	return ret;
+}
+
+/**
+ * scx_bpf_destroy_dsq - destroy an empty dispatch queue
+ * @dsq_id: ID of a DSQ created by scx_bpf_create_dsq()
+ */
+void noinline scx_bpf_destroy_dsq(u64 dsq_id)
+{
+	int ret = destroy_dsq(dsq_id);
+
+	if (ret == -EBUSY)
+		scx_ops_error("can't destroy DSQ 0x%llx with tasks", dsq_id);
+	else if (ret)
+		scx_ops_error("DSQ 0x%llx doesn't exist", dsq_id);
+}
+
+/**
+ * scx_bpf_dispatch - dispatch a task to a dispatch queue
+ * @p: the task ops.enqueue() was called for
+ * @dsq_id: SCX_DSQ_LOCAL, SCX_DSQ_GLOBAL or a DSQ created by the BPF scheduler
+ * @slice: how long @p may run once picked, SCX_SLICE_DFL if 0
+ * @enq_flags: SCX_ENQ_*
+ *
+ * Only valid in ops.enqueue(), which must call it exactly once.
+ */
+void noinline scx_bpf_dispatch(struct task_struct *p, u64 dsq_id, u64 slice,
+			       u64 enq_flags)
+{
+	struct scx_dsp_ctx *dctx = this_cpu_ptr(&scx_dsp_ctx);
+	struct scx_dispatch_q *dsq;
+	struct rq *rq;
+
+	if (unlikely(!p || p != dctx->enq_task)) {
+		scx_ops_error("scx_bpf_dispatch() called outside ops.enqueue() of the task");
+		return;
+	}
+	if (unlikely(dctx->enq_dispatched)) {
+		scx_ops_error("%s[%d] dispatched twice", p->comm, p->pid);
+		return;
+	}
+	dctx->enq_dispatched = true;
+
+	p->scx.slice = slice ?: SCX_SLICE_DFL;
+
+	if (dsq_id == SCX_DSQ_LOCAL) {
+		rq = task_rq(p);
+		dispatch_enqueue(&rq->scx.local_dsq, p, enq_flags);
+		if ((enq_flags & SCX_ENQ_PREEMPT) &&
+		    rq->curr->sched_class == &ext_sched_class) {
+			rq->curr->scx.slice = 0;
+			resched_curr(rq);
+		}
+		return;
+	}
+
+	dsq = find_non_local_dsq(dsq_id);
+	if (unlikely(!dsq)) {
+		scx_ops_error("%s[%d] dispatched to non-existent DSQ 0x%llx",
+			      p->comm, p->pid, dsq_id);
+		dsq = &scx_dsq_global;
+	}
+	dispatch_enqueue(dsq, p, enq_flags);
+}
+
+/**
+ * scx_bpf_consume - move a task from a dispatch queue to the local one
+ * @dsq_id: SCX_DSQ_GLOBAL or a DSQ created by the BPF scheduler
+ *
+ * Moves the first task of the DSQ that can run on the dispatching CPU. Only
+ * valid in ops.dispatch().
+ *
+ * Return: true if a task was moved.
+ */
+bool noinline scx_bpf_consume(u64 dsq_id)
+{
+	struct scx_dsp_ctx *dctx = this_cpu_ptr(&scx_dsp_ctx);
+	struct scx_dispatch_q *dsq;
+
+	if (unlikely(!dctx->rq)) {
+		scx_ops_error("scx_bpf_consume() called outside ops.dispatch()");
+		return false;
+	}
+
+	dsq = find_non_local_dsq(dsq_id);
+	if (unlikely(!dsq)) {
+		scx_ops_error("consuming non-existent DSQ 0x%llx", dsq_id);
+		return false;
+	}
+
+	return consume_dispatch_q(dctx->rq, dctx->rf, dsq);
+}
+
+/**
+ * scx_bpf_dsq_nr_queued - number of tasks on a dispatch queue
+ * @dsq_id: SCX_DSQ_LOCAL for the current CPU's, SCX_DSQ_GLOBAL, or a DSQ
+ *	created by the BPF scheduler
+ *
+ * Return: the number of tasks, or -ENOENT.
+ */
+s32 noinline scx_bpf_dsq_nr_queued(u64 dsq_id)
+{
+	struct scx_dispatch_q *dsq;
+
+	if (dsq_id == SCX_DSQ_LOCAL)
+		return READ_ONCE(this_rq()->scx.local_dsq.nr);
+
+	dsq = find_non_local_dsq(dsq_id);
+	if (unlikely(!dsq)) {
+		scx_ops_error("DSQ 0x%llx doesn't exist", dsq_id);
+		return -ENOENT;
+	}
+	return READ_ONCE(dsq->nr);
+}
+
+/**
+ * scx_bpf_kick_cpu - make a CPU go through the scheduler
+ * @cpu: the CPU
+ *
+ * E.g. so that an idle CPU looks for the tasks just dispatched to a shared
+ * DSQ.
+ */
+void noinline scx_bpf_kick_cpu(s32 cpu)
+{
+	if (unlikely(!ops_cpu_valid(cpu))) {
+		scx_ops_error("kicking invalid CPU %d", cpu);
+		return;
+	}
+
+	preempt_disable();
+	cpumask_set_cpu(cpu, this_cpu_cpumask_var_ptr(scx_kick_cpus));
+	irq_work_queue(this_cpu_ptr(&scx_kick_irq_work));
+	preempt_enable();
+}
+
+/**
+ * scx_bpf_select_cpu_dfl - the CPU picked without ops.select_cpu()
+ * @p: the task waking up
+ * @prev_cpu: the CPU it last ran on
+ * @wake_flags: WF_*
+ *
+ * Return: @prev_cpu if it is idle, else another idle CPU @p can run on, else
+ * @prev_cpu.
+ */
+s32 noinline scx_bpf_select_cpu_dfl(struct task_struct *p, s32 prev_cpu,
+				    u64 wake_flags)
+{
+	if (unlikely(!ops_cpu_valid(prev_cpu))) {
+		scx_ops_error("invalid CPU %d", prev_cpu);
+		return -EINVAL;
+	}
+	return scx_select_cpu_dfl(p, prev_cpu, wake_flags);
+}
+
+/**
+ * scx_bpf_task_cpu - the CPU a task is on or was last on
+ * @p: the task
+ */
+s32 noinline scx_bpf_task_cpu(const struct task_struct *p)
+{
+	return task_cpu(p);
+}
+
+__diag_pop();
+
+BTF_SET_START(scx_kfunc_ids)
+BTF_ID(func, scx_bpf_create_dsq)
+BTF_ID(func, scx_bpf_destroy_dsq)
+BTF_ID(func, scx_bpf_dispatch)
+BTF_ID(func, scx_bpf_consume)
+BTF_ID(func, scx_bpf_dsq_nr_queued)
+BTF_ID(func, scx_bpf_kick_cpu)
+BTF_ID(func, scx_bpf_select_cpu_dfl)
+BTF_ID(func, scx_bpf_task_cpu)
+BTF_SET_END(scx_kfunc_ids)
+
+static void kick_cpus_irq_workfn(struct irq_work *irq_work)
+{
+	struct cpumask *kick_cpus = this_cpu_cpumask_var_ptr(scx_kick_cpus);
+	int cpu;
+
+	for_each_cpu(cpu, kick_cpus) {
+		cpumask_clear_cpu(cpu, kick_cpus);
+		resched_cpu(cpu);
+	}
+}
+
+/*
+ * BPF struct_ops
+ */
+
+/* "extern" is to avoid sparse warning.  It is only used in bpf_struct_ops.c. */
+extern struct bpf_struct_ops bpf_sched_ext_ops;
+
+static const struct btf_type *task_struct_type;
+
+static int bpf_scx_init(struct btf *btf)
+{
+	s32 type_id;
+
+	type_id = btf_find_by_name_kind(btf, "task_struct", BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	task_struct_type = btf_type_by_id(btf, type_id);
+
+	return 0;
+}
+
+static bool bpf_scx_is_valid_access(int off, int size,
+				    enum bpf_access_type type,
+				    const struct bpf_prog *prog,
+				    struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off >= sizeof(__u64) * MAX_BPF_FUNC_ARGS)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+
+	return btf_ctx_access(off, size, type, prog, info);
+}
+
+static int bpf_scx_btf_struct_access(struct bpf_verifier_log *log,
+				     const struct btf *btf,
+				     const struct btf_type *t, int off,
+				     int size, enum bpf_access_type atype,
+				     u32 *next_btf_id)
+{
+	if (atype == BPF_READ)
+		return btf_struct_access(log, btf, t, off, size, atype, next_btf_id);
+
+	if (t == task_struct_type &&
+	    off >= offsetof(struct task_struct, scx.slice) &&
+	    off + size <= offsetofend(struct task_struct, scx.slice))
+		return NOT_INIT;
+
+	bpf_log(log, "only p->scx.slice can be written\n");
+	return -EACCES;
+}
+
+static const struct bpf_func_proto *
+bpf_scx_get_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id);
+}
+
+static bool bpf_scx_check_kfunc_call(u32 kfunc_btf_id)
+{
+	return btf_id_set_contains(&scx_kfunc_ids, kfunc_btf_id);
+}
+
+static const struct bpf_verifier_ops bpf_scx_verifier_ops = {
+	.get_func_proto		= bpf_scx_get_func_proto,
+	.is_valid_access	= bpf_scx_is_valid_access,
+	.btf_struct_access	= bpf_scx_btf_struct_access,
+	.check_kfunc_call	= bpf_scx_check_kfunc_call,
+};
+
+static int bpf_scx_init_member(const struct btf_type *t,
+			       const struct btf_member *member,
+			       void *kdata, const void *udata)
+{
+	const struct sched_ext_ops *uops = udata;
+	struct sched_ext_ops *ops = kdata;
+	u32 moff;
+
+	moff = btf_member_bit_offset(t, member) / 8;
+	switch (moff) {
+	case offsetof(struct sched_ext_ops, flags):
+		if (uops->flags & ~SCX_OPS_ALL_FLAGS)
+			return -EINVAL;
+		ops->flags = uops->flags;
+		return 1;
+	case offsetof(struct sched_ext_ops, timeout_ms):
+		if (msecs_to_jiffies(uops->timeout_ms) > SCX_WATCHDOG_MAX_TIMEOUT)
+			return -E2BIG;
+		ops->timeout_ms = uops->timeout_ms;
+		return 1;
+	case offsetof(struct sched_ext_ops, name):
+		if (bpf_obj_name_cpy(ops->name, uops->name,
+				     sizeof(ops->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	/* All the operations are optional */
+	return 0;
+}
+
+static int bpf_scx_reg(void *kdata)
+{
+	return scx_ops_enable(kdata);
+}
+
+static void bpf_scx_unreg(void *kdata)
+{
+	mutex_lock(&scx_ops_enable_mutex);
+	/* The BPF scheduler may have been disabled and replaced already */
+	if (scx_ops_kdata == kdata) {
+		int none = SCX_EXIT_NONE;
+
+		atomic_try_cmpxchg(&scx_exit_kind, &none, SCX_EXIT_UNREG);
+		scx_ops_disable_locked();
+	}
+	mutex_unlock(&scx_ops_enable_mutex);
+}
+
+struct bpf_struct_ops bpf_sched_ext_ops = {
+	.verifier_ops = &bpf_scx_verifier_ops,
+	.reg = bpf_scx_reg,
+	.unreg = bpf_scx_unreg,
+	.init_member = bpf_scx_init_member,
+	.init = bpf_scx_init,
+	.name = "sched_ext_ops",
+};
+
+/*
+ * Initialization
+ */
+
+void __init init_sched_ext_class(void)
+{
+	int cpu;
+
+	init_dsq(&scx_dsq_global, SCX_DSQ_GLOBAL);
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		init_dsq(&rq->scx.local_dsq, SCX_DSQ_LOCAL);
+		INIT_LIST_HEAD(&rq->scx.runnable_list);
+	}
+
+	kthread_init_work(&scx_ops_disable_work, scx_ops_disable_workfn);
+	init_irq_work(&scx_ops_error_irq_work, scx_ops_error_irq_workfn);
+	INIT_DELAYED_WORK(&scx_watchdog_work, scx_watchdog_workfn);
+}
+
+static int __init scx_init(void)
+{
+	struct kthread_worker *helper;
+	int cpu, ret;
+
+	ret = rhashtable_init(&scx_dsq_hash, &dsq_hash_params);
+	if (ret)
+		goto err;
+
+	for_each_possible_cpu(cpu) {
+		ret = -ENOMEM;
+		if (!zalloc_cpumask_var_node(&per_cpu(scx_kick_cpus, cpu),
+					     GFP_KERNEL, cpu_to_node(cpu)))
+			goto err;
+		init_irq_work(&per_cpu(scx_kick_irq_work, cpu),
+			      kick_cpus_irq_workfn);
+	}
+
+	/* Real-time, so that a broken BPF scheduler can't keep it from running */
+	helper = kthread_create_worker(0, "sched_ext_ops_helper");
+	if (IS_ERR(helper)) {
+		ret = PTR_ERR(helper);
+		goto err;
+	}
+	sched_set_fifo(helper->task);
+	scx_ops_helper = helper;
+
+	return 0;
+err:
+	pr_err("sched_ext: failed to initialize (%d), BPF schedulers can't be loaded\n",
+	       ret);
+	return ret;
+}
+core_initcall(scx_init);
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifdef CONFIG_SCHED_CLASS_EXT
+
+DECLARE_STATIC_KEY_FALSE(__scx_ops_enabled);
+/* true from the time a BPF scheduler starts loading until it is gone */
+#define scx_enabled()		static_branch_unlikely(&__scx_ops_enabled)
+
+extern bool task_should_scx(struct task_struct *p);
+extern void scx_post_fork(struct task_struct *p);
+extern void scx_tick(struct rq *rq);
+extern void init_sched_ext_class(void);
+extern void sched_update_task_class(struct task_struct *p);
+
+static inline void init_scx_entity(struct sched_ext_entity *scx)
+{
+	memset(scx, 0, sizeof(*scx));
+	INIT_LIST_HEAD(&scx->dsq_node);
+	INIT_LIST_HEAD(&scx->runnable_node);
+	INIT_LIST_HEAD(&scx->tasks_node);
+	scx->holding_cpu = -1;
+}
+
+#else /* !CONFIG_SCHED_CLASS_EXT */
+
+#define scx_enabled()		false
+
+static inline bool task_should_scx(struct task_struct *p)
+{
+	return false;
+}
+
+static inline void scx_post_fork(struct task_struct *p) {}
+static inline void scx_tick(struct rq *rq) {}
+static inline void init_sched_ext_class(void) {}
+
+#endif /* CONFIG_SCHED_CLASS_EXT */
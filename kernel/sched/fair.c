@@ -536,6 +536,62 @@ static inline bool entity_before(struct sched_entity *a,
 #define __node_2_se(node) \
 	rb_entry((node), struct sched_entity, run_node)
 
+/*
+ * Eligibility
+ *
+ * An entity is eligible when it hasn't received more service than it is
+ * entitled to, that is when its vruntime doesn't exceed the load weighted
+ * average vruntime of the cfs_rq:
+ *
+ *   v_i <= \Sum w_j * v_j / \Sum w_j
+ *
+ * To keep the sums small, cfs_rq->avg_vruntime accumulates the keys of the
+ * entities in the tree relative to min_vruntime, and is adjusted whenever
+ * min_vruntime moves. The current entity is added when it is needed.
+ */
+static inline s64 entity_key(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	return (s64)(se->vruntime - cfs_rq->min_vruntime);
+}
+
+static void avg_vruntime_add(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	unsigned long weight = scale_load_down(se->load.weight);
+
+	cfs_rq->avg_vruntime += entity_key(cfs_rq, se) * weight;
+	cfs_rq->avg_load += weight;
+}
+
+static void avg_vruntime_sub(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	unsigned long weight = scale_load_down(se->load.weight);
+
+	cfs_rq->avg_vruntime -= entity_key(cfs_rq, se) * weight;
+	cfs_rq->avg_load -= weight;
+}
+
+static inline void avg_vruntime_update(struct cfs_rq *cfs_rq, s64 delta)
+{
+	/* v - (min_vruntime + delta) for every entity */
+	cfs_rq->avg_vruntime -= cfs_rq->avg_load * delta;
+}
+
+static bool entity_eligible(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct sched_entity *curr = cfs_rq->curr;
+	s64 avg = cfs_rq->avg_vruntime;
+	long load = cfs_rq->avg_load;
+
+	if (curr && curr->on_rq) {
+		unsigned long weight = scale_load_down(curr->load.weight);
+
+		avg += entity_key(cfs_rq, curr) * weight;
+		load += weight;
+	}
+
+	return avg >= entity_key(cfs_rq, se) * load;
+}
+
 static void update_min_vruntime(struct cfs_rq *cfs_rq)
 {
 	struct sched_entity *curr = cfs_rq->curr;
@@ -560,7 +616,9 @@ static void update_min_vruntime(struct cfs_rq *cfs_rq)
 	}
 
 	/* ensure we never gain time by being placed backwards. */
-	cfs_rq->min_vruntime = max_vruntime(cfs_rq->min_vruntime, vruntime);
+	vruntime = max_vruntime(cfs_rq->min_vruntime, vruntime);
+	avg_vruntime_update(cfs_rq, (s64)(vruntime - cfs_rq->min_vruntime));
+	cfs_rq->min_vruntime = vruntime;
 #ifndef CONFIG_64BIT
 	smp_wmb();
 	cfs_rq->min_vruntime_copy = cfs_rq->min_vruntime;
@@ -572,17 +630,74 @@ static inline bool __entity_less(struct rb_node *a, const struct rb_node *b)
 	return entity_before(__node_2_se(a), __node_2_se(b));
 }
 
+/*
+ * Tasks with a negative latency nice run in slices shorter than CFS would
+ * give them, and are also kept in latency_timeline by the virtual deadline
+ * of their current slice, so that they can be picked ahead of the leftmost
+ * entity while they are eligible.
+ */
+static inline bool latency_sensitive(struct sched_entity *se)
+{
+	return entity_is_task(se) && task_of(se)->latency_nice < 0;
+}
+
+/* Wall time slice of a latency sensitive task, shorter as it gets nicer */
+static u64 latency_slice(struct sched_entity *se)
+{
+	int steps = task_of(se)->latency_nice - MIN_LATENCY_NICE + 1;
+	u64 slice;
+
+	/* sysctl_sched_latency in 20 steps, down to 1/20th of it */
+	slice = div_u64((u64)sysctl_sched_latency * steps, -MIN_LATENCY_NICE);
+
+	return max_t(u64, slice, 100 * NSEC_PER_USEC);
+}
+
+static inline void update_deadline(struct sched_entity *se)
+{
+	se->deadline = se->vruntime + calc_delta_fair(latency_slice(se), se);
+}
+
+#define __latency_node_2_se(node) \
+	rb_entry((node), struct sched_entity, latency_node)
+
+static inline bool __latency_less(struct rb_node *a, const struct rb_node *b)
+{
+	return (s64)(__latency_node_2_se(a)->deadline -
+		     __latency_node_2_se(b)->deadline) < 0;
+}
+
 /*
  * Enqueue an entity into the rb-tree:
  */
 static void __enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
+	avg_vruntime_add(cfs_rq, se);
 	rb_add_cached(&se->run_node, &cfs_rq->tasks_timeline, __entity_less);
+	if (latency_sensitive(se))
+		rb_add_cached(&se->latency_node, &cfs_rq->latency_timeline,
+			      __latency_less);
 }
 
 static void __dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 	rb_erase_cached(&se->run_node, &cfs_rq->tasks_timeline);
+	avg_vruntime_sub(cfs_rq, se);
+	/* latency_nice may have changed while the task was queued */
+	if (!RB_EMPTY_NODE(&se->latency_node)) {
+		rb_erase_cached(&se->latency_node, &cfs_rq->latency_timeline);
+		RB_CLEAR_NODE(&se->latency_node);
+	}
+}
+
+static struct sched_entity *__pick_first_latency(struct cfs_rq *cfs_rq)
+{
+	struct rb_node *left = rb_first_cached(&cfs_rq->latency_timeline);
+
+	if (!left)
+		return NULL;
+
+	return __latency_node_2_se(left);
 }
 
 struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq)
@@ -846,12 +961,28 @@ static void update_curr(struct cfs_rq *cfs_rq)
 	curr->vruntime += calc_delta_fair(delta_exec, curr);
 	update_min_vruntime(cfs_rq);
 
+	/* A latency sensitive task used up its slice, let others run */
+	if (latency_sensitive(curr) &&
+	    (s64)(curr->vruntime - curr->deadline) >= 0) {
+		update_deadline(curr);
+		if (cfs_rq->nr_running > 1)
+			resched_curr(rq_of(cfs_rq));
+	}
+
 	if (entity_is_task(curr)) {
 		struct task_struct *curtask = task_of(curr);
 
 		trace_sched_stat_runtime(curtask, delta_exec, curr->vruntime);
 		cgroup_account_cputime(curtask, delta_exec);
 		account_group_exec_runtime(curtask, delta_exec);
+
+		/*
+		 * Charge the fair server whether or not it picked the task:
+		 * what fair tasks got on their own counts against what it
+		 * still has to guarantee them this period.
+		 */
+		if (dl_server_active(&rq_of(cfs_rq)->fair_server))
+			dl_server_update(&rq_of(cfs_rq)->fair_server, delta_exec);
 	}
 
 	account_cfs_rq_runtime(cfs_rq, delta_exec);
@@ -1069,6 +1200,12 @@ unsigned int sysctl_numa_balancing_scan_size = 256;
 /* Scan @scan_size MB every @scan_period after an initial @scan_delay in ms */
 unsigned int sysctl_numa_balancing_scan_delay = 1000;
 
+/* The page with hint page fault latency < threshold in ms is considered hot */
+unsigned int sysctl_numa_balancing_hot_threshold = MSEC_PER_SEC;
+
+/* Restrict the NUMA promotion throughput (MB/s) for each target node. */
+unsigned int sysctl_numa_balancing_promote_rate_limit = 65536;
+
 struct numa_group {
 	refcount_t refcount;
 
@@ -1409,6 +1546,106 @@ static inline unsigned long group_weight(struct task_struct *p, int nid,
 	return 1000 * faults / total_faults;
 }
 
+static bool pgdat_free_space_enough(struct pglist_data *pgdat)
+{
+	int z;
+	unsigned long enough_wmark;
+
+	enough_wmark = max(1UL * 1024 * 1024 * 1024 >> PAGE_SHIFT,
+			   pgdat->node_present_pages >> 4);
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + enough_wmark,
+				      ZONE_MOVABLE, 0))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * For memory tiering mode, when page tables are scanned, the scan
+ * time will be recorded in struct page in addition to make page
+ * PROT_NONE for slow memory page.  So when the page is accessed, in
+ * hint page fault handler, the hint page fault latency is calculated
+ * via,
+ *
+ *	hint page fault latency = hint page fault time - scan time
+ *
+ * The smaller the hint page fault latency, the higher the possibility
+ * for the page to be hot.
+ */
+static int numa_hint_fault_latency(struct page *page)
+{
+	int last_time, time;
+
+	time = jiffies_to_msecs(jiffies);
+	last_time = xchg_page_access_time(page, time);
+
+	return (time - last_time) & PAGE_ACCESS_TIME_MASK;
+}
+
+/*
+ * For memory tiering mode, too high promotion/demotion throughput may
+ * hurt application latency.  So we provide a mechanism to rate limit
+ * the number of pages that are tried to be promoted.
+ */
+static bool numa_promotion_rate_limit(struct pglist_data *pgdat,
+				      unsigned long rate_limit, int nr)
+{
+	unsigned long nr_cand;
+	unsigned int now, start;
+
+	now = jiffies_to_msecs(jiffies);
+	mod_node_page_state(pgdat, PGPROMOTE_CANDIDATE, nr);
+	nr_cand = node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+	start = pgdat->nbp_rl_start;
+	if (now - start > MSEC_PER_SEC &&
+	    cmpxchg(&pgdat->nbp_rl_start, start, now) == start)
+		pgdat->nbp_rl_nr_cand = nr_cand;
+	if (nr_cand - pgdat->nbp_rl_nr_cand >= rate_limit)
+		return true;
+	return false;
+}
+
+#define NUMA_MIGRATION_ADJUST_STEPS	16
+
+/*
+ * Move the hot threshold so that the number of promotion candidates found
+ * per scan period tracks the rate limit: a smaller threshold when too many
+ * pages look hot, a larger one when too few do.
+ */
+static void numa_promotion_adjust_threshold(struct pglist_data *pgdat,
+					    unsigned long rate_limit,
+					    unsigned int ref_th)
+{
+	unsigned int now, start, th_period, unit_th, th;
+	unsigned long nr_cand, ref_cand, diff_cand;
+
+	now = jiffies_to_msecs(jiffies);
+	th_period = sysctl_numa_balancing_scan_period_max;
+	start = pgdat->nbp_th_start;
+	if (now - start > th_period &&
+	    cmpxchg(&pgdat->nbp_th_start, start, now) == start) {
+		ref_cand = rate_limit *
+			sysctl_numa_balancing_scan_period_max / MSEC_PER_SEC;
+		nr_cand = node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+		diff_cand = nr_cand - pgdat->nbp_th_nr_cand;
+		unit_th = ref_th * 2 / NUMA_MIGRATION_ADJUST_STEPS;
+		th = pgdat->nbp_threshold ? : ref_th;
+		if (diff_cand > ref_cand * 11 / 10)
+			th = max(th - unit_th, unit_th);
+		else if (diff_cand < ref_cand * 9 / 10)
+			th = min(th + unit_th, ref_th * 2);
+		pgdat->nbp_th_nr_cand = nr_cand;
+		pgdat->nbp_threshold = th;
+	}
+}
+
 bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 				int src_nid, int dst_cpu)
 {
@@ -1416,6 +1653,37 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	int dst_nid = cpu_to_node(dst_cpu);
 	int last_cpupid, this_cpupid;
 
+	/*
+	 * The pages in slow memory node should be migrated according
+	 * to hot/cold instead of private/shared.
+	 */
+	if (sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING &&
+	    !node_is_toptier(src_nid)) {
+		struct pglist_data *pgdat;
+		unsigned long rate_limit;
+		unsigned int latency, th, def_th;
+
+		pgdat = NODE_DATA(dst_nid);
+		if (pgdat_free_space_enough(pgdat)) {
+			/* workload changed, reset hot threshold */
+			pgdat->nbp_threshold = 0;
+			return true;
+		}
+
+		def_th = sysctl_numa_balancing_hot_threshold;
+		rate_limit = sysctl_numa_balancing_promote_rate_limit << \
+			(20 - PAGE_SHIFT);
+		numa_promotion_adjust_threshold(pgdat, rate_limit, def_th);
+
+		th = pgdat->nbp_threshold ? : def_th;
+		latency = numa_hint_fault_latency(page);
+		if (latency >= th)
+			return false;
+
+		return !numa_promotion_rate_limit(pgdat, rate_limit,
+						  thp_nr_pages(page));
+	}
+
 	this_cpupid = cpu_pid_to_cpupid(dst_cpu, current->pid);
 	last_cpupid = page_cpupid_xchg_last(page, this_cpupid);
 
@@ -2636,6 +2904,14 @@ void task_numa_fault(int last_cpupid, int mem_node, int pages, int flags)
 	if (!p->mm)
 		return;
 
+	/*
+	 * NUMA faults statistics are unnecessary for the slow memory
+	 * node for memory tiering mode.
+	 */
+	if (sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING &&
+	    !node_is_toptier(mem_node))
+		return;
+
 	/* Allocate buffer to track faults on a per-node basis */
 	if (unlikely(!p->numa_faults)) {
 		int size = sizeof(*p->numa_faults) *
@@ -3083,12 +3359,16 @@ dequeue_load_avg(struct cfs_rq *cfs_rq, struct sched_entity *se) { }
 static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
 			    unsigned long weight)
 {
+	bool in_tree = se->on_rq && cfs_rq->curr != se;
+
 	if (se->on_rq) {
 		/* commit outstanding execution time */
 		if (cfs_rq->curr == se)
 			update_curr(cfs_rq);
 		update_load_sub(&cfs_rq->load, se->load.weight);
 	}
+	if (in_tree)
+		avg_vruntime_sub(cfs_rq, se);
 	dequeue_load_avg(cfs_rq, se);
 
 	update_load_set(&se->load, weight);
@@ -3104,7 +3384,8 @@ static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
 	enqueue_load_avg(cfs_rq, se);
 	if (se->on_rq)
 		update_load_add(&cfs_rq->load, se->load.weight);
-
+	if (in_tree)
+		avg_vruntime_add(cfs_rq, se);
 }
 
 void reweight_task(struct task_struct *p, int prio)
@@ -4327,6 +4608,9 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (flags & ENQUEUE_WAKEUP)
 		place_entity(cfs_rq, se, 0);
 
+	if (latency_sensitive(se))
+		update_deadline(se);
+
 	check_schedstat_required();
 	update_stats_enqueue(cfs_rq, se, flags);
 	check_spread(cfs_rq, se);
@@ -4523,6 +4807,41 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 static int
 wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se);
 
+/*
+ * Virtual deadline of @se. Entities without one of their own are due at the
+ * end of their CFS slice, what is left of it for the current one.
+ */
+static u64 entity_deadline(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	u64 slice, ran;
+
+	if (latency_sensitive(se))
+		return se->deadline;
+
+	slice = sched_slice(cfs_rq, se);
+	if (se == cfs_rq->curr) {
+		ran = se->sum_exec_runtime - se->prev_sum_exec_runtime;
+		slice = slice > ran ? slice - ran : 0;
+	}
+
+	return se->vruntime + calc_delta_fair(slice, se);
+}
+
+/*
+ * Should the latency sensitive @se run before @other: it is eligible and
+ * its deadline is earlier.
+ */
+static bool latency_preempt_entity(struct cfs_rq *cfs_rq,
+				   struct sched_entity *se,
+				   struct sched_entity *other)
+{
+	if (!sched_feat(LATENCY_PICK))
+		return false;
+
+	return entity_eligible(cfs_rq, se) &&
+	       (s64)(se->deadline - entity_deadline(cfs_rq, other)) < 0;
+}
+
 /*
  * Pick the next process, keeping these things in mind, in this order:
  * 1) keep things fair between processes/task groups
@@ -4534,7 +4853,7 @@ static struct sched_entity *
 pick_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 {
 	struct sched_entity *left = __pick_first_entity(cfs_rq);
-	struct sched_entity *se;
+	struct sched_entity *se, *lat;
 
 	/*
 	 * If curr is set we have to see if its left of the leftmost entity
@@ -4564,6 +4883,18 @@ pick_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 			se = second;
 	}
 
+	/*
+	 * The earliest deadline of the latency sensitive entities comes
+	 * before the one of the entity picked so far.
+	 */
+	lat = __pick_first_latency(cfs_rq);
+	if (curr && curr->on_rq && latency_sensitive(curr) &&
+	    (!lat || (s64)(curr->deadline - lat->deadline) < 0))
+		lat = curr;
+	if (lat && lat != se && lat != cfs_rq->skip &&
+	    latency_preempt_entity(cfs_rq, lat, se))
+		return lat;
+
 	if (cfs_rq->next && wakeup_preempt_entity(cfs_rq->next, left) < 1) {
 		/*
 		 * Someone really wants this to run. If it's not unfair, run it.
@@ -4915,6 +5246,10 @@ static bool throttle_cfs_rq(struct cfs_rq *cfs_rq)
 	/* At this point se is NULL and we are at root level*/
 	sub_nr_running(rq, task_delta);
 
+	/* Stop the fair server if throttling resulted in no runnable tasks */
+	if (!rq->cfs.h_nr_running)
+		dl_server_stop(&rq->fair_server);
+
 done:
 	/*
 	 * Note: distribution will already see us throttled via the
@@ -4999,6 +5334,7 @@ void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
 
 	/* At this point se is NULL and we are at root level*/
 	add_nr_running(rq, task_delta);
+	dl_server_start(&rq->fair_server);
 
 unthrottle_throttle:
 	/*
@@ -5670,6 +6006,9 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	/* At this point se is NULL and we are at root level*/
 	add_nr_running(rq, 1);
 
+	/* Don't let RT tasks starve us from now on, a no-op if already so */
+	dl_server_start(&rq->fair_server);
+
 	/*
 	 * Since new tasks are assigned an initial util_avg equal to
 	 * half of the spare capacity of their CPU, tiny tasks have the
@@ -5776,6 +6115,9 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	/* At this point se is NULL and we are at root level*/
 	sub_nr_running(rq, 1);
 
+	if (!rq->cfs.h_nr_running)
+		dl_server_stop(&rq->fair_server);
+
 	/* balance early to pull high priority tasks */
 	if (unlikely(!was_sched_idle && sched_idle_rq(rq)))
 		rq->next_balance = jiffies;
@@ -6150,8 +6492,11 @@ static inline void set_idle_cores(int cpu, int val)
 	struct sched_domain_shared *sds;
 
 	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
-	if (sds)
+	if (sds) {
 		WRITE_ONCE(sds->has_idle_cores, val);
+		if (!val)
+			WRITE_ONCE(sds->idle_core, -1);
+	}
 }
 
 static inline bool test_idle_cores(int cpu, bool def)
@@ -6167,18 +6512,23 @@ static inline bool test_idle_cores(int cpu, bool def)
 
 /*
  * Scans the local SMT mask to see if the entire core is idle, and records this
- * information in sd_llc_shared->has_idle_cores.
+ * information in sd_llc_shared->has_idle_cores, and the core itself in
+ * sd_llc_shared->idle_core so that wakeups can try it before scanning.
  *
  * Since SMT siblings share all cache levels, inspecting this limited remote
  * state should be fairly cheap.
  */
 void __update_idle_core(struct rq *rq)
 {
+	struct sched_domain_shared *sds;
 	int core = cpu_of(rq);
 	int cpu;
 
 	rcu_read_lock();
-	if (test_idle_cores(core, true))
+	sds = rcu_dereference(per_cpu(sd_llc_shared, core));
+	if (!sds)
+		goto unlock;
+	if (READ_ONCE(sds->has_idle_cores) && READ_ONCE(sds->idle_core) >= 0)
 		goto unlock;
 
 	for_each_cpu(cpu, cpu_smt_mask(core)) {
@@ -6189,7 +6539,8 @@ void __update_idle_core(struct rq *rq)
 			goto unlock;
 	}
 
-	set_idle_cores(core, 1);
+	WRITE_ONCE(sds->idle_core, core);
+	WRITE_ONCE(sds->has_idle_cores, 1);
 unlock:
 	rcu_read_unlock();
 }
@@ -6211,7 +6562,8 @@ static int select_idle_core(struct task_struct *p, int core, struct cpumask *cpu
 		if (!available_idle_cpu(cpu)) {
 			idle = false;
 			if (*idle_cpu == -1) {
-				if (sched_idle_cpu(cpu) && cpumask_test_cpu(cpu, p->cpus_ptr)) {
+				if (sched_idle_cpu(cpu) && cpumask_test_cpu(cpu, p->cpus_ptr) &&
+				    sched_cpu_cookie_match(cpu_rq(cpu), p)) {
 					*idle_cpu = cpu;
 					break;
 				}
@@ -6219,7 +6571,8 @@ static int select_idle_core(struct task_struct *p, int core, struct cpumask *cpu
 			}
 			break;
 		}
-		if (*idle_cpu == -1 && cpumask_test_cpu(cpu, p->cpus_ptr))
+		if (*idle_cpu == -1 && cpumask_test_cpu(cpu, p->cpus_ptr) &&
+		    sched_cpu_cookie_match(cpu_rq(cpu), p))
 			*idle_cpu = cpu;
 	}
 
@@ -6241,7 +6594,7 @@ static int select_idle_smt(struct task_struct *p, struct sched_domain *sd, int t
 		if (!cpumask_test_cpu(cpu, p->cpus_ptr) ||
 		    !cpumask_test_cpu(cpu, sched_domain_span(sd)))
 			continue;
-		if (available_idle_cpu(cpu) || sched_idle_cpu(cpu))
+		if (__select_idle_cpu(cpu, p) == cpu)
 			return cpu;
 	}
 
@@ -6291,6 +6644,7 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, bool
 		return -1;
 
 	cpumask_and(cpus, sched_domain_span(sd), p->cpus_ptr);
+	schedstat_inc(this_rq->sis_search);
 
 	if (sched_feat(SIS_PROP) && !has_idle_core) {
 		u64 avg_cost, avg_idle, span_avg;
@@ -6326,20 +6680,76 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, bool
 			/* because !--nr is the condition to stop scan */
 			nr = READ_ONCE(sd_share->nr_idle_scan) + 1;
 			/* overloaded LLC is unlikely to have idle cpu/core */
-			if (nr == 1)
+			if (nr == 1) {
+				schedstat_inc(this_rq->sis_failed);
 				return -1;
+			}
+		}
+	}
+
+	/*
+	 * Look in the cluster of the target first, its CPUs share a cache
+	 * level below the LLC.
+	 */
+	if (static_branch_unlikely(&sched_cluster_active)) {
+		struct sched_domain *sdc;
+
+		sdc = rcu_dereference(per_cpu(sd_cluster, target));
+		if (sdc) {
+			for_each_cpu_wrap(cpu, sched_domain_span(sdc), target + 1) {
+				if (!cpumask_test_cpu(cpu, cpus))
+					continue;
+
+				schedstat_inc(this_rq->sis_scanned);
+				if (has_idle_core) {
+					i = select_idle_core(p, cpu, cpus, &idle_cpu);
+					if ((unsigned int)i < nr_cpumask_bits)
+						return i;
+				} else {
+					if (!--nr) {
+						schedstat_inc(this_rq->sis_failed);
+						return -1;
+					}
+					idle_cpu = __select_idle_cpu(cpu, p);
+					if ((unsigned int)idle_cpu < nr_cpumask_bits)
+						goto found;
+				}
+			}
+			cpumask_andnot(cpus, cpus, sched_domain_span(sdc));
+		}
+	}
+
+	/*
+	 * Then try the core last seen idle, a full scan of a large LLC for
+	 * an idle core is expensive.
+	 */
+	if (has_idle_core) {
+		sd_share = rcu_dereference(per_cpu(sd_llc_shared, target));
+		cpu = sd_share ? READ_ONCE(sd_share->idle_core) : -1;
+		if (cpu >= 0 && cpumask_test_cpu(cpu, cpus)) {
+			schedstat_inc(this_rq->sis_scanned);
+			i = select_idle_core(p, cpu, cpus, &idle_cpu);
+			/* consumed, or stale */
+			WRITE_ONCE(sd_share->idle_core, -1);
+			if ((unsigned int)i < nr_cpumask_bits) {
+				schedstat_inc(this_rq->sis_core_hint);
+				return i;
+			}
 		}
 	}
 
 	for_each_cpu_wrap(cpu, cpus, target + 1) {
+		schedstat_inc(this_rq->sis_scanned);
 		if (has_idle_core) {
 			i = select_idle_core(p, cpu, cpus, &idle_cpu);
 			if ((unsigned int)i < nr_cpumask_bits)
 				return i;
 
 		} else {
-			if (!--nr)
+			if (!--nr) {
+				schedstat_inc(this_rq->sis_failed);
 				return -1;
+			}
 			idle_cpu = __select_idle_cpu(cpu, p);
 			if ((unsigned int)idle_cpu < nr_cpumask_bits)
 				break;
@@ -6349,6 +6759,7 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, bool
 	if (has_idle_core)
 		set_idle_cores(target, false);
 
+found:
 	if (sched_feat(SIS_PROP) && !has_idle_core) {
 		time = cpu_clock(this) - time;
 
@@ -6361,6 +6772,9 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, bool
 		update_avg(&this_sd->avg_scan_cost, time);
 	}
 
+	if ((unsigned int)idle_cpu >= nr_cpumask_bits)
+		schedstat_inc(this_rq->sis_failed);
+
 	return idle_cpu;
 }
 
@@ -6414,7 +6828,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	bool has_idle_core = false;
 	struct sched_domain *sd;
 	unsigned long task_util;
-	int i, recent_used_cpu;
+	int i, recent_used_cpu, prev_aff = -1;
 
 	/*
 	 * On asymmetric system, update task utilization because we will check
@@ -6430,7 +6844,12 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	 */
 	lockdep_assert_irqs_disabled();
 
-	if ((available_idle_cpu(target) || sched_idle_cpu(target)) &&
+	/*
+	 * With core scheduling, an idle CPU whose siblings run tasks of
+	 * another cookie is only taken if nothing better is found, since
+	 * running there would force either them or us idle.
+	 */
+	if (__select_idle_cpu(target, p) == target &&
 	    asym_fits_capacity(task_util, target))
 		return target;
 
@@ -6438,9 +6857,15 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	 * If the previous CPU is cache affine and idle, don't be stupid:
 	 */
 	if (prev != target && cpus_share_cache(prev, target) &&
-	    (available_idle_cpu(prev) || sched_idle_cpu(prev)) &&
-	    asym_fits_capacity(task_util, prev))
-		return prev;
+	    __select_idle_cpu(prev, p) == prev &&
+	    asym_fits_capacity(task_util, prev)) {
+		/* Unless an idle CPU in the cluster of the target may be found */
+		if (!static_branch_unlikely(&sched_cluster_active) ||
+		    cpus_share_cluster(prev, target))
+			return prev;
+
+		prev_aff = prev;
+	}
 
 	/*
 	 * Allow a per-cpu kthread to stack with the wakee if the
@@ -6464,7 +6889,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if (recent_used_cpu != prev &&
 	    recent_used_cpu != target &&
 	    cpus_share_cache(recent_used_cpu, target) &&
-	    (available_idle_cpu(recent_used_cpu) || sched_idle_cpu(recent_used_cpu)) &&
+	    __select_idle_cpu(recent_used_cpu, p) == recent_used_cpu &&
 	    cpumask_test_cpu(p->recent_used_cpu, p->cpus_ptr) &&
 	    asym_fits_capacity(task_util, recent_used_cpu)) {
 		/*
@@ -6472,7 +6897,11 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 		 * candidate for the next wake:
 		 */
 		p->recent_used_cpu = prev;
-		return recent_used_cpu;
+		if (!static_branch_unlikely(&sched_cluster_active) ||
+		    cpus_share_cluster(recent_used_cpu, target))
+			return recent_used_cpu;
+	} else {
+		recent_used_cpu = -1;
 	}
 
 	/*
@@ -6513,6 +6942,15 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
 
+	/*
+	 * Nothing idle was found, the idle prev or recently used CPUs
+	 * outside the cluster of the target are still better than the target.
+	 */
+	if ((unsigned int)prev_aff < nr_cpumask_bits)
+		return prev_aff;
+	if ((unsigned int)recent_used_cpu < nr_cpumask_bits)
+		return recent_used_cpu;
+
 	return target;
 }
 
@@ -7076,6 +7514,10 @@ static unsigned long wakeup_gran(struct sched_entity *se)
 {
 	unsigned long gran = sysctl_sched_wakeup_granularity;
 
+	/* Tasks with a positive latency nice are slower to preempt */
+	if (entity_is_task(se) && task_of(se)->latency_nice > 0)
+		gran += gran * task_of(se)->latency_nice / MAX_LATENCY_NICE;
+
 	/*
 	 * Since its curr running now, convert the gran from real-time
 	 * to virtual-time in his units.
@@ -7219,6 +7661,10 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 		return;
 
 	update_curr(cfs_rq_of(se));
+	if (latency_sensitive(pse) &&
+	    latency_preempt_entity(cfs_rq_of(se), pse, se))
+		goto preempt;
+
 	if (wakeup_preempt_entity(se, pse) == 1) {
 		/*
 		 * Bias pick_next to pick the sched entity that is
@@ -7249,7 +7695,6 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 		set_last_buddy(se);
 }
 
-#ifdef CONFIG_SMP
 static struct task_struct *pick_task_fair(struct rq *rq)
 {
 	struct sched_entity *se;
@@ -7280,7 +7725,6 @@ static struct task_struct *pick_task_fair(struct rq *rq)
 
 	return task_of(se);
 }
-#endif
 
 struct task_struct *
 pick_next_task_fair(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
@@ -7431,6 +7875,31 @@ static struct task_struct *__pick_next_task_fair(struct rq *rq)
 	return pick_next_task_fair(rq, NULL, NULL);
 }
 
+/*
+ * The fair server guarantees fair tasks 50ms every second, as RT throttling
+ * used to by default, but only takes the CPU from RT tasks while fair ones
+ * are runnable and didn't already get that much.
+ */
+#define FAIR_SERVER_RUNTIME	(50 * NSEC_PER_MSEC)
+#define FAIR_SERVER_PERIOD	NSEC_PER_SEC
+
+static bool fair_server_has_tasks(struct sched_dl_entity *dl_se)
+{
+	return !!dl_se->rq->cfs.h_nr_running;
+}
+
+static struct task_struct *fair_server_pick(struct sched_dl_entity *dl_se)
+{
+	return pick_task_fair(dl_se->rq);
+}
+
+void fair_server_init(struct rq *rq)
+{
+	dl_server_init(&rq->fair_server, rq,
+		       FAIR_SERVER_RUNTIME, FAIR_SERVER_PERIOD,
+		       fair_server_has_tasks, fair_server_pick);
+}
+
 /*
  * Account for a descheduled task:
  */
@@ -7882,6 +8351,18 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 	if (tsk_cache_hot == -1)
 		tsk_cache_hot = task_hot(p, env);
 
+	/*
+	 * Going newly idle for a moment isn't worth pulling a cache hot task
+	 * away from its LLC; leave that to the periodic balance.
+	 */
+	if (tsk_cache_hot == 1 && env->idle == CPU_NEWLY_IDLE &&
+	    sched_feat(NEWIDLE_COST) &&
+	    !(env->sd->flags & SD_SHARE_PKG_RESOURCES)) {
+		schedstat_inc(env->sd->newidle_hot_skipped);
+		schedstat_inc(p->se.statistics.nr_failed_migrations_hot);
+		return 0;
+	}
+
 	if (tsk_cache_hot <= 0 ||
 	    env->sd->nr_balance_failed > env->sd->cache_nice_tries) {
 		if (tsk_cache_hot == 1) {
@@ -10305,6 +10786,12 @@ static void rebalance_domains(struct rq *rq, enum cpu_idle_type idle)
 		if (time_after(jiffies, sd->next_decay_max_lb_cost)) {
 			sd->max_newidle_lb_cost =
 				(sd->max_newidle_lb_cost * 253) / 256;
+			/*
+			 * Let a domain skipped for its poor success rate be
+			 * tried again eventually.
+			 */
+			sd->newidle_success +=
+				(NEWIDLE_SCALE - sd->newidle_success) / 8;
 			sd->next_decay_max_lb_cost = jiffies + HZ;
 			need_decay = 1;
 		}
@@ -10860,6 +11347,29 @@ static inline void nohz_newidle_balance(struct rq *this_rq) { }
  *     0 - failed, no new tasks
  *   > 0 - success, new (fair) tasks present
  */
+/*
+ * The expected cost of getting a task to run out of newidle balancing @sd:
+ * its average cost divided by the fraction of attempts that pulled a task.
+ */
+static u64 newidle_expected_cost(struct sched_domain *sd)
+{
+	unsigned int success = max(sd->newidle_success, NEWIDLE_SCALE / 16);
+
+	return div_u64(sd->avg_newidle_lb_cost * NEWIDLE_SCALE, success);
+}
+
+static void update_newidle_cost(struct sched_domain *sd, u64 cost, int pulled)
+{
+	s64 diff = cost - sd->avg_newidle_lb_cost;
+	int sample = pulled > 0 ? NEWIDLE_SCALE : 0;
+
+	if (cost > sd->max_newidle_lb_cost)
+		sd->max_newidle_lb_cost = cost;
+
+	sd->avg_newidle_lb_cost += diff / 8;
+	sd->newidle_success += (sample - (int)sd->newidle_success) / 8;
+}
+
 static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 {
 	unsigned long next_balance = jiffies + HZ;
@@ -10922,6 +11432,18 @@ static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 			break;
 		}
 
+		/*
+		 * The idle period isn't expected to pay for what it takes on
+		 * average to pull a task from this domain, nor from any of
+		 * the larger ones.
+		 */
+		if (sched_feat(NEWIDLE_COST) &&
+		    this_rq->avg_idle < curr_cost + newidle_expected_cost(sd)) {
+			schedstat_inc(sd->newidle_cost_skipped);
+			update_next_balance(sd, &next_balance);
+			break;
+		}
+
 		if (sd->flags & SD_BALANCE_NEWIDLE) {
 			t0 = sched_clock_cpu(this_cpu);
 
@@ -10930,8 +11452,7 @@ static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 						   &continue_balancing);
 
 			domain_cost = sched_clock_cpu(this_cpu) - t0;
-			if (domain_cost > sd->max_newidle_lb_cost)
-				sd->max_newidle_lb_cost = domain_cost;
+			update_newidle_cost(sd, domain_cost, pulled_task);
 
 			curr_cost += domain_cost;
 		}
@@ -11071,7 +11592,7 @@ static inline void task_tick_core(struct rq *rq, struct task_struct *curr)
 	 * MIN_NR_TASKS_DURING_FORCEIDLE - 1 tasks and use that to check
 	 * if we need to give up the CPU.
 	 */
-	if (rq->core->core_forceidle && rq->cfs.nr_running == 1 &&
+	if (rq->core->core_forceidle_count && rq->cfs.nr_running == 1 &&
 	    __entity_slice_used(&curr->se, MIN_NR_TASKS_DURING_FORCEIDLE))
 		resched_curr(rq);
 }
@@ -11412,6 +11933,7 @@ static void set_next_task_fair(struct rq *rq, struct task_struct *p, bool first)
 void init_cfs_rq(struct cfs_rq *cfs_rq)
 {
 	cfs_rq->tasks_timeline = RB_ROOT_CACHED;
+	cfs_rq->latency_timeline = RB_ROOT_CACHED;
 	cfs_rq->min_vruntime = (u64)(-(1LL << 20));
 #ifndef CONFIG_64BIT
 	cfs_rq->min_vruntime_copy = cfs_rq->min_vruntime;
@@ -58,6 +58,13 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_PROP, false)
 SCHED_FEAT(SIS_UTIL, true)
 
+/*
+ * Skip newidle balancing of a domain when the expected idle time doesn't
+ * cover its average cost per pulled task, and don't pull cache hot tasks
+ * across LLCs from it.
+ */
+SCHED_FEAT(NEWIDLE_COST, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
@@ -96,3 +103,9 @@ SCHED_FEAT(LATENCY_WARN, false)
 
 SCHED_FEAT(ALT_PERIOD, true)
 SCHED_FEAT(BASE_SLICE, true)
+
+/*
+ * Let tasks with a negative latency nice run ahead of the leftmost entity
+ * when they are eligible and due earlier.
+ */
+SCHED_FEAT(LATENCY_PICK, true)
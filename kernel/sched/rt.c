@@ -961,8 +961,17 @@ static inline int rt_se_prio(struct sched_rt_entity *rt_se)
 
 static int sched_rt_runtime_exceeded(struct rt_rq *rt_rq)
 {
+	struct rq *rq = rq_of_rt_rq(rt_rq);
 	u64 runtime = sched_rt_runtime(rt_rq);
 
+	/*
+	 * The fair server keeps fair tasks from starving, so the root rt_rq
+	 * needn't be throttled for their sake: RT tasks get all the time
+	 * fair tasks don't need instead of the CPU going idle.
+	 */
+	if (rt_rq == &rq->rt && rq->fair_server.dl_runtime)
+		return 0;
+
 	if (rt_rq->rt_throttled)
 		return rt_rq_throttled(rt_rq);
 
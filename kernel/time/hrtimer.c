@@ -40,6 +40,7 @@
 #include <linux/sched/debug.h>
 #include <linux/timer.h>
 #include <linux/freezer.h>
+#include <linux/jump_label.h>
 #include <linux/compat.h>
 
 #include <linux/uaccess.h>
@@ -678,9 +679,47 @@ static void __hrtimer_reprogram(struct hrtimer_cpu_base *cpu_base,
 	if (!__hrtimer_hres_active(cpu_base) || cpu_base->hang_detected)
 		return;
 
+	cpu_base->nr_reprograms++;
 	tick_program_event(expires_next, 1);
 }
 
+/*
+ * Coalescing of hrtimers with slack, enabled by default. Can be turned off
+ * with hrtimer_coalesce=off on the kernel command line.
+ */
+static DEFINE_STATIC_KEY_TRUE(hrtimer_coalesce);
+
+static int __init setup_hrtimer_coalesce(char *str)
+{
+	bool enable;
+
+	if (kstrtobool(str, &enable))
+		return 0;
+	if (!enable)
+		static_branch_disable(&hrtimer_coalesce);
+	return 1;
+}
+__setup("hrtimer_coalesce=", setup_hrtimer_coalesce);
+
+/*
+ * A timer with slack does not need the event device to be reprogrammed when
+ * the event it is already armed for (@armed, in the CLOCK_MONOTONIC time of
+ * the cpu base) falls in the [soft, hard] expiry range of the timer:
+ * __hrtimer_run_queues() expires the timer in the same batch as the timers
+ * the event is armed for. The soft expiry is taken in the time of the clock
+ * base of the timer.
+ */
+static inline bool hrtimer_coalesces(const struct hrtimer *timer, ktime_t armed)
+{
+	ktime_t soft;
+
+	if (!static_branch_likely(&hrtimer_coalesce) || armed == KTIME_MAX)
+		return false;
+
+	soft = ktime_sub(hrtimer_get_softexpires(timer), timer->base->offset);
+	return soft <= armed;
+}
+
 /*
  * Reprogram the event source with checking both queues for the
  * next event
@@ -836,6 +875,12 @@ static void hrtimer_reprogram(struct hrtimer *timer, bool reprogram)
 		if (!ktime_before(expires, timer_cpu_base->softirq_expires_next))
 			return;
 
+		/* The pending soft expiry takes care of the timer as well */
+		if (hrtimer_coalesces(timer, timer_cpu_base->softirq_expires_next)) {
+			timer_cpu_base->nr_coalesced++;
+			return;
+		}
+
 		timer_cpu_base->softirq_next_timer = timer;
 		timer_cpu_base->softirq_expires_next = expires;
 
@@ -861,6 +906,15 @@ static void hrtimer_reprogram(struct hrtimer *timer, bool reprogram)
 	if (cpu_base->in_hrtirq)
 		return;
 
+	/*
+	 * The armed event expires the timer within its slack. next_timer
+	 * stays the timer the device is armed for.
+	 */
+	if (hrtimer_coalesces(timer, cpu_base->expires_next)) {
+		cpu_base->nr_coalesced++;
+		return;
+	}
+
 	cpu_base->next_timer = timer;
 
 	__hrtimer_reprogram(cpu_base, timer, expires);
@@ -1652,6 +1706,7 @@ static void __run_hrtimer(struct hrtimer_cpu_base *cpu_base,
 
 	debug_deactivate(timer);
 	base->running = timer;
+	cpu_base->nr_expired++;
 
 	/*
 	 * Separate the ->running assignment from the ->state assignment.
@@ -1821,6 +1876,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 	raw_spin_unlock_irqrestore(&cpu_base->lock, flags);
 
 	/* Reprogramming necessary ? */
+	cpu_base->nr_reprograms++;
 	if (!tick_program_event(expires_next, 0)) {
 		cpu_base->hang_detected = 0;
 		return;
@@ -1865,6 +1921,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 		expires_next = ktime_add_ns(now, 100 * NSEC_PER_MSEC);
 	else
 		expires_next = ktime_add(now, delta);
+	cpu_base->nr_reprograms++;
 	tick_program_event(expires_next, 1);
 	pr_warn_once("hrtimer: interrupt took %llu ns\n", ktime_to_ns(delta));
 }
@@ -0,0 +1,550 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Infrastructure for migrating the global timers of idle CPUs
+ *
+ * Non pinned timers are queued on the global timer base of the local CPU.
+ * When a CPU goes idle for more than a tick, it hands the first expiry of
+ * its global base over to a hierarchy of groups instead of waking up for
+ * it, and one active CPU per group, the migrator, expires the global timers
+ * of the idle CPUs of the group on their behalf.
+ *
+ * The level 0 groups hold up to TMIGR_CHILDREN_PER_GROUP CPUs of the same
+ * node, and each upper level groups up to TMIGR_CHILDREN_PER_GROUP groups of
+ * the level below, up to a single top level group:
+ *
+ *	LVL 1			[GRP1:0]
+ *				/      \
+ *	LVL 0		[GRP0:0]	[GRP0:1]
+ *			 /    \		 /    \
+ *	CPUs		0      1	2      3
+ *
+ * While at least one child of a group is active, the group is active and
+ * one of its active children is its migrator, which expires the events
+ * queued in the group by its idle children. Once the last child of a group
+ * goes idle, the group goes idle in its parent and queues its first event
+ * there, so that the migrator of the parent takes care of it. When the top
+ * level group goes idle, the CPU which was the last to go idle has to wake
+ * up for the first event of the whole hierarchy itself.
+ *
+ * All the state is protected by the locks of the groups and CPUs, which
+ * nest bottom up: tmigr_cpu::lock, then the group locks from level 0 up.
+ * The timer base locks of a CPU nest outside of its tmigr_cpu::lock.
+ *
+ * CPUs which are isolated with nohz_full don't take part in the hierarchy,
+ * they keep expiring their global timers themselves.
+ */
+
+#include <linux/cpuhotplug.h>
+#include <linux/cpumask.h>
+#include <linux/sched/nohz.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+#include <linux/timerqueue.h>
+#include <linux/topology.h>
+
+#include "tick-internal.h"
+#include "timer_migration.h"
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+static void tmigr_update_next(struct tmigr_group *group)
+{
+	struct timerqueue_node *node = timerqueue_getnext(&group->events);
+
+	WRITE_ONCE(group->next_expiry, node ? node->expires : KTIME_MAX);
+}
+
+/* (Re)queue @evt expiring at @expires in @group, caller holds group->lock */
+static void tmigr_queue_event(struct tmigr_group *group,
+			      struct tmigr_event *evt, u64 expires)
+{
+	if (timerqueue_node_queued(&evt->nextevt))
+		timerqueue_del(&group->events, &evt->nextevt);
+
+	evt->nextevt.expires = expires;
+	if (expires != KTIME_MAX)
+		timerqueue_add(&group->events, &evt->nextevt);
+
+	tmigr_update_next(group);
+}
+
+static void tmigr_dequeue_event(struct tmigr_group *group,
+				struct tmigr_event *evt)
+{
+	if (timerqueue_node_queued(&evt->nextevt)) {
+		timerqueue_del(&group->events, &evt->nextevt);
+		tmigr_update_next(group);
+	}
+}
+
+/*
+ * Mark the child @childmask of @group idle and queue its event @evt
+ * expiring at @expires, then propagate the change up the hierarchy as long
+ * as the groups on the way are idle. A @childmask of 0 only updates the
+ * event of a child which is idle already.
+ *
+ * If @child is not NULL, it is the locked child of @group owning @evt, and
+ * it is unlocked once @group is locked. Returns with all the group locks
+ * released.
+ *
+ * Returns the expiry of the first event of the hierarchy if the top level
+ * group is idle, KTIME_MAX otherwise.
+ */
+static u64 tmigr_inactive_up(struct tmigr_group *group,
+			     struct tmigr_group *child, u8 childmask,
+			     struct tmigr_event *evt, u64 expires)
+{
+	u64 firstexp = KTIME_MAX;
+
+	for (;;) {
+		raw_spin_lock_nested(&group->lock, group->level);
+		if (child)
+			raw_spin_unlock(&child->lock);
+
+		group->active &= ~childmask;
+		tmigr_queue_event(group, evt, expires);
+
+		if (group->active) {
+			/* Hand the migrator duty over to another active child */
+			if (group->migrator == childmask)
+				group->migrator = group->active & -group->active;
+			break;
+		}
+
+		group->migrator = TMIGR_NONE;
+		if (!group->parent) {
+			firstexp = group->next_expiry;
+			break;
+		}
+
+		/* The whole group is idle, its parent takes over */
+		childmask = group->childmask;
+		evt = &group->groupevt;
+		expires = group->next_expiry;
+		child = group;
+		group = group->parent;
+	}
+	raw_spin_unlock(&group->lock);
+
+	return firstexp;
+}
+
+/*
+ * Mark the child @childmask of @group active and remove its event @evt,
+ * then propagate the change up the hierarchy as long as the groups on the
+ * way were idle.
+ */
+static void tmigr_active_up(struct tmigr_group *group, u8 childmask,
+			    struct tmigr_event *evt)
+{
+	struct tmigr_group *child = NULL;
+	u8 was_active;
+
+	for (;;) {
+		raw_spin_lock_nested(&group->lock, group->level);
+		if (child)
+			raw_spin_unlock(&child->lock);
+
+		was_active = group->active;
+		group->active |= childmask;
+		tmigr_dequeue_event(group, evt);
+		if (group->migrator == TMIGR_NONE)
+			group->migrator = childmask;
+
+		if (was_active || !group->parent)
+			break;
+
+		/* The group was idle, it is active in its parent now */
+		childmask = group->childmask;
+		evt = &group->groupevt;
+		child = group;
+		group = group->parent;
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers back from the hierarchy
+ *
+ * Called with interrupts disabled when the CPU leaves idle.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/* Only the CPU itself changes these, no need for the lock */
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	raw_spin_lock(&tmc->lock);
+	tmc->idle = false;
+	WRITE_ONCE(tmc->wakeup, KTIME_MAX);
+	tmigr_active_up(tmc->tmgroup, tmc->childmask, &tmc->cpuevt);
+	raw_spin_unlock(&tmc->lock);
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers over to the hierarchy
+ * @nextexp:	tick aligned clock monotonic time of the first global timer
+ *		of the CPU, or KTIME_MAX
+ *
+ * Called with interrupts disabled and the timer base locks held, when the
+ * CPU is about to sleep for more than a tick. Can be called again while the
+ * CPU is idle to update @nextexp.
+ *
+ * Returns the time at which the CPU has to wake up to expire global timers,
+ * either its own ones when it doesn't take part in the hierarchy, or the
+ * first event of the hierarchy when everything else is idle. KTIME_MAX if
+ * another CPU takes care of them.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 wakeup;
+
+	if (!tmc->online)
+		return nextexp;
+
+	raw_spin_lock(&tmc->lock);
+	tmc->idle = true;
+	wakeup = tmigr_inactive_up(tmc->tmgroup, NULL, tmc->childmask,
+				   &tmc->cpuevt, nextexp);
+	WRITE_ONCE(tmc->wakeup, wakeup);
+	raw_spin_unlock(&tmc->lock);
+
+	return wakeup;
+}
+
+/*
+ * Whether the child @childmask has to expire the events of @group: it is
+ * the migrator of the group, or the whole group is idle and a CPU below
+ * woke up to take care of the first event of the hierarchy.
+ */
+static bool tmigr_check_migrator(struct tmigr_group *group, u8 childmask)
+{
+	u8 migrator = READ_ONCE(group->migrator);
+
+	return migrator == childmask || migrator == TMIGR_NONE;
+}
+
+static void tmigr_handle_cpu(unsigned int cpu, unsigned long jif, u64 now)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	u64 next;
+
+	raw_spin_lock_irq(&tmc->lock);
+	/* Back from idle, the CPU expires its global timers itself */
+	if (!tmc->online || !tmc->idle || tmc->remote) {
+		raw_spin_unlock_irq(&tmc->lock);
+		return;
+	}
+	tmc->remote = true;
+	raw_spin_unlock_irq(&tmc->lock);
+
+	timer_expire_remote(cpu);
+
+	/*
+	 * If somebody else was expiring the base, don't spin on the timers
+	 * which are still pending, look again on the next tick.
+	 */
+	next = timer_next_global_event(cpu, jif, now);
+	if (next <= now)
+		next = now + TICK_NSEC;
+
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->remote = false;
+	/* Requeue unless the CPU woke up or updated its event meanwhile */
+	if (tmc->online && tmc->idle &&
+	    !timerqueue_node_queued(&tmc->cpuevt.nextevt))
+		tmigr_inactive_up(tmc->tmgroup, NULL, 0, &tmc->cpuevt, next);
+	raw_spin_unlock_irq(&tmc->lock);
+}
+
+/* Queue the first event of the idle group @child in its parent again */
+static void tmigr_requeue_group(struct tmigr_group *child)
+{
+	local_irq_disable();
+	raw_spin_lock_nested(&child->lock, child->level);
+
+	if (child->active || timerqueue_node_queued(&child->groupevt.nextevt)) {
+		raw_spin_unlock(&child->lock);
+	} else {
+		tmigr_inactive_up(child->parent, child, 0, &child->groupevt,
+				  child->next_expiry);
+	}
+
+	local_irq_enable();
+}
+
+/*
+ * Expire the events of @group which are due at @now. The events of idle
+ * child groups are handled recursively, the depth of the hierarchy is
+ * bounded by the number of levels.
+ */
+static void tmigr_handle_group(struct tmigr_group *group, unsigned long jif,
+			       u64 now)
+{
+	struct timerqueue_node *node;
+	struct tmigr_event *evt;
+
+	raw_spin_lock_irq(&group->lock);
+	while ((node = timerqueue_getnext(&group->events)) &&
+	       node->expires <= now) {
+		evt = container_of(node, struct tmigr_event, nextevt);
+		timerqueue_del(&group->events, node);
+		tmigr_update_next(group);
+		raw_spin_unlock_irq(&group->lock);
+
+		if (evt->child) {
+			tmigr_handle_group(evt->child, jif, now);
+			tmigr_requeue_group(evt->child);
+		} else {
+			tmigr_handle_cpu(evt->cpu, jif, now);
+		}
+
+		raw_spin_lock_irq(&group->lock);
+	}
+	raw_spin_unlock_irq(&group->lock);
+}
+
+/**
+ * tmigr_handle_remote - expire the global timers of idle CPUs
+ *
+ * Called from the timer softirq, walks up the groups this CPU is the
+ * migrator of and expires their due events.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group;
+	unsigned long jif;
+	u8 childmask;
+	u64 now;
+
+	if (!tmc->online)
+		return;
+
+	now = get_jiffies_update(&jif);
+
+	childmask = tmc->childmask;
+	for (group = tmc->tmgroup; group; group = group->parent) {
+		if (!tmigr_check_migrator(group, childmask))
+			break;
+		tmigr_handle_group(group, jif, now);
+		childmask = group->childmask;
+	}
+
+	/* The first event is handled, don't chase it on every tick */
+	if (READ_ONCE(tmc->wakeup) != KTIME_MAX) {
+		raw_spin_lock_irq(&tmc->lock);
+		tmc->wakeup = KTIME_MAX;
+		raw_spin_unlock_irq(&tmc->lock);
+	}
+}
+
+/**
+ * tmigr_requires_handle_remote - check whether remote timers are due
+ *
+ * Called from the tick with interrupts disabled. Returns true if this CPU
+ * has to expire the global timers of idle CPUs, see tmigr_handle_remote().
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group;
+	unsigned long jif;
+	u8 childmask;
+	u64 now;
+
+	if (!tmc->online)
+		return false;
+
+	now = get_jiffies_update(&jif);
+
+	/* An idle CPU only woke up for the first event of the hierarchy */
+	if (tmc->idle)
+		return READ_ONCE(tmc->wakeup) <= now;
+
+	childmask = tmc->childmask;
+	for (group = tmc->tmgroup; group; group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		if (READ_ONCE(group->next_expiry) <= now)
+			return true;
+		childmask = group->childmask;
+	}
+
+	return false;
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/* Isolated CPUs don't tick, they can't be migrators */
+	if (tick_nohz_full_cpu(cpu) || WARN_ON_ONCE(!tmc->tmgroup))
+		return 0;
+
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->online = true;
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+	tmigr_active_up(tmc->tmgroup, tmc->childmask, &tmc->cpuevt);
+	raw_spin_unlock_irq(&tmc->lock);
+
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 firstexp;
+
+	if (!tmc->online)
+		return 0;
+
+	/*
+	 * The timers of the outgoing CPU are migrated to another CPU later,
+	 * so just leave the hierarchy without an event.
+	 */
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->online = false;
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+	firstexp = tmigr_inactive_up(tmc->tmgroup, NULL, tmc->childmask,
+				     &tmc->cpuevt, KTIME_MAX);
+	raw_spin_unlock_irq(&tmc->lock);
+
+	/*
+	 * This was the last active CPU of the hierarchy. Kick another one out
+	 * of idle so that it becomes the migrator.
+	 */
+	if (firstexp != KTIME_MAX)
+		wake_up_nohz_cpu(cpumask_any_but(cpu_online_mask, cpu));
+
+	return 0;
+}
+
+static struct tmigr_group * __init tmigr_alloc_group(unsigned int level,
+						     int node)
+{
+	struct tmigr_group *group;
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return NULL;
+
+	raw_spin_lock_init(&group->lock);
+	timerqueue_init_head(&group->events);
+	timerqueue_init(&group->groupevt.nextevt);
+	group->groupevt.child = group;
+	group->next_expiry = KTIME_MAX;
+	group->migrator = TMIGR_NONE;
+	group->level = level;
+
+	return group;
+}
+
+static int __init tmigr_build_hierarchy(void)
+{
+	struct tmigr_group **groups, *group, *child;
+	unsigned int nr_groups = 0, nr_parents, level = 0, i;
+	int cpu, sibling, node;
+
+	groups = kcalloc(nr_cpu_ids, sizeof(*groups), GFP_KERNEL);
+	if (!groups)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		raw_spin_lock_init(&tmc->lock);
+		timerqueue_init(&tmc->cpuevt.nextevt);
+		tmc->cpuevt.cpu = cpu;
+		tmc->wakeup = KTIME_MAX;
+	}
+
+	/* Level 0: group the CPUs of the same node together */
+	for_each_possible_cpu(cpu) {
+		if (per_cpu(tmigr_cpu, cpu).tmgroup)
+			continue;
+
+		node = cpu_to_node(cpu);
+		group = NULL;
+		for (sibling = cpu; sibling < nr_cpu_ids;
+		     sibling = cpumask_next(sibling, cpu_possible_mask)) {
+			struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, sibling);
+
+			if (tmc->tmgroup || cpu_to_node(sibling) != node)
+				continue;
+
+			if (!group || group->num_children == TMIGR_CHILDREN_PER_GROUP) {
+				group = tmigr_alloc_group(0, node);
+				if (!group)
+					goto err;
+				groups[nr_groups++] = group;
+			}
+			tmc->tmgroup = group;
+			tmc->childmask = BIT(group->num_children++);
+		}
+	}
+
+	/* Upper levels, until a single top level group is left */
+	while (nr_groups > 1) {
+		level++;
+		nr_parents = 0;
+		group = NULL;
+
+		for (i = 0; i < nr_groups; i++) {
+			child = groups[i];
+			if (i % TMIGR_CHILDREN_PER_GROUP == 0) {
+				group = tmigr_alloc_group(level, NUMA_NO_NODE);
+				if (!group)
+					goto err;
+				groups[nr_parents++] = group;
+			}
+			child->parent = group;
+			child->childmask = BIT(group->num_children++);
+		}
+		nr_groups = nr_parents;
+	}
+
+	kfree(groups);
+	return 0;
+
+err:
+	/* Leave the partial hierarchy alone, nobody takes part in it */
+	for_each_possible_cpu(cpu)
+		per_cpu(tmigr_cpu, cpu).tmgroup = NULL;
+	kfree(groups);
+	return -ENOMEM;
+}
+
+static int __init tmigr_init(void)
+{
+	int ret;
+
+	BUILD_BUG_ON(TMIGR_CHILDREN_PER_GROUP > BITS_PER_BYTE);
+
+	/* Nothing to migrate the timers to */
+	if (num_possible_cpus() == 1)
+		return 0;
+
+	ret = tmigr_build_hierarchy();
+	if (ret)
+		goto err;
+
+	ret = cpuhp_setup_state(CPUHP_AP_TMIGR_ONLINE, "tmigr:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret)
+		goto err;
+
+	return 0;
+
+err:
+	pr_err("Timer migration setup failed\n");
+	return ret;
+}
+early_initcall(tmigr_init);
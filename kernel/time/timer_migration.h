@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+#include <linux/timerqueue.h>
+
+/* Per group capacity, the child masks are u8 */
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/* Value of tmigr_group::migrator when all the children of a group are idle */
+#define TMIGR_NONE			0
+
+/**
+ * struct tmigr_event - a timer event handed over to the hierarchy
+ * @nextevt:	timerqueue node, its expires field is the tick aligned clock
+ *		monotonic time of the first global timer of the owner
+ * @child:	the group owning the event, NULL for the event of a CPU
+ * @cpu:	the CPU owning the event, unused for a group event
+ */
+struct tmigr_event {
+	struct timerqueue_node	nextevt;
+	struct tmigr_group	*child;
+	unsigned int		cpu;
+};
+
+/**
+ * struct tmigr_group - a group of the timer migration hierarchy
+ * @lock:	protects the fields below and the events queued in @events
+ * @parent:	the parent group, NULL for the top level group
+ * @groupevt:	the first event of @events, queued in the parent while all
+ *		the children of the group are idle
+ * @events:	the events of the idle children
+ * @next_expiry: expiry of the first event of @events or KTIME_MAX, can be
+ *		read locklessly
+ * @active:	mask of the active children
+ * @migrator:	mask of the child which expires @events, TMIGR_NONE if all
+ *		the children are idle
+ * @childmask:	bit of the group in the masks of @parent
+ * @level:	level of the group, 0 for the groups of CPUs
+ * @num_children: number of children of the group
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	struct tmigr_event	groupevt;
+	struct timerqueue_head	events;
+	u64			next_expiry;
+	u8			active;
+	u8			migrator;
+	u8			childmask;
+	unsigned int		level;
+	unsigned int		num_children;
+};
+
+/**
+ * struct tmigr_cpu - per CPU state of the timer migration hierarchy
+ * @lock:	protects the fields below
+ * @online:	the CPU takes part in the hierarchy
+ * @idle:	the CPU is idle and handed its global timers to the hierarchy
+ * @remote:	the global timers of the CPU are being expired remotely
+ * @childmask:	bit of the CPU in the masks of @tmgroup
+ * @tmgroup:	the level 0 group of the CPU
+ * @wakeup:	while idle, the expiry of the first event of the whole
+ *		hierarchy if this CPU has to handle it, KTIME_MAX otherwise
+ * @cpuevt:	the event of the CPU, queued in @tmgroup while it is idle
+ */
+struct tmigr_cpu {
+	raw_spinlock_t		lock;
+	bool			online;
+	bool			idle;
+	bool			remote;
+	u8			childmask;
+	struct tmigr_group	*tmgroup;
+	u64			wakeup;
+	struct tmigr_event	cpuevt;
+};
+
+#endif
@@ -17,6 +17,9 @@
 #include <linux/error-injection.h>
 #include <linux/btf_ids.h>
 #include <linux/bpf_lsm.h>
+#include <linux/bsearch.h>
+#include <linux/sort.h>
+#include <linux/kallsyms.h>
 
 #include <net/bpf_sk_storage.h>
 
@@ -990,6 +993,20 @@ static const struct bpf_func_proto bpf_get_func_ip_proto_kprobe = {
 	.arg1_type	= ARG_PTR_TO_CTX,
 };
 
+static u64 bpf_kprobe_multi_entry_ip(struct bpf_run_ctx *ctx);
+
+BPF_CALL_1(bpf_get_func_ip_kprobe_multi, struct pt_regs *, regs)
+{
+	return bpf_kprobe_multi_entry_ip(current->bpf_ctx);
+}
+
+static const struct bpf_func_proto bpf_get_func_ip_proto_kprobe_multi = {
+	.func		= bpf_get_func_ip_kprobe_multi,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+};
+
 BPF_CALL_1(bpf_get_attach_cookie_trace, void *, ctx)
 {
 	struct bpf_trace_run_ctx *run_ctx;
@@ -1147,11 +1164,19 @@ kprobe_prog_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_get_stack_proto;
 #ifdef CONFIG_BPF_KPROBE_OVERRIDE
 	case BPF_FUNC_override_return:
+		/* the ftrace_ops of a multi link don't modify the ip */
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return NULL;
 		return &bpf_override_return_proto;
 #endif
 	case BPF_FUNC_get_func_ip:
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return &bpf_get_func_ip_proto_kprobe_multi;
 		return &bpf_get_func_ip_proto_kprobe;
 	case BPF_FUNC_get_attach_cookie:
+		/* there is no cookie per attach point on a multi link */
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return NULL;
 		return &bpf_get_attach_cookie_proto_trace;
 	default:
 		return bpf_tracing_func_proto(func_id, prog);
@@ -1726,6 +1751,10 @@ int perf_event_attach_bpf_prog(struct perf_event *event,
 	struct bpf_prog_array *new_array;
 	int ret = -EEXIST;
 
+	/* those are only run through a kprobe multi link */
+	if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
 	/*
 	 * Kprobe override only works if they are on the function entry,
 	 * and only if they are on the opt-in list.
@@ -2053,3 +2082,285 @@ static int __init bpf_event_init(void)
 
 fs_initcall(bpf_event_init);
 #endif /* CONFIG_MODULES */
+
+#ifdef CONFIG_DYNAMIC_FTRACE_WITH_REGS
+#define MAX_KPROBE_MULTI_CNT	(1U << 20)
+
+/*
+ * A kprobe multi link attaches its program to all of its functions through
+ * a single ftrace_ops, rather than through a kprobe and a perf event each.
+ */
+struct bpf_kprobe_multi_link {
+	struct bpf_link link;
+	struct ftrace_ops ops;
+	u32 cnt;
+};
+
+struct bpf_kprobe_multi_run_ctx {
+	struct bpf_run_ctx run_ctx;
+	unsigned long entry_ip;
+};
+
+static void bpf_kprobe_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	unregister_ftrace_function(&kmulti_link->ops);
+	ftrace_free_filter(&kmulti_link->ops);
+}
+
+static void bpf_kprobe_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	kfree(kmulti_link);
+}
+
+static void bpf_kprobe_multi_link_show_fdinfo(const struct bpf_link *link,
+					      struct seq_file *seq)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	seq_printf(seq, "func_cnt:\t%u\n", kmulti_link->cnt);
+}
+
+static const struct bpf_link_ops bpf_kprobe_multi_link_lops = {
+	.release = bpf_kprobe_multi_link_release,
+	.dealloc = bpf_kprobe_multi_link_dealloc,
+	.show_fdinfo = bpf_kprobe_multi_link_show_fdinfo,
+};
+
+static u64 bpf_kprobe_multi_entry_ip(struct bpf_run_ctx *ctx)
+{
+	struct bpf_kprobe_multi_run_ctx *run_ctx;
+
+	run_ctx = container_of(ctx, struct bpf_kprobe_multi_run_ctx, run_ctx);
+	return run_ctx->entry_ip;
+}
+
+static void kprobe_multi_link_handler(unsigned long ip, unsigned long parent_ip,
+				      struct ftrace_ops *ops,
+				      struct ftrace_regs *fregs)
+{
+	struct bpf_kprobe_multi_run_ctx run_ctx = { .entry_ip = ip };
+	struct bpf_kprobe_multi_link *link;
+	struct bpf_run_ctx *old_run_ctx;
+	struct pt_regs *regs;
+	int bit;
+
+	bit = ftrace_test_recursion_trylock(ip, parent_ip);
+	if (bit < 0)
+		return;
+
+	regs = ftrace_get_regs(fregs);
+	if (WARN_ON_ONCE(!regs))
+		goto out_unlock;
+
+	link = container_of(ops, struct bpf_kprobe_multi_link, ops);
+
+	preempt_disable_notrace();
+	/* same as trace_call_bpf(), don't nest into another program */
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		goto out;
+
+	migrate_disable();
+	rcu_read_lock();
+	old_run_ctx = bpf_set_run_ctx(&run_ctx.run_ctx);
+	bpf_prog_run(link->link.prog, regs);
+	bpf_reset_run_ctx(old_run_ctx);
+	rcu_read_unlock();
+	migrate_enable();
+out:
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable_notrace();
+out_unlock:
+	ftrace_test_recursion_unlock(bit);
+}
+
+static int symbols_cmp(const void *a, const void *b)
+{
+	const char **str_a = (const char **) a;
+	const char **str_b = (const char **) b;
+
+	return strcmp(*str_a, *str_b);
+}
+
+struct kprobe_multi_resolve {
+	const char **syms;
+	unsigned long *addrs;
+	u32 cnt;
+	u32 found;
+};
+
+static int kprobe_multi_resolve_cb(void *data, const char *name,
+				   struct module *mod, unsigned long addr)
+{
+	struct kprobe_multi_resolve *res = data;
+	const char **sym;
+	unsigned long *slot;
+
+	sym = bsearch(&name, res->syms, res->cnt, sizeof(*res->syms),
+		      symbols_cmp);
+	if (!sym)
+		return 0;
+
+	/* there can be several symbols with that name, take the first one */
+	slot = &res->addrs[sym - res->syms];
+	if (*slot)
+		return 0;
+
+	*slot = addr;
+	return ++res->found == res->cnt;
+}
+
+/*
+ * Copy the @cnt symbol names at @usyms from user space and look them up in
+ * vmlinux. The addresses end up in @addrs, in name order.
+ */
+static int kprobe_multi_resolve_syms(const void __user *usyms, u32 cnt,
+				     unsigned long *addrs)
+{
+	struct kprobe_multi_resolve res = {
+		.addrs	= addrs,
+		.cnt	= cnt,
+	};
+	char buf[KSYM_NAME_LEN];
+	unsigned long usymbol;
+	const char **syms;
+	int err = -ENOMEM;
+	u32 i;
+
+	syms = kvcalloc(cnt, sizeof(*syms), GFP_KERNEL);
+	if (!syms)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		if (get_user(usymbol, (unsigned long __user *)usyms + i)) {
+			err = -EFAULT;
+			goto out;
+		}
+		err = strncpy_from_user(buf, (const char __user *)usymbol,
+					KSYM_NAME_LEN);
+		if (err == KSYM_NAME_LEN)
+			err = -E2BIG;
+		if (err < 0)
+			goto out;
+		syms[i] = kstrdup(buf, GFP_KERNEL);
+		if (!syms[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+		cond_resched();
+	}
+
+	sort(syms, cnt, sizeof(*syms), symbols_cmp, NULL);
+	for (i = 1; i < cnt; i++) {
+		if (!strcmp(syms[i - 1], syms[i])) {
+			err = -EINVAL;
+			goto out;
+		}
+	}
+
+	res.syms = syms;
+	kallsyms_on_each_symbol(kprobe_multi_resolve_cb, &res);
+	err = res.found == cnt ? 0 : -ENOENT;
+out:
+	for (i = 0; i < cnt; i++)
+		kfree(syms[i]);
+	kvfree(syms);
+	return err;
+}
+
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	struct bpf_kprobe_multi_link *link = NULL;
+	struct bpf_link_primer link_primer;
+	void __user *uaddrs, *usyms;
+	unsigned long *addrs;
+	u32 cnt;
+	int err;
+
+	/* addresses and symbol pointers are passed as u64 */
+	if (sizeof(u64) != sizeof(void *))
+		return -EOPNOTSUPP;
+
+	if (prog->expected_attach_type != BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
+	if (attr->link_create.kprobe_multi.flags)
+		return -EINVAL;
+
+	uaddrs = u64_to_user_ptr(attr->link_create.kprobe_multi.addrs);
+	usyms = u64_to_user_ptr(attr->link_create.kprobe_multi.syms);
+	if (!!uaddrs == !!usyms)
+		return -EINVAL;
+
+	cnt = attr->link_create.kprobe_multi.cnt;
+	if (!cnt)
+		return -EINVAL;
+	if (cnt > MAX_KPROBE_MULTI_CNT)
+		return -E2BIG;
+
+	addrs = kvcalloc(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return -ENOMEM;
+
+	if (uaddrs) {
+		if (copy_from_user(addrs, uaddrs, sizeof(*addrs) * cnt)) {
+			err = -EFAULT;
+			goto error;
+		}
+	} else {
+		err = kprobe_multi_resolve_syms(usyms, cnt, addrs);
+		if (err)
+			goto error;
+	}
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	bpf_link_init(&link->link, BPF_LINK_TYPE_KPROBE_MULTI,
+		      &bpf_kprobe_multi_link_lops, prog);
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err)
+		goto error;
+
+	link->ops.func = kprobe_multi_link_handler;
+	link->ops.flags = FTRACE_OPS_FL_SAVE_REGS;
+	link->cnt = cnt;
+
+	/* the filter hash keeps its own copy of the addresses */
+	err = ftrace_set_filter_ips(&link->ops, addrs, cnt, 0, 0);
+	kvfree(addrs);
+	if (!err)
+		err = register_ftrace_function(&link->ops);
+	if (err) {
+		ftrace_free_filter(&link->ops);
+		bpf_link_cleanup(&link_primer);
+		return err;
+	}
+
+	return bpf_link_settle(&link_primer);
+
+error:
+	kfree(link);
+	kvfree(addrs);
+	return err;
+}
+#else /* !CONFIG_DYNAMIC_FTRACE_WITH_REGS */
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
+static u64 bpf_kprobe_multi_entry_ip(struct bpf_run_ctx *ctx)
+{
+	return 0;
+}
+#endif
@@ -26,8 +26,12 @@
 #include <linux/list.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/mm.h>
+
+#include <uapi/linux/trace_mmap.h>
 
 #include <asm/local.h>
+#include <asm/cacheflush.h>
 
 static void update_pages_handler(struct work_struct *work);
 
@@ -323,6 +327,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* ID in a user space mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -527,6 +532,15 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/*
+	 * User space mappings, counted under buffer->mutex. Going from
+	 * none to mapped and back also takes the reader_lock. The pages
+	 * are neither swapped out to readers nor resized while mapped.
+	 */
+	unsigned int			mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* ID to data page */
 };
 
 struct trace_buffer {
@@ -2166,7 +2180,8 @@ int ring_buffer_resize(struct trace_buffer *buffer, unsigned long size,
 		 */
 		for_each_buffer_cpu(buffer, cpu) {
 			cpu_buffer = buffer->buffers[cpu];
-			if (atomic_read(&cpu_buffer->resize_disabled)) {
+			if (atomic_read(&cpu_buffer->resize_disabled) ||
+			    cpu_buffer->mapped) {
 				err = -EBUSY;
 				goto out_err_unlock;
 			}
@@ -2240,7 +2255,8 @@ int ring_buffer_resize(struct trace_buffer *buffer, unsigned long size,
 		 * manipulating the ring buffer and is expecting a sane state while
 		 * this is true.
 		 */
-		if (atomic_read(&cpu_buffer->resize_disabled)) {
+		if (atomic_read(&cpu_buffer->resize_disabled) ||
+		    cpu_buffer->mapped) {
 			err = -EBUSY;
 			goto out_err_unlock;
 		}
@@ -5457,6 +5473,11 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* user space would be left looking at the other buffer */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -5676,12 +5697,14 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page, or
+	 * the page is mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -5694,7 +5717,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 		 * the reader page.
 		 */
 		if (full &&
-		    (!read || (len < (commit - read)) ||
+		    ((!read && !cpu_buffer->mapped) || (len < (commit - read)) ||
 		     cpu_buffer->reader_page == cpu_buffer->commit_page))
 			goto out_unlock;
 
@@ -5798,6 +5821,290 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				unsigned int read)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = read;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs don't keep the kernel and user views coherent */
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+	flush_dcache_page(virt_to_page(meta));
+}
+
+/* Give IDs to the reader page and then to the ring's, from the head on */
+static int rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				  struct trace_buffer_meta *meta,
+				  unsigned long *subbuf_ids)
+{
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	struct buffer_page *first, *bpage;
+	unsigned int id = 0;
+
+	first = rb_set_head_page(cpu_buffer);
+	if (!first)
+		return -EIO;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	bpage = first;
+	do {
+		if (RB_WARN_ON(cpu_buffer, id >= nr_subbufs))
+			return -EIO;
+		subbuf_ids[id] = (unsigned long)bpage->page;
+		bpage->id = id++;
+		rb_inc_page(&bpage);
+	} while (bpage != first);
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = nr_subbufs;
+
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	rb_update_meta_page(cpu_buffer, cpu_buffer->reader_page->read);
+
+	return 0;
+}
+
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_subbufs = cpu_buffer->nr_pages + 1;
+	unsigned long nr_pages = vma_pages(vma);
+	unsigned long pgoff = vma->vm_pgoff;
+	unsigned long i, nr_inserted;
+	struct page **pages;
+	int err;
+
+	/* The writer owns the pages, user space only gets to look */
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	/* The meta page, then the sub-buffers in ID order */
+	if (!nr_pages || pgoff + nr_pages > nr_subbufs + 1)
+		return -EINVAL;
+
+	pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_pages; i++, pgoff++) {
+		if (!pgoff)
+			pages[i] = virt_to_page(cpu_buffer->meta_page);
+		else
+			pages[i] = virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff - 1]);
+	}
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	nr_inserted = nr_pages;
+	err = vm_insert_pages(vma, vma->vm_start, pages, &nr_inserted);
+	kfree(pages);
+
+	return err;
+}
+
+/**
+ * ring_buffer_map - map a per CPU buffer into user space
+ * @buffer: the buffer to map
+ * @cpu: the CPU buffer to map
+ * @vma: the vma to map it into
+ *
+ * Maps the meta page and the data pages of the @cpu buffer into @vma,
+ * read-only, see <uapi/linux/trace_mmap.h> for the layout. As long as
+ * the buffer is mapped it can't be resized or swapped, and the data pages
+ * are copied rather than handed out to ring_buffer_read_page() callers.
+ *
+ * Returns 0 on success or a negative error.
+ */
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int err;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		err = __rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		goto out;
+	}
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!meta || !subbuf_ids) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	/* From now on the reader page stays in place */
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	err = rb_setup_ids_meta_page(cpu_buffer, meta, subbuf_ids);
+	if (!err)
+		cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+	if (err)
+		goto out_free;
+
+	err = __rb_map_vma(cpu_buffer, vma);
+	if (!err)
+		goto out;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+ out_free:
+	kfree(subbuf_ids);
+	free_page((unsigned long)meta);
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of a mapping
+ * @buffer: the mapped buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * For a vma ring_buffer_map() was done on that got split or moved.
+ */
+void ring_buffer_map_dup(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	mutex_unlock(&buffer->mutex);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - undo a ring_buffer_map() or ring_buffer_map_dup()
+ * @buffer: the mapped buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * Returns 0 on success, -ENODEV if the buffer wasn't mapped.
+ */
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	kfree(subbuf_ids);
+	free_page((unsigned long)meta);
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events to user space
+ * @buffer: the mapped buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * Consumes what of the reader page wasn't handed to user space yet, once
+ * it's all gone swapping in the oldest page with data, and describes that in
+ * the meta page. See TRACE_MMAP_IOCTL_GET_READER.
+ *
+ * Returns 0 on success, -ENODEV if the buffer isn't mapped.
+ */
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned int read;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	/* Only moves on from the reader page once it has been consumed */
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader)
+		reader = cpu_buffer->reader_page;
+
+	read = reader->read;
+	while (reader->read < rb_page_size(reader))
+		rb_advance_reader(cpu_buffer);
+
+	rb_update_meta_page(cpu_buffer, read);
+	cpu_buffer->lost_events = 0;
+ out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -50,6 +50,8 @@
 #include <linux/irq_work.h>
 #include <linux/workqueue.h>
 
+#include <uapi/linux/trace_mmap.h>
+
 #include "trace.h"
 #include "trace_output.h"
 
@@ -1202,6 +1204,10 @@ int tracing_alloc_snapshot_instance(struct trace_array *tr)
 {
 	int ret;
 
+	/* swapping buffers would change what user space looks at */
+	if (atomic_read(&tr->mapped))
+		return -EBUSY;
+
 	if (!tr->allocated_snapshot) {
 
 		/* allocate spare buffer */
@@ -5686,7 +5692,8 @@ static const char readme_msg[] =
 	"\t            .syscall    display a syscall id as a syscall name\n"
 	"\t            .log2       display log2 value rather than raw number\n"
 	"\t            .buckets=size  display values in groups of size rather than raw number\n"
-	"\t            .usecs      display a common_timestamp in microseconds\n\n"
+	"\t            .usecs      display a common_timestamp in microseconds\n"
+	"\t            .percentile display a val's p50/p90/p99 along with its sum\n\n"
 	"\t    The 'pause' parameter can be used to pause an existing hist\n"
 	"\t    trigger or to start a hist trigger but not log any events\n"
 	"\t    until told to do so.  'continue' can be used to start or\n"
@@ -8311,12 +8318,38 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	return ret;
 }
 
-/* An ioctl call with cmd 0 to the ring buffer file will wake up all waiters */
+static int tracing_buffers_get_reader(struct file *file)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (!(file->f_flags & O_NONBLOCK) && trace_empty(iter)) {
+		ret = wait_on_pipe(iter, 0);
+		if (ret)
+			return ret;
+	}
+
+	trace_access_lock(iter->cpu_file);
+	ret = ring_buffer_map_get_reader(iter->array_buffer->buffer,
+					 iter->cpu_file);
+	trace_access_unlock(iter->cpu_file);
+
+	return ret;
+}
+
+/*
+ * An ioctl call with cmd 0 to the ring buffer file will wake up all waiters,
+ * TRACE_MMAP_IOCTL_GET_READER moves a mapped buffer's reader on.
+ */
 static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct ftrace_buffer_info *info = file->private_data;
 	struct trace_iterator *iter = &info->iter;
 
+	if (cmd == TRACE_MMAP_IOCTL_GET_READER)
+		return tracing_buffers_get_reader(file);
+
 	if (cmd)
 		return -ENOIOCTLCMD;
 
@@ -8332,6 +8365,58 @@ static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned
 	return 0;
 }
 
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	atomic_inc(&iter->tr->mapped);
+	ring_buffer_map_dup(iter->array_buffer->buffer, iter->cpu_file);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->array_buffer->buffer, iter->cpu_file));
+	atomic_dec(&iter->tr->mapped);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	struct trace_array *tr = iter->tr;
+	int ret;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	/* keeps a snapshot from being allocated */
+	atomic_inc(&tr->mapped);
+#ifdef CONFIG_TRACER_MAX_TRACE
+	/* the snapshot buffer may get swapped in at any time */
+	if (tr->allocated_snapshot)
+		ret = -EBUSY;
+	else
+#endif
+		ret = ring_buffer_map(iter->array_buffer->buffer,
+				      iter->cpu_file, vma);
+	if (ret) {
+		atomic_dec(&tr->mapped);
+		return ret;
+	}
+
+	vma->vm_ops = &tracing_buffers_vmops;
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
@@ -8339,6 +8424,7 @@ static const struct file_operations tracing_buffers_fops = {
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
 	.unlocked_ioctl = tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -66,7 +66,8 @@
 	C(EMPTY_SORT_FIELD,	"Empty sort field"),			\
 	C(TOO_MANY_SORT_FIELDS,	"Too many sort fields (Max = 2)"),	\
 	C(INVALID_SORT_FIELD,	"Sort field must be a key or a val"),	\
-	C(INVALID_STR_OPERAND,	"String type can not be an operand in expression"),
+	C(INVALID_STR_OPERAND,	"String type can not be an operand in expression"), \
+	C(INVALID_PERCENTILE,	"Only vals can have the percentile modifier"),
 
 #undef C
 #define C(a, b)		HIST_ERR_##a
@@ -152,6 +153,11 @@ struct hist_field {
 	bool                            read_once;
 
 	unsigned int			var_str_idx;
+
+	/*
+	 * Index of the tracing_map distribution of a PERCENTILE val.
+	 */
+	unsigned int			dist_idx;
 };
 
 static u64 hist_field_none(struct hist_field *field,
@@ -341,6 +347,7 @@ enum hist_field_flags {
 	HIST_FIELD_FL_CPU		= 1 << 15,
 	HIST_FIELD_FL_ALIAS		= 1 << 16,
 	HIST_FIELD_FL_BUCKET		= 1 << 17,
+	HIST_FIELD_FL_PERCENTILE	= 1 << 18,
 };
 
 struct var_defs {
@@ -1508,6 +1515,8 @@ static const char *get_hist_field_flags(struct hist_field *hist_field)
 		flags_str = "buckets";
 	else if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
 		flags_str = "usecs";
+	else if (hist_field->flags & HIST_FIELD_FL_PERCENTILE)
+		flags_str = "percentile";
 
 	return flags_str;
 }
@@ -2017,6 +2026,8 @@ parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
 			*flags |= HIST_FIELD_FL_LOG2;
 		else if (strcmp(modifier, "usecs") == 0)
 			*flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
+		else if (strcmp(modifier, "percentile") == 0)
+			*flags |= HIST_FIELD_FL_PERCENTILE;
 		else if (strncmp(modifier, "bucket", 6) == 0) {
 			int ret;
 
@@ -3769,6 +3780,14 @@ static int __create_val_field(struct hist_trigger_data *hist_data,
 		goto out;
 	}
 
+	if (var_name && hist_field->flags & HIST_FIELD_FL_PERCENTILE) {
+		hist_err(file->tr, HIST_ERR_INVALID_PERCENTILE,
+			 errpos(field_str));
+		destroy_hist_field(hist_field, 0);
+		ret = -EINVAL;
+		goto out;
+	}
+
 	hist_data->fields[val_idx] = hist_field;
 
 	++hist_data->n_vals;
@@ -3930,6 +3949,13 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 			goto out;
 		}
 
+		if (hist_field->flags & HIST_FIELD_FL_PERCENTILE) {
+			hist_err(tr, HIST_ERR_INVALID_PERCENTILE, errpos(field_str));
+			destroy_hist_field(hist_field, 0);
+			ret = -EINVAL;
+			goto out;
+		}
+
 		key_size = hist_field->size;
 	}
 
@@ -4500,6 +4526,13 @@ static int create_tracing_map_fields(struct hist_trigger_data *hist_data)
 		if (idx < 0)
 			return idx;
 
+		if (hist_field->flags & HIST_FIELD_FL_PERCENTILE) {
+			idx = tracing_map_add_dist(map);
+			if (idx < 0)
+				return idx;
+			hist_field->dist_idx = idx;
+		}
+
 		if (hist_field->flags & HIST_FIELD_FL_VAR) {
 			idx = tracing_map_add_var(map);
 			if (idx < 0)
@@ -4609,6 +4642,9 @@ static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 			continue;
 		}
 		tracing_map_update_sum(elt, i, hist_val);
+		if (hist_field->flags & HIST_FIELD_FL_PERCENTILE)
+			tracing_map_update_dist(elt, hist_field->dist_idx,
+						hist_val);
 	}
 
 	for_each_hist_key_field(i, hist_data) {
@@ -4847,6 +4883,14 @@ static void hist_trigger_entry_print(struct seq_file *m,
 		if (hist_data->fields[i]->flags & HIST_FIELD_FL_HEX) {
 			seq_printf(m, "  %s: %10llx", field_name,
 				   tracing_map_read_sum(elt, i));
+		} else if (hist_data->fields[i]->flags & HIST_FIELD_FL_PERCENTILE) {
+			unsigned int dist_idx = hist_data->fields[i]->dist_idx;
+
+			seq_printf(m, "  %s: %10llu (p50: <= %llu p90: <= %llu p99: <= %llu)",
+				   field_name, tracing_map_read_sum(elt, i),
+				   tracing_map_read_percentile(elt, dist_idx, 50),
+				   tracing_map_read_percentile(elt, dist_idx, 90),
+				   tracing_map_read_percentile(elt, dist_idx, 99));
 		} else {
 			seq_printf(m, "  %s: %10llu", field_name,
 				   tracing_map_read_sum(elt, i));
@@ -4902,7 +4946,7 @@ static void hist_trigger_show(struct seq_file *m,
 	track_data_snapshot_print(m, hist_data);
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
+		   tracing_map_read_hits(hist_data->map),
 		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
 }
 
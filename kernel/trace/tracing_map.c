@@ -16,6 +16,7 @@
 #include <linux/slab.h>
 #include <linux/sort.h>
 #include <linux/kmemleak.h>
+#include <linux/percpu.h>
 
 #include "tracing_map.h"
 #include "trace.h"
@@ -38,7 +39,7 @@
  */
 void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
 {
-	atomic64_add(n, &elt->fields[i].sum);
+	this_cpu_add(*(elt->sums + i), n);
 }
 
 /**
@@ -55,7 +56,98 @@ void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
  */
 u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
 {
-	return (u64)atomic64_read(&elt->fields[i].sum);
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(per_cpu_ptr(elt->sums, cpu) + i);
+
+	return sum;
+}
+
+static unsigned int tracing_map_dist_bucket(u64 n)
+{
+	return n ? fls64(n) : 0;
+}
+
+/* the largest value falling in bucket b, see tracing_map_dist_bucket() */
+static u64 tracing_map_dist_bucket_max(unsigned int b)
+{
+	if (b == BITS_PER_LONG_LONG)
+		return U64_MAX;
+
+	return (1ULL << b) - 1;
+}
+
+/**
+ * tracing_map_update_dist - Account a value in a tracing_map_elt distribution
+ * @elt: The tracing_map_elt
+ * @i: The index of the given distribution associated with the tracing_map_elt
+ * @n: The value to account
+ *
+ * Increment the counter of the power of two bucket n falls in, in
+ * distribution i of the specified tracing_map_elt.  The index i is the
+ * index returned by the call to tracing_map_add_dist() when the tracing
+ * map was set up.
+ */
+void tracing_map_update_dist(struct tracing_map_elt *elt, unsigned int i, u64 n)
+{
+	atomic64_inc(&elt->dists[i * TRACING_MAP_DIST_BUCKETS +
+				 tracing_map_dist_bucket(n)]);
+}
+
+/**
+ * tracing_map_read_percentile - Approximate a percentile of a distribution
+ * @elt: The tracing_map_elt
+ * @i: The index of the given distribution associated with the tracing_map_elt
+ * @pct: The percentile, from 0 to 100
+ *
+ * Return: The upper bound of the power of two bucket holding the pct-th
+ * percentile of the values accounted in distribution i of elt, 0 if no
+ * value was accounted.
+ */
+u64 tracing_map_read_percentile(struct tracing_map_elt *elt, unsigned int i,
+				unsigned int pct)
+{
+	atomic64_t *dist = &elt->dists[i * TRACING_MAP_DIST_BUCKETS];
+	u64 counts[TRACING_MAP_DIST_BUCKETS];
+	u64 total = 0, rank, seen = 0;
+	unsigned int b;
+
+	for (b = 0; b < TRACING_MAP_DIST_BUCKETS; b++) {
+		counts[b] = atomic64_read(&dist[b]);
+		total += counts[b];
+	}
+
+	if (!total)
+		return 0;
+
+	rank = max_t(u64, DIV_ROUND_UP_ULL(total * pct, 100), 1);
+	for (b = 0; b < TRACING_MAP_DIST_BUCKETS - 1; b++) {
+		seen += counts[b];
+		if (seen >= rank)
+			break;
+	}
+
+	return tracing_map_dist_bucket_max(b);
+}
+
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of successful insertions and lookups since the map
+ * was last cleared, see tracing_map_insert().
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		hits += *per_cpu_ptr(map->hits, cpu);
+
+	return hits;
 }
 
 /**
@@ -251,6 +343,29 @@ int tracing_map_add_var(struct tracing_map *map)
 	return ret;
 }
 
+/**
+ * tracing_map_add_dist - Add a distribution to a tracing_map
+ * @map: The tracing_map
+ *
+ * Add a distribution to the map and return the index identifying it in
+ * the map and associated tracing_map_elts.  This is the index used for
+ * instance to account a value for a particular tracing_map_elt using
+ * tracing_map_update_dist() or reading a percentile via
+ * tracing_map_read_percentile().
+ *
+ * Return: The index identifying the distribution in the map and
+ * associated tracing_map_elts, or -EINVAL on error.
+ */
+int tracing_map_add_dist(struct tracing_map *map)
+{
+	int ret = -EINVAL;
+
+	if (map->n_dists < TRACING_MAP_DISTS_MAX)
+		ret = map->n_dists++;
+
+	return ret;
+}
+
 /**
  * tracing_map_add_key_field - Add a field describing a tracing_map key
  * @map: The tracing_map
@@ -358,11 +473,19 @@ static struct tracing_map_array *tracing_map_array_alloc(unsigned int n_elts,
 static void tracing_map_elt_clear(struct tracing_map_elt *elt)
 {
 	unsigned i;
+	int cpu;
 
 	for (i = 0; i < elt->map->n_fields; i++)
 		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
 			atomic64_set(&elt->fields[i].sum, 0);
 
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(elt->sums, cpu), 0,
+		       elt->map->n_fields * sizeof(u64));
+
+	for (i = 0; i < elt->map->n_dists * TRACING_MAP_DIST_BUCKETS; i++)
+		atomic64_set(&elt->dists[i], 0);
+
 	for (i = 0; i < elt->map->n_vars; i++) {
 		atomic64_set(&elt->vars[i], 0);
 		elt->var_set[i] = false;
@@ -394,6 +517,8 @@ static void tracing_map_elt_free(struct tracing_map_elt *elt)
 	if (elt->map->ops && elt->map->ops->elt_free)
 		elt->map->ops->elt_free(elt);
 	kfree(elt->fields);
+	free_percpu(elt->sums);
+	kfree(elt->dists);
 	kfree(elt->vars);
 	kfree(elt->var_set);
 	kfree(elt->key);
@@ -423,6 +548,19 @@ static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
 		goto free;
 	}
 
+	elt->sums = __alloc_percpu(map->n_fields * sizeof(u64), sizeof(u64));
+	if (!elt->sums) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	elt->dists = kcalloc(map->n_dists * TRACING_MAP_DIST_BUCKETS,
+			     sizeof(*elt->dists), GFP_KERNEL);
+	if (!elt->dists) {
+		err = -ENOMEM;
+		goto free;
+	}
+
 	elt->vars = kcalloc(map->n_vars, sizeof(*elt->vars), GFP_KERNEL);
 	if (!elt->vars) {
 		err = -ENOMEM;
@@ -535,7 +673,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 			if (val &&
 			    keys_match(key, val->key, map->key_size)) {
 				if (!lookup_only)
-					atomic64_inc(&map->hits);
+					this_cpu_inc(*map->hits);
 				return val;
 			} else if (unlikely(!val)) {
 				/*
@@ -575,7 +713,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 				memcpy(elt->key, key, map->key_size);
 				entry->val = elt;
-				atomic64_inc(&map->hits);
+				this_cpu_inc(*map->hits);
 
 				return entry->val;
 			} else {
@@ -676,6 +814,7 @@ void tracing_map_destroy(struct tracing_map *map)
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
+	free_percpu(map->hits);
 	kfree(map);
 }
 
@@ -693,9 +832,11 @@ void tracing_map_destroy(struct tracing_map *map)
 void tracing_map_clear(struct tracing_map *map)
 {
 	unsigned int i;
+	int cpu;
 
 	atomic_set(&map->next_elt, -1);
-	atomic64_set(&map->hits, 0);
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(map->hits, cpu) = 0;
 	atomic64_set(&map->drops, 0);
 
 	tracing_map_array_clear(map->map);
@@ -785,6 +926,10 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 
 	map->private_data = private_data;
 
+	map->hits = alloc_percpu(u64);
+	if (!map->hits)
+		goto free;
+
 	map->map = tracing_map_array_alloc(map->map_size,
 					   sizeof(struct tracing_map_entry));
 	if (!map->map)
@@ -943,6 +1088,17 @@ void tracing_map_destroy_sort_entries(struct tracing_map_sort_entry **entries,
 	vfree(entries);
 }
 
+/* fold the per CPU sums once so that the comparisons don't have to */
+static void tracing_map_elt_fold_sums(struct tracing_map_elt *elt)
+{
+	unsigned int i;
+
+	for (i = 0; i < elt->map->n_fields; i++)
+		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
+			atomic64_set(&elt->fields[i].sum,
+				     tracing_map_read_sum(elt, i));
+}
+
 static struct tracing_map_sort_entry *
 create_sort_entry(void *key, struct tracing_map_elt *elt)
 {
@@ -1087,6 +1243,7 @@ int tracing_map_sort_entries(struct tracing_map *map,
 		if (!entry->key || !entry->val)
 			continue;
 
+		tracing_map_elt_fold_sums(entry->val);
 		entries[n_entries] = create_sort_entry(entry->val->key,
 						       entry->val);
 		if (!entries[n_entries++]) {
@@ -12,6 +12,8 @@
 					 TRACING_MAP_VALS_MAX)
 #define TRACING_MAP_VARS_MAX		16
 #define TRACING_MAP_SORT_KEYS_MAX	2
+#define TRACING_MAP_DISTS_MAX		TRACING_MAP_VALS_MAX
+#define TRACING_MAP_DIST_BUCKETS	(BITS_PER_LONG_LONG + 1)
 
 typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
 
@@ -95,6 +97,18 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * tracing_map_elts is allocated as a single block and is stored in
  * the elts field of struct tracing_map.
  *
+ * The sums of a tracing_map_elt are kept per CPU, so that the CPUs
+ * hitting the same key don't all bounce the same cache line around.
+ * tracing_map_read_sum() adds up the per CPU values, and
+ * tracing_map_sort_entries() does the same once for each element before
+ * sorting, into the 'sum' of the element's tracing_map_field.  The key
+ * table itself and the variables are shared: a variable set on one CPU
+ * is routinely read on another one.
+ *
+ * A tracing_map_elt may also hold distributions, one atomic counter per
+ * power of two, from which tracing_map_read_percentile() approximates
+ * percentiles of the values passed to tracing_map_update_dist().
+ *
  * There is also a set of structures used for sorting that might
  * benefit from some minimal explanation.
  *
@@ -138,6 +152,8 @@ struct tracing_map_field {
 struct tracing_map_elt {
 	struct tracing_map		*map;
 	struct tracing_map_field	*fields;
+	u64 __percpu			*sums;
+	atomic64_t			*dists;
 	atomic64_t			*vars;
 	bool				*var_set;
 	void				*key;
@@ -196,7 +212,8 @@ struct tracing_map {
 	unsigned int			n_keys;
 	struct tracing_map_sort_key	sort_key;
 	unsigned int			n_vars;
-	atomic64_t			hits;
+	unsigned int			n_dists;
+	u64 __percpu			*hits;
 	atomic64_t			drops;
 };
 
@@ -246,6 +263,7 @@ extern int tracing_map_init(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
 extern int tracing_map_add_var(struct tracing_map *map);
+extern int tracing_map_add_dist(struct tracing_map *map);
 extern int tracing_map_add_key_field(struct tracing_map *map,
 				     unsigned int offset,
 				     tracing_map_cmp_fn_t cmp_fn);
@@ -271,6 +289,11 @@ extern bool tracing_map_var_set(struct tracing_map_elt *elt, unsigned int i);
 extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
 extern u64 tracing_map_read_var(struct tracing_map_elt *elt, unsigned int i);
 extern u64 tracing_map_read_var_once(struct tracing_map_elt *elt, unsigned int i);
+extern void tracing_map_update_dist(struct tracing_map_elt *elt,
+				    unsigned int i, u64 n);
+extern u64 tracing_map_read_percentile(struct tracing_map_elt *elt,
+				       unsigned int i, unsigned int pct);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
 
 extern void tracing_map_set_field_descr(struct tracing_map *map,
 					unsigned int i,
@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * lib/rcu_btree.c - B+tree with copy-on-write updates and RCU lookups
+ *
+ * Every node holds up to RCU_BTREE_SLOTS sorted keys. In a leaf, each key
+ * maps to an entry; in an internal node, each key is the largest key found
+ * in the corresponding child. A lookup for the first key >= x therefore only
+ * needs to scan one node per level, left to right.
+ *
+ * An update copies the leaf it changes and every node up to the root,
+ * splitting nodes that overflow and merging or rebalancing nodes that drop
+ * below RCU_BTREE_MIN keys with a sibling. The new root is then published
+ * with a single pointer store and the nodes it replaced are freed after an
+ * RCU grace period, so lockless readers only ever see complete trees.
+ */
+
+#include <linux/rcu_btree.h>
+#include <linux/bug.h>
+#include <linux/export.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#define RCU_BTREE_MIN		(RCU_BTREE_SLOTS / 3)
+/* an overflowing node, or an underflowing node merged with a sibling */
+#define RCU_BTREE_ITEMS		(RCU_BTREE_SLOTS + RCU_BTREE_MIN)
+
+struct rcu_btree_node {
+	unsigned long keys[RCU_BTREE_SLOTS];
+	void *slots[RCU_BTREE_SLOTS];
+	unsigned char nr;
+	bool leaf;
+	struct rcu_head rcu;
+};
+
+struct rcu_btree_items {
+	unsigned long keys[RCU_BTREE_ITEMS];
+	void *slots[RCU_BTREE_ITEMS];
+	int nr;
+};
+
+struct rcu_btree_op {
+	struct rcu_btree *tree;
+	/* the nodes from the root down to the leaf, and the slots taken */
+	struct rcu_btree_node *path[RCU_BTREE_MAX_HEIGHT];
+	unsigned char pos[RCU_BTREE_MAX_HEIGHT];
+	int depth;
+	/* the nodes to free once the new root is visible */
+	struct rcu_btree_node *old[2 * RCU_BTREE_MAX_HEIGHT];
+	int nr_old;
+	/* the new contents of the node being rebuilt */
+	struct rcu_btree_items items;
+};
+
+static int rcu_btree_node_find(const struct rcu_btree_node *node,
+			       unsigned long key)
+{
+	int i;
+
+	for (i = 0; i < node->nr; i++) {
+		if (node->keys[i] >= key)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * rcu_btree_lookup_ge - find the entry with the smallest key >= @key
+ * @tree: the tree
+ * @key: the key to start from, updated to the key of the entry found
+ *
+ * The caller must hold either rcu_read_lock() or whatever lock serializes
+ * the writers of @tree.
+ *
+ * Return: the entry, or NULL if no key in @tree is >= @key.
+ */
+void *rcu_btree_lookup_ge(struct rcu_btree *tree, unsigned long *key)
+{
+	struct rcu_btree_node *node = rcu_dereference_raw(tree->root);
+
+	while (node) {
+		int i = rcu_btree_node_find(node, *key);
+
+		if (i == node->nr)
+			return NULL;
+
+		if (node->leaf) {
+			*key = node->keys[i];
+			return node->slots[i];
+		}
+
+		node = rcu_dereference_raw(node->slots[i]);
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(rcu_btree_lookup_ge);
+
+/* Make sure @nr nodes can be taken with rcu_btree_node_get(). */
+static int rcu_btree_reserve(struct rcu_btree *tree, unsigned int nr, gfp_t gfp)
+{
+	while (tree->nr_spare < nr) {
+		struct rcu_btree_node *node = kmalloc(sizeof(*node), gfp);
+
+		if (!node)
+			return -ENOMEM;
+
+		node->slots[0] = tree->spare;
+		tree->spare = node;
+		tree->nr_spare++;
+	}
+
+	return 0;
+}
+
+static struct rcu_btree_node *rcu_btree_node_get(struct rcu_btree *tree)
+{
+	struct rcu_btree_node *node = tree->spare;
+
+	/* guaranteed by rcu_btree_reserve() */
+	tree->spare = node->slots[0];
+	tree->nr_spare--;
+
+	return node;
+}
+
+static void rcu_btree_node_put(struct rcu_btree *tree,
+			       struct rcu_btree_node *node)
+{
+	node->slots[0] = tree->spare;
+	tree->spare = node;
+	tree->nr_spare++;
+}
+
+/* the most nodes an update can allocate: two per level plus a new root */
+static unsigned int rcu_btree_op_nodes(struct rcu_btree *tree)
+{
+	return 2 * tree->height + 1;
+}
+
+/**
+ * rcu_btree_preallocate - reserve the nodes for upcoming updates
+ * @tree: the tree
+ * @nr_ops: the number of rcu_btree_insert() or rcu_btree_erase() calls
+ * @gfp: the allocation flags
+ *
+ * Once this returns 0, the next @nr_ops updates of @tree won't allocate
+ * memory and can't fail with -ENOMEM, whatever gfp flags they are given.
+ *
+ * Return: 0 on success or -ENOMEM.
+ */
+int rcu_btree_preallocate(struct rcu_btree *tree, unsigned int nr_ops,
+			  gfp_t gfp)
+{
+	unsigned int nr = 0;
+
+	/* each update may grow the tree by one level */
+	while (nr_ops--)
+		nr += 2 * (tree->height + nr_ops) + 1;
+
+	return rcu_btree_reserve(tree, nr, gfp);
+}
+EXPORT_SYMBOL_GPL(rcu_btree_preallocate);
+
+static void rcu_btree_items_add(struct rcu_btree_items *items,
+				unsigned long key, void *slot)
+{
+	items->keys[items->nr] = key;
+	items->slots[items->nr] = slot;
+	items->nr++;
+}
+
+static void rcu_btree_items_append(struct rcu_btree_items *items,
+				   const struct rcu_btree_node *node,
+				   int from, int to)
+{
+	int nr = to - from;
+
+	if (nr <= 0)
+		return;
+
+	memcpy(items->keys + items->nr, node->keys + from, nr * sizeof(long));
+	memcpy(items->slots + items->nr, node->slots + from, nr * sizeof(void *));
+	items->nr += nr;
+}
+
+static void rcu_btree_items_prepend(struct rcu_btree_items *items,
+				    const struct rcu_btree_node *node)
+{
+	memmove(items->keys + node->nr, items->keys, items->nr * sizeof(long));
+	memmove(items->slots + node->nr, items->slots,
+		items->nr * sizeof(void *));
+	memcpy(items->keys, node->keys, node->nr * sizeof(long));
+	memcpy(items->slots, node->slots, node->nr * sizeof(void *));
+	items->nr += node->nr;
+}
+
+/* Turn the pending items into zero, one or two new nodes. */
+static int rcu_btree_build(struct rcu_btree_op *op, bool leaf,
+			   struct rcu_btree_node **out)
+{
+	struct rcu_btree_items *items = &op->items;
+	int count = items->nr > RCU_BTREE_SLOTS ? 2 : !!items->nr;
+	int i, start = 0;
+
+	for (i = 0; i < count; i++) {
+		struct rcu_btree_node *node = rcu_btree_node_get(op->tree);
+		int nr = items->nr;
+
+		if (count == 2)
+			nr = i ? items->nr - items->nr / 2 : items->nr / 2;
+
+		memcpy(node->keys, items->keys + start, nr * sizeof(long));
+		memcpy(node->slots, items->slots + start, nr * sizeof(void *));
+		node->nr = nr;
+		node->leaf = leaf;
+		out[i] = node;
+		start += nr;
+	}
+
+	return count;
+}
+
+static unsigned long rcu_btree_max_key(const struct rcu_btree_node *node)
+{
+	return node->keys[node->nr - 1];
+}
+
+/*
+ * Replace the leaf at the end of op->path with the pending items, then
+ * rebuild every node above it and publish the new root.
+ */
+static void rcu_btree_update(struct rcu_btree_op *op)
+{
+	struct rcu_btree *tree = op->tree;
+	struct rcu_btree_node *repl[2], *root;
+	int level = op->depth - 1;
+	bool leaf = true;
+	int nr_repl, i;
+
+	for (; level > 0; level--, leaf = false) {
+		struct rcu_btree_node *parent = op->path[level - 1];
+		int pos = op->pos[level - 1];
+		int start = pos, nr_replaced = 1;
+
+		if (op->items.nr < RCU_BTREE_MIN && parent->nr > 1) {
+			int sib = pos + 1 < parent->nr ? pos + 1 : pos - 1;
+			struct rcu_btree_node *sibling = parent->slots[sib];
+
+			if (sib > pos) {
+				rcu_btree_items_append(&op->items, sibling, 0,
+						       sibling->nr);
+			} else {
+				rcu_btree_items_prepend(&op->items, sibling);
+				start = sib;
+			}
+			op->old[op->nr_old++] = sibling;
+			nr_replaced = 2;
+		}
+
+		nr_repl = rcu_btree_build(op, leaf, repl);
+		op->old[op->nr_old++] = op->path[level];
+
+		op->items.nr = 0;
+		rcu_btree_items_append(&op->items, parent, 0, start);
+		for (i = 0; i < nr_repl; i++)
+			rcu_btree_items_add(&op->items, rcu_btree_max_key(repl[i]),
+					    repl[i]);
+		rcu_btree_items_append(&op->items, parent, start + nr_replaced,
+				       parent->nr);
+	}
+
+	op->old[op->nr_old++] = op->path[0];
+	nr_repl = rcu_btree_build(op, leaf, repl);
+
+	if (!nr_repl) {
+		root = NULL;
+		tree->height = 0;
+	} else if (nr_repl == 2) {
+		root = rcu_btree_node_get(tree);
+		root->leaf = false;
+		root->nr = 2;
+		for (i = 0; i < 2; i++) {
+			root->keys[i] = rcu_btree_max_key(repl[i]);
+			root->slots[i] = repl[i];
+		}
+		tree->height++;
+	} else if (!repl[0]->leaf && repl[0]->nr == 1) {
+		/* the root is left with a single child, drop a level */
+		root = repl[0]->slots[0];
+		rcu_btree_node_put(tree, repl[0]);
+		tree->height--;
+	} else {
+		root = repl[0];
+	}
+
+	rcu_assign_pointer(tree->root, root);
+
+	for (i = 0; i < op->nr_old; i++)
+		kfree_rcu(op->old[i], rcu);
+}
+
+/* Fill op->path down to the leaf for @key and return the position in it. */
+static int rcu_btree_descend(struct rcu_btree_op *op, unsigned long key)
+{
+	struct rcu_btree_node *node = rcu_dereference_protected(op->tree->root,
+								true);
+	int level = 0;
+
+	while (!node->leaf) {
+		int i = rcu_btree_node_find(node, key);
+
+		/* keys beyond the last one go to the last child */
+		if (i == node->nr)
+			i--;
+
+		op->path[level] = node;
+		op->pos[level] = i;
+		level++;
+		node = node->slots[i];
+	}
+
+	op->path[level] = node;
+	op->depth = level + 1;
+
+	return rcu_btree_node_find(node, key);
+}
+
+/**
+ * rcu_btree_insert - add an entry
+ * @tree: the tree
+ * @key: the key of the new entry
+ * @entry: the entry, must not be NULL
+ * @gfp: the allocation flags, if nodes haven't been preallocated
+ *
+ * Return: 0 on success, -EEXIST if @key is already present or -ENOMEM.
+ */
+int rcu_btree_insert(struct rcu_btree *tree, unsigned long key, void *entry,
+		     gfp_t gfp)
+{
+	struct rcu_btree_op op = { .tree = tree };
+	struct rcu_btree_node *leaf;
+	int pos;
+
+	if (WARN_ON_ONCE(!entry))
+		return -EINVAL;
+
+	if (WARN_ON_ONCE(tree->height >= RCU_BTREE_MAX_HEIGHT))
+		return -ENOSPC;
+
+	if (rcu_btree_reserve(tree, rcu_btree_op_nodes(tree), gfp))
+		return -ENOMEM;
+
+	if (rcu_btree_empty(tree)) {
+		leaf = rcu_btree_node_get(tree);
+		leaf->leaf = true;
+		leaf->nr = 1;
+		leaf->keys[0] = key;
+		leaf->slots[0] = entry;
+		tree->height = 1;
+		rcu_assign_pointer(tree->root, leaf);
+		return 0;
+	}
+
+	pos = rcu_btree_descend(&op, key);
+	leaf = op.path[op.depth - 1];
+	if (pos < leaf->nr && leaf->keys[pos] == key)
+		return -EEXIST;
+
+	rcu_btree_items_append(&op.items, leaf, 0, pos);
+	rcu_btree_items_add(&op.items, key, entry);
+	rcu_btree_items_append(&op.items, leaf, pos, leaf->nr);
+	rcu_btree_update(&op);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rcu_btree_insert);
+
+/**
+ * rcu_btree_erase - remove an entry
+ * @tree: the tree
+ * @key: the key of the entry to remove
+ * @gfp: the allocation flags, if nodes haven't been preallocated
+ *
+ * Return: 0 on success, -ENOENT if @key isn't present or -ENOMEM.
+ */
+int rcu_btree_erase(struct rcu_btree *tree, unsigned long key, gfp_t gfp)
+{
+	struct rcu_btree_op op = { .tree = tree };
+	struct rcu_btree_node *leaf;
+	int pos;
+
+	if (rcu_btree_empty(tree))
+		return -ENOENT;
+
+	if (rcu_btree_reserve(tree, rcu_btree_op_nodes(tree), gfp))
+		return -ENOMEM;
+
+	pos = rcu_btree_descend(&op, key);
+	leaf = op.path[op.depth - 1];
+	if (pos == leaf->nr || leaf->keys[pos] != key)
+		return -ENOENT;
+
+	rcu_btree_items_append(&op.items, leaf, 0, pos);
+	rcu_btree_items_append(&op.items, leaf, pos + 1, leaf->nr);
+	rcu_btree_update(&op);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rcu_btree_erase);
+
+static void rcu_btree_free_node(struct rcu_btree_node *node)
+{
+	int i;
+
+	if (!node->leaf) {
+		for (i = 0; i < node->nr; i++)
+			rcu_btree_free_node(node->slots[i]);
+	}
+
+	kfree_rcu(node, rcu);
+}
+
+/**
+ * rcu_btree_destroy - remove all entries and free the nodes
+ * @tree: the tree
+ *
+ * The entries themselves are left alone. Lookups that already started may
+ * still find them until a grace period has passed.
+ */
+void rcu_btree_destroy(struct rcu_btree *tree)
+{
+	struct rcu_btree_node *root = rcu_dereference_protected(tree->root,
+								true);
+
+	RCU_INIT_POINTER(tree->root, NULL);
+	if (root)
+		rcu_btree_free_node(root);
+
+	while (tree->spare) {
+		struct rcu_btree_node *node = rcu_btree_node_get(tree);
+
+		kfree(node);
+	}
+
+	tree->height = 0;
+}
+EXPORT_SYMBOL_GPL(rcu_btree_destroy);
@@ -489,6 +489,61 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq)
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth;
+	unsigned long index, nr;
+	int i;
+
+	if (unlikely(sb->round_robin))
+		return 0;
+
+	depth = READ_ONCE(sb->depth);
+	hint = update_alloc_hint_before_get(sb, depth);
+
+	index = SB_NR_TO_INDEX(sb, hint);
+
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long get_mask;
+
+		sbitmap_deferred_clear(map);
+
+		nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr + nr_tags <= map->depth) {
+			atomic_long_t *ptr = (atomic_long_t *)&map->word;
+			unsigned long val, ret;
+
+			get_mask = (nr_tags == BITS_PER_LONG ? ~0UL :
+				    (1UL << nr_tags) - 1) << nr;
+			val = READ_ONCE(map->word);
+			do {
+				/* Only take the whole run of bits at once */
+				if (val & get_mask)
+					goto next;
+				ret = atomic_long_cmpxchg(ptr, val, get_mask | val);
+				if (ret == val)
+					break;
+				val = ret;
+			} while (1);
+
+			*offset = nr + (index << sb->shift);
+			update_alloc_hint_after_get(sb, depth, hint,
+						    *offset + nr_tags - 1);
+			return get_mask >> nr;
+		}
+next:
+		/* Jump to next index. */
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth)
 {
@@ -607,6 +662,49 @@ void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+				int *tags, int nr_tags)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL;
+	unsigned long mask = 0;
+	int i, nr;
+
+	/* Pairs with __sbitmap_get_word() like in sbitmap_queue_clear() */
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_tags; i++) {
+		const int tag = tags[i] - offset;
+		unsigned long *this_addr;
+
+		/*
+		 * The whole batch is cleared with one atomic per word, so skip
+		 * the deferred map and clear the allocation word directly.
+		 */
+		this_addr = &sb->map[SB_NR_TO_INDEX(sb, tag)].word;
+		if (!addr) {
+			addr = this_addr;
+		} else if (addr != this_addr) {
+			atomic_long_andnot(mask, (atomic_long_t *)addr);
+			mask = 0;
+			addr = this_addr;
+		}
+		mask |= 1UL << SB_NR_TO_BIT(sb, tag);
+	}
+
+	if (mask)
+		atomic_long_andnot(mask, (atomic_long_t *)addr);
+
+	/* Pairs with set_current_state() like in sbitmap_queue_clear() */
+	smp_mb__after_atomic();
+	for (i = 0; i < nr_tags; i++)
+		sbitmap_queue_wake_up(sbq);
+
+	nr = tags[nr_tags - 1] - offset;
+	if (likely(!sb->round_robin && nr < sb->depth))
+		*raw_cpu_ptr(sb->alloc_hint) = nr;
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
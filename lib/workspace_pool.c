@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Shared, NUMA-aware pool of compression workspaces
+ *
+ * See include/linux/workspace_pool.h for the rules callers have to follow.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/export.h>
+#include <linux/minmax.h>
+#include <linux/nodemask.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/workspace_pool.h>
+
+/**
+ * workspace_pool_init() - set up an empty pool
+ * @pool: the pool
+ * @alloc: allocates one workspace, preferably on the given node
+ * @free: frees a workspace returned by @alloc
+ *
+ * Return: 0 on success, -ENOMEM if the per-node lists can't be allocated.
+ */
+int workspace_pool_init(struct workspace_pool *pool,
+			struct workspace_pool_entry *(*alloc)(int nid),
+			void (*free)(struct workspace_pool_entry *ws))
+{
+	int nid;
+
+	pool->alloc = alloc;
+	pool->free = free;
+	mutex_init(&pool->mutex);
+	pool->users = 0;
+	pool->nr_allocated = 0;
+
+	pool->nodes = kcalloc(nr_node_ids, sizeof(*pool->nodes), GFP_KERNEL);
+	if (!pool->nodes)
+		return -ENOMEM;
+
+	for_each_node(nid) {
+		struct workspace_pool_node *node;
+
+		node = kzalloc_node(sizeof(*node), GFP_KERNEL,
+				    node_state(nid, N_NORMAL_MEMORY) ?
+				    nid : NUMA_NO_NODE);
+		if (!node) {
+			workspace_pool_destroy(pool);
+			return -ENOMEM;
+		}
+		spin_lock_init(&node->lock);
+		INIT_LIST_HEAD(&node->idle);
+		pool->nodes[nid] = node;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(workspace_pool_init);
+
+static struct workspace_pool_entry *
+workspace_pool_take_idle(struct workspace_pool *pool, int nid)
+{
+	struct workspace_pool_node *node = pool->nodes[nid];
+	struct workspace_pool_entry *ws;
+	unsigned long flags;
+
+	if (!node)
+		return NULL;
+
+	spin_lock_irqsave(&node->lock, flags);
+	ws = list_first_entry_or_null(&node->idle, struct workspace_pool_entry,
+				      list);
+	if (ws)
+		list_del(&ws->list);
+	spin_unlock_irqrestore(&node->lock, flags);
+
+	return ws;
+}
+
+/**
+ * workspace_pool_destroy() - free all workspaces of a pool
+ * @pool: the pool, which must have no users left
+ */
+void workspace_pool_destroy(struct workspace_pool *pool)
+{
+	struct workspace_pool_entry *ws;
+	int nid;
+
+	if (!pool->nodes)
+		return;
+
+	WARN_ON(pool->users);
+
+	for_each_node(nid) {
+		if (!pool->nodes[nid])
+			continue;
+		while ((ws = workspace_pool_take_idle(pool, nid))) {
+			pool->free(ws);
+			pool->nr_allocated--;
+		}
+		kfree(pool->nodes[nid]);
+	}
+	WARN_ON(pool->nr_allocated);
+
+	kfree(pool->nodes);
+	pool->nodes = NULL;
+}
+EXPORT_SYMBOL_GPL(workspace_pool_destroy);
+
+static unsigned int workspace_pool_target(struct workspace_pool *pool)
+{
+	return min(pool->users, num_possible_cpus());
+}
+
+/**
+ * workspace_pool_reserve() - register one more user of the pool
+ * @pool: the pool
+ *
+ * Allocates a workspace on the local node if the pool doesn't have enough
+ * for all its users yet.  Must be paired with workspace_pool_unreserve().
+ *
+ * Context: May sleep.
+ * Return: 0 on success, -ENOMEM if a needed workspace can't be allocated.
+ */
+int workspace_pool_reserve(struct workspace_pool *pool)
+{
+	struct workspace_pool_entry *ws;
+	int ret = 0;
+
+	mutex_lock(&pool->mutex);
+	pool->users++;
+	if (pool->nr_allocated < workspace_pool_target(pool)) {
+		int nid = numa_mem_id();
+
+		ws = pool->alloc(nid);
+		if (!ws) {
+			pool->users--;
+			ret = -ENOMEM;
+			goto out;
+		}
+		ws->nid = nid;
+		pool->nr_allocated++;
+		workspace_pool_put(pool, ws);
+	}
+out:
+	mutex_unlock(&pool->mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(workspace_pool_reserve);
+
+/**
+ * workspace_pool_unreserve() - drop a user of the pool
+ * @pool: the pool
+ *
+ * Frees a workspace if the pool now has more than its users can need.
+ *
+ * Context: May sleep.
+ */
+void workspace_pool_unreserve(struct workspace_pool *pool)
+{
+	struct workspace_pool_entry *ws;
+	int nid;
+
+	mutex_lock(&pool->mutex);
+	pool->users--;
+	if (pool->nr_allocated > workspace_pool_target(pool)) {
+		/*
+		 * At most users workspaces can be in use, so one is idle.
+		 * Take it from this node first, the others are likely
+		 * busier and would rather keep theirs.
+		 */
+		ws = workspace_pool_take_idle(pool, numa_mem_id());
+		for_each_node(nid) {
+			if (ws)
+				break;
+			ws = workspace_pool_take_idle(pool, nid);
+		}
+		if (!WARN_ON_ONCE(!ws)) {
+			pool->free(ws);
+			pool->nr_allocated--;
+		}
+	}
+	mutex_unlock(&pool->mutex);
+}
+EXPORT_SYMBOL_GPL(workspace_pool_unreserve);
+
+/**
+ * workspace_pool_get() - take an idle workspace
+ * @pool: the pool
+ *
+ * Prefers a workspace on the local node and falls back to the other nodes.
+ * The caller must have a reservation and must not sleep until it has put
+ * the workspace back.
+ *
+ * Context: Any context, does not sleep.
+ * Return: the workspace, or NULL if the pool is misused
+ */
+struct workspace_pool_entry *workspace_pool_get(struct workspace_pool *pool)
+{
+	int local = numa_mem_id();
+	struct workspace_pool_entry *ws;
+	int nid, pass;
+
+	ws = workspace_pool_take_idle(pool, local);
+	if (likely(ws))
+		return ws;
+
+	/*
+	 * There is always an idle workspace somewhere, but the node lists are
+	 * not scanned atomically: one can be taken from a node we haven't
+	 * looked at yet and another put back on a node we already passed.
+	 * That needs a get and a put racing with us, so a second pass finds
+	 * one unless the pool is really oversubscribed.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		for_each_node(nid) {
+			ws = workspace_pool_take_idle(pool, nid);
+			if (ws)
+				return ws;
+		}
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(workspace_pool_get);
+
+/**
+ * workspace_pool_put() - return a workspace to the pool
+ * @pool: the pool
+ * @ws: the workspace from workspace_pool_get()
+ *
+ * Workspaces go back to the list of the node their memory is on, at the head
+ * so the next user gets one that is still warm in the cache.
+ *
+ * Context: Any context, does not sleep.
+ */
+void workspace_pool_put(struct workspace_pool *pool,
+			struct workspace_pool_entry *ws)
+{
+	struct workspace_pool_node *node = pool->nodes[ws->nid];
+	unsigned long flags;
+
+	spin_lock_irqsave(&node->lock, flags);
+	list_add(&ws->list, &node->idle);
+	spin_unlock_irqrestore(&node->lock, flags);
+}
+EXPORT_SYMBOL_GPL(workspace_pool_put);
@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sampled allocation profiling.
+ *
+ * With alloc_sample.rate=N, one in about N slab and page allocations is
+ * sampled: its stack trace is saved to the stack depot and its size, scaled
+ * by the sampling rate, is added to a per-stack record. Sampled objects are
+ * remembered until they are freed, so that the records also estimate how
+ * much memory each allocation site holds right now. /proc/alloc_samples
+ * prints the records.
+ *
+ * Unlike page_owner or slub_debug, the unsampled allocations and frees only
+ * pay for the decrement of a per-CPU counter and for a bit test, which
+ * makes it cheap enough to leave on in production.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/alloc_sample.h>
+#include <linux/hashtable.h>
+#include <linux/kasan.h>
+#include <linux/memblock.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/prandom.h>
+#include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/stackdepot.h>
+#include <linux/stacktrace.h>
+#include <linux/vmalloc.h>
+#include <linux/xarray.h>
+
+#include "slab.h"
+
+#define ALLOC_SAMPLE_STACK_DEPTH	16
+#define ALLOC_SAMPLE_SITE_BITS		10
+/* Bound on the memory taken by records of distinct allocation stacks */
+#define ALLOC_SAMPLE_MAX_SITES		(1 << 16)
+
+struct alloc_sample_site {
+	struct hlist_node hnode;
+	struct list_head list;
+	depot_stack_handle_t handle;
+	/* estimated from the samples, i.e. scaled by the sampling rate */
+	atomic_long_t nr_allocs;
+	atomic_long_t bytes_allocated;
+	atomic_long_t nr_live;
+	atomic_long_t bytes_live;
+};
+
+/*
+ * A live sampled object, indexed by address in alloc_sample_objs. The
+ * contribution to the site is remembered since the rate can change.
+ */
+struct alloc_sample_obj {
+	struct alloc_sample_site *site;
+	struct list_head list;
+	unsigned long bytes;
+	unsigned long rate;
+};
+
+DEFINE_STATIC_KEY_FALSE(alloc_sample_key);
+DEFINE_PER_CPU(long, alloc_sample_countdown);
+unsigned long *alloc_sample_pfns __read_mostly;
+unsigned long alloc_sample_nr_pfns __read_mostly;
+
+static unsigned long alloc_sample_rate __read_mostly;
+static DEFINE_MUTEX(alloc_sample_mutex);
+
+static DEFINE_HASHTABLE(alloc_sample_sites, ALLOC_SAMPLE_SITE_BITS);
+static LIST_HEAD(alloc_sample_site_list);
+static unsigned int alloc_sample_nr_sites;
+static DEFINE_SPINLOCK(alloc_sample_lock);
+static DEFINE_XARRAY_FLAGS(alloc_sample_objs, XA_FLAGS_LOCK_IRQ);
+static atomic_long_t alloc_sample_dropped;
+
+/* Randomize the interval so that periodic allocation patterns don't alias */
+static void alloc_sample_reset_countdown(unsigned long rate)
+{
+	long next = rate < 2 ? 1 : 1 + prandom_u32_max(2 * rate - 1);
+
+	this_cpu_write(alloc_sample_countdown, next);
+}
+
+static struct alloc_sample_site *alloc_sample_get_site(depot_stack_handle_t handle)
+{
+	struct alloc_sample_site *site;
+
+	lockdep_assert_held(&alloc_sample_lock);
+
+	hash_for_each_possible(alloc_sample_sites, site, hnode, handle)
+		if (site->handle == handle)
+			return site;
+
+	if (alloc_sample_nr_sites >= ALLOC_SAMPLE_MAX_SITES)
+		return NULL;
+
+	site = kzalloc(sizeof(*site), GFP_ATOMIC | __GFP_NOWARN);
+	if (!site)
+		return NULL;
+
+	site->handle = handle;
+	hash_add(alloc_sample_sites, &site->hnode, handle);
+	/* Sites are never freed, /proc/alloc_samples walks them under RCU */
+	list_add_tail_rcu(&site->list, &alloc_sample_site_list);
+	alloc_sample_nr_sites++;
+
+	return site;
+}
+
+/* Drop a sample from the live counts, and with @unrecord from the totals */
+static void alloc_sample_put_obj(struct alloc_sample_obj *obj, bool unrecord)
+{
+	struct alloc_sample_site *site = obj->site;
+
+	atomic_long_sub(obj->rate, &site->nr_live);
+	atomic_long_sub(obj->bytes * obj->rate, &site->bytes_live);
+	if (unrecord) {
+		atomic_long_sub(obj->rate, &site->nr_allocs);
+		atomic_long_sub(obj->bytes * obj->rate, &site->bytes_allocated);
+	}
+	kfree(obj);
+}
+
+/* Record a sampled allocation of @bytes at @addr */
+static noinline void alloc_sample_record(void *addr, unsigned long bytes)
+{
+	unsigned long entries[ALLOC_SAMPLE_STACK_DEPTH];
+	unsigned long rate = READ_ONCE(alloc_sample_rate);
+	unsigned long pfn = PHYS_PFN(__pa(addr));
+	struct alloc_sample_obj *obj, *old;
+	struct alloc_sample_site *site;
+	depot_stack_handle_t handle;
+	unsigned int nr_entries;
+	unsigned long flags;
+
+	alloc_sample_reset_countdown(rate);
+
+	/* Saving the stack and the records allocates memory */
+	if (current->in_alloc_sample || !rate)
+		return;
+	current->in_alloc_sample = 1;
+
+	if (pfn >= alloc_sample_nr_pfns)
+		goto drop;
+
+	nr_entries = stack_trace_save(entries, ARRAY_SIZE(entries), 2);
+	nr_entries = filter_irq_stacks(entries, nr_entries);
+	handle = stack_depot_save(entries, nr_entries,
+				  GFP_NOWAIT | __GFP_NOWARN);
+	if (!handle)
+		goto drop;
+
+	obj = kmalloc(sizeof(*obj), GFP_NOWAIT | __GFP_NOWARN);
+	if (!obj)
+		goto drop;
+	obj->bytes = bytes;
+	obj->rate = rate;
+
+	spin_lock_irqsave(&alloc_sample_lock, flags);
+	site = alloc_sample_get_site(handle);
+	spin_unlock_irqrestore(&alloc_sample_lock, flags);
+	if (!site)
+		goto free_obj;
+	obj->site = site;
+
+	old = xa_store_irq(&alloc_sample_objs,
+			   (unsigned long)addr / ARCH_SLAB_MINALIGN, obj,
+			   GFP_NOWAIT | __GFP_NOWARN);
+	if (xa_is_err(old))
+		goto free_obj;
+	/* Its free went unnoticed while sampling was off */
+	if (old)
+		alloc_sample_put_obj(old, false);
+
+	atomic_long_add(rate, &site->nr_allocs);
+	atomic_long_add(bytes * rate, &site->bytes_allocated);
+	atomic_long_add(rate, &site->nr_live);
+	atomic_long_add(bytes * rate, &site->bytes_live);
+	set_bit(pfn, alloc_sample_pfns);
+
+	current->in_alloc_sample = 0;
+	return;
+
+free_obj:
+	kfree(obj);
+drop:
+	atomic_long_inc(&alloc_sample_dropped);
+	current->in_alloc_sample = 0;
+}
+
+static void alloc_sample_forget(void *addr, bool unrecord)
+{
+	struct alloc_sample_obj *obj;
+	unsigned long flags;
+
+	xa_lock_irqsave(&alloc_sample_objs, flags);
+	obj = __xa_erase(&alloc_sample_objs,
+			 (unsigned long)addr / ARCH_SLAB_MINALIGN);
+	xa_unlock_irqrestore(&alloc_sample_objs, flags);
+	if (obj)
+		alloc_sample_put_obj(obj, unrecord);
+}
+
+void __alloc_sample_slab(struct kmem_cache *s, void *object)
+{
+	alloc_sample_record(kasan_reset_tag(object), s->object_size);
+}
+
+void __alloc_sample_slab_free(struct kmem_cache *s, void *object)
+{
+	/*
+	 * The bit stays set for other objects sharing the page frame; it is
+	 * cleared once the slab page itself is freed.
+	 */
+	alloc_sample_forget(kasan_reset_tag(object), false);
+}
+
+void __alloc_sample_pages(struct page *page, unsigned int order)
+{
+	if (PageHighMem(page))
+		return;
+
+	alloc_sample_record(page_address(page), PAGE_SIZE << order);
+}
+
+/*
+ * Slab pages come from the page allocator too. The objects carved out of
+ * them are what gets sampled, not the page itself.
+ */
+void __alloc_sample_slab_page(struct page *page, unsigned int order)
+{
+	if (!PageHighMem(page))
+		alloc_sample_forget(page_address(page), true);
+}
+
+void __alloc_sample_pages_free(struct page *page, unsigned int order)
+{
+	unsigned long pfn = page_to_pfn(page);
+	unsigned long end = pfn + (1UL << order);
+	struct alloc_sample_obj *obj, *next;
+	unsigned long index, last;
+	unsigned long flags;
+	LIST_HEAD(objs);
+
+	if (pfn >= alloc_sample_nr_pfns)
+		return;
+	end = min(end, alloc_sample_nr_pfns);
+	if (find_next_bit(alloc_sample_pfns, end, pfn) >= end)
+		return;
+
+	bitmap_clear(alloc_sample_pfns, pfn, end - pfn);
+	if (PageHighMem(page))
+		return;
+
+	/*
+	 * Besides a sampled page allocation, a freed slab page can still have
+	 * sampled objects that were never freed, e.g. by a destroyed cache.
+	 */
+	index = (unsigned long)page_address(page) / ARCH_SLAB_MINALIGN;
+	last = index + (PAGE_SIZE << order) / ARCH_SLAB_MINALIGN - 1;
+	xa_lock_irqsave(&alloc_sample_objs, flags);
+	xa_for_each_range(&alloc_sample_objs, index, obj, index, last) {
+		__xa_erase(&alloc_sample_objs, index);
+		list_add(&obj->list, &objs);
+	}
+	xa_unlock_irqrestore(&alloc_sample_objs, flags);
+
+	list_for_each_entry_safe(obj, next, &objs, list)
+		alloc_sample_put_obj(obj, false);
+}
+
+/* Called with alloc_sample_mutex held, once the allocators are up */
+static int alloc_sample_enable(void)
+{
+	unsigned long *pfns;
+	int cpu;
+
+	if (!alloc_sample_pfns) {
+		pfns = vzalloc(BITS_TO_LONGS(max_pfn) * sizeof(long));
+		if (!pfns)
+			return -ENOMEM;
+		alloc_sample_pfns = pfns;
+		/* Publish the bitmap before its size */
+		smp_store_release(&alloc_sample_nr_pfns, max_pfn);
+	}
+
+	for_each_possible_cpu(cpu)
+		per_cpu(alloc_sample_countdown, cpu) = alloc_sample_rate;
+	static_branch_enable(&alloc_sample_key);
+
+	return 0;
+}
+
+static bool alloc_sample_ready;
+
+static int alloc_sample_rate_set(const char *val,
+				 const struct kernel_param *kp)
+{
+	unsigned long rate, old;
+	int ret;
+
+	ret = kstrtoul(val, 0, &rate);
+	if (ret)
+		return ret;
+
+	mutex_lock(&alloc_sample_mutex);
+	old = alloc_sample_rate;
+	WRITE_ONCE(alloc_sample_rate, rate);
+	if (alloc_sample_ready) {
+		if (rate && !old) {
+			ret = alloc_sample_enable();
+			if (ret)
+				WRITE_ONCE(alloc_sample_rate, 0);
+		} else if (!rate && old) {
+			/* Records of live objects are kept until they are freed */
+			static_branch_disable(&alloc_sample_key);
+		}
+	}
+	mutex_unlock(&alloc_sample_mutex);
+
+	return ret;
+}
+
+static const struct kernel_param_ops alloc_sample_rate_ops = {
+	.set = alloc_sample_rate_set,
+	.get = param_get_ulong,
+};
+module_param_cb(rate, &alloc_sample_rate_ops, &alloc_sample_rate, 0600);
+MODULE_PARM_DESC(rate, "Sample one in about this many allocations, 0 to disable");
+
+static void *alloc_sample_seq_start(struct seq_file *m, loff_t *pos)
+	__acquires(RCU)
+{
+	rcu_read_lock();
+	if (!*pos)
+		seq_printf(m, "rate %lu dropped %ld\n",
+			   READ_ONCE(alloc_sample_rate),
+			   atomic_long_read(&alloc_sample_dropped));
+	return seq_list_start_rcu(&alloc_sample_site_list, *pos);
+}
+
+static void *alloc_sample_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	return seq_list_next_rcu(v, &alloc_sample_site_list, pos);
+}
+
+static void alloc_sample_seq_stop(struct seq_file *m, void *v)
+	__releases(RCU)
+{
+	rcu_read_unlock();
+}
+
+static int alloc_sample_seq_show(struct seq_file *m, void *v)
+{
+	struct alloc_sample_site *site = list_entry(v, struct alloc_sample_site,
+						    list);
+	unsigned long *entries;
+	unsigned int nr_entries, i;
+
+	seq_printf(m, "\nlive %ld bytes %ld allocs %ld bytes %ld\n",
+		   atomic_long_read(&site->nr_live),
+		   atomic_long_read(&site->bytes_live),
+		   atomic_long_read(&site->nr_allocs),
+		   atomic_long_read(&site->bytes_allocated));
+
+	nr_entries = stack_depot_fetch(site->handle, &entries);
+	for (i = 0; i < nr_entries; i++)
+		seq_printf(m, " %pS\n", (void *)entries[i]);
+
+	return 0;
+}
+
+static const struct seq_operations alloc_sample_seq_ops = {
+	.start	= alloc_sample_seq_start,
+	.next	= alloc_sample_seq_next,
+	.stop	= alloc_sample_seq_stop,
+	.show	= alloc_sample_seq_show,
+};
+
+static int __init alloc_sample_init(void)
+{
+	int ret = 0;
+
+	mutex_lock(&alloc_sample_mutex);
+	alloc_sample_ready = true;
+	if (alloc_sample_rate) {
+		ret = alloc_sample_enable();
+		if (ret)
+			alloc_sample_rate = 0;
+	}
+	mutex_unlock(&alloc_sample_mutex);
+
+	proc_create_seq("alloc_samples", 0400, NULL, &alloc_sample_seq_ops);
+	return ret;
+}
+late_initcall(alloc_sample_init);
@@ -197,6 +197,25 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t bw_period_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	unsigned int msecs;
+	ssize_t ret;
+
+	ret = kstrtouint(buf, 10, &msecs);
+	if (ret < 0)
+		return ret;
+
+	ret = bdi_set_bw_period(bdi, msecs);
+	if (!ret)
+		ret = count;
+
+	return ret;
+}
+BDI_SHOW(bw_period_ms, jiffies_to_msecs(READ_ONCE(bdi->bw_period)))
+
 static ssize_t stable_pages_required_show(struct device *dev,
 					  struct device_attribute *attr,
 					  char *buf)
@@ -211,6 +230,7 @@ static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_read_ahead_kb.attr,
 	&dev_attr_min_ratio.attr,
 	&dev_attr_max_ratio.attr,
+	&dev_attr_bw_period_ms.attr,
 	&dev_attr_stable_pages_required.attr,
 	NULL,
 };
@@ -787,6 +807,7 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = FPROP_FRAC_BASE;
+	bdi->bw_period = BDI_BW_PERIOD;
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->wb_list);
 	init_waitqueue_head(&bdi->wb_waitq);
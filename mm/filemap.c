@@ -1003,6 +1003,99 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_batch_lru - add contiguous pages to the page cache
+ * @pvec:	pages to add
+ * @mapping:	the pages' address_space
+ * @index:	index of the first page, the others follow it
+ * @gfp_mask:	page allocation mode
+ *
+ * Like add_to_page_cache_lru() for each page of @pvec, but the pages are
+ * charged to the memcg at once and all inserted under a single hold of the
+ * i_pages lock.  Insertion stops at the first index that is already
+ * occupied by a page or by a multi-index shadow entry; the pages that were
+ * not added are left as they were passed in.
+ *
+ * Return: the number of pages added, locked and on the LRU, or a negative
+ * error code if none of them could be charged.
+ */
+int add_to_page_cache_batch_lru(struct pagevec *pvec,
+				struct address_space *mapping,
+				pgoff_t index, gfp_t gfp_mask)
+{
+	XA_STATE(xas, &mapping->i_pages, index);
+	unsigned int nr = pagevec_count(pvec);
+	void *shadows[PAGEVEC_SIZE];
+	gfp_t gfp = gfp_mask & GFP_RECLAIM_MASK;
+	unsigned int i, added = 0;
+	bool stop = false;
+	struct page *page;
+	int error;
+
+	mapping_set_update(&xas, mapping);
+
+	for (i = 0; i < nr; i++) {
+		page = pvec->pages[i];
+		VM_BUG_ON_PAGE(PageSwapBacked(page), page);
+		__SetPageLocked(page);
+		get_page(page);
+		page->mapping = mapping;
+		page->index = index + i;
+	}
+
+	error = mem_cgroup_charge_batch(pvec->pages, nr, NULL, gfp_mask);
+	if (error)
+		goto undo;
+
+	do {
+		xas_set(&xas, index + added);
+		xas_lock_irq(&xas);
+		for (; added < nr; added++) {
+			void *entry = xas_load(&xas);
+
+			if (entry && (!xa_is_value(entry) ||
+				      xa_get_order(xas.xa, xas.xa_index))) {
+				stop = true;
+				break;
+			}
+
+			page = pvec->pages[added];
+			xas_store(&xas, page);
+			if (xas_error(&xas))
+				break;
+
+			shadows[added] = entry;
+			mapping->nrpages++;
+			__inc_lruvec_page_state(page, NR_FILE_PAGES);
+			xas_next(&xas);
+		}
+		xas_unlock_irq(&xas);
+	} while (added < nr && !stop && xas_nomem(&xas, gfp));
+
+	for (i = added; i < nr; i++)
+		mem_cgroup_uncharge(pvec->pages[i]);
+undo:
+	for (i = added; i < nr; i++) {
+		page = pvec->pages[i];
+		page->mapping = NULL;
+		put_page(page);
+		__ClearPageLocked(page);
+	}
+
+	for (i = 0; i < added; i++) {
+		page = pvec->pages[i];
+		trace_mm_filemap_add_to_page_cache(page);
+		/* See add_to_page_cache_lru() */
+		WARN_ON_ONCE(PageActive(page));
+		if (!(gfp_mask & __GFP_WRITE) && shadows[i])
+			workingset_refault(page, shadows[i]);
+		lru_cache_add(page);
+	}
+
+	return added ? added : error;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_batch_lru);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -2544,6 +2637,7 @@ static int filemap_get_pages(struct kiocb *iocb, struct iov_iter *iter,
 		return -EINTR;
 
 	filemap_get_read_batch(mapping, index, last_index, pvec);
+	file_ra_account(ra, pagevec_count(pvec));
 	if (!pagevec_count(pvec)) {
 		if (iocb->ki_flags & IOCB_NOIO)
 			return -EAGAIN;
@@ -2891,6 +2985,14 @@ loff_t mapping_seek_hole_data(struct address_space *mapping, loff_t start,
 
 #ifdef CONFIG_MMU
 #define MMAP_LOTSAMISS  (100)
+
+/* Counts page cache lookups through a file, these are racy but harmless */
+static inline void file_ra_account(struct file_ra_state *ra, bool hit)
+{
+	unsigned int *counter = hit ? &ra->nr_hits : &ra->nr_misses;
+
+	WRITE_ONCE(*counter, READ_ONCE(*counter) + 1);
+}
 /*
  * lock_page_maybe_drop_mmap - lock the page, possibly dropping the mmap_lock
  * @vmf - the vm_fault for this fault.
@@ -2942,6 +3044,69 @@ static int lock_page_maybe_drop_mmap(struct vm_fault *vmf, struct page *page,
  * that.  If we didn't pin a file then we return NULL.  The file that is
  * returned needs to be fput()'ed when we're done with it.
  */
+/*
+ * Track runs of consecutive major faults, and the distance between the
+ * starts of successive runs. Returns true once the same stride has been
+ * seen RA_STRIDE_MIN_HITS times in a row, and it is larger than the runs.
+ */
+static bool mmap_detect_stride(struct file_ra_state *ra, pgoff_t index)
+{
+	long stride;
+
+	if (ra->run_len && index == ra->run_start + ra->run_len) {
+		/* The current run goes on */
+		if (ra->run_len < ra->ra_pages)
+			ra->run_len++;
+		return false;
+	}
+
+	stride = (long)(index - ra->run_start);
+	if (ra->run_len && stride == ra->stride) {
+		if (ra->stride_hits < RA_STRIDE_MIN_HITS)
+			ra->stride_hits++;
+	} else {
+		ra->stride = stride;
+		ra->stride_hits = 0;
+	}
+	ra->prev_run_len = max(ra->run_len, 1U);
+	ra->run_start = index;
+	ra->run_len = 1;
+
+	return ra->stride_hits >= RA_STRIDE_MIN_HITS &&
+	       abs(ra->stride) > ra->prev_run_len;
+}
+
+/*
+ * Read the runs at the next strides ahead, rather than a window around the
+ * fault that would mostly be wasted, for at most ra_pages in total.
+ */
+static void mmap_stride_readahead(struct readahead_control *ractl,
+				  struct file_ra_state *ra, pgoff_t index)
+{
+	unsigned int len = min(ra->prev_run_len, ra->ra_pages);
+	unsigned int nr = max(ra->ra_pages / len, 1U);
+	unsigned int i;
+	pgoff_t target = index;
+
+	for (i = 0; i < nr; i++) {
+		ractl->_index = target;
+		do_page_cache_ra(ractl, len, 0);
+		ra->run_start = target;
+
+		if (ra->stride < 0 && target < -ra->stride)
+			break;
+		target += ra->stride;
+	}
+	/*
+	 * The next fault is expected one stride after the last run read, so
+	 * the stride keeps being confirmed. Don't count it as a new run.
+	 */
+	ra->run_len = len;
+	ra->start = index;
+	ra->size = len;
+	ra->async_size = 0;
+}
+
 static struct file *do_sync_mmap_readahead(struct vm_fault *vmf)
 {
 	struct file *file = vmf->vma->vm_file;
@@ -2951,6 +3116,8 @@ static struct file *do_sync_mmap_readahead(struct vm_fault *vmf)
 	struct file *fpin = NULL;
 	unsigned int mmap_miss;
 
+	file_ra_account(ra, false);
+
 	/* If we don't want any read-ahead, don't bother */
 	if (vmf->vma->vm_flags & VM_RAND_READ)
 		return fpin;
@@ -2963,6 +3130,16 @@ static struct file *do_sync_mmap_readahead(struct vm_fault *vmf)
 		return fpin;
 	}
 
+	/*
+	 * Strided access misses on every run, so it is detected before the
+	 * mmap_miss heuristic gives up on readahead.
+	 */
+	if (mmap_detect_stride(ra, vmf->pgoff)) {
+		fpin = maybe_unlock_mmap_for_io(vmf, fpin);
+		mmap_stride_readahead(&ractl, ra, vmf->pgoff);
+		return fpin;
+	}
+
 	/* Avoid banging the cache line if not needed */
 	mmap_miss = READ_ONCE(ra->mmap_miss);
 	if (mmap_miss < MMAP_LOTSAMISS * 10)
@@ -3002,6 +3179,8 @@ static struct file *do_async_mmap_readahead(struct vm_fault *vmf,
 	unsigned int mmap_miss;
 	pgoff_t offset = vmf->pgoff;
 
+	file_ra_account(ra, true);
+
 	/* If we don't want any read-ahead, don't bother */
 	if (vmf->vma->vm_flags & VM_RAND_READ || !ra->ra_pages)
 		return fpin;
@@ -19,7 +19,9 @@
 #include <linux/sched.h>
 #include <linux/sched/mm.h>
 #include <linux/uio.h>
+#include <linux/compat.h>
 #include <linux/ksm.h>
+#include <linux/khugepaged.h>
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/blkdev.h>
@@ -37,8 +39,14 @@
 struct madvise_walk_private {
 	struct mmu_gather *tlb;
 	bool pageout;
+	/* pages isolated for MADV_PAGEOUT, reclaimed in batches */
+	struct list_head page_list;
+	unsigned int nr_isolated;
 };
 
+/* Isolated pages to gather before reclaiming them */
+#define MADVISE_RECLAIM_BATCH	(SWAP_CLUSTER_MAX * 16)
+
 /*
  * Any behaviour which results in changes to the vma->vm_flags needs to
  * take mmap_lock for writing. Others, which simply traverse vmas, need
@@ -55,6 +63,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_FREE:
 	case MADV_POPULATE_READ:
 	case MADV_POPULATE_WRITE:
+	case MADV_COLLAPSE:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -170,6 +179,7 @@ static long madvise_behavior(struct vm_area_struct *vma,
 	/*
 	 * vm_flags is protected by the mmap_lock held in write mode.
 	 */
+	vma_start_write(vma);
 	vma->vm_flags = new_flags;
 
 out_convert_errno:
@@ -305,6 +315,36 @@ static long madvise_willneed(struct vm_area_struct *vma,
 	return 0;
 }
 
+static void madvise_isolate_page(struct madvise_walk_private *private,
+				 struct page *page)
+{
+	if (isolate_lru_page(page))
+		return;
+
+	if (PageUnevictable(page)) {
+		putback_lru_page(page);
+		return;
+	}
+	list_add(&page->lru, &private->page_list);
+	private->nr_isolated += thp_nr_pages(page);
+}
+
+/*
+ * Reclaim the pages isolated so far, once there are enough of them to make
+ * a batch or when @force is set at the end of the walk.
+ */
+static void madvise_reclaim_isolated(struct madvise_walk_private *private,
+				     bool force)
+{
+	if (!private->nr_isolated)
+		return;
+	if (!force && private->nr_isolated < MADVISE_RECLAIM_BATCH)
+		return;
+
+	reclaim_pages(&private->page_list);
+	private->nr_isolated = 0;
+}
+
 static int madvise_cold_or_pageout_pte_range(pmd_t *pmd,
 				unsigned long addr, unsigned long end,
 				struct mm_walk *walk)
@@ -317,7 +357,6 @@ static int madvise_cold_or_pageout_pte_range(pmd_t *pmd,
 	pte_t *orig_pte, *pte, ptent;
 	spinlock_t *ptl;
 	struct page *page = NULL;
-	LIST_HEAD(page_list);
 
 	if (fatal_signal_pending(current))
 		return -EINTR;
@@ -372,19 +411,13 @@ static int madvise_cold_or_pageout_pte_range(pmd_t *pmd,
 
 		ClearPageReferenced(page);
 		test_and_clear_page_young(page);
-		if (pageout) {
-			if (!isolate_lru_page(page)) {
-				if (PageUnevictable(page))
-					putback_lru_page(page);
-				else
-					list_add(&page->lru, &page_list);
-			}
-		} else
+		if (pageout)
+			madvise_isolate_page(private, page);
+		else
 			deactivate_page(page);
 huge_unlock:
 		spin_unlock(ptl);
-		if (pageout)
-			reclaim_pages(&page_list);
+		madvise_reclaim_isolated(private, false);
 		return 0;
 	}
 
@@ -461,21 +494,15 @@ static int madvise_cold_or_pageout_pte_range(pmd_t *pmd,
 		 */
 		ClearPageReferenced(page);
 		test_and_clear_page_young(page);
-		if (pageout) {
-			if (!isolate_lru_page(page)) {
-				if (PageUnevictable(page))
-					putback_lru_page(page);
-				else
-					list_add(&page->lru, &page_list);
-			}
-		} else
+		if (pageout)
+			madvise_isolate_page(private, page);
+		else
 			deactivate_page(page);
 	}
 
 	arch_leave_lazy_mmu_mode();
 	pte_unmap_unlock(orig_pte, ptl);
-	if (pageout)
-		reclaim_pages(&page_list);
+	madvise_reclaim_isolated(private, false);
 	cond_resched();
 
 	return 0;
@@ -492,6 +519,7 @@ static void madvise_cold_page_range(struct mmu_gather *tlb,
 	struct madvise_walk_private walk_private = {
 		.pageout = false,
 		.tlb = tlb,
+		.page_list = LIST_HEAD_INIT(walk_private.page_list),
 	};
 
 	tlb_start_vma(tlb, vma);
@@ -525,11 +553,13 @@ static void madvise_pageout_page_range(struct mmu_gather *tlb,
 	struct madvise_walk_private walk_private = {
 		.pageout = true,
 		.tlb = tlb,
+		.page_list = LIST_HEAD_INIT(walk_private.page_list),
 	};
 
 	tlb_start_vma(tlb, vma);
 	walk_page_range(vma->vm_mm, addr, end, &cold_walk_ops, &walk_private);
 	tlb_end_vma(tlb, vma);
+	madvise_reclaim_isolated(&walk_private, true);
 }
 
 static inline bool can_do_pageout(struct vm_area_struct *vma)
@@ -1002,6 +1032,8 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	case MADV_POPULATE_READ:
 	case MADV_POPULATE_WRITE:
 		return madvise_populate(vma, prev, start, end, behavior);
+	case MADV_COLLAPSE:
+		return madvise_collapse(vma, prev, start, end);
 	default:
 		return madvise_behavior(vma, prev, start, end, behavior);
 	}
@@ -1031,6 +1063,7 @@ madvise_behavior_valid(int behavior)
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	case MADV_HUGEPAGE:
 	case MADV_NOHUGEPAGE:
+	case MADV_COLLAPSE:
 #endif
 	case MADV_DONTDUMP:
 	case MADV_DODUMP:
@@ -1054,6 +1087,7 @@ process_madvise_behavior_valid(int behavior)
 	case MADV_COLD:
 	case MADV_PAGEOUT:
 	case MADV_WILLNEED:
+	case MADV_COLLAPSE:
 		return true;
 	default:
 		return false;
@@ -1116,6 +1150,8 @@ process_madvise_behavior_valid(int behavior)
  *		triggering read faults if required
  *  MADV_POPULATE_WRITE - populate (prefault) page tables writable by
  *		triggering write faults if required
+ *  MADV_COLLAPSE - synchronously coalesce pages into new transparent huge
+ *		pages.
  *
  * return values:
  *  zero    - success
@@ -1233,6 +1269,111 @@ SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
 	return do_madvise(current->mm, start, len_in, behavior);
 }
 
+/*
+ * MADV_COLD and MADV_PAGEOUT over the ranges of a process_madvise() vector
+ * share one mmap_lock hold, one LRU drain and one mmu_gather, and the pages
+ * isolated for pageout are reclaimed in batches across ranges.
+ */
+struct madvise_lru_batch {
+	struct mmu_gather tlb;
+	struct madvise_walk_private walk_private;
+	struct blk_plug plug;
+	/* vma the mmu_gather was last started on */
+	struct vm_area_struct *tlb_vma;
+};
+
+static void madvise_lru_batch_start(struct madvise_lru_batch *batch,
+				    struct mm_struct *mm, int behavior)
+{
+	lru_add_drain();
+	tlb_gather_mmu(&batch->tlb, mm);
+	batch->walk_private.tlb = &batch->tlb;
+	batch->walk_private.pageout = behavior == MADV_PAGEOUT;
+	INIT_LIST_HEAD(&batch->walk_private.page_list);
+	batch->walk_private.nr_isolated = 0;
+	batch->tlb_vma = NULL;
+	blk_start_plug(&batch->plug);
+}
+
+static void madvise_lru_batch_finish(struct madvise_lru_batch *batch)
+{
+	if (batch->tlb_vma)
+		tlb_end_vma(&batch->tlb, batch->tlb_vma);
+	madvise_reclaim_isolated(&batch->walk_private, true);
+	blk_finish_plug(&batch->plug);
+	tlb_finish_mmu(&batch->tlb);
+}
+
+/*
+ * Advise one range of the batch. Returns the number of bytes of the range
+ * covered by vmas, or -errno.
+ */
+static long madvise_lru_batch_range(struct madvise_lru_batch *batch,
+				    struct mm_struct *mm, unsigned long start,
+				    size_t len_in)
+{
+	struct vm_area_struct *vma;
+	unsigned long end, len;
+	long done = 0;
+
+	start = untagged_addr(start);
+	if (!PAGE_ALIGNED(start))
+		return -EINVAL;
+	len = PAGE_ALIGN(len_in);
+	if (len_in && !len)
+		return -EINVAL;
+	end = start + len;
+	if (end < start)
+		return -EINVAL;
+
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		unsigned long vm_start = max(start, vma->vm_start);
+		unsigned long vm_end = min(end, vma->vm_end);
+
+		if (fatal_signal_pending(current))
+			return -EINTR;
+
+		if (!can_madv_lru_vma(vma))
+			return -EINVAL;
+
+		done += vm_end - vm_start;
+		if (batch->walk_private.pageout && !can_do_pageout(vma))
+			continue;
+
+		/*
+		 * Ranges are usually sorted, so consecutive ones tend to fall
+		 * into the same vma and share its TLB flush.
+		 */
+		if (batch->tlb_vma != vma) {
+			if (batch->tlb_vma)
+				tlb_end_vma(&batch->tlb, batch->tlb_vma);
+			tlb_start_vma(&batch->tlb, vma);
+			batch->tlb_vma = vma;
+		}
+		walk_page_range(mm, vm_start, vm_end, &cold_walk_ops,
+				&batch->walk_private);
+	}
+
+	return done;
+}
+
+/* Store the bytes advised in range @idx of the user's vector */
+static int process_madvise_put_result(const struct iovec __user *vec,
+				      size_t idx, size_t done)
+{
+#ifdef CONFIG_COMPAT
+	if (in_compat_syscall()) {
+		const struct compat_iovec __user *cvec =
+			(const struct compat_iovec __user *)vec;
+
+		return put_user((compat_size_t)done,
+				(compat_size_t __user *)&cvec[idx].iov_len);
+	}
+#endif
+	return put_user(done, (size_t __user *)&vec[idx].iov_len);
+}
+
 SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 		size_t, vlen, int, behavior, unsigned int, flags)
 {
@@ -1243,13 +1384,16 @@ SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 	struct pid *pid;
 	struct task_struct *task;
 	struct mm_struct *mm;
+	struct madvise_lru_batch batch;
+	bool lru_batch, results;
 	size_t total_len;
 	unsigned int f_flags;
 
-	if (flags != 0) {
+	if (flags & ~PMADV_VEC_RESULT) {
 		ret = -EINVAL;
 		goto out;
 	}
+	results = flags & PMADV_VEC_RESULT;
 
 	ret = import_iovec(READ, vec, vlen, ARRAY_SIZE(iovstack), &iov, &iter);
 	if (ret < 0)
@@ -1290,15 +1434,50 @@ SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 
 	total_len = iov_iter_count(&iter);
 
+	lru_batch = behavior == MADV_COLD || behavior == MADV_PAGEOUT;
+	if (lru_batch) {
+		if (mmap_read_lock_killable(mm)) {
+			ret = -EINTR;
+			goto release_mm;
+		}
+		madvise_lru_batch_start(&batch, mm, behavior);
+	}
+
 	while (iov_iter_count(&iter)) {
+		size_t idx = iter.iov - iov;
+		long done;
+
 		iovec = iov_iter_iovec(&iter);
-		ret = do_madvise(mm, (unsigned long)iovec.iov_base,
-					iovec.iov_len, behavior);
+		if (lru_batch) {
+			done = madvise_lru_batch_range(&batch, mm,
+					(unsigned long)iovec.iov_base,
+					iovec.iov_len);
+			ret = done < 0 ? done : 0;
+			/* Like madvise(), holes fail the call unless reported */
+			if (!ret && done < PAGE_ALIGN(iovec.iov_len) && !results)
+				ret = -ENOMEM;
+		} else {
+			ret = do_madvise(mm, (unsigned long)iovec.iov_base,
+						iovec.iov_len, behavior);
+			done = iovec.iov_len;
+		}
 		if (ret < 0)
 			break;
+		if (results) {
+			done = min_t(size_t, done, iovec.iov_len);
+			if (process_madvise_put_result(vec, idx, done)) {
+				ret = -EFAULT;
+				break;
+			}
+		}
 		iov_iter_advance(&iter, iovec.iov_len);
 	}
 
+	if (lru_batch) {
+		madvise_lru_batch_finish(&batch);
+		mmap_read_unlock(mm);
+	}
+
 	ret = (total_len - iov_iter_count(&iter)) ? : ret;
 
 release_mm:
@@ -47,6 +47,7 @@
 #include <linux/page_idle.h>
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/sysctl.h>
 #include <linux/ptrace.h>
 #include <linux/oom.h>
 #include <linux/memory.h>
@@ -172,11 +173,60 @@ void putback_movable_pages(struct list_head *l)
 /*
  * Restore a potential migration pte to a working pte entry
  */
+struct rmap_walk_arg {
+	struct page *page;
+	bool map_unused_to_zeropage;
+};
+
+/*
+ * Map a zero-filled subpage of a just split THP to the shared zeropage
+ * instead of restoring the migration entry, so that the subpage is freed
+ * once the split drops its reference.
+ */
+static bool try_to_map_unused_to_zeropage(struct page_vma_mapped_walk *pvmw,
+					  struct page *page)
+{
+	struct vm_area_struct *vma = pvmw->vma;
+	bool contains_data;
+	pte_t newpte;
+	void *addr;
+
+	VM_BUG_ON_PAGE(PageCompound(page), page);
+	VM_BUG_ON_PAGE(!PageAnon(page), page);
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+	VM_BUG_ON_PAGE(pte_present(*pvmw->pte), page);
+
+	if (PageMlocked(page) || (vma->vm_flags & VM_LOCKED) ||
+	    userfaultfd_armed(vma) || pte_swp_uffd_wp(*pvmw->pte) ||
+	    mm_forbids_zeropage(vma->vm_mm))
+		return false;
+
+	/*
+	 * The pmd entry mapping the old thp was flushed and the pte mapping
+	 * this subpage has been non present. If the subpage is only zero-filled
+	 * then map it to the shared zeropage.
+	 */
+	addr = kmap_local_page(page);
+	contains_data = memchr_inv(addr, 0, PAGE_SIZE);
+	kunmap_local(addr);
+
+	if (contains_data)
+		return false;
+
+	newpte = pte_mkspecial(pfn_pte(my_zero_pfn(pvmw->address),
+				       vma->vm_page_prot));
+	set_pte_at(vma->vm_mm, pvmw->address, pvmw->pte, newpte);
+
+	dec_mm_counter(vma->vm_mm, MM_ANONPAGES);
+	return true;
+}
+
 static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
-				 unsigned long addr, void *old)
+				 unsigned long addr, void *arg)
 {
+	struct rmap_walk_arg *rmap_walk_arg = arg;
 	struct page_vma_mapped_walk pvmw = {
-		.page = old,
+		.page = rmap_walk_arg->page,
 		.vma = vma,
 		.address = addr,
 		.flags = PVMW_SYNC | PVMW_MIGRATION,
@@ -202,6 +252,10 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 		}
 #endif
 
+		if (rmap_walk_arg->map_unused_to_zeropage &&
+		    try_to_map_unused_to_zeropage(&pvmw, new))
+			continue;
+
 		get_page(new);
 		pte = pte_mkold(mk_pte(new, READ_ONCE(vma->vm_page_prot)));
 		if (pte_swp_soft_dirty(*pvmw.pte))
@@ -266,16 +320,23 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 
 /*
  * Get rid of all migration entries and replace them by
- * references to the indicated page.
+ * references to the indicated page. With RMP_USE_SHARED_ZEROPAGE,
+ * zero-filled subpages are mapped to the shared zeropage instead.
  */
-void remove_migration_ptes(struct page *old, struct page *new, bool locked)
+void remove_migration_ptes(struct page *old, struct page *new, int flags)
 {
+	struct rmap_walk_arg rmap_walk_arg = {
+		.page = old,
+		.map_unused_to_zeropage = flags & RMP_USE_SHARED_ZEROPAGE,
+	};
 	struct rmap_walk_control rwc = {
 		.rmap_one = remove_migration_pte,
-		.arg = old,
+		.arg = &rmap_walk_arg,
 	};
 
-	if (locked)
+	VM_BUG_ON_PAGE((flags & RMP_USE_SHARED_ZEROPAGE) && old != new, old);
+
+	if (flags & RMP_LOCKED)
 		rmap_walk_locked(new, &rwc);
 	else
 		rmap_walk(new, &rwc);
@@ -576,6 +637,13 @@ void migrate_page_states(struct page *newpage, struct page *page)
 	 * future migrations of this same page.
 	 */
 	cpupid = page_cpupid_xchg_last(page, -1);
+	/*
+	 * Across tiers, the field means an access time on one side and a
+	 * cpupid on the other (see xchg_page_access_time()): don't copy it.
+	 */
+	if (node_is_toptier(page_to_nid(page)) !=
+	    node_is_toptier(page_to_nid(newpage)))
+		cpupid = -1;
 	page_cpupid_xchg_last(newpage, cpupid);
 
 	ksm_migrate_page(newpage, page);
@@ -828,7 +896,7 @@ static int writeout(struct address_space *mapping, struct page *page)
 	 * At this point we know that the migration attempt cannot
 	 * be successful.
 	 */
-	remove_migration_ptes(page, page, false);
+	remove_migration_ptes(page, page, 0);
 
 	rc = mapping->a_ops->writepage(page, &wbc);
 
@@ -959,8 +1027,45 @@ static int move_to_new_page(struct page *newpage, struct page *page,
 	return rc;
 }
 
-static int __unmap_and_move(struct page *page, struct page *newpage,
-				int force, enum migrate_mode mode)
+/*
+ * The page has been unmapped, or needs no unmapping, and both it and newpage
+ * are locked: only the copy is left to be done by __migrate_page_move().
+ */
+#define MIGRATEPAGE_UNMAP		1
+
+/*
+ * Between the unmap and the move phase, newpage->private remembers the
+ * anon_vma reference taken and whether the page was mapped.
+ */
+static void __migrate_page_record(struct page *newpage, bool page_was_mapped,
+				  struct anon_vma *anon_vma)
+{
+	set_page_private(newpage, (unsigned long)anon_vma | page_was_mapped);
+}
+
+static void __migrate_page_extract(struct page *newpage,
+				   bool *page_was_mapped,
+				   struct anon_vma **anon_vma)
+{
+	unsigned long private = page_private(newpage);
+
+	*anon_vma = (struct anon_vma *)(private & ~1UL);
+	*page_was_mapped = private & 1;
+	set_page_private(newpage, 0);
+}
+
+/*
+ * Lock the page and newpage and replace the ptes mapping the page with
+ * migration entries. With TTU_BATCH_FLUSH in @ttu, the TLB flush is left to
+ * the caller, which must do it with try_to_unmap_flush() before the page is
+ * copied.
+ *
+ * Returns MIGRATEPAGE_UNMAP on success, or an error code once the page and
+ * newpage have been unlocked again.
+ */
+static int __migrate_page_unmap(struct page *page, struct page *newpage,
+				int force, enum migrate_mode mode,
+				enum ttu_flags ttu)
 {
 	int rc = -EAGAIN;
 	bool page_was_mapped = false;
@@ -1039,8 +1144,8 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		goto out_unlock;
 
 	if (unlikely(!is_lru)) {
-		rc = move_to_new_page(newpage, page, mode);
-		goto out_unlock_both;
+		__migrate_page_record(newpage, false, anon_vma);
+		return MIGRATEPAGE_UNMAP;
 	}
 
 	/*
@@ -1065,16 +1170,17 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		/* Establish migration ptes */
 		VM_BUG_ON_PAGE(PageAnon(page) && !PageKsm(page) && !anon_vma,
 				page);
-		try_to_migrate(page, 0);
+		try_to_migrate(page, ttu);
 		page_was_mapped = true;
 	}
 
-	if (!page_mapped(page))
-		rc = move_to_new_page(newpage, page, mode);
+	if (!page_mapped(page)) {
+		__migrate_page_record(newpage, page_was_mapped, anon_vma);
+		return MIGRATEPAGE_UNMAP;
+	}
 
 	if (page_was_mapped)
-		remove_migration_ptes(page,
-			rc == MIGRATEPAGE_SUCCESS ? newpage : page, false);
+		remove_migration_ptes(page, page, 0);
 
 out_unlock_both:
 	unlock_page(newpage);
@@ -1084,6 +1190,35 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		put_anon_vma(anon_vma);
 	unlock_page(page);
 out:
+	return rc;
+}
+
+/*
+ * Copy a page unmapped by __migrate_page_unmap() to newpage, point its
+ * migration entries at the result and unlock both pages.
+ */
+static int __migrate_page_move(struct page *page, struct page *newpage,
+			       enum migrate_mode mode)
+{
+	int rc;
+	bool page_was_mapped;
+	struct anon_vma *anon_vma;
+	bool is_lru = !__PageMovable(page);
+
+	__migrate_page_extract(newpage, &page_was_mapped, &anon_vma);
+
+	rc = move_to_new_page(newpage, page, mode);
+
+	if (page_was_mapped)
+		remove_migration_ptes(page,
+			rc == MIGRATEPAGE_SUCCESS ? newpage : page, 0);
+
+	unlock_page(newpage);
+	/* Drop an anon_vma reference if we took one */
+	if (anon_vma)
+		put_anon_vma(anon_vma);
+	unlock_page(page);
+
 	/*
 	 * If migration is successful, decrease refcount of the newpage
 	 * which will not free the page because new page owner increased
@@ -1177,16 +1312,24 @@ int next_demotion_node(int node)
 	return target;
 }
 
+static void unmap_and_move_finish(free_page_t put_new_page,
+				  unsigned long private, struct page *page,
+				  struct page *newpage, int rc,
+				  enum migrate_reason reason,
+				  struct list_head *ret);
+
 /*
- * Obtain the lock on page, remove all ptes and migrate the page
- * to the newly allocated page in newpage.
+ * Obtain the lock on page and remove all ptes, the first half of
+ * unmap_and_move(). On MIGRATEPAGE_UNMAP, *@newpagep is the page to be
+ * passed to migrate_page_move() and the page is left on its list.
  */
-static int unmap_and_move(new_page_t get_new_page,
-				   free_page_t put_new_page,
-				   unsigned long private, struct page *page,
-				   int force, enum migrate_mode mode,
-				   enum migrate_reason reason,
-				   struct list_head *ret)
+static int migrate_page_unmap(new_page_t get_new_page,
+			      free_page_t put_new_page,
+			      unsigned long private, struct page *page,
+			      struct page **newpagep, int force,
+			      enum migrate_mode mode,
+			      enum migrate_reason reason,
+			      struct list_head *ret, enum ttu_flags ttu)
 {
 	int rc = MIGRATEPAGE_SUCCESS;
 	struct page *newpage = NULL;
@@ -1211,11 +1354,71 @@ static int unmap_and_move(new_page_t get_new_page,
 	if (!newpage)
 		return -ENOMEM;
 
-	rc = __unmap_and_move(page, newpage, force, mode);
-	if (rc == MIGRATEPAGE_SUCCESS)
-		set_page_owner_migrate_reason(newpage, reason);
+	rc = __migrate_page_unmap(page, newpage, force, mode, ttu);
+	if (rc == MIGRATEPAGE_UNMAP) {
+		*newpagep = newpage;
+		return rc;
+	}
 
 out:
+	unmap_and_move_finish(put_new_page, private, page, newpage, rc,
+			      reason, ret);
+	return rc;
+}
+
+/* Second half of unmap_and_move(): copy the page and remove the old one */
+/*
+ * Count pages moving between memory tiers against the node and memcg they
+ * moved to, so that memory.stat and memory.numa_stat show them.
+ */
+static void migrate_account_tiering(struct page *page, struct page *newpage,
+				    enum migrate_reason reason)
+{
+	int nr_pages = thp_nr_pages(newpage);
+
+	switch (reason) {
+	case MR_DEMOTION:
+		mod_lruvec_page_state(newpage, current_is_kswapd() ?
+				      PGDEMOTE_KSWAPD : PGDEMOTE_DIRECT,
+				      nr_pages);
+		break;
+#ifdef CONFIG_NUMA_BALANCING
+	case MR_NUMA_MISPLACED:
+		if (!node_is_toptier(page_to_nid(page)) &&
+		    node_is_toptier(page_to_nid(newpage)))
+			mod_lruvec_page_state(newpage, PGPROMOTE_SUCCESS,
+					      nr_pages);
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+static int migrate_page_move(free_page_t put_new_page, unsigned long private,
+			     struct page *page, struct page *newpage,
+			     enum migrate_mode mode, enum migrate_reason reason,
+			     struct list_head *ret)
+{
+	int rc;
+
+	rc = __migrate_page_move(page, newpage, mode);
+	if (rc == MIGRATEPAGE_SUCCESS) {
+		set_page_owner_migrate_reason(newpage, reason);
+		migrate_account_tiering(page, newpage, reason);
+	}
+
+	unmap_and_move_finish(put_new_page, private, page, newpage, rc,
+			      reason, ret);
+	return rc;
+}
+
+static void unmap_and_move_finish(free_page_t put_new_page,
+				  unsigned long private, struct page *page,
+				  struct page *newpage, int rc,
+				  enum migrate_reason reason,
+				  struct list_head *ret)
+{
 	if (rc != -EAGAIN) {
 		/*
 		 * A page that has been migrated has all references
@@ -1254,6 +1457,27 @@ static int unmap_and_move(new_page_t get_new_page,
 		else
 			put_page(newpage);
 	}
+}
+
+/*
+ * Obtain the lock on page, remove all ptes and migrate the page
+ * to the newly allocated page in newpage.
+ */
+static int unmap_and_move(new_page_t get_new_page,
+				   free_page_t put_new_page,
+				   unsigned long private, struct page *page,
+				   int force, enum migrate_mode mode,
+				   enum migrate_reason reason,
+				   struct list_head *ret)
+{
+	struct page *newpage = NULL;
+	int rc;
+
+	rc = migrate_page_unmap(get_new_page, put_new_page, private, page,
+				&newpage, force, mode, reason, ret, 0);
+	if (rc == MIGRATEPAGE_UNMAP)
+		rc = migrate_page_move(put_new_page, private, page, newpage,
+				       mode, reason, ret);
 
 	return rc;
 }
@@ -1370,7 +1594,7 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
 
 	if (page_was_mapped)
 		remove_migration_ptes(hpage,
-			rc == MIGRATEPAGE_SUCCESS ? new_hpage : hpage, false);
+			rc == MIGRATEPAGE_SUCCESS ? new_hpage : hpage, 0);
 
 unlock_put_anon:
 	unlock_page(new_hpage);
@@ -1419,6 +1643,82 @@ static inline int try_split_thp(struct page *page, struct page **page2,
 	return rc;
 }
 
+/* Largest number of base pages migrate_pages() keeps unmapped at once */
+#define NR_MAX_BATCHED_MIGRATION	512
+
+struct migrate_pages_stats {
+	int nr_succeeded;
+	int nr_failed;
+	int nr_thp_succeeded;
+	int nr_thp_failed;
+	int retry;
+	int thp_retry;
+};
+
+/*
+ * Move the pages unmapped by migrate_page_unmap() to the new pages at the
+ * same position on @new_pages. The ptes of the whole batch are flushed from
+ * the TLB at once first, so the pages can't be written while being copied.
+ * Pages to be retried go to @retry_pages.
+ */
+static void migrate_pages_batch_move(struct list_head *unmap_pages,
+				     struct list_head *new_pages,
+				     struct list_head *retry_pages,
+				     free_page_t put_new_page,
+				     unsigned long private,
+				     enum migrate_mode mode, int reason,
+				     struct list_head *ret_pages,
+				     struct migrate_pages_stats *stats)
+{
+	struct page *page, *page2, *newpage, *newpage2;
+	int rc, nr_subpages;
+	bool is_thp;
+
+	/*
+	 * Pages that failed to unmap completely had their ptes restored, but
+	 * may still have left a flush pending. Do it even if there's nothing
+	 * to move.
+	 */
+	try_to_unmap_flush();
+
+	if (list_empty(unmap_pages))
+		return;
+
+	newpage = list_first_entry(new_pages, struct page, lru);
+	newpage2 = list_next_entry(newpage, lru);
+	list_for_each_entry_safe(page, page2, unmap_pages, lru) {
+		is_thp = PageTransHuge(page);
+		nr_subpages = thp_nr_pages(page);
+		cond_resched();
+
+		list_del(&newpage->lru);
+		rc = migrate_page_move(put_new_page, private, page, newpage,
+				       mode, reason, ret_pages);
+		switch (rc) {
+		case -EAGAIN:
+			list_move_tail(&page->lru, retry_pages);
+			if (is_thp)
+				stats->thp_retry++;
+			else
+				stats->retry++;
+			break;
+		case MIGRATEPAGE_SUCCESS:
+			if (is_thp)
+				stats->nr_thp_succeeded++;
+			stats->nr_succeeded += nr_subpages;
+			break;
+		default:
+			if (is_thp)
+				stats->nr_thp_failed++;
+			stats->nr_failed += nr_subpages;
+			break;
+		}
+
+		newpage = newpage2;
+		newpage2 = list_next_entry(newpage, lru);
+	}
+}
+
 /*
  * migrate_pages - migrate the pages specified in a list, to the free pages
  *		   supplied as the target for the page migration
@@ -1446,30 +1746,37 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 		free_page_t put_new_page, unsigned long private,
 		enum migrate_mode mode, int reason, unsigned int *ret_succeeded)
 {
-	int retry = 1;
-	int thp_retry = 1;
-	int nr_failed = 0;
-	int nr_succeeded = 0;
-	int nr_thp_succeeded = 0;
-	int nr_thp_failed = 0;
+	struct migrate_pages_stats stats = { };
 	int nr_thp_split = 0;
 	int pass = 0;
 	bool is_thp = false;
 	struct page *page;
 	struct page *page2;
+	struct page *newpage;
 	int swapwrite = current->flags & PF_SWAPWRITE;
 	int rc, nr_subpages;
+	int nr_batched;
 	LIST_HEAD(ret_pages);
+	LIST_HEAD(retry_pages);
+	LIST_HEAD(unmap_pages);
+	LIST_HEAD(new_pages);
 	bool nosplit = (reason == MR_NUMA_MISPLACED);
+	/*
+	 * Asynchronous migration only trylocks pages, so it can keep a batch
+	 * of them locked and unmapped while it unmaps the next ones.
+	 */
+	bool batch = (mode == MIGRATE_ASYNC);
 
 	trace_mm_migrate_pages_start(mode, reason);
 
 	if (!swapwrite)
 		current->flags |= PF_SWAPWRITE;
 
-	for (pass = 0; pass < 10 && (retry || thp_retry); pass++) {
-		retry = 0;
-		thp_retry = 0;
+	stats.retry = 1;
+	for (pass = 0; pass < 10 && (stats.retry || stats.thp_retry); pass++) {
+		stats.retry = 0;
+		stats.thp_retry = 0;
+		nr_batched = 0;
 
 		list_for_each_entry_safe(page, page2, from, lru) {
 retry:
@@ -1487,6 +1794,12 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 						put_new_page, private, page,
 						pass > 2, mode, reason,
 						&ret_pages);
+			else if (batch)
+				rc = migrate_page_unmap(get_new_page,
+						put_new_page, private, page,
+						&newpage, pass > 2, mode,
+						reason, &ret_pages,
+						TTU_BATCH_FLUSH);
 			else
 				rc = unmap_and_move(get_new_page, put_new_page,
 						private, page, pass > 2, mode,
@@ -1495,6 +1808,8 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 			 * The rules are:
 			 *	Success: non hugetlb page will be freed, hugetlb
 			 *		 page will be put back
+			 *	Unmap: page and newpage go to the batch to be
+			 *	       moved
 			 *	-EAGAIN: stay on the from list
 			 *	-ENOMEM: stay on the from list
 			 *	Other errno: put on ret_pages list then splice to
@@ -1520,13 +1835,13 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 						goto retry;
 					}
 
-					nr_thp_failed++;
-					nr_failed += nr_subpages;
+					stats.nr_thp_failed++;
+					stats.nr_failed += nr_subpages;
 					break;
 				}
 
 				/* Hugetlb migration is unsupported */
-				nr_failed++;
+				stats.nr_failed++;
 				break;
 			case -ENOMEM:
 				/*
@@ -1540,26 +1855,45 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 						goto retry;
 					}
 
-					nr_thp_failed++;
-					nr_failed += nr_subpages;
+					stats.nr_thp_failed++;
+					stats.nr_failed += nr_subpages;
 					goto out;
 				}
-				nr_failed++;
+				stats.nr_failed++;
 				goto out;
+			case MIGRATEPAGE_UNMAP:
+				list_move_tail(&page->lru, &unmap_pages);
+				list_add_tail(&newpage->lru, &new_pages);
+				nr_batched += nr_subpages;
+				if (nr_batched >= NR_MAX_BATCHED_MIGRATION) {
+					migrate_pages_batch_move(&unmap_pages,
+						&new_pages, &retry_pages,
+						put_new_page, private, mode,
+						reason, &ret_pages, &stats);
+					nr_batched = 0;
+				}
+				break;
 			case -EAGAIN:
+				/*
+				 * The pages of a batch that need another try
+				 * join those on the retry list, which is
+				 * spliced back at the end of the pass.
+				 */
+				if (batch && !PageHuge(page))
+					list_move_tail(&page->lru, &retry_pages);
 				if (is_thp) {
-					thp_retry++;
+					stats.thp_retry++;
 					break;
 				}
-				retry++;
+				stats.retry++;
 				break;
 			case MIGRATEPAGE_SUCCESS:
 				if (is_thp) {
-					nr_thp_succeeded++;
-					nr_succeeded += nr_subpages;
+					stats.nr_thp_succeeded++;
+					stats.nr_succeeded += nr_subpages;
 					break;
 				}
-				nr_succeeded++;
+				stats.nr_succeeded++;
 				break;
 			default:
 				/*
@@ -1569,38 +1903,49 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 				 * retried in the next outer loop.
 				 */
 				if (is_thp) {
-					nr_thp_failed++;
-					nr_failed += nr_subpages;
+					stats.nr_thp_failed++;
+					stats.nr_failed += nr_subpages;
 					break;
 				}
-				nr_failed++;
+				stats.nr_failed++;
 				break;
 			}
 		}
+		migrate_pages_batch_move(&unmap_pages, &new_pages,
+					 &retry_pages, put_new_page, private,
+					 mode, reason, &ret_pages, &stats);
+		list_splice_tail_init(&retry_pages, from);
 	}
-	nr_failed += retry + thp_retry;
-	nr_thp_failed += thp_retry;
-	rc = nr_failed;
+	stats.nr_failed += stats.retry + stats.thp_retry;
+	stats.nr_thp_failed += stats.thp_retry;
+	rc = stats.nr_failed;
 out:
+	/* Finish the batch cut short by -ENOMEM */
+	migrate_pages_batch_move(&unmap_pages, &new_pages, &retry_pages,
+				 put_new_page, private, mode, reason,
+				 &ret_pages, &stats);
+	list_splice_tail_init(&retry_pages, from);
+
 	/*
 	 * Put the permanent failure page back to migration list, they
 	 * will be put back to the right list by the caller.
 	 */
 	list_splice(&ret_pages, from);
 
-	count_vm_events(PGMIGRATE_SUCCESS, nr_succeeded);
-	count_vm_events(PGMIGRATE_FAIL, nr_failed);
-	count_vm_events(THP_MIGRATION_SUCCESS, nr_thp_succeeded);
-	count_vm_events(THP_MIGRATION_FAIL, nr_thp_failed);
+	count_vm_events(PGMIGRATE_SUCCESS, stats.nr_succeeded);
+	count_vm_events(PGMIGRATE_FAIL, stats.nr_failed);
+	count_vm_events(THP_MIGRATION_SUCCESS, stats.nr_thp_succeeded);
+	count_vm_events(THP_MIGRATION_FAIL, stats.nr_thp_failed);
 	count_vm_events(THP_MIGRATION_SPLIT, nr_thp_split);
-	trace_mm_migrate_pages(nr_succeeded, nr_failed, nr_thp_succeeded,
-			       nr_thp_failed, nr_thp_split, mode, reason);
+	trace_mm_migrate_pages(stats.nr_succeeded, stats.nr_failed,
+			       stats.nr_thp_succeeded, stats.nr_thp_failed,
+			       nr_thp_split, mode, reason);
 
 	if (!swapwrite)
 		current->flags &= ~PF_SWAPWRITE;
 
 	if (ret_succeeded)
-		*ret_succeeded = nr_succeeded;
+		*ret_succeeded = stats.nr_succeeded;
 
 	return rc;
 }
@@ -2121,8 +2466,24 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 		return 0;
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, nr_pages))
+	if (!migrate_balanced_pgdat(pgdat, nr_pages)) {
+		int z;
+
+		if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING))
+			return 0;
+		/*
+		 * Make room for promotions by having kswapd demote the
+		 * coldest pages of the fast node.
+		 */
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		if (z >= 0)
+			wakeup_kswapd(pgdat->node_zones + z, 0,
+				      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -2198,8 +2559,9 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_events(NUMA_PAGE_MIGRATE, nr_pages);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2615,11 +2977,15 @@ static void migrate_vma_prepare(struct migrate_vma *migrate)
 
 	for (i = 0, addr = start; i < npages && restore; i++, addr += PAGE_SIZE) {
 		struct page *page = migrate_pfn_to_page(migrate->src[i]);
+		struct rmap_walk_arg rmap_walk_arg = {
+			.page = page,
+			.map_unused_to_zeropage = false,
+		};
 
 		if (!page || (migrate->src[i] & MIGRATE_PFN_MIGRATE))
 			continue;
 
-		remove_migration_pte(page, migrate->vma, addr, page);
+		remove_migration_pte(page, migrate->vma, addr, &rmap_walk_arg);
 
 		migrate->src[i] = 0;
 		unlock_page(page);
@@ -2672,7 +3038,7 @@ static void migrate_vma_unmap(struct migrate_vma *migrate)
 		if (!page || (migrate->src[i] & MIGRATE_PFN_MIGRATE))
 			continue;
 
-		remove_migration_ptes(page, page, false);
+		remove_migration_ptes(page, page, 0);
 
 		migrate->src[i] = 0;
 		unlock_page(page);
@@ -3050,7 +3416,7 @@ void migrate_vma_finalize(struct migrate_vma *migrate)
 			newpage = page;
 		}
 
-		remove_migration_ptes(page, newpage, false);
+		remove_migration_ptes(page, newpage, 0);
 		unlock_page(page);
 
 		if (is_zone_device_page(page))
@@ -13,7 +13,6 @@
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
 #include <linux/mm.h>
-#include <linux/vmacache.h>
 #include <linux/shm.h>
 #include <linux/mman.h>
 #include <linux/pagemap.h>
@@ -462,6 +461,9 @@ static inline void vma_rb_insert(struct vm_area_struct *vma,
 
 static void __vma_rb_erase(struct vm_area_struct *vma, struct rb_root *root)
 {
+	/* lock_vma_under_rcu() rejects the vma from here on */
+	vma_mark_detached(vma, true);
+
 	/*
 	 * Note rb_erase_augmented is a fairly large inline function,
 	 * so make sure we instantiate it only once with our desired
@@ -636,6 +638,13 @@ static unsigned long count_vma_pages_range(struct mm_struct *mm,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	/*
+	 * Lockless lookups can find the vma as soon as it is linked, keep it
+	 * write-locked until mmap_lock is released.
+	 */
+	vma_start_write(vma);
+	vma_mark_detached(vma, false);
+
 	/* Update tracking information for the gap following the new vma. */
 	if (vma->vm_next)
 		vma_gap_update(vma->vm_next);
@@ -651,12 +660,37 @@ void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * immediately update the gap to the correct value. Finally we
 	 * rebalance the rbtree after all augmented values have been set.
 	 */
-	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
+	rb_link_node_rcu(&vma->vm_rb, rb_parent, rb_link);
 	vma->rb_subtree_gap = 0;
 	vma_gap_update(vma);
 	vma_rb_insert(vma, &mm->mm_rb);
 }
 
+/*
+ * The vma tree is keyed by the last address of each vma, so the first entry
+ * at or above an address is the vma find_vma() wants.  Its updates allocate
+ * memory and are done outside the i_mmap and anon_vma locks; lockless readers
+ * recheck the vma bounds under the vma lock anyway.
+ */
+void vma_tree_insert(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	int err;
+
+	err = rcu_btree_insert(&mm->vma_tree, vma->vm_end - 1, vma,
+			       GFP_KERNEL | __GFP_NOFAIL);
+	WARN_ON_ONCE(err);
+}
+
+/* Remove the vma ending at @vm_end from the vma tree. */
+static void vma_tree_erase(struct mm_struct *mm, unsigned long vm_end)
+{
+	int err;
+
+	err = rcu_btree_erase(&mm->vma_tree, vm_end - 1,
+			      GFP_KERNEL | __GFP_NOFAIL);
+	WARN_ON_ONCE(err);
+}
+
 static void __vma_link_file(struct vm_area_struct *vma)
 {
 	struct file *file;
@@ -700,6 +734,7 @@ static void vma_link(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (mapping)
 		i_mmap_unlock_write(mapping);
 
+	vma_tree_insert(mm, vma);
 	mm->map_count++;
 	validate_mm(mm);
 }
@@ -726,8 +761,6 @@ static __always_inline void __vma_unlink(struct mm_struct *mm,
 {
 	vma_rb_erase_ignore(vma, &mm->mm_rb, ignore);
 	__vma_unlink_list(mm, vma);
-	/* Kill the cache */
-	vmacache_invalidate(mm);
 }
 
 /*
@@ -748,9 +781,14 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	struct anon_vma *anon_vma = NULL;
 	struct file *file = vma->vm_file;
 	bool start_changed = false, end_changed = false;
+	unsigned long old_end = 0;
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_start_write(vma);
+	if (next)
+		vma_start_write(next);
+
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL, *importer = NULL;
 
@@ -880,6 +918,7 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		start_changed = true;
 	}
 	if (end != vma->vm_end) {
+		old_end = vma->vm_end;
 		vma->vm_end = end;
 		end_changed = true;
 	}
@@ -941,8 +980,25 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		anon_vma_unlock_write(anon_vma);
 	}
 
-	if (file) {
+	if (file)
 		i_mmap_unlock_write(mapping);
+
+	/*
+	 * Rekey the vma tree now that the locks are dropped, but before
+	 * uprobe_mmap(), which may look the vmas up again.  Erase first:
+	 * vma may take over the key of the next it has swallowed.
+	 */
+	if (old_end)
+		vma_tree_erase(mm, old_end);
+	if (remove_next)
+		vma_tree_erase(mm, next->vm_end);
+	if (old_end)
+		vma_tree_insert(mm, vma);
+	if (insert && !remove_next)
+		vma_tree_insert(mm, insert);
+	old_end = 0;
+
+	if (file) {
 		uprobe_mmap(vma);
 
 		if (adjust_next)
@@ -2270,33 +2326,17 @@ EXPORT_SYMBOL(get_unmapped_area);
 /* Look up the first VMA which satisfies  addr < vm_end,  NULL if none. */
 struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 {
-	struct rb_node *rb_node;
 	struct vm_area_struct *vma;
+	unsigned long key = addr;
 
 	mmap_assert_locked(mm);
-	/* Check the cache first. */
-	vma = vmacache_find(mm, addr);
-	if (likely(vma))
-		return vma;
-
-	rb_node = mm->mm_rb.rb_node;
-
-	while (rb_node) {
-		struct vm_area_struct *tmp;
-
-		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
-
-		if (tmp->vm_end > addr) {
-			vma = tmp;
-			if (tmp->vm_start <= addr)
-				break;
-			rb_node = rb_node->rb_left;
-		} else
-			rb_node = rb_node->rb_right;
-	}
-
-	if (vma)
-		vmacache_update(addr, vma);
+	/*
+	 * expand_upwards() rekeys the tree with mmap_lock held for read, so
+	 * the nodes can be freed under us without the RCU read lock.
+	 */
+	rcu_read_lock();
+	vma = rcu_btree_lookup_ge(&mm->vma_tree, &key);
+	rcu_read_unlock();
 	return vma;
 }
 
@@ -2437,19 +2477,33 @@ int expand_upwards(struct vm_area_struct *vma, unsigned long address)
 				 * against concurrent vma expansions.
 				 */
 				spin_lock(&mm->page_table_lock);
-				if (vma->vm_flags & VM_LOCKED)
-					mm->locked_vm += grow;
-				vm_stat_account(mm, vma->vm_flags, grow);
-				anon_vma_interval_tree_pre_update_vma(vma);
-				vma->vm_end = address;
-				anon_vma_interval_tree_post_update_vma(vma);
-				if (vma->vm_next)
-					vma_gap_update(vma->vm_next);
-				else
-					mm->highest_vm_end = vm_end_gap(vma);
+				/*
+				 * The vma tree is keyed by vm_end, reserve the
+				 * nodes for rekeying it before touching vma.
+				 */
+				error = rcu_btree_preallocate(&mm->vma_tree, 2,
+						GFP_NOWAIT | __GFP_NOWARN);
+				if (!error) {
+					if (vma->vm_flags & VM_LOCKED)
+						mm->locked_vm += grow;
+					vm_stat_account(mm, vma->vm_flags, grow);
+					rcu_btree_insert(&mm->vma_tree,
+							 address - 1, vma,
+							 GFP_NOWAIT);
+					rcu_btree_erase(&mm->vma_tree,
+							vma->vm_end - 1, GFP_NOWAIT);
+					anon_vma_interval_tree_pre_update_vma(vma);
+					vma->vm_end = address;
+					anon_vma_interval_tree_post_update_vma(vma);
+					if (vma->vm_next)
+						vma_gap_update(vma->vm_next);
+					else
+						mm->highest_vm_end = vm_end_gap(vma);
+				}
 				spin_unlock(&mm->page_table_lock);
 
-				perf_event_mmap(vma);
+				if (!error)
+					perf_event_mmap(vma);
 			}
 		}
 	}
@@ -2682,6 +2736,7 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vma_tree_erase(mm, vma->vm_end);
 		vma_rb_erase(vma, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
@@ -2695,9 +2750,6 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 		mm->highest_vm_end = prev ? vm_end_gap(prev) : 0;
 	tail_vma->vm_next = NULL;
 
-	/* Kill the cache */
-	vmacache_invalidate(mm);
-
 	/*
 	 * Do not downgrade mmap_lock if we are next to VM_GROWSDOWN or
 	 * VM_GROWSUP VMA. Such VMAs can change their size under
@@ -3175,8 +3227,10 @@ void exit_mmap(struct mm_struct *mm)
 	arch_exit_mmap(mm);
 
 	vma = mm->mmap;
-	if (!vma)	/* Can happen if dup_mmap() received an OOM */
+	if (!vma) {	/* Can happen if dup_mmap() received an OOM */
+		rcu_btree_destroy(&mm->vma_tree);
 		return;
+	}
 
 	lru_add_drain();
 	flush_cache_mm(mm);
@@ -3197,6 +3251,7 @@ void exit_mmap(struct mm_struct *mm)
 		vma = remove_vma(vma);
 		cond_resched();
 	}
+	rcu_btree_destroy(&mm->vma_tree);
 	vm_unacct_memory(nr_accounted);
 }
 
@@ -701,6 +701,22 @@ int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned max_ratio)
 }
 EXPORT_SYMBOL(bdi_set_max_ratio);
 
+/*
+ * Set the period over which the write bandwidth of the wbs of @bdi is
+ * averaged.  Fast devices can use a shorter one to follow bursts instead
+ * of being throttled on a stale estimate.
+ */
+int bdi_set_bw_period(struct backing_dev_info *bdi, unsigned int msecs)
+{
+	unsigned long period = msecs_to_jiffies(msecs);
+
+	if (period < BANDWIDTH_INTERVAL || period > 8 * BDI_BW_PERIOD)
+		return -EINVAL;
+
+	WRITE_ONCE(bdi->bw_period, roundup_pow_of_two(period));
+	return 0;
+}
+
 static unsigned long dirty_freerun_ceiling(unsigned long thresh,
 					   unsigned long bg_thresh)
 {
@@ -1072,7 +1088,7 @@ static void wb_update_write_bandwidth(struct bdi_writeback *wb,
 				      unsigned long elapsed,
 				      unsigned long written)
 {
-	const unsigned long period = roundup_pow_of_two(3 * HZ);
+	const unsigned long period = READ_ONCE(wb->bdi->bw_period);
 	unsigned long avg = wb->avg_write_bandwidth;
 	unsigned long old = wb->write_bandwidth;
 	u64 bw;
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Offload of bulk page copies to DMA engines.
+ *
+ * Migrating THPs and hugetlb pages, and collapsing THPs, copy hundreds of
+ * pages in a row on the CPU. With page_copy.dma_enabled set, such copies are
+ * queued to a public DMA_MEMCPY channel, such as those of ioat or idxd, and
+ * the CPU sleeps while they complete. Whenever no channel is available or
+ * the engine fails, the pages are copied on the CPU instead.
+ */
+
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/module.h>
+#include <linux/rwsem.h>
+#include <linux/slab.h>
+#include <linux/page_copy.h>
+
+struct page_copy_entry {
+	struct page *dst;
+	struct page *src;
+	dma_addr_t dst_addr;
+	dma_addr_t src_addr;
+};
+
+static bool page_copy_dma_enabled __read_mostly;
+/* Batches of fewer pages are copied on the CPU */
+static unsigned int page_copy_dma_min_pages __read_mostly = 64;
+/* How long to wait for a batch before falling back to the CPU */
+#define PAGE_COPY_DMA_TIMEOUT	HZ
+
+/*
+ * Held for read by batches using a channel, so that the dmaengine client
+ * reference isn't dropped under them.
+ */
+static DECLARE_RWSEM(page_copy_dma_rwsem);
+
+static int page_copy_dma_enabled_set(const char *val,
+				     const struct kernel_param *kp)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(val, &enable);
+	if (ret)
+		return ret;
+
+#ifdef __HAVE_ARCH_COPY_HIGHPAGE
+	/* The architecture copies more than the contents of a page */
+	if (enable)
+		return -EOPNOTSUPP;
+#endif
+
+	down_write(&page_copy_dma_rwsem);
+	if (enable != page_copy_dma_enabled) {
+		if (enable)
+			dmaengine_get();
+		else
+			dmaengine_put();
+		WRITE_ONCE(page_copy_dma_enabled, enable);
+	}
+	up_write(&page_copy_dma_rwsem);
+
+	return 0;
+}
+
+static const struct kernel_param_ops page_copy_dma_enabled_ops = {
+	.set = page_copy_dma_enabled_set,
+	.get = param_get_bool,
+};
+module_param_cb(dma_enabled, &page_copy_dma_enabled_ops,
+		&page_copy_dma_enabled, 0644);
+MODULE_PARM_DESC(dma_enabled, "Offload bulk page copies to DMA engines");
+module_param_named(dma_min_pages, page_copy_dma_min_pages, uint, 0644);
+MODULE_PARM_DESC(dma_min_pages, "Smallest number of pages to offload");
+
+/**
+ * page_copy_batch_init - prepare a batch of page copies
+ * @batch: the batch
+ * @nr: number of pages the caller is going to copy
+ *
+ * Picks a DMA channel for @batch if offload is enabled and @nr is large
+ * enough.
+ */
+void page_copy_batch_init(struct page_copy_batch *batch, unsigned int nr)
+{
+	struct page_copy_entry *entries;
+	struct dma_chan *chan;
+
+	batch->chan = NULL;
+	batch->nr = 0;
+	batch->failed = false;
+
+	if (!READ_ONCE(page_copy_dma_enabled) ||
+	    nr < READ_ONCE(page_copy_dma_min_pages))
+		return;
+
+	if (!down_read_trylock(&page_copy_dma_rwsem))
+		return;
+	if (!page_copy_dma_enabled)
+		goto unlock;
+
+	chan = dma_find_channel(DMA_MEMCPY);
+	if (!chan)
+		goto unlock;
+
+	nr = min_t(unsigned int, nr, PAGE_COPY_BATCH_MAX);
+	entries = kmalloc_array(nr, sizeof(*entries),
+				GFP_NOWAIT | __GFP_NOWARN);
+	if (!entries)
+		goto unlock;
+
+	batch->chan = chan;
+	batch->entries = entries;
+	batch->max = nr;
+	return;
+unlock:
+	up_read(&page_copy_dma_rwsem);
+}
+EXPORT_SYMBOL_GPL(page_copy_batch_init);
+
+static void page_copy_entry_unmap(struct device *dev,
+				  struct page_copy_entry *entry)
+{
+	dma_unmap_page(dev, entry->dst_addr, PAGE_SIZE, DMA_FROM_DEVICE);
+	dma_unmap_page(dev, entry->src_addr, PAGE_SIZE, DMA_TO_DEVICE);
+}
+
+/* Wait for the copies in flight and copy them on the CPU if they failed */
+static void page_copy_batch_drain(struct page_copy_batch *batch)
+{
+	struct dma_chan *chan = batch->chan;
+	struct device *dev = chan->device->dev;
+	unsigned long timeout = jiffies + PAGE_COPY_DMA_TIMEOUT;
+	enum dma_status status;
+	unsigned int i;
+
+	if (!batch->nr)
+		return;
+
+	dma_async_issue_pending(chan);
+	while ((status = dma_async_is_tx_complete(chan, batch->cookie,
+						  NULL, NULL)) ==
+	       DMA_IN_PROGRESS) {
+		if (time_after(jiffies, timeout))
+			break;
+		usleep_range(10, 20);
+	}
+
+	if (status != DMA_COMPLETE) {
+		pr_warn_once("page_copy: DMA copy failed, using the CPU\n");
+		/* Don't let the engine write to the pages behind our back */
+		if (status == DMA_IN_PROGRESS)
+			dmaengine_terminate_sync(chan);
+		batch->failed = true;
+	}
+
+	for (i = 0; i < batch->nr; i++) {
+		struct page_copy_entry *entry = &batch->entries[i];
+
+		page_copy_entry_unmap(dev, entry);
+		if (status != DMA_COMPLETE)
+			copy_highpage(entry->dst, entry->src);
+	}
+	batch->nr = 0;
+}
+
+/**
+ * page_copy_batch_add - queue a page copy to a batch
+ * @batch: the batch
+ * @dst: destination page
+ * @src: source page
+ *
+ * Return: true if the copy was queued and will be done once
+ * page_copy_batch_finish() returns, false if the caller has to copy the page
+ * itself.
+ */
+bool page_copy_batch_add(struct page_copy_batch *batch, struct page *dst,
+			 struct page *src)
+{
+	struct dma_async_tx_descriptor *tx;
+	struct page_copy_entry *entry;
+	struct device *dev;
+	dma_cookie_t cookie;
+
+	if (!batch->chan || batch->failed)
+		return false;
+
+	if (batch->nr == batch->max) {
+		page_copy_batch_drain(batch);
+		if (batch->failed)
+			return false;
+	}
+
+	dev = batch->chan->device->dev;
+	entry = &batch->entries[batch->nr];
+	entry->dst = dst;
+	entry->src = src;
+
+	entry->src_addr = dma_map_page(dev, src, 0, PAGE_SIZE, DMA_TO_DEVICE);
+	if (dma_mapping_error(dev, entry->src_addr))
+		goto fail;
+	entry->dst_addr = dma_map_page(dev, dst, 0, PAGE_SIZE,
+				       DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, entry->dst_addr)) {
+		dma_unmap_page(dev, entry->src_addr, PAGE_SIZE, DMA_TO_DEVICE);
+		goto fail;
+	}
+
+	tx = dmaengine_prep_dma_memcpy(batch->chan, entry->dst_addr,
+				       entry->src_addr, PAGE_SIZE, 0);
+	if (!tx)
+		goto unmap;
+	cookie = dmaengine_submit(tx);
+	if (dma_submit_error(cookie))
+		goto unmap;
+
+	batch->cookie = cookie;
+	batch->nr++;
+	return true;
+unmap:
+	page_copy_entry_unmap(dev, entry);
+fail:
+	/* Keep what is in flight, but copy the rest of the batch on the CPU */
+	batch->failed = true;
+	return false;
+}
+EXPORT_SYMBOL_GPL(page_copy_batch_add);
+
+/**
+ * page_copy_batch_finish - complete a batch of page copies
+ * @batch: the batch
+ *
+ * Waits for all the copies queued by page_copy_batch_add() to be done.
+ * Context: Process context, may sleep.
+ */
+void page_copy_batch_finish(struct page_copy_batch *batch)
+{
+	if (!batch->chan)
+		return;
+
+	page_copy_batch_drain(batch);
+	kfree(batch->entries);
+	batch->chan = NULL;
+	up_read(&page_copy_dma_rwsem);
+}
+EXPORT_SYMBOL_GPL(page_copy_batch_finish);
@@ -1704,6 +1704,124 @@ static void pcpu_memcg_free_hook(struct pcpu_chunk *chunk, int off, size_t size)
 }
 #endif /* CONFIG_MEMCG_KMEM */
 
+/*
+ * Small areas released by free_percpu() are kept in per-cpu caches, one per
+ * power of two size class, and handed out again by pcpu_alloc() without
+ * taking pcpu_alloc_mutex or pcpu_lock.  As far as their chunks are
+ * concerned, cached areas stay allocated.  Only unaccounted areas from the
+ * normal chunks whose size is exactly that of a class are cached, so that
+ * a cached area fits any request of its class aligned to at most
+ * PCPU_OBJ_CACHE_ALIGN.
+ */
+#define PCPU_OBJ_CACHE_MIN_SHIFT	3	/* 8 bytes */
+#define PCPU_OBJ_CACHE_CLASSES		5	/* up to 128 bytes */
+#define PCPU_OBJ_CACHE_DEPTH		16
+#define PCPU_OBJ_CACHE_ALIGN		8
+
+struct pcpu_obj_cache {
+	unsigned int nr[PCPU_OBJ_CACHE_CLASSES];
+	void __percpu *objs[PCPU_OBJ_CACHE_CLASSES][PCPU_OBJ_CACHE_DEPTH];
+};
+
+static DEFINE_PER_CPU(struct pcpu_obj_cache, pcpu_obj_cache);
+
+static inline size_t pcpu_obj_cache_class_size(int class)
+{
+	return 1UL << (class + PCPU_OBJ_CACHE_MIN_SHIFT);
+}
+
+/* Returns the size class serving @size, -1 if there is none */
+static int pcpu_obj_cache_class(size_t size, size_t align, gfp_t gfp)
+{
+	if (size > pcpu_obj_cache_class_size(PCPU_OBJ_CACHE_CLASSES - 1) ||
+	    align > PCPU_OBJ_CACHE_ALIGN || (gfp & __GFP_ACCOUNT))
+		return -1;
+
+	if (size <= pcpu_obj_cache_class_size(0))
+		return 0;
+	return order_base_2(size) - PCPU_OBJ_CACHE_MIN_SHIFT;
+}
+
+static void __percpu *pcpu_obj_cache_alloc(int class, gfp_t gfp)
+{
+	size_t size = pcpu_obj_cache_class_size(class);
+	struct pcpu_obj_cache *cache;
+	struct pcpu_chunk *chunk;
+	void __percpu *ptr = NULL;
+	unsigned long flags;
+	void *addr;
+	int cpu;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_obj_cache);
+	if (cache->nr[class])
+		ptr = cache->objs[class][--cache->nr[class]];
+	local_irq_restore(flags);
+
+	if (!ptr)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ptr, cpu), 0, size);
+
+	kmemleak_alloc_percpu(ptr, size, gfp);
+
+	addr = __pcpu_ptr_to_addr(ptr);
+	chunk = pcpu_chunk_addr_search(addr);
+	trace_percpu_alloc_percpu(false, (gfp & GFP_KERNEL) != GFP_KERNEL, size,
+				  PCPU_OBJ_CACHE_ALIGN, chunk->base_addr,
+				  addr - chunk->base_addr, ptr);
+
+	return ptr;
+}
+
+/*
+ * Try to keep the area at @ptr in the cache instead of freeing it.  This
+ * runs without pcpu_lock: the boundary bits of an allocated area, which
+ * give its size, aren't changed by allocations and frees around it.
+ */
+static bool pcpu_obj_cache_free(void __percpu *ptr)
+{
+	void *addr = __pcpu_ptr_to_addr(ptr);
+	struct pcpu_obj_cache *cache;
+	struct pcpu_chunk *chunk;
+	unsigned long flags;
+	int bit_off, end, off, size, class;
+	bool cached = false;
+
+	chunk = pcpu_chunk_addr_search(addr);
+	off = addr - chunk->base_addr;
+	if (chunk == pcpu_reserved_chunk || !IS_ALIGNED(off, PCPU_OBJ_CACHE_ALIGN))
+		return false;
+
+#ifdef CONFIG_MEMCG_KMEM
+	if (chunk->obj_cgroups && chunk->obj_cgroups[off >> PCPU_MIN_ALLOC_SHIFT])
+		return false;
+#endif
+
+	bit_off = off / PCPU_MIN_ALLOC_SIZE;
+	end = find_next_bit(chunk->bound_map, pcpu_chunk_map_bits(chunk),
+			    bit_off + 1);
+	size = (end - bit_off) * PCPU_MIN_ALLOC_SIZE;
+
+	class = pcpu_obj_cache_class(size, PCPU_OBJ_CACHE_ALIGN, 0);
+	if (class < 0 || size != pcpu_obj_cache_class_size(class))
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_obj_cache);
+	if (cache->nr[class] < PCPU_OBJ_CACHE_DEPTH) {
+		cache->objs[class][cache->nr[class]++] = ptr;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	if (cached)
+		trace_percpu_free_percpu(chunk->base_addr, off, ptr);
+
+	return cached;
+}
+
 /**
  * pcpu_alloc - the percpu allocator
  * @size: size of area to allocate in bytes
@@ -1733,6 +1851,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	unsigned long flags;
 	void __percpu *ptr;
 	size_t bits, bit_align;
+	int class;
 
 	gfp = current_gfp_context(gfp);
 	/* whitelisted flags that can be passed to the backing allocators */
@@ -1760,6 +1879,19 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 		return NULL;
 	}
 
+	class = reserved ? -1 : pcpu_obj_cache_class(size, align, gfp);
+	if (class >= 0) {
+		ptr = pcpu_obj_cache_alloc(class, gfp);
+		if (ptr)
+			return ptr;
+
+		/* allocate the whole class so the area can be cached later */
+		size = pcpu_obj_cache_class_size(class);
+		align = PCPU_OBJ_CACHE_ALIGN;
+		bits = size >> PCPU_MIN_ALLOC_SHIFT;
+		bit_align = align >> PCPU_MIN_ALLOC_SHIFT;
+	}
+
 	if (unlikely(!pcpu_memcg_pre_alloc_hook(size, gfp, &objcg)))
 		return NULL;
 
@@ -2274,6 +2406,9 @@ void free_percpu(void __percpu *ptr)
 
 	kmemleak_free_percpu(ptr);
 
+	if (pcpu_obj_cache_free(ptr))
+		return;
+
 	addr = __pcpu_ptr_to_addr(ptr);
 
 	spin_lock_irqsave(&pcpu_lock, flags);
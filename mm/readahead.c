@@ -157,6 +157,41 @@ static void read_pages(struct readahead_control *rac, struct list_head *pages,
 		rac->_index++;
 }
 
+/*
+ * Add the pages batched in @pvec to the page cache, right after those already
+ * in @ractl.  Returns false if some of them could not be added, in which
+ * case they have been released.
+ */
+static bool ra_add_batch(struct readahead_control *ractl,
+			 struct pagevec *pvec, pgoff_t mark, gfp_t gfp_mask)
+{
+	unsigned int i, nr = pagevec_count(pvec);
+	int added;
+
+	if (!nr)
+		return true;
+
+	added = add_to_page_cache_batch_lru(pvec, ractl->mapping,
+				ractl->_index + ractl->_nr_pages, gfp_mask);
+	if (added < 0)
+		added = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (i >= added) {
+			put_page(page);
+			continue;
+		}
+		if (page->index == mark)
+			SetPageReadahead(page);
+		ractl->_nr_pages++;
+	}
+	pagevec_reinit(pvec);
+
+	return added == nr;
+}
+
 /**
  * page_cache_ra_unbounded - Start unchecked readahead.
  * @ractl: Readahead control.
@@ -176,7 +211,9 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 {
 	struct address_space *mapping = ractl->mapping;
 	unsigned long index = readahead_index(ractl);
+	pgoff_t mark = index + nr_to_read - lookahead_size;
 	LIST_HEAD(page_pool);
+	struct pagevec pvec;
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
 	unsigned long i;
 
@@ -193,8 +230,10 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	unsigned int nofs = memalloc_nofs_save();
 
 	filemap_invalidate_lock_shared(mapping);
+	pagevec_init(&pvec);
 	/*
-	 * Preallocate as many pages as we will need.
+	 * Preallocate as many pages as we will need, and add them to the
+	 * page cache a pagevec at a time.
 	 */
 	for (i = 0; i < nr_to_read; i++) {
 		struct page *page = xa_load(&mapping->i_pages, index + i);
@@ -206,8 +245,11 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 			 * next batch.  This page may be the one we would
 			 * have intended to mark as Readahead, but we don't
 			 * have a stable reference to this page, and it's
-			 * not worth getting one just for that.
+			 * not worth getting one just for that.  If the batch
+			 * stopped short, the page that got in its way is the
+			 * one skipped instead, and this one is found again.
 			 */
+			ra_add_batch(ractl, &pvec, mark, gfp_mask);
 			read_pages(ractl, &page_pool, true);
 			i = ractl->_index + ractl->_nr_pages - index - 1;
 			continue;
@@ -219,17 +261,20 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 		if (mapping->a_ops->readpages) {
 			page->index = index + i;
 			list_add(&page->lru, &page_pool);
-		} else if (add_to_page_cache_lru(page, mapping, index + i,
-					gfp_mask) < 0) {
-			put_page(page);
+			if (i == nr_to_read - lookahead_size)
+				SetPageReadahead(page);
+			ractl->_nr_pages++;
+			continue;
+		}
+
+		if (pagevec_add(&pvec, page))
+			continue;
+		if (!ra_add_batch(ractl, &pvec, mark, gfp_mask)) {
 			read_pages(ractl, &page_pool, true);
 			i = ractl->_index + ractl->_nr_pages - index - 1;
-			continue;
 		}
-		if (i == nr_to_read - lookahead_size)
-			SetPageReadahead(page);
-		ractl->_nr_pages++;
 	}
+	ra_add_batch(ractl, &pvec, mark, gfp_mask);
 
 	/*
 	 * Now start the IO.  We ignore I/O errors - if the page is not
@@ -3427,6 +3427,8 @@ static __always_inline void __cache_free(struct kmem_cache *cachep, void *objp,
 {
 	bool init;
 
+	alloc_sample_slab_free(cachep, objp);
+
 	if (is_kfence_address(objp)) {
 		kmemleak_free_recursive(objp, cachep->flags);
 		memcg_slab_free_hook(cachep, &objp, 1);
@@ -44,6 +44,7 @@ struct kmem_cache {
 #include <linux/fault-inject.h>
 #include <linux/kasan.h>
 #include <linux/kmemleak.h>
+#include <linux/alloc_sample.h>
 #include <linux/random.h>
 #include <linux/sched/mm.h>
 
@@ -423,6 +424,7 @@ static __always_inline void account_slab_page(struct page *page, int order,
 	if (memcg_kmem_enabled() && (s->flags & SLAB_ACCOUNT))
 		memcg_alloc_page_obj_cgroups(page, s, gfp, true);
 
+	alloc_sample_slab_page(page, order);
 	mod_node_page_state(page_pgdat(page), cache_vmstat_idx(s),
 			    PAGE_SIZE << order);
 }
@@ -521,6 +523,7 @@ static inline void slab_post_alloc_hook(struct kmem_cache *s,
 			memset(p[i], 0, s->object_size);
 		kmemleak_alloc_recursive(p[i], s->object_size, 1,
 					 s->flags, flags);
+		alloc_sample_slab(s, p[i]);
 	}
 
 	memcg_slab_post_alloc_hook(s, objcg, flags, size, p);
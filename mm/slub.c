@@ -46,10 +46,11 @@
 /*
  * Lock order:
  *   1. slab_mutex (Global Mutex)
- *   2. node->list_lock (Spinlock)
- *   3. kmem_cache->cpu_slab->lock (Local lock)
- *   4. slab_lock(page) (Only on some arches or for debugging)
- *   5. object_map_lock (Only for debugging)
+ *   2. kmem_cache->cpu_sheaves->lock (Local lock)
+ *   3. node->list_lock (Spinlock)
+ *   4. kmem_cache->cpu_slab->lock (Local lock)
+ *   5. slab_lock(page) (Only on some arches or for debugging)
+ *   6. object_map_lock (Only for debugging)
  *
  *   slab_mutex
  *
@@ -289,6 +290,17 @@ static void debugfs_slab_add(struct kmem_cache *);
 static inline void debugfs_slab_add(struct kmem_cache *s) { }
 #endif
 
+struct slub_sheaf {
+	local_lock_t lock;	/* Protects the fields below */
+	unsigned int size;	/* Number of objects in the sheaf */
+	void *objects[];
+};
+
+static void *sheaf_alloc(struct kmem_cache *s, gfp_t gfpflags);
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object);
+static void __flush_cpu_sheaf(struct kmem_cache *s, int cpu);
+static void flush_cpu_sheaf(struct kmem_cache *s);
+
 static inline void stat(const struct kmem_cache *s, enum stat_item si)
 {
 #ifdef CONFIG_SLUB_STATS
@@ -1673,6 +1685,7 @@ static __always_inline bool slab_free_hook(struct kmem_cache *s,
 						void *x, bool init)
 {
 	kmemleak_free_recursive(x, s->flags);
+	alloc_sample_slab_free(s, x);
 
 	debug_check_no_locks_freed(x, s->object_size);
 
@@ -2658,6 +2671,10 @@ static void flush_cpu_slab(struct work_struct *w)
 	sfw = container_of(w, struct slub_flush_work, work);
 
 	s = sfw->s;
+
+	if (s->cpu_sheaves)
+		flush_cpu_sheaf(s);
+
 	c = this_cpu_ptr(s->cpu_slab);
 
 	if (c->page)
@@ -2670,6 +2687,9 @@ static bool has_cpu_slab(int cpu, struct kmem_cache *s)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->cpu_sheaves && per_cpu_ptr(s->cpu_sheaves, cpu)->size)
+		return true;
+
 	return c->page || slub_percpu_partial(c);
 }
 
@@ -2722,8 +2742,11 @@ static int slub_cpu_dead(unsigned int cpu)
 	struct kmem_cache *s;
 
 	mutex_lock(&slab_mutex);
-	list_for_each_entry(s, &slab_caches, list)
+	list_for_each_entry(s, &slab_caches, list) {
+		if (s->cpu_sheaves)
+			__flush_cpu_sheaf(s, cpu);
 		__flush_cpu_slab(s, cpu);
+	}
 	mutex_unlock(&slab_mutex);
 	return 0;
 }
@@ -3139,6 +3162,12 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	if (unlikely(object))
 		goto out;
 
+	if (s->cpu_sheaves && node == NUMA_NO_NODE) {
+		object = sheaf_alloc(s, gfpflags);
+		if (object)
+			goto wipe;
+	}
+
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -3213,6 +3242,7 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 		stat(s, ALLOC_FASTPATH);
 	}
 
+wipe:
 	maybe_wipe_obj_freeptr(s, object);
 	init = slab_want_init_on_alloc(gfpflags, s);
 
@@ -3428,8 +3458,11 @@ static __always_inline void do_slab_free(struct kmem_cache *s,
 	unsigned long tid;
 
 	/* memcg_slab_free_hook() is already called for bulk free. */
-	if (!tail)
+	if (!tail) {
 		memcg_slab_free_hook(s, &head, 1);
+		if (s->cpu_sheaves && sheaf_free(s, page, head))
+			return;
+	}
 redo:
 	/*
 	 * Determine the currently cpus per cpu slab.
@@ -3642,18 +3675,19 @@ void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 }
 EXPORT_SYMBOL(kmem_cache_free_bulk);
 
-/* Note that interrupts must be enabled when calling this function. */
-int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
-			  void **p)
+/*
+ * Take up to @size objects from the cpu slab, refilling it as needed, but
+ * without running any of the allocation hooks. Returns the number of objects
+ * allocated, which is less than @size if allocating a new slab failed.
+ *
+ * Note that interrupts must be enabled when calling this function.
+ */
+static int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags,
+				   size_t size, void **p, bool use_kfence)
 {
 	struct kmem_cache_cpu *c;
 	int i;
-	struct obj_cgroup *objcg = NULL;
 
-	/* memcg and kmem_cache debug support */
-	s = slab_pre_alloc_hook(s, &objcg, size, flags);
-	if (unlikely(!s))
-		return false;
 	/*
 	 * Drain objects in the per cpu slab, while disabling local
 	 * IRQs, which protects against PREEMPT and interrupts
@@ -3663,8 +3697,10 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	local_lock_irq(&s->cpu_slab->lock);
 
 	for (i = 0; i < size; i++) {
-		void *object = kfence_alloc(s, s->object_size, flags);
+		void *object = NULL;
 
+		if (use_kfence)
+			object = kfence_alloc(s, s->object_size, flags);
 		if (unlikely(object)) {
 			p[i] = object;
 			continue;
@@ -3705,8 +3741,31 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	}
 	c->tid = next_tid(c->tid);
 	local_unlock_irq(&s->cpu_slab->lock);
+error:
 	slub_put_cpu_ptr(s->cpu_slab);
 
+	return i;
+}
+
+/* Note that interrupts must be enabled when calling this function. */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	int i;
+	struct obj_cgroup *objcg = NULL;
+
+	/* memcg and kmem_cache debug support */
+	s = slab_pre_alloc_hook(s, &objcg, size, flags);
+	if (unlikely(!s))
+		return false;
+
+	i = __kmem_cache_alloc_bulk(s, flags, size, p, true);
+	if (unlikely(i < size)) {
+		slab_post_alloc_hook(s, objcg, flags, i, p, false);
+		__kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+
 	/*
 	 * memcg and kmem_cache debug support and memory initialization.
 	 * Done outside of the IRQ disabled fastpath loop.
@@ -3714,14 +3773,208 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	slab_post_alloc_hook(s, objcg, flags, size, p,
 				slab_want_init_on_alloc(flags, s));
 	return i;
-error:
-	slub_put_cpu_ptr(s->cpu_slab);
-	slab_post_alloc_hook(s, objcg, flags, i, p, false);
-	__kmem_cache_free_bulk(s, i, p);
-	return 0;
 }
 EXPORT_SYMBOL(kmem_cache_alloc_bulk);
 
+/********************************************************************
+ *			Per cpu sheaves
+ *******************************************************************/
+
+/*
+ * A sheaf is a per cpu array of free objects sitting in front of the cpu
+ * slab. Allocations pop objects from it and frees push them back with only
+ * the local lock held, no matter which slab the objects belong to, so caches
+ * whose objects are often freed on another cpu than the one they were
+ * allocated on stop bouncing slab freelists between cpus. An empty sheaf is
+ * refilled and a full one is flushed half a capacity at a time through the
+ * bulk paths.
+ *
+ * Sheaves are off by default. They are enabled on the command line with
+ *
+ *	slub_sheaves=<capacity>[,<cache>[,<cache>...]]
+ *
+ * either for the listed caches or, without a list, for all caches that are
+ * not being debugged. Cache names are matched after merging, so slub_nomerge
+ * may be needed to single out a cache.
+ */
+#define SLUB_SHEAF_MAX_CAPACITY	64
+
+static unsigned int slub_sheaf_capacity;
+static char *slub_sheaves_list;
+
+static int __init setup_slub_sheaves(char *str)
+{
+	int capacity, ret;
+
+	ret = get_option(&str, &capacity);
+	if (!ret || capacity <= 0)
+		return 1;
+
+	slub_sheaf_capacity = clamp_t(unsigned int, round_up(capacity, 2), 2,
+				      SLUB_SHEAF_MAX_CAPACITY);
+	if (ret == 2 && *str)
+		slub_sheaves_list = str;
+
+	return 1;
+}
+
+__setup("slub_sheaves=", setup_slub_sheaves);
+
+static bool sheaves_wanted(struct kmem_cache *s)
+{
+	size_t len = strlen(s->name);
+	char *iter, *end;
+
+	if (!slub_sheaf_capacity || kmem_cache_debug(s))
+		return false;
+	if (!slub_sheaves_list)
+		return true;
+
+	for (iter = slub_sheaves_list; *iter; iter = *end ? end + 1 : end) {
+		end = strchrnul(iter, ',');
+		if (end - iter == len && !strncmp(iter, s->name, len))
+			return true;
+	}
+
+	return false;
+}
+
+static void init_sheaves(struct kmem_cache *s)
+{
+	struct slub_sheaf __percpu *sheaves;
+	int cpu;
+
+	if (!sheaves_wanted(s))
+		return;
+
+	/* The cache works just as well without, so fail quietly */
+	sheaves = __alloc_percpu(sizeof(struct slub_sheaf) +
+				 slub_sheaf_capacity * sizeof(void *),
+				 __alignof__(struct slub_sheaf));
+	if (!sheaves)
+		return;
+
+	for_each_possible_cpu(cpu)
+		local_lock_init(&per_cpu_ptr(sheaves, cpu)->lock);
+
+	s->sheaf_capacity = slub_sheaf_capacity;
+	s->cpu_sheaves = sheaves;
+}
+
+/*
+ * Free objects without running the free hooks again, they already ran when
+ * the objects were put into the sheaf.
+ */
+static void sheaf_flush_objects(struct kmem_cache *s, void **p, size_t size)
+{
+	stat(s, SHEAF_FLUSH);
+	do {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, p, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt, _RET_IP_);
+	} while (likely(size));
+}
+
+static void *sheaf_alloc(struct kmem_cache *s, gfp_t gfpflags)
+{
+	void *objects[SLUB_SHEAF_MAX_CAPACITY / 2];
+	struct slub_sheaf *sheaf;
+	unsigned long flags;
+	void *object = NULL;
+	int i, nr;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	if (likely(sheaf->size))
+		object = sheaf->objects[--sheaf->size];
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (likely(object)) {
+		stat(s, ALLOC_SHEAF);
+		return object;
+	}
+
+	/* The bulk path needs interrupts enabled, use the cpu slab instead */
+	if (irqs_disabled())
+		return NULL;
+
+	nr = __kmem_cache_alloc_bulk(s, gfpflags, s->sheaf_capacity / 2,
+				     objects, false);
+	if (!nr)
+		return NULL;
+	stat(s, SHEAF_REFILL);
+
+	/*
+	 * Keep the first object for the caller. We may have been migrated, or
+	 * objects freed to the sheaf in the meantime, so it may not have room
+	 * for all the others.
+	 */
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	for (i = 1; i < nr && sheaf->size < s->sheaf_capacity; i++)
+		sheaf->objects[sheaf->size++] = objects[i];
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (unlikely(i < nr))
+		sheaf_flush_objects(s, objects + i, nr - i);
+
+	return objects[0];
+}
+
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object)
+{
+	struct slub_sheaf *sheaf;
+	unsigned long flags;
+	unsigned int nr;
+
+	/*
+	 * Objects from remote nodes would be handed out to local allocations,
+	 * and kfence objects must go back to kfence.
+	 */
+	if (unlikely(page_to_nid(page) != numa_mem_id() ||
+		     is_kfence_address(object)))
+		return false;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves);
+	if (unlikely(sheaf->size == s->sheaf_capacity)) {
+		/* Make room by flushing the older, likely cache cold, half */
+		nr = s->sheaf_capacity / 2;
+		sheaf_flush_objects(s, sheaf->objects, nr);
+		sheaf->size -= nr;
+		memmove(sheaf->objects, sheaf->objects + nr,
+			sheaf->size * sizeof(void *));
+	}
+	sheaf->objects[sheaf->size++] = object;
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	stat(s, FREE_SHEAF);
+	return true;
+}
+
+/* Flush the sheaf of an offline cpu, or of the local one with the lock held */
+static void __flush_cpu_sheaf(struct kmem_cache *s, int cpu)
+{
+	struct slub_sheaf *sheaf = per_cpu_ptr(s->cpu_sheaves, cpu);
+
+	if (sheaf->size)
+		sheaf_flush_objects(s, sheaf->objects, sheaf->size);
+	sheaf->size = 0;
+}
+
+static void flush_cpu_sheaf(struct kmem_cache *s)
+{
+	unsigned long flags;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	__flush_cpu_sheaf(s, smp_processor_id());
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+}
+
 
 /*
  * Object placement in a slab is made very easy because we always start at
@@ -3955,6 +4208,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu(s->cpu_sheaves);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -4216,8 +4470,14 @@ static int kmem_cache_open(struct kmem_cache *s, slab_flags_t flags)
 	if (!init_kmem_cache_nodes(s))
 		goto error;
 
-	if (alloc_kmem_cache_cpus(s))
-		return 0;
+	if (!alloc_kmem_cache_cpus(s))
+		goto error;
+
+	/* Caches created during bootstrap get theirs in kmem_cache_init_late() */
+	if (slab_state >= UP)
+		init_sheaves(s);
+
+	return 0;
 
 error:
 	__kmem_cache_release(s);
@@ -4855,8 +5115,17 @@ void __init kmem_cache_init(void)
 
 void __init kmem_cache_init_late(void)
 {
+	struct kmem_cache *s;
+
 	flushwq = alloc_workqueue("slub_flushwq", WQ_MEM_RECLAIM, 0);
 	WARN_ON(!flushwq);
+
+	mutex_lock(&slab_mutex);
+	list_for_each_entry(s, &slab_caches, list) {
+		if (!s->cpu_sheaves)
+			init_sheaves(s);
+	}
+	mutex_unlock(&slab_mutex);
 }
 
 struct kmem_cache *
@@ -5425,6 +5694,12 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", s->sheaf_capacity);
+}
+SLAB_ATTR_RO(sheaf_capacity);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5729,6 +6004,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_SHEAF, alloc_sheaf);
+STAT_ATTR(FREE_SHEAF, free_sheaf);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
 #endif	/* CONFIG_SLUB_STATS */
 
 static struct attribute *slab_attrs[] = {
@@ -5738,6 +6017,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&sheaf_capacity_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5793,6 +6073,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&alloc_sheaf_attr.attr,
+	&free_sheaf_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
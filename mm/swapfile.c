@@ -346,6 +346,16 @@ static inline void cluster_clear_huge(struct swap_cluster_info *info)
 	info->flags &= ~CLUSTER_FLAG_HUGE;
 }
 
+static inline bool cluster_is_percpu(struct swap_cluster_info *info)
+{
+	return info->flags & CLUSTER_FLAG_PERCPU;
+}
+
+static inline void cluster_clear_percpu(struct swap_cluster_info *info)
+{
+	info->flags &= ~CLUSTER_FLAG_PERCPU;
+}
+
 static inline struct swap_cluster_info *lock_cluster(struct swap_info_struct *si,
 						     unsigned long offset)
 {
@@ -564,6 +574,10 @@ static void inc_cluster_info_page(struct swap_info_struct *p,
 	VM_BUG_ON(cluster_count(&cluster_info[idx]) >= SWAPFILE_CLUSTER);
 	cluster_set_count(&cluster_info[idx],
 		cluster_count(&cluster_info[idx]) + 1);
+
+	/* A full cluster has no reserved slots left */
+	if (cluster_count(&cluster_info[idx]) == SWAPFILE_CLUSTER)
+		cluster_clear_percpu(&cluster_info[idx]);
 }
 
 /*
@@ -583,10 +597,97 @@ static void dec_cluster_info_page(struct swap_info_struct *p,
 	cluster_set_count(&cluster_info[idx],
 		cluster_count(&cluster_info[idx]) - 1);
 
-	if (cluster_count(&cluster_info[idx]) == 0)
+	/* A reserved cluster is freed when the reservation is dropped */
+	if (cluster_count(&cluster_info[idx]) == 0 &&
+	    !cluster_is_percpu(&cluster_info[idx]))
 		free_cluster(p, idx);
 }
 
+/*
+ * A free cluster assigned to a CPU is reserved for it as a whole while the
+ * device is less than half full: all of its slots are accounted as in use
+ * right away, so that the CPU can allocate entries from it later on in
+ * swap_alloc_fast() under the cluster lock only. Closer to full, the
+ * device falls back to accounting each slot under si->lock.
+ */
+static inline bool swap_reserve_allowed(struct swap_info_struct *si)
+{
+	return si->inuse_pages < si->pages / 2;
+}
+
+static void swap_range_alloc(struct swap_info_struct *si, unsigned long offset,
+			     unsigned int nr_entries);
+static void swap_range_unuse(struct swap_info_struct *si, unsigned long begin,
+			     unsigned long end, unsigned int nr_entries);
+
+/* Called with si->lock held */
+static void swap_reserve_cluster(struct swap_info_struct *si, unsigned long idx)
+{
+	unsigned long offset = idx * SWAPFILE_CLUSTER;
+	struct swap_cluster_info *ci;
+
+	ci = lock_cluster(si, offset);
+	alloc_cluster(si, idx);
+	cluster_set_flag(ci, CLUSTER_FLAG_PERCPU);
+	unlock_cluster(ci);
+
+	swap_range_alloc(si, offset, SWAPFILE_CLUSTER);
+}
+
+/*
+ * Hand the unused slots of a reserved cluster back to the device, and
+ * free the cluster if none of them is in use. Called with si->lock held.
+ */
+static void swap_unreserve_cluster(struct swap_info_struct *si,
+				   unsigned long idx)
+{
+	unsigned long offset = idx * SWAPFILE_CLUSTER;
+	struct swap_cluster_info *ci;
+	unsigned int unused = 0;
+
+	ci = lock_cluster(si, offset);
+	if (cluster_is_percpu(ci)) {
+		cluster_clear_percpu(ci);
+		unused = SWAPFILE_CLUSTER - cluster_count(ci);
+		if (!cluster_count(ci))
+			free_cluster(si, idx);
+	}
+	unlock_cluster(ci);
+
+	if (unused)
+		swap_range_unuse(si, offset, offset + SWAPFILE_CLUSTER - 1,
+				 unused);
+}
+
+/* Called with si->lock held */
+static void swap_drop_percpu_cluster(struct swap_info_struct *si,
+				     struct percpu_cluster *cluster)
+{
+	unsigned long idx = cluster_next(&cluster->index);
+
+	cluster_set_null(&cluster->index);
+	swap_unreserve_cluster(si, idx);
+}
+
+/*
+ * Drop the clusters of all CPUs, e.g. because the device is full or is
+ * being swapped off. Called with si->lock held.
+ */
+static void swap_unreserve_all(struct swap_info_struct *si)
+{
+	struct percpu_cluster *cluster;
+	int cpu;
+
+	if (!si->cluster_info)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		cluster = per_cpu_ptr(si->percpu_cluster, cpu);
+		if (!cluster_is_null(&cluster->index))
+			swap_drop_percpu_cluster(si, cluster);
+	}
+}
+
 /*
  * It's possible scan_swap_map_slots() uses a free cluster in the middle of free
  * cluster list. Avoiding such abuse to avoid list corruption.
@@ -607,7 +708,8 @@ scan_swap_map_ssd_cluster_conflict(struct swap_info_struct *si,
 		return false;
 
 	percpu_cluster = this_cpu_ptr(si->percpu_cluster);
-	cluster_set_null(&percpu_cluster->index);
+	if (!cluster_is_null(&percpu_cluster->index))
+		swap_drop_percpu_cluster(si, percpu_cluster);
 	return true;
 }
 
@@ -629,6 +731,9 @@ static bool scan_swap_map_try_ssd_cluster(struct swap_info_struct *si,
 			cluster->index = si->free_clusters.head;
 			cluster->next = cluster_next(&cluster->index) *
 					SWAPFILE_CLUSTER;
+			if (swap_reserve_allowed(si))
+				swap_reserve_cluster(si,
+					cluster_next(&cluster->index));
 		} else if (!cluster_list_empty(&si->discard_clusters)) {
 			/*
 			 * we don't have free cluster but have some clusters in
@@ -660,7 +765,7 @@ static bool scan_swap_map_try_ssd_cluster(struct swap_info_struct *si,
 		unlock_cluster(ci);
 	}
 	if (tmp >= max) {
-		cluster_set_null(&cluster->index);
+		swap_drop_percpu_cluster(si, cluster);
 		goto new_cluster;
 	}
 	cluster->next = tmp + 1;
@@ -695,6 +800,11 @@ static void swap_range_alloc(struct swap_info_struct *si, unsigned long offset,
 		WRITE_ONCE(si->highest_bit, si->highest_bit - nr_entries);
 	si->inuse_pages += nr_entries;
 	if (si->inuse_pages == si->pages) {
+		/* Slots reserved by CPUs may still be free, take them back */
+		swap_unreserve_all(si);
+		if (si->inuse_pages != si->pages)
+			return;
+
 		si->lowest_bit = si->max;
 		si->highest_bit = 0;
 		del_from_avail_list(si);
@@ -713,15 +823,15 @@ static void add_to_avail_list(struct swap_info_struct *p)
 	spin_unlock(&swap_avail_lock);
 }
 
-static void swap_range_free(struct swap_info_struct *si, unsigned long offset,
-			    unsigned int nr_entries)
+/*
+ * Account @nr_entries slots within [@begin, @end] as no longer in use by
+ * the device.
+ */
+static void swap_range_unuse(struct swap_info_struct *si, unsigned long begin,
+			     unsigned long end, unsigned int nr_entries)
 {
-	unsigned long begin = offset;
-	unsigned long end = offset + nr_entries - 1;
-	void (*swap_slot_free_notify)(struct block_device *, unsigned long);
-
-	if (offset < si->lowest_bit)
-		si->lowest_bit = offset;
+	if (begin < si->lowest_bit)
+		si->lowest_bit = begin;
 	if (end > si->highest_bit) {
 		bool was_full = !si->highest_bit;
 
@@ -729,8 +839,21 @@ static void swap_range_free(struct swap_info_struct *si, unsigned long offset,
 		if (was_full && (si->flags & SWP_WRITEOK))
 			add_to_avail_list(si);
 	}
-	atomic_long_add(nr_entries, &nr_swap_pages);
 	si->inuse_pages -= nr_entries;
+}
+
+/*
+ * The entries are free again. This is all that is needed for entries of a
+ * reserved cluster, which go back to the reservation.
+ */
+static void swap_range_invalidate(struct swap_info_struct *si,
+				  unsigned long offset, unsigned int nr_entries)
+{
+	unsigned long begin = offset;
+	unsigned long end = offset + nr_entries - 1;
+	void (*swap_slot_free_notify)(struct block_device *, unsigned long);
+
+	atomic_long_add(nr_entries, &nr_swap_pages);
 	if (si->flags & SWP_BLKDEV)
 		swap_slot_free_notify =
 			si->bdev->bd_disk->fops->swap_slot_free_notify;
@@ -746,6 +869,13 @@ static void swap_range_free(struct swap_info_struct *si, unsigned long offset,
 	clear_shadow_from_swap_cache(si->type, begin, end);
 }
 
+static void swap_range_free(struct swap_info_struct *si, unsigned long offset,
+			    unsigned int nr_entries)
+{
+	swap_range_unuse(si, offset, offset + nr_entries - 1, nr_entries);
+	swap_range_invalidate(si, offset, nr_entries);
+}
+
 static void set_cluster_next(struct swap_info_struct *si, unsigned long next)
 {
 	unsigned long prev;
@@ -785,6 +915,7 @@ static int scan_swap_map_slots(struct swap_info_struct *si,
 	int latency_ration = LATENCY_LIMIT;
 	int n_ret = 0;
 	bool scanned_many = false;
+	bool reserved;
 
 	/*
 	 * We try to cluster swap pages by allocating them sequentially
@@ -891,11 +1022,14 @@ static int scan_swap_map_slots(struct swap_info_struct *si,
 		else
 			goto done;
 	}
+	/* The slots of a reserved cluster have been accounted already */
+	reserved = ci && cluster_is_percpu(ci);
 	WRITE_ONCE(si->swap_map[offset], usage);
 	inc_cluster_info_page(si, si->cluster_info, offset);
 	unlock_cluster(ci);
 
-	swap_range_alloc(si, offset, 1);
+	if (!reserved)
+		swap_range_alloc(si, offset, 1);
 	slots[n_ret++] = swp_entry(si->type, offset);
 
 	/* got enough slots or reach max slots? */
@@ -991,6 +1125,47 @@ static int scan_swap_map_slots(struct swap_info_struct *si,
 	return n_ret;
 }
 
+/*
+ * There is no free cluster left, but CPUs may hold reserved clusters none
+ * of whose slots are in use yet. Turn one of them into a huge cluster
+ * rather than have the THP split. Called with si->lock held.
+ */
+static int swap_alloc_reserved_cluster(struct swap_info_struct *si,
+				       swp_entry_t *slot)
+{
+	struct percpu_cluster *cluster;
+	struct swap_cluster_info *ci;
+	unsigned long offset;
+	int cpu;
+
+	if (!si->cluster_info)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		cluster = per_cpu_ptr(si->percpu_cluster, cpu);
+		if (cluster_is_null(&cluster->index))
+			continue;
+
+		offset = cluster_next(&cluster->index) * SWAPFILE_CLUSTER;
+		ci = lock_cluster(si, offset);
+		if (!cluster_is_percpu(ci) || cluster_count(ci)) {
+			unlock_cluster(ci);
+			continue;
+		}
+
+		cluster_set_null(&cluster->index);
+		cluster_set_count_flag(ci, SWAPFILE_CLUSTER, CLUSTER_FLAG_HUGE);
+		memset(si->swap_map + offset, SWAP_HAS_CACHE, SWAPFILE_CLUSTER);
+		unlock_cluster(ci);
+
+		/* The slots were accounted when the cluster was reserved */
+		*slot = swp_entry(si->type, offset);
+		return 1;
+	}
+
+	return 0;
+}
+
 static int swap_alloc_cluster(struct swap_info_struct *si, swp_entry_t *slot)
 {
 	unsigned long idx;
@@ -1007,7 +1182,7 @@ static int swap_alloc_cluster(struct swap_info_struct *si, swp_entry_t *slot)
 	}
 
 	if (cluster_list_empty(&si->free_clusters))
-		return 0;
+		return swap_alloc_reserved_cluster(si, slot);
 
 	idx = cluster_list_first(&si->free_clusters);
 	offset = idx * SWAPFILE_CLUSTER;
@@ -1036,6 +1211,64 @@ static void swap_free_cluster(struct swap_info_struct *si, unsigned long idx)
 	swap_range_free(si, offset, SWAPFILE_CLUSTER);
 }
 
+/*
+ * Allocate entries from the cluster this CPU has reserved. Only the cluster
+ * lock is taken: the slots of a reserved cluster have been accounted in
+ * si->inuse_pages when it was reserved, and the reservation is dropped
+ * under both the cluster lock and si->lock.
+ */
+static int swap_alloc_fast(struct swap_info_struct *si, int nr,
+			   swp_entry_t slots[])
+{
+	struct percpu_cluster *cluster;
+	struct swap_cluster_info *ci;
+	unsigned long offset, base;
+	unsigned int i;
+	int n_ret = 0;
+
+	/* Keep swapoff from freeing the cluster info under us */
+	if (!percpu_ref_tryget_live(&si->users))
+		return 0;
+	/* Paired with the spin_unlock() after setup_swap_info() */
+	smp_rmb();
+
+	if (!si->cluster_info)
+		goto put;
+
+	cluster = get_cpu_ptr(si->percpu_cluster);
+	if (cluster_is_null(&cluster->index))
+		goto out;
+
+	base = cluster_next(&cluster->index) * SWAPFILE_CLUSTER;
+	ci = lock_cluster(si, base);
+	if (!cluster_is_percpu(ci) || !(si->flags & SWP_WRITEOK))
+		goto unlock;
+
+	offset = cluster->next;
+	if (offset < base || offset >= base + SWAPFILE_CLUSTER)
+		offset = base;
+
+	for (i = 0; i < SWAPFILE_CLUSTER && n_ret < nr; i++) {
+		if (cluster_count(ci) == SWAPFILE_CLUSTER)
+			break;
+		if (!si->swap_map[offset]) {
+			WRITE_ONCE(si->swap_map[offset], SWAP_HAS_CACHE);
+			inc_cluster_info_page(si, si->cluster_info, offset);
+			slots[n_ret++] = swp_entry(si->type, offset);
+		}
+		if (++offset == base + SWAPFILE_CLUSTER)
+			offset = base;
+	}
+	cluster->next = offset;
+unlock:
+	unlock_cluster(ci);
+out:
+	put_cpu_ptr(si->percpu_cluster);
+put:
+	percpu_ref_put(&si->users);
+	return n_ret;
+}
+
 int get_swap_pages(int n_goal, swp_entry_t swp_entries[], int entry_size)
 {
 	unsigned long size = swap_entry_size(entry_size);
@@ -1065,6 +1298,11 @@ int get_swap_pages(int n_goal, swp_entry_t swp_entries[], int entry_size)
 		/* requeue si to after same-priority siblings */
 		plist_requeue(&si->avail_lists[node], &swap_avail_heads[node]);
 		spin_unlock(&swap_avail_lock);
+		if (size == 1) {
+			n_ret = swap_alloc_fast(si, n_goal, swp_entries);
+			if (n_ret)
+				goto check_out;
+		}
 		spin_lock(&si->lock);
 		if (!si->highest_bit || !(si->flags & SWP_WRITEOK)) {
 			spin_lock(&swap_avail_lock);
@@ -1317,16 +1555,21 @@ static void swap_entry_free(struct swap_info_struct *p, swp_entry_t entry)
 	struct swap_cluster_info *ci;
 	unsigned long offset = swp_offset(entry);
 	unsigned char count;
+	bool reserved;
 
 	ci = lock_cluster(p, offset);
 	count = p->swap_map[offset];
 	VM_BUG_ON(count != SWAP_HAS_CACHE);
 	p->swap_map[offset] = 0;
 	dec_cluster_info_page(p, p->cluster_info, offset);
+	reserved = ci && cluster_is_percpu(ci);
 	unlock_cluster(ci);
 
 	mem_cgroup_uncharge_swap(entry, 1);
-	swap_range_free(p, offset, 1);
+	if (reserved)
+		swap_range_invalidate(p, offset, 1);
+	else
+		swap_range_free(p, offset, 1);
 }
 
 /*
@@ -2584,6 +2827,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	atomic_long_sub(p->pages, &nr_swap_pages);
 	total_swap_pages -= p->pages;
 	p->flags &= ~SWP_WRITEOK;
+	swap_unreserve_all(p);
 	spin_unlock(&p->lock);
 	spin_unlock(&swap_lock);
 
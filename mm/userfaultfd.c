@@ -712,16 +712,25 @@ int mwriteprotect_range(struct mm_struct *dst_mm, unsigned long start,
 	err = -ENOENT;
 	dst_vma = find_dst_vma(dst_mm, start, len);
 	/*
-	 * Make sure the vma is not shared, that the dst range is
-	 * both valid and fully within a single existing vma.
+	 * Make sure the dst range is both valid and fully within a single
+	 * existing vma. Registration only allows shared vmas in async mode.
 	 */
-	if (!dst_vma || (dst_vma->vm_flags & VM_SHARED))
+	if (!dst_vma)
 		goto out_unlock;
 	if (!userfaultfd_wp(dst_vma))
 		goto out_unlock;
-	if (!vma_is_anonymous(dst_vma))
+	if (!vma_is_anonymous(dst_vma) && !vma_is_shmem(dst_vma) &&
+	    !is_vm_hugetlb_page(dst_vma))
 		goto out_unlock;
 
+	if (is_vm_hugetlb_page(dst_vma)) {
+		unsigned long page_mask = vma_kernel_pagesize(dst_vma) - 1;
+
+		err = -EINVAL;
+		if ((start & page_mask) || (len & page_mask))
+			goto out_unlock;
+	}
+
 	if (enable_wp)
 		newprot = vm_get_page_prot(dst_vma->vm_flags & ~(VM_WRITE));
 	else
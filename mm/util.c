@@ -23,6 +23,7 @@
 #include <linux/processor.h>
 #include <linux/sizes.h>
 #include <linux/compat.h>
+#include <linux/page_copy.h>
 
 #include <linux/uaccess.h>
 
@@ -837,11 +838,16 @@ EXPORT_SYMBOL_GPL(__page_mapcount);
 void copy_huge_page(struct page *dst, struct page *src)
 {
 	unsigned i, nr = compound_nr(src);
+	struct page_copy_batch batch;
 
+	page_copy_batch_init(&batch, nr);
 	for (i = 0; i < nr; i++) {
 		cond_resched();
-		copy_highpage(nth_page(dst, i), nth_page(src, i));
+		if (!page_copy_batch_add(&batch, nth_page(dst, i),
+					 nth_page(src, i)))
+			copy_highpage(nth_page(dst, i), nth_page(src, i));
 	}
+	page_copy_batch_finish(&batch);
 }
 
 int sysctl_overcommit_memory __read_mostly = OVERCOMMIT_GUESS;
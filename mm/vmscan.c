@@ -50,6 +50,9 @@
 #include <linux/printk.h>
 #include <linux/dax.h>
 #include <linux/psi.h>
+#include <linux/pagewalk.h>
+#include <linux/memory_hotplug.h>
+#include <linux/debugfs.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -125,6 +128,12 @@ struct scan_control {
 	/* Always discard instead of demoting to lower tier memory */
 	unsigned int no_demotion:1;
 
+	/* Proactive reclaim invoked by userspace through memory.reclaim */
+	unsigned int proactive:1;
+
+	/* Swappiness for proactive reclaim, always use sc_swappiness() */
+	int *proactive_swappiness;
+
 	/* Allocation order */
 	s8 order;
 
@@ -433,6 +442,13 @@ static bool cgroup_reclaim(struct scan_control *sc)
 	return sc->target_mem_cgroup;
 }
 
+static int sc_swappiness(struct scan_control *sc, struct mem_cgroup *memcg)
+{
+	if (sc->proactive && sc->proactive_swappiness)
+		return *sc->proactive_swappiness;
+	return mem_cgroup_swappiness(memcg);
+}
+
 /**
  * writeback_throttling_sane - is the usual dirty throttling mechanism available?
  * @sc: scan_control in question
@@ -483,6 +499,11 @@ static bool cgroup_reclaim(struct scan_control *sc)
 	return false;
 }
 
+static int sc_swappiness(struct scan_control *sc, struct mem_cgroup *memcg)
+{
+	return READ_ONCE(vm_swappiness);
+}
+
 static bool writeback_throttling_sane(struct scan_control *sc)
 {
 	return true;
@@ -1346,15 +1367,11 @@ static unsigned int demote_page_list(struct list_head *demote_pages,
 		return 0;
 
 	/* Demotion ignores all cpuset and mempolicy settings */
+	/* PGDEMOTE_* are counted per page by migrate_account_tiering() */
 	err = migrate_pages(demote_pages, alloc_demote_page, NULL,
 			    target_nid, MIGRATE_ASYNC, MR_DEMOTION,
 			    &nr_succeeded);
 
-	if (current_is_kswapd())
-		__count_vm_events(PGDEMOTE_KSWAPD, nr_succeeded);
-	else
-		__count_vm_events(PGDEMOTE_DIRECT, nr_succeeded);
-
 	return nr_succeeded;
 }
 
@@ -2512,7 +2529,7 @@ static void get_scan_count(struct lruvec *lruvec, struct scan_control *sc,
 	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
 	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
 	unsigned long anon_cost, file_cost, total_cost;
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc_swappiness(sc, memcg);
 	u64 fraction[ANON_AND_FILE];
 	u64 denominator = 0;	/* gcc */
 	enum scan_balance scan_balance;
@@ -2537,6 +2554,13 @@ static void get_scan_count(struct lruvec *lruvec, struct scan_control *sc,
 		goto out;
 	}
 
+	/* Proactive reclaim asked for anonymous pages only */
+	if (swappiness == SWAPPINESS_ANON_ONLY) {
+		WARN_ON_ONCE(!sc->proactive);
+		scan_balance = SCAN_ANON;
+		goto out;
+	}
+
 	/*
 	 * Do not apply any pressure balancing cleverness when the
 	 * system is close to OOM, scan both anon and file equally
@@ -2718,6 +2742,895 @@ static bool can_age_anon_pages(struct pglist_data *pgdat,
 	return can_demote(pgdat->node_id, sc);
 }
 
+#ifdef CONFIG_LRU_GEN
+
+DEFINE_STATIC_KEY_MAYBE(CONFIG_LRU_GEN_ENABLED, lru_gen_key);
+
+/* the number of pages the eviction isolates and the aging batches at a time */
+#define MIN_LRU_BATCH		BITS_PER_LONG
+#define MAX_LRU_BATCH		(MIN_LRU_BATCH * 64)
+
+/******************************************************************************
+ *                          mm_struct list
+ ******************************************************************************/
+
+/*
+ * All mm_structs that can be aged are kept on one list. A walker takes the
+ * first mm_struct and rotates it to the tail, so that concurrent and
+ * consecutive walkers share the work rather than repeating it.
+ */
+static struct {
+	struct list_head fifo;
+	unsigned long nr;
+	spinlock_t lock;
+} lru_gen_mm_list = {
+	.fifo = LIST_HEAD_INIT(lru_gen_mm_list.fifo),
+	.lock = __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+};
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	VM_WARN_ON_ONCE(!list_empty(&mm->lru_gen.list));
+
+	spin_lock(&lru_gen_mm_list.lock);
+	list_add_tail(&mm->lru_gen.list, &lru_gen_mm_list.fifo);
+	lru_gen_mm_list.nr++;
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	if (list_empty(&mm->lru_gen.list))
+		return;
+
+	spin_lock(&lru_gen_mm_list.lock);
+	list_del_init(&mm->lru_gen.list);
+	lru_gen_mm_list.nr--;
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+/******************************************************************************
+ *                          the aging
+ ******************************************************************************/
+
+struct lru_gen_mm_walk {
+	struct lruvec *lruvec;
+	unsigned long max_seq;
+	bool can_swap;
+	/* accessed pages not yet moved, with a reference held on each */
+	int nr_pages;
+	struct page *pages[MIN_LRU_BATCH];
+};
+
+static int lru_gen_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return lrugen->max_seq - lrugen->min_seq[type] + 1;
+}
+
+/* Must be called with lru_lock held. */
+static void lru_gen_move_page(struct lruvec *lruvec, struct page *page,
+			      int old_gen, int new_gen, bool tail)
+{
+	struct list_head *head;
+	int type = page_is_file_lru(page);
+	int zone = page_zonenum(page);
+
+	lockdep_assert_held(&lruvec->lru_lock);
+	VM_WARN_ON_ONCE_PAGE(page_lru_gen(page) != old_gen, page);
+
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (new_gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+
+	head = &lruvec->lrugen.lists[new_gen][type][zone];
+	if (tail)
+		list_move_tail(&page->lru, head);
+	else
+		list_move(&page->lru, head);
+}
+
+static bool lru_gen_page_eligible(struct page *page,
+				  struct lru_gen_mm_walk *walk)
+{
+	page = compound_head(page);
+
+	if (!PageLRU(page) || PageUnevictable(page))
+		return false;
+
+	if (!walk->can_swap && PageAnon(page) && PageSwapBacked(page))
+		return false;
+
+	/* rechecked under lru_lock before the page is moved */
+	return page_matches_lruvec(page, walk->lruvec);
+}
+
+static void lru_gen_walk_add(struct lru_gen_mm_walk *walk, struct page *page)
+{
+	page = compound_head(page);
+	get_page(page);
+	walk->pages[walk->nr_pages++] = page;
+}
+
+/* Move the pages found accessed to the generation the walk is filling. */
+static void lru_gen_walk_flush(struct lru_gen_mm_walk *walk)
+{
+	struct lruvec *lruvec = walk->lruvec;
+	int new_gen = lru_gen_from_seq(walk->max_seq);
+	int i;
+
+	if (!walk->nr_pages)
+		return;
+
+	spin_lock_irq(&lruvec->lru_lock);
+	/* the aging raced with another one that already finished */
+	if (READ_ONCE(lruvec->lrugen.max_seq) == walk->max_seq) {
+		for (i = 0; i < walk->nr_pages; i++) {
+			struct page *page = walk->pages[i];
+			int old_gen;
+
+			if (!PageLRU(page) || !page_matches_lruvec(page, lruvec))
+				continue;
+
+			old_gen = page_lru_gen(page);
+			if (old_gen < 0 || old_gen == new_gen)
+				continue;
+
+			lru_gen_move_page(lruvec, page, old_gen, new_gen, false);
+		}
+	}
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	for (i = 0; i < walk->nr_pages; i++)
+		put_page(walk->pages[i]);
+	walk->nr_pages = 0;
+}
+
+static int lru_gen_walk_pmd_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *args)
+{
+	struct lru_gen_mm_walk *walk = args->private;
+	struct vm_area_struct *vma = args->vma;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+
+again:
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge(*pmd)) {
+		pmd_t orig_pmd;
+
+		ptl = pmd_trans_huge_lock(pmd, vma);
+		if (!ptl)
+			return 0;
+
+		orig_pmd = *pmd;
+		if (pmd_present(orig_pmd) && !is_huge_zero_pmd(orig_pmd) &&
+		    pmd_young(orig_pmd)) {
+			struct page *page = pmd_page(orig_pmd);
+
+			if (lru_gen_page_eligible(page, walk) &&
+			    pmdp_test_and_clear_young(vma, addr, pmd))
+				lru_gen_walk_add(walk, page);
+		}
+		spin_unlock(ptl);
+		addr = end;
+		goto flush;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(args->mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	for (; addr < end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || !lru_gen_page_eligible(page, walk))
+			continue;
+
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+
+		lru_gen_walk_add(walk, page);
+		if (walk->nr_pages == ARRAY_SIZE(walk->pages)) {
+			addr += PAGE_SIZE;
+			break;
+		}
+	}
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+flush:
+	/* move the batch outside the PTL to keep its hold time short */
+	lru_gen_walk_flush(walk);
+	cond_resched();
+
+	/* the batch filled up before the end of this PMD */
+	if (addr < end)
+		goto again;
+
+	return 0;
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *args)
+{
+	struct lru_gen_mm_walk *walk = args->private;
+	struct vm_area_struct *vma = args->vma;
+
+	if (vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+
+	if (vma_is_anonymous(vma) && !walk->can_swap)
+		return 1;
+
+	return 0;
+}
+
+static const struct mm_walk_ops lru_gen_walk_ops = {
+	.pmd_entry		= lru_gen_walk_pmd_range,
+	.test_walk		= lru_gen_walk_test,
+};
+
+static void lru_gen_walk_mm_list(struct lru_gen_mm_walk *walk)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(walk->lruvec);
+	unsigned long nr;
+
+	spin_lock(&lru_gen_mm_list.lock);
+	nr = lru_gen_mm_list.nr;
+	spin_unlock(&lru_gen_mm_list.lock);
+
+	while (nr--) {
+		struct mm_struct *mm = NULL;
+
+		spin_lock(&lru_gen_mm_list.lock);
+		if (!list_empty(&lru_gen_mm_list.fifo)) {
+			mm = list_first_entry(&lru_gen_mm_list.fifo,
+					      struct mm_struct, lru_gen.list);
+			list_move_tail(&mm->lru_gen.list, &lru_gen_mm_list.fifo);
+			if (!mmget_not_zero(mm))
+				mm = NULL;
+		}
+		spin_unlock(&lru_gen_mm_list.lock);
+
+		if (!mm)
+			continue;
+
+		if ((!memcg || mem_cgroup_is_root(memcg) ||
+		     mm_match_cgroup(mm, memcg)) && mmap_read_trylock(mm)) {
+			walk_page_range(mm, 0, ULONG_MAX, &lru_gen_walk_ops, walk);
+			mmap_read_unlock(mm);
+		}
+
+		mmput_async(mm);
+
+		/* don't keep the next generation waiting on a dying task */
+		if (fatal_signal_pending(current) ||
+		    READ_ONCE(walk->lruvec->lrugen.max_seq) != walk->max_seq)
+			break;
+	}
+}
+
+/* Must be called with lru_lock held. */
+static void inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	int zone;
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[old_gen][type][zone];
+
+		/* keep the oldest pages at the tail */
+		while (!list_empty(head)) {
+			struct page *page = list_first_entry(head, struct page, lru);
+
+			lru_gen_move_page(lruvec, page, old_gen, new_gen, true);
+		}
+	}
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+}
+
+/* Must be called with lru_lock held. */
+static void try_to_inc_min_seq(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type, zone;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		while (lru_gen_nr_gens(lruvec, type) > MIN_NR_GENS) {
+			int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				if (!list_empty(&lrugen->lists[gen][type][zone]))
+					goto next;
+			}
+
+			WRITE_ONCE(lrugen->min_seq[type],
+				   lrugen->min_seq[type] + 1);
+		}
+next:
+		;
+	}
+}
+
+static void inc_max_seq(struct lruvec *lruvec, unsigned long max_seq)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int prev, next;
+	int type, zone;
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	if (max_seq != lrugen->max_seq)
+		goto unlock;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (lru_gen_nr_gens(lruvec, type) == MAX_NR_GENS)
+			inc_min_seq(lruvec, type);
+	}
+
+	/* the second youngest generation is about to become inactive */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	next = lru_gen_from_seq(lrugen->max_seq + 1);
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_INACTIVE_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru, zone, delta);
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+		}
+	}
+
+	WRITE_ONCE(lrugen->timestamps[next], jiffies);
+	/* make sure preceding modifications appear */
+	smp_store_release(&lrugen->max_seq, lrugen->max_seq + 1);
+unlock:
+	spin_unlock_irq(&lruvec->lru_lock);
+}
+
+/*
+ * Walk the page tables of the mm_structs on the list, move the pages found
+ * accessed to the youngest generation and then open a new one. The walk is
+ * best effort: without memory for its buffer, the aging still increments
+ * max_seq and the eviction falls back to the accessed bits checked by
+ * shrink_page_list().
+ */
+static void lru_gen_age(struct lruvec *lruvec, bool can_swap)
+{
+	struct lru_gen_mm_walk *walk;
+	unsigned long max_seq = READ_ONCE(lruvec->lrugen.max_seq);
+
+	walk = kzalloc(sizeof(*walk),
+		       __GFP_HIGH | __GFP_NOMEMALLOC | __GFP_NOWARN);
+	if (walk) {
+		walk->lruvec = lruvec;
+		walk->max_seq = max_seq;
+		walk->can_swap = can_swap;
+		lru_gen_walk_mm_list(walk);
+		kfree(walk);
+	}
+
+	inc_max_seq(lruvec, max_seq);
+}
+
+/******************************************************************************
+ *                          the eviction
+ ******************************************************************************/
+
+/*
+ * Returns true if the page was moved somewhere other than the isolation list,
+ * i.e., it shouldn't or can't be reclaimed right now.
+ */
+static bool lru_gen_sort_page(struct lruvec *lruvec, struct page *page,
+			      struct scan_control *sc, int gen)
+{
+	int new_gen = lru_gen_from_seq(lruvec->lrugen.min_seq
+				       [page_is_file_lru(page)] + 1);
+
+	/* unevictable */
+	if (!page_evictable(page)) {
+		del_page_from_lru_list(page, lruvec);
+		SetPageUnevictable(page);
+		add_page_to_lru_list(page, lruvec);
+		__count_vm_events(UNEVICTABLE_PGCULLED, thp_nr_pages(page));
+		return true;
+	}
+
+	/* waiting for writeback */
+	if (PageWriteback(page) || (!sc->may_unmap && page_mapped(page)) ||
+	    (!sc->may_writepage && PageDirty(page) && page_is_file_lru(page))) {
+		if (PageWriteback(page))
+			SetPageReclaim(page);
+		lru_gen_move_page(lruvec, page, gen, new_gen, false);
+		return true;
+	}
+
+	return false;
+}
+
+static bool lru_gen_isolate_page(struct lruvec *lruvec, struct page *page)
+{
+	/* see the comment in isolate_lru_pages() */
+	if (!get_page_unless_zero(page))
+		return false;
+
+	if (!TestClearPageLRU(page)) {
+		put_page(page);
+		return false;
+	}
+
+	lru_gen_del_page(lruvec, page, true);
+	return true;
+}
+
+/* Must be called with lru_lock held. */
+static int lru_gen_isolate_pages(struct lruvec *lruvec, struct scan_control *sc,
+				 int type, struct list_head *list,
+				 unsigned long *nr_scanned)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	int remaining = MAX_LRU_BATCH;
+	int isolated = 0;
+	int zone;
+
+	*nr_scanned = 0;
+
+	for (zone = sc->reclaim_idx; zone >= 0; zone--) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+			int delta = thp_nr_pages(page);
+
+			VM_WARN_ON_ONCE_PAGE(page_is_file_lru(page) != type, page);
+			VM_WARN_ON_ONCE_PAGE(page_zonenum(page) != zone, page);
+
+			*nr_scanned += delta;
+
+			if (!lru_gen_sort_page(lruvec, page, sc, gen)) {
+				if (lru_gen_isolate_page(lruvec, page)) {
+					list_add(&page->lru, list);
+					isolated += delta;
+				} else {
+					lru_gen_move_page(lruvec, page, gen,
+							  new_gen, false);
+				}
+			}
+
+			if (!--remaining || isolated >= MIN_LRU_BATCH)
+				return isolated;
+		}
+	}
+
+	return isolated;
+}
+
+/*
+ * Pick the type with the older oldest generation; ties go to file unless the
+ * swappiness prefers anon. Returns -1 if neither type has a generation to
+ * spare, in which case the aging has to run first.
+ */
+static int lru_gen_pick_type(struct lruvec *lruvec, int swappiness,
+			     bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	bool anon = can_swap &&
+		    lru_gen_nr_gens(lruvec, LRU_GEN_ANON) > MIN_NR_GENS;
+	bool file = swappiness != SWAPPINESS_ANON_ONLY &&
+		    lru_gen_nr_gens(lruvec, LRU_GEN_FILE) > MIN_NR_GENS;
+
+	if (anon && file) {
+		if (lrugen->min_seq[LRU_GEN_ANON] != lrugen->min_seq[LRU_GEN_FILE])
+			return lrugen->min_seq[LRU_GEN_ANON] <
+			       lrugen->min_seq[LRU_GEN_FILE] ?
+			       LRU_GEN_ANON : LRU_GEN_FILE;
+
+		return swappiness > 100 ? LRU_GEN_ANON : LRU_GEN_FILE;
+	}
+
+	if (file)
+		return LRU_GEN_FILE;
+	if (anon)
+		return LRU_GEN_ANON;
+
+	return -1;
+}
+
+static unsigned long lru_gen_evict(struct lruvec *lruvec,
+				   struct scan_control *sc, int type)
+{
+	LIST_HEAD(page_list);
+	unsigned long nr_scanned;
+	unsigned int nr_reclaimed;
+	unsigned long nr_taken;
+	struct reclaim_stat stat;
+	enum vm_event_item item;
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+
+	lru_add_drain();
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	nr_taken = lru_gen_isolate_pages(lruvec, sc, type, &page_list,
+					 &nr_scanned);
+	try_to_inc_min_seq(lruvec);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, nr_taken);
+	item = current_is_kswapd() ? PGSCAN_KSWAPD : PGSCAN_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_scanned);
+	__count_memcg_events(memcg, item, nr_scanned);
+	__count_vm_events(PGSCAN_ANON + type, nr_scanned);
+
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	if (!nr_taken)
+		return nr_scanned;
+
+	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, &stat, false);
+
+	spin_lock_irq(&lruvec->lru_lock);
+	move_pages_to_lru(lruvec, &page_list);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr_taken);
+	item = current_is_kswapd() ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_reclaimed);
+	__count_memcg_events(memcg, item, nr_reclaimed);
+	__count_vm_events(PGSTEAL_ANON + type, nr_reclaimed);
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	mem_cgroup_uncharge_list(&page_list);
+	free_unref_page_list(&page_list);
+
+	sc->nr.dirty += stat.nr_dirty;
+	sc->nr.congested += stat.nr_congested;
+	sc->nr.unqueued_dirty += stat.nr_unqueued_dirty;
+	sc->nr.writeback += stat.nr_writeback;
+	sc->nr.immediate += stat.nr_immediate;
+	sc->nr.taken += nr_taken;
+	if (type)
+		sc->nr.file_taken += nr_taken;
+
+	sc->nr_reclaimed += nr_reclaimed;
+
+	return nr_scanned;
+}
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	int swappiness = sc_swappiness(sc, memcg);
+	bool can_swap = sc->may_swap && (swappiness || !cgroup_reclaim(sc)) &&
+			can_reclaim_anon_pages(memcg, pgdat->node_id, sc);
+	unsigned long nr_to_scan = 0;
+	struct blk_plug plug;
+	bool aged = false;
+	enum lru_list lru;
+
+	for_each_evictable_lru(lru) {
+		if (is_file_lru(lru) || can_swap)
+			nr_to_scan += lruvec_lru_size(lruvec, lru,
+						      sc->reclaim_idx);
+	}
+	nr_to_scan >>= sc->priority;
+
+	blk_start_plug(&plug);
+
+	while (nr_to_scan) {
+		unsigned long scanned;
+		int type = lru_gen_pick_type(lruvec, swappiness, can_swap);
+
+		if (type < 0) {
+			/* age at most once per call so that priority can rise */
+			if (aged)
+				break;
+
+			lru_gen_age(lruvec, can_swap);
+			aged = true;
+			continue;
+		}
+
+		scanned = lru_gen_evict(lruvec, sc, type);
+		if (!scanned)
+			break;
+
+		nr_to_scan -= min(scanned, nr_to_scan);
+
+		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+
+		cond_resched();
+	}
+
+	blk_finish_plug(&plug);
+}
+
+/******************************************************************************
+ *                          state change
+ ******************************************************************************/
+
+/* Move pages from the classic lists onto the multi-gen lists. */
+static bool lru_gen_fill_lists(struct lruvec *lruvec)
+{
+	int remaining = MAX_LRU_BATCH;
+	enum lru_list lru;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			VM_WARN_ON_ONCE_PAGE(PageUnevictable(page), page);
+			VM_WARN_ON_ONCE_PAGE(PageActive(page) != is_active_lru(lru), page);
+
+			del_page_from_lru_list(page, lruvec);
+			add_page_to_lru_list(page, lruvec);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* Move pages from the multi-gen lists back onto the classic lists. */
+static bool lru_gen_drain_lists(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int remaining = MAX_LRU_BATCH;
+	int gen, type, zone;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head = &lrugen->lists[gen][type][zone];
+
+				while (!list_empty(head)) {
+					struct page *page = lru_to_page(head);
+
+					del_page_from_lru_list(page, lruvec);
+					add_page_to_lru_list(page, lruvec);
+
+					if (!--remaining)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static void lru_gen_change_state(bool enabled)
+{
+	static DEFINE_MUTEX(state_mutex);
+	struct mem_cgroup *memcg;
+
+	cpus_read_lock();
+	get_online_mems();
+	mutex_lock(&state_mutex);
+
+	if (enabled == lru_gen_enabled())
+		goto unlock;
+
+	if (enabled)
+		static_branch_enable_cpuslocked(&lru_gen_key);
+	else
+		static_branch_disable_cpuslocked(&lru_gen_key);
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		int nid;
+
+		for_each_online_node(nid) {
+			struct lruvec *lruvec = mem_cgroup_lruvec(memcg, NODE_DATA(nid));
+
+			spin_lock_irq(&lruvec->lru_lock);
+
+			VM_WARN_ON_ONCE(lruvec->lrugen.enabled == enabled);
+			lruvec->lrugen.enabled = enabled;
+
+			while (!(enabled ? lru_gen_fill_lists(lruvec) :
+					   lru_gen_drain_lists(lruvec))) {
+				spin_unlock_irq(&lruvec->lru_lock);
+				cond_resched();
+				spin_lock_irq(&lruvec->lru_lock);
+			}
+
+			spin_unlock_irq(&lruvec->lru_lock);
+		}
+
+		cond_resched();
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+unlock:
+	mutex_unlock(&state_mutex);
+	put_online_mems();
+	cpus_read_unlock();
+}
+
+/******************************************************************************
+ *                          sysfs interface
+ ******************************************************************************/
+
+static ssize_t show_enabled(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	return sysfs_emit(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t store_enabled(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t len)
+{
+	bool enabled;
+
+	if (kstrtobool(buf, &enabled))
+		return -EINVAL;
+
+	lru_gen_change_state(enabled);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr = __ATTR(
+	enabled, 0644, show_enabled, store_enabled
+);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+/******************************************************************************
+ *                          debugfs interface
+ ******************************************************************************/
+
+static void lru_gen_seq_show_lruvec(struct seq_file *m, struct lruvec *lruvec,
+				    int nid)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long max_seq = READ_ONCE(lrugen->max_seq);
+	unsigned long min_seq[ANON_AND_FILE] = {
+		READ_ONCE(lrugen->min_seq[LRU_GEN_ANON]),
+		READ_ONCE(lrugen->min_seq[LRU_GEN_FILE]),
+	};
+	unsigned long seq;
+
+	seq_printf(m, " node %5d\n", nid);
+
+	for (seq = min(min_seq[0], min_seq[1]); seq <= max_seq; seq++) {
+		int gen = lru_gen_from_seq(seq);
+		unsigned long birth = READ_ONCE(lrugen->timestamps[gen]);
+		int type, zone;
+
+		seq_printf(m, " %10lu %10u", seq, jiffies_to_msecs(jiffies - birth));
+
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			long size = 0;
+
+			if (seq >= min_seq[type]) {
+				for (zone = 0; zone < MAX_NR_ZONES; zone++)
+					size += max(READ_ONCE(lrugen->nr_pages[gen][type][zone]), 0L);
+			}
+
+			seq_printf(m, " %10ld", size);
+		}
+
+		seq_putc(m, '\n');
+	}
+}
+
+/*
+ * Format:
+ *   memcg memcg_id memcg_path
+ *    node node_id
+ *     seq age_in_ms nr_anon_pages nr_file_pages
+ */
+static int lru_gen_seq_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg;
+	char *path = kvmalloc(PATH_MAX, GFP_KERNEL);
+
+	if (!path)
+		return -ENOMEM;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		int nid;
+
+#ifdef CONFIG_MEMCG
+		if (memcg)
+			cgroup_path(memcg->css.cgroup, path, PATH_MAX);
+		else
+#endif
+			path[0] = '\0';
+
+		seq_printf(m, "memcg %5hu %s\n", mem_cgroup_id(memcg), path);
+
+		for_each_online_node(nid)
+			lru_gen_seq_show_lruvec(m, mem_cgroup_lruvec(memcg, NODE_DATA(nid)), nid);
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+
+	kvfree(path);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(lru_gen_seq);
+
+/******************************************************************************
+ *                          initialization
+ ******************************************************************************/
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
+
+	lrugen->max_seq = MIN_NR_GENS + 1;
+	lrugen->enabled = lru_gen_enabled();
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		lrugen->timestamps[gen] = jiffies;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+		}
+	}
+}
+
+static int __init init_lru_gen(void)
+{
+	BUILD_BUG_ON(MIN_NR_GENS + 1 >= MAX_NR_GENS);
+	BUILD_BUG_ON(BIT(LRU_GEN_WIDTH) <= MAX_NR_GENS);
+
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	debugfs_create_file("lru_gen", 0444, NULL, NULL, &lru_gen_seq_fops);
+
+	return 0;
+}
+late_initcall(init_lru_gen);
+
+#else /* !CONFIG_LRU_GEN */
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 {
 	unsigned long nr[NR_LRU_LISTS];
@@ -2729,6 +3642,11 @@ static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 	bool proportional_reclaim;
 	struct blk_plug plug;
 
+	if (lru_gen_enabled()) {
+		lru_gen_shrink_lruvec(lruvec, sc);
+		return;
+	}
+
 	get_scan_count(lruvec, sc, nr);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2906,6 +3824,9 @@ static void shrink_node_memcgs(pg_data_t *pgdat, struct scan_control *sc)
 {
 	struct mem_cgroup *target_memcg = sc->target_mem_cgroup;
 	struct mem_cgroup *memcg;
+	/* Reclaim from here demotes, protect the top tier part of usage */
+	bool demote = node_is_toptier(pgdat->node_id) &&
+		      can_demote(pgdat->node_id, sc);
 
 	memcg = mem_cgroup_iter(target_memcg, NULL, NULL);
 	do {
@@ -2923,13 +3844,15 @@ static void shrink_node_memcgs(pg_data_t *pgdat, struct scan_control *sc)
 
 		mem_cgroup_calculate_protection(target_memcg, memcg);
 
-		if (mem_cgroup_below_min(memcg)) {
+		if (mem_cgroup_below_min(memcg) ||
+		    (demote && mem_cgroup_toptier_below_min(memcg))) {
 			/*
 			 * Hard protection.
 			 * If there is no reclaimable memory, OOM.
 			 */
 			continue;
-		} else if (mem_cgroup_below_low(memcg)) {
+		} else if (mem_cgroup_below_low(memcg) ||
+			   (demote && mem_cgroup_toptier_below_low(memcg))) {
 			/*
 			 * Soft protection.
 			 * Respect the protection only as long as
@@ -2971,10 +3894,11 @@ static void shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 
 again:
 	/*
-	 * Flush the memory cgroup stats, so that we read accurate per-memcg
-	 * lruvec stats for heuristics.
+	 * Flush the memory cgroup stats in rate-limited way as we don't need
+	 * most accurate stats here. We may switch to regular stats flushing
+	 * in the future once it is cheap enough.
 	 */
-	mem_cgroup_flush_stats();
+	mem_cgroup_flush_stats_ratelimited(sc->target_mem_cgroup);
 
 	memset(&sc->nr, 0, sizeof(sc->nr));
 
@@ -3615,7 +4539,8 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					   unsigned long nr_pages,
 					   gfp_t gfp_mask,
-					   bool may_swap)
+					   unsigned int reclaim_options,
+					   int *swappiness)
 {
 	unsigned long nr_reclaimed;
 	unsigned int noreclaim_flag;
@@ -3628,7 +4553,9 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.priority = DEF_PRIORITY,
 		.may_writepage = !laptop_mode,
 		.may_unmap = 1,
-		.may_swap = may_swap,
+		.may_swap = !!(reclaim_options & MEMCG_RECLAIM_MAY_SWAP),
+		.proactive = !!(reclaim_options & MEMCG_RECLAIM_PROACTIVE),
+		.proactive_swappiness = swappiness,
 	};
 	/*
 	 * Traverse the ZONELIST_FALLBACK zonelist of the current node to put
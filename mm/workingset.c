@@ -298,6 +298,12 @@ void workingset_refault(struct page *page, void *shadow)
 
 	unpack_shadow(shadow, &memcgid, &pgdat, &eviction, &workingset);
 
+	/*
+	 * The activation decision below reads the lruvec stats. Flush
+	 * them, if they are overdue, while we can still sleep.
+	 */
+	mem_cgroup_flush_stats_ratelimited(NULL);
+
 	rcu_read_lock();
 	/*
 	 * Look up the memcg associated with the stored ID. It might
@@ -352,7 +358,6 @@ void workingset_refault(struct page *page, void *shadow)
 
 	inc_lruvec_state(lruvec, WORKINGSET_REFAULT_BASE + file);
 
-	mem_cgroup_flush_stats_delayed();
 	/*
 	 * Compare the distance to the existing workingset size. We
 	 * don't activate pages that couldn't stay resident even if
@@ -57,6 +57,9 @@
 #include <linux/wait.h>
 #include <linux/pagemap.h>
 #include <linux/fs.h>
+#include <linux/local_lock.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
 
 #define ZSPAGE_MAGIC	0x58
 
@@ -249,6 +252,21 @@ struct link_free {
 	};
 };
 
+/*
+ * Free objects of a zspage that a CPU took for itself. They stay chained
+ * through link_free in the zspage, starting at @freeobj.
+ */
+struct zs_cache_slot {
+	struct zspage *zspage;
+	unsigned int freeobj;
+	unsigned int nr_free;
+};
+
+struct zs_pcp_cache {
+	local_lock_t lock;
+	struct zs_cache_slot slots[ZS_SIZE_CLASSES];
+};
+
 struct zs_pool {
 	const char *name;
 
@@ -260,8 +278,15 @@ struct zs_pool {
 
 	struct zs_pool_stats stats;
 
+	/* Per-CPU free objects, taken without class->lock */
+	struct zs_pcp_cache __percpu *cache;
+	/* on zs_pools, to drain the caches of CPUs going offline */
+	struct list_head list;
+
 	/* Compact classes */
 	struct shrinker shrinker;
+	/* Class the shrinker resumes an incremental compaction from */
+	int compact_index;
 
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
@@ -299,6 +324,10 @@ struct mapping_area {
 };
 
 #ifdef CONFIG_COMPACTION
+static LIST_HEAD(zs_pools);
+static DEFINE_MUTEX(zs_pools_lock);
+static void zs_cache_drain_cpu(struct zs_pool *pool, unsigned int cpu);
+
 static int zs_register_migration(struct zs_pool *pool);
 static void zs_unregister_migration(struct zs_pool *pool);
 static void migrate_lock_init(struct zspage *zspage);
@@ -1196,9 +1225,15 @@ static int zs_cpu_prepare(unsigned int cpu)
 static int zs_cpu_dead(unsigned int cpu)
 {
 	struct mapping_area *area;
+	struct zs_pool *pool;
 
 	area = &per_cpu(zs_map_area, cpu);
 	__zs_cpu_down(area);
+
+	mutex_lock(&zs_pools_lock);
+	list_for_each_entry(pool, &zs_pools, list)
+		zs_cache_drain_cpu(pool, cpu);
+	mutex_unlock(&zs_pools_lock);
 	return 0;
 }
 
@@ -1395,6 +1430,162 @@ static unsigned long obj_malloc(struct size_class *class,
 	return obj;
 }
 
+/* Map the page holding object @obj_idx and return its link_free */
+static struct link_free *obj_link(struct size_class *class,
+				  struct zspage *zspage, unsigned int obj_idx,
+				  struct page **pagep, void **vaddr)
+{
+	unsigned long offset = obj_idx * class->size;
+	struct page *page = get_first_page(zspage);
+	int i;
+
+	for (i = 0; i < offset >> PAGE_SHIFT; i++)
+		page = get_next_page(page);
+
+	*pagep = page;
+	*vaddr = kmap_atomic(page);
+	return (struct link_free *)(*vaddr + (offset & ~PAGE_MASK));
+}
+
+/*
+ * Allocate an object from the free objects a CPU took from slot->zspage.
+ * Caller holds the local lock of the slot but not class->lock; the migrate
+ * lock keeps the pages of the zspage in place until the handle is set.
+ */
+static void cache_obj_malloc(struct size_class *class,
+			     struct zs_cache_slot *slot, unsigned long handle)
+{
+	struct zspage *zspage = slot->zspage;
+	unsigned int obj_idx = slot->freeobj;
+	struct link_free *link;
+	struct page *page;
+	void *vaddr;
+
+	migrate_read_lock(zspage);
+	link = obj_link(class, zspage, obj_idx, &page, &vaddr);
+	slot->freeobj = link->next >> OBJ_TAG_BITS;
+	link->handle = handle | OBJ_ALLOCATED_TAG;
+	kunmap_atomic(vaddr);
+
+	record_obj(handle, location_to_obj(page, obj_idx));
+	migrate_read_unlock(zspage);
+
+	if (!--slot->nr_free)
+		slot->zspage = NULL;
+}
+
+/*
+ * Hand the free objects of a partially filled zspage to a CPU. They are
+ * accounted as used until the CPU allocates them or gives them back, which
+ * puts the zspage on the ZS_FULL list and out of the way of other CPUs and
+ * of compaction.
+ */
+static bool cache_slot_fill(struct size_class *class,
+			    struct zs_cache_slot *slot)
+{
+	struct zspage *zspage;
+	int nr_free;
+
+	assert_spin_locked(&class->lock);
+
+	zspage = find_get_zspage(class);
+	if (!zspage)
+		return false;
+
+	nr_free = class->objs_per_zspage - get_zspage_inuse(zspage);
+	if (!nr_free)
+		return false;
+
+	slot->zspage = zspage;
+	slot->freeobj = get_freeobj(zspage);
+	slot->nr_free = nr_free;
+	/* Objects freed from now on start a chain of their own */
+	set_freeobj(zspage, -1U);
+
+	mod_zspage_inuse(zspage, nr_free);
+	zs_stat_inc(class, OBJ_USED, nr_free);
+	fix_fullness_group(class, zspage);
+
+	return true;
+}
+
+/* Give the objects left in @slot back to its zspage */
+static void cache_slot_drain(struct zs_pool *pool, struct size_class *class,
+			     struct zs_cache_slot *slot)
+{
+	struct zspage *zspage = slot->zspage;
+	struct link_free *link;
+	struct page *page;
+	void *vaddr;
+
+	if (!zspage)
+		return;
+
+	spin_lock(&class->lock);
+	while (slot->nr_free--) {
+		unsigned int obj_idx = slot->freeobj;
+
+		link = obj_link(class, zspage, obj_idx, &page, &vaddr);
+		slot->freeobj = link->next >> OBJ_TAG_BITS;
+		link->next = get_freeobj(zspage) << OBJ_TAG_BITS;
+		kunmap_atomic(vaddr);
+
+		set_freeobj(zspage, obj_idx);
+		mod_zspage_inuse(zspage, -1);
+		zs_stat_dec(class, OBJ_USED, 1);
+	}
+
+	if (fix_fullness_group(class, zspage) == ZS_EMPTY &&
+	    !is_zspage_isolated(zspage))
+		free_zspage(pool, class, zspage);
+	spin_unlock(&class->lock);
+
+	slot->zspage = NULL;
+	slot->nr_free = 0;
+}
+
+static void zs_cache_drain_cpu(struct zs_pool *pool, unsigned int cpu)
+{
+	struct zs_pcp_cache *cache = per_cpu_ptr(pool->cache, cpu);
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		if (!class || class->index != i)
+			continue;
+		cache_slot_drain(pool, class, &cache->slots[i]);
+	}
+}
+
+/*
+ * Allocate from the free objects this CPU holds for @class, refilling them
+ * from a partially filled zspage if needed. Returns false if there was no
+ * such zspage, or if @class doesn't use the per-CPU cache.
+ */
+static bool zs_cache_malloc(struct zs_pool *pool, struct size_class *class,
+			    unsigned long handle)
+{
+	struct zs_cache_slot *slot;
+	bool ret = true;
+
+	/* A zspage with a single object has nothing to share */
+	if (class->objs_per_zspage == 1)
+		return false;
+
+	local_lock(&pool->cache->lock);
+	slot = &this_cpu_ptr(pool->cache)->slots[class->index];
+	if (!slot->nr_free) {
+		spin_lock(&class->lock);
+		ret = cache_slot_fill(class, slot);
+		spin_unlock(&class->lock);
+	}
+	if (ret)
+		cache_obj_malloc(class, slot, handle);
+	local_unlock(&pool->cache->lock);
+
+	return ret;
+}
 
 /**
  * zs_malloc - Allocate block of given size from pool.
@@ -1424,6 +1615,9 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	size += ZS_HANDLE_SIZE;
 	class = pool->size_class[get_size_class_index(size)];
 
+	if (zs_cache_malloc(pool, class, handle))
+		return handle;
+
 	spin_lock(&class->lock);
 	zspage = find_get_zspage(class);
 	if (likely(zspage)) {
@@ -2239,14 +2433,21 @@ static unsigned long zs_can_compact(struct size_class *class)
 	return obj_wasted * class->pages_per_zspage;
 }
 
+/*
+ * Compact @class until nothing is left to move or, with a non-zero
+ * @deadline, until the deadline passes. The class lock is dropped after
+ * each source zspage, and *@done tells whether the class was finished.
+ */
 static unsigned long __zs_compact(struct zs_pool *pool,
-				  struct size_class *class)
+				  struct size_class *class, u64 deadline,
+				  bool *done)
 {
 	struct zs_compact_control cc;
 	struct zspage *src_zspage;
 	struct zspage *dst_zspage = NULL;
 	unsigned long pages_freed = 0;
 
+	*done = true;
 	spin_lock(&class->lock);
 	while ((src_zspage = isolate_zspage(class, true))) {
 
@@ -2278,6 +2479,10 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 			pages_freed += class->pages_per_zspage;
 		}
 		spin_unlock(&class->lock);
+		if (deadline && ktime_get_ns() > deadline) {
+			*done = false;
+			return pages_freed;
+		}
 		cond_resched();
 		spin_lock(&class->lock);
 	}
@@ -2295,6 +2500,7 @@ unsigned long zs_compact(struct zs_pool *pool)
 	int i;
 	struct size_class *class;
 	unsigned long pages_freed = 0;
+	bool done;
 
 	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
 		class = pool->size_class[i];
@@ -2302,7 +2508,7 @@ unsigned long zs_compact(struct zs_pool *pool)
 			continue;
 		if (class->index != i)
 			continue;
-		pages_freed += __zs_compact(pool, class);
+		pages_freed += __zs_compact(pool, class, 0, &done);
 	}
 	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
 
@@ -2310,6 +2516,49 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+/* Time the shrinker may spend compacting a pool per invocation, 0 for none */
+static unsigned int compact_budget_us = 1000;
+module_param(compact_budget_us, uint, 0644);
+MODULE_PARM_DESC(compact_budget_us,
+		 "Time budget of one background compaction pass (us)");
+
+/*
+ * Compact classes within the time budget, starting with the class the
+ * previous pass stopped at, so that large pools are compacted a bit at a
+ * time instead of all at once.
+ */
+static unsigned long zs_compact_incremental(struct zs_pool *pool)
+{
+	unsigned int budget = READ_ONCE(compact_budget_us);
+	int start = READ_ONCE(pool->compact_index);
+	unsigned long pages_freed = 0;
+	u64 deadline = 0;
+	int n, i = start;
+
+	if (budget)
+		deadline = ktime_get_ns() + (u64)budget * NSEC_PER_USEC;
+
+	for (n = 0; n < ZS_SIZE_CLASSES; n++, i = i ? i - 1 : ZS_SIZE_CLASSES - 1) {
+		struct size_class *class = pool->size_class[i];
+		bool done;
+
+		if (!class || class->index != i)
+			continue;
+
+		pages_freed += __zs_compact(pool, class, deadline, &done);
+		if (!done)
+			break;
+		if (deadline && ktime_get_ns() > deadline) {
+			i = i ? i - 1 : ZS_SIZE_CLASSES - 1;
+			break;
+		}
+	}
+	WRITE_ONCE(pool->compact_index, i);
+	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
+
+	return pages_freed;
+}
+
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
 {
 	memcpy(stats, &pool->stats, sizeof(struct zs_pool_stats));
@@ -2328,7 +2577,7 @@ static unsigned long zs_shrinker_scan(struct shrinker *shrinker,
 	 * Can run concurrently with a manually triggered
 	 * (by user) compaction.
 	 */
-	pages_freed = zs_compact(pool);
+	pages_freed = zs_compact_incremental(pool);
 
 	return pages_freed ? pages_freed : SHRINK_STOP;
 }
@@ -2391,6 +2640,8 @@ struct zs_pool *zs_create_pool(const char *name)
 		return NULL;
 
 	init_deferred_free(pool);
+	INIT_LIST_HEAD(&pool->list);
+	pool->compact_index = ZS_SIZE_CLASSES - 1;
 
 	pool->name = kstrdup(name, GFP_KERNEL);
 	if (!pool->name)
@@ -2403,6 +2654,12 @@ struct zs_pool *zs_create_pool(const char *name)
 	if (create_cache(pool))
 		goto err;
 
+	pool->cache = alloc_percpu(struct zs_pcp_cache);
+	if (!pool->cache)
+		goto err;
+	for_each_possible_cpu(i)
+		local_lock_init(&per_cpu_ptr(pool->cache, i)->lock);
+
 	/*
 	 * Iterate reversely, because, size of size_class that we want to use
 	 * for merging should be larger or equal to current size.
@@ -2480,6 +2737,10 @@ struct zs_pool *zs_create_pool(const char *name)
 	if (zs_register_migration(pool))
 		goto err;
 
+	mutex_lock(&zs_pools_lock);
+	list_add(&pool->list, &zs_pools);
+	mutex_unlock(&zs_pools_lock);
+
 	/*
 	 * Not critical since shrinker is only used to trigger internal
 	 * defragmentation of the pool which is pretty optional thing.  If
@@ -2501,6 +2762,16 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+
+	if (pool->cache) {
+		mutex_lock(&zs_pools_lock);
+		list_del(&pool->list);
+		mutex_unlock(&zs_pools_lock);
+
+		for_each_possible_cpu(i)
+			zs_cache_drain_cpu(pool, i);
+	}
+
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
@@ -2523,6 +2794,7 @@ void zs_destroy_pool(struct zs_pool *pool)
 		kfree(class);
 	}
 
+	free_percpu(pool->cache);
 	destroy_cache(pool);
 	kfree(pool->name);
 	kfree(pool);
@@ -35,6 +35,7 @@
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
 #include <linux/workqueue.h>
+#include <linux/memcontrol.h>
 
 /*********************************
 * statistics
@@ -129,11 +130,19 @@ module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 * data structures
 **********************************/
 
+/*
+ * Number of pages compressed per submission when the compressor is
+ * asynchronous, e.g. offloaded to an accelerator. Synchronous compressors
+ * only get one request per CPU.
+ */
+#define ZSWAP_MAX_BATCH_SIZE	8
+
 struct crypto_acomp_ctx {
 	struct crypto_acomp *acomp;
-	struct acomp_req *req;
-	struct crypto_wait wait;
-	u8 *dstmem;
+	struct acomp_req *reqs[ZSWAP_MAX_BATCH_SIZE];
+	struct crypto_wait waits[ZSWAP_MAX_BATCH_SIZE];
+	u8 *dstmem[ZSWAP_MAX_BATCH_SIZE];
+	unsigned int nr_reqs;
 	struct mutex *mutex;
 };
 
@@ -146,6 +155,8 @@ struct zswap_pool {
 	struct work_struct shrink_work;
 	struct hlist_node node;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
+	struct list_head lru;
+	spinlock_t lru_lock;
 };
 
 /*
@@ -155,7 +166,7 @@ struct zswap_pool {
  * page within zswap.
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
- * offset - the swap offset for the entry.  Index into the red-black tree.
+ * swpentry - associated swap entry, the offset indexes into the red-black tree
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -167,10 +178,12 @@ struct zswap_pool {
  * pool - the zswap_pool the entry's data is in
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
+ * objcg - the obj_cgroup that the compressed memory is charged to
+ * lru - handle to the pool's lru used to evict pages.
  */
 struct zswap_entry {
 	struct rb_node rbnode;
-	pgoff_t offset;
+	swp_entry_t swpentry;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -178,10 +191,8 @@ struct zswap_entry {
 		unsigned long handle;
 		unsigned long value;
 	};
-};
-
-struct zswap_header {
-	swp_entry_t swpentry;
+	struct obj_cgroup *objcg;
+	struct list_head lru;
 };
 
 /*
@@ -220,14 +231,11 @@ static bool zswap_has_pool;
 	pr_debug("%s pool %s/%s\n", msg, (p)->tfm_name,		\
 		 zpool_get_type((p)->zpool))
 
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
+static int zswap_writeback_entry(struct zswap_entry *entry,
+				 struct zswap_tree *tree);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
-static const struct zpool_ops zswap_zpool_ops = {
-	.evict = zswap_writeback_entry
-};
-
 static bool zswap_is_full(void)
 {
 	return totalram_pages() * zswap_max_pool_percent / 100 <
@@ -298,9 +306,9 @@ static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
 
 	while (node) {
 		entry = rb_entry(node, struct zswap_entry, rbnode);
-		if (entry->offset > offset)
+		if (swp_offset(entry->swpentry) > offset)
 			node = node->rb_left;
-		else if (entry->offset < offset)
+		else if (swp_offset(entry->swpentry) < offset)
 			node = node->rb_right;
 		else
 			return entry;
@@ -317,13 +325,15 @@ static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
 {
 	struct rb_node **link = &root->rb_node, *parent = NULL;
 	struct zswap_entry *myentry;
+	pgoff_t myentry_offset, entry_offset = swp_offset(entry->swpentry);
 
 	while (*link) {
 		parent = *link;
 		myentry = rb_entry(parent, struct zswap_entry, rbnode);
-		if (myentry->offset > entry->offset)
+		myentry_offset = swp_offset(myentry->swpentry);
+		if (myentry_offset > entry_offset)
 			link = &(*link)->rb_left;
-		else if (myentry->offset < entry->offset)
+		else if (myentry_offset < entry_offset)
 			link = &(*link)->rb_right;
 		else {
 			*dupentry = myentry;
@@ -335,12 +345,14 @@ static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
 	return 0;
 }
 
-static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
+static bool zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
 {
 	if (!RB_EMPTY_NODE(&entry->rbnode)) {
 		rb_erase(&entry->rbnode, root);
 		RB_CLEAR_NODE(&entry->rbnode);
+		return true;
 	}
+	return false;
 }
 
 /*
@@ -349,9 +361,16 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
+	if (entry->objcg) {
+		obj_cgroup_uncharge_zswap(entry->objcg, entry->length);
+		obj_cgroup_put(entry->objcg);
+	}
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
+		spin_lock(&entry->pool->lru_lock);
+		list_del(&entry->lru);
+		spin_unlock(&entry->pool->lru_lock);
 		zpool_free(entry->pool->zpool, entry->handle);
 		zswap_pool_put(entry->pool);
 	}
@@ -381,6 +400,18 @@ static void zswap_entry_put(struct zswap_tree *tree,
 	}
 }
 
+/*
+ * caller must hold the tree lock
+ * remove from the tree and drop the initial reference, unless somebody
+ * else already did so
+ */
+static void zswap_invalidate_entry(struct zswap_tree *tree,
+				   struct zswap_entry *entry)
+{
+	if (zswap_rb_erase(&tree->rbroot, entry))
+		zswap_entry_put(tree, entry);
+}
+
 /* caller must hold the tree lock */
 static struct zswap_entry *zswap_entry_find_get(struct rb_root *root,
 				pgoff_t offset)
@@ -442,12 +473,31 @@ static int zswap_dstmem_dead(unsigned int cpu)
 	return 0;
 }
 
+static void zswap_acomp_ctx_free(struct crypto_acomp_ctx *acomp_ctx)
+{
+	int i;
+
+	for (i = 0; i < ZSWAP_MAX_BATCH_SIZE; i++) {
+		if (!IS_ERR_OR_NULL(acomp_ctx->reqs[i]))
+			acomp_request_free(acomp_ctx->reqs[i]);
+		acomp_ctx->reqs[i] = NULL;
+		/* the first buffer is the shared per-cpu zswap_dstmem */
+		if (i)
+			kfree(acomp_ctx->dstmem[i]);
+		acomp_ctx->dstmem[i] = NULL;
+	}
+	if (!IS_ERR_OR_NULL(acomp_ctx->acomp))
+		crypto_free_acomp(acomp_ctx->acomp);
+	acomp_ctx->acomp = NULL;
+}
+
 static int zswap_cpu_comp_prepare(unsigned int cpu, struct hlist_node *node)
 {
 	struct zswap_pool *pool = hlist_entry(node, struct zswap_pool, node);
 	struct crypto_acomp_ctx *acomp_ctx = per_cpu_ptr(pool->acomp_ctx, cpu);
 	struct crypto_acomp *acomp;
 	struct acomp_req *req;
+	int i;
 
 	acomp = crypto_alloc_acomp_node(pool->tfm_name, 0, 0, cpu_to_node(cpu));
 	if (IS_ERR(acomp)) {
@@ -457,28 +507,46 @@ static int zswap_cpu_comp_prepare(unsigned int cpu, struct hlist_node *node)
 	}
 	acomp_ctx->acomp = acomp;
 
-	req = acomp_request_alloc(acomp_ctx->acomp);
-	if (!req) {
-		pr_err("could not alloc crypto acomp_request %s\n",
-		       pool->tfm_name);
-		crypto_free_acomp(acomp_ctx->acomp);
-		return -ENOMEM;
-	}
-	acomp_ctx->req = req;
-
-	crypto_init_wait(&acomp_ctx->wait);
-	/*
-	 * if the backend of acomp is async zip, crypto_req_done() will wakeup
-	 * crypto_wait_req(); if the backend of acomp is scomp, the callback
-	 * won't be called, crypto_wait_req() will return without blocking.
-	 */
-	acomp_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
-				   crypto_req_done, &acomp_ctx->wait);
+	acomp_ctx->nr_reqs = 1;
+	if (crypto_acomp_tfm(acomp)->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC)
+		acomp_ctx->nr_reqs = ZSWAP_MAX_BATCH_SIZE;
 
 	acomp_ctx->mutex = per_cpu(zswap_mutex, cpu);
-	acomp_ctx->dstmem = per_cpu(zswap_dstmem, cpu);
+	acomp_ctx->dstmem[0] = per_cpu(zswap_dstmem, cpu);
+
+	for (i = 0; i < acomp_ctx->nr_reqs; i++) {
+		req = acomp_request_alloc(acomp_ctx->acomp);
+		if (!req) {
+			pr_err("could not alloc crypto acomp_request %s\n",
+			       pool->tfm_name);
+			goto fail;
+		}
+		acomp_ctx->reqs[i] = req;
+
+		crypto_init_wait(&acomp_ctx->waits[i]);
+		/*
+		 * if the backend of acomp is async zip, crypto_req_done() will
+		 * wakeup crypto_wait_req(); if the backend of acomp is scomp,
+		 * the callback won't be called, crypto_wait_req() will return
+		 * without blocking.
+		 */
+		acomp_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					   crypto_req_done,
+					   &acomp_ctx->waits[i]);
+
+		if (!i)
+			continue;
+		acomp_ctx->dstmem[i] = kmalloc_node(PAGE_SIZE * 2, GFP_KERNEL,
+						    cpu_to_node(cpu));
+		if (!acomp_ctx->dstmem[i])
+			goto fail;
+	}
 
 	return 0;
+
+fail:
+	zswap_acomp_ctx_free(acomp_ctx);
+	return -ENOMEM;
 }
 
 static int zswap_cpu_comp_dead(unsigned int cpu, struct hlist_node *node)
@@ -486,12 +554,8 @@ static int zswap_cpu_comp_dead(unsigned int cpu, struct hlist_node *node)
 	struct zswap_pool *pool = hlist_entry(node, struct zswap_pool, node);
 	struct crypto_acomp_ctx *acomp_ctx = per_cpu_ptr(pool->acomp_ctx, cpu);
 
-	if (!IS_ERR_OR_NULL(acomp_ctx)) {
-		if (!IS_ERR_OR_NULL(acomp_ctx->req))
-			acomp_request_free(acomp_ctx->req);
-		if (!IS_ERR_OR_NULL(acomp_ctx->acomp))
-			crypto_free_acomp(acomp_ctx->acomp);
-	}
+	if (!IS_ERR_OR_NULL(acomp_ctx))
+		zswap_acomp_ctx_free(acomp_ctx);
 
 	return 0;
 }
@@ -572,13 +636,90 @@ static struct zswap_pool *zswap_pool_find_get(char *type, char *compressor)
 	return NULL;
 }
 
+/*
+ * Write back the least recently stored or loaded entry of the pool.
+ * Returns 0 on success, -EAGAIN if the entry couldn't be written back
+ * and another one may be tried, or -ENOENT if the LRU is empty.
+ */
+static int zswap_reclaim_entry(struct zswap_pool *pool)
+{
+	struct zswap_entry *entry;
+	struct zswap_tree *tree;
+	pgoff_t swpoffset;
+	int ret;
+
+	/* Get an entry off the LRU */
+	spin_lock(&pool->lru_lock);
+	if (list_empty(&pool->lru)) {
+		spin_unlock(&pool->lru_lock);
+		return -ENOENT;
+	}
+	entry = list_last_entry(&pool->lru, struct zswap_entry, lru);
+	list_del_init(&entry->lru);
+	/*
+	 * Once the lru lock is dropped, the entry might get freed. The
+	 * swpoffset is copied to the stack, and entry isn't deref'd again
+	 * until the entry is verified to still be alive in the tree.
+	 */
+	swpoffset = swp_offset(entry->swpentry);
+	tree = zswap_trees[swp_type(entry->swpentry)];
+	spin_unlock(&pool->lru_lock);
+
+	/* Check for invalidate() race */
+	spin_lock(&tree->lock);
+	if (entry != zswap_rb_search(&tree->rbroot, swpoffset)) {
+		ret = -EAGAIN;
+		goto unlock;
+	}
+	/* Hold a reference to prevent a free during writeback */
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	ret = zswap_writeback_entry(entry, tree);
+
+	spin_lock(&tree->lock);
+	if (ret) {
+		/* Writeback failed, put entry back on LRU */
+		spin_lock(&pool->lru_lock);
+		list_move(&entry->lru, &pool->lru);
+		spin_unlock(&pool->lru_lock);
+		goto put_unlock;
+	}
+
+	/*
+	 * Writeback started successfully, the page now belongs to the
+	 * swapcache. Drop the entry from zswap - unless invalidate already
+	 * took it out while we had the tree->lock released for IO.
+	 */
+	zswap_invalidate_entry(tree, entry);
+
+put_unlock:
+	/* Drop local reference */
+	zswap_entry_put(tree, entry);
+unlock:
+	spin_unlock(&tree->lock);
+	return ret ? -EAGAIN : 0;
+}
+
+#define ZSWAP_MAX_RECLAIM_RETRIES 16
+
 static void shrink_worker(struct work_struct *w)
 {
 	struct zswap_pool *pool = container_of(w, typeof(*pool),
 						shrink_work);
+	int ret, failures = 0;
 
-	if (zpool_shrink(pool->zpool, 1, NULL))
-		zswap_reject_reclaim_fail++;
+	do {
+		ret = zswap_reclaim_entry(pool);
+		if (ret) {
+			zswap_reject_reclaim_fail++;
+			if (ret != -EAGAIN)
+				break;
+			if (++failures == ZSWAP_MAX_RECLAIM_RETRIES)
+				break;
+		}
+		cond_resched();
+	} while (!zswap_can_accept());
 	zswap_pool_put(pool);
 }
 
@@ -607,7 +748,8 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	/* unique name for each pool specifically required by zsmalloc */
 	snprintf(name, 38, "zswap%x", atomic_inc_return(&zswap_pools_count));
 
-	pool->zpool = zpool_create_pool(type, name, gfp, &zswap_zpool_ops);
+	/* zswap keeps its own LRU, so the zpool doesn't need to evict */
+	pool->zpool = zpool_create_pool(type, name, gfp, NULL);
 	if (!pool->zpool) {
 		pr_err("%s zpool not available\n", type);
 		goto error;
@@ -634,6 +776,8 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
 	INIT_WORK(&pool->shrink_work, shrink_worker);
+	INIT_LIST_HEAD(&pool->lru);
+	spin_lock_init(&pool->lru_lock);
 
 	zswap_pool_debug("created", pool);
 
@@ -923,14 +1067,15 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference to the entry; dropping the entry from
+ * the tree once writeback has started is left to the caller as well.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_entry(struct zswap_entry *entry,
+				 struct zswap_tree *tree)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	swp_entry_t swpentry = entry->swpentry;
+	struct zpool *pool = entry->pool->zpool;
 	struct page *page;
 	struct scatterlist input, output;
 	struct crypto_acomp_ctx *acomp_ctx;
@@ -943,37 +1088,11 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	};
 
 	if (!zpool_can_sleep_mapped(pool)) {
-		tmp = kmalloc(PAGE_SIZE, GFP_ATOMIC);
+		tmp = kmalloc(PAGE_SIZE, GFP_KERNEL);
 		if (!tmp)
 			return -ENOMEM;
 	}
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		zpool_unmap_handle(pool, handle);
-		kfree(tmp);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
-	src = (u8 *)zhdr + sizeof(struct zswap_header);
-	if (!zpool_can_sleep_mapped(pool)) {
-		memcpy(tmp, src, entry->length);
-		src = tmp;
-		zpool_unmap_handle(pool, handle);
-	}
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
@@ -987,19 +1106,49 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		goto fail;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
+		/*
+		 * Having a local reference to the zswap entry doesn't exclude
+		 * swapping from invalidating and recycling the swap slot. Once
+		 * the swapcache is secured against concurrent swapping to and
+		 * from the slot, recheck that the entry is still current before
+		 * writing.
+		 */
+		spin_lock(&tree->lock);
+		if (zswap_rb_search(&tree->rbroot, swp_offset(swpentry)) != entry) {
+			spin_unlock(&tree->lock);
+			delete_from_swap_cache(page);
+			unlock_page(page);
+			put_page(page);
+			ret = -ENOMEM;
+			goto fail;
+		}
+		spin_unlock(&tree->lock);
+
 		/* decompress */
 		acomp_ctx = raw_cpu_ptr(entry->pool->acomp_ctx);
 		dlen = PAGE_SIZE;
 
+		src = zpool_map_handle(pool, entry->handle, ZPOOL_MM_RO);
+		if (!zpool_can_sleep_mapped(pool)) {
+			memcpy(tmp, src, entry->length);
+			src = tmp;
+			zpool_unmap_handle(pool, entry->handle);
+		}
+
 		mutex_lock(acomp_ctx->mutex);
 		sg_init_one(&input, src, entry->length);
 		sg_init_table(&output, 1);
 		sg_set_page(&output, page, PAGE_SIZE, 0);
-		acomp_request_set_params(acomp_ctx->req, &input, &output, entry->length, dlen);
-		ret = crypto_wait_req(crypto_acomp_decompress(acomp_ctx->req), &acomp_ctx->wait);
-		dlen = acomp_ctx->req->dlen;
+		acomp_request_set_params(acomp_ctx->reqs[0], &input, &output, entry->length, dlen);
+		ret = crypto_wait_req(crypto_acomp_decompress(acomp_ctx->reqs[0]), &acomp_ctx->waits[0]);
+		dlen = acomp_ctx->reqs[0]->dlen;
 		mutex_unlock(acomp_ctx->mutex);
 
+		if (zpool_can_sleep_mapped(pool))
+			zpool_unmap_handle(pool, entry->handle);
+		else
+			kfree(tmp);
+
 		BUG_ON(ret);
 		BUG_ON(dlen != PAGE_SIZE);
 
@@ -1015,41 +1164,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	put_page(page);
 	zswap_written_back_pages++;
 
-	spin_lock(&tree->lock);
-	/* drop local reference */
-	zswap_entry_put(tree, entry);
-
-	/*
-	* There are two possible situations for entry here:
-	* (1) refcount is 1(normal case),  entry is valid and on the tree
-	* (2) refcount is 0, entry is freed and not on the tree
-	*     because invalidate happened during writeback
-	*  search the tree and free the entry if find entry
-	*/
-	if (entry == zswap_rb_search(&tree->rbroot, offset))
-		zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
-
-	goto end;
+	return ret;
 
-	/*
-	* if we get here due to ZSWAP_SWAPCACHE_EXIST
-	* a load may be happening concurrently.
-	* it is safe and okay to not free the entry.
-	* if we free the entry in the following put
-	* it is also okay to return !0
-	*/
 fail:
-	spin_lock(&tree->lock);
-	zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
-
-end:
-	if (zpool_can_sleep_mapped(pool))
-		zpool_unmap_handle(pool, handle);
-	else
-		kfree(tmp);
-
+	kfree(tmp);
 	return ret;
 }
 
@@ -1075,169 +1193,251 @@ static void zswap_fill_page(void *ptr, unsigned long value)
 	memset_l(page, value, PAGE_SIZE / sizeof(unsigned long));
 }
 
-/*********************************
-* frontswap hooks
-**********************************/
-/* attempts to compress and store an single page */
-static int zswap_frontswap_store(unsigned type, pgoff_t offset,
-				struct page *page)
+/*
+ * Compress @nr pages into the per-cpu destination buffers of @acomp_ctx,
+ * which must be locked by the caller.
+ *
+ * All the requests are submitted before waiting for the first one, so an
+ * asynchronous compressor has the whole batch in flight at once. With a
+ * synchronous one each request completes on submission and this degrades
+ * to compressing one page after another.
+ */
+static int zswap_compress(struct crypto_acomp_ctx *acomp_ctx,
+			  struct page **pages, unsigned int *dlens, int nr)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct scatterlist input[ZSWAP_MAX_BATCH_SIZE];
+	struct scatterlist output[ZSWAP_MAX_BATCH_SIZE];
+	int errs[ZSWAP_MAX_BATCH_SIZE];
+	int i, ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct acomp_req *req = acomp_ctx->reqs[i];
+
+		sg_init_table(&input[i], 1);
+		sg_set_page(&input[i], pages[i], PAGE_SIZE, 0);
+		/* dstmem is of size (PAGE_SIZE * 2). Reflect same in sg_list */
+		sg_init_one(&output[i], acomp_ctx->dstmem[i], PAGE_SIZE * 2);
+		acomp_request_set_params(req, &input[i], &output[i], PAGE_SIZE,
+					 PAGE_SIZE);
+		errs[i] = crypto_acomp_compress(req);
+	}
+
+	for (i = 0; i < nr; i++) {
+		errs[i] = crypto_wait_req(errs[i], &acomp_ctx->waits[i]);
+		if (errs[i])
+			ret = errs[i];
+		dlens[i] = acomp_ctx->reqs[i]->dlen;
+	}
+
+	return ret;
+}
+
+/*
+ * Compress and store @nr <= ZSWAP_MAX_BATCH_SIZE contiguous pages starting
+ * at @page under consecutive swap entries starting at @swpentry. Either all
+ * of the pages end up in the tree, or none of them.
+ */
+static int zswap_store_pages(struct zswap_tree *tree, struct zswap_pool *pool,
+			     struct obj_cgroup *objcg, swp_entry_t swpentry,
+			     struct page *page, int nr)
+{
+	struct zswap_entry *entries[ZSWAP_MAX_BATCH_SIZE];
+	struct zswap_entry *comp[ZSWAP_MAX_BATCH_SIZE];
+	struct page *pages[ZSWAP_MAX_BATCH_SIZE];
+	unsigned int dlens[ZSWAP_MAX_BATCH_SIZE];
 	struct zswap_entry *entry, *dupentry;
-	struct scatterlist input, output;
 	struct crypto_acomp_ctx *acomp_ctx;
-	int ret;
-	unsigned int hlen, dlen = PAGE_SIZE;
+	int i, j, n, nr_alloc, nr_comp = 0, nr_stored = 0;
 	unsigned long handle, value;
+	int ret = 0;
 	char *buf;
-	u8 *src, *dst;
-	struct zswap_header zhdr = { .swpentry = swp_entry(type, offset) };
+	u8 *src;
 	gfp_t gfp;
 
-	/* THP isn't supported */
-	if (PageTransHuge(page)) {
-		ret = -EINVAL;
-		goto reject;
-	}
+	for (nr_alloc = 0; nr_alloc < nr; nr_alloc++) {
+		entry = zswap_entry_cache_alloc(GFP_KERNEL);
+		if (!entry) {
+			zswap_reject_kmemcache_fail++;
+			ret = -ENOMEM;
+			goto freeentries;
+		}
+		entry->swpentry = swp_entry(swp_type(swpentry),
+					    swp_offset(swpentry) + nr_alloc);
+		entries[nr_alloc] = entry;
+
+		if (zswap_same_filled_pages_enabled) {
+			src = kmap_atomic(page + nr_alloc);
+			if (zswap_is_page_same_filled(src, &value)) {
+				kunmap_atomic(src);
+				entry->length = 0;
+				entry->value = value;
+				continue;
+			}
+			kunmap_atomic(src);
+		}
 
-	if (!zswap_enabled || !tree) {
-		ret = -ENODEV;
-		goto reject;
+		entry->pool = pool;
+		comp[nr_comp] = entry;
+		pages[nr_comp++] = page + nr_alloc;
 	}
 
-	/* reclaim space if needed */
-	if (zswap_is_full()) {
-		struct zswap_pool *pool;
+	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
+	if (zpool_malloc_support_movable(pool->zpool))
+		gfp |= __GFP_HIGHMEM | __GFP_MOVABLE;
 
-		zswap_pool_limit_hit++;
-		zswap_pool_reached_full = true;
-		pool = zswap_pool_last_get();
-		if (pool)
-			queue_work(shrink_wq, &pool->shrink_work);
-		ret = -ENOMEM;
-		goto reject;
-	}
+	acomp_ctx = raw_cpu_ptr(pool->acomp_ctx);
+	mutex_lock(acomp_ctx->mutex);
+	for (i = 0; i < nr_comp; i += n) {
+		n = min_t(int, nr_comp - i, acomp_ctx->nr_reqs);
 
-	if (zswap_pool_reached_full) {
-	       if (!zswap_can_accept()) {
-			ret = -ENOMEM;
-			goto reject;
-		} else
-			zswap_pool_reached_full = false;
-	}
+		if (zswap_compress(acomp_ctx, pages + i, dlens, n)) {
+			ret = -EINVAL;
+			goto unlock;
+		}
 
-	/* allocate entry */
-	entry = zswap_entry_cache_alloc(GFP_KERNEL);
-	if (!entry) {
-		zswap_reject_kmemcache_fail++;
-		ret = -ENOMEM;
-		goto reject;
+		for (j = 0; j < n; j++) {
+			ret = zpool_malloc(pool->zpool, dlens[j], gfp, &handle);
+			if (ret == -ENOSPC) {
+				zswap_reject_compress_poor++;
+				goto unlock;
+			}
+			if (ret) {
+				zswap_reject_alloc_fail++;
+				goto unlock;
+			}
+			buf = zpool_map_handle(pool->zpool, handle, ZPOOL_MM_WO);
+			memcpy(buf, acomp_ctx->dstmem[j], dlens[j]);
+			zpool_unmap_handle(pool->zpool, handle);
+
+			comp[nr_stored]->handle = handle;
+			comp[nr_stored++]->length = dlens[j];
+		}
 	}
+unlock:
+	mutex_unlock(acomp_ctx->mutex);
+	if (ret)
+		goto freeentries;
 
-	if (zswap_same_filled_pages_enabled) {
-		src = kmap_atomic(page);
-		if (zswap_is_page_same_filled(src, &value)) {
-			kunmap_atomic(src);
-			entry->offset = offset;
-			entry->length = 0;
-			entry->value = value;
+	for (i = 0; i < nr; i++) {
+		entry = entries[i];
+		/* the caller's reference keeps the pool alive */
+		if (entry->length)
+			kref_get(&pool->kref);
+		else
 			atomic_inc(&zswap_same_filled_pages);
-			goto insert_entry;
+		entry->objcg = objcg;
+		if (objcg) {
+			obj_cgroup_get(objcg);
+			obj_cgroup_charge_zswap(objcg, entry->length);
 		}
-		kunmap_atomic(src);
 	}
 
-	/* if entry is successfully added, it keeps the reference */
-	entry->pool = zswap_pool_current_get();
-	if (!entry->pool) {
-		ret = -EINVAL;
-		goto freepage;
+	/* map */
+	spin_lock(&tree->lock);
+	for (i = 0; i < nr; i++) {
+		entry = entries[i];
+		while (zswap_rb_insert(&tree->rbroot, entry, &dupentry) == -EEXIST) {
+			zswap_duplicate_entry++;
+			zswap_invalidate_entry(tree, dupentry);
+		}
+		if (entry->length) {
+			spin_lock(&pool->lru_lock);
+			list_add(&entry->lru, &pool->lru);
+			spin_unlock(&pool->lru_lock);
+		}
 	}
+	spin_unlock(&tree->lock);
 
-	/* compress */
-	acomp_ctx = raw_cpu_ptr(entry->pool->acomp_ctx);
+	/* update stats */
+	atomic_add(nr, &zswap_stored_pages);
+	zswap_update_total_size();
 
-	mutex_lock(acomp_ctx->mutex);
+	return 0;
 
-	dst = acomp_ctx->dstmem;
-	sg_init_table(&input, 1);
-	sg_set_page(&input, page, PAGE_SIZE, 0);
+freeentries:
+	for (i = 0; i < nr_stored; i++)
+		zpool_free(pool->zpool, comp[i]->handle);
+	for (i = 0; i < nr_alloc; i++)
+		zswap_entry_cache_free(entries[i]);
+	return ret;
+}
 
-	/* zswap_dstmem is of size (PAGE_SIZE * 2). Reflect same in sg_list */
-	sg_init_one(&output, dst, PAGE_SIZE * 2);
-	acomp_request_set_params(acomp_ctx->req, &input, &output, PAGE_SIZE, dlen);
-	/*
-	 * it maybe looks a little bit silly that we send an asynchronous request,
-	 * then wait for its completion synchronously. This makes the process look
-	 * synchronous in fact.
-	 * Theoretically, acomp supports users send multiple acomp requests in one
-	 * acomp instance, then get those requests done simultaneously. but in this
-	 * case, frontswap actually does store and load page by page, there is no
-	 * existing method to send the second page before the first page is done
-	 * in one thread doing frontswap.
-	 * but in different threads running on different cpu, we have different
-	 * acomp instance, so multiple threads can do (de)compression in parallel.
-	 */
-	ret = crypto_wait_req(crypto_acomp_compress(acomp_ctx->req), &acomp_ctx->wait);
-	dlen = acomp_ctx->req->dlen;
+/*********************************
+* frontswap hooks
+**********************************/
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset);
 
-	if (ret) {
-		ret = -EINVAL;
-		goto put_dstmem;
+/*
+ * attempts to compress and store a single page, or all the subpages of a
+ * THP, which sit in a swap cluster of their own
+ */
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct obj_cgroup *objcg = NULL;
+	struct zswap_pool *pool;
+	int i, n, nr = thp_nr_pages(page);
+	int ret;
+
+	if (!zswap_enabled || !tree) {
+		ret = -ENODEV;
+		goto reject;
 	}
 
-	/* store */
-	hlen = zpool_evictable(entry->pool->zpool) ? sizeof(zhdr) : 0;
-	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
-	if (zpool_malloc_support_movable(entry->pool->zpool))
-		gfp |= __GFP_HIGHMEM | __GFP_MOVABLE;
-	ret = zpool_malloc(entry->pool->zpool, hlen + dlen, gfp, &handle);
-	if (ret == -ENOSPC) {
-		zswap_reject_compress_poor++;
-		goto put_dstmem;
+	objcg = get_obj_cgroup_from_page(page);
+	if (objcg && !obj_cgroup_may_zswap(objcg)) {
+		ret = -ENOMEM;
+		goto reject;
 	}
-	if (ret) {
-		zswap_reject_alloc_fail++;
-		goto put_dstmem;
+
+	/* reclaim space if needed */
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		zswap_pool_reached_full = true;
+		goto shrink;
 	}
-	buf = zpool_map_handle(entry->pool->zpool, handle, ZPOOL_MM_WO);
-	memcpy(buf, &zhdr, hlen);
-	memcpy(buf + hlen, dst, dlen);
-	zpool_unmap_handle(entry->pool->zpool, handle);
-	mutex_unlock(acomp_ctx->mutex);
 
-	/* populate entry */
-	entry->offset = offset;
-	entry->handle = handle;
-	entry->length = dlen;
+	if (zswap_pool_reached_full) {
+	       if (!zswap_can_accept())
+			goto shrink;
+		else
+			zswap_pool_reached_full = false;
+	}
 
-insert_entry:
-	/* map */
-	spin_lock(&tree->lock);
-	do {
-		ret = zswap_rb_insert(&tree->rbroot, entry, &dupentry);
-		if (ret == -EEXIST) {
-			zswap_duplicate_entry++;
-			/* remove from rbtree */
-			zswap_rb_erase(&tree->rbroot, dupentry);
-			zswap_entry_put(tree, dupentry);
-		}
-	} while (ret == -EEXIST);
-	spin_unlock(&tree->lock);
+	/* each stored entry takes its own reference */
+	pool = zswap_pool_current_get();
+	if (!pool) {
+		ret = -EINVAL;
+		goto reject;
+	}
 
-	/* update stats */
-	atomic_inc(&zswap_stored_pages);
-	zswap_update_total_size();
+	for (i = 0; i < nr; i += n) {
+		n = min(nr - i, ZSWAP_MAX_BATCH_SIZE);
+		ret = zswap_store_pages(tree, pool, objcg,
+					swp_entry(type, offset + i), page + i, n);
+		if (ret)
+			break;
+	}
+	zswap_pool_put(pool);
 
-	return 0;
+	/* drop whatever part of a THP was stored before the failure */
+	if (ret) {
+		while (i--)
+			zswap_frontswap_invalidate_page(type, offset + i);
+	}
 
-put_dstmem:
-	mutex_unlock(acomp_ctx->mutex);
-	zswap_pool_put(entry->pool);
-freepage:
-	zswap_entry_cache_free(entry);
 reject:
+	if (objcg)
+		obj_cgroup_put(objcg);
 	return ret;
+
+shrink:
+	pool = zswap_pool_last_get();
+	if (pool && !queue_work(shrink_wq, &pool->shrink_work))
+		zswap_pool_put(pool);
+	ret = -ENOMEM;
+	goto reject;
 }
 
 /*
@@ -1285,8 +1485,6 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	/* decompress */
 	dlen = PAGE_SIZE;
 	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
-	if (zpool_evictable(entry->pool->zpool))
-		src += sizeof(struct zswap_header);
 
 	if (!zpool_can_sleep_mapped(entry->pool->zpool)) {
 
@@ -1301,8 +1499,8 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	sg_init_one(&input, src, entry->length);
 	sg_init_table(&output, 1);
 	sg_set_page(&output, page, PAGE_SIZE, 0);
-	acomp_request_set_params(acomp_ctx->req, &input, &output, entry->length, dlen);
-	ret = crypto_wait_req(crypto_acomp_decompress(acomp_ctx->req), &acomp_ctx->wait);
+	acomp_request_set_params(acomp_ctx->reqs[0], &input, &output, entry->length, dlen);
+	ret = crypto_wait_req(crypto_acomp_decompress(acomp_ctx->reqs[0]), &acomp_ctx->waits[0]);
 	mutex_unlock(acomp_ctx->mutex);
 
 	if (zpool_can_sleep_mapped(entry->pool->zpool))
@@ -1312,6 +1510,11 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 
 	BUG_ON(ret);
 
+	/* the page was just faulted back in, keep it away from writeback */
+	spin_lock(&entry->pool->lru_lock);
+	list_move(&entry->lru, &entry->pool->lru);
+	spin_unlock(&entry->pool->lru_lock);
+
 freeentry:
 	spin_lock(&tree->lock);
 	zswap_entry_put(tree, entry);
@@ -1335,12 +1538,7 @@ static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 		return;
 	}
 
-	/* remove from rbtree */
-	zswap_rb_erase(&tree->rbroot, entry);
-
-	/* drop the initial reference from entry creation */
-	zswap_entry_put(tree, entry);
-
+	zswap_invalidate_entry(tree, entry);
 	spin_unlock(&tree->lock);
 }
 
@@ -4310,6 +4310,7 @@ int netdev_tstamp_prequeue __read_mostly = 1;
 int netdev_budget __read_mostly = 300;
 /* Must be at least 2 jiffes to guarantee 1 jiffy timeout */
 unsigned int __read_mostly netdev_budget_usecs = 2 * USEC_PER_SEC / HZ;
+unsigned int sysctl_skb_defer_max __read_mostly = 64;
 int weight_p __read_mostly = 64;           /* old backlog weight */
 int dev_weight_rx_bias __read_mostly = 1;  /* bias for backlog weight */
 int dev_weight_tx_bias __read_mostly = 1;  /* bias for output_queue quota */
@@ -4558,6 +4559,15 @@ static void rps_trigger_softirq(void *data)
 
 #endif /* CONFIG_RPS */
 
+/* Called from hardirq (IPI) context */
+static void trigger_rx_softirq(void *data)
+{
+	struct softnet_data *sd = data;
+
+	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+	smp_store_release(&sd->defer_ipi_scheduled, 0);
+}
+
 /*
  * Check if this softnet_data structure is another cpu one
  * If yes, queue it to our IPI list and return 1
@@ -6562,12 +6572,12 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 
 	if (work_done) {
 		if (n->gro_bitmask)
-			timeout = READ_ONCE(n->dev->gro_flush_timeout);
-		n->defer_hard_irqs_count = READ_ONCE(n->dev->napi_defer_hard_irqs);
+			timeout = napi_get_gro_flush_timeout(n);
+		n->defer_hard_irqs_count = napi_get_defer_hard_irqs(n);
 	}
 	if (n->defer_hard_irqs_count > 0) {
 		n->defer_hard_irqs_count--;
-		timeout = READ_ONCE(n->dev->gro_flush_timeout);
+		timeout = napi_get_gro_flush_timeout(n);
 		if (timeout)
 			ret = false;
 	}
@@ -6673,8 +6683,8 @@ static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock, bool
 	local_bh_disable();
 
 	if (prefer_busy_poll) {
-		napi->defer_hard_irqs_count = READ_ONCE(napi->dev->napi_defer_hard_irqs);
-		timeout = READ_ONCE(napi->dev->gro_flush_timeout);
+		napi->defer_hard_irqs_count = napi_get_defer_hard_irqs(napi);
+		timeout = napi_get_gro_flush_timeout(napi);
 		if (napi->defer_hard_irqs_count && timeout) {
 			hrtimer_start(&napi->timer, ns_to_ktime(timeout), HRTIMER_MODE_REL_PINNED);
 			skip_schedule = true;
@@ -6773,6 +6783,57 @@ void napi_busy_loop(unsigned int napi_id,
 }
 EXPORT_SYMBOL(napi_busy_loop);
 
+/**
+ * napi_suspend_irqs - keep the IRQs of a NAPI instance off
+ * @napi_id: id of the NAPI instance
+ *
+ * Called once busy polling found events. The IRQs stay masked while the
+ * application keeps polling, irq_suspend_timeout is the safety net that
+ * resumes them through napi_watchdog() if it stops doing so.
+ */
+void napi_suspend_irqs(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+
+	rcu_read_lock();
+	napi = napi_by_id(napi_id);
+	if (napi) {
+		unsigned long timeout = napi_get_irq_suspend_timeout(napi);
+
+		if (timeout)
+			hrtimer_start(&napi->timer, ns_to_ktime(timeout),
+				      HRTIMER_MODE_REL_PINNED);
+	}
+	rcu_read_unlock();
+}
+
+/**
+ * napi_resume_irqs - give the IRQs of a NAPI instance back
+ * @napi_id: id of the NAPI instance
+ *
+ * Called when busy polling found nothing and the application is about to
+ * sleep. Scheduling the NAPI instance lets the driver re-enable its IRQs.
+ */
+void napi_resume_irqs(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+
+	rcu_read_lock();
+	napi = napi_by_id(napi_id);
+	if (napi) {
+		/* If irq_suspend_timeout was cleared since the IRQs were
+		 * suspended, the watchdog armed with the old value still
+		 * resumes them.
+		 */
+		if (napi_get_irq_suspend_timeout(napi)) {
+			local_bh_disable();
+			napi_schedule(napi);
+			local_bh_enable();
+		}
+	}
+	rcu_read_unlock();
+}
+
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 
 static void napi_hash_add(struct napi_struct *napi)
@@ -6841,9 +6902,9 @@ int dev_set_threaded(struct net_device *dev, bool threaded)
 	struct napi_struct *napi;
 	int err = 0;
 
-	if (dev->threaded == threaded)
-		return 0;
-
+	/* Not short-circuited on dev->threaded, the NAPIs of the device may
+	 * have been switched one by one by napi_set_threaded().
+	 */
 	if (threaded) {
 		list_for_each_entry(napi, &dev->napi_list, dev_list) {
 			if (!napi->thread) {
@@ -6870,6 +6931,7 @@ int dev_set_threaded(struct net_device *dev, bool threaded)
 	 * This should not cause hiccups/stalls to the live traffic.
 	 */
 	list_for_each_entry(napi, &dev->napi_list, dev_list) {
+		napi->threaded = threaded;
 		if (threaded)
 			set_bit(NAPI_STATE_THREADED, &napi->state);
 		else
@@ -6880,6 +6942,82 @@ int dev_set_threaded(struct net_device *dev, bool threaded)
 }
 EXPORT_SYMBOL(dev_set_threaded);
 
+/**
+ *	napi_set_threaded - switch one NAPI context to or from threaded mode
+ *	@napi: NAPI context
+ *	@threaded: poll @napi from its kthread rather than from softirq
+ *
+ * Like dev_set_threaded() but for a single NAPI instance, the setting
+ * sticks across napi_disable()/napi_enable(). Must be called under rtnl_lock.
+ */
+int napi_set_threaded(struct napi_struct *napi, bool threaded)
+{
+	if (threaded && !napi->thread) {
+		int err = napi_kthread_create(napi);
+
+		if (err)
+			return err;
+	}
+
+	napi->threaded = threaded;
+
+	/* Make sure kthread is created before THREADED bit is set. */
+	smp_mb__before_atomic();
+	if (threaded)
+		set_bit(NAPI_STATE_THREADED, &napi->state);
+	else
+		clear_bit(NAPI_STATE_THREADED, &napi->state);
+
+	return 0;
+}
+EXPORT_SYMBOL(napi_set_threaded);
+
+/**
+ *	netif_queue_set_napi - report the NAPI context of a queue
+ *	@dev: network device
+ *	@queue_index: index of the RX or TX queue
+ *	@type: queue type, NETDEV_QUEUE_TYPE_RX or NETDEV_QUEUE_TYPE_TX
+ *	@napi: NAPI context serving the queue, NULL to clear the association
+ *
+ * The association is only reported to user space through the netdev netlink
+ * family and is dropped by netif_napi_del(), so drivers don't have to clear
+ * it when tearing down the NAPI context.
+ */
+void netif_queue_set_napi(struct net_device *dev, unsigned int queue_index,
+			  enum netdev_queue_type type,
+			  struct napi_struct *napi)
+{
+	switch (type) {
+	case NETDEV_QUEUE_TYPE_RX:
+		if (WARN_ON_ONCE(queue_index >= dev->num_rx_queues))
+			return;
+		WRITE_ONCE(dev->_rx[queue_index].napi, napi);
+		break;
+	case NETDEV_QUEUE_TYPE_TX:
+		if (WARN_ON_ONCE(queue_index >= dev->num_tx_queues))
+			return;
+		WRITE_ONCE(dev->_tx[queue_index].napi, napi);
+		break;
+	}
+}
+EXPORT_SYMBOL(netif_queue_set_napi);
+
+/* Look up a NAPI context by id, the caller must hold rtnl_lock. */
+struct napi_struct *netdev_napi_by_id(struct net *net, unsigned int napi_id)
+{
+	struct napi_struct *napi;
+
+	ASSERT_RTNL();
+
+	rcu_read_lock();
+	napi = napi_by_id(napi_id);
+	if (napi && !net_eq(dev_net(napi->dev), net))
+		napi = NULL;
+	rcu_read_unlock();
+
+	return napi;
+}
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -6900,6 +7038,10 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 				weight);
 	napi->weight = weight;
 	napi->dev = dev;
+	napi->irq = -1;
+	napi_set_defer_hard_irqs(napi, READ_ONCE(dev->napi_defer_hard_irqs));
+	napi_set_gro_flush_timeout(napi, READ_ONCE(dev->gro_flush_timeout));
+	napi_set_irq_suspend_timeout(napi, READ_ONCE(dev->irq_suspend_timeout));
 #ifdef CONFIG_NETPOLL
 	napi->poll_owner = -1;
 #endif
@@ -6913,6 +7055,7 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	 */
 	if (dev->threaded && napi_kthread_create(napi))
 		dev->threaded = 0;
+	napi->threaded = dev->threaded;
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -6950,7 +7093,7 @@ void napi_enable(struct napi_struct *n)
 		BUG_ON(!test_bit(NAPI_STATE_SCHED, &val));
 
 		new = val & ~(NAPIF_STATE_SCHED | NAPIF_STATE_NPSVC);
-		if (n->dev->threaded && n->thread)
+		if (n->threaded && n->thread)
 			new |= NAPIF_STATE_THREADED;
 	} while (cmpxchg(&n->state, val, new) != val);
 }
@@ -6970,11 +7113,25 @@ static void flush_gro_hash(struct napi_struct *napi)
 }
 
 /* Must be called in process context */
+static void netif_queues_clear_napi(struct napi_struct *napi)
+{
+	struct net_device *dev = napi->dev;
+	unsigned int i;
+
+	for (i = 0; dev->_rx && i < dev->num_rx_queues; i++)
+		if (dev->_rx[i].napi == napi)
+			WRITE_ONCE(dev->_rx[i].napi, NULL);
+	for (i = 0; dev->_tx && i < dev->num_tx_queues; i++)
+		if (dev->_tx[i].napi == napi)
+			WRITE_ONCE(dev->_tx[i].napi, NULL);
+}
+
 void __netif_napi_del(struct napi_struct *napi)
 {
 	if (!test_and_clear_bit(NAPI_STATE_LISTED, &napi->state))
 		return;
 
+	netif_queues_clear_napi(napi);
 	napi_hash_del(napi);
 	list_del_rcu(&napi->dev_list);
 	napi_free_frags(napi);
@@ -7134,6 +7291,28 @@ static int napi_threaded_poll(void *data)
 	return 0;
 }
 
+static void skb_defer_free_flush(struct softnet_data *sd)
+{
+	struct sk_buff *skb, *next;
+	unsigned long flags;
+
+	/* Paired with WRITE_ONCE() in skb_attempt_defer_free() */
+	if (!READ_ONCE(sd->defer_list))
+		return;
+
+	spin_lock_irqsave(&sd->defer_lock, flags);
+	skb = sd->defer_list;
+	sd->defer_list = NULL;
+	sd->defer_count = 0;
+	spin_unlock_irqrestore(&sd->defer_lock, flags);
+
+	while (skb != NULL) {
+		next = skb->next;
+		napi_consume_skb(skb, 1);
+		skb = next;
+	}
+}
+
 static __latent_entropy void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = this_cpu_ptr(&softnet_data);
@@ -7150,6 +7329,8 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 	for (;;) {
 		struct napi_struct *n;
 
+		skb_defer_free_flush(sd);
+
 		if (list_empty(&list)) {
 			if (!sd_has_rps_ipi_waiting(sd) && list_empty(&repoll))
 				return;
@@ -7179,6 +7360,7 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 		__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 
 	net_rps_action_and_irq_enable(sd);
+	skb_defer_free_flush(sd);
 }
 
 struct netdev_adjacent {
@@ -10842,7 +11024,7 @@ struct net_device *alloc_netdev_mqs(int sizeof_priv, const char *name,
 
 	dev_net_set(dev, &init_net);
 
-	dev->gso_max_size = GSO_MAX_SIZE;
+	dev->gso_max_size = GSO_LEGACY_MAX_SIZE;
 	dev->gso_max_segs = GSO_MAX_SEGS;
 	dev->upper_level = 1;
 	dev->lower_level = 1;
@@ -10930,6 +11112,10 @@ void free_netdev(struct net_device *dev)
 		return;
 	}
 
+	/* Before the queues go, they may still point at the NAPIs */
+	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list)
+		netif_napi_del(p);
+
 	netif_free_tx_queues(dev);
 	netif_free_rx_queues(dev);
 
@@ -10938,9 +11124,6 @@ void free_netdev(struct net_device *dev)
 	/* Flush device addresses */
 	dev_addr_flush(dev);
 
-	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list)
-		netif_napi_del(p);
-
 #ifdef CONFIG_PCPU_DEV_REFCNT
 	free_percpu(dev->pcpu_refcnt);
 	dev->pcpu_refcnt = NULL;
@@ -11338,6 +11521,19 @@ static int dev_cpu_dead(unsigned int oldcpu)
 		input_queue_head_incr(oldsd);
 	}
 
+	/* Free the skbs deferred to the offline CPU */
+	spin_lock_irq(&oldsd->defer_lock);
+	skb = oldsd->defer_list;
+	oldsd->defer_list = NULL;
+	oldsd->defer_count = 0;
+	spin_unlock_irq(&oldsd->defer_lock);
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		__kfree_skb(skb);
+		skb = next;
+	}
+
 	return 0;
 }
 
@@ -11659,6 +11855,8 @@ static int __init net_dev_init(void)
 		INIT_CSD(&sd->csd, rps_trigger_softirq, sd);
 		sd->cpu = i;
 #endif
+		INIT_CSD(&sd->defer_csd, trigger_rx_softirq, sd);
+		spin_lock_init(&sd->defer_lock);
 
 		init_gro_hash(&sd->backlog);
 		sd->backlog.poll = process_backlog;
@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Generic netlink interface to the queues and NAPI instances of netdevs.
+ *
+ * Drivers report which NAPI instance serves which queue with
+ * netif_queue_set_napi() and the IRQ of a NAPI instance with
+ * netif_napi_set_irq(); everything else is known to the core already.
+ */
+
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/sched.h>
+#include <net/genetlink.h>
+#include <net/sock.h>
+#include <uapi/linux/netdev.h>
+
+static struct genl_family netdev_nl_family;
+
+static const struct nla_policy netdev_queue_policy[NETDEV_A_QUEUE_MAX + 1] = {
+	[NETDEV_A_QUEUE_ID]		= { .type = NLA_U32 },
+	[NETDEV_A_QUEUE_IFINDEX]	= NLA_POLICY_MIN(NLA_U32, 1),
+	[NETDEV_A_QUEUE_TYPE]		= NLA_POLICY_MAX(NLA_U32,
+							 NETDEV_QUEUE_TYPE_TX),
+};
+
+static const struct nla_policy netdev_napi_policy[NETDEV_A_NAPI_MAX + 1] = {
+	[NETDEV_A_NAPI_IFINDEX]		= NLA_POLICY_MIN(NLA_U32, 1),
+	[NETDEV_A_NAPI_ID]		= NLA_POLICY_MIN(NLA_U32, 1),
+	[NETDEV_A_NAPI_THREADED]	= NLA_POLICY_MAX(NLA_U8, 1),
+	[NETDEV_A_NAPI_DEFER_HARD_IRQS]	= NLA_POLICY_MAX(NLA_U32, S32_MAX),
+	[NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT] = { .type = NLA_U64 },
+	[NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT] = { .type = NLA_U64 },
+};
+
+static int netdev_nl_queue_fill(struct sk_buff *rsp, struct net_device *dev,
+				u32 q_idx, u32 q_type, u32 portid, u32 seq,
+				int flags)
+{
+	struct napi_struct *napi;
+	void *hdr;
+
+	hdr = genlmsg_put(rsp, portid, seq, &netdev_nl_family, flags,
+			  NETDEV_CMD_QUEUE_GET);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(rsp, NETDEV_A_QUEUE_ID, q_idx) ||
+	    nla_put_u32(rsp, NETDEV_A_QUEUE_TYPE, q_type) ||
+	    nla_put_u32(rsp, NETDEV_A_QUEUE_IFINDEX, dev->ifindex))
+		goto nla_put_failure;
+
+	if (q_type == NETDEV_QUEUE_TYPE_RX)
+		napi = READ_ONCE(dev->_rx[q_idx].napi);
+	else
+		napi = READ_ONCE(dev->_tx[q_idx].napi);
+	if (napi && napi->napi_id &&
+	    nla_put_u32(rsp, NETDEV_A_QUEUE_NAPI_ID, napi->napi_id))
+		goto nla_put_failure;
+
+	genlmsg_end(rsp, hdr);
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(rsp, hdr);
+	return -EMSGSIZE;
+}
+
+static int netdev_nl_queue_get_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct net_device *dev;
+	u32 q_idx, q_type;
+	struct sk_buff *rsp;
+	int err;
+
+	if (!info->attrs[NETDEV_A_QUEUE_IFINDEX] ||
+	    !info->attrs[NETDEV_A_QUEUE_ID] ||
+	    !info->attrs[NETDEV_A_QUEUE_TYPE]) {
+		NL_SET_ERR_MSG(info->extack, "ifindex, queue id and type are required");
+		return -EINVAL;
+	}
+
+	q_idx = nla_get_u32(info->attrs[NETDEV_A_QUEUE_ID]);
+	q_type = nla_get_u32(info->attrs[NETDEV_A_QUEUE_TYPE]);
+
+	rsp = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!rsp)
+		return -ENOMEM;
+
+	rtnl_lock();
+
+	dev = __dev_get_by_index(genl_info_net(info),
+				 nla_get_u32(info->attrs[NETDEV_A_QUEUE_IFINDEX]));
+	if (!dev) {
+		NL_SET_ERR_MSG_ATTR(info->extack,
+				    info->attrs[NETDEV_A_QUEUE_IFINDEX],
+				    "device not found");
+		err = -ENODEV;
+		goto err_unlock;
+	}
+
+	if (q_idx >= (q_type == NETDEV_QUEUE_TYPE_RX ? dev->real_num_rx_queues :
+						       dev->real_num_tx_queues)) {
+		NL_SET_ERR_MSG_ATTR(info->extack, info->attrs[NETDEV_A_QUEUE_ID],
+				    "queue does not exist");
+		err = -EINVAL;
+		goto err_unlock;
+	}
+
+	err = netdev_nl_queue_fill(rsp, dev, q_idx, q_type, info->snd_portid,
+				   info->snd_seq, 0);
+	if (err)
+		goto err_unlock;
+
+	rtnl_unlock();
+
+	return genlmsg_reply(rsp, info);
+
+err_unlock:
+	rtnl_unlock();
+	nlmsg_free(rsp);
+	return err;
+}
+
+/* cb->args[0] is the device position, cb->args[1] the queue position, RX
+ * queues first.
+ */
+static int netdev_nl_queue_dump_one(struct sk_buff *rsp, struct net_device *dev,
+				    struct netlink_callback *cb)
+{
+	unsigned int i;
+	int err = 0;
+
+	for (i = cb->args[1]; i < dev->real_num_rx_queues; i++) {
+		err = netdev_nl_queue_fill(rsp, dev, i, NETDEV_QUEUE_TYPE_RX,
+					   NETLINK_CB(cb->skb).portid,
+					   cb->nlh->nlmsg_seq, NLM_F_MULTI);
+		if (err)
+			goto out;
+	}
+	for (; i < dev->real_num_rx_queues + dev->real_num_tx_queues; i++) {
+		err = netdev_nl_queue_fill(rsp, dev,
+					   i - dev->real_num_rx_queues,
+					   NETDEV_QUEUE_TYPE_TX,
+					   NETLINK_CB(cb->skb).portid,
+					   cb->nlh->nlmsg_seq, NLM_F_MULTI);
+		if (err)
+			goto out;
+	}
+	i = 0;
+out:
+	cb->args[1] = i;
+	return err;
+}
+
+static int netdev_nl_queue_get_dumpit(struct sk_buff *skb,
+				      struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct net *net = sock_net(skb->sk);
+	struct net_device *dev;
+	u32 ifindex = 0;
+	int idx = 0;
+	int err = 0;
+
+	if (info->attrs[NETDEV_A_QUEUE_IFINDEX])
+		ifindex = nla_get_u32(info->attrs[NETDEV_A_QUEUE_IFINDEX]);
+
+	rtnl_lock();
+	for_each_netdev(net, dev) {
+		if (idx < cb->args[0] || (ifindex && dev->ifindex != ifindex)) {
+			idx++;
+			continue;
+		}
+		err = netdev_nl_queue_dump_one(skb, dev, cb);
+		if (err)
+			break;
+		idx++;
+	}
+	rtnl_unlock();
+
+	cb->args[0] = idx;
+	if (err == -EMSGSIZE && skb->len)
+		return skb->len;
+	return err;
+}
+
+static int netdev_nl_napi_fill(struct sk_buff *rsp, struct napi_struct *napi,
+			       u32 portid, u32 seq, int flags)
+{
+	void *hdr;
+
+	hdr = genlmsg_put(rsp, portid, seq, &netdev_nl_family, flags,
+			  NETDEV_CMD_NAPI_GET);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(rsp, NETDEV_A_NAPI_ID, napi->napi_id) ||
+	    nla_put_u32(rsp, NETDEV_A_NAPI_IFINDEX, napi->dev->ifindex))
+		goto nla_put_failure;
+
+	if (napi->irq >= 0 && nla_put_u32(rsp, NETDEV_A_NAPI_IRQ, napi->irq))
+		goto nla_put_failure;
+
+	if (napi->thread &&
+	    nla_put_u32(rsp, NETDEV_A_NAPI_PID, task_pid_nr(napi->thread)))
+		goto nla_put_failure;
+
+	if (nla_put_u8(rsp, NETDEV_A_NAPI_THREADED, napi->threaded) ||
+	    nla_put_u32(rsp, NETDEV_A_NAPI_DEFER_HARD_IRQS,
+			napi_get_defer_hard_irqs(napi)) ||
+	    nla_put_u64_64bit(rsp, NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT,
+			      napi_get_gro_flush_timeout(napi),
+			      NETDEV_A_NAPI_PAD) ||
+	    nla_put_u64_64bit(rsp, NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT,
+			      napi_get_irq_suspend_timeout(napi),
+			      NETDEV_A_NAPI_PAD))
+		goto nla_put_failure;
+
+	genlmsg_end(rsp, hdr);
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(rsp, hdr);
+	return -EMSGSIZE;
+}
+
+static struct napi_struct *netdev_nl_napi_lookup(struct genl_info *info)
+{
+	struct napi_struct *napi;
+
+	if (!info->attrs[NETDEV_A_NAPI_ID]) {
+		NL_SET_ERR_MSG(info->extack, "napi id is required");
+		return ERR_PTR(-EINVAL);
+	}
+
+	napi = netdev_napi_by_id(genl_info_net(info),
+				 nla_get_u32(info->attrs[NETDEV_A_NAPI_ID]));
+	if (!napi) {
+		NL_SET_ERR_MSG_ATTR(info->extack, info->attrs[NETDEV_A_NAPI_ID],
+				    "napi not found");
+		return ERR_PTR(-ENOENT);
+	}
+
+	return napi;
+}
+
+static int netdev_nl_napi_get_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct napi_struct *napi;
+	struct sk_buff *rsp;
+	int err;
+
+	rsp = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!rsp)
+		return -ENOMEM;
+
+	rtnl_lock();
+
+	napi = netdev_nl_napi_lookup(info);
+	if (IS_ERR(napi)) {
+		err = PTR_ERR(napi);
+		goto err_unlock;
+	}
+
+	err = netdev_nl_napi_fill(rsp, napi, info->snd_portid, info->snd_seq,
+				  0);
+	if (err)
+		goto err_unlock;
+
+	rtnl_unlock();
+
+	return genlmsg_reply(rsp, info);
+
+err_unlock:
+	rtnl_unlock();
+	nlmsg_free(rsp);
+	return err;
+}
+
+/* cb->args[0] is the device position, cb->args[1] the NAPI position */
+static int netdev_nl_napi_dump_one(struct sk_buff *rsp, struct net_device *dev,
+				   struct netlink_callback *cb)
+{
+	struct napi_struct *napi;
+	unsigned int i = 0;
+	int err = 0;
+
+	list_for_each_entry(napi, &dev->napi_list, dev_list) {
+		/* NAPIs without an id can't be referred to from user space */
+		if (i++ < cb->args[1] || !napi->napi_id)
+			continue;
+
+		err = netdev_nl_napi_fill(rsp, napi, NETLINK_CB(cb->skb).portid,
+					  cb->nlh->nlmsg_seq, NLM_F_MULTI);
+		if (err) {
+			cb->args[1] = i - 1;
+			return err;
+		}
+	}
+
+	cb->args[1] = 0;
+	return 0;
+}
+
+static int netdev_nl_napi_get_dumpit(struct sk_buff *skb,
+				     struct netlink_callback *cb)
+{
+	const struct genl_dumpit_info *info = genl_dumpit_info(cb);
+	struct net *net = sock_net(skb->sk);
+	struct net_device *dev;
+	u32 ifindex = 0;
+	int idx = 0;
+	int err = 0;
+
+	if (info->attrs[NETDEV_A_NAPI_IFINDEX])
+		ifindex = nla_get_u32(info->attrs[NETDEV_A_NAPI_IFINDEX]);
+
+	rtnl_lock();
+	for_each_netdev(net, dev) {
+		if (idx < cb->args[0] || (ifindex && dev->ifindex != ifindex)) {
+			idx++;
+			continue;
+		}
+		err = netdev_nl_napi_dump_one(skb, dev, cb);
+		if (err)
+			break;
+		idx++;
+	}
+	rtnl_unlock();
+
+	cb->args[0] = idx;
+	if (err == -EMSGSIZE && skb->len)
+		return skb->len;
+	return err;
+}
+
+static int netdev_nl_napi_set_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct napi_struct *napi;
+	int err = 0;
+
+	rtnl_lock();
+
+	napi = netdev_nl_napi_lookup(info);
+	if (IS_ERR(napi)) {
+		err = PTR_ERR(napi);
+		goto out_unlock;
+	}
+
+	if (info->attrs[NETDEV_A_NAPI_THREADED]) {
+		err = napi_set_threaded(napi,
+					nla_get_u8(info->attrs[NETDEV_A_NAPI_THREADED]));
+		if (err) {
+			NL_SET_ERR_MSG(info->extack, "failed to create the napi thread");
+			goto out_unlock;
+		}
+	}
+
+	if (info->attrs[NETDEV_A_NAPI_DEFER_HARD_IRQS])
+		napi_set_defer_hard_irqs(napi,
+					 nla_get_u32(info->attrs[NETDEV_A_NAPI_DEFER_HARD_IRQS]));
+
+	if (info->attrs[NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT])
+		napi_set_gro_flush_timeout(napi,
+					   nla_get_u64(info->attrs[NETDEV_A_NAPI_GRO_FLUSH_TIMEOUT]));
+
+	if (info->attrs[NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT])
+		napi_set_irq_suspend_timeout(napi,
+					     nla_get_u64(info->attrs[NETDEV_A_NAPI_IRQ_SUSPEND_TIMEOUT]));
+
+out_unlock:
+	rtnl_unlock();
+	return err;
+}
+
+static const struct genl_ops netdev_nl_ops[] = {
+	{
+		.cmd		= NETDEV_CMD_QUEUE_GET,
+		.doit		= netdev_nl_queue_get_doit,
+		.dumpit		= netdev_nl_queue_get_dumpit,
+		.policy		= netdev_queue_policy,
+		.maxattr	= NETDEV_A_QUEUE_MAX,
+	},
+	{
+		.cmd		= NETDEV_CMD_NAPI_GET,
+		.doit		= netdev_nl_napi_get_doit,
+		.dumpit		= netdev_nl_napi_get_dumpit,
+		.policy		= netdev_napi_policy,
+		.maxattr	= NETDEV_A_NAPI_MAX,
+	},
+	{
+		.cmd		= NETDEV_CMD_NAPI_SET,
+		.doit		= netdev_nl_napi_set_doit,
+		.policy		= netdev_napi_policy,
+		.maxattr	= NETDEV_A_NAPI_MAX,
+		.flags		= GENL_ADMIN_PERM,
+	},
+};
+
+static struct genl_family netdev_nl_family __ro_after_init = {
+	.name		= NETDEV_FAMILY_NAME,
+	.version	= NETDEV_FAMILY_VERSION,
+	.netnsok	= true,
+	.parallel_ops	= true,
+	.module		= THIS_MODULE,
+	.ops		= netdev_nl_ops,
+	.n_ops		= ARRAY_SIZE(netdev_nl_ops),
+};
+
+static int __init netdev_genl_init(void)
+{
+	return genl_register_family(&netdev_nl_family);
+}
+
+subsys_initcall(netdev_genl_init);
@@ -9,6 +9,7 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/device.h>
+#include <linux/ethtool.h>
 
 #include <net/page_pool.h>
 #include <net/xdp.h>
@@ -26,6 +27,108 @@
 
 #define BIAS_MAX	LONG_MAX
 
+#define alloc_stat_inc(pool, __stat)	(pool->alloc_stats.__stat++)
+#define recycle_stat_inc(pool, __stat)					\
+	this_cpu_inc(pool->recycle_stats->__stat)
+#define recycle_stat_add(pool, __stat, val)				\
+	this_cpu_add(pool->recycle_stats->__stat, val)
+
+static const char pp_stats[][ETH_GSTRING_LEN] = {
+	"rx_pp_alloc_fast",
+	"rx_pp_alloc_slow",
+	"rx_pp_alloc_slow_ho",
+	"rx_pp_alloc_empty",
+	"rx_pp_alloc_refill",
+	"rx_pp_alloc_waive",
+	"rx_pp_recycle_cached",
+	"rx_pp_recycle_cache_full",
+	"rx_pp_recycle_pcp",
+	"rx_pp_recycle_ring",
+	"rx_pp_recycle_ring_full",
+	"rx_pp_recycle_released_ref",
+};
+
+/**
+ * page_pool_get_stats() - fetch page pool stats
+ * @pool:	pool from which page was allocated
+ * @stats:	struct page_pool_stats to fill in
+ *
+ * The counters are added to @stats, so that drivers can sum up the
+ * pools of all their queues.
+ *
+ * Return: true if stats were filled in.
+ */
+bool page_pool_get_stats(struct page_pool *pool,
+			 struct page_pool_stats *stats)
+{
+	int cpu;
+
+	if (!stats)
+		return false;
+
+	stats->alloc_stats.fast += pool->alloc_stats.fast;
+	stats->alloc_stats.slow += pool->alloc_stats.slow;
+	stats->alloc_stats.slow_high_order += pool->alloc_stats.slow_high_order;
+	stats->alloc_stats.empty += pool->alloc_stats.empty;
+	stats->alloc_stats.refill += pool->alloc_stats.refill;
+	stats->alloc_stats.waive += pool->alloc_stats.waive;
+
+	for_each_possible_cpu(cpu) {
+		const struct page_pool_recycle_stats *pcpu =
+			per_cpu_ptr(pool->recycle_stats, cpu);
+
+		stats->recycle_stats.cached += pcpu->cached;
+		stats->recycle_stats.cache_full += pcpu->cache_full;
+		stats->recycle_stats.pcp += pcpu->pcp;
+		stats->recycle_stats.ring += pcpu->ring;
+		stats->recycle_stats.ring_full += pcpu->ring_full;
+		stats->recycle_stats.released_refcnt += pcpu->released_refcnt;
+	}
+
+	return true;
+}
+EXPORT_SYMBOL(page_pool_get_stats);
+
+u8 *page_pool_ethtool_stats_get_strings(u8 *data)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pp_stats); i++) {
+		memcpy(data, pp_stats[i], ETH_GSTRING_LEN);
+		data += ETH_GSTRING_LEN;
+	}
+
+	return data;
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get_strings);
+
+int page_pool_ethtool_stats_get_count(void)
+{
+	return ARRAY_SIZE(pp_stats);
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get_count);
+
+u64 *page_pool_ethtool_stats_get(u64 *data, void *stats)
+{
+	struct page_pool_stats *pool_stats = stats;
+
+	*data++ = pool_stats->alloc_stats.fast;
+	*data++ = pool_stats->alloc_stats.slow;
+	*data++ = pool_stats->alloc_stats.slow_high_order;
+	*data++ = pool_stats->alloc_stats.empty;
+	*data++ = pool_stats->alloc_stats.refill;
+	*data++ = pool_stats->alloc_stats.waive;
+	*data++ = pool_stats->recycle_stats.cached;
+	*data++ = pool_stats->recycle_stats.cache_full;
+	*data++ = pool_stats->recycle_stats.pcp;
+	*data++ = pool_stats->recycle_stats.ring;
+	*data++ = pool_stats->recycle_stats.ring_full;
+	*data++ = pool_stats->recycle_stats.released_refcnt;
+
+	return data;
+}
+EXPORT_SYMBOL(page_pool_ethtool_stats_get);
+
 static int page_pool_init(struct page_pool *pool,
 			  const struct page_pool_params *params)
 {
@@ -73,9 +176,19 @@ static int page_pool_init(struct page_pool *pool,
 	    pool->p.flags & PP_FLAG_PAGE_FRAG)
 		return -EINVAL;
 
-	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
+	pool->recycle_stats = alloc_percpu(struct page_pool_recycle_stats);
+	if (!pool->recycle_stats)
 		return -ENOMEM;
 
+	if (pool->p.flags & PP_FLAG_RECYCLE_PCP) {
+		pool->recycle_pcp = alloc_percpu(struct pp_recycle_pcp);
+		if (!pool->recycle_pcp)
+			goto err_free_stats;
+	}
+
+	if (ptr_ring_init(&pool->ring, ring_qsize, GFP_KERNEL) < 0)
+		goto err_free_pcp;
+
 	atomic_set(&pool->pages_state_release_cnt, 0);
 
 	/* Driver calling page_pool_create() also call page_pool_destroy() */
@@ -85,6 +198,12 @@ static int page_pool_init(struct page_pool *pool,
 		get_device(pool->p.dev);
 
 	return 0;
+
+err_free_pcp:
+	free_percpu(pool->recycle_pcp);
+err_free_stats:
+	free_percpu(pool->recycle_stats);
+	return -ENOMEM;
 }
 
 struct page_pool *page_pool_create(const struct page_pool_params *params)
@@ -109,6 +228,36 @@ EXPORT_SYMBOL(page_pool_create);
 
 static void page_pool_return_page(struct page_pool *pool, struct page *page);
 
+/* Take back pages that were freed on this CPU outside of NAPI context */
+static struct page *page_pool_refill_from_pcp(struct page_pool *pool,
+					      int pref_nid)
+{
+	struct pp_recycle_pcp *pcp;
+	struct page *page = NULL;
+
+	/* Producers may run in process context with BH disabled */
+	local_bh_disable();
+	pcp = this_cpu_ptr(pool->recycle_pcp);
+	while (pcp->count && pool->alloc.count < PP_ALLOC_CACHE_REFILL) {
+		page = pcp->cache[--pcp->count];
+		if (likely(page_to_nid(page) == pref_nid)) {
+			pool->alloc.cache[pool->alloc.count++] = page;
+		} else {
+			page_pool_return_page(pool, page);
+			alloc_stat_inc(pool, waive);
+		}
+	}
+	local_bh_enable();
+
+	page = NULL;
+	if (likely(pool->alloc.count > 0)) {
+		page = pool->alloc.cache[--pool->alloc.count];
+		alloc_stat_inc(pool, refill);
+	}
+
+	return page;
+}
+
 noinline
 static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
 {
@@ -116,10 +265,6 @@ static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
 	struct page *page;
 	int pref_nid; /* preferred NUMA node */
 
-	/* Quicker fallback, avoid locks when ring is empty */
-	if (__ptr_ring_empty(r))
-		return NULL;
-
 	/* Softirq guarantee CPU and thus NUMA node is stable. This,
 	 * assumes CPU refilling driver RX-ring will also run RX-NAPI.
 	 */
@@ -130,6 +275,19 @@ static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
 	pref_nid = numa_mem_id(); /* will be zero like page_to_nid() */
 #endif
 
+	/* The local per-CPU recycle cache needs no lock at all */
+	if (pool->recycle_pcp) {
+		page = page_pool_refill_from_pcp(pool, pref_nid);
+		if (page)
+			return page;
+	}
+
+	/* Quicker fallback, avoid locks when ring is empty */
+	if (__ptr_ring_empty(r)) {
+		alloc_stat_inc(pool, empty);
+		return NULL;
+	}
+
 	/* Slower-path: Get pages from locked ring queue */
 	spin_lock(&r->consumer_lock);
 
@@ -148,14 +306,17 @@ static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
 			 * This limit stress on page buddy alloactor.
 			 */
 			page_pool_return_page(pool, page);
+			alloc_stat_inc(pool, waive);
 			page = NULL;
 			break;
 		}
 	} while (pool->alloc.count < PP_ALLOC_CACHE_REFILL);
 
 	/* Return last page */
-	if (likely(pool->alloc.count > 0))
+	if (likely(pool->alloc.count > 0)) {
 		page = pool->alloc.cache[--pool->alloc.count];
+		alloc_stat_inc(pool, refill);
+	}
 
 	spin_unlock(&r->consumer_lock);
 	return page;
@@ -170,6 +331,7 @@ static struct page *__page_pool_get_cached(struct page_pool *pool)
 	if (likely(pool->alloc.count)) {
 		/* Fast-path */
 		page = pool->alloc.cache[--pool->alloc.count];
+		alloc_stat_inc(pool, fast);
 	} else {
 		page = page_pool_refill_alloc_cache(pool);
 	}
@@ -246,6 +408,7 @@ static struct page *__page_pool_alloc_page_order(struct page_pool *pool,
 	/* Track how many pages are held 'in-flight' */
 	pool->pages_state_hold_cnt++;
 	trace_page_pool_state_hold(pool, page, pool->pages_state_hold_cnt);
+	alloc_stat_inc(pool, slow_high_order);
 	return page;
 }
 
@@ -295,10 +458,12 @@ static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
 	}
 
 	/* Return last page */
-	if (likely(pool->alloc.count > 0))
+	if (likely(pool->alloc.count > 0)) {
 		page = pool->alloc.cache[--pool->alloc.count];
-	else
+		alloc_stat_inc(pool, slow);
+	} else {
 		page = NULL;
+	}
 
 	/* When page just alloc'ed is should/must have refcnt 1. */
 	return page;
@@ -396,7 +561,57 @@ static bool page_pool_recycle_in_ring(struct page_pool *pool, struct page *page)
 	else
 		ret = ptr_ring_produce_bh(&pool->ring, page);
 
-	return (ret == 0) ? true : false;
+	if (!ret) {
+		recycle_stat_inc(pool, ring);
+		return true;
+	}
+
+	return false;
+}
+
+/* Hand a full per-CPU recycle cache to the ptr_ring under one lock */
+static void page_pool_flush_pcp(struct page_pool *pool,
+				struct pp_recycle_pcp *pcp)
+{
+	u32 i;
+
+	page_pool_ring_lock(pool);
+	for (i = 0; i < pcp->count; i++) {
+		if (__ptr_ring_produce(&pool->ring, pcp->cache[i]))
+			break; /* ring full */
+	}
+	page_pool_ring_unlock(pool);
+
+	recycle_stat_add(pool, ring, i);
+	for (; i < pcp->count; i++) {
+		recycle_stat_inc(pool, ring_full);
+		page_pool_return_page(pool, pcp->cache[i]);
+	}
+	pcp->count = 0;
+}
+
+static bool page_pool_recycle_in_pcp(struct page_pool *pool, struct page *page)
+{
+	struct pp_recycle_pcp *pcp;
+	bool ret = false;
+
+	local_bh_disable();
+	/* page_pool_destroy() waits for an RCU grace period after closing
+	 * the caches before draining them, and BH disabled sections are
+	 * RCU read-side critical sections.
+	 */
+	if (likely(!READ_ONCE(pool->recycle_pcp_closed))) {
+		pcp = this_cpu_ptr(pool->recycle_pcp);
+		if (unlikely(pcp->count == PP_RECYCLE_PCP_SIZE))
+			page_pool_flush_pcp(pool, pcp);
+
+		pcp->cache[pcp->count++] = page;
+		recycle_stat_inc(pool, pcp);
+		ret = true;
+	}
+	local_bh_enable();
+
+	return ret;
 }
 
 /* Only allow direct recycling in special circumstances, into the
@@ -407,11 +622,14 @@ static bool page_pool_recycle_in_ring(struct page_pool *pool, struct page *page)
 static bool page_pool_recycle_in_cache(struct page *page,
 				       struct page_pool *pool)
 {
-	if (unlikely(pool->alloc.count == PP_ALLOC_CACHE_SIZE))
+	if (unlikely(pool->alloc.count == PP_ALLOC_CACHE_SIZE)) {
+		recycle_stat_inc(pool, cache_full);
 		return false;
+	}
 
 	/* Caller MUST have verified/know (page_ref_count(page) == 1) */
 	pool->alloc.cache[pool->alloc.count++] = page;
+	recycle_stat_inc(pool, cached);
 	return true;
 }
 
@@ -467,6 +685,7 @@ __page_pool_put_page(struct page_pool *pool, struct page *page,
 	 * will be invoking put_page.
 	 */
 	/* Do not replace this with page_pool_return_page() */
+	recycle_stat_inc(pool, released_refcnt);
 	page_pool_release_page(pool, page);
 	put_page(page);
 
@@ -477,8 +696,15 @@ void page_pool_put_page(struct page_pool *pool, struct page *page,
 			unsigned int dma_sync_size, bool allow_direct)
 {
 	page = __page_pool_put_page(pool, page, dma_sync_size, allow_direct);
-	if (page && !page_pool_recycle_in_ring(pool, page)) {
+	if (!page)
+		return;
+
+	if (pool->recycle_pcp && page_pool_recycle_in_pcp(pool, page))
+		return;
+
+	if (!page_pool_recycle_in_ring(pool, page)) {
 		/* Cache full, fallback to free pages */
+		recycle_stat_inc(pool, ring_full);
 		page_pool_return_page(pool, page);
 	}
 }
@@ -510,10 +736,14 @@ void page_pool_put_page_bulk(struct page_pool *pool, void **data,
 	}
 	page_pool_ring_unlock(pool);
 
+	recycle_stat_add(pool, ring, i);
+
 	/* Hopefully all pages was return into ptr_ring */
 	if (likely(i == bulk_len))
 		return;
 
+	recycle_stat_add(pool, ring_full, bulk_len - i);
+
 	/* ptr_ring cache full, free remaining pages outside producer lock
 	 * since put_page() with refcnt == 1 can be an expensive operation
 	 */
@@ -621,6 +851,8 @@ static void page_pool_free(struct page_pool *pool)
 		pool->disconnect(pool);
 
 	ptr_ring_cleanup(&pool->ring, NULL);
+	free_percpu(pool->recycle_pcp);
+	free_percpu(pool->recycle_stats);
 
 	if (pool->p.flags & PP_FLAG_DMA_MAP)
 		put_device(pool->p.dev);
@@ -645,9 +877,29 @@ static void page_pool_empty_alloc_cache_once(struct page_pool *pool)
 	}
 }
 
+static void page_pool_empty_pcp(struct page_pool *pool)
+{
+	struct pp_recycle_pcp *pcp;
+	int cpu;
+
+	/* Producers that saw the caches open may still be running until
+	 * the grace period has elapsed, the release worker retries.
+	 */
+	if (!pool->recycle_pcp ||
+	    !poll_state_synchronize_rcu(pool->recycle_pcp_gp))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->recycle_pcp, cpu);
+		while (pcp->count)
+			page_pool_return_page(pool, pcp->cache[--pcp->count]);
+	}
+}
+
 static void page_pool_scrub(struct page_pool *pool)
 {
 	page_pool_empty_alloc_cache_once(pool);
+	page_pool_empty_pcp(pool);
 	pool->destroy_cnt++;
 
 	/* No more consumers should exist, but producers could still
@@ -707,6 +959,11 @@ void page_pool_destroy(struct page_pool *pool)
 
 	page_pool_free_frag(pool);
 
+	if (pool->recycle_pcp) {
+		WRITE_ONCE(pool->recycle_pcp_closed, true);
+		pool->recycle_pcp_gp = start_poll_synchronize_rcu();
+	}
+
 	if (!page_pool_release(pool))
 		return;
 
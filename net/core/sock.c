@@ -137,6 +137,7 @@
 #include <trace/events/sock.h>
 
 #include <net/tcp.h>
+#include <net/ipv6.h>
 #include <net/busy_poll.h>
 
 #include <linux/ethtool.h>
@@ -2161,6 +2162,23 @@ void sk_free_unlock_clone(struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(sk_free_unlock_clone);
 
+static u32 sk_dst_gso_max_size(struct sock *sk, struct dst_entry *dst)
+{
+	u32 max_size = dst->dev->gso_max_size;
+
+	/* skbs bigger than 64KB need an IPv6 jumbo HBH header */
+	if (max_size > GSO_LEGACY_MAX_SIZE) {
+#if IS_ENABLED(CONFIG_IPV6)
+		if (sk->sk_family == AF_INET6 &&
+		    sk->sk_protocol == IPPROTO_TCP &&
+		    !ipv6_addr_v4mapped(&sk->sk_v6_rcv_saddr))
+			return max_size;
+#endif
+		max_size = GSO_LEGACY_MAX_SIZE;
+	}
+	return max_size;
+}
+
 void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 {
 	u32 max_segs = 1;
@@ -2175,7 +2193,7 @@ void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 			sk->sk_route_caps &= ~NETIF_F_GSO_MASK;
 		} else {
 			sk->sk_route_caps |= NETIF_F_SG | NETIF_F_HW_CSUM;
-			sk->sk_gso_max_size = dst->dev->gso_max_size;
+			sk->sk_gso_max_size = sk_dst_gso_max_size(sk, dst);
 			max_segs = max_t(u32, dst->dev->gso_max_segs, 1);
 		}
 	}
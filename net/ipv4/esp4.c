@@ -138,6 +138,7 @@ static struct sock *esp_find_tcp_sk(struct xfrm_state *x)
 	__be16 sport, dport;
 	struct sock *nsk;
 	struct sock *sk;
+	struct net *net;
 
 	sk = rcu_dereference(x->encap_sk);
 	if (sk && sk->sk_state == TCP_ESTABLISHED)
@@ -160,8 +161,10 @@ static struct sock *esp_find_tcp_sk(struct xfrm_state *x)
 	}
 	spin_unlock_bh(&x->lock);
 
-	sk = inet_lookup_established(xs_net(x), &tcp_hashinfo, x->id.daddr.a4,
-				     dport, x->props.saddr.a4, sport, 0);
+	net = xs_net(x);
+	sk = inet_lookup_established(net, net->ipv4.tcp_death_row.hashinfo,
+				     x->id.daddr.a4, dport,
+				     x->props.saddr.a4, sport, 0);
 	if (!sk)
 		return ERR_PTR(-ENOENT);
 
@@ -1212,17 +1212,24 @@ int tcp_sendmsg_locked(struct sock *sk, struct msghdr *msg, size_t size)
 
 	flags = msg->msg_flags;
 
-	if (flags & MSG_ZEROCOPY && size && sock_flag(sk, SOCK_ZEROCOPY)) {
-		skb = tcp_write_queue_tail(sk);
-		uarg = msg_zerocopy_realloc(sk, size, skb_zcopy(skb));
-		if (!uarg) {
-			err = -ENOBUFS;
-			goto out_err;
-		}
+	if ((flags & MSG_ZEROCOPY) && size) {
+		if (msg->msg_ubuf) {
+			/* caller-owned notification, e.g. io_uring */
+			uarg = msg->msg_ubuf;
+			net_zcopy_get(uarg);
+			zc = sk->sk_route_caps & NETIF_F_SG;
+		} else if (sock_flag(sk, SOCK_ZEROCOPY)) {
+			skb = tcp_write_queue_tail(sk);
+			uarg = msg_zerocopy_realloc(sk, size, skb_zcopy(skb));
+			if (!uarg) {
+				err = -ENOBUFS;
+				goto out_err;
+			}
 
-		zc = sk->sk_route_caps & NETIF_F_SG;
-		if (!zc)
-			uarg->zerocopy = 0;
+			zc = sk->sk_route_caps & NETIF_F_SG;
+			if (!zc)
+				uarg->zerocopy = 0;
+		}
 	}
 
 	if (unlikely(flags & MSG_FASTOPEN || inet_sk(sk)->defer_connect) &&
@@ -1599,6 +1606,24 @@ void tcp_cleanup_rbuf(struct sock *sk, int copied)
 		tcp_send_ack(sk);
 }
 
+/* Hand a consumed skb back to the CPU which allocated it, so that its freeing
+ * doesn't bounce slab and page cache lines between CPUs.
+ */
+static void tcp_eat_recv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	if (static_branch_unlikely(&tcp_rx_skb_cache_key) ||
+	    unlikely(skb->destructor != sock_rfree)) {
+		sk_eat_skb(sk, skb);
+		return;
+	}
+
+	__skb_unlink(skb, &sk->sk_receive_queue);
+	sock_rfree(skb);
+	skb->destructor = NULL;
+	skb->sk = NULL;
+	skb_attempt_defer_free(skb);
+}
+
 static struct sk_buff *tcp_recv_skb(struct sock *sk, u32 seq, u32 *off)
 {
 	struct sk_buff *skb;
@@ -1618,7 +1643,7 @@ static struct sk_buff *tcp_recv_skb(struct sock *sk, u32 seq, u32 *off)
 		 * splitted a fat GRO packet, while we released socket lock
 		 * in skb_splice_bits()
 		 */
-		sk_eat_skb(sk, skb);
+		tcp_eat_recv_skb(sk, skb);
 	}
 	return NULL;
 }
@@ -1686,11 +1711,11 @@ int tcp_read_sock(struct sock *sk, read_descriptor_t *desc,
 				continue;
 		}
 		if (TCP_SKB_CB(skb)->tcp_flags & TCPHDR_FIN) {
-			sk_eat_skb(sk, skb);
+			tcp_eat_recv_skb(sk, skb);
 			++seq;
 			break;
 		}
-		sk_eat_skb(sk, skb);
+		tcp_eat_recv_skb(sk, skb);
 		if (!desc->count)
 			break;
 		WRITE_ONCE(tp->copied_seq, seq);
@@ -1830,6 +1855,19 @@ static void tcp_zerocopy_set_hint_for_skb(struct sock *sk,
 	/* worst case: skip to next skb. try to improve on this case below */
 	zc->recv_skip_hint = skb->len - offset;
 
+	/* Data in the linear part must be read, but the frags behind it may
+	 * well be mappable, e.g. when the NIC split the headers off and the
+	 * driver pulled some payload along with them.
+	 */
+	if (offset < skb_headlen(skb)) {
+		if (!skb_shinfo(skb)->nr_frags || skb_has_frag_list(skb))
+			return;
+		mappable_offset = find_next_mappable_frag(skb_shinfo(skb)->frags,
+							  skb->data_len);
+		zc->recv_skip_hint = skb_headlen(skb) - offset + mappable_offset;
+		return;
+	}
+
 	/* Find the frag containing this offset (and how far into that frag) */
 	frag = skb_advance_to_frag(skb, offset, &frag_offset);
 	if (!frag)
@@ -2139,8 +2177,12 @@ static int tcp_zerocopy_receive(struct sock *sk,
 			}
 			zc->recv_skip_hint = skb->len - offset;
 			frags = skb_advance_to_frag(skb, offset, &offset_frag);
-			if (!frags || offset_frag)
+			if (!frags || offset_frag) {
+				/* only copy up to the next mappable frag */
+				tcp_zerocopy_set_hint_for_skb(sk, zc, skb,
+							      offset);
 				break;
+			}
 		}
 
 		mappable_offset = find_next_mappable_frag(frags,
@@ -2506,14 +2548,14 @@ static int tcp_recvmsg_locked(struct sock *sk, struct msghdr *msg, size_t len,
 		if (TCP_SKB_CB(skb)->tcp_flags & TCPHDR_FIN)
 			goto found_fin_ok;
 		if (!(flags & MSG_PEEK))
-			sk_eat_skb(sk, skb);
+			tcp_eat_recv_skb(sk, skb);
 		continue;
 
 found_fin_ok:
 		/* Process the FIN. */
 		WRITE_ONCE(*seq, *seq + 1);
 		if (!(flags & MSG_PEEK))
-			sk_eat_skb(sk, skb);
+			tcp_eat_recv_skb(sk, skb);
 		break;
 	} while (len > 0);
 
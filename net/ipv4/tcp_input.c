@@ -690,6 +690,43 @@ static inline void tcp_rcv_rtt_measure_ts(struct sock *sk,
  * This function should be called every time data is copied to user space.
  * It calculates the appropriate TCP receive buffer space.
  */
+/* Receive buffer holding @rcvwin bytes of payload, within tcp_rmem[2] */
+static int tcp_rcvbuf_from_win(const struct sock *sk, u64 rcvwin)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	int rcvmem;
+
+	rcvmem = SKB_TRUESIZE(tp->advmss + MAX_TCP_HEADER);
+	while (tcp_win_from_space(sk, rcvmem) < tp->advmss)
+		rcvmem += 128;
+
+	do_div(rcvwin, tp->advmss);
+	return min_t(u64, rcvwin * rcvmem,
+		     READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_rmem[2]));
+}
+
+/* Start with the receive buffer autotuning reached on previous connections
+ * to the same destination, @space being the bytes they copied per RTT,
+ * rather than ramping up from tcp_rmem[1] again.
+ */
+void tcp_rcvbuf_init_learned(struct sock *sk, u32 space)
+{
+	const struct net *net = sock_net(sk);
+	int rcvbuf, max;
+
+	max = READ_ONCE(net->ipv4.sysctl_tcp_rcvbuf_dst_max);
+	if (!max || !READ_ONCE(net->ipv4.sysctl_tcp_moderate_rcvbuf) ||
+	    (sk->sk_userlocks & SOCK_RCVBUF_LOCK))
+		return;
+
+	/* Same window as tcp_rcv_space_adjust(), without the growth */
+	rcvbuf = tcp_rcvbuf_from_win(sk, ((u64)space << 1) +
+					 16 * tcp_sk(sk)->advmss);
+	rcvbuf = min(rcvbuf, max);
+	if (rcvbuf > sk->sk_rcvbuf)
+		WRITE_ONCE(sk->sk_rcvbuf, rcvbuf);
+}
+
 void tcp_rcv_space_adjust(struct sock *sk)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
@@ -719,26 +756,23 @@ void tcp_rcv_space_adjust(struct sock *sk)
 
 	if (READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_moderate_rcvbuf) &&
 	    !(sk->sk_userlocks & SOCK_RCVBUF_LOCK)) {
-		int rcvmem, rcvbuf;
+		u8 factor = READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_rcvbuf_grow);
 		u64 rcvwin, grow;
+		int rcvbuf;
 
 		/* minimal window to cope with packet losses, assuming
 		 * steady state. Add some cushion because of small variations.
 		 */
 		rcvwin = ((u64)copied << 1) + 16 * tp->advmss;
 
-		/* Accommodate for sender rate increase (eg. slow start) */
+		/* Accommodate for sender rate increase (eg. slow start),
+		 * tcp_rcvbuf_grow times the increase seen in the last RTT.
+		 */
 		grow = rcvwin * (copied - tp->rcvq_space.space);
 		do_div(grow, tp->rcvq_space.space);
-		rcvwin += (grow << 1);
-
-		rcvmem = SKB_TRUESIZE(tp->advmss + MAX_TCP_HEADER);
-		while (tcp_win_from_space(sk, rcvmem) < tp->advmss)
-			rcvmem += 128;
+		rcvwin += grow * factor;
 
-		do_div(rcvwin, tp->advmss);
-		rcvbuf = min_t(u64, rcvwin * rcvmem,
-			       READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_rmem[2]));
+		rcvbuf = tcp_rcvbuf_from_win(sk, rcvwin);
 		if (rcvbuf > sk->sk_rcvbuf) {
 			WRITE_ONCE(sk->sk_rcvbuf, rcvbuf);
 
@@ -46,6 +46,7 @@ struct tcp_metrics_block {
 	unsigned long			tcpm_stamp;
 	u32				tcpm_lock;
 	u32				tcpm_vals[TCP_METRIC_MAX_KERNEL + 1];
+	u32				tcpm_rcv_space;
 	struct tcp_fastopen_metrics	tcpm_fastopen;
 
 	struct rcu_head			rcu_head;
@@ -120,6 +121,7 @@ static void tcpm_suck_dst(struct tcp_metrics_block *tm,
 	tm->tcpm_vals[TCP_METRIC_SSTHRESH] = dst_metric_raw(dst, RTAX_SSTHRESH);
 	tm->tcpm_vals[TCP_METRIC_CWND] = dst_metric_raw(dst, RTAX_CWND);
 	tm->tcpm_vals[TCP_METRIC_REORDERING] = dst_metric_raw(dst, RTAX_REORDERING);
+	tm->tcpm_rcv_space = 0;
 	if (fastopen_clear) {
 		tm->tcpm_fastopen.mss = 0;
 		tm->tcpm_fastopen.syn_loss = 0;
@@ -434,6 +436,19 @@ void tcp_update_metrics(struct sock *sk)
 					       tp->reordering);
 		}
 	}
+
+	/* Receive autotuning: follow increases right away, and decay
+	 * slowly so that a few short transfers don't lose the history.
+	 */
+	if (READ_ONCE(net->ipv4.sysctl_tcp_rcvbuf_dst_max) &&
+	    tp->rcvq_space.space > TCP_INIT_CWND * tp->advmss) {
+		val = tm->tcpm_rcv_space;
+		if (tp->rcvq_space.space >= val)
+			val = tp->rcvq_space.space;
+		else
+			val -= (val - tp->rcvq_space.space) >> 2;
+		tm->tcpm_rcv_space = val;
+	}
 	tm->tcpm_stamp = jiffies;
 out_unlock:
 	rcu_read_unlock();
@@ -480,6 +495,10 @@ void tcp_init_metrics(struct sock *sk)
 		tp->reordering = val;
 
 	crtt = tcp_metric_get(tm, TCP_METRIC_RTT);
+
+	val = tm->tcpm_rcv_space;
+	if (val)
+		tcp_rcvbuf_init_learned(sk, val);
 	rcu_read_unlock();
 reset:
 	/* The initial RTT measurement from the SYN/SYN-ACK is not ideal
@@ -686,6 +705,11 @@ static int tcp_metrics_fill_info(struct sk_buff *msg,
 			nla_nest_cancel(msg, nest);
 	}
 
+	if (tm->tcpm_rcv_space &&
+	    nla_put_u32(msg, TCP_METRICS_ATTR_RCV_SPACE,
+			tm->tcpm_rcv_space) < 0)
+		goto nla_put_failure;
+
 	{
 		struct tcp_fastopen_metrics tfom_copy[1], *tfom;
 		unsigned int seq;
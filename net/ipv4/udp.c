@@ -889,6 +889,27 @@ void udp_set_csum(bool nocheck, struct sk_buff *skb,
 }
 EXPORT_SYMBOL(udp_set_csum);
 
+/* Send the segments of a GSO train one by one, see udp_gso_segment_train() */
+static int udp_send_train(struct net *net, struct sk_buff *skb, u32 gap)
+{
+	struct sk_buff *segs, *next;
+	int err = 0, ret;
+
+	skb->protocol = htons(ETH_P_IP);
+	segs = udp_gso_segment_train(skb, gap);
+	if (IS_ERR(segs))
+		return PTR_ERR(segs);
+
+	skb_list_walk_safe(segs, segs, next) {
+		skb_mark_not_on_list(segs);
+		ret = ip_send_skb(net, segs);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
 static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4,
 			struct inet_cork *cork)
 {
@@ -966,7 +987,11 @@ static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4,
 		uh->check = CSUM_MANGLED_0;
 
 send:
-	err = ip_send_skb(sock_net(sk), skb);
+	/* SO_TXTIME spaced segments are paced by the qdisc, each on its own */
+	if (unlikely(cork->gso_gap && skb->tstamp && skb_is_gso(skb)))
+		err = udp_send_train(sock_net(sk), skb, cork->gso_gap);
+	else
+		err = ip_send_skb(sock_net(sk), skb);
 	if (err) {
 		if (err == -ENOBUFS && !inet->recverr) {
 			UDP_INC_STATS(sock_net(sk),
@@ -1003,7 +1028,7 @@ int udp_push_pending_frames(struct sock *sk)
 }
 EXPORT_SYMBOL(udp_push_pending_frames);
 
-static int __udp_cmsg_send(struct cmsghdr *cmsg, u16 *gso_size)
+static int __udp_cmsg_send(struct cmsghdr *cmsg, u16 *gso_size, u32 *gso_gap)
 {
 	switch (cmsg->cmsg_type) {
 	case UDP_SEGMENT:
@@ -1011,12 +1036,18 @@ static int __udp_cmsg_send(struct cmsghdr *cmsg, u16 *gso_size)
 			return -EINVAL;
 		*gso_size = *(__u16 *)CMSG_DATA(cmsg);
 		return 0;
+	case UDP_SEGMENT_GAP:
+		if (cmsg->cmsg_len != CMSG_LEN(sizeof(__u32)))
+			return -EINVAL;
+		*gso_gap = *(__u32 *)CMSG_DATA(cmsg);
+		return 0;
 	default:
 		return -EINVAL;
 	}
 }
 
-int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size)
+int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size,
+		  u32 *gso_gap)
 {
 	struct cmsghdr *cmsg;
 	bool need_ip = false;
@@ -1031,7 +1062,7 @@ int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size)
 			continue;
 		}
 
-		err = __udp_cmsg_send(cmsg, gso_size);
+		err = __udp_cmsg_send(cmsg, gso_size, gso_gap);
 		if (err)
 			return err;
 	}
@@ -1119,9 +1150,10 @@ int udp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 
 	ipcm_init_sk(&ipc, inet);
 	ipc.gso_size = READ_ONCE(up->gso_size);
+	ipc.gso_gap = READ_ONCE(up->gso_gap);
 
 	if (msg->msg_controllen) {
-		err = udp_cmsg_send(sk, msg, &ipc.gso_size);
+		err = udp_cmsg_send(sk, msg, &ipc.gso_size, &ipc.gso_gap);
 		if (err > 0)
 			err = ip_cmsg_send(sk, msg, &ipc,
 					   sk->sk_family == AF_INET6);
@@ -2730,6 +2762,12 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		WRITE_ONCE(up->gso_size, val);
 		break;
 
+	case UDP_SEGMENT_GAP:
+		if (val < 0)
+			return -EINVAL;
+		WRITE_ONCE(up->gso_gap, val);
+		break;
+
 	case UDP_GRO:
 		lock_sock(sk);
 
@@ -2825,6 +2863,10 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = READ_ONCE(up->gso_size);
 		break;
 
+	case UDP_SEGMENT_GAP:
+		val = READ_ONCE(up->gso_gap);
+		break;
+
 	case UDP_GRO:
 		val = up->gro_enabled;
 		break;
@@ -364,6 +364,34 @@ struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
 }
 EXPORT_SYMBOL_GPL(__udp_gso_segment);
 
+/* Split a locally built GSO train before it is queued, so that each segment
+ * carries its own earliest departure time: @gap ns after the previous one,
+ * starting from the one requested for the whole train. Frags, zerocopy
+ * notifications included, and socket ownership are shared by the segments.
+ *
+ * @skb is consumed, skb->protocol must be set.
+ */
+struct sk_buff *udp_gso_segment_train(struct sk_buff *skb, u32 gap)
+{
+	ktime_t tstamp = skb->tstamp;
+	struct sk_buff *segs, *seg;
+
+	segs = skb_gso_segment(skb, NETIF_F_SG | NETIF_F_HW_CSUM);
+	if (IS_ERR_OR_NULL(segs)) {
+		kfree_skb(skb);
+		return segs ? : ERR_PTR(-EINVAL);
+	}
+	consume_skb(skb);
+
+	for (seg = segs; seg; seg = seg->next) {
+		seg->tstamp = tstamp;
+		tstamp = ktime_add_ns(tstamp, gap);
+	}
+
+	return segs;
+}
+EXPORT_SYMBOL_GPL(udp_gso_segment_train);
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
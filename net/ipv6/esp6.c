@@ -156,6 +156,7 @@ static struct sock *esp6_find_tcp_sk(struct xfrm_state *x)
 	__be16 sport, dport;
 	struct sock *nsk;
 	struct sock *sk;
+	struct net *net;
 
 	sk = rcu_dereference(x->encap_sk);
 	if (sk && sk->sk_state == TCP_ESTABLISHED)
@@ -178,8 +179,10 @@ static struct sock *esp6_find_tcp_sk(struct xfrm_state *x)
 	}
 	spin_unlock_bh(&x->lock);
 
-	sk = __inet6_lookup_established(xs_net(x), &tcp_hashinfo, &x->id.daddr.in6,
-					dport, &x->props.saddr.in6, ntohs(sport), 0, 0);
+	net = xs_net(x);
+	sk = __inet6_lookup_established(net, net->ipv4.tcp_death_row.hashinfo,
+					&x->id.daddr.in6, dport,
+					&x->props.saddr.in6, ntohs(sport), 0, 0);
 	if (!sk)
 		return ERR_PTR(-ENOENT);
 
@@ -87,6 +87,9 @@ static struct sk_buff *ipv6_gso_segment(struct sk_buff *skb,
 	bool gso_partial;
 
 	skb_reset_network_header(skb);
+	/* the segments have a 16bit payload_len again */
+	if (ipv6_hopopt_jumbo_remove(skb))
+		return ERR_PTR(-ENOMEM);
 	nhoff = skb_network_header(skb) - skb_mac_header(skb);
 	if (unlikely(!pskb_may_pull(skb, sizeof(*ipv6h))))
 		goto out;
@@ -1179,6 +1179,27 @@ static void udp6_hwcsum_outgoing(struct sock *sk, struct sk_buff *skb,
  *	Sending
  */
 
+/* Send the segments of a GSO train one by one, see udp_gso_segment_train() */
+static int udp_v6_send_train(struct sk_buff *skb, u32 gap)
+{
+	struct sk_buff *segs, *next;
+	int err = 0, ret;
+
+	skb->protocol = htons(ETH_P_IPV6);
+	segs = udp_gso_segment_train(skb, gap);
+	if (IS_ERR(segs))
+		return PTR_ERR(segs);
+
+	skb_list_walk_safe(segs, segs, next) {
+		skb_mark_not_on_list(segs);
+		ret = ip6_send_skb(segs);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
 static int udp_v6_send_skb(struct sk_buff *skb, struct flowi6 *fl6,
 			   struct inet_cork *cork)
 {
@@ -1250,7 +1271,11 @@ static int udp_v6_send_skb(struct sk_buff *skb, struct flowi6 *fl6,
 		uh->check = CSUM_MANGLED_0;
 
 send:
-	err = ip6_send_skb(skb);
+	/* SO_TXTIME spaced segments are paced by the qdisc, each on its own */
+	if (unlikely(cork->gso_gap && skb->tstamp && skb_is_gso(skb)))
+		err = udp_v6_send_train(skb, cork->gso_gap);
+	else
+		err = ip6_send_skb(skb);
 	if (err) {
 		if (err == -ENOBUFS && !inet6_sk(sk)->recverr) {
 			UDP6_INC_STATS(sock_net(sk),
@@ -1315,6 +1340,7 @@ int udpv6_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 
 	ipcm6_init(&ipc6);
 	ipc6.gso_size = READ_ONCE(up->gso_size);
+	ipc6.gso_gap = READ_ONCE(up->gso_gap);
 	ipc6.sockc.tsflags = sk->sk_tsflags;
 	ipc6.sockc.mark = sk->sk_mark;
 
@@ -1447,7 +1473,7 @@ int udpv6_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 		opt->tot_len = sizeof(*opt);
 		ipc6.opt = opt;
 
-		err = udp_cmsg_send(sk, msg, &ipc6.gso_size);
+		err = udp_cmsg_send(sk, msg, &ipc6.gso_size, &ipc6.gso_gap);
 		if (err > 0)
 			err = ip6_datagram_send_ctl(sock_net(sk), sk, msg, &fl6,
 						    &ipc6);
@@ -427,16 +427,6 @@ static long mptcp_timeout_from_subflow(const struct mptcp_subflow_context *subfl
 	       inet_csk(ssk)->icsk_timeout - jiffies : 0;
 }
 
-static void mptcp_set_timeout(struct sock *sk)
-{
-	struct mptcp_subflow_context *subflow;
-	long tout = 0;
-
-	mptcp_for_each_subflow(mptcp_sk(sk), subflow)
-		tout = max(tout, mptcp_timeout_from_subflow(subflow));
-	__mptcp_set_timeout(sk, tout);
-}
-
 static bool tcp_can_send_ack(const struct sock *ssk)
 {
 	return !((1 << inet_sk_state_load(ssk)) &
@@ -1412,17 +1402,6 @@ static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
 	return copy;
 }
 
-#define MPTCP_SEND_BURST_SIZE		((1 << 16) - \
-					 sizeof(struct tcphdr) - \
-					 MAX_TCP_OPTION_SPACE - \
-					 sizeof(struct ipv6hdr) - \
-					 sizeof(struct frag_hdr))
-
-struct subflow_send_info {
-	struct sock *ssk;
-	u64 ratio;
-};
-
 void mptcp_subflow_set_active(struct mptcp_subflow_context *subflow)
 {
 	if (!subflow->stale)
@@ -1445,20 +1424,17 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 	return __mptcp_subflow_active(subflow);
 }
 
-/* implement the mptcp packet scheduler;
+/* run the mptcp packet scheduler of msk;
  * returns the subflow that will transmit the next DSS
  * additionally updates the rtx timeout
  */
 static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 {
-	struct subflow_send_info send_info[2];
 	struct mptcp_subflow_context *subflow;
 	struct sock *sk = (struct sock *)msk;
-	int i, nr_active = 0;
-	struct sock *ssk;
+	struct mptcp_sched_data data;
 	long tout = 0;
-	u64 ratio;
-	u32 pace;
+	int i;
 
 	sock_owned_by_me(sk);
 
@@ -1468,55 +1444,84 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 		return sk_stream_memory_free(msk->first) ? msk->first : NULL;
 	}
 
-	/* re-use last subflow, if the burst allow that */
-	if (msk->last_snd && msk->snd_burst > 0 &&
-	    sk_stream_memory_free(msk->last_snd) &&
-	    mptcp_subflow_active(mptcp_subflow_ctx(msk->last_snd))) {
-		mptcp_set_timeout(sk);
-		return msk->last_snd;
-	}
-
-	/* pick the subflow with the lower wmem/wspace ratio */
-	for (i = 0; i < 2; ++i) {
-		send_info[i].ssk = NULL;
-		send_info[i].ratio = -1;
-	}
+	data.nr_active = 0;
+	data.subflows = 0;
 	mptcp_for_each_subflow(msk, subflow) {
 		trace_mptcp_subflow_get_send(subflow);
-		ssk =  mptcp_subflow_tcp_sock(subflow);
 		if (!mptcp_subflow_active(subflow))
 			continue;
 
 		tout = max(tout, mptcp_timeout_from_subflow(subflow));
-		nr_active += !subflow->backup;
-		if (!sk_stream_memory_free(subflow->tcp_sock) || !tcp_sk(ssk)->snd_wnd)
-			continue;
-
-		pace = READ_ONCE(ssk->sk_pacing_rate);
-		if (!pace)
+		data.nr_active += !subflow->backup;
+		if (!sk_stream_memory_free(subflow->tcp_sock) ||
+		    data.subflows == MPTCP_SCHED_MAX_SUBFLOWS)
 			continue;
 
-		ratio = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32,
-				pace);
-		if (ratio < send_info[subflow->backup].ratio) {
-			send_info[subflow->backup].ssk = ssk;
-			send_info[subflow->backup].ratio = ratio;
-		}
+		data.contexts[data.subflows++] = subflow;
 	}
 	__mptcp_set_timeout(sk, tout);
 
-	/* pick the best backup if no other subflow is active */
-	if (!nr_active)
-		send_info[0].ssk = send_info[1].ssk;
+	i = msk->sched->get_subflow(msk, &data);
+	if (i < 0 || i >= data.subflows)
+		return NULL;
 
-	if (send_info[0].ssk) {
-		msk->last_snd = send_info[0].ssk;
-		msk->snd_burst = min_t(int, MPTCP_SEND_BURST_SIZE,
-				       tcp_sk(msk->last_snd)->snd_wnd);
-		return msk->last_snd;
-	}
+	msk->last_snd = mptcp_subflow_tcp_sock(data.contexts[i]);
+	return msk->last_snd;
+}
 
-	return NULL;
+/* Duplicate the data in [from, to) on all the active subflows but the last
+ * one used, for schedulers with MPTCP_SCHED_FLAG_REDUNDANT.
+ */
+static void __mptcp_push_redundant(struct sock *sk, u64 from, u64 to)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_sendmsg_info info = {};
+	struct mptcp_data_frag *dfrag;
+	int ret;
+
+	/* like __mptcp_retrans(), checksums want whole dfrags resent */
+	if (READ_ONCE(msk->csum_enabled))
+		return;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		int copied = 0;
+
+		if (ssk == msk->last_snd || subflow->backup ||
+		    !mptcp_subflow_active(subflow) ||
+		    !sk_stream_memory_free(ssk))
+			continue;
+
+		lock_sock(ssk);
+		list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+			if (!before64(dfrag->data_seq, to))
+				break;
+			if (!after64(dfrag->data_seq + dfrag->already_sent, from))
+				continue;
+
+			info.sent = after64(from, dfrag->data_seq) ?
+				    from - dfrag->data_seq : 0;
+			info.limit = min_t(u64, to - dfrag->data_seq,
+					   dfrag->already_sent);
+			while (info.sent < info.limit) {
+				ret = mptcp_sendmsg_frag(sk, ssk, dfrag, &info);
+				if (ret <= 0)
+					goto push;
+
+				info.sent += ret;
+				copied += ret;
+			}
+		}
+push:
+		if (copied) {
+			subflow->sched_bytes += copied;
+			subflow->redundant_bytes += copied;
+			tcp_push(ssk, 0, info.mss_now, tcp_sk(ssk)->nonagle,
+				 info.size_goal);
+		}
+		release_sock(ssk);
+	}
 }
 
 static void mptcp_push_release(struct sock *sk, struct sock *ssk,
@@ -1560,6 +1565,7 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 				.flags = flags,
 	};
 	struct mptcp_data_frag *dfrag;
+	u64 snd_nxt = msk->snd_nxt;
 	int len, copied = 0;
 
 	while ((dfrag = mptcp_send_head(sk))) {
@@ -1597,6 +1603,7 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 			info.sent += ret;
 			copied += ret;
 			len -= ret;
+			mptcp_subflow_ctx(ssk)->sched_bytes += ret;
 
 			mptcp_update_post_push(msk, dfrag, ret);
 		}
@@ -1608,6 +1615,10 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 		mptcp_push_release(sk, ssk, &info);
 
 out:
+	if (copied && (msk->sched->flags & MPTCP_SCHED_FLAG_REDUNDANT) &&
+	    after64(msk->snd_nxt, snd_nxt))
+		__mptcp_push_redundant(sk, snd_nxt, msk->snd_nxt);
+
 	/* ensure the rtx timer is running */
 	if (!mptcp_timer_pending(sk))
 		mptcp_reset_timer(sk);
@@ -1655,6 +1666,7 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 			copied += ret;
 			len -= ret;
 			first = false;
+			mptcp_subflow_ctx(ssk)->sched_bytes += ret;
 
 			mptcp_update_post_push(msk, dfrag, ret);
 		}
@@ -2506,6 +2518,7 @@ static int __mptcp_init_sock(struct sock *sk)
 	msk->timer_ival = TCP_RTO_MIN;
 
 	msk->first = NULL;
+	msk->sched = NULL;
 	inet_csk(sk)->icsk_sync_mss = mptcp_sync_mss;
 	WRITE_ONCE(msk->csum_enabled, mptcp_is_checksum_enabled(sock_net(sk)));
 	msk->recovery = false;
@@ -2549,6 +2562,8 @@ static int mptcp_init_sock(struct sock *sk)
 	tcp_cleanup_congestion_control(sk);
 	icsk->icsk_ca_ops = NULL;
 
+	mptcp_sched_assign(mptcp_sk(sk), mptcp_get_scheduler(net));
+
 	sk_sockets_allocated_inc(sk);
 	sk->sk_rcvbuf = READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_rmem[1]);
 	sk->sk_sndbuf = READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_wmem[1]);
@@ -2839,6 +2854,7 @@ struct sock *mptcp_sk_clone(const struct sock *sk,
 	__mptcp_init_sock(nsk);
 
 	msk = mptcp_sk(nsk);
+	mptcp_sched_init_sock(msk, mptcp_sk(sk)->sched);
 	msk->local_key = subflow_req->local_key;
 	msk->token = subflow_req->token;
 	msk->subflow = NULL;
@@ -2951,6 +2967,7 @@ void mptcp_destroy_common(struct mptcp_sock *msk)
 	skb_rbtree_purge(&msk->out_of_order_queue);
 	mptcp_token_destroy(msk);
 	mptcp_pm_free_anno_list(msk);
+	mptcp_sched_release(msk);
 }
 
 static void mptcp_destroy(struct sock *sk)
@@ -2977,6 +2994,16 @@ void __mptcp_check_push(struct sock *sk, struct sock *ssk)
 	if (!mptcp_send_head(sk))
 		return;
 
+	/* the duplicates need the subflows locked in turn, which is only
+	 * possible from process context
+	 */
+	if (mptcp_sk(sk)->sched->flags & MPTCP_SCHED_FLAG_REDUNDANT) {
+		set_bit(MPTCP_PUSH_PENDING, &mptcp_sk(sk)->flags);
+		if (!sock_owned_by_user(sk))
+			mptcp_schedule_work(sk);
+		return;
+	}
+
 	if (!sock_owned_by_user(sk)) {
 		struct sock *xmit_ssk = mptcp_subflow_get_send(mptcp_sk(sk));
 
@@ -3574,6 +3601,7 @@ void __init mptcp_proto_init(void)
 
 	mptcp_subflow_init();
 	mptcp_pm_init();
+	mptcp_sched_init();
 	mptcp_token_init();
 
 	if (proto_register(&mptcp_prot, 1) != 0)
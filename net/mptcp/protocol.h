@@ -271,6 +271,7 @@ struct mptcp_sock {
 
 	u32 setsockopt_seq;
 	char		ca_name[TCP_CA_NAME_MAX];
+	struct mptcp_sched_ops	*sched;
 };
 
 #define mptcp_lock_sock(___sk, cb) do {					\
@@ -457,6 +458,9 @@ struct mptcp_subflow_context {
 	u32	setsockopt_seq;
 	u32	stale_rcv_tstamp;
 
+	u64	sched_bytes;	    /* data the packet scheduler sent here */
+	u64	redundant_bytes;    /* of which duplicated by a redundant one */
+
 	struct	sock *tcp_sock;	    /* tcp sk backpointer */
 	struct	sock *conn;	    /* parent mptcp_sock */
 	const	struct inet_connection_sock_af_ops *icsk_af_ops;
@@ -566,6 +570,7 @@ unsigned int mptcp_get_add_addr_timeout(const struct net *net);
 int mptcp_is_checksum_enabled(const struct net *net);
 int mptcp_allow_join_id0(const struct net *net);
 unsigned int mptcp_stale_loss_cnt(const struct net *net);
+const char *mptcp_get_scheduler(const struct net *net);
 void mptcp_subflow_fully_established(struct mptcp_subflow_context *subflow,
 				     struct mptcp_options_received *mp_opt);
 bool __mptcp_retransmit_pending_data(struct sock *sk);
@@ -604,6 +609,12 @@ void mptcp_subflow_set_active(struct mptcp_subflow_context *subflow);
 
 bool mptcp_subflow_active(struct mptcp_subflow_context *subflow);
 
+void __init mptcp_sched_init(void);
+void mptcp_sched_assign(struct mptcp_sock *msk, const char *name);
+void mptcp_sched_init_sock(struct mptcp_sock *msk,
+			   struct mptcp_sched_ops *sched);
+void mptcp_sched_release(struct mptcp_sock *msk);
+
 static inline void mptcp_subflow_tcp_fallback(struct sock *sk,
 					      struct mptcp_subflow_context *ctx)
 {
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Packet schedulers, picking the subflow the next chunk of data is sent on.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/bpf.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <net/ipv6.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+#include "protocol.h"
+
+#define MPTCP_SEND_BURST_SIZE		((1 << 16) - \
+					 sizeof(struct tcphdr) - \
+					 MAX_TCP_OPTION_SPACE - \
+					 sizeof(struct ipv6hdr) - \
+					 sizeof(struct frag_hdr))
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* pick the subflow with the lower wmem/wspace ratio, and keep sending on it
+ * for up to a burst
+ */
+static int mptcp_sched_default_get_subflow(struct mptcp_sock *msk,
+					   struct mptcp_sched_data *data)
+{
+	u64 best_ratio[2] = { U64_MAX, U64_MAX };
+	int i, best[2] = { -1, -1 };
+	struct sock *ssk;
+	u64 ratio;
+	u32 pace;
+
+	/* re-use last subflow, if the burst allow that */
+	if (msk->last_snd && msk->snd_burst > 0) {
+		for (i = 0; i < data->subflows; i++)
+			if (mptcp_subflow_tcp_sock(data->contexts[i]) == msk->last_snd)
+				return i;
+	}
+
+	for (i = 0; i < data->subflows; i++) {
+		struct mptcp_subflow_context *subflow = data->contexts[i];
+
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		if (!tcp_sk(ssk)->snd_wnd)
+			continue;
+
+		pace = READ_ONCE(ssk->sk_pacing_rate);
+		if (!pace)
+			continue;
+
+		ratio = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32,
+				pace);
+		if (ratio < best_ratio[subflow->backup]) {
+			best[subflow->backup] = i;
+			best_ratio[subflow->backup] = ratio;
+		}
+	}
+
+	/* pick the best backup if no other subflow is active */
+	if (!data->nr_active)
+		best[0] = best[1];
+
+	if (best[0] >= 0) {
+		ssk = mptcp_subflow_tcp_sock(data->contexts[best[0]]);
+		msk->snd_burst = min_t(int, MPTCP_SEND_BURST_SIZE,
+				       tcp_sk(ssk)->snd_wnd);
+	}
+
+	return best[0];
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+/* Send everything on the subflow picked by the default scheduler, and a
+ * copy on each of the other active subflows: the receiver keeps whichever
+ * arrives first.
+ */
+static struct mptcp_sched_ops mptcp_sched_redundant = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.name		= "redundant",
+	.owner		= THIS_MODULE,
+	.flags		= MPTCP_SCHED_FLAG_REDUNDANT,
+};
+
+/* latency first: the subflow with the lowest smoothed RTT, as long as it has
+ * room for more data
+ */
+static int mptcp_sched_rtt_min_get_subflow(struct mptcp_sock *msk,
+					   struct mptcp_sched_data *data)
+{
+	u32 best_rtt[2] = { U32_MAX, U32_MAX };
+	int i, best[2] = { -1, -1 };
+
+	for (i = 0; i < data->subflows; i++) {
+		struct mptcp_subflow_context *subflow = data->contexts[i];
+		const struct tcp_sock *tp;
+		u32 rtt;
+
+		tp = tcp_sk(mptcp_subflow_tcp_sock(subflow));
+		if (!tp->snd_wnd)
+			continue;
+
+		/* no RTT sample yet, only use it when there's nothing else */
+		rtt = READ_ONCE(tp->srtt_us) ? : U32_MAX;
+		if (best[subflow->backup] < 0 || rtt < best_rtt[subflow->backup]) {
+			best[subflow->backup] = i;
+			best_rtt[subflow->backup] = rtt;
+		}
+	}
+
+	if (!data->nr_active)
+		best[0] = best[1];
+
+	return best[0];
+}
+
+static struct mptcp_sched_ops mptcp_sched_rtt_min = {
+	.get_subflow	= mptcp_sched_rtt_min_get_subflow,
+	.name		= "rtt-min",
+	.owner		= THIS_MODULE,
+};
+
+/* Must be called with rcu read lock held */
+static struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_subflow || sched->flags & ~MPTCP_SCHED_FLAG_ALL)
+		return -EINVAL;
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_debug("%s registered", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+/* Sockets using @sched hold a reference on its owner, so it stays around
+ * until they are gone.
+ */
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* Wait for outstanding lookups to complete */
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+void mptcp_sched_init_sock(struct mptcp_sock *msk,
+			   struct mptcp_sched_ops *sched)
+{
+	if (!sched || !bpf_try_module_get(sched, sched->owner))
+		sched = &mptcp_sched_default;
+
+	msk->sched = sched;
+	if (sched->init)
+		sched->init(msk);
+}
+
+/* Use the scheduler called @name, or the default one if there's none */
+void mptcp_sched_assign(struct mptcp_sock *msk, const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+	if (sched && !bpf_try_module_get(sched, sched->owner))
+		sched = NULL;
+	rcu_read_unlock();
+
+	mptcp_sched_init_sock(msk, sched);
+	if (sched)
+		bpf_module_put(sched, sched->owner);
+}
+
+void mptcp_sched_release(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	msk->sched = NULL;
+	if (sched->release)
+		sched->release(msk);
+	bpf_module_put(sched, sched->owner);
+}
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_redundant);
+	mptcp_register_scheduler(&mptcp_sched_rtt_min);
+}
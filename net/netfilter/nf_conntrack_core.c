@@ -1169,6 +1169,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		return NF_ACCEPT;
 
 	zone = nf_ct_zone(ct);
+	max_chainlen = MIN_CHAINLEN + prandom_u32_max(MAX_CHAINLEN);
 	local_bh_disable();
 
 	do {
@@ -1212,7 +1213,6 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		goto dying;
 	}
 
-	max_chainlen = MIN_CHAINLEN + prandom_u32_max(MAX_CHAINLEN);
 	/* See if there's one in the list already, including reverse:
 	   NAT could have grabbed it without realizing, since we're
 	   not in the hash.  If there is, we lost race. */
@@ -1341,6 +1341,12 @@ EXPORT_SYMBOL_GPL(nf_conntrack_tuple_taken);
 
 #define NF_CT_EVICTION_RANGE	8
 
+/* Keep evicting over the eviction range until this many entries are gone, so
+ * that a burst of new connections hitting a full table doesn't need a scan
+ * for each allocation.
+ */
+#define NF_CT_EARLY_DROP_BATCH	8
+
 /* There's a small race here where we may free a just-assured
    connection.  Too bad: we're in trouble anyway. */
 static unsigned int early_drop_list(struct net *net,
@@ -1390,11 +1396,11 @@ static unsigned int early_drop_list(struct net *net,
 
 static noinline int early_drop(struct net *net, unsigned int hash)
 {
-	unsigned int i, bucket;
+	unsigned int i, bucket, drops = 0;
 
 	for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
 		struct hlist_nulls_head *ct_hash;
-		unsigned int hsize, drops;
+		unsigned int hsize;
 
 		rcu_read_lock();
 		nf_conntrack_get_ht(&ct_hash, &hsize);
@@ -1403,13 +1409,16 @@ static noinline int early_drop(struct net *net, unsigned int hash)
 		else
 			bucket = (bucket + 1) % hsize;
 
-		drops = early_drop_list(net, &ct_hash[bucket]);
+		drops += early_drop_list(net, &ct_hash[bucket]);
 		rcu_read_unlock();
 
-		if (drops) {
-			NF_CT_STAT_ADD_ATOMIC(net, early_drop, drops);
-			return true;
-		}
+		if (drops >= NF_CT_EARLY_DROP_BATCH)
+			break;
+	}
+
+	if (drops) {
+		NF_CT_STAT_ADD_ATOMIC(net, early_drop, drops);
+		return true;
 	}
 
 	return false;
@@ -1750,6 +1759,7 @@ init_conntrack(struct net *net, struct nf_conn *tmpl,
 	/* Now it is inserted into the unconfirmed list, set refcount to 1. */
 	refcount_set(&ct->ct_general.use, 1);
 	nf_ct_add_to_unconfirmed_list(ct);
+	raw_cpu_inc(cnet->stat->new);
 
 	local_bh_enable();
 
@@ -2577,6 +2587,7 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	list_for_each_entry(net, net_exit_list, exit_list) {
 		nf_conntrack_ecache_pernet_fini(net);
 		nf_conntrack_expect_pernet_fini(net);
+		free_percpu(nf_ct_pernet(net)->stat);
 		free_percpu(net->ct.stat);
 		free_percpu(net->ct.pcpu_lists);
 	}
@@ -2876,6 +2887,10 @@ int nf_conntrack_init_net(struct net *net)
 	if (!net->ct.stat)
 		goto err_pcpu_lists;
 
+	cnet->stat = alloc_percpu(struct nf_conntrack_net_stat);
+	if (!cnet->stat)
+		goto err_cnet_stat;
+
 	ret = nf_conntrack_expect_pernet_init(net);
 	if (ret < 0)
 		goto err_expect;
@@ -2889,6 +2904,8 @@ int nf_conntrack_init_net(struct net *net)
 	return 0;
 
 err_expect:
+	free_percpu(cnet->stat);
+err_cnet_stat:
 	free_percpu(net->ct.stat);
 err_pcpu_lists:
 	free_percpu(net->ct.pcpu_lists);
@@ -2509,7 +2509,8 @@ static int ctnetlink_new_conntrack(struct sk_buff *skb,
 
 static int
 ctnetlink_ct_stat_cpu_fill_info(struct sk_buff *skb, u32 portid, u32 seq,
-				__u16 cpu, const struct ip_conntrack_stat *st)
+				__u16 cpu, const struct ip_conntrack_stat *st,
+				const struct nf_conntrack_net_stat *cst)
 {
 	struct nlmsghdr *nlh;
 	unsigned int flags = portid ? NLM_F_MULTI : 0, event;
@@ -2522,6 +2523,7 @@ ctnetlink_ct_stat_cpu_fill_info(struct sk_buff *skb, u32 portid, u32 seq,
 		goto nlmsg_failure;
 
 	if (nla_put_be32(skb, CTA_STATS_FOUND, htonl(st->found)) ||
+	    nla_put_be32(skb, CTA_STATS_NEW, htonl(cst->new)) ||
 	    nla_put_be32(skb, CTA_STATS_INVALID, htonl(st->invalid)) ||
 	    nla_put_be32(skb, CTA_STATS_INSERT, htonl(st->insert)) ||
 	    nla_put_be32(skb, CTA_STATS_INSERT_FAILED,
@@ -2556,16 +2558,18 @@ ctnetlink_ct_stat_cpu_dump(struct sk_buff *skb, struct netlink_callback *cb)
 		return 0;
 
 	for (cpu = cb->args[0]; cpu < nr_cpu_ids; cpu++) {
+		const struct nf_conntrack_net_stat *cst;
 		const struct ip_conntrack_stat *st;
 
 		if (!cpu_possible(cpu))
 			continue;
 
 		st = per_cpu_ptr(net->ct.stat, cpu);
+		cst = per_cpu_ptr(nf_ct_pernet(net)->stat, cpu);
 		if (ctnetlink_ct_stat_cpu_fill_info(skb,
 						    NETLINK_CB(cb->skb).portid,
 						    cb->nlh->nlmsg_seq,
-						    cpu, st) < 0)
+						    cpu, st, cst) < 0)
 				break;
 	}
 	cb->args[0] = cpu;
@@ -3735,6 +3739,7 @@ ctnetlink_exp_stat_cpu_dump(struct sk_buff *skb, struct netlink_callback *cb)
 		return 0;
 
 	for (cpu = cb->args[0]; cpu < nr_cpu_ids; cpu++) {
+		const struct nf_conntrack_net_stat *cst;
 		const struct ip_conntrack_stat *st;
 
 		if (!cpu_possible(cpu))
@@ -428,6 +428,7 @@ static void ct_cpu_seq_stop(struct seq_file *seq, void *v)
 static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 {
 	struct net *net = seq_file_net(seq);
+	const struct nf_conntrack_net_stat *cst;
 	const struct ip_conntrack_stat *st = v;
 	unsigned int nr_conntracks;
 
@@ -437,13 +438,15 @@ static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 	}
 
 	nr_conntracks = nf_conntrack_count(net);
+	/* ct_cpu_seq_start() and ct_cpu_seq_next() leave cpu + 1 in *pos */
+	cst = per_cpu_ptr(nf_ct_pernet(net)->stat, seq->index - 1);
 
 	seq_printf(seq, "%08x  %08x %08x %08x %08x %08x %08x %08x "
 			"%08x %08x %08x %08x %08x  %08x %08x %08x %08x\n",
 		   nr_conntracks,
 		   st->clash_resolve,
 		   st->found,
-		   0,
+		   cst->new,
 		   st->invalid,
 		   0,
 		   0,
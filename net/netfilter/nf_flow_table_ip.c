@@ -137,29 +137,43 @@ static bool ip_has_options(unsigned int thoff)
 	return thoff != sizeof(struct iphdr);
 }
 
+/* The in-band headers were validated by nf_flow_skb_inner_proto() */
 static void nf_flow_tuple_encap(struct sk_buff *skb,
 				struct flow_offload_tuple *tuple)
 {
-	struct vlan_ethhdr *veth;
+	__be16 proto = skb->protocol;
 	struct pppoe_hdr *phdr;
+	struct vlan_hdr *vhdr;
+	u32 offset = 0;
 	int i = 0;
 
+	/* The forward path only knows the VLAN ID, not the priority */
 	if (skb_vlan_tag_present(skb)) {
-		tuple->encap[i].id = skb_vlan_tag_get(skb);
+		tuple->encap[i].id = skb_vlan_tag_get_id(skb);
 		tuple->encap[i].proto = skb->vlan_proto;
 		i++;
 	}
-	switch (skb->protocol) {
-	case htons(ETH_P_8021Q):
-		veth = (struct vlan_ethhdr *)skb_mac_header(skb);
-		tuple->encap[i].id = ntohs(veth->h_vlan_TCI);
-		tuple->encap[i].proto = skb->protocol;
-		break;
-	case htons(ETH_P_PPP_SES):
-		phdr = (struct pppoe_hdr *)skb_mac_header(skb);
-		tuple->encap[i].id = ntohs(phdr->sid);
-		tuple->encap[i].proto = skb->protocol;
-		break;
+	for (; i < NF_FLOW_TABLE_ENCAP_MAX; i++) {
+		switch (proto) {
+		case htons(ETH_P_8021Q):
+		case htons(ETH_P_8021AD):
+			vhdr = (struct vlan_hdr *)(skb->data + offset);
+			tuple->encap[i].id = ntohs(vhdr->h_vlan_TCI) &
+					     VLAN_VID_MASK;
+			tuple->encap[i].proto = proto;
+			proto = vhdr->h_vlan_encapsulated_proto;
+			offset += VLAN_HLEN;
+			break;
+		case htons(ETH_P_PPP_SES):
+			phdr = (struct pppoe_hdr *)(skb->data + offset);
+			tuple->encap[i].id = ntohs(phdr->sid);
+			tuple->encap[i].proto = proto;
+			proto = __nf_flow_pppoe_proto(phdr);
+			offset += PPPOE_SES_HLEN;
+			break;
+		default:
+			return;
+		}
 	}
 }
 
@@ -246,28 +260,10 @@ static unsigned int nf_flow_xmit_xfrm(struct sk_buff *skb,
 	return NF_STOLEN;
 }
 
-static bool nf_flow_skb_encap_protocol(const struct sk_buff *skb, __be16 proto,
+static bool nf_flow_skb_encap_protocol(struct sk_buff *skb, __be16 proto,
 				       u32 *offset)
 {
-	struct vlan_ethhdr *veth;
-
-	switch (skb->protocol) {
-	case htons(ETH_P_8021Q):
-		veth = (struct vlan_ethhdr *)skb_mac_header(skb);
-		if (veth->h_vlan_encapsulated_proto == proto) {
-			*offset += VLAN_HLEN;
-			return true;
-		}
-		break;
-	case htons(ETH_P_PPP_SES):
-		if (nf_flow_pppoe_proto(skb) == proto) {
-			*offset += PPPOE_SES_HLEN;
-			return true;
-		}
-		break;
-	}
-
-	return false;
+	return nf_flow_skb_inner_proto(skb, offset) == proto;
 }
 
 static void nf_flow_encap_pop(struct sk_buff *skb,
@@ -283,13 +279,15 @@ static void nf_flow_encap_pop(struct sk_buff *skb,
 		}
 		switch (skb->protocol) {
 		case htons(ETH_P_8021Q):
+		case htons(ETH_P_8021AD):
 			vlan_hdr = (struct vlan_hdr *)skb->data;
 			__skb_pull(skb, VLAN_HLEN);
 			vlan_set_encap_proto(skb, vlan_hdr);
 			skb_reset_network_header(skb);
 			break;
 		case htons(ETH_P_PPP_SES):
-			skb->protocol = nf_flow_pppoe_proto(skb);
+			skb->protocol = __nf_flow_pppoe_proto((struct pppoe_hdr *)
+							      skb->data);
 			skb_pull(skb, PPPOE_SES_HLEN);
 			skb_reset_network_header(skb);
 			break;
@@ -114,7 +114,7 @@ static int nf_flow_rule_match(struct nf_flow_match *match,
 	mask->meta.ingress_ifindex = 0xffffffff;
 
 	if (tuple->encap_num > 0 && !(tuple->in_vlan_ingress & BIT(0)) &&
-	    tuple->encap[0].proto == htons(ETH_P_8021Q)) {
+	    eth_type_vlan(tuple->encap[0].proto)) {
 		NF_FLOW_DISSECTOR(match, FLOW_DISSECTOR_KEY_VLAN, vlan);
 		nf_flow_rule_vlan_match(&key->vlan, &mask->vlan,
 					tuple->encap[0].id,
@@ -123,7 +123,7 @@ static int nf_flow_rule_match(struct nf_flow_match *match,
 	}
 
 	if (tuple->encap_num > 1 && !(tuple->in_vlan_ingress & BIT(1)) &&
-	    tuple->encap[1].proto == htons(ETH_P_8021Q)) {
+	    eth_type_vlan(tuple->encap[1].proto)) {
 		if (vlan_encap) {
 			NF_FLOW_DISSECTOR(match, FLOW_DISSECTOR_KEY_CVLAN,
 					  cvlan);
@@ -636,7 +636,7 @@ nf_flow_rule_route_common(struct net *net, const struct flow_offload *flow,
 		if (tuple->in_vlan_ingress & BIT(i))
 			continue;
 
-		if (tuple->encap[i].proto == htons(ETH_P_8021Q)) {
+		if (eth_type_vlan(tuple->encap[i].proto)) {
 			entry = flow_action_entry_next(flow_rule);
 			entry->id = FLOW_ACTION_VLAN_POP;
 		}
@@ -658,6 +658,7 @@ nf_flow_rule_route_common(struct net *net, const struct flow_offload *flow,
 			entry->pppoe.sid = other_tuple->encap[i].id;
 			break;
 		case htons(ETH_P_8021Q):
+		case htons(ETH_P_8021AD):
 			entry->id = FLOW_ACTION_VLAN_PUSH;
 			entry->vlan.vid = other_tuple->encap[i].id;
 			entry->vlan.proto = other_tuple->encap[i].proto;
@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: AVX-512 packet lookup routines
+ *
+ * Based on the AVX2 implementation, see nft_set_pipapo_avx2.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <linux/compiler.h>
+#include <asm/fpu/api.h>
+
+#include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_avx512.h"
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_AVX512_BITS		512
+#define NFT_PIPAPO_LONGS_PER_M512	(NFT_PIPAPO_AVX512_BITS / BITS_PER_LONG)
+
+/* Buckets are only guaranteed to be aligned to, and sized in multiples of,
+ * NFT_PIPAPO_ALIGN bytes, that is, half a ZMM register. Non-temporal loads
+ * can't be used as they need natural alignment, so we use unaligned loads,
+ * and the last chunk of a bucket is loaded and stored with the k1 write
+ * mask, which is set by NFT_PIPAPO_AVX512_MASK() before each chunk.
+ */
+#define NFT_PIPAPO_AVX512_MASK(mask)					\
+	asm volatile("kmovw %0, %%k1" : : "r" ((u32)(mask)))
+
+/* Load masked 512 bits from memory into ZMM register, zeroing masked words */
+#define NFT_PIPAPO_AVX512_LOAD(reg, loc)				\
+	asm volatile("vmovdqu64 %0, %%zmm" #reg "%{%%k1%}%{z%}"		\
+		     : : "m" (loc))
+
+/* Load a single lookup table bucket chunk given a bucket offset, in longs */
+#define NFT_PIPAPO_AVX512_BUCKET_LOAD(reg, lt, pos)			\
+	NFT_PIPAPO_AVX512_LOAD(reg, lt[(pos)])
+
+/* Bitwise AND of 64-bit words */
+#define NFT_PIPAPO_AVX512_AND(dst, a, b)				\
+	asm volatile("vpandq %zmm" #a ", %zmm" #b ", %zmm" #dst)
+
+/* Jump to label if @reg is zero: k2 gets a bit per non-zero 64-bit word */
+#define NFT_PIPAPO_AVX512_NOMATCH_GOTO(reg, label)			\
+	asm_volatile_goto("vptestmq %%zmm" #reg ", %%zmm" #reg ", %%k2;"\
+			  "kortestw %%k2, %%k2;"			\
+			  "je %l[" #label "]" : : : : label)
+
+/* Store masked 512 bits from ZMM register into memory. As with AVX2, stored
+ * matching results are used shortly after, so don't bypass the cache here.
+ */
+#define NFT_PIPAPO_AVX512_STORE(loc, reg)				\
+	asm volatile("vmovdqu64 %%zmm" #reg ", %0%{%%k1%}" : "=m" (loc))
+
+/* Zero out a complete ZMM register, @reg */
+#define NFT_PIPAPO_AVX512_ZERO(reg)					\
+	asm volatile("vpxorq %zmm" #reg ", %zmm" #reg ", %zmm" #reg)
+
+/* Current working bitmap index, toggled between field matches */
+static DEFINE_PER_CPU(bool, nft_pipapo_avx512_scratch_index);
+
+/**
+ * nft_pipapo_avx512_prepare() - Prepare before main algorithm body
+ *
+ * This zeroes out zmm15, which is later used whenever we need to clear a
+ * memory location, by storing its content into memory.
+ */
+static void nft_pipapo_avx512_prepare(void)
+{
+	NFT_PIPAPO_AVX512_ZERO(15);
+}
+
+/**
+ * nft_pipapo_avx512_refill() - Scan bitmap, select mapping table item, set bits
+ * @offset:	Start from given bitmap (equivalent to bucket) offset, in longs
+ * @map:	Bitmap to be scanned for set bits
+ * @dst:	Destination bitmap
+ * @mt:		Mapping table containing bit set specifiers
+ * @words:	Count of words to be scanned, up to NFT_PIPAPO_LONGS_PER_M512
+ * @last:	Return index of first set bit, if this is the last field
+ *
+ * See nft_pipapo_avx2_refill(): this scans up to eight words instead of four,
+ * as the last chunk of a bucket might be half of a ZMM register.
+ *
+ * This function doesn't actually use any AVX-512 instruction.
+ *
+ * Return: first set bit index if @last, index of first filled word otherwise.
+ */
+static int nft_pipapo_avx512_refill(int offset, unsigned long *map,
+				    unsigned long *dst,
+				    union nft_pipapo_map_bucket *mt,
+				    int words, bool last)
+{
+	int ret = -1, x;
+
+	for (x = 0; x < words; x++) {
+		while (map[x]) {
+			int r = __builtin_ctzl(map[x]);
+			int i = (offset + x) * BITS_PER_LONG + r;
+
+			if (last)
+				return i;
+
+			bitmap_set(dst, mt[i].to, mt[i].n);
+
+			if (ret == -1)
+				ret = mt[i].to;
+
+			map[x] &= ~(1UL << r);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * nft_pipapo_avx512_lookup_field() - AVX-512-based lookup for a single field
+ * @map:	Previous match result, used as initial bitmap
+ * @fill:	Destination bitmap to be filled with current match result
+ * @f:		Field, containing lookup and mapping tables
+ * @offset:	Ignore buckets before the given index, no bits are filled there
+ * @pkt:	Packet data, pointer to input nftables register
+ * @first:	If this is the first field, don't source previous result
+ * @last:	Last field: stop at the first match and return bit index
+ *
+ * Intersect, 512 bits at a time, the lookup table buckets selected by each
+ * group of packet bits, and the starting bitmap unless this is the first
+ * field. Then call nft_pipapo_avx512_refill() to generate the next working
+ * bitmap, @fill.
+ *
+ * Contrary to the AVX2 implementation, there's a single routine for all the
+ * field sizes: with large sets, cost is dominated by the bucket size rather
+ * than by the count of groups, and halving the count of iterations over
+ * buckets is what we're after.
+ *
+ * Return: -1 on no match, rule index of match if @last, otherwise first
+ * 512-bit chunk index to be checked next (i.e. first filled chunk).
+ */
+static int nft_pipapo_avx512_lookup_field(unsigned long *map,
+					  unsigned long *fill,
+					  struct nft_pipapo_field *f,
+					  int offset, const u8 *pkt,
+					  bool first, bool last)
+{
+	unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt), bsize = f->bsize;
+	int m512_size = DIV_ROUND_UP(bsize, NFT_PIPAPO_LONGS_PER_M512);
+	unsigned long pos[NFT_PIPAPO_MAX_BITS / NFT_PIPAPO_GROUP_BITS_LARGE_SET];
+	int i, g, b, ret = -1;
+
+	for (g = 0; g < f->groups; g++) {
+		u8 v;
+
+		if (f->bb == 8)
+			v = pkt[g];
+		else if (g % 2)
+			v = pkt[g / 2] & 0x0f;
+		else
+			v = pkt[g / 2] >> 4;
+		NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+		pos[g] = (g * NFT_PIPAPO_BUCKETS(f->bb) + v) * bsize;
+	}
+
+	lt += offset * NFT_PIPAPO_LONGS_PER_M512;
+	for (i = offset; i < m512_size; i++, lt += NFT_PIPAPO_LONGS_PER_M512) {
+		int i_ul = i * NFT_PIPAPO_LONGS_PER_M512;
+		int words = min_t(int, bsize - i_ul, NFT_PIPAPO_LONGS_PER_M512);
+
+		NFT_PIPAPO_AVX512_MASK(GENMASK(words - 1, 0));
+
+		if (first) {
+			NFT_PIPAPO_AVX512_BUCKET_LOAD(0, lt, pos[0]);
+			g = 1;
+		} else {
+			NFT_PIPAPO_AVX512_LOAD(0, map[i_ul]);
+			NFT_PIPAPO_AVX512_NOMATCH_GOTO(0, nothing);
+			g = 0;
+		}
+
+		/* Alternate two registers for bucket loads, so that a load
+		 * doesn't need to wait for the previous intersection.
+		 */
+		for (; g + 1 < f->groups; g += 2) {
+			NFT_PIPAPO_AVX512_BUCKET_LOAD(1, lt, pos[g]);
+			NFT_PIPAPO_AVX512_BUCKET_LOAD(2, lt, pos[g + 1]);
+			NFT_PIPAPO_AVX512_AND(3, 1, 2);
+			NFT_PIPAPO_AVX512_AND(0, 0, 3);
+		}
+		if (g < f->groups) {
+			NFT_PIPAPO_AVX512_BUCKET_LOAD(1, lt, pos[g]);
+			NFT_PIPAPO_AVX512_AND(0, 0, 1);
+		}
+
+		NFT_PIPAPO_AVX512_NOMATCH_GOTO(0, nomatch);
+		NFT_PIPAPO_AVX512_STORE(map[i_ul], 0);
+
+		b = nft_pipapo_avx512_refill(i_ul, &map[i_ul], fill, f->mt,
+					     words, last);
+		if (last)
+			return b;
+
+		if (unlikely(ret == -1))
+			ret = b / NFT_PIPAPO_AVX512_BITS;
+
+		continue;
+nomatch:
+		NFT_PIPAPO_AVX512_STORE(map[i_ul], 15);
+nothing:
+		;
+	}
+
+	return ret;
+}
+
+/**
+ * nft_pipapo_avx512_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * Return: true if set is compatible and AVX-512 available, false otherwise.
+ */
+bool nft_pipapo_avx512_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (!boot_cpu_has(X86_FEATURE_AVX512F) ||
+	    !cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+			       XFEATURE_MASK_AVX512, NULL))
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_avx512_lookup() - Lookup function for AVX-512 implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c, and
+ * nft_pipapo_avx2_lookup(), which this mirrors.
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_avx512_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned long *res, *fill, *scratch;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool map_index;
+	int i, ret = 0;
+
+	if (unlikely(!irq_fpu_usable()))
+		return nft_pipapo_lookup(net, set, key, ext);
+
+	m = rcu_dereference(priv->match);
+
+	/* This also protects access to all data related to scratch maps, see
+	 * nft_pipapo_avx2_lookup() for the MXCSR mask.
+	 */
+	kernel_fpu_begin_mask(0);
+
+	scratch = *raw_cpu_ptr(m->scratch_aligned);
+	if (unlikely(!scratch)) {
+		kernel_fpu_end();
+		return false;
+	}
+	map_index = raw_cpu_read(nft_pipapo_avx512_scratch_index);
+
+	res  = scratch + (map_index ? m->bsize_max : 0);
+	fill = scratch + (map_index ? 0 : m->bsize_max);
+
+	/* Starting map doesn't need to be set for this implementation */
+
+	nft_pipapo_avx512_prepare();
+
+next_match:
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1, first = !i;
+
+		ret = nft_pipapo_avx512_lookup_field(res, fill, f, ret, rp,
+						     first, last);
+		if (ret < 0)
+			goto out;
+
+		if (last) {
+			*ext = &f->mt[ret].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask))) {
+				ret = 0;
+				goto next_match;
+			}
+
+			goto out;
+		}
+
+		swap(res, fill);
+		rp += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+out:
+	if (i % 2)
+		raw_cpu_write(nft_pipapo_avx512_scratch_index, !map_index);
+	kernel_fpu_end();
+
+	return ret >= 0;
+}
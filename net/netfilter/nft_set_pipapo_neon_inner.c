@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON bucket intersection
+ *
+ * This file is built with NEON enabled and without kernel headers, see
+ * nft_set_pipapo_neon.c for the caller.
+ */
+
+#include <asm/neon-intrinsics.h>
+
+void nft_pipapo_neon_and_buckets(uint64_t *map, const uint64_t *lt,
+				 unsigned long bsize, const uint8_t *pkt,
+				 int groups, int bb);
+
+/* Largest field (16 bytes) split in 4-bit groups */
+#define NFT_PIPAPO_NEON_GROUPS_MAX	32
+
+/**
+ * nft_pipapo_neon_and_buckets() - Intersect buckets selected by packet data
+ * @map:	Starting bitmap, overwritten with the result
+ * @lt:		Lookup table for the field
+ * @bsize:	Size of each bucket in lookup table, in 64-bit words
+ * @pkt:	Packet data, pointer to the field in the input register
+ * @groups:	Amount of bit groups in field
+ * @bb:		Number of bits grouped together in lookup table buckets
+ *
+ * This is the equivalent of pipapo_and_field_buckets_4bit() and
+ * pipapo_and_field_buckets_8bit(), but it walks the bitmap once, 128 bits at a
+ * time, intersecting all the buckets for the current chunk in registers, and
+ * skipping chunks where the starting bitmap has no bits set.
+ */
+void nft_pipapo_neon_and_buckets(uint64_t *map, const uint64_t *lt,
+				 unsigned long bsize, const uint8_t *pkt,
+				 int groups, int bb)
+{
+	const uint64_t *b[NFT_PIPAPO_NEON_GROUPS_MAX];
+	unsigned long i;
+	int g;
+
+	for (g = 0; g < groups; g++) {
+		uint8_t v;
+
+		if (bb == 8)
+			v = pkt[g];
+		else if (g % 2)
+			v = pkt[g / 2] & 0x0f;
+		else
+			v = pkt[g / 2] >> 4;
+
+		b[g] = lt + ((unsigned long)g * (1UL << bb) + v) * bsize;
+	}
+
+	for (i = 0; i + 2 <= bsize; i += 2) {
+		uint64x2_t acc = vld1q_u64(map + i);
+
+		if (!(vgetq_lane_u64(acc, 0) | vgetq_lane_u64(acc, 1)))
+			continue;
+
+		for (g = 0; g + 1 < groups; g += 2)
+			acc = vandq_u64(acc, vandq_u64(vld1q_u64(b[g] + i),
+						       vld1q_u64(b[g + 1] + i)));
+		if (g < groups)
+			acc = vandq_u64(acc, vld1q_u64(b[g] + i));
+
+		vst1q_u64(map + i, acc);
+	}
+
+	/* Buckets are sized in longs, there might be a single word left */
+	if (i < bsize && map[i]) {
+		for (g = 0; g < groups; g++)
+			map[i] &= b[g][i];
+	}
+}
@@ -11,6 +11,9 @@
 #include <linux/rhashtable.h>
 #include <linux/workqueue.h>
 #include <linux/refcount.h>
+#include <linux/jhash.h>
+#include <linux/mutex.h>
+#include <linux/u64_stats_sync.h>
 
 #include <linux/if_ether.h>
 #include <linux/in6.h>
@@ -99,6 +102,29 @@ struct fl_flow_tmplt {
 	struct tcf_chain *chain;
 };
 
+/* Exact match cache in front of the per-mask lookups, enabled once a
+ * classifier instance has seen FL_CACHE_MIN_MASKS distinct masks. Entries
+ * are keyed by the packet key masked with the union of all masks, so one
+ * entry stands for the result of the whole mask walk. Any change to the
+ * filters bumps the generation, which invalidates all the entries.
+ */
+#define FL_CACHE_MIN_MASKS	8
+#define FL_CACHE_ENTRIES	128
+
+struct fl_cache_entry {
+	u64 gen;
+	const struct fl_flow_mask *umask;
+	struct cls_fl_filter *filter; /* NULL if nothing matched */
+	struct fl_flow_key key;
+};
+
+struct fl_cache {
+	struct u64_stats_sync syncp;
+	u64_stats_t hits;
+	u64_stats_t misses;
+	struct fl_cache_entry entries[FL_CACHE_ENTRIES];
+};
+
 struct cls_fl_head {
 	struct rhashtable ht;
 	spinlock_t masks_lock; /* Protect masks list */
@@ -106,6 +132,11 @@ struct cls_fl_head {
 	struct list_head hw_filters;
 	struct rcu_work rwork;
 	struct idr handle_idr;
+	struct fl_flow_mask __rcu *cache_mask; /* union of all masks */
+	struct fl_cache * __percpu *cache;
+	atomic64_t cache_gen;
+	struct mutex cache_lock; /* Protect cache_mask and cache setup */
+	unsigned int cache_nmasks;
 };
 
 struct cls_fl_filter {
@@ -306,40 +337,120 @@ static u16 fl_ct_info_to_flower_map[] = {
 					TCA_FLOWER_KEY_CT_FLAGS_NEW,
 };
 
-static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
-		       struct tcf_result *res)
+static void fl_skb_key(struct sk_buff *skb, struct fl_flow_mask *mask,
+		       struct fl_flow_key *skb_key, bool post_ct, u16 zone)
+{
+	flow_dissector_init_keys(&skb_key->control, &skb_key->basic);
+	fl_clear_masked_range(skb_key, mask);
+
+	skb_flow_dissect_meta(skb, &mask->dissector, skb_key);
+	/* skb_flow_dissect() does not set n_proto in case an unknown
+	 * protocol, so do it rather here.
+	 */
+	skb_key->basic.n_proto = skb_protocol(skb, false);
+	skb_flow_dissect_tunnel_info(skb, &mask->dissector, skb_key);
+	skb_flow_dissect_ct(skb, &mask->dissector, skb_key,
+			    fl_ct_info_to_flower_map,
+			    ARRAY_SIZE(fl_ct_info_to_flower_map),
+			    post_ct, zone);
+	skb_flow_dissect_hash(skb, &mask->dissector, skb_key);
+	skb_flow_dissect(skb, &mask->dissector, skb_key, 0);
+}
+
+static struct cls_fl_filter *fl_lookup_masks(struct cls_fl_head *head,
+					     struct sk_buff *skb,
+					     bool post_ct, u16 zone)
 {
-	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
-	bool post_ct = tc_skb_cb(skb)->post_ct;
-	u16 zone = tc_skb_cb(skb)->zone;
 	struct fl_flow_key skb_key;
 	struct fl_flow_mask *mask;
 	struct cls_fl_filter *f;
 
 	list_for_each_entry_rcu(mask, &head->masks, list) {
-		flow_dissector_init_keys(&skb_key.control, &skb_key.basic);
-		fl_clear_masked_range(&skb_key, mask);
-
-		skb_flow_dissect_meta(skb, &mask->dissector, &skb_key);
-		/* skb_flow_dissect() does not set n_proto in case an unknown
-		 * protocol, so do it rather here.
-		 */
-		skb_key.basic.n_proto = skb_protocol(skb, false);
-		skb_flow_dissect_tunnel_info(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect_ct(skb, &mask->dissector, &skb_key,
-				    fl_ct_info_to_flower_map,
-				    ARRAY_SIZE(fl_ct_info_to_flower_map),
-				    post_ct, zone);
-		skb_flow_dissect_hash(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect(skb, &mask->dissector, &skb_key, 0);
+		fl_skb_key(skb, mask, &skb_key, post_ct, zone);
 
 		f = fl_mask_lookup(mask, &skb_key);
-		if (f && !tc_skip_sw(f->flags)) {
-			*res = f->res;
-			return tcf_exts_exec(skb, &f->exts, res);
-		}
+		if (f && !tc_skip_sw(f->flags))
+			return f;
 	}
-	return -1;
+	return NULL;
+}
+
+/* Returns the cache entry of the packet, which on a miss is already keyed
+ * and only needs its filter to be set.
+ */
+static noinline_for_stack
+struct fl_cache_entry *fl_cache_get(struct cls_fl_head *head,
+				    struct fl_cache *cache,
+				    struct sk_buff *skb, bool post_ct,
+				    u16 zone, bool *hit)
+{
+	/* Pairs with smp_mb__before_atomic() in fl_cache_invalidate() */
+	u64 gen = atomic64_read_acquire(&head->cache_gen);
+	struct fl_flow_mask *umask = rcu_dereference_bh(head->cache_mask);
+	struct fl_cache_entry *ce;
+	struct fl_flow_key skb_key;
+	void *start;
+	u32 hash;
+
+	fl_skb_key(skb, umask, &skb_key, post_ct, zone);
+	fl_set_masked_key(&skb_key, &skb_key, umask);
+
+	start = fl_key_get_start(&skb_key, umask);
+	hash = jhash2(start, fl_mask_range(umask) / sizeof(u32), 0);
+	ce = &cache->entries[hash & (FL_CACHE_ENTRIES - 1)];
+
+	*hit = ce->gen == gen && ce->umask == umask &&
+	       !memcmp(fl_key_get_start(&ce->key, umask), start,
+		       fl_mask_range(umask));
+	if (!*hit) {
+		ce->gen = gen;
+		ce->umask = umask;
+		memcpy(fl_key_get_start(&ce->key, umask), start,
+		       fl_mask_range(umask));
+	}
+	return ce;
+}
+
+static struct cls_fl_filter *fl_cache_lookup(struct cls_fl_head *head,
+					     struct fl_cache *cache,
+					     struct sk_buff *skb,
+					     bool post_ct, u16 zone)
+{
+	struct fl_cache_entry *ce;
+	bool hit;
+
+	ce = fl_cache_get(head, cache, skb, post_ct, zone, &hit);
+
+	u64_stats_update_begin(&cache->syncp);
+	u64_stats_inc(hit ? &cache->hits : &cache->misses);
+	u64_stats_update_end(&cache->syncp);
+
+	if (!hit)
+		ce->filter = fl_lookup_masks(head, skb, post_ct, zone);
+	return ce->filter;
+}
+
+static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
+		       struct tcf_result *res)
+{
+	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
+	bool post_ct = tc_skb_cb(skb)->post_ct;
+	u16 zone = tc_skb_cb(skb)->zone;
+	struct fl_cache * __percpu *cache;
+	struct cls_fl_filter *f;
+
+	/* Pairs with smp_store_release() in fl_cache_add_mask() */
+	cache = smp_load_acquire(&head->cache);
+	if (cache)
+		f = fl_cache_lookup(head, *this_cpu_ptr(cache), skb, post_ct,
+				    zone);
+	else
+		f = fl_lookup_masks(head, skb, post_ct, zone);
+	if (!f)
+		return -1;
+
+	*res = f->res;
+	return tcf_exts_exec(skb, &f->exts, res);
 }
 
 static int fl_init(struct tcf_proto *tp)
@@ -352,6 +463,7 @@ static int fl_init(struct tcf_proto *tp)
 
 	spin_lock_init(&head->masks_lock);
 	INIT_LIST_HEAD_RCU(&head->masks);
+	mutex_init(&head->cache_lock);
 	INIT_LIST_HEAD(&head->hw_filters);
 	rcu_assign_pointer(tp->root, head);
 	idr_init(&head->handle_idr);
@@ -385,6 +497,48 @@ static void fl_uninit_mask_free_work(struct work_struct *work)
 	fl_mask_free(mask, false);
 }
 
+static void fl_cache_free(struct fl_cache * __percpu *cache)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kvfree(*per_cpu_ptr(cache, cpu));
+	free_percpu(cache);
+}
+
+static struct fl_cache * __percpu *fl_cache_alloc(void)
+{
+	struct fl_cache * __percpu *cache;
+	int cpu;
+
+	cache = alloc_percpu(*cache);
+	if (!cache)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		struct fl_cache *c;
+
+		c = kvzalloc_node(sizeof(*c), GFP_KERNEL, cpu_to_node(cpu));
+		if (!c) {
+			fl_cache_free(cache);
+			return NULL;
+		}
+		u64_stats_init(&c->syncp);
+		*per_cpu_ptr(cache, cpu) = c;
+	}
+
+	return cache;
+}
+
+/* Called once filter changes are visible to lookups, and before anything
+ * that went away is released.
+ */
+static void fl_cache_invalidate(struct cls_fl_head *head)
+{
+	smp_mb__before_atomic();
+	atomic64_inc(&head->cache_gen);
+}
+
 static bool fl_mask_put(struct cls_fl_head *head, struct fl_flow_mask *mask)
 {
 	if (!refcount_dec_and_test(&mask->refcnt))
@@ -555,6 +709,7 @@ static int __fl_delete(struct tcf_proto *tp, struct cls_fl_filter *f,
 	list_del_rcu(&f->list);
 	spin_unlock(&tp->lock);
 
+	fl_cache_invalidate(head);
 	*last = fl_mask_put(head, f->mask);
 	if (!tc_skip_hw(f->flags))
 		fl_hw_destroy_filter(tp, f, rtnl_held, extack);
@@ -570,6 +725,10 @@ static void fl_destroy_sleepable(struct work_struct *work)
 						struct cls_fl_head,
 						rwork);
 
+	if (head->cache)
+		fl_cache_free(head->cache);
+	kfree(rcu_dereference_protected(head->cache_mask, 1));
+	mutex_destroy(&head->cache_lock);
 	rhashtable_destroy(&head->ht);
 	kfree(head);
 	module_put(THIS_MODULE);
@@ -1826,6 +1985,50 @@ static void fl_init_dissector(struct flow_dissector *dissector,
 	skb_flow_dissector_init(dissector, keys, cnt);
 }
 
+/* Merge @mask into the key of the cache, before any filter using it can be
+ * looked up.
+ */
+static int fl_cache_add_mask(struct cls_fl_head *head,
+			     const struct fl_flow_mask *mask)
+{
+	const long *lmask = (const long *)&mask->key;
+	struct fl_cache * __percpu *cache;
+	struct fl_flow_mask *umask, *old;
+	long *lumask;
+	int i;
+
+	umask = kzalloc(sizeof(*umask), GFP_KERNEL);
+	if (!umask)
+		return -ENOMEM;
+
+	mutex_lock(&head->cache_lock);
+	old = rcu_dereference_protected(head->cache_mask,
+					lockdep_is_held(&head->cache_lock));
+	if (old)
+		umask->key = old->key;
+	lumask = (long *)&umask->key;
+	for (i = 0; i < sizeof(umask->key) / sizeof(long); i++)
+		lumask[i] |= lmask[i];
+	fl_mask_update_range(umask);
+	fl_init_dissector(&umask->dissector, &umask->key);
+	rcu_assign_pointer(head->cache_mask, umask);
+
+	head->cache_nmasks++;
+	if (!head->cache && head->cache_nmasks >= FL_CACHE_MIN_MASKS) {
+		/* The cache is an optimization, do without it on failure */
+		cache = fl_cache_alloc();
+		if (cache)
+			smp_store_release(&head->cache, cache);
+	}
+	mutex_unlock(&head->cache_lock);
+
+	fl_cache_invalidate(head);
+	if (old)
+		tcf_queue_work(&old->rwork, fl_uninit_mask_free_work);
+
+	return 0;
+}
+
 static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 					       struct fl_flow_mask *mask)
 {
@@ -1852,6 +2055,10 @@ static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 
 	INIT_LIST_HEAD_RCU(&newmask->filters);
 
+	err = fl_cache_add_mask(head, newmask);
+	if (err)
+		goto errout_destroy;
+
 	refcount_set(&newmask->refcnt, 1);
 	err = rhashtable_replace_fast(&head->ht, &mask->ht_node,
 				      &newmask->ht_node, mask_ht_params);
@@ -2107,6 +2314,7 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 
 		spin_unlock(&tp->lock);
 
+		fl_cache_invalidate(head);
 		fl_mask_put(head, fold->mask);
 		if (!tc_skip_hw(fold->flags))
 			fl_hw_destroy_filter(tp, fold, rtnl_held, NULL);
@@ -2142,6 +2350,8 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 		fnew->handle = handle;
 		list_add_tail_rcu(&fnew->list, &fnew->mask->filters);
 		spin_unlock(&tp->lock);
+
+		fl_cache_invalidate(head);
 	}
 
 	*arg = fnew;
@@ -2161,6 +2371,8 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 		rhashtable_remove_fast(&fnew->mask->ht, &fnew->ht_node,
 				       fnew->mask->filter_ht_params);
 errout_mask:
+	/* fnew may have been found by lookups while in the hashtable */
+	fl_cache_invalidate(head);
 	fl_mask_put(head, fnew->mask);
 errout:
 	__fl_put(fnew);
@@ -3059,6 +3271,40 @@ static int fl_dump_key(struct sk_buff *skb, struct net *net,
 	return -EMSGSIZE;
 }
 
+/* The cache is shared by all filters of the classifier instance */
+static int fl_dump_cache_stats(struct sk_buff *skb, struct cls_fl_head *head)
+{
+	struct fl_cache * __percpu *cache = smp_load_acquire(&head->cache);
+	u64 hits = 0, misses = 0;
+	int cpu;
+
+	if (!cache)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		const struct fl_cache *c = *per_cpu_ptr(cache, cpu);
+		unsigned int start;
+		u64 h, m;
+
+		do {
+			start = u64_stats_fetch_begin_irq(&c->syncp);
+			h = u64_stats_read(&c->hits);
+			m = u64_stats_read(&c->misses);
+		} while (u64_stats_fetch_retry_irq(&c->syncp, start));
+
+		hits += h;
+		misses += m;
+	}
+
+	if (nla_put_u64_64bit(skb, TCA_FLOWER_CACHE_HITS, hits,
+			      TCA_FLOWER_PAD) ||
+	    nla_put_u64_64bit(skb, TCA_FLOWER_CACHE_MISSES, misses,
+			      TCA_FLOWER_PAD))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
 static int fl_dump(struct net *net, struct tcf_proto *tp, void *fh,
 		   struct sk_buff *skb, struct tcmsg *t, bool rtnl_held)
 {
@@ -3100,6 +3346,9 @@ static int fl_dump(struct net *net, struct tcf_proto *tp, void *fh,
 	if (nla_put_u32(skb, TCA_FLOWER_IN_HW_COUNT, f->in_hw_count))
 		goto nla_put_failure;
 
+	if (fl_dump_cache_stats(skb, fl_head_dereference(tp)))
+		goto nla_put_failure;
+
 	if (tcf_exts_dump(skb, &f->exts))
 		goto nla_put_failure;
 
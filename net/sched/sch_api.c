@@ -183,6 +183,9 @@ int unregister_qdisc(struct Qdisc_ops *qops)
 	if (q) {
 		*qp = q->next;
 		q->next = NULL;
+		/* Only reachable for qdiscs not pinned by a module reference */
+		if (default_qdisc_ops == q)
+			default_qdisc_ops = &pfifo_fast_ops;
 		err = 0;
 	}
 	write_unlock(&qdisc_mod_lock);
@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * net/sched/sch_bpf.c	Queueing disciplines implemented in BPF
+ *
+ * A struct bpf_qdisc_ops registered through BPF struct_ops becomes a qdisc
+ * of its own. The packets stay in kernel owned FIFOs, the BPF program only
+ * picks the FIFO a packet is appended to and the FIFO served next, while
+ * departure times (skb->tstamp) are enforced here as in sch_fq.
+ */
+
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+#include <linux/filter.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/refcount.h>
+#include <linux/rtnetlink.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <net/bpf_qdisc.h>
+#include <net/pkt_sched.h>
+#include <net/sch_generic.h>
+
+#define BPF_QDISC_TIMER_SLACK	(10 * NSEC_PER_USEC)
+
+/*
+ * Created when a struct bpf_qdisc_ops is registered. Each qdisc instance
+ * holds a reference, as sch->ops points here until the instance is gone.
+ */
+struct bpf_qdisc {
+	struct Qdisc_ops	qops;
+	struct bpf_qdisc_ops	*ops;
+	struct list_head	list;
+	refcount_t		refcnt;
+	struct rcu_head		rcu;
+};
+
+struct bpf_qdisc_sched_data {
+	const struct bpf_qdisc_ops *ops;
+	struct qdisc_skb_head	*queues;
+	u32			nr_queues;
+	u32			rr;		/* next queue of round robin */
+	bool			ops_inited;
+	struct qdisc_watchdog	watchdog;
+	struct bpf_qdisc	*bq;
+};
+
+/* protected by RTNL */
+static LIST_HEAD(bpf_qdisc_list);
+
+static int bpf_qdisc_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			     struct sk_buff **to_free)
+{
+	struct bpf_qdisc_sched_data *q = qdisc_priv(sch);
+	s32 queue;
+
+	if (unlikely(sch->q.qlen >= sch->limit))
+		return qdisc_drop(skb, sch, to_free);
+
+	queue = q->ops->enqueue(skb, sch);
+	if (queue < 0 || queue >= q->nr_queues)
+		return qdisc_drop(skb, sch, to_free);
+
+	__qdisc_enqueue_tail(skb, &q->queues[queue]);
+	qdisc_qstats_backlog_inc(sch, skb);
+	sch->q.qlen++;
+	return NET_XMIT_SUCCESS;
+}
+
+/* Round robin over the queues whose head is due, returns -1 if there's none */
+static s32 bpf_qdisc_next_queue(struct bpf_qdisc_sched_data *q, u64 now)
+{
+	u64 next = U64_MAX;
+	struct sk_buff *skb;
+	u32 i, queue;
+
+	for (i = 0, queue = q->rr; i < q->nr_queues; i++) {
+		skb = q->queues[queue].head;
+		if (skb) {
+			if (skb->tstamp <= now) {
+				q->rr = queue + 1 < q->nr_queues ? queue + 1 : 0;
+				return queue;
+			}
+			next = min_t(u64, next, skb->tstamp);
+		}
+		if (++queue == q->nr_queues)
+			queue = 0;
+	}
+
+	if (next != U64_MAX)
+		qdisc_watchdog_schedule_range_ns(&q->watchdog, next,
+						 BPF_QDISC_TIMER_SLACK);
+	return -1;
+}
+
+static struct sk_buff *bpf_qdisc_dequeue(struct Qdisc *sch)
+{
+	struct bpf_qdisc_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+	u64 now;
+	s32 queue;
+
+	if (!sch->q.qlen)
+		return NULL;
+
+	now = ktime_get_ns();
+	if (q->ops->dequeue)
+		queue = q->ops->dequeue(sch);
+	else
+		queue = bpf_qdisc_next_queue(q, now);
+	if (queue < 0 || queue >= q->nr_queues)
+		return NULL;
+
+	skb = q->queues[queue].head;
+	if (!skb)
+		return NULL;
+
+	if (skb->tstamp > now) {
+		qdisc_watchdog_schedule_range_ns(&q->watchdog, skb->tstamp,
+						 BPF_QDISC_TIMER_SLACK);
+		return NULL;
+	}
+
+	skb = __qdisc_dequeue_head(&q->queues[queue]);
+	qdisc_qstats_backlog_dec(sch, skb);
+	qdisc_bstats_update(sch, skb);
+	sch->q.qlen--;
+	return skb;
+}
+
+static void bpf_qdisc_reset(struct Qdisc *sch)
+{
+	struct bpf_qdisc_sched_data *q = qdisc_priv(sch);
+	u32 i;
+
+	if (!q->queues)
+		return;
+
+	for (i = 0; i < q->nr_queues; i++)
+		__qdisc_reset_queue(&q->queues[i]);
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+	qdisc_watchdog_cancel(&q->watchdog);
+
+	if (q->ops_inited && q->ops->reset)
+		q->ops->reset(sch);
+}
+
+static void bpf_qdisc_put(struct bpf_qdisc *bq)
+{
+	/* qdisc_destroy() still looks at sch->ops after ->destroy() */
+	if (refcount_dec_and_test(&bq->refcnt))
+		kfree_rcu(bq, rcu);
+}
+
+static int bpf_qdisc_init(struct Qdisc *sch, struct nlattr *opt,
+			  struct netlink_ext_ack *extack)
+{
+	struct bpf_qdisc *bq = container_of(sch->ops, struct bpf_qdisc, qops);
+	struct bpf_qdisc_sched_data *q = qdisc_priv(sch);
+	int err;
+
+	qdisc_watchdog_init(&q->watchdog, sch);
+
+	if (opt) {
+		NL_SET_ERR_MSG(extack, "BPF qdiscs take no options");
+		return -EINVAL;
+	}
+
+	/* Unregistering takes RTNL, so does creating a qdisc */
+	ASSERT_RTNL();
+	if (!bpf_struct_ops_get(bq->ops))
+		return -ENODEV;
+	refcount_inc(&bq->refcnt);
+	q->bq = bq;
+	q->ops = bq->ops;
+	q->nr_queues = bq->ops->nr_queues;
+
+	q->queues = kvcalloc(q->nr_queues, sizeof(*q->queues), GFP_KERNEL);
+	if (!q->queues)
+		return -ENOMEM;
+
+	sch->limit = qdisc_dev(sch)->tx_queue_len ? : 1;
+
+	if (q->ops->init) {
+		err = q->ops->init(sch);
+		if (err)
+			return err;
+	}
+	q->ops_inited = true;
+	return 0;
+}
+
+static void bpf_qdisc_destroy(struct Qdisc *sch)
+{
+	struct bpf_qdisc_sched_data *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+	if (!q->bq)
+		return;
+
+	if (q->ops_inited && q->ops->destroy)
+		q->ops->destroy(sch);
+	kvfree(q->queues);
+	bpf_struct_ops_put(q->bq->ops);
+	bpf_qdisc_put(q->bq);
+}
+
+/*
+ * Functions the BPF qdisc can call
+ */
+
+static struct bpf_qdisc_sched_data *bpf_qdisc_priv(struct Qdisc *sch)
+{
+	/* @sch may be any qdisc the program found a pointer to */
+	if (sch->ops->enqueue != bpf_qdisc_enqueue)
+		return NULL;
+	return qdisc_priv(sch);
+}
+
+__diag_push();
+__diag_ignore(GCC, 8, "-Wmissing-prototypes",
+	      "Global functions as their definitions will be in vmlinux BTF");
+
+/**
+ * bpf_qdisc_qlen - number of packets on a queue
+ * @sch: the BPF qdisc
+ * @queue: index of the queue
+ *
+ * Return: the number of packets, 0 if @queue doesn't exist.
+ */
+u32 noinline bpf_qdisc_qlen(struct Qdisc *sch, u32 queue)
+{
+	struct bpf_qdisc_sched_data *q = bpf_qdisc_priv(sch);
+
+	if (!q || queue >= q->nr_queues)
+		return 0;
+	return q->queues[queue].qlen;
+}
+
+/**
+ * bpf_qdisc_head_tstamp - departure time of the head of a queue
+ * @sch: the BPF qdisc
+ * @queue: index of the queue
+ *
+ * Return: skb->tstamp of the first packet, U64_MAX if @queue is empty or
+ * doesn't exist.
+ */
+u64 noinline bpf_qdisc_head_tstamp(struct Qdisc *sch, u32 queue)
+{
+	struct bpf_qdisc_sched_data *q = bpf_qdisc_priv(sch);
+
+	if (!q || queue >= q->nr_queues || !q->queues[queue].head)
+		return U64_MAX;
+	return q->queues[queue].head->tstamp;
+}
+
+/**
+ * bpf_qdisc_watchdog_schedule - have the qdisc dequeued again later
+ * @sch: the BPF qdisc
+ * @expires: CLOCK_MONOTONIC time in ns
+ *
+ * For ops.dequeue() holding packets back, e.g. to enforce a rate.
+ */
+void noinline bpf_qdisc_watchdog_schedule(struct Qdisc *sch, u64 expires)
+{
+	struct bpf_qdisc_sched_data *q = bpf_qdisc_priv(sch);
+
+	if (q)
+		qdisc_watchdog_schedule_range_ns(&q->watchdog, expires,
+						 BPF_QDISC_TIMER_SLACK);
+}
+
+__diag_pop();
+
+BTF_SET_START(bpf_qdisc_kfunc_ids)
+BTF_ID(func, bpf_qdisc_qlen)
+BTF_ID(func, bpf_qdisc_head_tstamp)
+BTF_ID(func, bpf_qdisc_watchdog_schedule)
+BTF_SET_END(bpf_qdisc_kfunc_ids)
+
+/*
+ * BPF struct_ops
+ */
+
+/* "extern" is to avoid sparse warning.  It is only used in bpf_struct_ops.c. */
+extern struct bpf_struct_ops bpf_bpf_qdisc_ops;
+
+static const struct btf_type *sk_buff_type;
+
+static int bpf_qdisc_btf_init(struct btf *btf)
+{
+	s32 type_id;
+
+	type_id = btf_find_by_name_kind(btf, "sk_buff", BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	sk_buff_type = btf_type_by_id(btf, type_id);
+
+	return 0;
+}
+
+static bool bpf_qdisc_is_valid_access(int off, int size,
+				      enum bpf_access_type type,
+				      const struct bpf_prog *prog,
+				      struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off >= sizeof(__u64) * MAX_BPF_FUNC_ARGS)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+
+	return btf_ctx_access(off, size, type, prog, info);
+}
+
+static int bpf_qdisc_btf_struct_access(struct bpf_verifier_log *log,
+				       const struct btf *btf,
+				       const struct btf_type *t, int off,
+				       int size, enum bpf_access_type atype,
+				       u32 *next_btf_id)
+{
+	if (atype == BPF_READ)
+		return btf_struct_access(log, btf, t, off, size, atype, next_btf_id);
+
+	if (t == sk_buff_type &&
+	    off >= offsetof(struct sk_buff, tstamp) &&
+	    off + size <= offsetofend(struct sk_buff, tstamp))
+		return NOT_INIT;
+
+	bpf_log(log, "only skb->tstamp can be written\n");
+	return -EACCES;
+}
+
+static const struct bpf_func_proto *
+bpf_qdisc_get_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id);
+}
+
+static bool bpf_qdisc_check_kfunc_call(u32 kfunc_btf_id)
+{
+	return btf_id_set_contains(&bpf_qdisc_kfunc_ids, kfunc_btf_id);
+}
+
+static const struct bpf_verifier_ops bpf_qdisc_verifier_ops = {
+	.get_func_proto		= bpf_qdisc_get_func_proto,
+	.is_valid_access	= bpf_qdisc_is_valid_access,
+	.btf_struct_access	= bpf_qdisc_btf_struct_access,
+	.check_kfunc_call	= bpf_qdisc_check_kfunc_call,
+};
+
+static int bpf_qdisc_init_member(const struct btf_type *t,
+				 const struct btf_member *member,
+				 void *kdata, const void *udata)
+{
+	const struct bpf_qdisc_ops *uops = udata;
+	struct bpf_qdisc_ops *ops = kdata;
+	u32 moff;
+
+	moff = btf_member_bit_offset(t, member) / 8;
+	switch (moff) {
+	case offsetof(struct bpf_qdisc_ops, nr_queues):
+		if (uops->nr_queues > BPF_QDISC_MAX_QUEUES)
+			return -E2BIG;
+		ops->nr_queues = uops->nr_queues ? : 1;
+		return 1;
+	case offsetof(struct bpf_qdisc_ops, name):
+		if (bpf_obj_name_cpy(ops->name, uops->name,
+				     sizeof(ops->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	/* Function pointers are checked by bpf_qdisc_reg() */
+	return 0;
+}
+
+static int bpf_qdisc_reg(void *kdata)
+{
+	struct bpf_qdisc_ops *ops = kdata;
+	struct bpf_qdisc *bq;
+	int err;
+
+	if (!ops->enqueue)
+		return -EINVAL;
+
+	bq = kzalloc(sizeof(*bq), GFP_KERNEL);
+	if (!bq)
+		return -ENOMEM;
+
+	strscpy(bq->qops.id, ops->name, sizeof(bq->qops.id));
+	bq->qops.priv_size = sizeof(struct bpf_qdisc_sched_data);
+	bq->qops.enqueue = bpf_qdisc_enqueue;
+	bq->qops.dequeue = bpf_qdisc_dequeue;
+	bq->qops.peek = qdisc_peek_dequeued;
+	bq->qops.init = bpf_qdisc_init;
+	bq->qops.reset = bpf_qdisc_reset;
+	bq->qops.destroy = bpf_qdisc_destroy;
+	bq->ops = ops;
+	refcount_set(&bq->refcnt, 1);
+
+	rtnl_lock();
+	err = register_qdisc(&bq->qops);
+	if (!err)
+		list_add(&bq->list, &bpf_qdisc_list);
+	rtnl_unlock();
+
+	if (err)
+		kfree(bq);
+	return err;
+}
+
+static void bpf_qdisc_unreg(void *kdata)
+{
+	struct bpf_qdisc *bq;
+
+	rtnl_lock();
+	list_for_each_entry(bq, &bpf_qdisc_list, list) {
+		if (bq->ops == kdata) {
+			/* Existing instances keep running until destroyed */
+			list_del(&bq->list);
+			unregister_qdisc(&bq->qops);
+			bpf_qdisc_put(bq);
+			break;
+		}
+	}
+	rtnl_unlock();
+}
+
+struct bpf_struct_ops bpf_bpf_qdisc_ops = {
+	.verifier_ops = &bpf_qdisc_verifier_ops,
+	.reg = bpf_qdisc_reg,
+	.unreg = bpf_qdisc_unreg,
+	.init_member = bpf_qdisc_init_member,
+	.init = bpf_qdisc_btf_init,
+	.name = "bpf_qdisc_ops",
+};
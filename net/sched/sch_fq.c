@@ -23,6 +23,8 @@
  *     If non existent flow, create it, add it to the tree.
  *     Add skb to the per flow list of skb (fifo).
  *   - Use a special fifo for high prio packets
+ *   When lockless (TCQ_F_NOLOCK, root of a device queue), enqueue() only
+ *   stages packets on per cpu lists, and the above is done by dequeue().
  *
  *  dequeue() : serves flows in Round Robin
  *  Note : When a flow becomes empty, we do not immediately remove it from
@@ -133,6 +135,10 @@ struct fq_sched_data {
 
 	u32		timer_slack; /* hrtimer slack in ns */
 	struct qdisc_watchdog watchdog;
+
+	struct qdisc_skb_head __percpu *stage;	/* TCQ_F_NOLOCK enqueue */
+	cpumask_var_t	stage_mask;	/* cpus with packets in @stage */
+	atomic_long_t	stage_drops;	/* drops at enqueue, not in qstats yet */
 };
 
 /*
@@ -439,8 +445,11 @@ static bool fq_packet_beyond_horizon(const struct sk_buff *skb,
 	return unlikely((s64)skb->tstamp > (s64)(q->ktime_cache + q->horizon));
 }
 
-static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
-		      struct sk_buff **to_free)
+/* @staged: packet comes from fq_stage_flush(), time_to_send was already set
+ * at enqueue time if there's no EDT timestamp
+ */
+static int __fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			struct sk_buff **to_free, bool staged)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
 	struct fq_flow *f;
@@ -449,7 +458,9 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 		return qdisc_drop(skb, sch, to_free);
 
 	if (!skb->tstamp) {
-		fq_skb_cb(skb)->time_to_send = q->ktime_cache = ktime_get_ns();
+		if (!staged)
+			fq_skb_cb(skb)->time_to_send = q->ktime_cache =
+						       ktime_get_ns();
 	} else {
 		/* Check if packet timestamp is too far in the future.
 		 * Try first if our cached value, to avoid ktime_get_ns()
@@ -496,6 +507,85 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	return NET_XMIT_SUCCESS;
 }
 
+/* With TCQ_F_NOLOCK, enqueue runs concurrently on all cpus: packets are only
+ * stamped with their enqueue time and put on a per-cpu staging list. Flows,
+ * their rbtrees and qdisc statistics are only touched by fq_stage_flush(),
+ * under the qdisc seqlock at dequeue time, so pacing works as usual.
+ */
+static int fq_stage_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			    struct sk_buff **to_free)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	struct qdisc_skb_head *stage;
+	bool was_empty;
+
+	if (unlikely(READ_ONCE(sch->q.qlen) >= READ_ONCE(sch->limit))) {
+		atomic_long_inc(&q->stage_drops);
+		__qdisc_drop(skb, to_free);
+		return NET_XMIT_DROP;
+	}
+
+	if (!skb->tstamp)
+		fq_skb_cb(skb)->time_to_send = ktime_get_ns();
+
+	stage = this_cpu_ptr(q->stage);
+	spin_lock(&stage->lock);
+	was_empty = !stage->qlen;
+	__qdisc_enqueue_tail(skb, stage);
+	spin_unlock(&stage->lock);
+
+	if (was_empty)
+		cpumask_set_cpu(smp_processor_id(), q->stage_mask);
+
+	return NET_XMIT_SUCCESS;
+}
+
+static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+		      struct sk_buff **to_free)
+{
+	if (sch->flags & TCQ_F_NOLOCK)
+		return fq_stage_enqueue(skb, sch, to_free);
+
+	return __fq_enqueue(skb, sch, to_free, false);
+}
+
+/* Move staged packets to their flows, in batches, one cpu at a time */
+static void fq_stage_flush(struct Qdisc *sch)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb, *next, *to_free = NULL;
+	unsigned int qlen;
+	int cpu;
+
+	for_each_cpu(cpu, q->stage_mask) {
+		struct qdisc_skb_head *stage = per_cpu_ptr(q->stage, cpu);
+
+		cpumask_clear_cpu(cpu, q->stage_mask);
+		/* Clear the bit before looking at the list: if we miss a
+		 * packet, its producer saw an empty list and sets it again.
+		 */
+		smp_mb__after_atomic();
+
+		spin_lock(&stage->lock);
+		skb = stage->head;
+		qlen = stage->qlen;
+		qdisc_skb_head_init(stage);
+		spin_unlock(&stage->lock);
+
+		for (; qlen; qlen--, skb = next) {
+			next = skb->next;
+			skb_mark_not_on_list(skb);
+			__fq_enqueue(skb, sch, &to_free, true);
+		}
+	}
+
+	if (unlikely(atomic_long_read(&q->stage_drops)))
+		sch->qstats.drops += atomic_long_xchg(&q->stage_drops, 0);
+
+	if (unlikely(to_free))
+		kfree_skb_list(to_free);
+}
+
 static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 {
 	unsigned long sample;
@@ -523,7 +613,7 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 	}
 }
 
-static struct sk_buff *fq_dequeue(struct Qdisc *sch)
+static struct sk_buff *__fq_dequeue(struct Qdisc *sch)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
 	struct fq_flow_head *head;
@@ -643,6 +733,31 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 	return skb;
 }
 
+static struct sk_buff *fq_dequeue(struct Qdisc *sch)
+{
+	bool need_retry = sch->flags & TCQ_F_NOLOCK;
+	struct sk_buff *skb;
+
+retry:
+	fq_stage_flush(sch);
+	skb = __fq_dequeue(sch);
+	if (!skb && need_retry &&
+	    READ_ONCE(sch->state) & QDISC_STATE_NON_EMPTY) {
+		/* As in pfifo_fast_dequeue(), clear STATE_MISSED here, and
+		 * look at staged packets again afterwards.
+		 */
+		clear_bit(__QDISC_STATE_MISSED, &sch->state);
+		clear_bit(__QDISC_STATE_DRAINING, &sch->state);
+		smp_mb__after_atomic();
+
+		need_retry = false;
+
+		goto retry;
+	}
+
+	return skb;
+}
+
 static void fq_flow_purge(struct fq_flow *flow)
 {
 	struct rb_node *p = rb_first(&flow->t_root);
@@ -659,6 +774,25 @@ static void fq_flow_purge(struct fq_flow *flow)
 	flow->qlen = 0;
 }
 
+static void fq_stage_purge(struct fq_sched_data *q)
+{
+	int cpu;
+
+	if (!q->stage)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct qdisc_skb_head *stage = per_cpu_ptr(q->stage, cpu);
+
+		spin_lock_bh(&stage->lock);
+		rtnl_kfree_skbs(stage->head, stage->tail);
+		qdisc_skb_head_init(stage);
+		spin_unlock_bh(&stage->lock);
+	}
+	cpumask_clear(q->stage_mask);
+	atomic_long_set(&q->stage_drops, 0);
+}
+
 static void fq_reset(struct Qdisc *sch)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
@@ -670,6 +804,7 @@ static void fq_reset(struct Qdisc *sch)
 	sch->q.qlen = 0;
 	sch->qstats.backlog = 0;
 
+	fq_stage_purge(q);
 	fq_flow_purge(&q->internal);
 
 	if (!q->fq_root)
@@ -744,6 +879,29 @@ static void fq_free(void *addr)
 	kvfree(addr);
 }
 
+/* With TCQ_F_NOLOCK, dequeue runs under the qdisc seqlock and not under the
+ * root lock: changes to flows and parameters need to hold both.
+ */
+static void fq_tree_lock(struct Qdisc *sch)
+{
+	if (sch->flags & TCQ_F_NOLOCK)
+		spin_lock_bh(&sch->seqlock);
+	sch_tree_lock(sch);
+}
+
+static void fq_tree_unlock(struct Qdisc *sch)
+{
+	sch_tree_unlock(sch);
+	if (sch->flags & TCQ_F_NOLOCK) {
+		spin_unlock_bh(&sch->seqlock);
+
+		/* See qdisc_run_end() */
+		smp_mb();
+		if (test_bit(__QDISC_STATE_MISSED, &sch->state))
+			__netif_schedule(sch);
+	}
+}
+
 static int fq_resize(struct Qdisc *sch, u32 log)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
@@ -763,7 +921,7 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 	for (idx = 0; idx < (1U << log); idx++)
 		array[idx] = RB_ROOT;
 
-	sch_tree_lock(sch);
+	fq_tree_lock(sch);
 
 	old_fq_root = q->fq_root;
 	if (old_fq_root)
@@ -772,7 +930,7 @@ static int fq_resize(struct Qdisc *sch, u32 log)
 	q->fq_root = array;
 	q->fq_trees_log = log;
 
-	sch_tree_unlock(sch);
+	fq_tree_unlock(sch);
 
 	fq_free(old_fq_root);
 
@@ -816,7 +974,7 @@ static int fq_change(struct Qdisc *sch, struct nlattr *opt,
 	if (err < 0)
 		return err;
 
-	sch_tree_lock(sch);
+	fq_tree_lock(sch);
 
 	fq_log = q->fq_trees_log;
 
@@ -895,9 +1053,9 @@ static int fq_change(struct Qdisc *sch, struct nlattr *opt,
 
 	if (!err) {
 
-		sch_tree_unlock(sch);
+		fq_tree_unlock(sch);
 		err = fq_resize(sch, fq_log);
-		sch_tree_lock(sch);
+		fq_tree_lock(sch);
 	}
 	while (sch->q.qlen > sch->limit) {
 		struct sk_buff *skb = fq_dequeue(sch);
@@ -910,7 +1068,7 @@ static int fq_change(struct Qdisc *sch, struct nlattr *opt,
 	}
 	qdisc_tree_reduce_backlog(sch, drop_count, drop_len);
 
-	sch_tree_unlock(sch);
+	fq_tree_unlock(sch);
 	return err;
 }
 
@@ -921,13 +1079,30 @@ static void fq_destroy(struct Qdisc *sch)
 	fq_reset(sch);
 	fq_free(q->fq_root);
 	qdisc_watchdog_cancel(&q->watchdog);
+	free_percpu(q->stage);
+	free_cpumask_var(q->stage_mask);
 }
 
 static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 		   struct netlink_ext_ack *extack)
 {
 	struct fq_sched_data *q = qdisc_priv(sch);
-	int err;
+	int err, cpu;
+
+	if (!zalloc_cpumask_var(&q->stage_mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	q->stage = alloc_percpu(struct qdisc_skb_head);
+	if (!q->stage)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct qdisc_skb_head *stage = per_cpu_ptr(q->stage, cpu);
+
+		qdisc_skb_head_init(stage);
+		spin_lock_init(&stage->lock);
+	}
+	atomic_long_set(&q->stage_drops, 0);
 
 	sch->limit		= 10000;
 	q->flow_plimit		= 100;
@@ -1036,6 +1211,7 @@ static int fq_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 static struct Qdisc_ops fq_qdisc_ops __read_mostly = {
 	.id		=	"fq",
 	.priv_size	=	sizeof(struct fq_sched_data),
+	.static_flags	=	TCQ_F_NOLOCK,
 
 	.enqueue	=	fq_enqueue,
 	.dequeue	=	fq_dequeue,
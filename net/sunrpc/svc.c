@@ -480,7 +480,9 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 
 		pool->sp_id = i;
 		INIT_LIST_HEAD(&pool->sp_sockets);
+		init_llist_head(&pool->sp_xprts);
 		INIT_LIST_HEAD(&pool->sp_all_threads);
+		init_llist_head(&pool->sp_idle_threads);
 		spin_lock_init(&pool->sp_lock);
 	}
 
@@ -878,12 +880,90 @@ svc_rqst_free(struct svc_rqst *rqstp)
 }
 EXPORT_SYMBOL_GPL(svc_rqst_free);
 
+/*
+ * Threads about to sleep push themselves on pool->sp_idle_threads, RQ_IDLE
+ * telling whether rq_idle is on there. Entries are only ever taken off all
+ * at once with llist_del_all(), so that any number of wakers can do it
+ * concurrently and without a lock. An entry goes stale if its thread was
+ * woken by other means in the meantime: RQ_BUSY is set then.
+ */
+static void svc_pool_idle_putback(struct svc_pool *pool,
+				  struct llist_node *first)
+{
+	struct llist_node *last = first;
+
+	if (!first)
+		return;
+	while (last->next)
+		last = last->next;
+	llist_add_batch(first, last, &pool->sp_idle_threads);
+}
+
+/**
+ * svc_pool_wake_idle_thread - wake up an idle thread of a pool
+ * @pool: the pool to wake a thread in
+ *
+ * An idle thread has RQ_BUSY set by the time it is woken. If the caller
+ * queued work before, threads that are busy now find it before they sleep.
+ *
+ * Return: the thread woken, or NULL if none was idle.
+ */
+struct svc_rqst *svc_pool_wake_idle_thread(struct svc_pool *pool)
+{
+	struct llist_node *ln, *next;
+	struct svc_rqst *rqstp;
+
+	rcu_read_lock();
+	for (ln = llist_del_all(&pool->sp_idle_threads); ln; ln = next) {
+		rqstp = llist_entry(ln, struct svc_rqst, rq_idle);
+		next = ln->next;
+
+		/* the thread can list itself again from now on */
+		clear_bit(RQ_IDLE, &rqstp->rq_flags);
+		smp_mb__after_atomic();
+		if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
+			continue;
+
+		svc_pool_idle_putback(pool, next);
+		rqstp->rq_qtime = ktime_get();
+		wake_up_process(rqstp->rq_task);
+		rcu_read_unlock();
+		return rqstp;
+	}
+	rcu_read_unlock();
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(svc_pool_wake_idle_thread);
+
+/* Take @rqstp off the idle list, a waker may hold it right now */
+static void svc_rqst_forget_idle(struct svc_rqst *rqstp)
+{
+	struct svc_pool	*pool = rqstp->rq_pool;
+	struct llist_node *ln, *next;
+	LLIST_HEAD(others);
+
+	while (test_bit(RQ_IDLE, &rqstp->rq_flags)) {
+		for (ln = llist_del_all(&pool->sp_idle_threads); ln; ln = next) {
+			next = ln->next;
+			if (ln == &rqstp->rq_idle)
+				clear_bit(RQ_IDLE, &rqstp->rq_flags);
+			else
+				__llist_add(ln, &others);
+		}
+		svc_pool_idle_putback(pool, __llist_del_all(&others));
+		cond_resched();
+	}
+}
+
 void
 svc_exit_thread(struct svc_rqst *rqstp)
 {
 	struct svc_serv	*serv = rqstp->rq_server;
 	struct svc_pool	*pool = rqstp->rq_pool;
 
+	svc_rqst_forget_idle(rqstp);
+
 	spin_lock_bh(&pool->sp_lock);
 	pool->sp_nrthreads--;
 	if (!test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags))
@@ -46,6 +46,8 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	Transports are enqueued on svc_pool->sp_xprts without it, and
+ *	moved to svc_pool->sp_sockets under it by the threads.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	The "service mutex" protects svc_serv->sv_nrthread.
@@ -446,25 +448,15 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 
 	atomic_long_inc(&pool->sp_stats.packets);
 
-	spin_lock_bh(&pool->sp_lock);
-	list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-	pool->sp_stats.sockets_queued++;
-	spin_unlock_bh(&pool->sp_lock);
+	llist_add(&xprt->xpt_qnode, &pool->sp_xprts);
+	atomic_long_inc(&pool->sp_stats.sockets_queued);
 
 	/* find a thread for this xprt */
-	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
+	rqstp = svc_pool_wake_idle_thread(pool);
+	if (rqstp)
 		atomic_long_inc(&pool->sp_stats.threads_woken);
-		rqstp->rq_qtime = ktime_get();
-		wake_up_process(rqstp->rq_task);
-		goto out_unlock;
-	}
-	set_bit(SP_CONGESTED, &pool->sp_flags);
-	rqstp = NULL;
-out_unlock:
-	rcu_read_unlock();
+	else
+		set_bit(SP_CONGESTED, &pool->sp_flags);
 	put_cpu();
 	trace_svc_xprt_do_enqueue(xprt, rqstp);
 }
@@ -483,6 +475,25 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+static bool svc_pool_has_xprts(struct svc_pool *pool)
+{
+	return !list_empty(&pool->sp_sockets) || !llist_empty(&pool->sp_xprts);
+}
+
+/*
+ * Move the transports enqueued since last time to sp_sockets, oldest
+ * first. Caller holds sp_lock.
+ */
+static void svc_pool_splice_xprts(struct svc_pool *pool)
+{
+	struct llist_node *first = llist_del_all(&pool->sp_xprts);
+	struct svc_xprt *xprt, *next;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(xprt, next, first, xpt_qnode)
+		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
+}
+
 /*
  * Dequeue the first transport, if there is one.
  */
@@ -490,10 +501,12 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_pool_has_xprts(pool))
 		goto out;
 
 	spin_lock_bh(&pool->sp_lock);
+	if (list_empty(&pool->sp_sockets))
+		svc_pool_splice_xprts(pool);
 	if (likely(!list_empty(&pool->sp_sockets))) {
 		xprt = list_first_entry(&pool->sp_sockets,
 					struct svc_xprt, xpt_ready);
@@ -575,17 +588,11 @@ void svc_wake_up(struct svc_serv *serv)
 
 	pool = &serv->sv_pools[0];
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* skip any that aren't queued */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-		rcu_read_unlock();
-		wake_up_process(rqstp->rq_task);
+	rqstp = svc_pool_wake_idle_thread(pool);
+	if (rqstp) {
 		trace_svc_wake_up(rqstp->rq_task->pid);
 		return;
 	}
-	rcu_read_unlock();
 
 	/* No free entries available */
 	set_bit(SP_TASK_PENDING, &pool->sp_flags);
@@ -714,7 +721,7 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 		return false;
 
 	/* was a socket queued? */
-	if (!list_empty(&pool->sp_sockets))
+	if (svc_pool_has_xprts(pool))
 		return false;
 
 	/* are we shutting down? */
@@ -750,6 +757,12 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	clear_bit(RQ_BUSY, &rqstp->rq_flags);
 	smp_mb__after_atomic();
 
+	/* Unless still there from last time, so that enqueuers find us.
+	 * Either they see us there or we see what they queued.
+	 */
+	if (!test_and_set_bit(RQ_IDLE, &rqstp->rq_flags))
+		llist_add(&rqstp->rq_idle, &pool->sp_idle_threads);
+
 	if (likely(rqst_should_sleep(rqstp)))
 		time_left = schedule_timeout(timeout);
 	else
@@ -1105,6 +1118,7 @@ static struct svc_xprt *svc_dequeue_net(struct svc_serv *serv, struct net *net)
 		pool = &serv->sv_pools[i];
 
 		spin_lock_bh(&pool->sp_lock);
+		svc_pool_splice_xprts(pool);
 		list_for_each_entry_safe(xprt, tmp, &pool->sp_sockets, xpt_ready) {
 			if (xprt->xpt_net != net)
 				continue;
@@ -1431,7 +1445,7 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	seq_printf(m, "%u %lu %lu %lu %lu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
-		pool->sp_stats.sockets_queued,
+		(unsigned long)atomic_long_read(&pool->sp_stats.sockets_queued),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
 
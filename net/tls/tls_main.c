@@ -431,6 +431,35 @@ static int do_tls_getsockopt_conf(struct sock *sk, char __user *optval,
 	return rc;
 }
 
+static int do_tls_getsockopt_no_pad(struct sock *sk, char __user *optval,
+				    int __user *optlen)
+{
+	struct tls_context *ctx = tls_get_ctx(sk);
+	int value, len;
+	int rc = 0;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len != sizeof(value))
+		return -EINVAL;
+
+	lock_sock(sk);
+	if (ctx->prot_info.version == TLS_1_3_VERSION &&
+	    (ctx->rx_conf == TLS_SW || ctx->rx_conf == TLS_HW))
+		value = ctx->rx_no_pad;
+	else
+		rc = -EINVAL;
+	release_sock(sk);
+	if (rc)
+		return rc;
+
+	if (put_user(sizeof(value), optlen) ||
+	    copy_to_user(optval, &value, sizeof(value)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int do_tls_getsockopt(struct sock *sk, int optname,
 			     char __user *optval, int __user *optlen)
 {
@@ -442,6 +471,9 @@ static int do_tls_getsockopt(struct sock *sk, int optname,
 		rc = do_tls_getsockopt_conf(sk, optval, optlen,
 					    optname == TLS_TX);
 		break;
+	case TLS_RX_EXPECT_NO_PAD:
+		rc = do_tls_getsockopt_no_pad(sk, optval, optlen);
+		break;
 	default:
 		rc = -ENOPROTOOPT;
 		break;
@@ -461,9 +493,32 @@ static int tls_getsockopt(struct sock *sk, int level, int optname,
 	return do_tls_getsockopt(sk, optname, optval, optlen);
 }
 
+/* TLS 1.3 KeyUpdate. Device offload keeps the key in the NIC, which may
+ * still need the old one for retransmissions, or have processed records
+ * protected with the new one already, so only software contexts can do it.
+ */
+static int tls_update_key(struct sock *sk, struct tls_context *ctx,
+			  struct tls_crypto_info *crypto_info, int tx)
+{
+	int rc;
+
+	if ((tx ? ctx->tx_conf : ctx->rx_conf) != TLS_SW)
+		return -EOPNOTSUPP;
+
+	rc = tls_sw_update_key(sk, ctx, crypto_info, tx);
+	if (rc)
+		return rc;
+
+	TLS_INC_STATS(sock_net(sk), tx ? LINUX_MIB_TLSTXREKEYOK :
+					 LINUX_MIB_TLSRXREKEYOK);
+	return 0;
+}
+
 static int do_tls_setsockopt_conf(struct sock *sk, sockptr_t optval,
 				  unsigned int optlen, int tx)
 {
+	struct tls_crypto_info *old_crypto_info = NULL;
+	union tls_crypto_context new_crypto_info;
 	struct tls_crypto_info *crypto_info;
 	struct tls_crypto_info *alt_crypto_info;
 	struct tls_context *ctx = tls_get_ctx(sk);
@@ -484,10 +539,16 @@ static int do_tls_setsockopt_conf(struct sock *sk, sockptr_t optval,
 		alt_crypto_info = &ctx->crypto_send.info;
 	}
 
-	/* Currently we don't support set crypto info more than one time */
+	/* Setting crypto info again is only possible for TLS 1.3 key
+	 * updates, the new key is checked aside from the current one.
+	 */
 	if (TLS_CRYPTO_INFO_READY(crypto_info)) {
-		rc = -EBUSY;
-		goto out;
+		if (crypto_info->version != TLS_1_3_VERSION) {
+			rc = -EBUSY;
+			goto out;
+		}
+		old_crypto_info = crypto_info;
+		crypto_info = &new_crypto_info.info;
 	}
 
 	rc = copy_from_sockptr(crypto_info, optval, sizeof(*crypto_info));
@@ -503,6 +564,13 @@ static int do_tls_setsockopt_conf(struct sock *sk, sockptr_t optval,
 		goto err_crypto_info;
 	}
 
+	if (old_crypto_info &&
+	    (crypto_info->version != old_crypto_info->version ||
+	     crypto_info->cipher_type != old_crypto_info->cipher_type)) {
+		rc = -EINVAL;
+		goto err_crypto_info;
+	}
+
 	/* Ensure that TLS version and ciphers are same in both directions */
 	if (TLS_CRYPTO_INFO_READY(alt_crypto_info)) {
 		if (alt_crypto_info->version != crypto_info->version ||
@@ -544,6 +612,14 @@ static int do_tls_setsockopt_conf(struct sock *sk, sockptr_t optval,
 		goto err_crypto_info;
 	}
 
+	if (old_crypto_info) {
+		rc = tls_update_key(sk, ctx, crypto_info, tx);
+		if (!rc)
+			memcpy(old_crypto_info, crypto_info, optsize);
+		/* wipe the copy of the new key either way */
+		goto err_crypto_info;
+	}
+
 	if (tx) {
 		rc = tls_set_device_offload(sk, ctx);
 		conf = TLS_HW;
@@ -592,18 +668,55 @@ static int do_tls_setsockopt_conf(struct sock *sk, sockptr_t optval,
 	return rc;
 }
 
+static int do_tls_setsockopt_no_pad(struct sock *sk, sockptr_t optval,
+				    unsigned int optlen)
+{
+	struct tls_context *ctx = tls_get_ctx(sk);
+	u32 val;
+	int rc;
+
+	if (sockptr_is_null(optval) || optlen < sizeof(val))
+		return -EINVAL;
+
+	if (copy_from_sockptr(&val, optval, sizeof(val)))
+		return -EFAULT;
+
+	if (val > 1)
+		return -EINVAL;
+
+	rc = -EINVAL;
+	lock_sock(sk);
+	if (ctx->prot_info.version == TLS_1_3_VERSION &&
+	    (ctx->rx_conf == TLS_SW || ctx->rx_conf == TLS_HW)) {
+		ctx->rx_no_pad = val;
+		rc = 0;
+	}
+	release_sock(sk);
+
+	return rc;
+}
+
 static int do_tls_setsockopt(struct sock *sk, int optname, sockptr_t optval,
 			     unsigned int optlen)
 {
+	struct tls_context *ctx = tls_get_ctx(sk);
 	int rc = 0;
 
 	switch (optname) {
 	case TLS_TX:
 	case TLS_RX:
+		/* TX key updates push the open record, lock like sendmsg */
+		if (optname == TLS_TX)
+			mutex_lock(&ctx->tx_lock);
 		lock_sock(sk);
 		rc = do_tls_setsockopt_conf(sk, optval, optlen,
 					    optname == TLS_TX);
 		release_sock(sk);
+		if (optname == TLS_TX)
+			mutex_unlock(&ctx->tx_lock);
+		break;
+	case TLS_RX_EXPECT_NO_PAD:
+		rc = do_tls_setsockopt_no_pad(sk, optval, optlen);
 		break;
 	default:
 		rc = -ENOPROTOOPT;
@@ -840,6 +953,12 @@ static int tls_get_info(const struct sock *sk, struct sk_buff *skb)
 	if (err)
 		goto nla_failure;
 
+	if (ctx->rx_no_pad) {
+		err = nla_put_flag(skb, TLS_INFO_RX_NO_PAD);
+		if (err)
+			goto nla_failure;
+	}
+
 	rcu_read_unlock();
 	nla_nest_end(skb, start);
 	return 0;
@@ -859,6 +978,7 @@ static size_t tls_get_info_size(const struct sock *sk)
 		nla_total_size(sizeof(u16)) +	/* TLS_INFO_CIPHER */
 		nla_total_size(sizeof(u16)) +	/* TLS_INFO_RXCONF */
 		nla_total_size(sizeof(u16)) +	/* TLS_INFO_TXCONF */
+		nla_total_size(0) +		/* TLS_INFO_RX_NO_PAD */
 		0;
 
 	return size;
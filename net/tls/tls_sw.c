@@ -1427,7 +1427,8 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 
 	if (*zc && (out_iov || out_sg)) {
 		if (out_iov)
-			n_sgout = iov_iter_npages(out_iov, INT_MAX) + 1;
+			n_sgout = iov_iter_npages(out_iov, INT_MAX) + 1 +
+				  prot->tail_size;
 		else
 			n_sgout = sg_nents(out_sg);
 		n_sgin = skb_nsg(skb, rxm->offset + prot->prepend_size,
@@ -1511,11 +1512,20 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 			sg_set_buf(&sgout[0], aad, prot->aad_size);
 
 			*chunk = 0;
-			err = tls_setup_from_iter(sk, out_iov, data_len,
+			err = tls_setup_from_iter(sk, out_iov,
+						  data_len - prot->tail_size,
 						  &pages, chunk, &sgout[1],
-						  (n_sgout - 1));
+						  n_sgout - 1 - prot->tail_size);
 			if (err < 0)
 				goto fallback_to_reg_recv;
+
+			/* TLS 1.3 content type, see decrypt_skb_update() */
+			if (prot->tail_size) {
+				sg_unmark_end(&sgout[pages]);
+				sg_set_buf(&sgout[pages + 1], &ctx->tail,
+					   prot->tail_size);
+				sg_mark_end(&sgout[pages + 1]);
+			}
 		} else if (out_sg) {
 			memcpy(sgout, out_sg, n_sgout * sizeof(*sgout));
 		} else {
@@ -1543,6 +1553,33 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	return err;
 }
 
+/* The records following a TLS 1.3 KeyUpdate are protected with the next
+ * traffic secret, which only userspace can derive: stop decrypting until it
+ * installs the new key with TLS_RX.
+ */
+static void tls_check_key_update(struct sock *sk, struct tls_sw_context_rx *ctx,
+				 struct sk_buff *skb)
+{
+	struct strp_msg *rxm = strp_msg(skb);
+	u32 off = 0;
+	u8 hdr[4];
+
+	/* A KeyUpdate must be the last handshake message of its record */
+	while (off + sizeof(hdr) <= rxm->full_len) {
+		if (skb_copy_bits(skb, rxm->offset + off, hdr, sizeof(hdr)))
+			return;
+
+		if (hdr[0] == TLS_HANDSHAKE_KEYUPDATE) {
+			ctx->key_update_pending = 1;
+			TLS_INC_STATS(sock_net(sk),
+				      LINUX_MIB_TLSRXREKEYRECEIVED);
+			return;
+		}
+
+		off += sizeof(hdr) + (hdr[1] << 16 | hdr[2] << 8 | hdr[3]);
+	}
+}
+
 static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 			      struct iov_iter *dest, int *chunk, bool *zc,
 			      bool async)
@@ -1554,6 +1591,9 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 	int pad, err = 0;
 
 	if (!ctx->decrypted) {
+		if (unlikely(ctx->key_update_pending))
+			return -EKEYEXPIRED;
+
 		if (tls_ctx->rx_conf == TLS_HW) {
 			err = tls_device_decrypted(sk, tls_ctx, skb, rxm);
 			if (err < 0)
@@ -1573,19 +1613,44 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 						      LINUX_MIB_TLSDECRYPTERROR);
 				return err;
 			}
+
+			/* With TLS_RX_EXPECT_NO_PAD, TLS 1.3 records go to the
+			 * user buffer betting on unpadded data, with the
+			 * content type in ctx->tail. The ciphertext is still
+			 * in the skb: decrypt anything else there again.
+			 */
+			if (*zc && prot->tail_size &&
+			    ctx->tail != TLS_RECORD_TYPE_DATA) {
+				TLS_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TLSRXNOPADVIOL);
+				iov_iter_revert(dest, *chunk);
+				*zc = false;
+				err = decrypt_internal(sk, skb, NULL, NULL,
+						       chunk, zc, false);
+				if (err < 0)
+					return err;
+			}
 		} else {
 			*zc = false;
 		}
 
-		pad = padding_length(ctx, prot, skb);
-		if (pad < 0)
-			return pad;
+		if (*zc && prot->tail_size) {
+			ctx->control = ctx->tail;
+			pad = 0;
+		} else {
+			pad = padding_length(ctx, prot, skb);
+			if (pad < 0)
+				return pad;
+		}
 
 		rxm->full_len -= pad;
 		rxm->offset += prot->prepend_size;
 		rxm->full_len -= prot->overhead_size;
 		tls_advance_record_sn(sk, prot, &tls_ctx->rx);
 		ctx->decrypted = 1;
+		if (prot->version == TLS_1_3_VERSION &&
+		    ctx->control == TLS_RECORD_TYPE_HANDSHAKE)
+			tls_check_key_update(sk, ctx, skb);
 		ctx->saved_data_ready(sk);
 	} else {
 		*zc = false;
@@ -1796,6 +1861,12 @@ int tls_sw_recvmsg(struct sock *sk,
 		bool async_capable;
 		bool async = false;
 
+		/* Don't wait for records that can't be decrypted yet */
+		if (unlikely(ctx->key_update_pending) && !ctx->recv_pkt) {
+			err = -EKEYEXPIRED;
+			goto recv_end;
+		}
+
 		skb = tls_wait_data(sk, psock, flags & MSG_DONTWAIT, timeo, &err);
 		if (!skb) {
 			if (psock) {
@@ -1823,7 +1894,7 @@ int tls_sw_recvmsg(struct sock *sk,
 
 		if (to_decrypt <= len && !is_kvec && !is_peek &&
 		    ctx->control == TLS_RECORD_TYPE_DATA &&
-		    prot->version != TLS_1_3_VERSION &&
+		    (prot->version != TLS_1_3_VERSION || tls_ctx->rx_no_pad) &&
 		    !bpf_strp_enabled)
 			zc = true;
 
@@ -1835,6 +1906,8 @@ int tls_sw_recvmsg(struct sock *sk,
 
 		err = decrypt_skb_update(sk, skb, &msg->msg_iter,
 					 &chunk, &zc, async_capable);
+		if (err == -EKEYEXPIRED)
+			goto recv_end;
 		if (err < 0 && err != -EINPROGRESS) {
 			tls_err_abort(sk, -EBADMSG);
 			goto recv_end;
@@ -2007,12 +2080,19 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 	if (from_queue) {
 		skb = __skb_dequeue(&ctx->rx_list);
 	} else {
+		if (unlikely(ctx->key_update_pending) && !ctx->recv_pkt) {
+			err = -EKEYEXPIRED;
+			goto splice_read_end;
+		}
+
 		skb = tls_wait_data(sk, NULL, flags & SPLICE_F_NONBLOCK, timeo,
 				    &err);
 		if (!skb)
 			goto splice_read_end;
 
 		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc, false);
+		if (err == -EKEYEXPIRED)
+			goto splice_read_end;
 		if (err < 0) {
 			tls_err_abort(sk, -EBADMSG);
 			goto splice_read_end;
@@ -2551,3 +2631,109 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 out:
 	return rc;
 }
+
+/* Install the next TLS 1.3 traffic key of an already configured direction.
+ * Whatever was written so far is encrypted with the old key first.
+ */
+int tls_sw_update_key(struct sock *sk, struct tls_context *ctx,
+		      struct tls_crypto_info *crypto_info, int tx)
+{
+	struct tls_prot_info *prot = &ctx->prot_info;
+	char *iv, *rec_seq, *key, *salt;
+	struct cipher_context *cctx;
+	struct crypto_aead *aead;
+	size_t keysize;
+	int rc;
+
+	switch (crypto_info->cipher_type) {
+	case TLS_CIPHER_AES_GCM_128: {
+		struct tls12_crypto_info_aes_gcm_128 *info = (void *)crypto_info;
+
+		iv = info->iv;
+		rec_seq = info->rec_seq;
+		key = info->key;
+		salt = info->salt;
+		keysize = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+		break;
+	}
+	case TLS_CIPHER_AES_GCM_256: {
+		struct tls12_crypto_info_aes_gcm_256 *info = (void *)crypto_info;
+
+		iv = info->iv;
+		rec_seq = info->rec_seq;
+		key = info->key;
+		salt = info->salt;
+		keysize = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+		break;
+	}
+	case TLS_CIPHER_AES_CCM_128: {
+		struct tls12_crypto_info_aes_ccm_128 *info = (void *)crypto_info;
+
+		iv = info->iv;
+		rec_seq = info->rec_seq;
+		key = info->key;
+		salt = info->salt;
+		keysize = TLS_CIPHER_AES_CCM_128_KEY_SIZE;
+		break;
+	}
+	case TLS_CIPHER_CHACHA20_POLY1305: {
+		struct tls12_crypto_info_chacha20_poly1305 *info =
+			(void *)crypto_info;
+
+		iv = info->iv;
+		rec_seq = info->rec_seq;
+		key = info->key;
+		salt = info->salt;
+		keysize = TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+		break;
+	}
+	default:
+		return -EINVAL;
+	}
+
+	if (tx) {
+		struct tls_sw_context_tx *sw_ctx = tls_sw_ctx_tx(ctx);
+		int pending;
+
+		/* Close the open record, its data is from before the update */
+		if (tls_is_pending_open_record(ctx)) {
+			rc = ctx->push_pending_record(sk, MSG_DONTWAIT);
+			if (rc && rc != -EAGAIN)
+				return rc;
+		}
+		if (sw_ctx->open_rec && sw_ctx->open_rec->msg_plaintext.sg.size)
+			return -EBUSY;
+
+		/* Wait for pending encryptions using the old key */
+		spin_lock_bh(&sw_ctx->encrypt_compl_lock);
+		sw_ctx->async_notify = true;
+
+		pending = atomic_read(&sw_ctx->encrypt_pending);
+		spin_unlock_bh(&sw_ctx->encrypt_compl_lock);
+		if (pending)
+			crypto_wait_req(-EINPROGRESS, &sw_ctx->async_wait);
+		else
+			reinit_completion(&sw_ctx->async_wait.completion);
+
+		WRITE_ONCE(sw_ctx->async_notify, false);
+
+		aead = sw_ctx->aead_send;
+		cctx = &ctx->tx;
+	} else {
+		aead = tls_sw_ctx_rx(ctx)->aead_recv;
+		cctx = &ctx->rx;
+	}
+
+	rc = crypto_aead_setkey(aead, key, keysize);
+	if (rc)
+		return rc;
+
+	memcpy(cctx->iv, salt, prot->salt_size);
+	memcpy(cctx->iv + prot->salt_size, iv, prot->iv_size);
+	memcpy(cctx->rec_seq, rec_seq, prot->rec_seq_size);
+
+	if (!tx)
+		tls_sw_ctx_rx(ctx)->key_update_pending = 0;
+
+	return 0;
+}
@@ -1112,6 +1112,8 @@ struct kvm_ppc_resize_hpt {
 #define KVM_CAP_BINARY_STATS_FD 203
 #define KVM_CAP_EXIT_ON_EMULATION_FAILURE 204
 #define KVM_CAP_ARM_MTE 205
+#define KVM_CAP_DIRTY_LOG_RING_VCPU_RESET 206
+#define KVM_CAP_DIRTY_LOG_RING_WITH_BITMAP 207
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1929,6 +1931,17 @@ struct kvm_dirty_gfn {
 	__u64 offset;
 };
 
+/*
+ * The eventfd is signalled when the vcpu's dirty ring becomes soft full,
+ * i.e. when the vcpu is about to exit with KVM_EXIT_DIRTY_RING_FULL.
+ */
+#define KVM_DIRTY_RING_EVENTFD_FLAG_DEASSIGN	(1 << 0)
+
+struct kvm_dirty_ring_eventfd {
+	__s32 fd;
+	__u32 flags;
+};
+
 #define KVM_BUS_LOCK_DETECTION_OFF             (1 << 0)
 #define KVM_BUS_LOCK_DETECTION_EXIT            (1 << 1)
 
@@ -2007,4 +2020,8 @@ struct kvm_stats_desc {
 
 #define KVM_GET_STATS_FD  _IO(KVMIO,  0xce)
 
+/* Available with KVM_CAP_DIRTY_LOG_RING_VCPU_RESET */
+#define KVM_RESET_DIRTY_RING		_IO(KVMIO, 0xcf)
+#define KVM_DIRTY_RING_EVENTFD	_IOW(KVMIO,  0xd0, struct kvm_dirty_ring_eventfd)
+
 #endif /* __LINUX_KVM_H */
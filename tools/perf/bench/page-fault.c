@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page fault and mmap_lock scalability across the threads of one process:
+ *
+ *  page-fault ... fault in anonymous pages, zapping them again with
+ *                 MADV_DONTNEED once the whole region was touched
+ *  mmap       ... mmap() and munmap() small anonymous regions
+ *
+ * All the threads share the mm, so these mostly stress the mmap_lock, the
+ * page table locks and the page allocator.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/string2.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "sweep.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/kernel.h>
+
+static struct bench_sweep sweep = {
+	.runtime	= 5,
+	.affinity	= true,
+};
+static const char *size_str;
+static bool shared_region;
+static bool touch;
+
+static size_t page_size;
+static size_t region_size;
+
+/* the region of --shared-region, each thread faulting its own chunk */
+static void *shared_ptr;
+
+static const struct option fault_options[] = {
+	OPT_STRING('t', "threads", &sweep.threads_str, "list",
+		   "List of thread counts to run, e.g. 1,2,4-8 (default: nr CPUs)"),
+	OPT_UINTEGER('r', "runtime", &sweep.runtime, "Specify runtime per thread count (in seconds)"),
+	OPT_STRING('s', "size", &size_str, "16MB", "Size of the region of each thread"),
+	OPT_BOOLEAN('S', "shared-region", &shared_region,
+		    "Fault in chunks of a single mapping instead of one mapping per thread"),
+	OPT_BOOLEAN(0, "affinity", &sweep.affinity, "Pin each thread to a different CPU"),
+	OPT_END()
+};
+
+static const struct option mmap_options[] = {
+	OPT_STRING('t', "threads", &sweep.threads_str, "list",
+		   "List of thread counts to run, e.g. 1,2,4-8 (default: nr CPUs)"),
+	OPT_UINTEGER('r', "runtime", &sweep.runtime, "Specify runtime per thread count (in seconds)"),
+	OPT_STRING('s', "size", &size_str, "64KB", "Size of each mapping"),
+	OPT_BOOLEAN(0, "touch", &touch, "Fault in the first page of each mapping"),
+	OPT_BOOLEAN(0, "affinity", &sweep.affinity, "Pin each thread to a different CPU"),
+	OPT_END()
+};
+
+static const char * const bench_page_fault_usage[] = {
+	"perf bench mem page-fault <options>",
+	NULL
+};
+
+static const char * const bench_mmap_usage[] = {
+	"perf bench mem mmap <options>",
+	NULL
+};
+
+static int parse_size(const char *str, const char *def)
+{
+	s64 size = perf_atoll(str ?: def);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (size <= 0) {
+		fprintf(stderr, "Invalid size: %s\n", str);
+		return -EINVAL;
+	}
+	region_size = roundup((size_t)size, page_size);
+	return 0;
+}
+
+static int fault_setup(struct bench_worker *w)
+{
+	if (shared_region) {
+		w->priv = shared_ptr + w->idx * region_size;
+		return 0;
+	}
+
+	w->priv = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (w->priv == MAP_FAILED) {
+		w->priv = NULL;
+		return -errno;
+	}
+	return 0;
+}
+
+static void fault_run(struct bench_worker *w)
+{
+	char *region = w->priv;
+
+	while (!bench_sweep__done()) {
+		size_t off;
+
+		for (off = 0; off < region_size; off += page_size) {
+			region[off] = 1;
+			w->ops++;
+			if (bench_sweep__done())
+				return;
+		}
+		madvise(region, region_size, MADV_DONTNEED);
+	}
+}
+
+static void fault_teardown(struct bench_worker *w)
+{
+	if (!shared_region && w->priv)
+		munmap(w->priv, region_size);
+}
+
+static const struct bench_sweep_ops fault_ops = {
+	.setup		= fault_setup,
+	.run		= fault_run,
+	.teardown	= fault_teardown,
+};
+
+static void mmap_run(struct bench_worker *w)
+{
+	while (!bench_sweep__done()) {
+		char *p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			break;
+		if (touch)
+			p[0] = 1;
+		munmap(p, region_size);
+		w->ops++;
+	}
+}
+
+static const struct bench_sweep_ops mmap_ops = {
+	.run		= mmap_run,
+};
+
+int bench_mem_page_fault(int argc, const char **argv)
+{
+	unsigned int max_threads = 0;
+	int ret;
+
+	argc = parse_options(argc, argv, fault_options, bench_page_fault_usage, 0);
+	if (argc || !sweep.runtime)
+		usage_with_options(bench_page_fault_usage, fault_options);
+
+	if (parse_size(size_str, "16MB"))
+		return -EINVAL;
+	sweep.unit = "faults";
+
+	if (shared_region) {
+		/* sized for the largest point of the sweep, or one per CPU */
+		const char *p = sweep.threads_str;
+
+		while (p && *p) {
+			char *end;
+			unsigned long n = strtoul(p, &end, 10);
+
+			if (end == p)
+				break;
+			max_threads = max_t(unsigned int, max_threads, n);
+			p = *end ? end + 1 : end;
+		}
+		if (!max_threads)
+			max_threads = sysconf(_SC_NPROCESSORS_CONF);
+
+		shared_ptr = mmap(NULL, max_threads * region_size,
+				  PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (shared_ptr == MAP_FAILED) {
+			perror("mmap");
+			return -errno;
+		}
+	}
+
+	ret = bench_sweep__run(&sweep, &fault_ops);
+
+	if (shared_region)
+		munmap(shared_ptr, max_threads * region_size);
+	return ret;
+}
+
+int bench_mem_mmap(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, mmap_options, bench_mmap_usage, 0);
+	if (argc || !sweep.runtime)
+		usage_with_options(bench_mmap_usage, mmap_options);
+
+	if (parse_size(size_str, "64KB"))
+		return -EINVAL;
+	sweep.unit = "ops";
+
+	return bench_sweep__run(&sweep, &mmap_ops);
+}
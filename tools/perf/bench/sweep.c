@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Thread count sweeps shared by the kernel hot path benchmarks.
+ */
+#include "bench.h"
+#include "sweep.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+#include <linux/zalloc.h>
+#include <perf/cpumap.h>
+
+#include "../util/stat.h"
+
+volatile bool bench_sweep_done;
+
+/* workers check in once set up, then wait for everybody to start together */
+static pthread_mutex_t sweep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sweep_parent = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sweep_worker = PTHREAD_COND_INITIALIZER;
+static unsigned int sweep_ready;
+static bool sweep_go;
+
+struct sweep_thread {
+	struct bench_worker		w;
+	const struct bench_sweep_ops	*ops;
+	int				err;
+};
+
+static void *sweep_thread_fn(void *arg)
+{
+	struct sweep_thread *t = arg;
+	struct bench_worker *w = &t->w;
+
+	if (w->cpu >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(w->cpu, &cpuset);
+		t->err = -pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	}
+
+	if (!t->err && t->ops->setup)
+		t->err = t->ops->setup(w);
+
+	pthread_mutex_lock(&sweep_mutex);
+	sweep_ready++;
+	pthread_cond_signal(&sweep_parent);
+	while (!sweep_go)
+		pthread_cond_wait(&sweep_worker, &sweep_mutex);
+	pthread_mutex_unlock(&sweep_mutex);
+
+	if (!t->err)
+		t->ops->run(w);
+
+	if (t->ops->teardown)
+		t->ops->teardown(w);
+	return NULL;
+}
+
+/* "1,2,4-8" -> { 1, 2, 4, 5, 6, 7, 8 } */
+static int parse_threads(const char *str, unsigned int **counts, unsigned int *nr)
+{
+	const char *p = str;
+	unsigned int *array = NULL;
+	unsigned int n = 0;
+
+	while (*p) {
+		unsigned long start, end;
+		unsigned int *tmp;
+		char *endp;
+
+		start = strtoul(p, &endp, 10);
+		if (endp == p)
+			goto invalid;
+		end = start;
+		if (*endp == '-') {
+			p = endp + 1;
+			end = strtoul(p, &endp, 10);
+			if (endp == p)
+				goto invalid;
+		}
+		if (!start || end < start || end > UINT_MAX)
+			goto invalid;
+
+		tmp = realloc(array, (n + end - start + 1) * sizeof(*array));
+		if (!tmp) {
+			free(array);
+			return -ENOMEM;
+		}
+		array = tmp;
+		while (start <= end)
+			array[n++] = start++;
+
+		if (*endp == ',')
+			endp++;
+		else if (*endp)
+			goto invalid;
+		p = endp;
+	}
+
+	if (!n)
+		goto invalid;
+
+	*counts = array;
+	*nr = n;
+	return 0;
+
+invalid:
+	fprintf(stderr, "Invalid thread list: %s\n", str);
+	free(array);
+	return -EINVAL;
+}
+
+static void print_point(struct bench_sweep *sweep, unsigned int nr,
+			struct stats *stats, double total)
+{
+	double avg = avg_stats(stats);
+	double rel = rel_stddev_stats(stddev_stats(stats), avg);
+
+	if (bench_format == BENCH_FORMAT_SIMPLE) {
+		printf("%u,%.0f,%.0f,%.2f\n", nr, total, avg, rel);
+		return;
+	}
+
+	printf("%6u threads: %14.0f %s/sec, %12.0f %s/sec/thread (+- %.2f%%)\n",
+	       nr, total, sweep->unit, avg, sweep->unit, rel);
+}
+
+static int run_point(struct bench_sweep *sweep, const struct bench_sweep_ops *ops,
+		     struct perf_cpu_map *cpus, unsigned int nr)
+{
+	struct timeval start, end, runtime;
+	struct sweep_thread *threads;
+	struct stats stats;
+	double secs, total = 0;
+	unsigned int i, created;
+	int err = 0;
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	sweep_ready = 0;
+	sweep_go = false;
+	bench_sweep_done = false;
+
+	for (created = 0; created < nr; created++) {
+		struct sweep_thread *t = &threads[created];
+
+		t->w.idx = created;
+		t->w.cpu = sweep->affinity ? cpus->map[created % cpus->nr] : -1;
+		t->ops = ops;
+
+		err = -pthread_create(&t->w.thread, NULL, sweep_thread_fn, t);
+		if (err)
+			break;
+	}
+
+	pthread_mutex_lock(&sweep_mutex);
+	while (sweep_ready < created)
+		pthread_cond_wait(&sweep_parent, &sweep_mutex);
+	/* the ones which made it stop right away if some failed to start */
+	bench_sweep_done = created < nr;
+	sweep_go = true;
+	pthread_cond_broadcast(&sweep_worker);
+	pthread_mutex_unlock(&sweep_mutex);
+
+	if (created < nr) {
+		for (i = 0; i < created; i++)
+			pthread_join(threads[i].w.thread, NULL);
+		goto out;
+	}
+
+	gettimeofday(&start, NULL);
+	sleep(sweep->runtime);
+	bench_sweep_done = true;
+
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].w.thread, NULL);
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+	secs = runtime.tv_sec + runtime.tv_usec / (double)USEC_PER_SEC;
+
+	init_stats(&stats);
+	for (i = 0; i < nr; i++) {
+		if (threads[i].err) {
+			err = threads[i].err;
+			fprintf(stderr, "thread %u failed: %s\n", i, strerror(-err));
+			goto out;
+		}
+		update_stats(&stats, threads[i].w.ops / secs);
+		total += threads[i].w.ops / secs;
+	}
+
+	print_point(sweep, nr, &stats, total);
+out:
+	free(threads);
+	return err;
+}
+
+int bench_sweep__run(struct bench_sweep *sweep, const struct bench_sweep_ops *ops)
+{
+	struct perf_cpu_map *cpus;
+	unsigned int *counts = NULL;
+	unsigned int i, nr = 0;
+	int err;
+
+	cpus = perf_cpu_map__new(NULL);
+	if (!cpus)
+		return -ENOMEM;
+
+	if (sweep->threads_str) {
+		err = parse_threads(sweep->threads_str, &counts, &nr);
+		if (err)
+			goto out;
+	} else {
+		counts = malloc(sizeof(*counts));
+		if (!counts) {
+			err = -ENOMEM;
+			goto out;
+		}
+		counts[0] = cpus->nr;
+		nr = 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_SIMPLE)
+		printf("threads,%s/sec,%s/sec/thread,stddev%%\n",
+		       sweep->unit, sweep->unit);
+	else
+		printf("# %u secs per point, %s\n\n", sweep->runtime,
+		       sweep->affinity ? "threads pinned to CPUs" : "threads not pinned");
+
+	for (i = 0; i < nr; i++) {
+		err = run_point(sweep, ops, cpus, counts[i]);
+		if (err)
+			break;
+	}
+
+out:
+	free(counts);
+	perf_cpu_map__put(cpus);
+	return err;
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef BENCH_SWEEP_H
+#define BENCH_SWEEP_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <linux/types.h>
+
+/*
+ * Run the same per-thread loop for each thread count of a list like
+ * "1,2,4-8", each point for a fixed time, and report the rate of
+ * operations in total and per thread. With 'perf bench -f simple' each
+ * point is a single CSV line, so kernels can be compared by script.
+ */
+
+struct bench_worker {
+	pthread_t	thread;
+	unsigned int	idx;
+	int		cpu;		/* -1 when not pinned */
+	u64		ops;
+	void		*priv;
+};
+
+struct bench_sweep_ops {
+	/* called in the worker thread before the run starts, may fail */
+	int		(*setup)(struct bench_worker *w);
+	/* loop until bench_sweep__done(), accounting in w->ops */
+	void		(*run)(struct bench_worker *w);
+	void		(*teardown)(struct bench_worker *w);
+};
+
+struct bench_sweep {
+	const char	*threads_str;	/* list of thread counts, NULL for nr CPUs */
+	unsigned int	runtime;	/* seconds per point */
+	bool		affinity;	/* pin worker N to the Nth online CPU */
+	const char	*unit;		/* "ops", "faults", ... */
+};
+
+extern volatile bool bench_sweep_done;
+
+static inline bool bench_sweep__done(void)
+{
+	return bench_sweep_done;
+}
+
+int bench_sweep__run(struct bench_sweep *sweep, const struct bench_sweep_ops *ops);
+
+#endif /* BENCH_SWEEP_H */
@@ -0,0 +1,369 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * io_uring submission and completion throughput, per thread and per CPU:
+ *
+ *  nop  ... IORING_OP_NOP, the cost of the ring itself
+ *  read ... IORING_OP_READ of random blocks of a file
+ *
+ * Each thread has its own ring, kept full at --depth entries, and is
+ * pinned to its own CPU unless --no-affinity is given.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/string2.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "sweep.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter	426
+#endif
+
+struct uring {
+	int			fd;
+	unsigned int		entries;
+
+	unsigned int		*sq_tail;
+	unsigned int		*sq_mask;
+	unsigned int		*sq_array;
+	struct io_uring_sqe	*sqes;
+
+	unsigned int		*cq_head;
+	unsigned int		*cq_tail;
+	unsigned int		*cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	void			*sq_ptr, *cq_ptr;
+	size_t			sq_len, cq_len, sqes_len;
+};
+
+struct uring_worker {
+	struct uring		ring;
+	int			fd;		/* file for read, -1 for nop */
+	void			*bufs;
+	u64			seed;
+};
+
+static struct bench_sweep sweep = {
+	.runtime	= 5,
+	.affinity	= true,
+	.unit		= "IOPS",
+};
+static unsigned int depth = 32;
+static unsigned int block_size = 4096;
+static const char *file_name;
+static const char *size_str = "64MB";
+static bool direct;
+
+static u64 file_blocks;
+static char tmp_name[] = "/tmp/perf-bench-uring-XXXXXX";
+
+static const struct option nop_options[] = {
+	OPT_STRING('t', "threads", &sweep.threads_str, "list",
+		   "List of thread counts to run, e.g. 1,2,4-8 (default: nr CPUs)"),
+	OPT_UINTEGER('r', "runtime", &sweep.runtime, "Specify runtime per thread count (in seconds)"),
+	OPT_UINTEGER('d', "depth", &depth, "Specify ring depth, kept full"),
+	OPT_BOOLEAN(0, "affinity", &sweep.affinity, "Pin each thread to a different CPU"),
+	OPT_END()
+};
+
+static const struct option read_options[] = {
+	OPT_STRING('f', "file", &file_name, "file",
+		   "File to read (default: a sparse temporary file of --size)"),
+	OPT_STRING('s', "size", &size_str, "64MB",
+		   "Size of the temporary file"),
+	OPT_UINTEGER('b', "block-size", &block_size, "Specify read size"),
+	OPT_BOOLEAN(0, "direct", &direct, "Open the file with O_DIRECT"),
+	OPT_PARENT(nop_options)
+};
+
+static const char * const bench_uring_nop_usage[] = {
+	"perf bench uring nop <options>",
+	NULL
+};
+
+static const char * const bench_uring_read_usage[] = {
+	"perf bench uring read <options>",
+	NULL
+};
+
+static int uring_setup(struct uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	int err;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return -errno;
+
+	ring->entries = p.sq_entries;
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		err = -errno;
+		goto out_close;
+	}
+
+	ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	if (ring->cq_ptr == MAP_FAILED) {
+		err = -errno;
+		goto out_unmap_sq;
+	}
+
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		err = -errno;
+		goto out_unmap_cq;
+	}
+
+	ring->sq_tail = ring->sq_ptr + p.sq_off.tail;
+	ring->sq_mask = ring->sq_ptr + p.sq_off.ring_mask;
+	ring->sq_array = ring->sq_ptr + p.sq_off.array;
+	ring->cq_head = ring->cq_ptr + p.cq_off.head;
+	ring->cq_tail = ring->cq_ptr + p.cq_off.tail;
+	ring->cq_mask = ring->cq_ptr + p.cq_off.ring_mask;
+	ring->cqes = ring->cq_ptr + p.cq_off.cqes;
+	return 0;
+
+out_unmap_cq:
+	munmap(ring->cq_ptr, ring->cq_len);
+out_unmap_sq:
+	munmap(ring->sq_ptr, ring->sq_len);
+out_close:
+	close(ring->fd);
+	ring->sq_ptr = NULL;
+	return err;
+}
+
+static void uring_exit(struct uring *ring)
+{
+	munmap(ring->sqes, ring->sqes_len);
+	munmap(ring->cq_ptr, ring->cq_len);
+	munmap(ring->sq_ptr, ring->sq_len);
+	close(ring->fd);
+}
+
+/* the kernel moves the CQ tail, the head is ours */
+static unsigned int uring_reap(struct uring *ring, int *err)
+{
+	unsigned int head = *ring->cq_head;
+	unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned int nr = 0;
+
+	for (; head != tail; head++, nr++) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+		if (cqe->res < 0)
+			*err = cqe->res;
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return nr;
+}
+
+static u64 next_rand(u64 *seed)
+{
+	/* xorshift64 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+static void prep_sqe(struct uring_worker *uw, struct io_uring_sqe *sqe,
+		     unsigned int slot)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	if (uw->fd < 0) {
+		sqe->opcode = IORING_OP_NOP;
+		return;
+	}
+
+	/*
+	 * One buffer per SQ slot. Completions come in any order, so a slot
+	 * can be reused while an older read into it is still in flight, but
+	 * nobody looks at the data anyway.
+	 */
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = uw->fd;
+	sqe->addr = (unsigned long)(uw->bufs + (size_t)slot * block_size);
+	sqe->len = block_size;
+	sqe->off = (next_rand(&uw->seed) % file_blocks) * block_size;
+}
+
+static int uring_worker_setup(struct bench_worker *w, bool read)
+{
+	struct uring_worker *uw;
+	int err;
+
+	uw = zalloc(sizeof(*uw));
+	if (!uw)
+		return -ENOMEM;
+	uw->fd = -1;
+	uw->seed = 0x9e3779b97f4a7c15ULL * (w->idx + 1);
+	w->priv = uw;
+
+	err = uring_setup(&uw->ring, depth);
+	if (err)
+		return err;
+
+	if (!read)
+		return 0;
+
+	uw->fd = open(file_name, O_RDONLY | (direct ? O_DIRECT : 0));
+	if (uw->fd < 0)
+		return -errno;
+
+	err = posix_memalign(&uw->bufs, sysconf(_SC_PAGESIZE),
+			     (size_t)uw->ring.entries * block_size);
+	return -err;
+}
+
+static int uring_nop_setup(struct bench_worker *w)
+{
+	return uring_worker_setup(w, false);
+}
+
+static int uring_read_setup(struct bench_worker *w)
+{
+	return uring_worker_setup(w, true);
+}
+
+static void uring_run(struct bench_worker *w)
+{
+	struct uring_worker *uw = w->priv;
+	struct uring *ring = &uw->ring;
+	unsigned int inflight = 0;
+	unsigned int tail = *ring->sq_tail;
+	int err = 0;
+
+	while (!bench_sweep__done() && !err) {
+		unsigned int nr = ring->entries - inflight;
+		unsigned int i;
+		int ret;
+
+		for (i = 0; i < nr; i++, tail++) {
+			unsigned int idx = tail & *ring->sq_mask;
+
+			prep_sqe(uw, &ring->sqes[idx], idx);
+			ring->sq_array[idx] = idx;
+		}
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+		ret = syscall(__NR_io_uring_enter, ring->fd, nr, 1,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			err = -errno;
+			break;
+		}
+		inflight += nr;
+
+		nr = uring_reap(ring, &err);
+		inflight -= nr;
+		w->ops += nr;
+	}
+
+	if (err)
+		warnx("thread %u: %s", w->idx, strerror(-err));
+}
+
+static void uring_teardown(struct bench_worker *w)
+{
+	struct uring_worker *uw = w->priv;
+
+	if (!uw)
+		return;
+
+	if (uw->ring.sq_ptr)
+		uring_exit(&uw->ring);
+	if (uw->fd >= 0)
+		close(uw->fd);
+	free(uw->bufs);
+	zfree(&w->priv);
+}
+
+static const struct bench_sweep_ops uring_nop_ops = {
+	.setup		= uring_nop_setup,
+	.run		= uring_run,
+	.teardown	= uring_teardown,
+};
+
+static const struct bench_sweep_ops uring_read_ops = {
+	.setup		= uring_read_setup,
+	.run		= uring_run,
+	.teardown	= uring_teardown,
+};
+
+int bench_uring_nop(int argc, const char **argv)
+{
+	argc = parse_options(argc, argv, nop_options, bench_uring_nop_usage, 0);
+	if (argc || !depth || !sweep.runtime)
+		usage_with_options(bench_uring_nop_usage, nop_options);
+
+	return bench_sweep__run(&sweep, &uring_nop_ops);
+}
+
+int bench_uring_read(int argc, const char **argv)
+{
+	struct stat st;
+	int fd, ret;
+
+	argc = parse_options(argc, argv, read_options, bench_uring_read_usage, 0);
+	if (argc || !depth || !sweep.runtime || !block_size)
+		usage_with_options(bench_uring_read_usage, read_options);
+
+	if (!file_name) {
+		s64 size = perf_atoll(size_str);
+
+		if (size <= 0) {
+			fprintf(stderr, "Invalid size: %s\n", size_str);
+			return -EINVAL;
+		}
+
+		fd = mkstemp(tmp_name);
+		if (fd < 0 || ftruncate(fd, size) < 0)
+			err(EXIT_FAILURE, "can't create %s", tmp_name);
+		close(fd);
+		file_name = tmp_name;
+	}
+
+	if (stat(file_name, &st) < 0)
+		err(EXIT_FAILURE, "can't stat %s", file_name);
+
+	file_blocks = st.st_size / block_size;
+	if (!file_blocks) {
+		fprintf(stderr, "%s is smaller than a block\n", file_name);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = bench_sweep__run(&sweep, &uring_read_ops);
+out:
+	if (file_name == tmp_name)
+		unlink(tmp_name);
+	return ret;
+}
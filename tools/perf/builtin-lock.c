@@ -18,9 +18,14 @@
 #include "util/session.h"
 #include "util/tool.h"
 #include "util/data.h"
+#include "util/target.h"
+#include "util/machine.h"
+#include "util/lock-contention.h"
 
 #include <sys/types.h>
 #include <sys/prctl.h>
+#include <signal.h>
+#include <unistd.h>
 #include <semaphore.h>
 #include <pthread.h>
 #include <math.h>
@@ -30,6 +35,7 @@
 #include <linux/hash.h>
 #include <linux/kernel.h>
 #include <linux/zalloc.h>
+#include <linux/string.h>
 #include <linux/err.h>
 
 static struct perf_session *session;
@@ -43,35 +49,6 @@ static struct list_head lockhash_table[LOCKHASH_SIZE];
 #define __lockhashfn(key)	hash_long((unsigned long)key, LOCKHASH_BITS)
 #define lockhashentry(key)	(lockhash_table + __lockhashfn((key)))
 
-struct lock_stat {
-	struct list_head	hash_entry;
-	struct rb_node		rb;		/* used for sorting */
-
-	/*
-	 * FIXME: evsel__intval() returns u64,
-	 * so address of lockdep_map should be treated as 64bit.
-	 * Is there more better solution?
-	 */
-	void			*addr;		/* address of lockdep_map, used as ID */
-	char			*name;		/* for strcpy(), we cannot use const */
-
-	unsigned int		nr_acquire;
-	unsigned int		nr_acquired;
-	unsigned int		nr_contended;
-	unsigned int		nr_release;
-
-	unsigned int		nr_readlock;
-	unsigned int		nr_trylock;
-
-	/* these times are in nano sec. */
-	u64                     avg_wait_time;
-	u64			wait_time_total;
-	u64			wait_time_min;
-	u64			wait_time_max;
-
-	int			discard; /* flag of blacklist */
-};
-
 /*
  * States of lock_seq_stat
  *
@@ -315,7 +292,7 @@ static struct lock_stat *pop_from_result(void)
 	return container_of(node, struct lock_stat, rb);
 }
 
-static struct lock_stat *lock_stat_findnew(void *addr, const char *name)
+struct lock_stat *lock_stat_findnew(void *addr, const char *name)
 {
 	struct list_head *entry = lockhashentry(addr);
 	struct lock_stat *ret, *new;
@@ -754,6 +731,48 @@ static void print_result(void)
 	print_bad_events(bad, total);
 }
 
+static const char *get_type_str(struct lock_stat *st)
+{
+	switch (st->flags & ~LCB_F_PERCPU) {
+	case LCB_F_SPIN:
+		return "spinlock";
+	case LCB_F_SPIN | LCB_F_READ:
+		return "rwlock:R";
+	case LCB_F_SPIN | LCB_F_WRITE:
+		return "rwlock:W";
+	case LCB_F_READ:
+		return "rwsem:R";
+	case LCB_F_WRITE:
+		return "rwsem:W";
+	case LCB_F_MUTEX:
+	case LCB_F_MUTEX | LCB_F_SPIN:
+		return "mutex";
+	default:
+		return "unknown";
+	}
+}
+
+static void print_contention_result(struct lock_contention *con)
+{
+	struct lock_stat *st;
+
+	pr_info("%10s %12s %12s %12s  %-10s  %s\n\n", "contended",
+		"total wait", "max wait", "avg wait", "type",
+		con->aggr_by_addr ? "address" : "caller");
+
+	while ((st = pop_from_result())) {
+		pr_info("%10u ", st->nr_contended);
+		pr_info("%12" PRIu64 " ", st->wait_time_total);
+		pr_info("%12" PRIu64 " ", st->wait_time_max);
+		pr_info("%12" PRIu64 "  ", st->avg_wait_time);
+		pr_info("%-10s  %s\n", get_type_str(st), st->name);
+	}
+
+	if (con->lost)
+		pr_info("\n=== %lu contention(s) without a callstack ===\n",
+			con->lost);
+}
+
 static bool info_threads, info_map;
 
 static void dump_threads(void)
@@ -904,6 +923,104 @@ static int __cmd_report(bool display_info)
 	return err;
 }
 
+static struct target target;
+static bool contention_by_addr;
+static volatile int contention_done;
+
+static void contention_sig_handler(int sig __maybe_unused)
+{
+	contention_done = 1;
+}
+
+static int __cmd_contention(int argc, const char **argv)
+{
+	int err = -EINVAL;
+	struct lock_contention con = {
+		.target = &target,
+		.aggr_by_addr = contention_by_addr,
+	};
+
+#ifndef HAVE_BPF_SKEL
+	pr_err("perf lock contention needs perf built with BUILD_BPF_SKEL=1\n");
+	return -EOPNOTSUPP;
+#endif
+
+	if (!argc && target__none(&target))
+		target.system_wide = true;
+
+	err = target__validate(&target);
+	if (err) {
+		char errbuf[512];
+
+		target__strerror(&target, err, errbuf, sizeof(errbuf));
+		pr_err("%s\n", errbuf);
+		return -EINVAL;
+	}
+
+	if (select_key())
+		return -EINVAL;
+
+	signal(SIGINT, contention_sig_handler);
+	signal(SIGCHLD, contention_sig_handler);
+	signal(SIGTERM, contention_sig_handler);
+
+	symbol__init(NULL);
+
+	err = -ENOMEM;
+	con.machine = machine__new_host();
+	if (con.machine == NULL)
+		goto out_exit;
+
+	con.evlist = evlist__new();
+	if (con.evlist == NULL)
+		goto out_delete_machine;
+
+	err = evlist__create_maps(con.evlist, &target);
+	if (err < 0)
+		goto out_delete_evlist;
+
+	if (argc) {
+		err = evlist__prepare_workload(con.evlist, &target, argv,
+					       false, NULL);
+		if (err < 0)
+			goto out_delete_evlist;
+	}
+
+	err = lock_contention_prepare(&con);
+	if (err < 0)
+		goto out_delete_evlist;
+
+	lock_contention_start();
+	if (argc)
+		evlist__start_workload(con.evlist);
+
+	/* wait for the workload to exit or for the user to hit ^C */
+	while (!contention_done)
+		pause();
+
+	lock_contention_stop();
+
+	err = lock_contention_read(&con);
+	if (err < 0) {
+		pr_err("Failed to read lock contention data\n");
+		goto out_finish;
+	}
+
+	setup_pager();
+	sort_result();
+	print_contention_result(&con);
+
+out_finish:
+	lock_contention_finish();
+out_delete_evlist:
+	evlist__delete(con.evlist);
+out_delete_machine:
+	machine__delete(con.machine);
+out_exit:
+	symbol__exit();
+	return err;
+}
+
 static int __cmd_record(int argc, const char **argv)
 {
 	const char *record_args[] = {
@@ -972,12 +1089,28 @@ int cmd_lock(int argc, const char **argv)
 	OPT_PARENT(lock_options)
 	};
 
+	const struct option contention_options[] = {
+	OPT_STRING('k', "key", &sort_key, "wait_total",
+		    "key for sorting (contended / wait_total / wait_max / wait_min / avg_wait)"),
+	OPT_BOOLEAN('a', "all-cpus", &target.system_wide,
+		    "system-wide collection from all CPUs"),
+	OPT_STRING('C', "cpu", &target.cpu_list, "cpu",
+		    "list of cpus to monitor"),
+	OPT_STRING('p', "pid", &target.pid, "pid",
+		   "trace on existing process id"),
+	OPT_STRING(0, "tid", &target.tid, "tid",
+		   "trace on existing thread id (exclusive to --pid)"),
+	OPT_BOOLEAN('l', "lock-addr", &contention_by_addr,
+		    "aggregate by lock address instead of by caller"),
+	OPT_PARENT(lock_options)
+	};
+
 	const char * const info_usage[] = {
 		"perf lock info [<options>]",
 		NULL
 	};
 	const char *const lock_subcommands[] = { "record", "report", "script",
-						 "info", NULL };
+						 "info", "contention", NULL };
 	const char *lock_usage[] = {
 		NULL,
 		NULL
@@ -986,6 +1119,10 @@ int cmd_lock(int argc, const char **argv)
 		"perf lock report [<options>]",
 		NULL
 	};
+	const char * const contention_usage[] = {
+		"perf lock contention [<options>] [<command>]",
+		NULL
+	};
 	unsigned int i;
 	int rc = 0;
 
@@ -1021,6 +1158,11 @@ int cmd_lock(int argc, const char **argv)
 		/* recycling report_lock_ops */
 		trace_handler = &report_lock_ops;
 		rc = __cmd_report(true);
+	} else if (strlen(argv[0]) > 2 && strstarts("contention", argv[0])) {
+		sort_key = "wait_total";
+		argc = parse_options(argc, argv, contention_options,
+				     contention_usage, PARSE_OPT_STOP_AT_NON_OPTION);
+		rc = __cmd_contention(argc, argv);
 	} else {
 		usage_with_options(lock_usage, lock_options);
 	}
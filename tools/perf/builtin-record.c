@@ -51,6 +51,7 @@
 #include "util/evlist-hybrid.h"
 #include "asm/bug.h"
 #include "perf.h"
+#include <api/fd/array.h>
 
 #include <errno.h>
 #include <inttypes.h>
@@ -87,6 +88,38 @@ struct switch_output {
 	int		 cur_file;
 };
 
+enum record_threads_spec {
+	THREADS_SPEC__NONE,
+	THREADS_SPEC__CPU,
+	THREADS_SPEC__NUMA,
+};
+
+static const char *threads_spec_tags[] = {
+	"none", "cpu", "numa",
+};
+
+/*
+ * With --threads, each record_thread reads the mmaps of the CPUs in its
+ * mask into their own perf_data_file of the output directory. The first
+ * one is the main thread, which also takes care of the control fds.
+ */
+struct record_thread {
+	pthread_t		tid;
+	struct record		*rec;
+	int			key;		/* CPU or NUMA node */
+	struct mmap_cpu_mask	mask;
+	int			nr_mmaps;
+	struct mmap		**maps;
+	struct fdarray		pollfd;
+	int			ctlfd_pos;	/* evlist ctl_fd copy, main thread */
+	int			ctl_pipe[2];	/* stop request, other threads */
+	bool			running;
+	int			err;
+	unsigned long long	samples;
+	unsigned long		waking;
+	u64			bytes_written;
+};
+
 struct record {
 	struct perf_tool	tool;
 	struct record_opts	opts;
@@ -111,10 +144,15 @@ struct record {
 	unsigned long long	samples;
 	struct mmap_cpu_mask	affinity_mask;
 	unsigned long		output_max_size;	/* = 0: unlimited */
+	enum record_threads_spec threads_spec;
+	int			nr_threads;
+	struct record_thread	*thread_data;
 };
 
 static volatile int done;
 
+static __thread struct record_thread *thread;
+
 static volatile int auxtrace_record__snapshot_started;
 static DEFINE_TRIGGER(auxtrace_snapshot_trigger);
 static DEFINE_TRIGGER(switch_output_trigger);
@@ -123,6 +161,27 @@ static const char *affinity_tags[PERF_AFFINITY_MAX] = {
 	"SYS", "NODE", "CPU"
 };
 
+static bool record__threads_enabled(struct record *rec)
+{
+	return rec->threads_spec != THREADS_SPEC__NONE;
+}
+
+static u64 record__bytes_written(struct record *rec)
+{
+	u64 bytes_written = rec->bytes_written;
+	int t;
+
+	for (t = 0; t < rec->nr_threads; t++)
+		bytes_written += READ_ONCE(rec->thread_data[t].bytes_written);
+
+	return bytes_written;
+}
+
+static unsigned long long record__samples(struct record *rec)
+{
+	return thread ? thread->samples : rec->samples;
+}
+
 static bool switch_output_signal(struct record *rec)
 {
 	return rec->switch_output.signal &&
@@ -145,25 +204,31 @@ static bool switch_output_time(struct record *rec)
 static bool record__output_max_size_exceeded(struct record *rec)
 {
 	return rec->output_max_size &&
-	       (rec->bytes_written >= rec->output_max_size);
+	       (record__bytes_written(rec) >= rec->output_max_size);
 }
 
-static int record__write(struct record *rec, struct mmap *map __maybe_unused,
+static int record__write(struct record *rec, struct mmap *map,
 			 void *bf, size_t size)
 {
 	struct perf_data_file *file = &rec->session->data->file;
 
+	if (map && map->file)
+		file = map->file;
+
 	if (perf_data_file__write(file, bf, size) < 0) {
 		pr_err("failed to write perf data, error: %m\n");
 		return -1;
 	}
 
-	rec->bytes_written += size;
+	if (map && map->file)
+		thread->bytes_written += size;
+	else
+		rec->bytes_written += size;
 
 	if (record__output_max_size_exceeded(rec) && !done) {
 		fprintf(stderr, "[ perf record: perf size limit reached (%" PRIu64 " KB),"
 				" stopping session ]\n",
-				rec->bytes_written >> 10);
+				record__bytes_written(rec) >> 10);
 		done = 1;
 	}
 
@@ -541,7 +606,10 @@ static int record__pushfn(struct mmap *map, void *to, void *bf, size_t size)
 		bf   = map->data;
 	}
 
-	rec->samples++;
+	if (thread)
+		thread->samples++;
+	else
+		rec->samples++;
 	return record__write(rec, map, bf, size);
 }
 
@@ -1114,6 +1182,7 @@ static int record__mmap_read_evlist(struct record *rec, struct evlist *evlist,
 	int i;
 	int rc = 0;
 	struct mmap *maps;
+	int nr_mmaps = evlist ? evlist->core.nr_mmaps : 0;
 	int trace_fd = rec->data.file.fd;
 	off_t off = 0;
 
@@ -1124,15 +1193,23 @@ static int record__mmap_read_evlist(struct record *rec, struct evlist *evlist,
 	if (!maps)
 		return 0;
 
+	if (record__threads_enabled(rec)) {
+		/* nothing was read before the threads got their mmaps */
+		if (!thread || overwrite)
+			return 0;
+		nr_mmaps = thread->nr_mmaps;
+	}
+
 	if (overwrite && evlist->bkw_mmap_state != BKW_MMAP_DATA_PENDING)
 		return 0;
 
 	if (record__aio_enabled(rec))
 		off = record__aio_get_pos(trace_fd);
 
-	for (i = 0; i < evlist->core.nr_mmaps; i++) {
+	for (i = 0; i < nr_mmaps; i++) {
 		u64 flush = 0;
-		struct mmap *map = &maps[i];
+		struct mmap *map = record__threads_enabled(rec) ?
+				   thread->maps[i] : &maps[i];
 
 		if (map->core.base) {
 			record__adjust_affinity(rec, map);
@@ -1173,9 +1250,11 @@ static int record__mmap_read_evlist(struct record *rec, struct evlist *evlist,
 
 	/*
 	 * Mark the round finished in case we wrote
-	 * at least one event.
+	 * at least one event. The --threads files have no rounds: they are
+	 * read in parallel, a round in one of them would say nothing about
+	 * the others.
 	 */
-	if (bytes_written != rec->bytes_written)
+	if (bytes_written != rec->bytes_written && !record__threads_enabled(rec))
 		rc = record__write(rec, NULL, &finished_round_event, sizeof(finished_round_event));
 
 	if (overwrite)
@@ -1195,6 +1274,325 @@ static int record__mmap_read_all(struct record *rec, bool synch)
 	return record__mmap_read_evlist(rec, rec->evlist, true, synch);
 }
 
+static struct record_thread *record__cpu_thread(struct record *rec, int cpu)
+{
+	int t;
+
+	for (t = 0; t < rec->nr_threads; t++) {
+		if (test_bit(cpu, rec->thread_data[t].mask.bits))
+			return &rec->thread_data[t];
+	}
+
+	return NULL;
+}
+
+static void record__free_thread_data(struct record *rec)
+{
+	int t;
+
+	for (t = 0; t < rec->nr_threads; t++) {
+		struct record_thread *td = &rec->thread_data[t];
+
+		if (td->ctl_pipe[0] >= 0)
+			close(td->ctl_pipe[0]);
+		if (td->ctl_pipe[1] >= 0)
+			close(td->ctl_pipe[1]);
+		fdarray__exit(&td->pollfd);
+		zfree(&td->maps);
+		bitmap_free(td->mask.bits);
+	}
+
+	zfree(&rec->thread_data);
+	rec->nr_threads = 0;
+	thread = NULL;
+}
+
+/*
+ * One thread per CPU or per NUMA node of the evlist CPUs, each with the
+ * mmaps of its CPUs and the mmap data files of the same index.
+ */
+static int record__alloc_thread_data(struct record *rec)
+{
+	struct evlist *evlist = rec->evlist;
+	struct perf_cpu_map *cpus = evlist->core.cpus;
+	int nr_mmaps = evlist->core.nr_mmaps;
+	struct record_thread *td;
+	int cpu, idx, i, t;
+
+	rec->thread_data = zalloc(perf_cpu_map__nr(cpus) * sizeof(*rec->thread_data));
+	if (!rec->thread_data)
+		return -ENOMEM;
+
+	if (rec->threads_spec == THREADS_SPEC__NUMA)
+		cpu__setup_cpunode_map();
+
+	perf_cpu_map__for_each_cpu(cpu, idx, cpus) {
+		int key = cpu;
+
+		if (cpu < 0) {
+			pr_err("--threads needs per CPU mmaps\n");
+			goto out_free;
+		}
+
+		if (rec->threads_spec == THREADS_SPEC__NUMA)
+			key = cpu__get_node(cpu);
+
+		for (t = 0; t < rec->nr_threads; t++) {
+			if (rec->thread_data[t].key == key)
+				break;
+		}
+
+		td = &rec->thread_data[t];
+		if (t == rec->nr_threads) {
+			td->rec = rec;
+			td->key = key;
+			td->ctlfd_pos = -1;
+			td->ctl_pipe[0] = td->ctl_pipe[1] = -1;
+			fdarray__init(&td->pollfd, 64);
+			rec->nr_threads++;
+
+			td->mask.nbits = cpu__max_cpu();
+			td->mask.bits = bitmap_zalloc(td->mask.nbits);
+			td->maps = zalloc(nr_mmaps * sizeof(*td->maps));
+			if (!td->mask.bits || !td->maps)
+				goto out_free;
+		}
+
+		set_bit(cpu, td->mask.bits);
+	}
+
+	for (i = 0; i < nr_mmaps; i++) {
+		struct mmap *map = &evlist->mmap[i];
+
+		td = record__cpu_thread(rec, map->core.cpu);
+		if (!td) {
+			pr_err("No record thread for the mmap of CPU %d\n", map->core.cpu);
+			goto out_free;
+		}
+
+		td->maps[td->nr_mmaps++] = map;
+		map->file = &rec->data.dir.files[i];
+	}
+
+	if (verbose > 0) {
+		for (t = 0; t < rec->nr_threads; t++) {
+			pr_debug("record thread %d: %d mmaps\n", t,
+				 rec->thread_data[t].nr_mmaps);
+			mmap_cpu_mask__scnprintf(&rec->thread_data[t].mask, "thread");
+		}
+	}
+
+	return 0;
+
+out_free:
+	record__free_thread_data(rec);
+	return -1;
+}
+
+/*
+ * Split the evlist pollfd: the mmap fds go to the thread reading the
+ * mmap, the non mmap ones (wakeup eventfd, control fd) to the main thread.
+ * The other threads get the read end of a pipe to be told to stop.
+ */
+static int record__init_thread_pollfd(struct record *rec)
+{
+	struct evlist *evlist = rec->evlist;
+	struct fdarray *fda = &evlist->core.pollfd;
+	int i, t, pos;
+
+	for (t = 1; t < rec->nr_threads; t++) {
+		struct record_thread *td = &rec->thread_data[t];
+
+		if (pipe(td->ctl_pipe)) {
+			pr_err("Failed to create record thread pipe: %m\n");
+			return -1;
+		}
+
+		pos = fdarray__add(&td->pollfd, td->ctl_pipe[0], POLLIN,
+				   fdarray_flag__nonfilterable);
+		if (pos < 0)
+			return pos;
+	}
+
+	for (i = 0; i < fda->nr; i++) {
+		struct perf_mmap *pmap = fda->priv[i].ptr;
+		struct record_thread *td = &rec->thread_data[0];
+
+		if (!fda->entries[i].events)
+			continue;
+
+		if (pmap) {
+			td = record__cpu_thread(rec, pmap->cpu);
+			if (!td)
+				return -1;
+		}
+
+		pos = fdarray__add(&td->pollfd, fda->entries[i].fd,
+				   fda->entries[i].events, fda->priv[i].flags);
+		if (pos < 0)
+			return pos;
+
+		td->pollfd.priv[pos].ptr = pmap;
+		if (!pmap && i == evlist->ctl_fd.pos)
+			td->ctlfd_pos = pos;
+	}
+
+	return 0;
+}
+
+static int record__poll(struct record *rec)
+{
+	struct evlist *evlist = rec->evlist;
+	int err;
+
+	if (!thread)
+		return evlist__poll(evlist, -1);
+
+	err = fdarray__poll(&thread->pollfd, -1);
+	/* evlist__ctlfd_process() looks at the revents in the evlist pollfd */
+	if (thread->ctlfd_pos >= 0)
+		evlist->core.pollfd.entries[evlist->ctl_fd.pos].revents =
+			thread->pollfd.entries[thread->ctlfd_pos].revents;
+
+	return err;
+}
+
+static int record__filter_pollfd(struct record *rec)
+{
+	if (!thread)
+		return evlist__filter_pollfd(rec->evlist, POLLERR | POLLHUP);
+
+	return fdarray__filter(&thread->pollfd, POLLERR | POLLHUP, NULL, NULL);
+}
+
+static void *record__thread(void *arg)
+{
+	struct record_thread *td = arg;
+	struct record *rec = td->rec;
+	bool draining = false, stop = false;
+
+	thread = td;
+
+	for (;;) {
+		unsigned long long hits = thread->samples;
+
+		if (record__mmap_read_all(rec, false) < 0) {
+			thread->err = -1;
+			done = 1;
+			break;
+		}
+
+		if (hits == thread->samples) {
+			if (done || draining || stop)
+				break;
+
+			if (fdarray__poll(&thread->pollfd, -1) < 0 &&
+			    errno != EINTR) {
+				thread->err = -errno;
+				break;
+			}
+			thread->waking++;
+
+			/* the pipe is the first entry, see record__init_thread_pollfd() */
+			if (thread->pollfd.entries[0].revents & POLLIN)
+				stop = true;
+
+			if (fdarray__filter(&thread->pollfd, POLLERR | POLLHUP,
+					    NULL, NULL) == 0)
+				draining = true;
+		}
+	}
+
+	if (record__mmap_read_all(rec, true) < 0)
+		thread->err = -1;
+
+	return NULL;
+}
+
+static int record__start_threads(struct record *rec)
+{
+	struct record_thread *td = &rec->thread_data[0];
+	sigset_t full, mask;
+	pthread_attr_t attrs;
+	int t, err = 0;
+
+	/* leave the signals to the main thread */
+	sigfillset(&full);
+	if (pthread_sigmask(SIG_SETMASK, &full, &mask)) {
+		pr_err("Failed to block signals: %m\n");
+		return -1;
+	}
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_JOINABLE);
+
+	for (t = 1; t < rec->nr_threads; t++) {
+		td = &rec->thread_data[t];
+
+		pthread_attr_setaffinity_np(&attrs, MMAP_CPU_MASK_BYTES(&td->mask),
+					    (cpu_set_t *)td->mask.bits);
+		err = pthread_create(&td->tid, &attrs, record__thread, td);
+		if (err) {
+			pr_err("Failed to start record thread %d: %s\n", t, strerror(err));
+			err = -err;
+			break;
+		}
+		td->running = true;
+	}
+
+	pthread_attr_destroy(&attrs);
+	pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+	thread = &rec->thread_data[0];
+	sched_setaffinity(0, MMAP_CPU_MASK_BYTES(&thread->mask),
+			  (cpu_set_t *)thread->mask.bits);
+
+	return err;
+}
+
+static int record__stop_threads(struct record *rec, unsigned long *waking)
+{
+	char msg = 0;
+	int t, err = 0;
+
+	for (t = 1; t < rec->nr_threads; t++) {
+		struct record_thread *td = &rec->thread_data[t];
+
+		if (!td->running)
+			continue;
+
+		if (write(td->ctl_pipe[1], &msg, sizeof(msg)) < 0)
+			pr_err("Failed to stop record thread %d: %m\n", t);
+		pthread_join(td->tid, NULL);
+		td->running = false;
+
+		*waking += td->waking;
+		if (td->err)
+			err = td->err;
+	}
+
+	return err;
+}
+
+static int record__setup_threads(struct record *rec)
+{
+	int err;
+
+	err = perf_data__create_dir(&rec->data, rec->evlist->core.nr_mmaps);
+	if (err) {
+		pr_err("Failed to create the data directory files\n");
+		return err;
+	}
+
+	err = record__alloc_thread_data(rec);
+	if (err)
+		return err;
+
+	pr_debug("threads: %s, %d record threads\n",
+		 threads_spec_tags[rec->threads_spec], rec->nr_threads);
+	return 0;
+}
+
 static void record__init_features(struct record *rec)
 {
 	struct perf_session *session = rec->session;
@@ -1221,7 +1619,8 @@ static void record__init_features(struct record *rec)
 	if (!rec->opts.use_clockid)
 		perf_header__clear_feat(&session->header, HEADER_CLOCK_DATA);
 
-	perf_header__clear_feat(&session->header, HEADER_DIR_FORMAT);
+	if (!record__threads_enabled(rec))
+		perf_header__clear_feat(&session->header, HEADER_DIR_FORMAT);
 	if (!record__comp_enabled(rec))
 		perf_header__clear_feat(&session->header, HEADER_COMPRESSED);
 
@@ -1239,6 +1638,8 @@ record__finish_output(struct record *rec)
 
 	rec->session->header.data_size += rec->bytes_written;
 	data->file.size = lseek(perf_data__fd(data), 0, SEEK_CUR);
+	if (record__threads_enabled(rec))
+		perf_data__update_dir(data);
 
 	if (!rec->no_buildid) {
 		process_buildids(rec);
@@ -1658,6 +2059,12 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		return PTR_ERR(session);
 	}
 
+	if (record__threads_enabled(rec) && data->is_pipe) {
+		pr_err("--threads can't write to a pipe.\n");
+		status = -EINVAL;
+		goto out_delete_session;
+	}
+
 	fd = perf_data__fd(data);
 	rec->session = session;
 
@@ -1721,6 +2128,12 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	}
 	session->header.env.comp_mmap_len = session->evlist->core.mmap_len;
 
+	if (record__threads_enabled(rec)) {
+		err = record__setup_threads(rec);
+		if (err)
+			goto out_child;
+	}
+
 	if (rec->opts.kcore) {
 		err = record__kcore_copy(&session->machines.host, data);
 		if (err) {
@@ -1857,11 +2270,19 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		}
 	}
 
+	if (record__threads_enabled(rec)) {
+		err = record__init_thread_pollfd(rec);
+		if (!err)
+			err = record__start_threads(rec);
+		if (err)
+			goto out_child;
+	}
+
 	trigger_ready(&auxtrace_snapshot_trigger);
 	trigger_ready(&switch_output_trigger);
 	perf_hooks__invoke_record_start();
 	for (;;) {
-		unsigned long long hits = rec->samples;
+		unsigned long long hits = record__samples(rec);
 
 		/*
 		 * rec->evlist->bkw_mmap_state is possible to be
@@ -1930,10 +2351,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 				alarm(rec->switch_output.time);
 		}
 
-		if (hits == rec->samples) {
+		if (hits == record__samples(rec)) {
 			if (done || draining)
 				break;
-			err = evlist__poll(rec->evlist, -1);
+			err = record__poll(rec);
 			/*
 			 * Propagate error, only if there's any. Ignore positive
 			 * number of returned events and interrupt error.
@@ -1942,7 +2363,7 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 				err = 0;
 			waking++;
 
-			if (evlist__filter_pollfd(rec->evlist, POLLERR | POLLHUP) == 0)
+			if (record__filter_pollfd(rec) == 0)
 				draining = true;
 		}
 
@@ -1981,6 +2402,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	trigger_off(&auxtrace_snapshot_trigger);
 	trigger_off(&switch_output_trigger);
 
+	err = record__stop_threads(rec, &waking);
+	if (err)
+		goto out_child;
+
 	if (opts->auxtrace_snapshot_on_exit)
 		record__auxtrace_snapshot_exit(rec);
 
@@ -2003,6 +2428,7 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		record__synthesize_workload(rec, true);
 
 out_child:
+	record__stop_threads(rec, &waking);
 	evlist__finalize_ctlfd(rec->evlist);
 	record__mmap_read_all(rec, true);
 	record__aio_mmap_read_sync(rec);
@@ -2075,6 +2501,7 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		close(done_fd);
 #endif
 	zstd_fini(&session->zstd_data);
+	record__free_thread_data(rec);
 	perf_session__delete(session);
 
 	if (!opts->no_bpf_event)
@@ -2188,6 +2615,32 @@ static int record__parse_affinity(const struct option *opt, const char *str, int
 	return 0;
 }
 
+static int record__parse_threads(const struct option *opt, const char *str, int unset)
+{
+	enum record_threads_spec *spec = opt->value;
+	unsigned int s;
+
+	if (unset) {
+		*spec = THREADS_SPEC__NONE;
+		return 0;
+	}
+
+	if (!str) {
+		*spec = THREADS_SPEC__NUMA;
+		return 0;
+	}
+
+	for (s = THREADS_SPEC__CPU; s < ARRAY_SIZE(threads_spec_tags); s++) {
+		if (!strcasecmp(str, threads_spec_tags[s])) {
+			*spec = s;
+			return 0;
+		}
+	}
+
+	pr_err("Unknown --threads spec: %s\n", str);
+	return -1;
+}
+
 static int parse_output_max_size(const struct option *opt,
 				 const char *str, int unset)
 {
@@ -2620,6 +3073,9 @@ static struct option __record_options[] = {
 	OPT_UINTEGER(0, "num-thread-synthesize",
 		     &record.opts.nr_threads_synthesize,
 		     "number of threads to run for event synthesis"),
+	OPT_CALLBACK_OPTARG(0, "threads", &record.threads_spec, NULL, "numa|cpu",
+			    "Read the mmaps from a thread per NUMA node (default) or per CPU, each writing to its own files of a perf.data directory",
+			    record__parse_threads),
 #ifdef HAVE_LIBPFM
 	OPT_CALLBACK(0, "pfm-events", &record.evlist, "event",
 		"libpfm4 event selector. use 'perf list' to list available events",
@@ -2714,6 +3170,31 @@ int cmd_record(int argc, const char **argv)
 	if (rec->opts.kcore)
 		rec->data.is_dir = true;
 
+	if (record__threads_enabled(rec)) {
+		const char *conflict = NULL;
+
+		if (rec->opts.target.per_thread)
+			conflict = "--per-thread";
+		else if (rec->opts.nr_cblocks)
+			conflict = "--aio";
+		else if (rec->opts.comp_level)
+			conflict = "-z";
+		else if (rec->switch_output.set)
+			conflict = "--switch-output";
+		else if (rec->opts.overwrite)
+			conflict = "--overwrite";
+		else if (rec->opts.affinity != PERF_AFFINITY_SYS)
+			conflict = "--affinity";
+
+		if (conflict) {
+			pr_err("--threads can't be used with %s.\n", conflict);
+			err = -EINVAL;
+			goto out_opts;
+		}
+
+		rec->data.is_dir = true;
+	}
+
 	if (rec->opts.comp_level != 0) {
 		pr_debug("Compression enabled, disabling build id collection at the end of the session.\n");
 		rec->no_buildid = true;
@@ -2870,6 +3351,12 @@ int cmd_record(int argc, const char **argv)
 	if (err)
 		goto out;
 
+	if (record__threads_enabled(rec) && rec->opts.full_auxtrace) {
+		pr_err("--threads can't record AUX area tracing data.\n");
+		err = -EINVAL;
+		goto out;
+	}
+
 	/*
 	 * We take all buildids when the file contains
 	 * AUX area tracing data because we do not decode the
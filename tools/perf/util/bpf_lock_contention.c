@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "util/debug.h"
+#include "util/evlist.h"
+#include "util/machine.h"
+#include "util/map.h"
+#include "util/symbol.h"
+#include "util/target.h"
+#include "util/thread_map.h"
+#include "util/cpumap.h"
+#include "util/lock-contention.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <linux/zalloc.h>
+#include <bpf/bpf.h>
+
+#include "bpf_skel/lock_contention.skel.h"
+
+static struct lock_contention_bpf *skel;
+
+/* should be same as bpf_skel/lock_contention.bpf.c */
+struct lock_contention_key {
+	u64 aggr_key;
+};
+
+struct lock_contention_data {
+	u64 total_time;
+	u64 min_time;
+	u64 max_time;
+	u32 count;
+	u32 flags;
+	s32 stack_id;
+	u32 pad;
+};
+
+/* the BPF program and the tracepoint glue at the top of each stack */
+#define CONTENTION_STACK_SKIP	3
+
+int lock_contention_prepare(struct lock_contention *con)
+{
+	int i, fd;
+	int ncpus = 1, ntasks = 1;
+	struct evlist *evlist = con->evlist;
+	struct target *target = con->target;
+
+	skel = lock_contention_bpf__open();
+	if (!skel) {
+		pr_err("Failed to open lock-contention BPF skeleton\n");
+		return -1;
+	}
+
+	if (target__has_cpu(target))
+		ncpus = perf_cpu_map__nr(evlist->core.cpus);
+	if (target__has_task(target))
+		ntasks = perf_thread_map__nr(evlist->core.threads);
+
+	bpf_map__resize(skel->maps.cpu_filter, ncpus);
+	bpf_map__resize(skel->maps.task_filter, ntasks);
+
+	if (lock_contention_bpf__load(skel) < 0) {
+		pr_err("Failed to load lock-contention BPF skeleton\n");
+		goto out_destroy;
+	}
+
+	if (target__has_cpu(target)) {
+		u32 cpu;
+		u8 val = 1;
+
+		skel->bss->has_cpu = 1;
+		fd = bpf_map__fd(skel->maps.cpu_filter);
+
+		for (i = 0; i < ncpus; i++) {
+			cpu = evlist->core.cpus->map[i];
+			bpf_map_update_elem(fd, &cpu, &val, BPF_ANY);
+		}
+	}
+
+	if (target__has_task(target)) {
+		u32 pid;
+		u8 val = 1;
+
+		skel->bss->has_task = 1;
+		fd = bpf_map__fd(skel->maps.task_filter);
+
+		for (i = 0; i < ntasks; i++) {
+			pid = perf_thread_map__pid(evlist->core.threads, i);
+			bpf_map_update_elem(fd, &pid, &val, BPF_ANY);
+		}
+	}
+
+	if (target__none(target) && evlist->workload.pid > 0) {
+		u32 pid = evlist->workload.pid;
+		u8 val = 1;
+
+		skel->bss->has_task = 1;
+		fd = bpf_map__fd(skel->maps.task_filter);
+		bpf_map_update_elem(fd, &pid, &val, BPF_ANY);
+	}
+
+	skel->bss->aggr_by_addr = con->aggr_by_addr;
+
+	if (lock_contention_bpf__attach(skel) < 0) {
+		pr_err("Failed to attach lock-contention BPF skeleton, "
+		       "does the kernel have the lock:contention_begin tracepoint?\n");
+		goto out_destroy;
+	}
+	return 0;
+
+out_destroy:
+	lock_contention_bpf__destroy(skel);
+	skel = NULL;
+	return -1;
+}
+
+int lock_contention_start(void)
+{
+	skel->bss->enabled = 1;
+	return 0;
+}
+
+int lock_contention_stop(void)
+{
+	skel->bss->enabled = 0;
+	return 0;
+}
+
+static u64 sched_text_start, sched_text_end;
+static u64 lock_text_start, lock_text_end;
+
+static u64 kernel_symbol_addr(struct machine *machine, const char *name)
+{
+	struct symbol *sym;
+	struct map *kmap;
+
+	sym = machine__find_kernel_symbol_by_name(machine, name, &kmap);
+	if (!sym)
+		return 0;
+	return kmap->unmap_ip(kmap, sym->start);
+}
+
+/* the slow paths of the lock functions aren't interesting as callers */
+static bool is_lock_function(struct machine *machine, u64 addr)
+{
+	struct symbol *sym;
+	struct map *kmap;
+
+	if (!sched_text_start) {
+		sched_text_start = kernel_symbol_addr(machine, "__sched_text_start");
+		sched_text_end = kernel_symbol_addr(machine, "__sched_text_end");
+		lock_text_start = kernel_symbol_addr(machine, "__lock_text_start");
+		lock_text_end = kernel_symbol_addr(machine, "__lock_text_end");
+	}
+
+	/* mutex and rwsem functions are in sched text */
+	if (sched_text_start <= addr && addr < sched_text_end)
+		return true;
+
+	/* spinlock and rwlock functions are in lock text */
+	if (lock_text_start <= addr && addr < lock_text_end)
+		return true;
+
+	/* queued_spin_lock_slowpath() and friends are in neither */
+	sym = machine__find_kernel_symbol(machine, addr, &kmap);
+	return sym && strstr(sym->name, "_slowpath");
+}
+
+static char *lock_contention_name(struct machine *machine, u64 addr)
+{
+	struct symbol *sym;
+	struct map *kmap;
+	char *name = NULL;
+	int ret;
+
+	sym = machine__find_kernel_symbol(machine, addr, &kmap);
+	if (sym) {
+		u64 offset = kmap->map_ip(kmap, addr) - sym->start;
+
+		if (offset)
+			ret = asprintf(&name, "%s+%#" PRIx64, sym->name, offset);
+		else
+			ret = asprintf(&name, "%s", sym->name);
+	} else {
+		ret = asprintf(&name, "%#" PRIx64, addr);
+	}
+
+	return ret < 0 ? NULL : name;
+}
+
+int lock_contention_read(struct lock_contention *con)
+{
+	int fd, stack;
+	struct lock_contention_key prev_key, key;
+	struct lock_contention_data data;
+	struct lock_stat *st;
+	struct machine *machine = con->machine;
+	u64 stack_trace[CONTENTION_STACK_DEPTH];
+	void *prev = NULL;
+
+	fd = bpf_map__fd(skel->maps.lock_stat);
+	stack = bpf_map__fd(skel->maps.stacks);
+
+	con->lost = skel->bss->lost;
+
+	while (!bpf_map_get_next_key(fd, prev, &key)) {
+		u64 addr;
+		char *name;
+		int idx;
+
+		prev_key = key;
+		prev = &prev_key;
+
+		if (bpf_map_lookup_elem(fd, &key, &data) < 0)
+			continue;
+
+		if (con->aggr_by_addr) {
+			addr = key.aggr_key;
+		} else {
+			if (data.stack_id < 0 ||
+			    bpf_map_lookup_elem(stack, &data.stack_id, stack_trace) < 0)
+				continue;
+
+			/* skip BPF + lock internal functions */
+			idx = CONTENTION_STACK_SKIP;
+			while (idx < CONTENTION_STACK_DEPTH - 1 &&
+			       is_lock_function(machine, stack_trace[idx]))
+				idx++;
+
+			addr = stack_trace[idx];
+		}
+
+		name = lock_contention_name(machine, addr);
+		if (!name)
+			return -1;
+
+		/* different stacks can have the same caller, merge them */
+		st = lock_stat_findnew((void *)(unsigned long)addr, name);
+		free(name);
+		if (!st)
+			return -1;
+
+		st->nr_contended += data.count;
+		st->wait_time_total += data.total_time;
+		if (st->wait_time_max < data.max_time)
+			st->wait_time_max = data.max_time;
+		if (st->wait_time_min > data.min_time)
+			st->wait_time_min = data.min_time;
+		st->avg_wait_time = st->wait_time_total / st->nr_contended;
+		st->flags = data.flags;
+	}
+
+	return 0;
+}
+
+int lock_contention_finish(void)
+{
+	if (skel) {
+		skel->bss->enabled = 0;
+		lock_contention_bpf__destroy(skel);
+		skel = NULL;
+	}
+
+	return 0;
+}
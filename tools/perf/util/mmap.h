@@ -16,6 +16,7 @@
 #include "event.h"
 
 struct aiocb;
+struct perf_data_file;
 
 struct mmap_cpu_mask {
 	unsigned long *bits;
@@ -44,6 +45,7 @@ struct mmap {
 	struct mmap_cpu_mask	affinity_mask;
 	void		*data;
 	int		comp_level;
+	struct perf_data_file	*file;	/* own output file, 'perf record --threads' */
 };
 
 struct mmap_params {
@@ -15,6 +15,10 @@
 #define MADV_PAGEOUT 21
 #endif
 
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
 #define BASE_ADDR ((void *)(1UL << 30))
 static unsigned long hpage_pmd_size;
 static unsigned long page_size;
@@ -997,6 +1001,47 @@ static void collapse_max_ptes_shared()
 	munmap(p, hpage_pmd_size);
 }
 
+static void madvise_collapse_full(void)
+{
+	void *p;
+
+	p = alloc_mapping();
+	fill_memory(p, 0, hpage_pmd_size);
+	printf("Collapse fully populated PTE table with MADV_COLLAPSE...");
+	if (madvise(p, hpage_pmd_size, MADV_COLLAPSE))
+		fail("Fail: madvise");
+	else if (check_huge(p))
+		success("OK");
+	else
+		fail("Fail");
+	validate_memory(p, 0, hpage_pmd_size);
+	munmap(p, hpage_pmd_size);
+}
+
+static void madvise_collapse_max_ptes_none(void)
+{
+	int max_ptes_none = hpage_pmd_nr / 2;
+	struct settings settings = default_settings;
+	void *p;
+
+	settings.khugepaged.max_ptes_none = max_ptes_none;
+	write_settings(&settings);
+
+	p = alloc_mapping();
+	fill_memory(p, 0, (hpage_pmd_nr - max_ptes_none - 1) * page_size);
+	printf("MADV_COLLAPSE ignores max_ptes_none...");
+	if (madvise(p, hpage_pmd_size, MADV_COLLAPSE))
+		fail("Fail: madvise");
+	else if (check_huge(p))
+		success("OK");
+	else
+		fail("Fail");
+	validate_memory(p, 0, (hpage_pmd_nr - max_ptes_none - 1) * page_size);
+
+	munmap(p, hpage_pmd_size);
+	write_settings(&default_settings);
+}
+
 int main(void)
 {
 	setbuf(stdout, NULL);
@@ -1026,6 +1071,8 @@ int main(void)
 	collapse_fork();
 	collapse_fork_compound();
 	collapse_max_ptes_shared();
+	madvise_collapse_full();
+	madvise_collapse_max_ptes_none();
 
 	restore_settings(0);
 }
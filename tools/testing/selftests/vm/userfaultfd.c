@@ -1440,6 +1440,63 @@ static void userfaultfd_pagemap_test(unsigned int test_pgsize)
 	printf("done\n");
 }
 
+/*
+ * Write protect faults are resolved by the kernel in async mode, the pages
+ * written since UFFDIO_WRITEPROTECT are the ones that lost the uffd-wp bit.
+ */
+static int userfaultfd_wp_async_test(void)
+{
+	struct uffdio_register uffdio_register;
+	uint64_t features, value;
+	unsigned long p;
+	int pagemap_fd;
+
+	printf("testing async uffd-wp: ");
+	fflush(stdout);
+
+	features = UFFD_FEATURE_WP_ASYNC;
+	uffd_test_ctx_init_ext(&features);
+	/* If kernel reports required features aren't supported, skip test. */
+	if (!(features & UFFD_FEATURE_WP_ASYNC)) {
+		printf("skipping test due to lack of feature support\n");
+		fflush(stdout);
+		return 0;
+	}
+
+	uffdio_register.range.start = (unsigned long)area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register))
+		err("register failure");
+	if (!(uffdio_register.ioctls & (1 << _UFFDIO_WRITEPROTECT)))
+		err("unexpected missing ioctl(s)");
+
+	memset(area_dst, 1, nr_pages * page_size);
+	wp_range(uffd, (unsigned long)area_dst, nr_pages * page_size, true);
+
+	pagemap_fd = pagemap_open();
+	for (p = 0; p < nr_pages; p++) {
+		value = pagemap_read_vaddr(pagemap_fd, area_dst + p * page_size);
+		pagemap_check_wp(value, true);
+	}
+
+	/* None of these may block waiting for a message to be read */
+	for (p = 0; p < nr_pages; p += 2)
+		*(area_dst + p * page_size) = 2;
+
+	for (p = 0; p < nr_pages; p++) {
+		value = pagemap_read_vaddr(pagemap_fd, area_dst + p * page_size);
+		pagemap_check_wp(value, p % 2);
+		if (*(area_dst + p * page_size) != (p % 2 ? 1 : 2))
+			err("unexpected page contents after async wp fault");
+	}
+
+	close(pagemap_fd);
+	printf("done.\n");
+
+	return 0;
+}
+
 static int userfaultfd_stress(void)
 {
 	void *area;
@@ -1585,7 +1642,8 @@ static int userfaultfd_stress(void)
 	}
 
 	return userfaultfd_zeropage_test() || userfaultfd_sig_test()
-		|| userfaultfd_events_test() || userfaultfd_minor_test();
+		|| userfaultfd_events_test() || userfaultfd_minor_test()
+		|| userfaultfd_wp_async_test();
 }
 
 /*
@@ -19,6 +19,12 @@
 
 static struct kmem_cache *async_pf_cache;
 
+/*
+ * The faults can block for long, on swap-in or on userspace resolving them
+ * through userfaultfd, so don't tie them to the CPU that the vCPU runs on.
+ */
+static struct workqueue_struct *async_pf_wq;
+
 int kvm_async_pf_init(void)
 {
 	async_pf_cache = KMEM_CACHE(kvm_async_pf, 0);
@@ -26,11 +32,21 @@ int kvm_async_pf_init(void)
 	if (!async_pf_cache)
 		return -ENOMEM;
 
+	async_pf_wq = alloc_workqueue("kvm-async-pf", WQ_UNBOUND | WQ_HIGHPRI,
+				      0);
+	if (!async_pf_wq) {
+		kmem_cache_destroy(async_pf_cache);
+		async_pf_cache = NULL;
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
 void kvm_async_pf_deinit(void)
 {
+	destroy_workqueue(async_pf_wq);
+	async_pf_wq = NULL;
 	kmem_cache_destroy(async_pf_cache);
 	async_pf_cache = NULL;
 }
@@ -134,9 +150,61 @@ void kvm_clear_async_pf_completion_queue(struct kvm_vcpu *vcpu)
 	vcpu->async_pf.queued = 0;
 }
 
-void kvm_check_async_pf_completion(struct kvm_vcpu *vcpu)
+/*
+ * If several faults have completed and none is in flight anymore, the guest
+ * doesn't need a "page ready" event for each of them, which it would have to
+ * acknowledge one by one.  A single broadcast wakeup lets all the waiting
+ * tasks retry their access, and all of them will find their page.
+ */
+static bool kvm_async_pf_can_batch(struct kvm_vcpu *vcpu)
 {
 	struct kvm_async_pf *work;
+	u32 done = 0;
+
+	if (IS_ENABLED(CONFIG_KVM_ASYNC_PF_SYNC))
+		return false;
+
+	spin_lock(&vcpu->async_pf.lock);
+	list_for_each_entry(work, &vcpu->async_pf.done, link) {
+		if (work->wakeup_all) {
+			done = 0;
+			break;
+		}
+		done++;
+	}
+	spin_unlock(&vcpu->async_pf.lock);
+
+	/* Only this vCPU queues faults, so none can be added meanwhile */
+	return done > 1 && done == vcpu->async_pf.queued;
+}
+
+static void kvm_async_pf_queue_wakeup_all(struct kvm_vcpu *vcpu,
+					  struct kvm_async_pf *work)
+{
+	bool first;
+
+	work->wakeup_all = true;
+	INIT_LIST_HEAD(&work->queue); /* for list_del to work */
+
+	spin_lock(&vcpu->async_pf.lock);
+	first = list_empty(&vcpu->async_pf.done);
+	list_add_tail(&work->link, &vcpu->async_pf.done);
+	spin_unlock(&vcpu->async_pf.lock);
+
+	if (!IS_ENABLED(CONFIG_KVM_ASYNC_PF_SYNC) && first)
+		kvm_arch_async_page_present_queued(vcpu);
+
+	vcpu->async_pf.queued++;
+}
+
+void kvm_check_async_pf_completion(struct kvm_vcpu *vcpu)
+{
+	struct kvm_async_pf *work, *wakeup = NULL;
+	bool notify = false;
+
+	/* Without the broadcast wakeup, the waiting tasks would never wake */
+	if (kvm_async_pf_can_batch(vcpu))
+		wakeup = kmem_cache_zalloc(async_pf_cache, GFP_ATOMIC);
 
 	while (!list_empty_careful(&vcpu->async_pf.done) &&
 	      kvm_arch_can_dequeue_async_page_present(vcpu)) {
@@ -146,6 +214,12 @@ void kvm_check_async_pf_completion(struct kvm_vcpu *vcpu)
 		list_del(&work->link);
 		spin_unlock(&vcpu->async_pf.lock);
 
+		/* The guest is notified by the broadcast wakeup below */
+		if (wakeup) {
+			notify |= work->notpresent_injected;
+			work->notpresent_injected = false;
+		}
+
 		kvm_arch_async_page_ready(vcpu, work);
 		if (!IS_ENABLED(CONFIG_KVM_ASYNC_PF_SYNC))
 			kvm_arch_async_page_present(vcpu, work);
@@ -154,6 +228,11 @@ void kvm_check_async_pf_completion(struct kvm_vcpu *vcpu)
 		vcpu->async_pf.queued--;
 		kmem_cache_free(async_pf_cache, work);
 	}
+
+	if (notify)
+		kvm_async_pf_queue_wakeup_all(vcpu, wakeup);
+	else if (wakeup)
+		kmem_cache_free(async_pf_cache, wakeup);
 }
 
 /*
@@ -195,7 +274,7 @@ bool kvm_setup_async_pf(struct kvm_vcpu *vcpu, gpa_t cr2_or_gpa,
 	vcpu->async_pf.queued++;
 	work->notpresent_injected = kvm_arch_async_page_not_present(vcpu, work);
 
-	schedule_work(&work->work);
+	queue_work(async_pf_wq, &work->work);
 
 	return true;
 }
@@ -203,7 +282,6 @@ bool kvm_setup_async_pf(struct kvm_vcpu *vcpu, gpa_t cr2_or_gpa,
 int kvm_async_pf_wakeup_all(struct kvm_vcpu *vcpu)
 {
 	struct kvm_async_pf *work;
-	bool first;
 
 	if (!list_empty_careful(&vcpu->async_pf.done))
 		return 0;
@@ -212,17 +290,6 @@ int kvm_async_pf_wakeup_all(struct kvm_vcpu *vcpu)
 	if (!work)
 		return -ENOMEM;
 
-	work->wakeup_all = true;
-	INIT_LIST_HEAD(&work->queue); /* for list_del to work */
-
-	spin_lock(&vcpu->async_pf.lock);
-	first = list_empty(&vcpu->async_pf.done);
-	list_add_tail(&work->link, &vcpu->async_pf.done);
-	spin_unlock(&vcpu->async_pf.lock);
-
-	if (!IS_ENABLED(CONFIG_KVM_ASYNC_PF_SYNC) && first)
-		kvm_arch_async_page_present_queued(vcpu);
-
-	vcpu->async_pf.queued++;
+	kvm_async_pf_queue_wakeup_all(vcpu, work);
 	return 0;
 }
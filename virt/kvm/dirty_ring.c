@@ -7,6 +7,7 @@
 #include <linux/kvm_host.h>
 #include <linux/kvm.h>
 #include <linux/vmalloc.h>
+#include <linux/eventfd.h>
 #include <linux/kvm_dirty_ring.h>
 #include <trace/events/kvm.h>
 #include "mmu_lock.h"
@@ -40,6 +41,10 @@ struct kvm_dirty_ring *kvm_dirty_ring_get(struct kvm *kvm)
 {
 	struct kvm_vcpu *vcpu = kvm_get_running_vcpu();
 
+	/* e.g. an emulated device writing guest memory from a kernel thread */
+	if (!vcpu)
+		return NULL;
+
 	WARN_ON_ONCE(vcpu->kvm != kvm);
 
 	return &vcpu->dirty_ring;
@@ -77,6 +82,8 @@ int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size)
 	ring->dirty_index = 0;
 	ring->reset_index = 0;
 	ring->index = index;
+	mutex_init(&ring->reset_lock);
+	ring->soft_full_eventfd = NULL;
 
 	return 0;
 }
@@ -108,6 +115,8 @@ int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
 	/* This is only needed to make compilers happy */
 	cur_slot = cur_offset = mask = 0;
 
+	mutex_lock(&ring->reset_lock);
+
 	while (true) {
 		entry = &ring->dirty_gfns[ring->reset_index & (ring->size - 1)];
 
@@ -153,6 +162,8 @@ int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
 
 	trace_kvm_dirty_ring_reset(ring);
 
+	mutex_unlock(&ring->reset_lock);
+
 	return count;
 }
 
@@ -175,6 +186,14 @@ void kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
 	kvm_dirty_gfn_set_dirtied(entry);
 	ring->dirty_index++;
 	trace_kvm_dirty_ring_push(ring, slot, offset);
+
+	/*
+	 * Pushes add one entry at a time and resets only remove some, so the
+	 * ring can't get soft full without passing through the limit.
+	 */
+	if (ring->soft_full_eventfd &&
+	    kvm_dirty_ring_used(ring) == ring->soft_limit)
+		eventfd_signal(ring->soft_full_eventfd, 1);
 }
 
 struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
@@ -182,8 +201,32 @@ struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
 	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
 }
 
+int kvm_dirty_ring_set_eventfd(struct kvm_dirty_ring *ring, int fd)
+{
+	struct eventfd_ctx *eventfd = NULL;
+
+	if (fd >= 0) {
+		eventfd = eventfd_ctx_fdget(fd);
+		if (IS_ERR(eventfd))
+			return PTR_ERR(eventfd);
+	}
+
+	if (ring->soft_full_eventfd)
+		eventfd_ctx_put(ring->soft_full_eventfd);
+	ring->soft_full_eventfd = eventfd;
+
+	/* Don't lose the wakeup if the ring filled up before */
+	if (eventfd && kvm_dirty_ring_soft_full(ring))
+		eventfd_signal(eventfd, 1);
+
+	return 0;
+}
+
 void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
 {
+	if (ring->soft_full_eventfd)
+		eventfd_ctx_put(ring->soft_full_eventfd);
+	ring->soft_full_eventfd = NULL;
 	vfree(ring->dirty_gfns);
 	ring->dirty_gfns = NULL;
 }
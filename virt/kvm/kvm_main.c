@@ -93,6 +93,10 @@ unsigned int halt_poll_ns_shrink;
 module_param(halt_poll_ns_shrink, uint, 0644);
 EXPORT_SYMBOL_GPL(halt_poll_ns_shrink);
 
+/* Poll only if the wakeup is predicted within the halt_poll_ns budget */
+static bool halt_poll_predict;
+module_param(halt_poll_predict, bool, 0644);
+
 /*
  * Ordering of locks:
  *
@@ -1793,7 +1797,8 @@ int __kvm_set_memory_region(struct kvm *kvm,
 	/* Allocate/free page dirty bitmap as needed */
 	if (!(new.flags & KVM_MEM_LOG_DIRTY_PAGES))
 		new.dirty_bitmap = NULL;
-	else if (!new.dirty_bitmap && !kvm->dirty_ring_size) {
+	else if (!new.dirty_bitmap &&
+		 (!kvm->dirty_ring_size || kvm->dirty_ring_with_bitmap)) {
 		r = kvm_alloc_dirty_bitmap(&new);
 		if (r)
 			return r;
@@ -1854,8 +1859,11 @@ int kvm_get_dirty_log(struct kvm *kvm, struct kvm_dirty_log *log,
 	unsigned long n;
 	unsigned long any = 0;
 
-	/* Dirty ring tracking is exclusive to dirty log tracking */
-	if (kvm->dirty_ring_size)
+	/*
+	 * Dirty ring tracking is exclusive to dirty log tracking, unless
+	 * the bitmap collects the writes done outside of vcpu context.
+	 */
+	if (kvm->dirty_ring_size && !kvm->dirty_ring_with_bitmap)
 		return -ENXIO;
 
 	*memslot = NULL;
@@ -1919,8 +1927,11 @@ static int kvm_get_dirty_log_protect(struct kvm *kvm, struct kvm_dirty_log *log)
 	unsigned long *dirty_bitmap_buffer;
 	bool flush;
 
-	/* Dirty ring tracking is exclusive to dirty log tracking */
-	if (kvm->dirty_ring_size)
+	/*
+	 * Dirty ring tracking is exclusive to dirty log tracking, unless
+	 * the bitmap collects the writes done outside of vcpu context.
+	 */
+	if (kvm->dirty_ring_size && !kvm->dirty_ring_with_bitmap)
 		return -ENXIO;
 
 	as_id = log->slot >> 16;
@@ -2031,8 +2042,11 @@ static int kvm_clear_dirty_log_protect(struct kvm *kvm,
 	unsigned long *dirty_bitmap_buffer;
 	bool flush;
 
-	/* Dirty ring tracking is exclusive to dirty log tracking */
-	if (kvm->dirty_ring_size)
+	/*
+	 * Dirty ring tracking is exclusive to dirty log tracking, unless
+	 * the bitmap collects the writes done outside of vcpu context.
+	 */
+	if (kvm->dirty_ring_size && !kvm->dirty_ring_with_bitmap)
 		return -ENXIO;
 
 	as_id = log->slot >> 16;
@@ -3140,11 +3154,18 @@ void mark_page_dirty_in_slot(struct kvm *kvm,
 	if (memslot && kvm_slot_dirty_track_enabled(memslot)) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
 		u32 slot = (memslot->as_id << 16) | memslot->id;
+		struct kvm_dirty_ring *ring = NULL;
 
 		if (kvm->dirty_ring_size)
-			kvm_dirty_ring_push(kvm_dirty_ring_get(kvm),
-					    slot, rel_gfn);
-		else
+			ring = kvm_dirty_ring_get(kvm);
+
+		/*
+		 * Without a running vcpu there is no ring to push to, and
+		 * the write is only logged if userspace enabled the bitmap.
+		 */
+		if (ring)
+			kvm_dirty_ring_push(ring, slot, rel_gfn);
+		else if (!WARN_ON_ONCE(!memslot->dirty_bitmap))
 			set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
 }
@@ -3232,6 +3253,39 @@ static void shrink_halt_poll_ns(struct kvm_vcpu *vcpu)
 	trace_kvm_halt_poll_ns_shrink(vcpu->vcpu_id, val, old);
 }
 
+u64 __weak kvm_arch_vcpu_timer_remaining_ns(struct kvm_vcpu *vcpu)
+{
+	return U64_MAX;
+}
+
+/*
+ * The vCPU is woken up either by its timer, whose expiry is known, or by an
+ * interrupt, whose arrival is predicted from the average of the previous
+ * wakeup times.  Don't poll at all if the wakeup is not expected within the
+ * polling budget, or poll a bit past the prediction if it is.
+ */
+static unsigned int kvm_vcpu_predict_poll_ns(struct kvm_vcpu *vcpu)
+{
+	unsigned int max_poll_ns = vcpu->kvm->max_halt_poll_ns;
+	u64 predict_ns;
+
+	predict_ns = min(kvm_arch_vcpu_timer_remaining_ns(vcpu),
+			 vcpu->halt_wakeup_avg_ns);
+	if (predict_ns > max_poll_ns)
+		return 0;
+
+	return clamp_t(u64, predict_ns + predict_ns / 4,
+		       READ_ONCE(halt_poll_ns_grow_start), max_poll_ns);
+}
+
+static void update_halt_wakeup_avg(struct kvm_vcpu *vcpu, u64 block_ns)
+{
+	/* A long sleep only needs to push the average past the budget */
+	block_ns = min(block_ns, 2 * (u64)vcpu->kvm->max_halt_poll_ns);
+
+	vcpu->halt_wakeup_avg_ns = (vcpu->halt_wakeup_avg_ns * 7 + block_ns) / 8;
+}
+
 static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
 {
 	int ret = -EINTR;
@@ -3269,15 +3323,24 @@ update_halt_poll_stats(struct kvm_vcpu *vcpu, u64 poll_ns, bool waited)
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
 	bool halt_poll_allowed = !kvm_arch_no_poll(vcpu);
+	bool predict = READ_ONCE(halt_poll_predict);
 	ktime_t start, cur, poll_end;
+	unsigned int poll_ns = 0;
 	bool waited = false;
 	u64 block_ns;
 
 	kvm_arch_vcpu_blocking(vcpu);
 
+	if (halt_poll_allowed) {
+		poll_ns = predict ? kvm_vcpu_predict_poll_ns(vcpu) :
+				    vcpu->halt_poll_ns;
+		if (!poll_ns)
+			++vcpu->stat.generic.halt_poll_skipped;
+	}
+
 	start = cur = poll_end = ktime_get();
-	if (vcpu->halt_poll_ns && halt_poll_allowed) {
-		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
+	if (poll_ns) {
+		ktime_t stop = ktime_add_ns(ktime_get(), poll_ns);
 
 		++vcpu->stat.generic.halt_attempted_poll;
 		do {
@@ -3332,7 +3395,15 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 		vcpu, ktime_to_ns(ktime_sub(poll_end, start)), waited);
 
 	if (halt_poll_allowed) {
-		if (!vcpu_valid_wakeup(vcpu)) {
+		/* Polling would have caught this wakeup */
+		if (!poll_ns && vcpu_valid_wakeup(vcpu) &&
+		    block_ns <= vcpu->kvm->max_halt_poll_ns)
+			++vcpu->stat.generic.halt_poll_missed;
+
+		if (predict) {
+			if (vcpu_valid_wakeup(vcpu))
+				update_halt_wakeup_avg(vcpu, block_ns);
+		} else if (!vcpu_valid_wakeup(vcpu)) {
 			shrink_halt_poll_ns(vcpu);
 		} else if (vcpu->kvm->max_halt_poll_ns) {
 			if (block_ns <= vcpu->halt_poll_ns)
@@ -3794,6 +3865,25 @@ static int kvm_vcpu_ioctl_get_stats_fd(struct kvm_vcpu *vcpu)
 	return fd;
 }
 
+static int kvm_vcpu_ioctl_reset_dirty_ring(struct kvm_vcpu *vcpu)
+{
+	struct kvm *kvm = vcpu->kvm;
+	int cleared, idx;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	/* The memslots are only looked up, no need for slots_lock */
+	idx = srcu_read_lock(&kvm->srcu);
+	cleared = kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+	srcu_read_unlock(&kvm->srcu, idx);
+
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	return cleared;
+}
+
 static long kvm_vcpu_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -3817,6 +3907,13 @@ static long kvm_vcpu_ioctl(struct file *filp,
 	if (r != -ENOIOCTLCMD)
 		return r;
 
+	/*
+	 * The dirty ring is reset while the vcpu keeps running, so don't
+	 * wait for KVM_RUN to drop vcpu->mutex.  The ring has its own lock.
+	 */
+	if (ioctl == KVM_RESET_DIRTY_RING)
+		return kvm_vcpu_ioctl_reset_dirty_ring(vcpu);
+
 	if (mutex_lock_killable(&vcpu->mutex))
 		return -EINTR;
 	switch (ioctl) {
@@ -3995,6 +4092,24 @@ static long kvm_vcpu_ioctl(struct file *filp,
 		r = kvm_vcpu_ioctl_get_stats_fd(vcpu);
 		break;
 	}
+	case KVM_DIRTY_RING_EVENTFD: {
+		struct kvm_dirty_ring_eventfd ring_eventfd;
+
+		r = -EFAULT;
+		if (copy_from_user(&ring_eventfd, argp, sizeof(ring_eventfd)))
+			goto out;
+		r = -EINVAL;
+		if (!vcpu->kvm->dirty_ring_size ||
+		    (ring_eventfd.flags & ~KVM_DIRTY_RING_EVENTFD_FLAG_DEASSIGN))
+			goto out;
+		if (ring_eventfd.flags & KVM_DIRTY_RING_EVENTFD_FLAG_DEASSIGN)
+			ring_eventfd.fd = -1;
+		else if (ring_eventfd.fd < 0)
+			goto out;
+		r = kvm_dirty_ring_set_eventfd(&vcpu->dirty_ring,
+					       ring_eventfd.fd);
+		break;
+	}
 	default:
 		r = kvm_arch_vcpu_ioctl(filp, ioctl, arg);
 	}
@@ -4256,6 +4371,9 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #else
 		return 0;
 #endif
+	case KVM_CAP_DIRTY_LOG_RING_VCPU_RESET:
+	case KVM_CAP_DIRTY_LOG_RING_WITH_BITMAP:
+		return KVM_DIRTY_LOG_PAGE_OFFSET > 0;
 	case KVM_CAP_BINARY_STATS_FD:
 		return 1;
 	default:
@@ -4302,6 +4420,32 @@ static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u32 size)
 	return r;
 }
 
+static int kvm_vm_ioctl_enable_dirty_log_ring_bitmap(struct kvm *kvm)
+{
+	struct kvm_memory_slot *memslot;
+	int i, r = 0;
+
+	if (!KVM_DIRTY_LOG_PAGE_OFFSET || !kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+
+	/* The slots already logging dirty pages have no bitmap */
+	for (i = 0; i < KVM_ADDRESS_SPACE_NUM; i++) {
+		kvm_for_each_memslot(memslot, __kvm_memslots(kvm, i)) {
+			if (memslot->flags & KVM_MEM_LOG_DIRTY_PAGES) {
+				r = -EBUSY;
+				goto out;
+			}
+		}
+	}
+
+	kvm->dirty_ring_with_bitmap = true;
+out:
+	mutex_unlock(&kvm->slots_lock);
+	return r;
+}
+
 static int kvm_vm_ioctl_reset_dirty_pages(struct kvm *kvm)
 {
 	int i;
@@ -4356,6 +4500,10 @@ static int kvm_vm_ioctl_enable_cap_generic(struct kvm *kvm,
 	}
 	case KVM_CAP_DIRTY_LOG_RING:
 		return kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap->args[0]);
+	case KVM_CAP_DIRTY_LOG_RING_WITH_BITMAP:
+		if (cap->flags || cap->args[0])
+			return -EINVAL;
+		return kvm_vm_ioctl_enable_dirty_log_ring_bitmap(kvm);
 	default:
 		return kvm_vm_ioctl_enable_cap(kvm, cap);
 	}